@@ -29,6 +29,7 @@ libcompiler_rt_common_SRC_FILES := \
   lib/absvti2.c \
   lib/adddf3.c \
   lib/addsf3.c \
+  lib/addtf3.c \
   lib/addvdi3.c \
   lib/addvsi3.c \
   lib/addvti3.c \
@@ -43,6 +44,8 @@ libcompiler_rt_common_SRC_FILES := \
   lib/cmpti2.c \
   lib/comparedf2.c \
   lib/comparesf2.c \
+  lib/comparetf2.c \
+  lib/cpu_model.c \
   lib/ctzdi2.c \
   lib/ctzsi2.c \
   lib/ctzti2.c \
@@ -54,11 +57,15 @@ libcompiler_rt_common_SRC_FILES := \
   lib/divsc3.c \
   lib/divsf3.c \
   lib/divsi3.c \
+  lib/divtf3.c \
   lib/divti3.c \
   lib/divxc3.c \
   lib/enable_execute_stack.c \
   lib/eprintf.c \
+  lib/extenddftf2.c \
+  lib/extendhfsf2.c \
   lib/extendsfdf2.c \
+  lib/extendsftf2.c \
   lib/ffsdi2.c \
   lib/ffsti2.c \
   lib/fixdfdi.c \
@@ -67,12 +74,16 @@ libcompiler_rt_common_SRC_FILES := \
   lib/fixsfdi.c \
   lib/fixsfsi.c \
   lib/fixsfti.c \
+  lib/fixtfdi.c \
+  lib/fixtfsi.c \
   lib/fixunsdfdi.c \
   lib/fixunsdfsi.c \
   lib/fixunsdfti.c \
   lib/fixunssfdi.c \
   lib/fixunssfsi.c \
   lib/fixunssfti.c \
+  lib/fixunstfdi.c \
+  lib/fixunstfsi.c \
   lib/fixunsxfdi.c \
   lib/fixunsxfsi.c \
   lib/fixunsxfti.c \
@@ -80,17 +91,21 @@ libcompiler_rt_common_SRC_FILES := \
   lib/fixxfti.c \
   lib/floatdidf.c \
   lib/floatdisf.c \
+  lib/floatditf.c \
   lib/floatdixf.c \
   lib/floatsidf.c \
   lib/floatsisf.c \
+  lib/floatsitf.c \
   lib/floattidf.c \
   lib/floattisf.c \
   lib/floattixf.c \
   lib/floatundidf.c \
   lib/floatundisf.c \
+  lib/floatunditf.c \
   lib/floatundixf.c \
   lib/floatunsidf.c \
   lib/floatunsisf.c \
+  lib/floatunsitf.c \
   lib/floatuntidf.c \
   lib/floatuntisf.c \
   lib/floatuntixf.c \
@@ -108,6 +123,7 @@ libcompiler_rt_common_SRC_FILES := \
   lib/muloti4.c \
   lib/mulsc3.c \
   lib/mulsf3.c \
+  lib/multf3.c \
   lib/multi3.c \
   lib/mulvdi3.c \
   lib/mulvsi3.c \
@@ -124,6 +140,7 @@ libcompiler_rt_common_SRC_FILES := \
   lib/paritysi2.c \
   lib/parityti2.c \
   lib/popcountdi2.c \
+  lib/popcountdi2_array.c \
   lib/popcountsi2.c \
   lib/popcountti2.c \
   lib/powidf2.c \
@@ -132,14 +149,20 @@ libcompiler_rt_common_SRC_FILES := \
   lib/powixf2.c \
   lib/subdf3.c \
   lib/subsf3.c \
+  lib/subtf3.c \
   lib/subvdi3.c \
   lib/subvsi3.c \
   lib/subvti3.c \
   lib/trampoline_setup.c \
+  lib/truncdfhf2.c \
   lib/truncdfsf2.c \
+  lib/truncsfhf2.c \
+  lib/trunctfdf2.c \
+  lib/trunctfsf2.c \
   lib/ucmpdi2.c \
   lib/ucmpti2.c \
   lib/udivdi3.c \
+  lib/udivdi3_by_invariant.c \
   lib/udivmoddi4.c \
   lib/udivmodsi4.c \
   lib/udivmodti4.c \
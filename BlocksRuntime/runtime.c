@@ -187,6 +187,63 @@ static void _Block_release_object_default(const void *ptr) {
     if (!ptr) return;
 }
 
+/*
+ * Per-thread cache of freed heap blocks, by size class.
+ * Most blocks are small and copied over and over again (e.g. completion
+ * handlers), this saves the malloc/free pair for each of them. A block freed
+ * by another thread lands in that thread's cache. The cached blocks of an
+ * exited thread are not reclaimed; the cache is kept small for that reason.
+ */
+#if defined(__GNUC__) && !defined(_WIN32)
+#define BLOCK_CACHE_GRANULE 16
+#define BLOCK_CACHE_CLASSES 8   /* blocks of up to 128 bytes */
+#define BLOCK_CACHE_DEPTH 16
+
+struct Block_cache_class {
+    void *head;
+    int count;
+};
+
+static __thread struct Block_cache_class _Block_cache[BLOCK_CACHE_CLASSES];
+
+static void *_Block_cache_alloc(unsigned long size) {
+    unsigned long cls = (size - 1) / BLOCK_CACHE_GRANULE;
+    if (size && cls < BLOCK_CACHE_CLASSES) {
+        struct Block_cache_class *c = &_Block_cache[cls];
+        void *result = c->head;
+        if (result) {
+            c->head = *(void **)result;
+            c->count--;
+            return result;
+        }
+        // Allocate the whole class size, so any block of the class fits.
+        return malloc((cls + 1) * BLOCK_CACHE_GRANULE);
+    }
+    return malloc(size);
+}
+
+static void _Block_cache_free(void *ptr, unsigned long size) {
+    unsigned long cls = (size - 1) / BLOCK_CACHE_GRANULE;
+    if (size && cls < BLOCK_CACHE_CLASSES &&
+        _Block_cache[cls].count < BLOCK_CACHE_DEPTH) {
+        struct Block_cache_class *c = &_Block_cache[cls];
+        *(void **)ptr = c->head;
+        c->head = ptr;
+        c->count++;
+        return;
+    }
+    free(ptr);
+}
+#else
+static void *_Block_cache_alloc(unsigned long size) {
+    return malloc(size);
+}
+
+static void _Block_cache_free(void *ptr, unsigned long size) {
+    free(ptr);
+}
+#endif
+
 static void _Block_assign_weak_default(const void *ptr, void *dest) {
     *(void **)dest = (void *)ptr;
 }
@@ -311,7 +368,7 @@ static void *_Block_copy_internal(const void *arg, const int flags) {
 
     // Its a stack block.  Make a copy.
     if (!isGC) {
-        struct Block_layout *result = malloc(aBlock->descriptor->size);
+        struct Block_layout *result = _Block_cache_alloc(aBlock->descriptor->size);
         if (!result) return (void *)0;
         memmove(result, aBlock, aBlock->descriptor->size); // bitcopy first
         // reset refcount
@@ -460,7 +517,15 @@ void _Block_release(void *arg) {
     struct Block_layout *aBlock = (struct Block_layout *)arg;
     int32_t newCount;
     if (!aBlock) return;
-    newCount = latching_decr_int(&aBlock->flags) & BLOCK_REFCOUNT_MASK;
+    if ((aBlock->flags & (BLOCK_NEEDS_FREE|BLOCK_REFCOUNT_MASK)) == (BLOCK_NEEDS_FREE|1)) {
+        // The caller holds the only reference, so nobody can retain the block
+        // concurrently and the count can be dropped without a CAS loop.
+        aBlock->flags -= 1;
+        newCount = 0;
+    }
+    else {
+        newCount = latching_decr_int(&aBlock->flags) & BLOCK_REFCOUNT_MASK;
+    }
     if (newCount > 0) return;
     // Hit zero
     if (aBlock->flags & BLOCK_IS_GC) {
@@ -470,8 +535,13 @@ void _Block_release(void *arg) {
         _Block_setHasRefcount(aBlock, false);
     }
     else if (aBlock->flags & BLOCK_NEEDS_FREE) {
+        unsigned long size = aBlock->descriptor->size;
         if (aBlock->flags & BLOCK_HAS_COPY_DISPOSE)(*aBlock->descriptor->dispose)(aBlock);
-        _Block_deallocator(aBlock);
+        // Heap blocks are only created by the non-GC copy path.
+        if (!isGC)
+            _Block_cache_free(aBlock, size);
+        else
+            _Block_deallocator(aBlock);
     }
     else if (aBlock->flags & BLOCK_IS_GLOBAL) {
         ;
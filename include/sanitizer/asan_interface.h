@@ -36,6 +36,21 @@ extern "C" {
   // Method is NOT thread-safe in the sense that no two threads can
   // (un)poison memory in the same memory region simultaneously.
   void __asan_unpoison_memory_region(void const volatile *addr, size_t size);
+  // Bulk versions for custom allocators, which annotate many objects at once:
+  // (un)poison the regions [addrs[i], addrs[i]+sizes[i]) for i in [0, n),
+  // as n calls of __asan_(un)poison_memory_region would.
+  void __asan_poison_memory_regions(const void *const *addrs,
+                                    const size_t *sizes, size_t n);
+  void __asan_unpoison_memory_regions(const void *const *addrs,
+                                      const size_t *sizes, size_t n);
+  // Poisons the region [addr, addr+size), e.g. an arena, except its live
+  // objects [live_addrs[i], live_addrs[i]+live_sizes[i]) for i in [0, n),
+  // which are left addressable. Same as poisoning the region and then
+  // unpoisoning the objects.
+  void __asan_poison_memory_region_except(
+      void const volatile *addr, size_t size,
+      const void *const *live_addrs, const size_t *live_sizes,
+      size_t n);
 
 // User code should use macros instead of functions.
 #if __has_feature(address_sanitizer) || defined(__SANITIZE_ADDRESS__)
@@ -119,6 +134,26 @@ extern "C" {
   // Prints accumulated stats to stderr. Used for debugging.
   void __asan_print_accumulated_stats();
 
+  // Allocator counters filled by __asan_get_stats(). Unless noted otherwise,
+  // the counters are cumulative since the program start.
+  struct __asan_heap_stats {
+    size_t mallocs, malloced;  // Number of calls and bytes requested.
+    size_t frees, freed;
+    size_t real_frees, really_freed;  // Chunks that left the quarantine.
+    size_t mmaps, mmaped, munmaps, munmaped;
+    size_t quarantine_size;  // Bytes currently in the global quarantine.
+    size_t cache_refills, cache_drains;  // Per-thread cache slow paths.
+    // Per size class. Class 0 holds the allocations that are too large for
+    // any class. Bytes of a class are its counter times class_size.
+    size_t num_size_classes;
+    size_t class_size[256];
+    size_t mallocs_by_class[256];
+    size_t frees_by_class[256];
+  };
+  // Fills *stats. Does not stop other threads; the counters of threads that
+  // are running may be slightly outdated.
+  void __asan_get_stats(struct __asan_heap_stats *stats);
+
   // This function may be optionally provided by user and should return
   // a string containing ASan runtime options. See asan_flags.h for details.
   const char* __asan_default_options();
@@ -51,6 +51,40 @@ extern "C" {
   void __sanitizer_unaligned_store32(void *p, uint32_t x);
   void __sanitizer_unaligned_store64(void *p, uint64_t x);
 
+  // Maintain the shadow call stack of the current thread. Compilers or
+  // manual instrumentation call push with the return address of a function
+  // on its entry and pop on its exit. With use_shadow_call_stack=1
+  // the tools then take malloc/free stacks from it instead of unwinding.
+  void __sanitizer_shadow_call_stack_push(void *pc);
+  void __sanitizer_shadow_call_stack_pop();
+
+  // Print and reset the histograms of the sampled runtime timing enabled
+  // with timing_sample_rate=N.
+  void __sanitizer_print_timing_stats();
+  void __sanitizer_reset_timing_stats();
+
+  // Writes a heap profile of the live heap objects, aggregated by allocation
+  // stack, to <heap_profile_path>.<pid>.<n>.heap in the format read by pprof.
+  // Only implemented in AddressSanitizer and LeakSanitizer.
+  void __sanitizer_dump_heap_profile();
+
+  // Edge coverage of the code built with -fsanitize-coverage=trace-pc-guard.
+  // The compiler emits calls to the two callbacks. Each edge has an 8-bit
+  // counter of its hits, saturating at 255, indexed from 1 (counter 0 is
+  // not used). The counters stay in place, so fuzzers can keep the pointer
+  // and read and reset them after every input.
+  void __sanitizer_cov_trace_pc_guard_init(uint32_t *start, uint32_t *stop);
+  void __sanitizer_cov_trace_pc_guard(uint32_t *guard);
+  // Returns the number of counters and stores the counter array to
+  // *counters.
+  size_t __sanitizer_get_coverage_counters(unsigned char **counters);
+  // Returns the number of edges hit since the start or the last reset.
+  size_t __sanitizer_get_total_unique_coverage();
+  void __sanitizer_reset_coverage();
+  // Writes the edges hit by each module to <coverage_dir>/<module>.<pid>
+  // .sancov, which coverage=1 also does at exit.
+  void __sanitizer_cov_dump();
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
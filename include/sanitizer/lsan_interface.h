@@ -37,6 +37,18 @@ extern "C" {
   // most once per process. This function will terminate the process if there
   // are memory leaks and the exit_code flag is non-zero.
   void __lsan_do_leak_check();
+  // Checks for leaks now and returns nonzero if any are found. Unlike
+  // __lsan_do_leak_check(), this function may be called repeatedly (e.g. to
+  // check a long-running process periodically), does not terminate the
+  // process and does not affect end-of-process leak checking.
+  int __lsan_do_recoverable_leak_check();
+  // Allocations made by this thread between __lsan_begin_scope() and
+  // __lsan_end_scope_check() are recorded. __lsan_end_scope_check() checks
+  // for leaks like __lsan_do_recoverable_leak_check(), but reports only the
+  // recorded objects and returns nonzero if any of them leaked. Scopes may
+  // not be nested.
+  void __lsan_begin_scope();
+  int __lsan_end_scope_check();
 #ifdef __cplusplus
 }  // extern "C"
 
@@ -0,0 +1,34 @@
+/* ===-- hwdiv.c - Detect the ARM hardware divide --------------------------===
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is dual licensed under the MIT and the University of Illinois Open
+ * Source Licenses. See LICENSE.TXT for details.
+ *
+ * ===----------------------------------------------------------------------===
+ *
+ * This file sets __compilerrt_arm_hwdiv, see hwdiv.h.
+ *
+ * ===----------------------------------------------------------------------===
+ */
+
+#include "hwdiv.h"
+
+#if COMPILERRT_ARM_HWDIV_DISPATCH
+
+#include "../int_cpu_model.h"
+
+/* Nonzero if udiv/sdiv are available in ARM state. The divides which run
+ * before the constructor (e.g. from other constructors) take the software
+ * path, which computes the same results.
+ */
+__attribute__((visibility("hidden")))
+int __compilerrt_arm_hwdiv = 0;
+
+__attribute__((constructor))
+static void detect_hwdiv(void)
+{
+    __compilerrt_arm_hwdiv = __compilerrt_cpu_has(COMPILERRT_CPU_ARM_IDIVA);
+}
+
+#endif
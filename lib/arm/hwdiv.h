@@ -0,0 +1,43 @@
+/*===-- hwdiv.h - Runtime selection of the ARM hardware divide ------------===//
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is dual licensed under the MIT and the University of Illinois Open
+ * Source Licenses. See LICENSE.TXT for details.
+ *
+ *===----------------------------------------------------------------------===//
+ *
+ * The generic ARMv7-A builds can't assume udiv/sdiv, which only some cores
+ * (Cortex-A7, A15 and newer) implement. On Linux the divide routines check
+ * __compilerrt_arm_hwdiv, set at load time by hwdiv.c from the AT_HWCAP bits
+ * read by cpu_model.c, and only fall back to the digit by digit loop when it
+ * is zero.
+ *
+ * This file is not part of the interface of this library.
+ *
+ *===----------------------------------------------------------------------===*/
+
+#ifndef COMPILERRT_ARM_HWDIV_H
+#define COMPILERRT_ARM_HWDIV_H
+
+#if __ARM_ARCH_7A__ && defined(__linux__) && !defined(__thumb__)
+#define COMPILERRT_ARM_HWDIV_DISPATCH 1
+#else
+#define COMPILERRT_ARM_HWDIV_DISPATCH 0
+#endif
+
+#if COMPILERRT_ARM_HWDIV_DISPATCH && defined(__ASSEMBLER__)
+    .arch_extension idiv
+
+// Branches to label unless the CPU implements udiv/sdiv. Clobbers ip and the
+// flags. The flag is addressed relative to pc (which reads as . + 8 in ARM
+// state), so this works in position independent code.
+#define BRANCH_IF_NO_HWDIV(label)                                              \
+    movw    ip, #:lower16:(SYMBOL_NAME(__compilerrt_arm_hwdiv) - (8f + 8))    ;\
+    movt    ip, #:upper16:(SYMBOL_NAME(__compilerrt_arm_hwdiv) - (8f + 8))    ;\
+8:  ldr     ip, [pc, ip]                                                      ;\
+    cmp     ip, #0                                                            ;\
+    beq     label
+#endif
+
+#endif /* COMPILERRT_ARM_HWDIV_H */
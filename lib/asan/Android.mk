@@ -55,6 +55,7 @@ asan_rtl_files := \
 	../sanitizer_common/sanitizer_posix_libcdep.cc \
 	../sanitizer_common/sanitizer_platform_limits_posix.cc \
 	../sanitizer_common/sanitizer_printf.cc \
+	../sanitizer_common/sanitizer_shadow_call_stack.cc \
 	../sanitizer_common/sanitizer_stackdepot.cc \
 	../sanitizer_common/sanitizer_stacktrace.cc \
 	../sanitizer_common/sanitizer_symbolizer_itanium.cc \
@@ -65,6 +66,7 @@ asan_rtl_files := \
 	../sanitizer_common/sanitizer_symbolizer_posix_libcdep.cc \
 	../sanitizer_common/sanitizer_symbolizer_win.cc \
 	../sanitizer_common/sanitizer_thread_registry.cc \
+	../sanitizer_common/sanitizer_unwind_cfi_linux_libcdep.cc \
 	../sanitizer_common/sanitizer_win.cc \
 
 asan_rtl_cflags := \
@@ -18,6 +18,7 @@
 #include "asan_internal.h"
 #include "asan_interceptors.h"
 #include "sanitizer_common/sanitizer_list.h"
+#include "sanitizer_common/sanitizer_stackdepot.h"
 
 namespace __asan {
 
@@ -99,6 +100,9 @@ struct AsanThreadLocalMallocStorage {
 
   uptr quarantine_cache[16];
   uptr allocator2_cache[96 * (512 * 8 + 16)];  // Opaque.
+  StackDepotCache stack_depot_cache;
+  uptr budget_alloc_counter;  // Used if heap_overhead_budget is set.
+  uptr sample_alloc_counter;  // Used if sample_allocations is set.
   void CommitBack();
 };
 
@@ -119,8 +123,17 @@ uptr asan_malloc_usable_size(void *ptr, StackTrace *stack);
 uptr asan_mz_size(const void *ptr);
 void asan_mz_force_lock();
 void asan_mz_force_unlock();
+// Recycles at least goal bytes (all, if goal is 0) of the quarantine and
+// returns the free memory of the allocator to the OS. Returns the number of
+// recycled and unmapped bytes, not counting the released primary pages.
+uptr asan_mz_pressure_relief(uptr goal);
 
 void PrintInternalAllocatorStats();
+// Used by __asan_get_stats().
+uptr GetQuarantineSize();
+void GetAllocatorCacheStats(uptr *refills, uptr *drains);
+// Chunk size of the size class, or 0 if there is no such class.
+uptr SizeClassToSize(uptr class_id);
 
 }  // namespace __asan
 #endif  // ASAN_ALLOCATOR_H
@@ -21,11 +21,13 @@
 #include "asan_report.h"
 #include "asan_thread.h"
 #include "sanitizer_common/sanitizer_allocator.h"
+#include "sanitizer_common/sanitizer_atomic.h"
 #include "sanitizer_common/sanitizer_flags.h"
 #include "sanitizer_common/sanitizer_internal_defs.h"
 #include "sanitizer_common/sanitizer_list.h"
 #include "sanitizer_common/sanitizer_stackdepot.h"
 #include "sanitizer_common/sanitizer_quarantine.h"
+#include "sanitizer_common/sanitizer_timing.h"
 #include "lsan/lsan_common.h"
 
 namespace __asan {
@@ -53,6 +55,9 @@ struct AsanMapUnmapCallback {
     thread_stats.munmaps++;
     thread_stats.munmaped += size;
   }
+  void OnRelease(uptr p, uptr size) const {
+    ReleaseHeapShadow(p, size);
+  }
 };
 
 #if SANITIZER_WORDSIZE == 64
@@ -63,18 +68,29 @@ const uptr kAllocatorSize  =  0x20000000000ULL;  // 2T.
 const uptr kAllocatorSpace = 0x600000000000ULL;
 const uptr kAllocatorSize  =  0x40000000000ULL;  // 4T.
 #endif
-typedef DefaultSizeClassMap SizeClassMap;
+#if ASAN_DENSE_SIZE_CLASSES
+typedef DenseTableSizeClassMap SizeClassMap;
+#else
+typedef DefaultTableSizeClassMap SizeClassMap;
+#endif
+// Enough for 4-socket machines; on larger ones nodes share the space.
+const uptr kNumaNodes = 4;
 typedef SizeClassAllocator64<kAllocatorSpace, kAllocatorSize, 0 /*metadata*/,
-    SizeClassMap, AsanMapUnmapCallback> PrimaryAllocator;
+    SizeClassMap, AsanMapUnmapCallback, /*kNumFreeListShards*/ 1,
+    kNumaNodes> PrimaryAllocator;
 #elif SANITIZER_WORDSIZE == 32
 static const u64 kAddressSpaceSize = 1ULL << 32;
+#if ASAN_DENSE_SIZE_CLASSES
+typedef DenseSizeClassMap SizeClassMap;
+#else
 typedef CompactSizeClassMap SizeClassMap;
+#endif
 static const uptr kRegionSizeLog = 20;
 static const uptr kFlatByteMapSize = kAddressSpaceSize >> kRegionSizeLog;
 typedef SizeClassAllocator32<0, kAddressSpaceSize, 16,
   SizeClassMap, kRegionSizeLog,
   FlatByteMap<kFlatByteMapSize>,
-  AsanMapUnmapCallback> PrimaryAllocator;
+  AsanMapUnmapCallback, /*kLockFreeFreeList*/true> PrimaryAllocator;
 #endif
 
 typedef SizeClassAllocatorLocalCache<PrimaryAllocator> AllocatorCache;
@@ -93,12 +109,23 @@ AllocatorCache *GetAllocatorCache(AsanThreadLocalMallocStorage *ms) {
 
 static Allocator allocator;
 
+static u32 PutToStackDepot(StackTrace *stack) {
+  AsanThread *t = GetCurrentThread();
+  StackDepotCache *cache = t ? &t->malloc_storage().stack_depot_cache : 0;
+  return StackDepotPutCached(cache, stack->trace, stack->size);
+}
+
 static const uptr kMaxAllowedMallocSize =
   FIRST_32_SECOND_64(3UL << 30, 8UL << 30);
 
 static const uptr kMaxThreadLocalQuarantine =
   FIRST_32_SECOND_64(1 << 18, 1 << 20);
 
+// The smallest quarantine used in the heap_overhead_budget mode.
+static const uptr kMinBudgetQuarantine = 16 * kMaxThreadLocalQuarantine;
+// How often (in allocations per thread) the quarantine size is adapted.
+static const uptr kQuarantineBudgetUpdatePeriod = 1 << 16;
+
 // Every chunk of memory allocated by this allocator can be in one of 3 states:
 // CHUNK_AVAILABLE: the chunk is in the free list and ready to be allocated.
 // CHUNK_ALLOCATED: the chunk is allocated and not yet freed.
@@ -125,6 +152,22 @@ static u32 RZSize2Log(u32 rz_size) {
   return res;
 }
 
+// The left redzone holds the chunk header and must cover whole shadow
+// granules, so with SHADOW_SCALE > 4 even the smallest redzone is larger
+// than the 16-byte header.
+static u32 MinRZLog() {
+  return RZSize2Log(Max((uptr)flags()->redzone, (uptr)SHADOW_GRANULARITY));
+}
+
+// Returns the largest redzone log not above rz_log for which the redzone
+// takes at most half of the heap_overhead_budget of the chunk.
+static uptr ShrinkRZLogForBudget(uptr rz_log, uptr user_requested_size) {
+  uptr max_rz_size = user_requested_size / 200 * flags()->heap_overhead_budget;
+  while (rz_log > 0 && RZLog2Size(rz_log) > max_rz_size)
+    rz_log--;
+  return Max(rz_log, (uptr)MinRZLog());
+}
+
 static uptr ComputeRZLog(uptr user_requested_size) {
   u32 rz_log =
     user_requested_size <= 64        - 16   ? 0 :
@@ -134,7 +177,7 @@ static uptr ComputeRZLog(uptr user_requested_size) {
     user_requested_size <= (1 << 14) - 256  ? 4 :
     user_requested_size <= (1 << 15) - 512  ? 5 :
     user_requested_size <= (1 << 16) - 1024 ? 6 : 7;
-  return Max(rz_log, RZSize2Log(flags()->redzone));
+  return Max(rz_log, MinRZLog());
 }
 
 // The memory chunk allocated from the underlying allocator looks like this:
@@ -156,6 +199,10 @@ static uptr ComputeRZLog(uptr user_requested_size) {
 //   B -- address of ChunkHeader pointing to the first 'H'
 static const uptr kAllocBegMagic = 0xCC6E96B9;
 
+// Stored in alloc_context_id and free_context_id of chunks that were not
+// sampled (see sample_allocations). StackDepot ids never have the top bit set.
+static const u32 kUnsampledContextId = ~(u32)0;
+
 struct ChunkHeader {
   // 1-st 8 bytes.
   u32 chunk_state       : 8;  // Must be first.
@@ -234,7 +281,9 @@ static void GetStackTraceFromId(u32 id, StackTrace *stack) {
 }
 
 void AsanChunkView::GetAllocStack(StackTrace *stack) {
-  if (flags()->use_stack_depot)
+  if (chunk_->alloc_context_id == kUnsampledContextId)
+    stack->size = 0;
+  else if (flags()->use_stack_depot)
     GetStackTraceFromId(chunk_->alloc_context_id, stack);
   else
     StackTrace::UncompressStack(stack, chunk_->AllocStackBeg(),
@@ -242,7 +291,9 @@ void AsanChunkView::GetAllocStack(StackTrace *stack) {
 }
 
 void AsanChunkView::GetFreeStack(StackTrace *stack) {
-  if (flags()->use_stack_depot)
+  if (chunk_->alloc_context_id == kUnsampledContextId)
+    stack->size = 0;
+  else if (flags()->use_stack_depot)
     GetStackTraceFromId(chunk_->free_context_id, stack);
   else
     StackTrace::UncompressStack(stack, chunk_->FreeStackBeg(),
@@ -250,7 +301,9 @@ void AsanChunkView::GetFreeStack(StackTrace *stack) {
 }
 
 struct QuarantineCallback;
-typedef Quarantine<QuarantineCallback, AsanChunk> AsanQuarantine;
+static const uptr kNumQuarantineShards = FIRST_32_SECOND_64(2, 8);
+typedef Quarantine<QuarantineCallback, AsanChunk, kNumQuarantineShards>
+    AsanQuarantine;
 typedef AsanQuarantine::Cache QuarantineCache;
 static AsanQuarantine quarantine(LINKER_INITIALIZED);
 static QuarantineCache fallback_quarantine_cache(LINKER_INITIALIZED);
@@ -263,19 +316,42 @@ QuarantineCache *GetQuarantineCache(AsanThreadLocalMallocStorage *ms) {
   return reinterpret_cast<QuarantineCache *>(ms->quarantine_cache);
 }
 
+static u32 sample_seed;  // Used if sample_by_size_class is set.
+
+// Size class of the chunk for AsanStats; 0 for secondary chunks.
+static uptr ChunkClassId(void *alloc_beg) {
+  uptr size = allocator.GetActuallyAllocatedSize(alloc_beg);
+  return Min(kNumberOfSizeClasses, SizeClassMap::ClassID(size));
+}
+
 struct QuarantineCallback {
   explicit QuarantineCallback(AllocatorCache *cache)
       : cache_(cache) {
   }
 
-  void Recycle(AsanChunk *m) {
-    CHECK_EQ(m->chunk_state, CHUNK_QUARANTINE);
-    atomic_store((atomic_uint8_t*)m, CHUNK_AVAILABLE, memory_order_relaxed);
-    CHECK_NE(m->alloc_tid, kInvalidTid);
-    CHECK_NE(m->free_tid, kInvalidTid);
-    PoisonShadow(m->Beg(),
-                 RoundUpTo(m->UsedSize(), SHADOW_GRANULARITY),
+  void RecycleBatch(AsanChunk **chunks, uptr n) {
+    // Poison all chunks in one sweep. This must be done before any of them
+    // is returned to the allocator, which may hand it out to another thread.
+    ShadowPoisonBatch poison;
+    const uptr kPrefetch = 16;
+    for (uptr i = 0; i < kPrefetch; i++)
+      PREFETCH(chunks[i]);
+    for (uptr i = 0; i < n; i++) {
+      PREFETCH(chunks[i + kPrefetch]);
+      AsanChunk *m = chunks[i];
+      CHECK_EQ(m->chunk_state, CHUNK_QUARANTINE);
+      atomic_store((atomic_uint8_t*)m, CHUNK_AVAILABLE, memory_order_relaxed);
+      CHECK_NE(m->alloc_tid, kInvalidTid);
+      CHECK_NE(m->free_tid, kInvalidTid);
+      poison.Add(m->Beg(), RoundUpTo(m->UsedSize(), SHADOW_GRANULARITY),
                  kAsanHeapLeftRedzoneMagic);
+    }
+    poison.Flush();
+    for (uptr i = 0; i < n; i++)
+      Recycle(chunks[i]);
+  }
+
+  void Recycle(AsanChunk *m) {
     void *p = reinterpret_cast<void *>(m->AllocBeg());
     if (p != m) {
       uptr *alloc_magic = reinterpret_cast<uptr *>(p);
@@ -290,6 +366,7 @@ struct QuarantineCallback {
     AsanStats &thread_stats = GetCurrentThreadStats();
     thread_stats.real_frees++;
     thread_stats.really_freed += m->UsedSize();
+    thread_stats.really_freed_by_size[ChunkClassId(p)]++;
 
     allocator.Deallocate(cache_, p);
   }
@@ -307,13 +384,65 @@ struct QuarantineCallback {
 
 void InitializeAllocator() {
   allocator.Init();
+#if SANITIZER_WORDSIZE == 64
+  // The shadow of the primary allocator space is the most densely used.
+  SetShadowHugePages(common_flags()->shadow_huge_pages,
+                     MEM_TO_SHADOW(kAllocatorSpace),
+                     kAllocatorSize >> SHADOW_SCALE, /*dense*/ true);
+  if (flags()->release_heap_shadow)
+    InitHeapShadowRelease(MEM_TO_SHADOW(kAllocatorSpace),
+                          MEM_TO_SHADOW(kAllocatorSpace + kAllocatorSize));
+#endif
+  allocator.SetReleaseToOSIntervalMs(flags()->release_to_os_interval_ms);
+  allocator.SetNumaMode(flags()->numa_allocator);
+  allocator.SetSecondaryCacheLimits(
+      (uptr)flags()->large_alloc_cache_size_mb << 20,
+      flags()->large_alloc_cache_max_age_ms);
   quarantine.Init((uptr)flags()->quarantine_size, kMaxThreadLocalQuarantine);
+  if (flags()->heap_overhead_budget)
+    quarantine.SetMaxSize(Min((uptr)flags()->quarantine_size,
+                              kMinBudgetQuarantine));
+  sample_seed = (u32)NanoTime();
+}
+
+// Resizes the quarantine to the heap_overhead_budget share of the live heap.
+static void UpdateQuarantineBudget() {
+  uptr live = __asan_get_current_allocated_bytes();
+  uptr size = live / 200 * flags()->heap_overhead_budget;
+  size = Max(size, kMinBudgetQuarantine);
+  quarantine.SetMaxSize(Min((uptr)flags()->quarantine_size, size));
+}
+
+// In the sample_allocations mode, decides if the current allocation is
+// checked.
+static bool IsSampledAllocation(AsanThread *t, uptr size) {
+  uptr rate = flags()->sample_allocations;
+  if (flags()->sample_by_size_class) {
+    uptr class_id = SizeClassMap::ClassID(size);
+    return (class_id * 0x9E3779B1U ^ sample_seed) % rate == 0;
+  }
+  if (!t)
+    return true;
+  return t->malloc_storage().sample_alloc_counter++ % rate == 0;
+}
+
+// In the heap_overhead_budget mode, decides if the current allocation keeps
+// the regular redzone, and periodically adapts the quarantine size.
+static bool UseFullRedzone(AsanThread *t) {
+  if (!t)
+    return true;
+  uptr n = t->malloc_storage().budget_alloc_counter++;
+  if (n % kQuarantineBudgetUpdatePeriod == 0)
+    UpdateQuarantineBudget();
+  return n % flags()->full_redzone_sample_rate == 0;
 }
 
 static void *Allocate(uptr size, uptr alignment, StackTrace *stack,
-                      AllocType alloc_type, bool can_fill) {
+                      AllocType alloc_type, bool can_fill,
+                      bool cleared = false) {
   if (!asan_inited)
     __asan_init();
+  ScopedTiming timing(kTimingMalloc);
   Flags &fl = *flags();
   CHECK(stack);
   const uptr min_alignment = SHADOW_GRANULARITY;
@@ -328,7 +457,19 @@ static void *Allocate(uptr size, uptr alignment, StackTrace *stack,
     size = 1;
   }
   CHECK(IsPowerOfTwo(alignment));
-  uptr rz_log = ComputeRZLog(size);
+  AsanThread *t = GetCurrentThread();
+  bool sampled = fl.sample_allocations == 1 || IsSampledAllocation(t, size);
+  // Unsampled chunks get just the chunk header, padded to a granule.
+  uptr rz_log = RZSize2Log(Max(kChunkHeaderSize, (uptr)SHADOW_GRANULARITY));
+  bool full_redzone = true;
+  if (sampled) {
+    rz_log = ComputeRZLog(size);
+    if (fl.heap_overhead_budget) {
+      full_redzone = UseFullRedzone(t);
+      if (!full_redzone)
+        rz_log = ShrinkRZLogForBudget(rz_log, size);
+    }
+  }
   uptr rz_size = RZLog2Size(rz_log);
   uptr rounded_size = RoundUpTo(Max(size, kChunkHeader2Size), alignment);
   uptr needed_size = rounded_size + rz_size;
@@ -338,7 +479,8 @@ static void *Allocate(uptr size, uptr alignment, StackTrace *stack,
   // If we are allocating from the secondary allocator, there will be no
   // automatic right redzone, so add the right redzone manually.
   if (!PrimaryAllocator::CanAllocate(needed_size, alignment)) {
-    needed_size += rz_size;
+    if (sampled)
+      needed_size += rz_size;
     using_primary_allocator = false;
   }
   CHECK(IsAligned(needed_size, min_alignment));
@@ -348,15 +490,17 @@ static void *Allocate(uptr size, uptr alignment, StackTrace *stack,
     return 0;
   }
 
-  AsanThread *t = GetCurrentThread();
   void *allocated;
+  bool zero;
   if (t) {
     AllocatorCache *cache = GetAllocatorCache(&t->malloc_storage());
-    allocated = allocator.Allocate(cache, needed_size, 8, false);
+    allocated = allocator.AllocateCheckZero(cache, needed_size, min_alignment,
+                                            &zero);
   } else {
     SpinMutexLock l(&fallback_mutex);
     AllocatorCache *cache = &fallback_allocator_cache;
-    allocated = allocator.Allocate(cache, needed_size, 8, false);
+    allocated = allocator.AllocateCheckZero(cache, needed_size, min_alignment,
+                                            &zero);
   }
   uptr alloc_beg = reinterpret_cast<uptr>(allocated);
   uptr alloc_end = alloc_beg + needed_size;
@@ -377,8 +521,11 @@ static void *Allocate(uptr size, uptr alignment, StackTrace *stack,
   m->from_memalign = user_beg != beg_plus_redzone;
   if (alloc_beg != chunk_beg) {
     CHECK_LE(alloc_beg+ 2 * sizeof(uptr), chunk_beg);
-    reinterpret_cast<uptr *>(alloc_beg)[0] = kAllocBegMagic;
+    // The heap profiler may look at the chunk concurrently: publish the
+    // pointer before the magic value.
     reinterpret_cast<uptr *>(alloc_beg)[1] = chunk_beg;
+    atomic_store(reinterpret_cast<atomic_uintptr_t *>(alloc_beg),
+                 kAllocBegMagic, memory_order_release);
   }
   if (using_primary_allocator) {
     CHECK(size);
@@ -392,8 +539,10 @@ static void *Allocate(uptr size, uptr alignment, StackTrace *stack,
     meta[1] = chunk_beg;
   }
 
-  if (fl.use_stack_depot) {
-    m->alloc_context_id = StackDepotPut(stack->trace, stack->size);
+  if (!sampled) {
+    m->alloc_context_id = kUnsampledContextId;
+  } else if (fl.use_stack_depot) {
+    m->alloc_context_id = PutToStackDepot(stack);
   } else {
     m->alloc_context_id = 0;
     StackTrace::CompressStack(stack, m->AllocStackBeg(), m->AllocStackSize());
@@ -417,8 +566,16 @@ static void *Allocate(uptr size, uptr alignment, StackTrace *stack,
   thread_stats.malloced_by_size[class_id]++;
   if (needed_size > SizeClassMap::kMaxSize)
     thread_stats.malloc_large++;
+  if (fl.heap_overhead_budget && full_redzone)
+    thread_stats.malloc_full_redzone++;
+  if (!sampled)
+    thread_stats.malloc_unsampled++;
 
   void *res = reinterpret_cast<void *>(user_beg);
+  // The chunk header is outside of the user memory, which is still zero if
+  // the chunk is fresh.
+  if (cleared && !zero)
+    REAL(memset)(res, 0, size);
   if (can_fill && fl.max_malloc_fill_size) {
     uptr fill_size = Min(size, (uptr)fl.max_malloc_fill_size);
     REAL(memset)(res, fl.malloc_fill_byte, fill_size);
@@ -429,6 +586,9 @@ static void *Allocate(uptr size, uptr alignment, StackTrace *stack,
 #endif
   // Must be the last mutation of metadata in this function.
   atomic_store((atomic_uint8_t *)m, CHUNK_ALLOCATED, memory_order_release);
+#if CAN_SANITIZE_LEAKS
+  __lsan::RecordScopedAllocation(user_beg);
+#endif
   ASAN_MALLOC_HOOK(res, size);
   return res;
 }
@@ -450,6 +610,20 @@ static void AtomicallySetQuarantineFlag(AsanChunk *m,
   CHECK_EQ(CHUNK_ALLOCATED, old_chunk_state);
 }
 
+static void RecycleUnsampledChunk(AsanChunk *m, AsanThread *t) {
+  AsanStats &thread_stats = GetCurrentThreadStats();
+  thread_stats.frees++;
+  thread_stats.freed += m->UsedSize();
+  thread_stats.freed_by_size[ChunkClassId((void*)m->AllocBeg())]++;
+  if (t) {
+    AllocatorCache *ac = GetAllocatorCache(&t->malloc_storage());
+    QuarantineCallback(ac).RecycleBatch(&m, 1);
+  } else {
+    SpinMutexLock l(&fallback_mutex);
+    QuarantineCallback(&fallback_allocator_cache).RecycleBatch(&m, 1);
+  }
+}
+
 // Expects the chunk to already be marked as quarantined by using
 // AtomicallySetQuarantineFlag.
 static void QuarantineChunk(AsanChunk *m, void *ptr,
@@ -465,8 +639,14 @@ static void QuarantineChunk(AsanChunk *m, void *ptr,
     CHECK_EQ(m->free_tid, kInvalidTid);
   AsanThread *t = GetCurrentThread();
   m->free_tid = t ? t->tid() : 0;
+  if (m->alloc_context_id == kUnsampledContextId) {
+    // Not sampled: no free stack and no quarantine.
+    m->free_context_id = kUnsampledContextId;
+    RecycleUnsampledChunk(m, t);
+    return;
+  }
   if (flags()->use_stack_depot) {
-    m->free_context_id = StackDepotPut(stack->trace, stack->size);
+    m->free_context_id = PutToStackDepot(stack);
   } else {
     m->free_context_id = 0;
     StackTrace::CompressStack(stack, m->FreeStackBeg(), m->FreeStackSize());
@@ -479,6 +659,7 @@ static void QuarantineChunk(AsanChunk *m, void *ptr,
   AsanStats &thread_stats = GetCurrentThreadStats();
   thread_stats.frees++;
   thread_stats.freed += m->UsedSize();
+  thread_stats.freed_by_size[ChunkClassId((void*)m->AllocBeg())]++;
 
   // Push into quarantine.
   if (t) {
@@ -497,6 +678,7 @@ static void QuarantineChunk(AsanChunk *m, void *ptr,
 static void Deallocate(void *ptr, StackTrace *stack, AllocType alloc_type) {
   uptr p = reinterpret_cast<uptr>(ptr);
   if (p == 0) return;
+  ScopedTiming timing(kTimingFree);
 
   uptr chunk_beg = p - kChunkHeaderSize;
   AsanChunk *m = reinterpret_cast<AsanChunk *>(chunk_beg);
@@ -506,6 +688,72 @@ static void Deallocate(void *ptr, StackTrace *stack, AllocType alloc_type) {
   QuarantineChunk(m, ptr, stack, alloc_type);
 }
 
+// Resizes a chunk of the secondary allocator without copying its contents.
+// The chunk may move. Returns the new user memory or 0 if the chunk can't be
+// resized this way.
+static void *ReallocateSecondaryInPlace(AsanChunk *m, uptr new_size,
+                                        StackTrace *stack) {
+  if (m->from_memalign || new_size > kMaxAllowedMallocSize)
+    return 0;
+  void *alloc_beg = m->AllocBeg();
+  if (allocator.FromPrimary(alloc_beg))
+    return 0;
+  // Same layout as in Allocate.
+  uptr rz_size = RZLog2Size(m->rz_log);
+  uptr needed_size =
+      RoundUpTo(Max(new_size, kChunkHeader2Size), SHADOW_GRANULARITY) +
+      2 * rz_size;
+  if (PrimaryAllocator::CanAllocate(needed_size, SHADOW_GRANULARITY))
+    return 0;
+  u8 chunk_state = m->chunk_state;
+  if (chunk_state != CHUNK_ALLOCATED)
+    ReportInvalidFree((void*)m->Beg(), chunk_state, stack);
+  uptr old_size = m->UsedSize();
+  void *new_alloc_beg = allocator.ResizeSecondary(alloc_beg, needed_size);
+  if (!new_alloc_beg)
+    return 0;
+  bool moved = new_alloc_beg != alloc_beg;
+  uptr chunk_beg = reinterpret_cast<uptr>(m) +
+      (reinterpret_cast<uptr>(new_alloc_beg) - reinterpret_cast<uptr>(alloc_beg));
+  m = reinterpret_cast<AsanChunk *>(chunk_beg);
+  if (moved && reinterpret_cast<uptr>(new_alloc_beg) != chunk_beg)
+    reinterpret_cast<uptr *>(new_alloc_beg)[1] = chunk_beg;
+  uptr *meta = reinterpret_cast<uptr *>(allocator.GetMetaData(new_alloc_beg));
+  meta[0] = new_size;
+  meta[1] = chunk_beg;
+
+  // Only fix up the shadow that changed. A moved chunk has a fresh mapping,
+  // poisoned entirely by AsanMapUnmapCallback::OnMap.
+  uptr user_beg = m->Beg();
+  uptr valid_end =
+      moved ? 0 : RoundDownTo(Min(old_size, new_size), SHADOW_GRANULARITY);
+  uptr new_end = RoundDownTo(new_size, SHADOW_GRANULARITY);
+  uptr old_end = moved ? 0 : RoundUpTo(old_size, SHADOW_GRANULARITY);
+  if (new_end > valid_end)
+    PoisonShadow(user_beg + valid_end, new_end - valid_end, 0);
+  if (old_end > new_end)
+    PoisonShadow(user_beg + new_end, old_end - new_end,
+                 kAsanHeapLeftRedzoneMagic);
+  if (new_size != new_end && flags()->poison_heap) {
+    u8 *shadow = (u8*)MemToShadow(user_beg + new_end);
+    *shadow = new_size & (SHADOW_GRANULARITY - 1);
+  }
+
+  if (m->alloc_context_id == kUnsampledContextId) {
+    // Keep it unsampled.
+  } else if (flags()->use_stack_depot) {
+    m->alloc_context_id = PutToStackDepot(stack);
+  } else {
+    StackTrace::CompressStack(stack, m->AllocStackBeg(), m->AllocStackSize());
+  }
+  AsanStats &thread_stats = GetCurrentThreadStats();
+  if (new_size > old_size)
+    thread_stats.malloced += new_size - old_size;
+  else
+    thread_stats.freed += old_size - new_size;
+  return reinterpret_cast<void *>(user_beg);
+}
+
 static void *Reallocate(void *old_ptr, uptr new_size, StackTrace *stack) {
   CHECK(old_ptr && new_size);
   uptr p = reinterpret_cast<uptr>(old_ptr);
@@ -516,6 +764,11 @@ static void *Reallocate(void *old_ptr, uptr new_size, StackTrace *stack) {
   thread_stats.reallocs++;
   thread_stats.realloced += new_size;
 
+  if (flags()->large_realloc_in_place) {
+    if (void *new_ptr = ReallocateSecondaryInPlace(m, new_size, stack))
+      return new_ptr;
+  }
+
   void *new_ptr = Allocate(new_size, 8, stack, FROM_MALLOC, true);
   if (new_ptr) {
     u8 chunk_state = m->chunk_state;
@@ -540,7 +793,8 @@ static AsanChunk *GetAsanChunk(void *alloc_beg) {
     return m;
   }
   uptr *alloc_magic = reinterpret_cast<uptr *>(alloc_beg);
-  if (alloc_magic[0] == kAllocBegMagic)
+  if (atomic_load(reinterpret_cast<atomic_uintptr_t *>(alloc_beg),
+                  memory_order_acquire) == kAllocBegMagic)
     return reinterpret_cast<AsanChunk *>(alloc_magic[1]);
   return reinterpret_cast<AsanChunk *>(alloc_beg);
 }
@@ -619,6 +873,23 @@ void PrintInternalAllocatorStats() {
   allocator.PrintStats();
 }
 
+uptr GetQuarantineSize() {
+  return quarantine.GetSize();
+}
+
+void GetAllocatorCacheStats(uptr *refills, uptr *drains) {
+  AllocatorStatCounters s;
+  allocator.GetStats(s);
+  *refills = s[AllocatorStatRefills];
+  *drains = s[AllocatorStatDrains];
+}
+
+uptr SizeClassToSize(uptr class_id) {
+  if (class_id == 0 || class_id >= SizeClassMap::kNumClasses)
+    return 0;
+  return SizeClassMap::Size(class_id);
+}
+
 SANITIZER_INTERFACE_ATTRIBUTE
 void *asan_memalign(uptr alignment, uptr size, StackTrace *stack,
                     AllocType alloc_type) {
@@ -637,12 +908,7 @@ void *asan_malloc(uptr size, StackTrace *stack) {
 
 void *asan_calloc(uptr nmemb, uptr size, StackTrace *stack) {
   if (CallocShouldReturnNullDueToOverflow(size, nmemb)) return 0;
-  void *ptr = Allocate(nmemb * size, 8, stack, FROM_MALLOC, false);
-  // If the memory comes from the secondary allocator no need to clear it
-  // as it comes directly from mmap.
-  if (ptr && allocator.FromPrimary(ptr))
-    REAL(memset)(ptr, 0, nmemb * size);
-  return ptr;
+  return Allocate(nmemb * size, 8, stack, FROM_MALLOC, false, true);
 }
 
 void *asan_realloc(void *p, uptr size, StackTrace *stack) {
@@ -701,6 +967,26 @@ void asan_mz_force_unlock() {
   allocator.ForceUnlock();
 }
 
+uptr asan_mz_pressure_relief(uptr goal) {
+  // Recycled chunks go to the free lists through an allocator cache, which is
+  // then emptied, so that their pages can be released below.
+  uptr released;
+  AsanThread *t = GetCurrentThread();
+  if (t) {
+    AllocatorCache *ac = GetAllocatorCache(&t->malloc_storage());
+    released = quarantine.Shrink(QuarantineCallback(ac), goal);
+    allocator.SwallowCache(ac);
+  } else {
+    SpinMutexLock l(&fallback_mutex);
+    AllocatorCache *ac = &fallback_allocator_cache;
+    released = quarantine.Shrink(QuarantineCallback(ac), goal);
+    allocator.SwallowCache(ac);
+  }
+  released += allocator.DrainSecondaryCache();
+  allocator.ReleaseToOS();
+  return released;
+}
+
 }  // namespace __asan
 
 // --- Implementation of LSan-specific functions --- {{{1
@@ -718,6 +1004,12 @@ void GetAllocatorGlobalRange(uptr *begin, uptr *end) {
   *end = *begin + sizeof(__asan::allocator);
 }
 
+void GetAllocatorChunkRangesLocked(uptr *primary_begin, uptr *primary_end,
+                                   uptr *secondary_begin, uptr *secondary_end) {
+  __asan::allocator.GetAddressRangesLocked(primary_begin, primary_end,
+                                           secondary_begin, secondary_end);
+}
+
 uptr PointsIntoChunk(void* p) {
   uptr addr = reinterpret_cast<uptr>(p);
   __asan::AsanChunk *m = __asan::GetAsanChunkByAddrFastLocked(addr);
@@ -744,6 +1036,10 @@ bool LsanMetadata::allocated() const {
   return m->chunk_state == __asan::CHUNK_ALLOCATED;
 }
 
+void LsanMetadata::prefetch() const {
+  PREFETCH(metadata_);
+}
+
 ChunkTag LsanMetadata::tag() const {
   __asan::AsanChunk *m = reinterpret_cast<__asan::AsanChunk *>(metadata_);
   return static_cast<ChunkTag>(m->lsan_tag);
@@ -754,6 +1050,22 @@ void LsanMetadata::set_tag(ChunkTag value) {
   m->lsan_tag = value;
 }
 
+bool LsanMetadata::compare_and_set_tag(ChunkTag cmp, ChunkTag value) {
+  // lsan_tag is in the second 4-byte word of the header, the other fields of
+  // that word do not change during leak checking.
+  atomic_uint32_t *word = reinterpret_cast<atomic_uint32_t *>(metadata_) + 1;
+  u32 old_word = atomic_load(word, memory_order_relaxed);
+  __asan::ChunkHeader h;
+  internal_memcpy(reinterpret_cast<u32 *>(&h) + 1, &old_word, sizeof(u32));
+  if (h.lsan_tag != cmp)
+    return false;
+  h.lsan_tag = value;
+  u32 new_word;
+  internal_memcpy(&new_word, reinterpret_cast<u32 *>(&h) + 1, sizeof(u32));
+  return atomic_compare_exchange_strong(word, &old_word, new_word,
+                                        memory_order_relaxed);
+}
+
 uptr LsanMetadata::requested_size() const {
   __asan::AsanChunk *m = reinterpret_cast<__asan::AsanChunk *>(metadata_);
   return m->UsedSize();
@@ -761,6 +1073,9 @@ uptr LsanMetadata::requested_size() const {
 
 u32 LsanMetadata::stack_trace_id() const {
   __asan::AsanChunk *m = reinterpret_cast<__asan::AsanChunk *>(metadata_);
+  // Unsampled chunks have no stack, LSan reports them under the id 0.
+  if (m->alloc_context_id == __asan::kUnsampledContextId)
+    return 0;
   return m->alloc_context_id;
 }
 
@@ -768,6 +1083,10 @@ void ForEachChunk(ForEachChunkCallback callback, void *arg) {
   __asan::allocator.ForEachChunk(callback, arg);
 }
 
+void ForEachChunkWithRegionLocks(ForEachChunkCallback callback, void *arg) {
+  __asan::allocator.ForEachChunkWithRegionLocks(callback, arg);
+}
+
 IgnoreObjectResult IgnoreObjectLocked(const void *p) {
   uptr addr = reinterpret_cast<uptr>(p);
   __asan::AsanChunk *m = __asan::GetAsanChunkByAddr(addr);
@@ -17,23 +17,13 @@
 
 namespace __asan {
 
-bool FakeStack::AddrIsInSizeClass(uptr addr, uptr size_class) {
-  uptr mem = allocated_size_classes_[size_class];
-  uptr size = ClassMmapSize(size_class);
-  bool res = mem && addr >= mem && addr < mem + size;
-  return res;
-}
-
 uptr FakeStack::AddrIsInFakeStack(uptr addr) {
-  for (uptr size_class = 0; size_class < kNumberOfSizeClasses; size_class++) {
-    if (!AddrIsInSizeClass(addr, size_class)) continue;
-    uptr size_class_first_ptr = allocated_size_classes_[size_class];
-    uptr size = ClassSize(size_class);
-    CHECK_LE(size_class_first_ptr, addr);
-    CHECK_GT(size_class_first_ptr + ClassMmapSize(size_class), addr);
-    return size_class_first_ptr + ((addr - size_class_first_ptr) / size) * size;
-  }
-  return 0;
+  if (!mem_ || addr < mem_ || addr >= mem_ + MmapSize())
+    return 0;
+  uptr size_class = (addr - mem_) >> stack_size_log_;
+  uptr beg = ClassBeg(size_class);
+  uptr size = ClassSize(size_class);
+  return beg + ((addr - beg) / size) * size;
 }
 
 // We may want to compute this during compilation.
@@ -48,112 +38,137 @@ ALWAYS_INLINE uptr FakeStack::ComputeSizeClass(uptr alloc_size) {
   return res;
 }
 
-void FakeFrameFifo::FifoPush(FakeFrame *node) {
-  CHECK(node);
-  node->next = 0;
-  if (first_ == 0 && last_ == 0) {
-    first_ = last_ = node;
-  } else {
-    CHECK(first_);
-    CHECK(last_);
-    last_->next = node;
-    last_ = node;
-  }
+uptr FakeStack::ComputeStackSizeLog(uptr stack_size) {
+  // Limit the number of frames when running with unlimited stack.
+  if (stack_size > (1UL << kMaxStackSizeLog))
+    return kMaxStackSizeLog;
+  if (stack_size < (1UL << kMinStackSizeLog))
+    return kMinStackSizeLog;
+  return Log2(RoundUpToPowerOfTwo(stack_size));
 }
 
-FakeFrame *FakeFrameFifo::FifoPop() {
-  CHECK(first_ && last_ && "Exhausted fake stack");
-  FakeFrame *res = 0;
-  if (first_ == last_) {
-    res = first_;
-    first_ = last_ = 0;
-  } else {
-    res = first_;
-    first_ = first_->next;
-  }
-  return res;
+void FakeStack::Init(uptr stack_size) {
+  stack_size_ = stack_size;
+  stack_size_log_ = ComputeStackSizeLog(stack_size);
+  mem_ = (uptr)MmapOrDie(MmapSize(), "FakeStack");
+  ResetFrames();
 }
 
-void FakeStack::Init(uptr stack_size) {
+void FakeStack::Reset(uptr stack_size) {
+  if (!mem_ || ComputeStackSizeLog(stack_size) != stack_size_log_) {
+    Cleanup();
+    Init(stack_size);
+    return;
+  }
   stack_size_ = stack_size;
+  // The shadow of the frames is left as the previous thread left it: it is
+  // unpoisoned by AllocateStack() when a frame is handed out.
+  ResetFrames();
+}
+
+void FakeStack::ResetFrames() {
+  for (uptr i = 0; i < kNumberOfSizeClasses; i++) {
+    hint_[i] = 0;
+    internal_memset(bitmap_[i], 0, sizeof(bitmap_[i]));
+    uptr n_frames = NumFramesInClass(i);
+    if (n_frames % kBitsPerWord)
+      bitmap_[i][n_frames / kBitsPerWord] =
+          ~(uptr)0 << (n_frames % kBitsPerWord);
+  }
+  needs_gc_ = false;
   alive_ = true;
 }
 
 void FakeStack::Cleanup() {
   alive_ = false;
-  for (uptr i = 0; i < kNumberOfSizeClasses; i++) {
-    uptr mem = allocated_size_classes_[i];
-    if (mem) {
-      PoisonShadow(mem, ClassMmapSize(i), 0);
-      allocated_size_classes_[i] = 0;
-      UnmapOrDie((void*)mem, ClassMmapSize(i));
-    }
+  if (mem_) {
+    PoisonShadow(mem_, MmapSize(), 0);
+    UnmapOrDie((void*)mem_, MmapSize());
+    mem_ = 0;
   }
 }
 
-uptr FakeStack::ClassMmapSize(uptr size_class) {
-  // Limit allocation size to ClassSize * MaxDepth when running with unlimited
-  // stack.
-  return RoundUpTo(Min(ClassSize(size_class) * kMaxRecursionDepth, stack_size_),
-                   GetPageSizeCached());
+ALWAYS_INLINE uptr FakeStack::AllocateFrame(uptr size_class) {
+  uptr *bitmap = bitmap_[size_class];
+  uptr n_words = NumBitmapWords(size_class);
+  uptr pos = hint_[size_class];
+  uptr w = pos / kBitsPerWord;
+  // Look at the frames after the hint first, then wrap around.
+  uptr free_bits = ~bitmap[w] & (~(uptr)0 << (pos % kBitsPerWord));
+  for (uptr i = 0; i <= n_words; i++) {
+    if (free_bits) {
+      uptr bit = LeastSignificantSetBitIndex(free_bits);
+      bitmap[w] |= (uptr)1 << bit;
+      uptr idx = w * kBitsPerWord + bit;
+      hint_[size_class] = idx + 1 == NumFramesInClass(size_class) ? 0 : idx + 1;
+      return ClassBeg(size_class) + idx * ClassSize(size_class);
+    }
+    w = w + 1 == n_words ? 0 : w + 1;
+    free_bits = ~bitmap[w];
+  }
+  return 0;
 }
 
-void FakeStack::AllocateOneSizeClass(uptr size_class) {
-  CHECK(ClassMmapSize(size_class) >= GetPageSizeCached());
-  uptr new_mem = (uptr)MmapOrDie(
-      ClassMmapSize(size_class), __FUNCTION__);
-  // Printf("T%d new_mem[%zu]: %p-%p mmap %zu\n",
-  //       GetCurrentThread()->tid(),
-  //       size_class, new_mem, new_mem + ClassMmapSize(size_class),
-  //       ClassMmapSize(size_class));
-  uptr i;
-  for (i = 0; i < ClassMmapSize(size_class);
-       i += ClassSize(size_class)) {
-    size_classes_[size_class].FifoPush((FakeFrame*)(new_mem + i));
+void FakeStack::GC(uptr real_stack) {
+  needs_gc_ = false;
+  for (uptr size_class = 0; size_class < kNumberOfSizeClasses; size_class++) {
+    uptr *bitmap = bitmap_[size_class];
+    uptr n_frames = NumFramesInClass(size_class);
+    uptr n_words = NumBitmapWords(size_class);
+    for (uptr w = 0; w < n_words; w++) {
+      uptr used_bits = bitmap[w];
+      while (used_bits) {
+        uptr bit = LeastSignificantSetBitIndex(used_bits);
+        used_bits &= ~((uptr)1 << bit);
+        uptr idx = w * kBitsPerWord + bit;
+        if (idx >= n_frames) break;
+        FakeFrame *fake_frame = (FakeFrame*)(ClassBeg(size_class) +
+                                             idx * ClassSize(size_class));
+        if (fake_frame->real_stack > real_stack) continue;
+        bitmap[w] &= ~((uptr)1 << bit);
+        PoisonShadow((uptr)fake_frame, fake_frame->size_minus_one + 1,
+                     kAsanStackAfterReturnMagic);
+      }
+    }
   }
-  CHECK(i == ClassMmapSize(size_class));
-  allocated_size_classes_[size_class] = new_mem;
 }
 
 ALWAYS_INLINE uptr FakeStack::AllocateStack(uptr size, uptr real_stack) {
   if (!alive_) return real_stack;
   CHECK(size <= kMaxStackMallocSize && size > 1);
+  if (needs_gc_)
+    GC(real_stack);
   uptr size_class = ComputeSizeClass(size);
-  if (!allocated_size_classes_[size_class]) {
-    AllocateOneSizeClass(size_class);
+  uptr ptr = AllocateFrame(size_class);
+  if (!ptr) {
+    GC(real_stack);
+    ptr = AllocateFrame(size_class);
+    // Too deep a recursion; fall back to the real stack.
+    if (!ptr) return real_stack;
   }
-  FakeFrame *fake_frame = size_classes_[size_class].FifoPop();
-  CHECK(fake_frame);
+  FakeFrame *fake_frame = (FakeFrame*)ptr;
   fake_frame->size_minus_one = size - 1;
   fake_frame->real_stack = real_stack;
-  while (FakeFrame *top = call_stack_.top()) {
-    if (top->real_stack > real_stack) break;
-    call_stack_.LifoPop();
-    DeallocateFrame(top);
-  }
-  call_stack_.LifoPush(fake_frame);
-  uptr ptr = (uptr)fake_frame;
   PoisonShadow(ptr, size, 0);
   return ptr;
 }
 
-ALWAYS_INLINE void FakeStack::DeallocateFrame(FakeFrame *fake_frame) {
-  CHECK(alive_);
-  uptr size = static_cast<uptr>(fake_frame->size_minus_one + 1);
-  uptr size_class = ComputeSizeClass(size);
-  CHECK(allocated_size_classes_[size_class]);
-  uptr ptr = (uptr)fake_frame;
-  CHECK(AddrIsInSizeClass(ptr, size_class));
-  CHECK(AddrIsInSizeClass(ptr + size - 1, size_class));
-  size_classes_[size_class].FifoPush(fake_frame);
-}
-
-ALWAYS_INLINE void FakeStack::OnFree(uptr ptr, uptr size, uptr real_stack) {
+ALWAYS_INLINE void FakeStack::DeallocateStack(uptr ptr, uptr size) {
   FakeFrame *fake_frame = (FakeFrame*)ptr;
   CHECK_EQ(fake_frame->magic, kRetiredStackFrameMagic);
   CHECK_NE(fake_frame->descr, 0);
   CHECK_EQ(fake_frame->size_minus_one, size - 1);
-  PoisonShadow(ptr, size, kAsanStackAfterReturnMagic);
+  uptr size_class = ComputeSizeClass(size);
+  CHECK_EQ(AddrIsInFakeStack(ptr), ptr);
+  CHECK_EQ((ptr - mem_) >> stack_size_log_, size_class);
+  uptr idx = (ptr - ClassBeg(size_class)) / ClassSize(size_class);
+  uptr mask = (uptr)1 << (idx % kBitsPerWord);
+  uptr *word = &bitmap_[size_class][idx / kBitsPerWord];
+  // The frame may have been collected by GC already.
+  if (*word & mask) {
+    *word &= ~mask;
+    PoisonShadow(ptr, size, kAsanStackAfterReturnMagic);
+  }
 }
 
 }  // namespace __asan
@@ -177,6 +192,9 @@ uptr __asan_stack_malloc(uptr size, uptr real_stack) {
 void __asan_stack_free(uptr ptr, uptr size, uptr real_stack) {
   if (!flags()->use_fake_stack) return;
   if (ptr != real_stack) {
-    FakeStack::OnFree(ptr, size, real_stack);
+    AsanThread *t = GetCurrentThread();
+    // If TSD is gone, so is the fake stack.
+    if (t && t->fake_stack())
+      t->fake_stack()->DeallocateStack(ptr, size);
   }
 }
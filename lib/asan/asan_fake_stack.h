@@ -25,39 +25,6 @@ struct FakeFrame {
   u64 real_stack     : 48;
   u64 size_minus_one : 16;
   // End of the first 32 bytes.
-  // The rest should not be used when the frame is active.
-  FakeFrame *next;
-};
-
-struct FakeFrameFifo {
- public:
-  void FifoPush(FakeFrame *node);
-  FakeFrame *FifoPop();
- private:
-  FakeFrame *first_, *last_;
-};
-
-template<uptr kMaxNumberOfFrames>
-class FakeFrameLifo {
- public:
-  explicit FakeFrameLifo(LinkerInitialized) {}
-  FakeFrameLifo() : n_frames_(0) {}
-  void LifoPush(FakeFrame *node) {
-    CHECK_LT(n_frames_, kMaxNumberOfFrames);
-    frames_[n_frames_++] = node;
-  }
-  void LifoPop() {
-    CHECK(n_frames_);
-    n_frames_--;
-  }
-  FakeFrame *top() {
-    if (n_frames_ == 0)
-      return 0;
-    return frames_[n_frames_ - 1];
-  }
- private:
-  uptr n_frames_;
-  FakeFrame *frames_[kMaxNumberOfFrames];
 };
 
 // For each thread we create a fake stack and place stack objects on this fake
@@ -66,16 +33,27 @@ class FakeFrameLifo {
 // is not poped but remains there for quite some time until gets used again.
 // So, we poison the objects on the fake stack when function returns.
 // It helps us find use-after-return bugs.
-// We can not rely on __asan_stack_free being called on every function exit,
-// so we maintain a lifo list of all current fake frames and update it on every
-// call to __asan_stack_malloc.
+// Each size class is a fixed-size array of frames mapped at Init; a bitmap
+// tracks the frames in use. Frames are handed out round-robin so that a
+// released frame stays poisoned for as long as possible.
+// We can not rely on __asan_stack_free being called on every function exit
+// (longjmp, exceptions), so frames whose real stack is not above the real
+// stack of the new frame are released in bulk (see GC).
 class FakeStack {
  public:
   void Init(uptr stack_size);
+  // Prepares the fake stack of a finished thread for a new thread, keeping
+  // the mapping if its size fits the new stack.
+  void Reset(uptr stack_size);
   void StopUsingFakeStack() { alive_ = false; }
+  // Undoes StopUsingFakeStack(), unless the stack was cleaned up.
+  void ResumeUsingFakeStack() { alive_ = mem_ != 0; }
   void Cleanup();
   uptr AllocateStack(uptr size, uptr real_stack);
-  static void OnFree(uptr ptr, uptr size, uptr real_stack);
+  void DeallocateStack(uptr ptr, uptr size);
+  // The stack is about to be unwound; collect dead frames on the next
+  // allocation.
+  void HandleNoReturn() { needs_gc_ = true; }
   // Return the bottom of the maped region.
   uptr AddrIsInFakeStack(uptr addr);
   uptr StackSize() const { return stack_size_; }
@@ -86,28 +64,49 @@ class FakeStack {
   static const uptr kMaxStackMallocSize = 1 << kMaxStackFrameSizeLog;
   static const uptr kNumberOfSizeClasses =
       kMaxStackFrameSizeLog - kMinStackFrameSizeLog + 1;
-  static const uptr kMaxRecursionDepth = 15000;
-
-  bool AddrIsInSizeClass(uptr addr, uptr size_class);
-
-  // Each size class should be large enough to hold all frames.
-  uptr ClassMmapSize(uptr size_class);
+  // Each size class takes (1 << stack_size_log_) bytes.
+  static const uptr kMinStackSizeLog = kMaxStackFrameSizeLog;
+  static const uptr kMaxStackSizeLog = 23;
+  static const uptr kBitsPerWord = SANITIZER_WORDSIZE;
+  static const uptr kMaxBitmapWords =
+      (1UL << (kMaxStackSizeLog - kMinStackFrameSizeLog)) / kBitsPerWord;
 
   uptr ClassSize(uptr size_class) {
     return 1UL << (size_class + kMinStackFrameSizeLog);
   }
+  uptr NumFramesInClass(uptr size_class) {
+    return 1UL << (stack_size_log_ - kMinStackFrameSizeLog - size_class);
+  }
+  uptr NumBitmapWords(uptr size_class) {
+    return RoundUpTo(NumFramesInClass(size_class), kBitsPerWord) /
+           kBitsPerWord;
+  }
+  uptr ClassBeg(uptr size_class) {
+    return mem_ + (size_class << stack_size_log_);
+  }
+  uptr MmapSize() { return kNumberOfSizeClasses << stack_size_log_; }
 
-  void DeallocateFrame(FakeFrame *fake_frame);
-
+  static uptr ComputeStackSizeLog(uptr stack_size);
   uptr ComputeSizeClass(uptr alloc_size);
-  void AllocateOneSizeClass(uptr size_class);
+  // Marks all frames free.
+  void ResetFrames();
+  // Returns 0 if all frames of the class are in use.
+  uptr AllocateFrame(uptr size_class);
+  // Releases the frames that belong to functions which are no longer on
+  // the real stack.
+  void GC(uptr real_stack);
 
   uptr stack_size_;
-  bool   alive_;
-
-  uptr allocated_size_classes_[kNumberOfSizeClasses];
-  FakeFrameFifo size_classes_[kNumberOfSizeClasses];
-  FakeFrameLifo<kMaxRecursionDepth> call_stack_;
+  uptr stack_size_log_;
+  uptr mem_;
+  bool alive_;
+  bool needs_gc_;
+
+  // Index of the frame to try first, for each size class.
+  uptr hint_[kNumberOfSizeClasses];
+  // One bit per frame, set if the frame is in use. Bits past the last frame
+  // of a class are always set.
+  uptr bitmap_[kNumberOfSizeClasses][kMaxBitmapWords];
 };
 
 COMPILER_CHECK(sizeof(FakeStack) <= (1 << 17));
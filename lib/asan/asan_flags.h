@@ -73,16 +73,32 @@ struct Flags {
   bool use_sigaltstack;
   // Allow the users to work around the bug in Nvidia drivers prior to 295.*.
   bool check_malloc_usable_size;
+  // If set, realloc() resizes large chunks in place or moves them with
+  // mremap instead of copying. Accesses through the old pointer are then
+  // no longer reported as use-after-free.
+  bool large_realloc_in_place;
   // If set, explicitly unmaps (huge) shadow at exit.
   bool unmap_shadow_on_exit;
+  // Number of threads used to unmap the shadow if unmap_shadow_on_exit is set.
+  int unmap_shadow_threads;
   // If set, calls abort() instead of _exit() after printing an error report.
   bool abort_on_error;
+  // If false, the program keeps running after reporting an invalid memory
+  // access made by an interceptor or reported through __asan_report_error().
+  // Only the first error at each pc and access type is reported, the number
+  // of repeats is printed at exit. Other errors (e.g. double-free) are still
+  // fatal. The compiler-inserted checks do not return after a report.
+  bool halt_on_error;
   // Print various statistics after printing an error message or if atexit=1.
   bool print_stats;
   // Print the legend for the shadow bytes.
   bool print_legend;
   // If set, prints ASan exit stats even after program terminates successfully.
   bool atexit;
+  // If set, a background thread appends allocator stats to this file every
+  // stats_dump_interval_ms milliseconds.
+  const char *stats_dump_path;
+  int stats_dump_interval_ms;
   // By default, disable core dumper on 64-bit - it makes little sense
   // to dump 16T+ core.
   bool disable_core;
@@ -106,6 +122,46 @@ struct Flags {
   // If true, assume that dynamic initializers can never access globals from
   // other modules, even if the latter are already initialized.
   bool strict_init_order;
+  // If non-negative, free memory of the primary allocator is returned to the
+  // OS at most once per release_to_os_interval_ms milliseconds.
+  int release_to_os_interval_ms;
+  // If true, when free memory of the primary allocator is returned to the OS,
+  // its shadow is reclaimed as well: all-zero shadow pages are released, and
+  // the pages of free chunk poison are shared copy-on-write.
+  bool release_heap_shadow;
+  // Up to this many megabytes of freed large mappings are kept around and
+  // reused by subsequent large allocations instead of being unmapped.
+  int large_alloc_cache_size_mb;
+  // Cached large mappings older than this many milliseconds are unmapped.
+  // Negative value means no age limit.
+  int large_alloc_cache_max_age_ms;
+  // If true, threads get small chunks from the part of the primary allocator
+  // dedicated to the NUMA node they run on, and the chunks are reused on that
+  // node after they are freed. This keeps the heap and its shadow local.
+  bool numa_allocator;
+  // If positive, heap redzones and the quarantine size are adapted to keep
+  // the heap overhead around this many percent of the live heap size.
+  // Half of the budget goes to redzones, the other half to the quarantine
+  // (at most quarantine_size). Useful on memory-constrained deployments.
+  int heap_overhead_budget;
+  // If heap_overhead_budget is set, one of this many allocations still gets
+  // the regular redzone.
+  int full_redzone_sample_rate;
+  // If greater than 1, only one of this many allocations is checked: gets
+  // redzones, quarantine and stack traces. Other allocations take a fast
+  // path and are not protected.
+  int sample_allocations;
+  // If true, sample_allocations applies to size classes rather than to
+  // single allocations: a random subset of size classes is checked.
+  bool sample_by_size_class;
+  // If non-negative, stack trace depth used for allocations of at most
+  // small_malloc_size bytes instead of malloc_context_size.
+  int small_malloc_context_size;
+  int small_malloc_size;
+  // If non-negative, stack trace depth used for deallocations instead of
+  // malloc_context_size. Small values make free() cheaper at the cost of
+  // less useful use-after-free reports.
+  int free_context_size;
 };
 
 extern Flags asan_flags_dont_use_directly;
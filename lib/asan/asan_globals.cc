@@ -27,23 +27,59 @@ namespace __asan {
 
 typedef __asan_global Global;
 
-struct ListOfGlobals {
-  const Global *g;
-  ListOfGlobals *next;
-};
-
 static BlockingMutex mu_for_globals(LINKER_INITIALIZED);
 static LowLevelAllocator allocator_for_globals;
-static ListOfGlobals *list_of_all_globals;
+
+// All registered globals, sorted by address on demand.
+static const int kGlobalsInitialCapacity = 1024;
+typedef InternalMmapVector<const Global *> VectorOfGlobalPtrs;
+// Lazy-initialized and never deleted.
+static VectorOfGlobalPtrs *all_globals;
+// all_globals[0, n_sorted_globals) is sorted.
+static uptr n_sorted_globals;
+static uptr max_global_size_with_redzone;
+
+// The globals of one __asan_register_globals() call, i.e. of one module,
+// which __asan_unregister_globals() gets with the same array. Looking it up
+// by the array makes the unregistration O(1) besides the shadow; the
+// globals of the dead groups stay in all_globals until enough of them pile
+// up (or an address is described), and are then dropped all at once.
+struct GlobalGroup {
+  const Global *globals;
+  uptr n;
+  // Range of the group's modules in dynamic_init_modules.
+  uptr dyn_init_beg, dyn_init_end;
+  u32 next;  // Next live group in the hash bucket, plus one.
+  bool live;
+};
+static const int kGlobalGroupsInitialCapacity = 64;
+typedef InternalMmapVector<GlobalGroup> VectorOfGroups;
+// Lazy-initialized and never deleted.
+static VectorOfGroups *global_groups;
+// Hash table of the live groups by their globals array, chained through
+// GlobalGroup::next. Holds the group indices plus one.
+static u32 *group_buckets;
+static uptr n_group_buckets;
+// The number of globals of the dead groups in all_globals.
+static uptr n_dead_globals;
 
 static const int kDynamicInitGlobalsInitialCapacity = 512;
-struct DynInitGlobal {
-  Global g;
+typedef InternalMmapVector<Global> VectorOfGlobals;
+// Lazy-initialized and never deleted.
+static VectorOfGlobals *dynamic_init_globals;
+
+// Globals of a module are registered together, so the dynamically
+// initialized ones form a range of dynamic_init_globals. Handling them by
+// module lets the init-order checks skip initialized modules entirely.
+struct DynInitModule {
+  const char *module_name;
+  uptr beg, end;  // Range in dynamic_init_globals.
   bool initialized;
 };
-typedef InternalMmapVector<DynInitGlobal> VectorOfGlobals;
+static const int kDynamicInitModulesInitialCapacity = 64;
+typedef InternalMmapVector<DynInitModule> VectorOfModules;
 // Lazy-initialized and never deleted.
-static VectorOfGlobals *dynamic_init_globals;
+static VectorOfModules *dynamic_init_modules;
 
 ALWAYS_INLINE void PoisonShadowForGlobal(const Global *g, u8 value) {
   FastPoisonShadow(g->beg, g->size_with_redzone, value);
@@ -68,12 +104,115 @@ static void ReportGlobal(const Global &g, const char *prefix) {
          g.module_name, g.has_dynamic_init);
 }
 
+static bool GlobalLess(const Global *a, const Global *b) {
+  return a->beg < b->beg;
+}
+
+// Returns the number of globals in all_globals with beg < addr.
+static uptr LowerBoundGlobal(uptr addr) {
+  uptr lo = 0, hi = n_sorted_globals;
+  while (lo < hi) {
+    uptr mid = lo + (hi - lo) / 2;
+    if ((*all_globals)[mid]->beg < addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static uptr GroupBucket(const Global *globals) {
+  return ((uptr)globals >> 4) * 2654435761U & (n_group_buckets - 1);
+}
+
+static GlobalGroup *FindGlobalGroup(const Global *globals) {
+  if (!group_buckets)
+    return 0;
+  for (u32 i = group_buckets[GroupBucket(globals)]; i;) {
+    GlobalGroup *group = &(*global_groups)[i - 1];
+    if (group->globals == globals)
+      return group;
+    i = group->next;
+  }
+  return 0;
+}
+
+static void InsertGlobalGroup(uptr idx) {
+  GlobalGroup *group = &(*global_groups)[idx];
+  u32 *bucket = &group_buckets[GroupBucket(group->globals)];
+  group->next = *bucket;
+  *bucket = idx + 1;
+}
+
+static void RemoveGlobalGroup(const GlobalGroup *group) {
+  u32 *link = &group_buckets[GroupBucket(group->globals)];
+  while (&(*global_groups)[*link - 1] != group)
+    link = &(*global_groups)[*link - 1].next;
+  *link = group->next;
+}
+
+// Rebuilds group_buckets, with room for twice the groups until it grows.
+static void RehashGlobalGroups() {
+  if (group_buckets)
+    UnmapOrDie(group_buckets, n_group_buckets * sizeof(group_buckets[0]));
+  n_group_buckets = RoundUpToPowerOfTwo(
+      Max<uptr>(4 * global_groups->size(), kGlobalGroupsInitialCapacity));
+  group_buckets = (u32 *)MmapOrDie(n_group_buckets * sizeof(group_buckets[0]),
+                                   "GlobalGroups");
+  for (uptr i = 0; i < global_groups->size(); i++) {
+    if ((*global_groups)[i].live)
+      InsertGlobalGroup(i);
+  }
+}
+
+// Drops the dead groups and their globals.
+static void DropDeadGlobalsLocked() {
+  if (!n_dead_globals)
+    return;
+  all_globals->clear();
+  n_sorted_globals = 0;
+  max_global_size_with_redzone = 0;
+  uptr n_live = 0;
+  for (uptr i = 0; i < global_groups->size(); i++) {
+    const GlobalGroup &group = (*global_groups)[i];
+    if (!group.live)
+      continue;
+    for (uptr j = 0; j < group.n; j++) {
+      all_globals->push_back(&group.globals[j]);
+      max_global_size_with_redzone =
+          Max(max_global_size_with_redzone, group.globals[j].size_with_redzone);
+    }
+    (*global_groups)[n_live++] = group;
+  }
+  while (global_groups->size() > n_live)
+    global_groups->pop_back();
+  n_dead_globals = 0;
+  RehashGlobalGroups();
+}
+
+static void SortGlobalsLocked() {
+  DropDeadGlobalsLocked();
+  if (n_sorted_globals == all_globals->size())
+    return;
+  InternalSort(all_globals, all_globals->size(), GlobalLess);
+  n_sorted_globals = all_globals->size();
+}
+
 bool DescribeAddressIfGlobal(uptr addr, uptr size) {
   if (!flags()->report_globals) return false;
   BlockingMutexLock lock(&mu_for_globals);
+  if (!all_globals) return false;
+  SortGlobalsLocked();
+  // The address may be described relative to a global if it is at most
+  // kMinimalDistanceFromAnotherGlobal bytes to the left of the global or
+  // inside it with its redzone. Look at all globals that may qualify.
+  static const uptr kMaxDistanceToTheLeft = 64;
   bool res = false;
-  for (ListOfGlobals *l = list_of_all_globals; l; l = l->next) {
-    const Global &g = *l->g;
+  uptr end = LowerBoundGlobal(addr + kMaxDistanceToTheLeft);
+  for (uptr i = end; i > 0; i--) {
+    const Global &g = *(*all_globals)[i - 1];
+    if (g.beg + max_global_size_with_redzone <= addr)
+      break;
     if (flags()->report_globals >= 2)
       ReportGlobal(g, "Search");
     res |= DescribeAddressRelativeToGlobal(addr, size, g);
@@ -94,20 +233,78 @@ static void RegisterGlobal(const Global *g) {
   CHECK(AddrIsAlignedByGranularity(g->size_with_redzone));
   if (flags()->poison_heap)
     PoisonRedZones(*g);
-  ListOfGlobals *l =
-      (ListOfGlobals*)allocator_for_globals.Allocate(sizeof(ListOfGlobals));
-  l->g = g;
-  l->next = list_of_all_globals;
-  list_of_all_globals = l;
+  if (all_globals == 0) {
+    void *mem = allocator_for_globals.Allocate(sizeof(VectorOfGlobalPtrs));
+    all_globals = new(mem) VectorOfGlobalPtrs(kGlobalsInitialCapacity);
+  }
+  all_globals->push_back(g);
+  max_global_size_with_redzone =
+      Max(max_global_size_with_redzone, g->size_with_redzone);
   if (g->has_dynamic_init) {
     if (dynamic_init_globals == 0) {
       void *mem = allocator_for_globals.Allocate(sizeof(VectorOfGlobals));
       dynamic_init_globals = new(mem)
           VectorOfGlobals(kDynamicInitGlobalsInitialCapacity);
+      mem = allocator_for_globals.Allocate(sizeof(VectorOfModules));
+      dynamic_init_modules = new(mem)
+          VectorOfModules(kDynamicInitModulesInitialCapacity);
+    }
+    uptr idx = dynamic_init_globals->size();
+    dynamic_init_globals->push_back(*g);
+    if (dynamic_init_modules->size() == 0 ||
+        dynamic_init_modules->back().module_name != g->module_name ||
+        dynamic_init_modules->back().end != idx) {
+      DynInitModule module = { g->module_name, idx, idx, false };
+      dynamic_init_modules->push_back(module);
+    }
+    dynamic_init_modules->back().end = idx + 1;
+  }
+}
+
+// Poisons all dynamically initialized globals of the module with the given
+// value, merging adjacent globals into one shadow store.
+static void PoisonDynInitModule(const DynInitModule &module, u8 value) {
+  uptr beg = 0, end = 0;
+  for (uptr i = module.beg; i < module.end; i++) {
+    const Global &g = (*dynamic_init_globals)[i];
+    if (g.beg != end) {
+      if (end != beg)
+        FastPoisonShadow(beg, end - beg, value);
+      beg = g.beg;
     }
-    DynInitGlobal dyn_global = { *g, false };
-    dynamic_init_globals->push_back(dyn_global);
+    end = g.beg + g.size_with_redzone;
+  }
+  if (end != beg)
+    FastPoisonShadow(beg, end - beg, value);
+}
+
+static void UnpoisonDynInitModule(const DynInitModule &module) {
+  // Unpoison the whole globals.
+  PoisonDynInitModule(module, 0);
+  // Poison redzones back.
+  for (uptr i = module.beg; i < module.end; i++)
+    PoisonRedZones((*dynamic_init_globals)[i]);
+}
+
+static void RegisterGlobalGroup(const Global *globals, uptr n) {
+  if (n == 0 || FindGlobalGroup(globals))
+    return;
+  if (global_groups == 0) {
+    void *mem = allocator_for_globals.Allocate(sizeof(VectorOfGroups));
+    global_groups = new(mem) VectorOfGroups(kGlobalGroupsInitialCapacity);
   }
+  GlobalGroup group = { globals, n, 0, 0, 0, true };
+  if (dynamic_init_modules)
+    group.dyn_init_beg = dynamic_init_modules->size();
+  for (uptr i = 0; i < n; i++)
+    RegisterGlobal(&globals[i]);
+  if (dynamic_init_modules)
+    group.dyn_init_end = dynamic_init_modules->size();
+  global_groups->push_back(group);
+  if (2 * global_groups->size() > n_group_buckets)
+    RehashGlobalGroups();
+  else
+    InsertGlobalGroup(global_groups->size() - 1);
 }
 
 static void UnregisterGlobal(const Global *g) {
@@ -119,8 +316,39 @@ static void UnregisterGlobal(const Global *g) {
   if (flags()->poison_heap)
     PoisonShadowForGlobal(g, 0);
   // We unpoison the shadow memory for the global but we do not remove it from
-  // the list because that would require O(n^2) time with the current list
-  // implementation. It might not be worth doing anyway.
+  // all_globals because that would require O(n) time per global.
+  // It might not be worth doing anyway.
+}
+
+static void UnregisterGlobalGroup(GlobalGroup *group) {
+  CHECK(asan_inited);
+  CHECK(flags()->report_globals);
+  if (flags()->poison_heap) {
+    // Unpoison the adjacent globals with one shadow store.
+    uptr beg = 0, end = 0;
+    for (uptr i = 0; i < group->n; i++) {
+      const Global &g = group->globals[i];
+      if (flags()->report_globals >= 2)
+        ReportGlobal(g, "Removed");
+      if (g.beg != end) {
+        if (end != beg)
+          FastPoisonShadow(beg, end - beg, 0);
+        beg = g.beg;
+      }
+      end = g.beg + g.size_with_redzone;
+    }
+    if (end != beg)
+      FastPoisonShadow(beg, end - beg, 0);
+  }
+  // The module is unloaded, don't poison its globals before the later
+  // dynamic initializers.
+  for (uptr i = group->dyn_init_beg; i < group->dyn_init_end; i++)
+    (*dynamic_init_modules)[i].initialized = true;
+  RemoveGlobalGroup(group);
+  group->live = false;
+  n_dead_globals += group->n;
+  if (2 * n_dead_globals > all_globals->size())
+    DropDeadGlobalsLocked();
 }
 
 void StopInitOrderChecking() {
@@ -128,13 +356,10 @@ void StopInitOrderChecking() {
   if (!flags()->check_initialization_order || !dynamic_init_globals)
     return;
   flags()->check_initialization_order = false;
-  for (uptr i = 0, n = dynamic_init_globals->size(); i < n; ++i) {
-    DynInitGlobal &dyn_g = (*dynamic_init_globals)[i];
-    const Global *g = &dyn_g.g;
-    // Unpoison the whole global.
-    PoisonShadowForGlobal(g, 0);
-    // Poison redzones back.
-    PoisonRedZones(*g);
+  for (uptr i = 0, n = dynamic_init_modules->size(); i < n; ++i) {
+    const DynInitModule &module = (*dynamic_init_modules)[i];
+    if (!module.initialized)
+      UnpoisonDynInitModule(module);
   }
 }
 
@@ -147,9 +372,7 @@ using namespace __asan;  // NOLINT
 void __asan_register_globals(__asan_global *globals, uptr n) {
   if (!flags()->report_globals) return;
   BlockingMutexLock lock(&mu_for_globals);
-  for (uptr i = 0; i < n; i++) {
-    RegisterGlobal(&globals[i]);
-  }
+  RegisterGlobalGroup(globals, n);
 }
 
 // Unregister an array of globals.
@@ -157,6 +380,10 @@ void __asan_register_globals(__asan_global *globals, uptr n) {
 void __asan_unregister_globals(__asan_global *globals, uptr n) {
   if (!flags()->report_globals) return;
   BlockingMutexLock lock(&mu_for_globals);
+  if (GlobalGroup *group = FindGlobalGroup(globals)) {
+    UnregisterGlobalGroup(group);
+    return;
+  }
   for (uptr i = 0; i < n; i++) {
     UnregisterGlobal(&globals[i]);
   }
@@ -177,15 +404,14 @@ void __asan_before_dynamic_init(const char *module_name) {
   BlockingMutexLock lock(&mu_for_globals);
   if (flags()->report_globals >= 3)
     Printf("DynInitPoison module: %s\n", module_name);
-  for (uptr i = 0, n = dynamic_init_globals->size(); i < n; ++i) {
-    DynInitGlobal &dyn_g = (*dynamic_init_globals)[i];
-    const Global *g = &dyn_g.g;
-    if (dyn_g.initialized)
+  for (uptr i = 0, n = dynamic_init_modules->size(); i < n; ++i) {
+    DynInitModule &module = (*dynamic_init_modules)[i];
+    if (module.initialized)
       continue;
-    if (g->module_name != module_name)
-      PoisonShadowForGlobal(g, kAsanInitializationOrderMagic);
+    if (module.module_name != module_name)
+      PoisonDynInitModule(module, kAsanInitializationOrderMagic);
     else if (!strict_init_order)
-      dyn_g.initialized = true;
+      module.initialized = true;
   }
 }
 
@@ -199,14 +425,9 @@ void __asan_after_dynamic_init() {
   CHECK(asan_inited);
   BlockingMutexLock lock(&mu_for_globals);
   // FIXME: Optionally report that we're unpoisoning globals from a module.
-  for (uptr i = 0, n = dynamic_init_globals->size(); i < n; ++i) {
-    DynInitGlobal &dyn_g = (*dynamic_init_globals)[i];
-    const Global *g = &dyn_g.g;
-    if (!dyn_g.initialized) {
-      // Unpoison the whole global.
-      PoisonShadowForGlobal(g, 0);
-      // Poison redzones back.
-      PoisonRedZones(*g);
-    }
+  for (uptr i = 0, n = dynamic_init_modules->size(); i < n; ++i) {
+    const DynInitModule &module = (*dynamic_init_modules)[i];
+    if (!module.initialized)
+      UnpoisonDynInitModule(module);
   }
 }
@@ -23,6 +23,7 @@
 #include "asan_stats.h"
 #include "interception/interception.h"
 #include "sanitizer_common/sanitizer_libc.h"
+#include "sanitizer_common/sanitizer_timing.h"
 
 namespace __asan {
 
@@ -33,6 +34,14 @@ static inline bool QuickCheckForUnpoisonedRegion(uptr beg, uptr size) {
     return !AddressIsPoisoned(beg) &&
            !AddressIsPoisoned(beg + size - 1) &&
            !AddressIsPoisoned(beg + size / 2);
+  // The redzones are at least 16 bytes, so a check every 16 bytes still
+  // finds the overflows.
+  if (size <= 64)
+    return !AddressIsPoisoned(beg) &&
+           !AddressIsPoisoned(beg + size / 4) &&
+           !AddressIsPoisoned(beg + size / 2) &&
+           !AddressIsPoisoned(beg + 3 * size / 4) &&
+           !AddressIsPoisoned(beg + size - 1);
   return false;
 }
 
@@ -42,6 +51,7 @@ static inline bool QuickCheckForUnpoisonedRegion(uptr beg, uptr size) {
 // relevant information only.
 // We check all shadow bytes.
 #define ACCESS_MEMORY_RANGE(offset, size, isWrite) do {                 \
+    ScopedTiming __timing(kTimingMemoryRangeCheck);                     \
     uptr __offset = (uptr)(offset);                                     \
     uptr __size = (uptr)(size);                                         \
     uptr __bad = 0;                                                     \
@@ -109,6 +119,7 @@ DECLARE_REAL_AND_INTERCEPTOR(void, free, void *)
   ASAN_WRITE_RANGE(ptr, size)
 #define COMMON_INTERCEPTOR_READ_RANGE(ctx, ptr, size) ASAN_READ_RANGE(ptr, size)
 #define COMMON_INTERCEPTOR_ENTER(ctx, func, ...)              \
+  ScopedTiming timing(kTimingInterceptor);                    \
   do {                                                        \
     if (asan_init_is_running) return REAL(func)(__VA_ARGS__); \
     ctx = 0;                                                  \
@@ -165,6 +176,17 @@ INTERCEPTOR(int, pthread_create, void *thread,
 }
 #endif  // ASAN_INTERCEPT_PTHREAD_CREATE
 
+namespace __asan {
+bool StartInternalThread(void *(*func)(void *arg), void *arg) {
+#if ASAN_INTERCEPT_PTHREAD_CREATE
+  void *th;
+  return REAL(pthread_create) && REAL(pthread_create)(&th, 0, func, arg) == 0;
+#else
+  return false;
+#endif
+}
+}  // namespace __asan
+
 #if ASAN_INTERCEPT_SIGNAL_AND_SIGACTION
 INTERCEPTOR(void*, signal, int signum, void *handler) {
   if (!AsanInterceptsSignal(signum) || flags()->allow_user_segv_handler) {
@@ -84,6 +84,16 @@ extern "C" {
       SANITIZER_INTERFACE_ATTRIBUTE;
   void __asan_unpoison_memory_region(void const volatile *addr, uptr size)
       SANITIZER_INTERFACE_ATTRIBUTE;
+  void __asan_poison_memory_regions(const void *const *addrs,
+                                    const uptr *sizes, uptr n)
+      SANITIZER_INTERFACE_ATTRIBUTE;
+  void __asan_unpoison_memory_regions(const void *const *addrs,
+                                      const uptr *sizes, uptr n)
+      SANITIZER_INTERFACE_ATTRIBUTE;
+  void __asan_poison_memory_region_except(
+      void const volatile *addr, uptr size,
+      const void *const *live_addrs, const uptr *live_sizes, uptr n)
+      SANITIZER_INTERFACE_ATTRIBUTE;
 
   bool __asan_address_is_poisoned(void const volatile *addr)
       SANITIZER_INTERFACE_ATTRIBUTE;
@@ -129,6 +139,22 @@ extern "C" {
   void __asan_print_accumulated_stats()
       SANITIZER_INTERFACE_ATTRIBUTE;
 
+  // Same layout as in sanitizer/asan_interface.h.
+  struct __asan_heap_stats {
+    uptr mallocs, malloced;
+    uptr frees, freed;
+    uptr real_frees, really_freed;
+    uptr mmaps, mmaped, munmaps, munmaped;
+    uptr quarantine_size;
+    uptr cache_refills, cache_drains;
+    uptr num_size_classes;
+    uptr class_size[256];
+    uptr mallocs_by_class[256];
+    uptr frees_by_class[256];
+  };
+  void __asan_get_stats(__asan_heap_stats *stats)
+      SANITIZER_INTERFACE_ATTRIBUTE;
+
   /* OPTIONAL */ const char* __asan_default_options()
       SANITIZER_WEAK_ATTRIBUTE SANITIZER_INTERFACE_ATTRIBUTE;
 
@@ -50,6 +50,15 @@
 # define ASAN_FLEXIBLE_MAPPING_AND_OFFSET 0
 #endif
 
+// Shadow scale of the fixed mapping, i.e. when
+// ASAN_FLEXIBLE_MAPPING_AND_OFFSET is 0: every shadow byte describes
+// 2^ASAN_SHADOW_SCALE bytes of application memory. Scales 3 to 6 are
+// supported; the instrumented code must be built with the same scale
+// (-mllvm -asan-mapping-scale=N).
+#ifndef ASAN_SHADOW_SCALE
+# define ASAN_SHADOW_SCALE 3
+#endif
+
 // If set, values like allocator chunk size, as well as defaults for some flags
 // will be changed towards less memory overhead.
 #ifndef ASAN_LOW_MEMORY
@@ -60,6 +69,12 @@
 # endif
 #endif
 
+// If set, the allocator uses DenseSizeClassMap: less memory is lost to the
+// rounding of the chunk sizes, at the price of more size classes.
+#ifndef ASAN_DENSE_SIZE_CLASSES
+# define ASAN_DENSE_SIZE_CLASSES 0
+#endif
+
 #ifndef ASAN_USE_PREINIT_ARRAY
 # define ASAN_USE_PREINIT_ARRAY (SANITIZER_LINUX && !SANITIZER_ANDROID)
 #endif
@@ -93,6 +108,17 @@ void InstallSignalHandlers();
 void ReadContextStack(void *context, uptr *stack, uptr *ssize);
 void AsanPlatformThreadInit();
 void StopInitOrderChecking();
+// Shadow blocks of this size can be shared in memory, see below.
+const uptr kSharedShadowPoisonSize = 1 << 16;
+// Creates the shared contents of the blocks: kSharedShadowPoisonSize copies
+// of value. Returns false if the platform can not share shadow blocks.
+bool InitSharedShadowPoison(u8 value);
+// Replaces the aligned shadow block at beg with a copy-on-write view of the
+// shared contents, so it takes no memory until it is written.
+bool MapSharedShadowPoison(uptr beg);
+// Starts a thread unknown to ASan. The thread must not call intercepted
+// functions. Returns false if threads can not be started.
+bool StartInternalThread(void *(*func)(void *arg), void *arg);
 
 // Wrapper for TLS/TSD.
 void AsanTSDInit(void (*destructor)(void *tsd));
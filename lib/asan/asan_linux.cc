@@ -119,6 +119,49 @@ void ReadContextStack(void *context, uptr *stack, uptr *ssize) {
 }
 #endif
 
+// An unlinked file filled with a shadow value.
+static fd_t shared_poison_fd = kInvalidFd;
+
+bool InitSharedShadowPoison(u8 value) {
+  if (shared_poison_fd != kInvalidFd)
+    return true;
+  const char *tmpdir = GetEnv("TMPDIR");
+#ifdef P_tmpdir
+  if (tmpdir == 0)
+    tmpdir = P_tmpdir;
+#endif
+  if (tmpdir == 0)
+    return false;
+  char filename[256];
+  internal_snprintf(filename, sizeof(filename), "%s/asan.poison.%d",
+                    tmpdir, (int)internal_getpid());
+  uptr openrv = internal_open(filename, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (internal_iserror(openrv))
+    return false;
+  fd_t fd = openrv;
+  internal_unlink(filename);
+  InternalScopedBuffer<u8> poison(kSharedShadowPoisonSize);
+  internal_memset(poison.data(), value, poison.size());
+  if (internal_write(fd, poison.data(), poison.size()) != poison.size()) {
+    internal_close(fd);
+    return false;
+  }
+  shared_poison_fd = fd;
+  return true;
+}
+
+bool MapSharedShadowPoison(uptr beg) {
+  CHECK(IsAligned(beg, kSharedShadowPoisonSize));
+  if (shared_poison_fd == kInvalidFd)
+    return false;
+  // A private mapping: the page cache pages are shared by all the mappings
+  // until they are written, and then the kernel copies them.
+  uptr res = internal_mmap((void*)beg, kSharedShadowPoisonSize,
+                           PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                           shared_poison_fd, 0);
+  return !internal_iserror(res);
+}
+
 }  // namespace __asan
 
 #endif  // SANITIZER_LINUX
@@ -249,6 +249,14 @@ void ReadContextStack(void *context, uptr *stack, uptr *ssize) {
   UNIMPLEMENTED();
 }
 
+bool InitSharedShadowPoison(u8 value) {
+  return false;
+}
+
+bool MapSharedShadowPoison(uptr beg) {
+  return false;
+}
+
 // Support for the following functions from libdispatch on Mac OS:
 //   dispatch_async_f()
 //   dispatch_async()
@@ -71,7 +71,7 @@ INTERCEPTOR(void, cfree, void *ptr) {
 }
 
 INTERCEPTOR(void*, malloc, uptr size) {
-  GET_STACK_TRACE_MALLOC;
+  GET_STACK_TRACE_MALLOC_SIZE(size);
   return asan_malloc(size, &stack);
 }
 
@@ -87,7 +87,7 @@ INTERCEPTOR(void*, calloc, uptr nmemb, uptr size) {
     CHECK(allocated < kCallocPoolSize);
     return mem;
   }
-  GET_STACK_TRACE_MALLOC;
+  GET_STACK_TRACE_MALLOC_SIZE(nmemb * size);
   return asan_calloc(nmemb, size, &stack);
 }
 
@@ -97,7 +97,7 @@ INTERCEPTOR(void*, realloc, void *ptr, uptr size) {
 }
 
 INTERCEPTOR(void*, memalign, uptr boundary, uptr size) {
-  GET_STACK_TRACE_MALLOC;
+  GET_STACK_TRACE_MALLOC_SIZE(size);
   return asan_memalign(boundary, size, &stack, FROM_MALLOC);
 }
 
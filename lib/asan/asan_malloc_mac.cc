@@ -196,19 +196,22 @@ void *mz_valloc(malloc_zone_t *zone, size_t size) {
   malloc_zone_t *zone_ptr = malloc_zone_from_ptr(ptr); \
   const char *zone_name = (zone_ptr == 0) ? 0 : zone_ptr->zone_name
 
-void ALWAYS_INLINE free_common(void *context, void *ptr) {
-  if (!ptr) return;
-  GET_STACK_TRACE_FREE;
+void ALWAYS_INLINE free_with_stack(void *ptr, StackTrace *stack) {
   // FIXME: need to retire this flag.
   if (!flags()->mac_ignore_invalid_free) {
-    asan_free(ptr, &stack, FROM_MALLOC);
+    asan_free(ptr, stack, FROM_MALLOC);
   } else {
     GET_ZONE_FOR_PTR(ptr);
-    WarnMacFreeUnallocated((uptr)ptr, (uptr)zone_ptr, zone_name, &stack);
-    return;
+    WarnMacFreeUnallocated((uptr)ptr, (uptr)zone_ptr, zone_name, stack);
   }
 }
 
+void ALWAYS_INLINE free_common(void *context, void *ptr) {
+  if (!ptr) return;
+  GET_STACK_TRACE_FREE;
+  free_with_stack(ptr, &stack);
+}
+
 // TODO(glider): the allocation callbacks need to be refactored.
 void mz_free(malloc_zone_t *zone, void *ptr) {
   free_common(zone, ptr);
@@ -233,6 +236,34 @@ void *mz_realloc(malloc_zone_t *zone, void *ptr, size_t size) {
   }
 }
 
+// Core Foundation allocates and frees objects in bulk through these. The
+// stack is unwound once for the whole batch.
+unsigned mz_batch_malloc(malloc_zone_t *zone, size_t size, void **results,
+                         unsigned num_requested) {
+  if (!asan_inited) {
+    CHECK(system_malloc_zone);
+    return malloc_zone_batch_malloc(system_malloc_zone, size, results,
+                                    num_requested);
+  }
+  GET_STACK_TRACE_MALLOC;
+  unsigned allocated = 0;
+  for (; allocated < num_requested; allocated++) {
+    results[allocated] = asan_malloc(size, &stack);
+    if (results[allocated] == 0)
+      break;
+  }
+  return allocated;
+}
+
+void mz_batch_free(malloc_zone_t *zone, void **to_be_freed,
+                   unsigned num_to_be_freed) {
+  GET_STACK_TRACE_FREE;
+  for (unsigned i = 0; i < num_to_be_freed; i++) {
+    if (to_be_freed[i])
+      free_with_stack(to_be_freed[i], &stack);
+  }
+}
+
 void mz_destroy(malloc_zone_t* zone) {
   // A no-op -- we will not be destroyed!
   Report("mz_destroy() called -- ignoring\n");
@@ -259,6 +290,18 @@ void mz_free_definite_size(malloc_zone_t* zone, void *ptr, size_t size) {
 #endif
 #endif
 
+#if defined(MAC_OS_X_VERSION_10_7) && \
+    MAC_OS_X_VERSION_MAX_ALLOWED >= MAC_OS_X_VERSION_10_7
+// Called by the system under memory pressure (and by
+// malloc_zone_pressure_relief()). Giving up quarantined memory makes
+// use-after-free detection weaker, but the process keeps running.
+size_t mz_pressure_relief(malloc_zone_t *zone, size_t goal) {
+  if (!asan_inited)
+    return 0;
+  return asan_mz_pressure_relief(goal);
+}
+#endif
+
 kern_return_t mi_enumerator(task_t task, void *,
                             unsigned type_mask, vm_address_t zone_address,
                             memory_reader_t reader,
@@ -337,8 +380,8 @@ void ReplaceSystemMalloc() {
   asan_zone.free = &mz_free;
   asan_zone.realloc = &mz_realloc;
   asan_zone.destroy = &mz_destroy;
-  asan_zone.batch_malloc = 0;
-  asan_zone.batch_free = 0;
+  asan_zone.batch_malloc = &mz_batch_malloc;
+  asan_zone.batch_free = &mz_batch_free;
   asan_zone.introspect = &asan_introspection;
 
   // from AvailabilityMacros.h
@@ -351,6 +394,13 @@ void ReplaceSystemMalloc() {
   asan_introspection.zone_locked = &mi_zone_locked;
 #endif
 
+#if defined(MAC_OS_X_VERSION_10_7) && \
+    MAC_OS_X_VERSION_MAX_ALLOWED >= MAC_OS_X_VERSION_10_7
+  // Version 8 adds pressure_relief.
+  asan_zone.version = 8;
+  asan_zone.pressure_relief = &mz_pressure_relief;
+#endif
+
   // Register the ASan zone.
   malloc_zone_register(&asan_zone);
 }
@@ -63,11 +63,13 @@ extern SANITIZER_INTERFACE_ATTRIBUTE uptr __asan_mapping_offset;
 # define SHADOW_SCALE (__asan_mapping_scale)
 # define SHADOW_OFFSET (__asan_mapping_offset)
 #else
+# if ASAN_SHADOW_SCALE < 3 || ASAN_SHADOW_SCALE > 6
+#  error "ASAN_SHADOW_SCALE must be between 3 and 6"
+# endif
+# define SHADOW_SCALE (ASAN_SHADOW_SCALE)
 # if SANITIZER_ANDROID
-#  define SHADOW_SCALE (3)
 #  define SHADOW_OFFSET (0)
 # else
-#  define SHADOW_SCALE (3)
 #  if SANITIZER_WORDSIZE == 32
 #   if defined(__mips__)
 #     define SHADOW_OFFSET 0x0aaa8000
@@ -37,7 +37,7 @@ struct nothrow_t {};
 }  // namespace std
 
 #define OPERATOR_NEW_BODY(type) \
-  GET_STACK_TRACE_MALLOC;\
+  GET_STACK_TRACE_MALLOC_SIZE(size);\
   return asan_memalign(0, size, &stack, type);
 
 // On OS X it's not enough to just provide our own 'operator new' and
@@ -17,16 +17,143 @@
 
 namespace __asan {
 
-void PoisonShadow(uptr addr, uptr size, u8 value) {
-  if (!flags()->poison_heap) return;
+// Shadow ranges at least this large are unpoisoned with
+// FlushUnneededShadowMemory.
+static const uptr kShadowReleaseThreshold = 1 << 16;
+// Shadow ranges at most this large are written byte by byte.
+static const uptr kShadowInlineStoreSize = 16;
+
+// The shadow of the primary allocator space, if ReleaseHeapShadow is on.
+static uptr heap_shadow_beg, heap_shadow_end;
+// A bit per kSharedShadowPoisonSize block of the heap shadow: set if the
+// block was mapped with MapSharedShadowPoison. Blocks of different size
+// classes are disjoint, and each class releases its memory under a lock.
+static u8 *shared_poison_blocks;
+static bool can_share_poison;
+// Each shared block costs a mapping, keep well below the kernel limit.
+static const uptr kMaxSharedPoisonBlocks = 1 << 13;
+static atomic_uintptr_t n_shared_poison_blocks;
+
+static bool ShadowMayHaveSharedPoison(uptr shadow_beg, uptr shadow_end) {
+  return can_share_poison && shadow_beg < heap_shadow_end &&
+         shadow_end > heap_shadow_beg;
+}
+
+static void ClearShadow(uptr shadow_beg, uptr shadow_end) {
+  // MADV_DONTNEED is guaranteed to zero the pages only on Linux. It would
+  // bring back the contents of the file in the shared poison blocks.
+  if (SANITIZER_LINUX &&
+      shadow_end - shadow_beg >= kShadowReleaseThreshold &&
+      !ShadowMayHaveSharedPoison(shadow_beg, shadow_end)) {
+    uptr page_size = GetPageSizeCached();
+    uptr page_beg = RoundUpTo(shadow_beg, page_size);
+    uptr page_end = RoundDownTo(shadow_end, page_size);
+    if (page_beg < page_end) {
+      REAL(memset)((void*)shadow_beg, 0, page_beg - shadow_beg);
+      FlushUnneededShadowMemory(page_beg, page_end - page_beg);
+      REAL(memset)((void*)page_end, 0, shadow_end - page_end);
+      return;
+    }
+  }
+  REAL(memset)((void*)shadow_beg, 0, shadow_end - shadow_beg);
+}
+
+static void CheckPoisonRange(uptr addr, uptr size) {
   CHECK(AddrIsAlignedByGranularity(addr));
   CHECK(AddrIsInMem(addr));
   CHECK(AddrIsAlignedByGranularity(addr + size));
   CHECK(AddrIsInMem(addr + size - SHADOW_GRANULARITY));
+}
+
+void PoisonShadow(uptr addr, uptr size, u8 value) {
+  if (!flags()->poison_heap) return;
+  CheckPoisonRange(addr, size);
   CHECK(REAL(memset));
+  if (value == 0) {
+    ClearShadow(MEM_TO_SHADOW(addr),
+                MEM_TO_SHADOW(addr + size - SHADOW_GRANULARITY) + 1);
+    return;
+  }
   FastPoisonShadow(addr, size, value);
 }
 
+void ShadowPoisonBatch::Flush() {
+  uptr n = n_ranges_;
+  n_ranges_ = 0;
+  if (!flags()->poison_heap) return;
+  CHECK(REAL(memset));
+  for (uptr i = 0; i < n; i++) {
+    Range *r = &ranges_[i];
+    if (r->beg == r->end) continue;
+    CheckPoisonRange(r->beg, r->end - r->beg);
+    uptr shadow_beg = MEM_TO_SHADOW(r->beg);
+    uptr shadow_end = MEM_TO_SHADOW(r->end - SHADOW_GRANULARITY) + 1;
+    if (shadow_end - shadow_beg <= kShadowInlineStoreSize) {
+      for (u8 *shadow = (u8*)shadow_beg; shadow < (u8*)shadow_end; shadow++)
+        *shadow = r->value;
+    } else if (r->value == 0) {
+      ClearShadow(shadow_beg, shadow_end);
+    } else {
+      REAL(memset)((void*)shadow_beg, r->value, shadow_end - shadow_beg);
+    }
+  }
+}
+
+void InitHeapShadowRelease(uptr shadow_beg, uptr shadow_end) {
+  CHECK(IsAligned(shadow_beg, kSharedShadowPoisonSize));
+  CHECK(IsAligned(shadow_end, kSharedShadowPoisonSize));
+  uptr n_blocks = (shadow_end - shadow_beg) / kSharedShadowPoisonSize;
+  shared_poison_blocks =
+      (u8*)MmapOrDie(RoundUpTo(n_blocks, 8) / 8, "SharedPoisonBlocks");
+  can_share_poison = InitSharedShadowPoison(kAsanHeapLeftRedzoneMagic);
+  heap_shadow_beg = shadow_beg;
+  heap_shadow_end = shadow_end;
+}
+
+// Returns true if all the bytes of the block are *value.
+static bool ShadowBlockIsUniform(uptr beg, u8 *value) {
+  const u64 *p = (const u64*)beg;
+  const u64 *end = (const u64*)(beg + kSharedShadowPoisonSize);
+  u64 word = *p;
+  for (; p < end; p++)
+    if (*p != word) return false;
+  *value = word & 0xff;
+  return word == *value * 0x0101010101010101ULL;
+}
+
+void ReleaseHeapShadow(uptr addr, uptr size) {
+  if (!heap_shadow_end || !flags()->poison_heap) return;
+  uptr beg = RoundUpTo(MEM_TO_SHADOW(addr), kSharedShadowPoisonSize);
+  uptr end = RoundDownTo(MEM_TO_SHADOW(addr + size), kSharedShadowPoisonSize);
+  CHECK(beg >= end || (beg >= heap_shadow_beg && end <= heap_shadow_end));
+  for (uptr p = beg; p < end; p += kSharedShadowPoisonSize) {
+    uptr block = (p - heap_shadow_beg) / kSharedShadowPoisonSize;
+    u8 *bits = &shared_poison_blocks[block / 8];
+    u8 mask = 1 << (block % 8);
+    u8 value;
+    if (!ShadowBlockIsUniform(p, &value))
+      continue;
+    if (value == 0) {
+      if (*bits & mask) {
+        // A fresh mapping is the only way to zero a shared block.
+        MmapFixedNoReserve(p, kSharedShadowPoisonSize);
+        *bits &= ~mask;
+      } else {
+        FlushUnneededShadowMemory(p, kSharedShadowPoisonSize);
+      }
+    } else if (value == kAsanHeapLeftRedzoneMagic && can_share_poison &&
+               !(*bits & mask)) {
+      // Blocks that were shared before are not shared again, even if they
+      // were written meanwhile, so that the number of mappings is bounded.
+      if (atomic_fetch_add(&n_shared_poison_blocks, 1, memory_order_relaxed) >=
+          kMaxSharedPoisonBlocks)
+        return;
+      if (MapSharedShadowPoison(p))
+        *bits |= mask;
+    }
+  }
+}
+
 void PoisonShadowPartialRightRedzone(uptr addr,
                                      uptr size,
                                      uptr redzone_size,
@@ -49,10 +176,16 @@ struct ShadowSegmentEndpoint {
   }
 };
 
-}  // namespace __asan
-
-// ---------------------- Interface ---------------- {{{1
-using namespace __asan;  // NOLINT
+// The user regions are mostly small objects, their shadow is set without a
+// memset call.
+static void SetShadow(u8 *beg, u8 *end, u8 value) {
+  if (end - beg <= (sptr)kShadowInlineStoreSize) {
+    for (; beg < end; beg++)
+      *beg = value;
+  } else {
+    REAL(memset)(beg, value, end - beg);
+  }
+}
 
 // Current implementation of __asan_(un)poison_memory_region doesn't check
 // that user program (un)poisons the memory it owns. It poisons memory
@@ -64,13 +197,14 @@ using namespace __asan;  // NOLINT
 // at least [left, AlignDown(right)).
 // * if user asks to unpoison region [left, right), the program unpoisons
 // at most [AlignDown(left), right).
-void __asan_poison_memory_region(void const volatile *addr, uptr size) {
-  if (!flags()->allow_user_poisoning || size == 0) return;
-  uptr beg_addr = (uptr)addr;
+static void PoisonRegion(uptr beg_addr, uptr size) {
+  if (size == 0) return;
   uptr end_addr = beg_addr + size;
-  if (flags()->verbosity >= 1) {
-    Printf("Trying to poison memory region [%p, %p)\n",
-           (void*)beg_addr, (void*)end_addr);
+  // Whole granules, there are no partial shadow values to merge.
+  if (((beg_addr | size) & (SHADOW_GRANULARITY - 1)) == 0) {
+    SetShadow((u8*)MemToShadow(beg_addr), (u8*)MemToShadow(end_addr),
+              kAsanUserPoisonedMemoryMagic);
+    return;
   }
   ShadowSegmentEndpoint beg(beg_addr);
   ShadowSegmentEndpoint end(end_addr);
@@ -99,20 +233,19 @@ void __asan_poison_memory_region(void const volatile *addr, uptr size) {
     }
     beg.chunk++;
   }
-  REAL(memset)(beg.chunk, kAsanUserPoisonedMemoryMagic, end.chunk - beg.chunk);
+  SetShadow(beg.chunk, end.chunk, kAsanUserPoisonedMemoryMagic);
   // Poison if byte in end.offset is unaddressable.
   if (end.value > 0 && end.value <= end.offset) {
     *end.chunk = kAsanUserPoisonedMemoryMagic;
   }
 }
 
-void __asan_unpoison_memory_region(void const volatile *addr, uptr size) {
-  if (!flags()->allow_user_poisoning || size == 0) return;
-  uptr beg_addr = (uptr)addr;
+static void UnpoisonRegion(uptr beg_addr, uptr size) {
+  if (size == 0) return;
   uptr end_addr = beg_addr + size;
-  if (flags()->verbosity >= 1) {
-    Printf("Trying to unpoison memory region [%p, %p)\n",
-           (void*)beg_addr, (void*)end_addr);
+  if (((beg_addr | size) & (SHADOW_GRANULARITY - 1)) == 0) {
+    SetShadow((u8*)MemToShadow(beg_addr), (u8*)MemToShadow(end_addr), 0);
+    return;
   }
   ShadowSegmentEndpoint beg(beg_addr);
   ShadowSegmentEndpoint end(end_addr);
@@ -132,12 +265,66 @@ void __asan_unpoison_memory_region(void const volatile *addr, uptr size) {
     *beg.chunk = 0;
     beg.chunk++;
   }
-  REAL(memset)(beg.chunk, 0, end.chunk - beg.chunk);
+  SetShadow(beg.chunk, end.chunk, 0);
   if (end.offset > 0 && end.value != 0) {
     *end.chunk = Max(end.value, end.offset);
   }
 }
 
+}  // namespace __asan
+
+// ---------------------- Interface ---------------- {{{1
+using namespace __asan;  // NOLINT
+
+void __asan_poison_memory_region(void const volatile *addr, uptr size) {
+  if (!flags()->allow_user_poisoning || size == 0) return;
+  if (flags()->verbosity >= 1) {
+    Printf("Trying to poison memory region [%p, %p)\n",
+           (void*)addr, (void*)((uptr)addr + size));
+  }
+  PoisonRegion((uptr)addr, size);
+}
+
+void __asan_unpoison_memory_region(void const volatile *addr, uptr size) {
+  if (!flags()->allow_user_poisoning || size == 0) return;
+  if (flags()->verbosity >= 1) {
+    Printf("Trying to unpoison memory region [%p, %p)\n",
+           (void*)addr, (void*)((uptr)addr + size));
+  }
+  UnpoisonRegion((uptr)addr, size);
+}
+
+void __asan_poison_memory_regions(const void *const *addrs,
+                                  const uptr *sizes, uptr n) {
+  if (!flags()->allow_user_poisoning) return;
+  if (flags()->verbosity >= 1)
+    Printf("Trying to poison %zd memory regions\n", n);
+  for (uptr i = 0; i < n; i++)
+    PoisonRegion((uptr)addrs[i], sizes[i]);
+}
+
+void __asan_unpoison_memory_regions(const void *const *addrs,
+                                    const uptr *sizes, uptr n) {
+  if (!flags()->allow_user_poisoning) return;
+  if (flags()->verbosity >= 1)
+    Printf("Trying to unpoison %zd memory regions\n", n);
+  for (uptr i = 0; i < n; i++)
+    UnpoisonRegion((uptr)addrs[i], sizes[i]);
+}
+
+void __asan_poison_memory_region_except(void const volatile *addr, uptr size,
+                                        const void *const *live_addrs,
+                                        const uptr *live_sizes, uptr n) {
+  if (!flags()->allow_user_poisoning) return;
+  if (flags()->verbosity >= 1) {
+    Printf("Trying to poison memory region [%p, %p) except %zd regions\n",
+           (void*)addr, (void*)((uptr)addr + size), n);
+  }
+  PoisonRegion((uptr)addr, size);
+  for (uptr i = 0; i < n; i++)
+    UnpoisonRegion((uptr)live_addrs[i], live_sizes[i]);
+}
+
 bool __asan_address_is_poisoned(void const volatile *addr) {
   return __asan::AddressIsPoisoned((uptr)addr);
 }
@@ -161,7 +348,19 @@ uptr __asan_region_is_poisoned(uptr beg, uptr size) {
                                 shadow_end - shadow_beg)))
     return 0;
   // The fast check failed, so we have a poisoned byte somewhere.
-  // Find it slowly.
+  // Skip the leading unpoisoned part of a large region quickly using the
+  // shadow, then find the poisoned byte slowly.
+  for (; beg < end && beg < aligned_b; beg++)
+    if (__asan::AddressIsPoisoned(beg))
+      return beg;
+  if (shadow_end > shadow_beg) {
+    const uptr kShadowStep = 64;
+    uptr shadow = shadow_beg;
+    while (shadow + kShadowStep <= shadow_end &&
+           __sanitizer::mem_is_zero((const char *)shadow, kShadowStep))
+      shadow += kShadowStep;
+    beg = aligned_b + (shadow - shadow_beg) * SHADOW_GRANULARITY;
+  }
   for (; beg < end; beg++)
     if (__asan::AddressIsPoisoned(beg))
       return beg;
@@ -19,8 +19,56 @@
 namespace __asan {
 
 // Poisons the shadow memory for "size" bytes starting from "addr".
+// Where possible, large ranges are unpoisoned by returning their shadow
+// pages to the OS instead of clearing them.
 void PoisonShadow(uptr addr, uptr size, u8 value);
 
+// Collects ranges to be poisoned and poisons them in one sweep: adjacent
+// ranges with the same value are merged, the checks are done once per merged
+// range, and short shadow ranges are written without calling memset.
+// Ranges must be aligned by SHADOW_GRANULARITY. Nothing is poisoned
+// until Flush() is called.
+class ShadowPoisonBatch {
+ public:
+  ShadowPoisonBatch() : n_ranges_(0) {}
+
+  void Add(uptr aligned_beg, uptr aligned_size, u8 value) {
+    if (n_ranges_) {
+      Range *last = &ranges_[n_ranges_ - 1];
+      if (last->end == aligned_beg && last->value == value) {
+        last->end += aligned_size;
+        return;
+      }
+    }
+    if (n_ranges_ == kMaxRanges)
+      Flush();
+    Range *r = &ranges_[n_ranges_++];
+    r->beg = aligned_beg;
+    r->end = aligned_beg + aligned_size;
+    r->value = value;
+  }
+
+  void Flush();
+
+ private:
+  static const uptr kMaxRanges = 64;
+  struct Range {
+    uptr beg, end;
+    u8 value;
+  };
+  Range ranges_[kMaxRanges];
+  uptr n_ranges_;
+};
+
+// Lets ReleaseHeapShadow reclaim the given shadow range of the heap.
+void InitHeapShadowRelease(uptr shadow_beg, uptr shadow_end);
+
+// Called when the allocator returns the pages of free chunks to the OS.
+// Wholly covered shadow blocks that are all zero are returned to the OS as
+// well, and the ones that are uniformly kAsanHeapLeftRedzoneMagic, as the
+// shadow of free chunks is, are replaced with views of a shared block.
+void ReleaseHeapShadow(uptr addr, uptr size);
+
 // Poisons the shadow memory for "redzone_size" bytes starting from
 // "addr + size".
 void PoisonShadowPartialRightRedzone(uptr addr,
@@ -442,67 +442,203 @@ void DescribeThread(AsanThreadContext *context) {
 
 // -------------------- Different kinds of reports ----------------- {{{1
 
+// Serializes the error reports. Reports normally end with Die(), so a second
+// report from any thread is only allowed with halt_on_error=0, where
+// recoverable reports from different threads take turns.
+static atomic_uint32_t num_calls;
+static u32 reporting_thread_tid;
+
+static void NORETURN DieOnNestedReport() {
+  // Do not print more than one report, otherwise they will mix up.
+  // Error reporting functions shouldn't return at this situation, as
+  // they are defined as no-return.
+  Report("AddressSanitizer: while reporting a bug found another one."
+             "Ignoring.\n");
+  u32 current_tid = GetCurrentTidOrInvalid();
+  if (current_tid != reporting_thread_tid) {
+    // ASan found two bugs in different threads simultaneously. Sleep
+    // long enough to make sure that the thread which started to print
+    // an error report will finish doing it.
+    SleepForSeconds(Max(100, flags()->sleep_before_dying + 1));
+  }
+  // If we're still not dead for some reason, use raw _exit() instead of
+  // Die() to bypass any additional checks.
+  internal__exit(flags()->exitcode);
+}
+
+static void StartErrorReport() {
+  u32 current_tid = GetCurrentTidOrInvalid();
+  if (flags()->halt_on_error) {
+    if (atomic_fetch_add(&num_calls, 1, memory_order_relaxed) != 0)
+      DieOnNestedReport();
+  } else {
+    while (atomic_exchange(&num_calls, 1, memory_order_acquire) != 0) {
+      if (current_tid != kInvalidTid && current_tid == reporting_thread_tid)
+        DieOnNestedReport();
+      internal_sched_yield();
+    }
+  }
+  ASAN_ON_ERROR();
+  // Make sure the registry and sanitizer report mutexes are locked while
+  // we're printing an error report.
+  // We can lock them only here to avoid self-deadlock in case of
+  // recursive reports.
+  asanThreadRegistry().Lock();
+  CommonSanitizerReportMutex.Lock();
+  // The buffered report is written out by Die().
+  StartReportBuffering();
+  reporting_thread_tid = current_tid;
+  Printf("===================================================="
+         "=============\n");
+  if (reporting_thread_tid != kInvalidTid) {
+    // We started reporting an error message. Stop using the fake stack
+    // in case we call an instrumented function from a symbolizer.
+    AsanThread *curr_thread = GetCurrentThread();
+    CHECK(curr_thread);
+    if (curr_thread->fake_stack())
+      curr_thread->fake_stack()->StopUsingFakeStack();
+  }
+}
+
+static void FinishErrorReport() {
+  // Make sure the current thread is announced.
+  AsanThread *curr_thread = GetCurrentThread();
+  if (curr_thread) {
+    DescribeThread(curr_thread->context());
+  }
+  // Print memory stats.
+  if (flags()->print_stats)
+    __asan_print_accumulated_stats();
+  if (error_report_callback) {
+    error_report_callback(error_message_buffer);
+  }
+}
+
 // Use ScopedInErrorReport to run common actions just before and
 // immediately after printing error report.
 class ScopedInErrorReport {
  public:
-  ScopedInErrorReport() {
-    static atomic_uint32_t num_calls;
-    static u32 reporting_thread_tid;
-    if (atomic_fetch_add(&num_calls, 1, memory_order_relaxed) != 0) {
-      // Do not print more than one report, otherwise they will mix up.
-      // Error reporting functions shouldn't return at this situation, as
-      // they are defined as no-return.
-      Report("AddressSanitizer: while reporting a bug found another one."
-                 "Ignoring.\n");
-      u32 current_tid = GetCurrentTidOrInvalid();
-      if (current_tid != reporting_thread_tid) {
-        // ASan found two bugs in different threads simultaneously. Sleep
-        // long enough to make sure that the thread which started to print
-        // an error report will finish doing it.
-        SleepForSeconds(Max(100, flags()->sleep_before_dying + 1));
-      }
-      // If we're still not dead for some reason, use raw _exit() instead of
-      // Die() to bypass any additional checks.
-      internal__exit(flags()->exitcode);
-    }
-    ASAN_ON_ERROR();
-    // Make sure the registry and sanitizer report mutexes are locked while
-    // we're printing an error report.
-    // We can lock them only here to avoid self-deadlock in case of
-    // recursive reports.
-    asanThreadRegistry().Lock();
-    CommonSanitizerReportMutex.Lock();
-    reporting_thread_tid = GetCurrentTidOrInvalid();
-    Printf("===================================================="
-           "=============\n");
-    if (reporting_thread_tid != kInvalidTid) {
-      // We started reporting an error message. Stop using the fake stack
-      // in case we call an instrumented function from a symbolizer.
-      AsanThread *curr_thread = GetCurrentThread();
-      CHECK(curr_thread);
-      if (curr_thread->fake_stack())
-        curr_thread->fake_stack()->StopUsingFakeStack();
-    }
-  }
+  ScopedInErrorReport() { StartErrorReport(); }
   // Destructor is NORETURN, as functions that report errors are.
   NORETURN ~ScopedInErrorReport() {
-    // Make sure the current thread is announced.
-    AsanThread *curr_thread = GetCurrentThread();
-    if (curr_thread) {
-      DescribeThread(curr_thread->context());
-    }
-    // Print memory stats.
-    if (flags()->print_stats)
-      __asan_print_accumulated_stats();
-    if (error_report_callback) {
-      error_report_callback(error_message_buffer);
-    }
+    FinishErrorReport();
     Report("ABORTING\n");
     Die();
   }
 };
 
+// Same, for the reports after which the program continues (halt_on_error=0).
+class ScopedInRecoverableErrorReport {
+ public:
+  ScopedInRecoverableErrorReport() { StartErrorReport(); }
+  ~ScopedInRecoverableErrorReport() {
+    FinishErrorReport();
+    error_message_buffer_pos = 0;
+    AsanThread *curr_thread = GetCurrentThread();
+    if (curr_thread && curr_thread->fake_stack())
+      curr_thread->fake_stack()->ResumeUsingFakeStack();
+    reporting_thread_tid = kInvalidTid;
+    FinishReportBuffering();
+    CommonSanitizerReportMutex.Unlock();
+    asanThreadRegistry().Unlock();
+    atomic_store(&num_calls, 0, memory_order_release);
+  }
+};
+
+// Invalid accesses reported with halt_on_error=0, keyed by the pc, the
+// caller pc and the access type. The caller pc separates the errors found
+// by the same interceptor. The table is looked up before anything else is
+// done for a report, so that the repeats of an error cost a few atomic
+// operations.
+static const uptr kRecoveredErrorTableSize = 1 << 12;
+struct RecoveredError {
+  atomic_uint64_t key;  // 0 for an empty slot.
+  atomic_uint32_t count;
+  bool is_write;
+  uptr pcs[2];  // Written by the thread that took the slot, after the key.
+};
+static RecoveredError recovered_errors[kRecoveredErrorTableSize];
+static atomic_uint32_t recovered_errors_not_deduped;
+
+// Returns the return address of the frame at bp, if bp is in the stack of
+// the current thread.
+static uptr CallerPcForDedup(uptr bp) {
+  AsanThread *t = GetCurrentThread();
+  if (!t || (bp % sizeof(uptr)) != 0 || !t->AddrIsInStack(bp) ||
+      !t->AddrIsInStack(bp + sizeof(uptr)))
+    return 0;
+  return reinterpret_cast<uptr *>(bp)[1];
+}
+
+// Returns true if the error was already reported.
+static bool IsRecoveredErrorDuplicate(uptr pc, uptr bp, bool is_write) {
+  uptr caller_pc = CallerPcForDedup(bp);
+  const u64 kMul = 0x9e3779b97f4a7c15ull;
+  u64 key = ((u64)pc * kMul) ^ ((u64)caller_pc + (is_write ? 1 : 0));
+  key = (key ^ (key >> 29)) * kMul;
+  key |= 1;
+  uptr idx = (uptr)(key >> 40);
+  for (uptr i = 0; i < kRecoveredErrorTableSize; i++) {
+    RecoveredError *e =
+        &recovered_errors[(idx + i) % kRecoveredErrorTableSize];
+    u64 cur = atomic_load(&e->key, memory_order_relaxed);
+    if (cur == 0) {
+      if (atomic_compare_exchange_strong(&e->key, &cur, key,
+                                         memory_order_relaxed)) {
+        e->is_write = is_write;
+        e->pcs[0] = pc;
+        e->pcs[1] = caller_pc;
+        atomic_fetch_add(&e->count, 1, memory_order_release);
+        return false;
+      }
+      // Another thread took the slot, cur is its key now.
+    }
+    if (cur == key) {
+      atomic_fetch_add(&e->count, 1, memory_order_relaxed);
+      return true;
+    }
+  }
+  // The table is full, new errors are still reported.
+  atomic_fetch_add(&recovered_errors_not_deduped, 1, memory_order_relaxed);
+  return false;
+}
+
+void PrintRecoveredErrors() {
+  uptr unique = 0, total = 0;
+  for (uptr i = 0; i < kRecoveredErrorTableSize; i++) {
+    u32 count = atomic_load(&recovered_errors[i].count, memory_order_acquire);
+    if (count == 0)
+      continue;
+    unique++;
+    total += count;
+  }
+  if (total == 0)
+    return;
+  Printf("AddressSanitizer: %zu invalid access(es) at %zu place(s), only the "
+         "first one at each place was reported:\n", total, unique);
+  for (uptr i = 0; i < kRecoveredErrorTableSize; i++) {
+    RecoveredError *e = &recovered_errors[i];
+    u32 count = atomic_load(&e->count, memory_order_acquire);
+    if (count == 0)
+      continue;
+    // A slot counted only by the repeats of a racing thread may not have
+    // its pcs yet.
+    if (e->pcs[0] == 0)
+      continue;
+    Printf("%s, %u time(s):\n", e->is_write ? "WRITE" : "READ", count);
+    StackTrace stack;
+    stack.size = e->pcs[1] ? 2 : 1;
+    stack.trace[0] = e->pcs[0];
+    stack.trace[1] = e->pcs[1];
+    PrintStack(&stack);
+  }
+  u32 not_deduped = atomic_load(&recovered_errors_not_deduped,
+                                memory_order_relaxed);
+  if (not_deduped)
+    Printf("%u more reported invalid access(es) were not counted\n",
+           not_deduped);
+}
+
 static void ReportSummary(const char *error_type, StackTrace *stack) {
   if (!stack->size) return;
   if (IsSymbolizerAvailable()) {
@@ -671,10 +807,9 @@ void ReportMacCfReallocUnknown(
 // --------------------------- Interface --------------------- {{{1
 using namespace __asan;  // NOLINT
 
-void __asan_report_error(uptr pc, uptr bp, uptr sp,
-                         uptr addr, bool is_write, uptr access_size) {
-  ScopedInErrorReport in_report;
-
+namespace __asan {
+static void PrintInvalidAccess(uptr pc, uptr bp, uptr sp, uptr addr,
+                               bool is_write, uptr access_size) {
   // Determine the error type.
   const char *bug_descr = "unknown-crash";
   if (AddrIsInMem(addr)) {
@@ -741,6 +876,20 @@ void __asan_report_error(uptr pc, uptr bp, uptr sp,
   ReportSummary(bug_descr, &stack);
   PrintShadowMemoryForAddress(addr);
 }
+}  // namespace __asan
+
+void __asan_report_error(uptr pc, uptr bp, uptr sp,
+                         uptr addr, bool is_write, uptr access_size) {
+  if (!flags()->halt_on_error) {
+    if (IsRecoveredErrorDuplicate(pc, bp, is_write))
+      return;
+    ScopedInRecoverableErrorReport in_report;
+    PrintInvalidAccess(pc, bp, sp, addr, is_write, access_size);
+    return;
+  }
+  ScopedInErrorReport in_report;
+  PrintInvalidAccess(pc, bp, sp, addr, is_write, access_size);
+}
 
 void NOINLINE __asan_set_error_report_callback(void (*callback)(const char*)) {
   error_report_callback = callback;
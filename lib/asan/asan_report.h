@@ -31,6 +31,9 @@ void DescribeAddress(uptr addr, uptr access_size);
 
 void DescribeThread(AsanThreadContext *context);
 
+// Prints the counts of the errors reported with halt_on_error=0.
+void PrintRecoveredErrors();
+
 // Different kinds of error reports.
 void NORETURN ReportSIGSEGV(uptr pc, uptr sp, uptr bp, uptr addr);
 void NORETURN ReportDoubleFree(uptr addr, StackTrace *stack);
@@ -21,15 +21,59 @@
 #include "asan_stats.h"
 #include "asan_thread.h"
 #include "sanitizer_common/sanitizer_atomic.h"
+#include "sanitizer_common/sanitizer_coverage.h"
 #include "sanitizer_common/sanitizer_flags.h"
 #include "sanitizer_common/sanitizer_libc.h"
 #include "sanitizer_common/sanitizer_symbolizer.h"
+#include "sanitizer_common/sanitizer_timing.h"
 #include "lsan/lsan_common.h"
 
 namespace __asan {
 
 uptr AsanMappingProfile[kAsanMappingProfileSize];
 
+// Unmapping the shadow of a large process takes a while, so the shadow is
+// split into chunks which may be unmapped by several threads in parallel.
+static const uptr kShadowUnmapChunks = 64;
+struct ShadowUnmapState {
+  uptr beg, end, chunk_size;
+  atomic_uintptr_t next_chunk;
+  atomic_uintptr_t n_done;
+};
+static ShadowUnmapState shadow_unmap_state;
+
+static void *UnmapShadowChunks(void *arg) {
+  ShadowUnmapState *s = (ShadowUnmapState*)arg;
+  for (;;) {
+    uptr i = atomic_fetch_add(&s->next_chunk, 1, memory_order_acquire);
+    if (i >= kShadowUnmapChunks) break;
+    uptr beg = s->beg + i * s->chunk_size;
+    uptr end = Min(beg + s->chunk_size, s->end);
+    if (beg < end)
+      UnmapOrDie((void*)beg, end - beg);
+    atomic_fetch_add(&s->n_done, 1, memory_order_release);
+  }
+  return 0;
+}
+
+static void UnmapShadowRange(uptr beg, uptr end) {
+  ShadowUnmapState *s = &shadow_unmap_state;
+  s->beg = beg;
+  s->end = end;
+  s->chunk_size = RoundUpTo((end - beg + kShadowUnmapChunks - 1) /
+                            kShadowUnmapChunks, GetPageSizeCached());
+  atomic_store(&s->n_done, 0, memory_order_relaxed);
+  // Threads left from the previous range may pick up chunks of this one.
+  atomic_store(&s->next_chunk, 0, memory_order_release);
+  for (int i = 1; i < flags()->unmap_shadow_threads; i++) {
+    if (!StartInternalThread(UnmapShadowChunks, s))
+      break;
+  }
+  UnmapShadowChunks(s);
+  while (atomic_load(&s->n_done, memory_order_acquire) < kShadowUnmapChunks)
+    internal_sched_yield();
+}
+
 static void AsanDie() {
   static atomic_uint32_t num_calls;
   if (atomic_fetch_add(&num_calls, 1, memory_order_relaxed) != 0) {
@@ -42,10 +86,10 @@ static void AsanDie() {
   }
   if (flags()->unmap_shadow_on_exit) {
     if (kMidMemBeg) {
-      UnmapOrDie((void*)kLowShadowBeg, kMidMemBeg - kLowShadowBeg);
-      UnmapOrDie((void*)kMidMemEnd, kHighShadowEnd - kMidMemEnd);
+      UnmapShadowRange(kLowShadowBeg, kMidMemBeg);
+      UnmapShadowRange(kMidMemEnd, kHighShadowEnd);
     } else {
-      UnmapOrDie((void*)kLowShadowBeg, kHighShadowEnd - kLowShadowBeg);
+      UnmapShadowRange(kLowShadowBeg, kHighShadowEnd);
     }
   }
   if (death_callback)
@@ -85,45 +129,74 @@ static const char *MaybeUseAsanDefaultOptionsCompileDefiniton() {
 }
 
 static void ParseFlagsFromString(Flags *f, const char *str) {
-  ParseCommonFlagsFromString(str);
-  CHECK((uptr)common_flags()->malloc_context_size <= kStackTraceMax);
+  FlagParser parser;
+  RegisterCommonFlags(&parser);
+
+  parser.AddFlag(&f->quarantine_size, "quarantine_size");
+  parser.AddFlag(&f->verbosity, "verbosity");
+  parser.AddFlag(&f->redzone, "redzone");
+
+  parser.AddFlag(&f->debug, "debug");
+  parser.AddFlag(&f->report_globals, "report_globals");
+  parser.AddFlag(&f->check_initialization_order, "check_initialization_order");
+
+  parser.AddFlag(&f->replace_str, "replace_str");
+  parser.AddFlag(&f->replace_intrin, "replace_intrin");
+  parser.AddFlag(&f->mac_ignore_invalid_free, "mac_ignore_invalid_free");
+  parser.AddFlag(&f->use_fake_stack, "use_fake_stack");
+  parser.AddFlag(&f->max_malloc_fill_size, "max_malloc_fill_size");
+  parser.AddFlag(&f->malloc_fill_byte, "malloc_fill_byte");
+  parser.AddFlag(&f->exitcode, "exitcode");
+  parser.AddFlag(&f->allow_user_poisoning, "allow_user_poisoning");
+  parser.AddFlag(&f->sleep_before_dying, "sleep_before_dying");
+  parser.AddFlag(&f->handle_segv, "handle_segv");
+  parser.AddFlag(&f->allow_user_segv_handler, "allow_user_segv_handler");
+  parser.AddFlag(&f->use_sigaltstack, "use_sigaltstack");
+  parser.AddFlag(&f->check_malloc_usable_size, "check_malloc_usable_size");
+  parser.AddFlag(&f->large_realloc_in_place, "large_realloc_in_place");
+  parser.AddFlag(&f->unmap_shadow_on_exit, "unmap_shadow_on_exit");
+  parser.AddFlag(&f->unmap_shadow_threads, "unmap_shadow_threads");
+  parser.AddFlag(&f->abort_on_error, "abort_on_error");
+  parser.AddFlag(&f->halt_on_error, "halt_on_error");
+  parser.AddFlag(&f->print_stats, "print_stats");
+  parser.AddFlag(&f->print_legend, "print_legend");
+  parser.AddFlag(&f->atexit, "atexit");
+  parser.AddFlag(&f->stats_dump_path, "stats_dump_path");
+  parser.AddFlag(&f->stats_dump_interval_ms, "stats_dump_interval_ms");
+  parser.AddFlag(&f->disable_core, "disable_core");
+  parser.AddFlag(&f->allow_reexec, "allow_reexec");
+  parser.AddFlag(&f->print_full_thread_history, "print_full_thread_history");
+  parser.AddFlag(&f->poison_heap, "poison_heap");
+  parser.AddFlag(&f->alloc_dealloc_mismatch, "alloc_dealloc_mismatch");
+  parser.AddFlag(&f->use_stack_depot, "use_stack_depot");
+  parser.AddFlag(&f->strict_memcmp, "strict_memcmp");
+  parser.AddFlag(&f->strict_init_order, "strict_init_order");
+  parser.AddFlag(&f->release_to_os_interval_ms, "release_to_os_interval_ms");
+  parser.AddFlag(&f->release_heap_shadow, "release_heap_shadow");
+  parser.AddFlag(&f->large_alloc_cache_size_mb, "large_alloc_cache_size_mb");
+  parser.AddFlag(&f->large_alloc_cache_max_age_ms,
+                 "large_alloc_cache_max_age_ms");
+  parser.AddFlag(&f->numa_allocator, "numa_allocator");
+  parser.AddFlag(&f->heap_overhead_budget, "heap_overhead_budget");
+  parser.AddFlag(&f->full_redzone_sample_rate, "full_redzone_sample_rate");
+  parser.AddFlag(&f->sample_allocations, "sample_allocations");
+  parser.AddFlag(&f->sample_by_size_class, "sample_by_size_class");
+  parser.AddFlag(&f->small_malloc_context_size, "small_malloc_context_size");
+  parser.AddFlag(&f->small_malloc_size, "small_malloc_size");
+  parser.AddFlag(&f->free_context_size, "free_context_size");
+  parser.ParseString(str);
 
-  ParseFlag(str, &f->quarantine_size, "quarantine_size");
-  ParseFlag(str, &f->verbosity, "verbosity");
-  ParseFlag(str, &f->redzone, "redzone");
+  CHECK((uptr)common_flags()->malloc_context_size <= kStackTraceMax);
   CHECK_GE(f->redzone, 16);
   CHECK(IsPowerOfTwo(f->redzone));
-
-  ParseFlag(str, &f->debug, "debug");
-  ParseFlag(str, &f->report_globals, "report_globals");
-  ParseFlag(str, &f->check_initialization_order, "check_initialization_order");
-
-  ParseFlag(str, &f->replace_str, "replace_str");
-  ParseFlag(str, &f->replace_intrin, "replace_intrin");
-  ParseFlag(str, &f->mac_ignore_invalid_free, "mac_ignore_invalid_free");
-  ParseFlag(str, &f->use_fake_stack, "use_fake_stack");
-  ParseFlag(str, &f->max_malloc_fill_size, "max_malloc_fill_size");
-  ParseFlag(str, &f->malloc_fill_byte, "malloc_fill_byte");
-  ParseFlag(str, &f->exitcode, "exitcode");
-  ParseFlag(str, &f->allow_user_poisoning, "allow_user_poisoning");
-  ParseFlag(str, &f->sleep_before_dying, "sleep_before_dying");
-  ParseFlag(str, &f->handle_segv, "handle_segv");
-  ParseFlag(str, &f->allow_user_segv_handler, "allow_user_segv_handler");
-  ParseFlag(str, &f->use_sigaltstack, "use_sigaltstack");
-  ParseFlag(str, &f->check_malloc_usable_size, "check_malloc_usable_size");
-  ParseFlag(str, &f->unmap_shadow_on_exit, "unmap_shadow_on_exit");
-  ParseFlag(str, &f->abort_on_error, "abort_on_error");
-  ParseFlag(str, &f->print_stats, "print_stats");
-  ParseFlag(str, &f->print_legend, "print_legend");
-  ParseFlag(str, &f->atexit, "atexit");
-  ParseFlag(str, &f->disable_core, "disable_core");
-  ParseFlag(str, &f->allow_reexec, "allow_reexec");
-  ParseFlag(str, &f->print_full_thread_history, "print_full_thread_history");
-  ParseFlag(str, &f->poison_heap, "poison_heap");
-  ParseFlag(str, &f->alloc_dealloc_mismatch, "alloc_dealloc_mismatch");
-  ParseFlag(str, &f->use_stack_depot, "use_stack_depot");
-  ParseFlag(str, &f->strict_memcmp, "strict_memcmp");
-  ParseFlag(str, &f->strict_init_order, "strict_init_order");
+  CHECK_GE(f->unmap_shadow_threads, 1);
+  CHECK_GT(f->stats_dump_interval_ms, 0);
+  CHECK_GE(f->heap_overhead_budget, 0);
+  CHECK_GT(f->full_redzone_sample_rate, 0);
+  CHECK_GT(f->sample_allocations, 0);
+  // CHECK_LE compares as unsigned, and these flags are negative by default.
+  CHECK(f->small_malloc_context_size <= (int)kStackTraceMax);
+  CHECK(f->free_context_size <= (int)kStackTraceMax);
 }
 
 void InitializeFlags(Flags *f, const char *env) {
@@ -133,11 +206,20 @@ void InitializeFlags(Flags *f, const char *env) {
   cf->malloc_context_size = kDefaultMallocContextSize;
   cf->fast_unwind_on_fatal = false;
   cf->fast_unwind_on_malloc = true;
+  cf->use_shadow_call_stack = false;
+  cf->compress_stack_depot = false;
+  cf->stack_depot_max_mb = 0;
   cf->strip_path_prefix = "";
   cf->handle_ioctl = false;
   cf->log_path = 0;
   cf->detect_leaks = false;
   cf->leak_check_at_exit = true;
+  cf->shadow_huge_pages = 0;
+  cf->prefault_shadow = false;
+  cf->fast_init = false;
+  cf->timing_sample_rate = 0;
+  cf->coverage = false;
+  cf->coverage_dir = "";
 
   internal_memset(f, 0, sizeof(*f));
   f->quarantine_size = (ASAN_LOW_MEMORY) ? 1UL << 26 : 1UL << 28;
@@ -159,11 +241,16 @@ void InitializeFlags(Flags *f, const char *env) {
   f->allow_user_segv_handler = false;
   f->use_sigaltstack = false;
   f->check_malloc_usable_size = true;
+  f->large_realloc_in_place = false;
   f->unmap_shadow_on_exit = false;
+  f->unmap_shadow_threads = 1;
   f->abort_on_error = false;
+  f->halt_on_error = true;
   f->print_stats = false;
   f->print_legend = true;
   f->atexit = false;
+  f->stats_dump_path = 0;
+  f->stats_dump_interval_ms = 1000;
   f->disable_core = (SANITIZER_WORDSIZE == 64);
   f->allow_reexec = true;
   f->print_full_thread_history = true;
@@ -174,6 +261,18 @@ void InitializeFlags(Flags *f, const char *env) {
   f->use_stack_depot = true;
   f->strict_memcmp = true;
   f->strict_init_order = false;
+  f->release_to_os_interval_ms = -1;
+  f->release_heap_shadow = false;
+  f->large_alloc_cache_size_mb = 0;
+  f->large_alloc_cache_max_age_ms = 1000;
+  f->numa_allocator = false;
+  f->heap_overhead_budget = 0;
+  f->full_redzone_sample_rate = 16;
+  f->sample_allocations = 1;
+  f->sample_by_size_class = false;
+  f->small_malloc_context_size = -1;
+  f->small_malloc_size = 64;
+  f->free_context_size = -1;
 
   // Override from compile definition.
   ParseFlagsFromString(f, MaybeUseAsanDefaultOptionsCompileDefiniton());
@@ -230,6 +329,9 @@ static void ReserveShadowMemoryRange(uptr beg, uptr end) {
            "Perhaps you're using ulimit -v\n", size);
     Abort();
   }
+  // The allocator marks the shadow of its space as dense.
+  SetShadowHugePages(common_flags()->shadow_huge_pages, beg, size,
+                     /*dense*/ false);
 }
 
 // --------------- LowLevelAllocateCallbac ---------- {{{1
@@ -313,6 +415,10 @@ static NOINLINE void force_interface_symbols() {
     case 33: __asan_unpoison_stack_memory(0, 0); break;
     case 34: __asan_region_is_poisoned(0, 0); break;
     case 35: __asan_describe_address(0); break;
+    case 36: __asan_get_stats(0); break;
+    case 37: __asan_poison_memory_regions(0, 0, 0); break;
+    case 38: __asan_unpoison_memory_regions(0, 0, 0); break;
+    case 39: __asan_poison_memory_region_except(0, 0, 0, 0, 0); break;
   }
 }
 
@@ -340,6 +446,33 @@ static void ProtectGap(uptr a, uptr size) {
   CHECK_EQ(a, (uptr)Mprotect(a, size));
 }
 
+// Reserves the low shadow, the gap and the high shadow with one mmap that
+// fails if anything is mapped there yet, then protects the gap. This is what
+// the common case needs and spares reading /proc/self/maps at startup.
+static bool TryReserveFullShadow(uptr shadow_start) {
+  if (shadow_start == 0 ||
+      !TryMmapFixedNoReserve(shadow_start, kHighShadowEnd - shadow_start + 1))
+    return false;
+  ProtectGap(kShadowGapBeg, kShadowGapEnd - kShadowGapBeg + 1);
+  SetShadowHugePages(common_flags()->shadow_huge_pages, shadow_start,
+                     kLowShadowEnd - shadow_start + 1, /*dense*/ false);
+  SetShadowHugePages(common_flags()->shadow_huge_pages, kHighShadowBeg,
+                     kHighShadowEnd - kHighShadowBeg + 1, /*dense*/ false);
+  return true;
+}
+
+// With verbosity, reports how long each initialization step took.
+static u64 init_phase_start_ns;
+
+static void ReportInitPhase(const char *phase) {
+  if (!flags()->verbosity)
+    return;
+  u64 now = MonotonicNanoTime();
+  Report("Init phase %s: %zu us\n", phase,
+         (uptr)((now - init_phase_start_ns) / 1000));
+  init_phase_start_ns = now;
+}
+
 static void PrintAddressSpaceLayout() {
   Printf("|| `[%p, %p]` || HighMem    ||\n",
          (void*)kHighMemBeg, (void*)kHighMemEnd);
@@ -410,6 +543,8 @@ void NOINLINE __asan_handle_no_return() {
   int local_stack;
   AsanThread *curr_thread = GetCurrentThread();
   CHECK(curr_thread);
+  if (curr_thread->fake_stack())
+    curr_thread->fake_stack()->HandleNoReturn();
   uptr PageSize = GetPageSizeCached();
   uptr top = curr_thread->stack_top();
   uptr bottom = ((uptr)&local_stack - PageSize) & ~(PageSize-1);
@@ -439,6 +574,8 @@ void __asan_init() {
   SanitizerToolName = "AddressSanitizer";
   CHECK(!asan_init_is_running && "ASan init calls itself!");
   asan_init_is_running = true;
+  u64 init_start_ns = MonotonicNanoTime();
+  init_phase_start_ns = init_start_ns;
   InitializeHighMemEnd();
 
   // Make sure we are not statically linked.
@@ -461,6 +598,7 @@ void __asan_init() {
 
   // Re-exec ourselves if we need to set additional env or command line args.
   MaybeReexec();
+  ReportInitPhase("flags");
 
   // Setup internal allocator callback.
   SetLowLevelAllocateCallback(OnLowLevelAllocate);
@@ -468,17 +606,28 @@ void __asan_init() {
   if (flags()->atexit) {
     Atexit(asan_atexit);
   }
+  if (common_flags()->timing_sample_rate) {
+    InitializeTiming(common_flags()->timing_sample_rate);
+    Atexit(PrintTimingStats);
+  }
+  InitializeCoverage(common_flags()->coverage_dir);
+  if (common_flags()->coverage)
+    Atexit(DumpCoverage);
+  if (!flags()->halt_on_error)
+    Atexit(PrintRecoveredErrors);
 
   // interceptors
   InitializeAsanInterceptors();
 
   ReplaceSystemMalloc();
   ReplaceOperatorsNewAndDelete();
+  ReportInitPhase("interceptors");
 
   uptr shadow_start = kLowShadowBeg;
   if (kLowShadowBeg)
     shadow_start -= GetMmapGranularity();
-  bool full_shadow_is_available =
+  bool full_shadow_is_reserved = TryReserveFullShadow(shadow_start);
+  bool full_shadow_is_available = full_shadow_is_reserved ||
       MemoryRangeIsAvailable(shadow_start, kHighShadowEnd);
 
 #if SANITIZER_LINUX && defined(__x86_64__) && !ASAN_FIXED_MAPPING
@@ -495,7 +644,9 @@ void __asan_init() {
     DisableCoreDumper();
   }
 
-  if (full_shadow_is_available) {
+  if (full_shadow_is_reserved) {
+    // Done above.
+  } else if (full_shadow_is_available) {
     // mmap the low shadow plus at least one page at the left.
     if (kLowShadowBeg)
       ReserveShadowMemoryRange(shadow_start, kLowShadowEnd);
@@ -523,6 +674,7 @@ void __asan_init() {
     DumpProcessMap();
     Die();
   }
+  ReportInitPhase("shadow");
 
   InstallSignalHandlers();
 
@@ -530,13 +682,18 @@ void __asan_init() {
   // Allocator should be initialized before starting external symbolizer, as
   // fork() on Mac locks the allocator.
   InitializeAllocator();
+  ReportInitPhase("allocator");
 
   // Start symbolizer process if necessary.
   const char* external_symbolizer = common_flags()->external_symbolizer_path;
   if (common_flags()->symbolize && external_symbolizer &&
       external_symbolizer[0]) {
-    InitializeExternalSymbolizer(external_symbolizer);
+    if (common_flags()->fast_init)
+      InitializeExternalSymbolizerLazily(external_symbolizer);
+    else
+      InitializeExternalSymbolizer(external_symbolizer);
   }
+  ReportInitPhase("symbolizer");
 
   // On Linux AsanThread::ThreadStart() calls malloc() that's why asan_inited
   // should be set to 1 prior to initializing the threads.
@@ -555,14 +712,27 @@ void __asan_init() {
   main_thread->ThreadStart(internal_getpid());
   force_interface_symbols();  // no-op.
 
+  if (common_flags()->prefault_shadow) {
+    // The top of the stack is the part in use.
+    const uptr kMaxPrefaultedStack = 1 << 23;
+    uptr size = Min(main_thread->stack_size(), kMaxPrefaultedStack);
+    uptr beg = MEM_TO_SHADOW(main_thread->stack_top() - size);
+    PrefaultRegion(beg, size >> SHADOW_SCALE);
+  }
+
+  if (flags()->stats_dump_path && flags()->stats_dump_path[0])
+    StartStatsDumpThread();
+
 #if CAN_SANITIZE_LEAKS
   __lsan::InitCommonLsan();
   if (common_flags()->detect_leaks && common_flags()->leak_check_at_exit) {
     Atexit(__lsan::DoLeakCheck);
   }
 #endif  // CAN_SANITIZE_LEAKS
+  ReportInitPhase("threads");
 
   if (flags()->verbosity) {
-    Report("AddressSanitizer Init done\n");
+    Report("AddressSanitizer Init done in %zu us\n",
+           (uptr)((MonotonicNanoTime() - init_start_ns) / 1000));
   }
 }
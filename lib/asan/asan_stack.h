@@ -23,16 +23,25 @@ namespace __asan {
 
 void PrintStack(StackTrace *stack);
 
+// Stack trace depth to collect for an allocation of the given size.
+INLINE uptr GetMallocContextSize(uptr size) {
+  if (flags()->small_malloc_context_size >= 0 &&
+      size <= (uptr)flags()->small_malloc_size)
+    return flags()->small_malloc_context_size;
+  return common_flags()->malloc_context_size;
+}
+
+INLINE uptr GetFreeContextSize() {
+  if (flags()->free_context_size >= 0)
+    return flags()->free_context_size;
+  return common_flags()->malloc_context_size;
+}
+
 }  // namespace __asan
 
 // Get the stack trace with the given pc and bp.
 // The pc will be in the position 0 of the resulting stack trace.
 // The bp may refer to the current frame or to the caller's frame.
-#if SANITIZER_WINDOWS
-#define GET_STACK_TRACE_WITH_PC_AND_BP(max_s, pc, bp, fast)     \
-  StackTrace stack;                                             \
-  GetStackTrace(&stack, max_s, pc, bp, 0, 0, fast)
-#else
 #define GET_STACK_TRACE_WITH_PC_AND_BP(max_s, pc, bp, fast)     \
   StackTrace stack;                                             \
   {                                                             \
@@ -45,7 +54,6 @@ void PrintStack(StackTrace *stack);
     GetStackTrace(&stack, max_s, pc, bp,                        \
                   stack_top, stack_bottom, fast);               \
   }
-#endif  // SANITIZER_WINDOWS
 
 // NOTE: A Rule of thumb is to retrieve stack trace in the interceptors
 // as early as possible (in functions exposed to the user), as we generally
@@ -69,7 +77,14 @@ void PrintStack(StackTrace *stack);
   GET_STACK_TRACE(common_flags()->malloc_context_size,            \
                   common_flags()->fast_unwind_on_malloc)
 
-#define GET_STACK_TRACE_FREE GET_STACK_TRACE_MALLOC
+// Same as GET_STACK_TRACE_MALLOC, but the depth may depend on the size.
+#define GET_STACK_TRACE_MALLOC_SIZE(size)                         \
+  GET_STACK_TRACE(GetMallocContextSize(size),                     \
+                  common_flags()->fast_unwind_on_malloc)
+
+#define GET_STACK_TRACE_FREE                                      \
+  GET_STACK_TRACE(GetFreeContextSize(),                           \
+                  common_flags()->fast_unwind_on_malloc)
 
 #define PRINT_CURRENT_STACK()                    \
   {                                              \
@@ -52,6 +52,18 @@ void AsanStats::Print() {
   PrintMallocStatsArray("  rfrees  by size class: ", really_freed_by_size);
   Printf("Stats: malloc large: %zu small slow: %zu\n",
              malloc_large, malloc_small_slow);
+  if (flags()->sample_allocations > 1)
+    Printf("Stats: %zu of %zu mallocs not sampled\n",
+           malloc_unsampled, mallocs);
+  if (flags()->heap_overhead_budget) {
+    uptr live = malloced > freed ? malloced - freed : 0;
+    uptr heap = mmaped > munmaped ? mmaped - munmaped : 0;
+    uptr projected = live / 100 * flags()->heap_overhead_budget;
+    uptr actual = heap > live ? heap - live : 0;
+    Printf("Stats: heap overhead budget %d%%: projected %zuM, actual %zuM; "
+           "%zu mallocs with full redzones\n", flags()->heap_overhead_budget,
+           projected >> 20, actual >> 20, malloc_full_redzone);
+  }
 }
 
 static BlockingMutex print_lock(LINKER_INITIALIZED);
@@ -65,6 +77,21 @@ static void PrintAccumulatedStats() {
   StackDepotStats *stack_depot_stats = StackDepotGetStats();
   Printf("Stats: StackDepot: %zd ids; %zdM mapped\n",
          stack_depot_stats->n_uniq_ids, stack_depot_stats->mapped >> 20);
+  Printf("Stats: StackDepot: %zd tables; %zd buckets; max chain %zd; "
+         "chains by length: ", stack_depot_stats->n_tabs,
+         stack_depot_stats->n_buckets, stack_depot_stats->max_chain_len);
+  for (uptr i = 0; i < kStackDepotChainHistSize; i++) {
+    uptr c = stack_depot_stats->chain_len_hist[i];
+    if (!c) continue;
+    Printf("%zd:%zd; ", i, c);
+  }
+  Printf("\n");
+  Printf("Stats: StackDepot: cache hits %zd of %zd lookups\n",
+         stack_depot_stats->n_cache_hits, stack_depot_stats->n_cache_lookups);
+  if (stack_depot_stats->n_truncated || stack_depot_stats->n_dropped)
+    Printf("Stats: StackDepot: %zd stacks truncated, %zd dropped "
+           "(stack_depot_max_mb)\n", stack_depot_stats->n_truncated,
+           stack_depot_stats->n_dropped);
   PrintInternalAllocatorStats();
 }
 
@@ -132,6 +159,77 @@ AsanStats &GetCurrentThreadStats() {
   return (t) ? t->stats() : unknown_thread_stats;
 }
 
+COMPILER_CHECK(kNumberOfSizeClasses <=
+               ARRAY_SIZE(((__asan_heap_stats *)0)->class_size));
+
+static void GetHeapStats(__asan_heap_stats *res) {
+  AsanStats stats;
+  GetAccumulatedStats(&stats);
+  res->mallocs = stats.mallocs;
+  res->malloced = stats.malloced;
+  res->frees = stats.frees;
+  res->freed = stats.freed;
+  res->real_frees = stats.real_frees;
+  res->really_freed = stats.really_freed;
+  res->mmaps = stats.mmaps;
+  res->mmaped = stats.mmaped;
+  res->munmaps = stats.munmaps;
+  res->munmaped = stats.munmaped;
+  res->quarantine_size = GetQuarantineSize();
+  GetAllocatorCacheStats(&res->cache_refills, &res->cache_drains);
+  res->num_size_classes = kNumberOfSizeClasses;
+  for (uptr i = 0; i < kNumberOfSizeClasses; i++) {
+    res->class_size[i] = SizeClassToSize(i);
+    res->mallocs_by_class[i] = stats.malloced_by_size[i];
+    res->frees_by_class[i] = stats.really_freed_by_size[i];
+  }
+}
+
+// Appends one line per dump:
+// <time in ns> mallocs=... ... classes=<class>:<mallocs>/<frees>;...
+static void DumpStats(fd_t fd, char *buf, uptr size, __asan_heap_stats *s) {
+  GetHeapStats(s);
+  uptr pos = internal_snprintf(buf, size,
+      "%llu mallocs=%zu malloced=%zu frees=%zu freed=%zu rfrees=%zu "
+      "rfreed=%zu mmaps=%zu mmaped=%zu munmaps=%zu munmaped=%zu "
+      "quarantine=%zu refills=%zu drains=%zu classes=", NanoTime(),
+      s->mallocs, s->malloced, s->frees, s->freed, s->real_frees,
+      s->really_freed, s->mmaps, s->mmaped, s->munmaps, s->munmaped,
+      s->quarantine_size, s->cache_refills, s->cache_drains);
+  for (uptr i = 0; i < s->num_size_classes && pos < size; i++) {
+    if (!s->mallocs_by_class[i] && !s->frees_by_class[i]) continue;
+    pos += internal_snprintf(buf + pos, size - pos, "%zu:%zu/%zu;", i,
+                             s->mallocs_by_class[i], s->frees_by_class[i]);
+  }
+  if (pos >= size)
+    pos = size - 1;
+  buf[pos++] = '\n';
+  internal_write(fd, buf, pos);
+}
+
+static void *StatsDumpThread(void *arg) {
+  fd_t fd = (fd_t)(uptr)arg;
+  InternalScopedBuffer<char> buf(1 << 14);
+  InternalScopedBuffer<__asan_heap_stats> stats(1);
+  for (;;) {
+    SleepForMillis(flags()->stats_dump_interval_ms);
+    DumpStats(fd, buf.data(), buf.size(), stats.data());
+  }
+  return 0;
+}
+
+void StartStatsDumpThread() {
+  uptr openrv = OpenFile(flags()->stats_dump_path, true);
+  if (internal_iserror(openrv)) {
+    Report("ERROR: Can't open file: %s\n", flags()->stats_dump_path);
+    return;
+  }
+  if (!StartInternalThread(StatsDumpThread, (void*)openrv)) {
+    Report("ERROR: Can't start the stats dump thread\n");
+    internal_close(openrv);
+  }
+}
+
 }  // namespace __asan
 
 // ---------------------- Interface ---------------- {{{1
@@ -174,3 +272,7 @@ uptr __asan_get_unmapped_bytes() {
 void __asan_print_accumulated_stats() {
   PrintAccumulatedStats();
 }
+
+void __asan_get_stats(__asan_heap_stats *stats) {
+  GetHeapStats(stats);
+}
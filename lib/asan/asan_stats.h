@@ -46,6 +46,10 @@ struct AsanStats {
 
   uptr malloc_large;
   uptr malloc_small_slow;
+  // Allocations with the regular redzone when heap_overhead_budget is set.
+  uptr malloc_full_redzone;
+  // Allocations that were not checked because of sample_allocations.
+  uptr malloc_unsampled;
 
   // Ctor for global AsanStats (accumulated stats and main thread stats).
   explicit AsanStats(LinkerInitialized) { }
@@ -75,6 +79,9 @@ struct AsanMallocStats {
 
 void FillMallocStatistics(AsanMallocStats *malloc_stats);
 
+// Starts a thread that appends stats to flags()->stats_dump_path.
+void StartStatsDumpThread();
+
 }  // namespace __asan
 
 #endif  // ASAN_STATS_H
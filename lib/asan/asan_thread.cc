@@ -18,7 +18,9 @@
 #include "asan_thread.h"
 #include "asan_mapping.h"
 #include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_mutex.h"
 #include "sanitizer_common/sanitizer_placement_new.h"
+#include "sanitizer_common/sanitizer_timing.h"
 #include "lsan/lsan_common.h"
 
 namespace __asan {
@@ -44,7 +46,10 @@ static ALIGNED(16) char thread_registry_placeholder[sizeof(ThreadRegistry)];
 static ThreadRegistry *asan_thread_registry;
 
 static ThreadContextBase *GetAsanThreadContext(u32 tid) {
-  void *mem = MmapOrDie(sizeof(AsanThreadContext), "AsanThreadContext");
+  // Called under the registry lock. The contexts are never freed, so they
+  // are carved out of larger mappings instead of taking a mapping each.
+  static LowLevelAllocator allocator_for_contexts;
+  void *mem = allocator_for_contexts.Allocate(sizeof(AsanThreadContext));
   return new(mem) AsanThreadContext(tid);
 }
 
@@ -71,11 +76,33 @@ AsanThreadContext *GetThreadContextByTidLocked(u32 tid) {
 
 // AsanThread implementation.
 
+// The AsanThread objects of finished threads are kept, with their fake
+// stacks, for the threads created later. Programs that create a thread per
+// task then save an mmap/munmap pair of each, and the poisoning of the whole
+// fake stack shadow when it is unmapped.
+static const uptr kMaxPooledThreads = 64;
+static StaticSpinMutex thread_pool_mu;
+static AsanThread *thread_pool;
+static uptr thread_pool_size;
+
 AsanThread *AsanThread::Create(thread_callback_t start_routine,
                                void *arg) {
-  uptr PageSize = GetPageSizeCached();
-  uptr size = RoundUpTo(sizeof(AsanThread), PageSize);
-  AsanThread *thread = (AsanThread*)MmapOrDie(size, __FUNCTION__);
+  AsanThread *thread;
+  {
+    SpinMutexLock l(&thread_pool_mu);
+    thread = thread_pool;
+    if (thread) {
+      thread_pool = thread->next_pooled_;
+      thread_pool_size--;
+    }
+  }
+  // A pooled thread is not cleared: Destroy() has emptied its malloc storage
+  // and stats, Init() resets its fake stack and sets the other fields. The
+  // allocator cache alone is megabytes which a new mapping does not touch.
+  if (!thread) {
+    uptr size = RoundUpTo(sizeof(AsanThread), GetPageSizeCached());
+    thread = (AsanThread*)MmapOrDie(size, __FUNCTION__);
+  }
   thread->start_routine_ = start_routine;
   thread->arg_ = arg;
   thread->context_ = 0;
@@ -97,11 +124,22 @@ void AsanThread::Destroy() {
   }
 
   asanThreadRegistry().FinishThread(tid());
+  malloc_storage().CommitBack();
   FlushToAccumulatedStats(&stats_);
+  TimingThreadFinish();
   // We also clear the shadow on thread destruction because
   // some code may still be executing in later TSD destructors
   // and we don't want it to have any poisoned stack.
   ClearShadowForThreadStackAndTLS();
+  {
+    SpinMutexLock l(&thread_pool_mu);
+    if (thread_pool_size < kMaxPooledThreads) {
+      next_pooled_ = thread_pool;
+      thread_pool = this;
+      thread_pool_size++;
+      return;
+    }
+  }
   DeleteFakeStack();
   uptr size = RoundUpTo(sizeof(AsanThread), GetPageSizeCached());
   UnmapOrDie(this, size);
@@ -118,7 +156,10 @@ void AsanThread::Init() {
            tid(), (void*)stack_bottom_, (void*)stack_top_,
            stack_top_ - stack_bottom_, &local);
   }
-  fake_stack_ = 0;  // Will be initialized lazily if needed.
+  // A new fake stack is initialized lazily if needed, the one of a pooled
+  // thread is reused.
+  if (fake_stack_)
+    fake_stack_->Reset(stack_size());
   AsanPlatformThreadInit();
 }
 
@@ -136,7 +177,6 @@ thread_return_t AsanThread::ThreadStart(uptr os_id) {
   }
 
   thread_return_t res = start_routine_(arg_);
-  malloc_storage().CommitBack();
   if (flags()->use_sigaltstack) UnsetAlternateSignalStack();
 
   this->Destroy();
@@ -260,7 +300,7 @@ void EnsureMainThreadIDIsCorrect() {
   AsanThreadContext *context =
       reinterpret_cast<AsanThreadContext *>(AsanTSDGet());
   if (context && (context->tid == 0))
-    context->os_id = GetTid();
+    asanThreadRegistry().SetThreadOsId(0, GetTid());
 }
 }  // namespace __asan
 
@@ -295,4 +335,8 @@ void UnlockThreadRegistry() {
 void EnsureMainThreadIDIsCorrect() {
   __asan::EnsureMainThreadIDIsCorrect();
 }
+
+bool StartInternalThread(void *(*func)(void *arg), void *arg) {
+  return __asan::StartInternalThread(func, arg);
+}
 }  // namespace __lsan
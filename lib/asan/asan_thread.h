@@ -50,7 +50,8 @@ class AsanThreadContext : public ThreadContextBase {
 // AsanThreadContext objects are never freed, so we need many of them.
 COMPILER_CHECK(sizeof(AsanThreadContext) <= 4096);
 
-// AsanThread are stored in TSD and destroyed when the thread dies.
+// AsanThread are stored in TSD and destroyed when the thread dies. Destroyed
+// objects are pooled and handed out again by Create().
 class AsanThread {
  public:
   static AsanThread *Create(thread_callback_t start_routine, void *arg);
@@ -105,6 +106,7 @@ class AsanThread {
   FakeStack *fake_stack_;
   AsanThreadLocalMallocStorage malloc_storage_;
   AsanStats stats_;
+  AsanThread *next_pooled_;
 };
 
 struct CreateThreadContextArgs {
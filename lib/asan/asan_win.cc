@@ -84,6 +84,14 @@ void ReadContextStack(void *context, uptr *stack, uptr *ssize) {
   UNIMPLEMENTED();
 }
 
+bool InitSharedShadowPoison(u8 value) {
+  return false;
+}
+
+bool MapSharedShadowPoison(uptr beg) {
+  return false;
+}
+
 }  // namespace __asan
 
 // ---------------------- Interface ---------------- {{{1
@@ -0,0 +1,27 @@
+// Check that LSan reports the leaked chunks which were not sampled, without
+// their allocation stacks.
+// RUN: %clangxx_asan -O0 %s -o %t
+// RUN: ASAN_OPTIONS=detect_leaks=1:sample_allocations=1000000 \
+// RUN:   LSAN_OPTIONS=use_stacks=0:use_registers=0 not %t 2>&1 | FileCheck %s
+// REQUIRES: x86_64-supported-target, asan-64-bits
+
+#include <stdlib.h>
+
+void *sink;
+
+__attribute__((noinline)) void LeakObjects(int size, int count) {
+  for (int i = 0; i < count; i++)
+    sink = malloc(size);
+}
+
+int main() {
+  // Only the first allocation of the thread is sampled.
+  free(malloc(1));
+  LeakObjects(33, 10);
+  sink = 0;
+  return 0;
+}
+// CHECK: ERROR: LeakSanitizer: detected memory leaks
+// CHECK: Direct leak of 330 byte(s) in 10 object(s) allocated from:
+// CHECK-NEXT: <allocation stack not recorded>
+// CHECK: SUMMARY: {{.*}}Sanitizer: 330 byte(s) leaked in 10 allocation(s)
@@ -0,0 +1,29 @@
+// Check that the heap stays checked when the shadow of the released free
+// memory is reclaimed.
+// RUN: %clangxx_asan -O0 %s -o %t
+// RUN: ASAN_OPTIONS=release_heap_shadow=1:release_to_os_interval_ms=0:quarantine_size=1 not %t 2>&1 | FileCheck %s
+// REQUIRES: x86_64-supported-target, asan-64-bits
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const int kNumChunks = 2048;
+const int kChunkSize = 4000;
+
+int main() {
+  char *chunks[kNumChunks];
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < kNumChunks; i++) {
+      chunks[i] = (char*)malloc(kChunkSize);
+      memset(chunks[i], round, kChunkSize);
+    }
+    for (int i = 0; i < kNumChunks; i++)
+      free(chunks[i]);
+  }
+  fprintf(stderr, "DONE\n");
+  // CHECK: DONE
+  volatile char *p = chunks[kNumChunks / 2];
+  return p[kChunkSize / 2];
+  // CHECK: ERROR: AddressSanitizer: heap-
+}
@@ -0,0 +1,52 @@
+// Threads created one after another reuse the fake stack of the finished
+// ones: the frames left poisoned by a finished thread must not fire, and
+// use-after-return must still be found in a reused fake stack.
+// RUN: %clangxx_asan -fsanitize=use-after-return -O0 %s -o %t && \
+// RUN:   not %t 2>&1 | FileCheck %s
+// RUN: %clangxx_asan -fsanitize=use-after-return -O2 %s -o %t && \
+// RUN:   not %t 2>&1 | FileCheck %s
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+__attribute__((noinline))
+char *pretend_to_do_something(char *x) {
+  __asm__ __volatile__("" : : "r" (x) : "memory");
+  return x;
+}
+
+__attribute__((noinline))
+char *LeakStack() {
+  char x[1024];
+  memset(x, 0, sizeof(x));
+  return pretend_to_do_something(x);
+}
+
+__attribute__((noinline))
+void UseStack() {
+  char x[1024];
+  memset(x, 1, sizeof(x));
+  pretend_to_do_something(x);
+}
+
+void *Thread(void *arg) {
+  char *stale = LeakStack();
+  UseStack();
+  if (arg)
+    stale[100] = 1;
+  return 0;
+}
+
+int main() {
+  const int kNumThreads = 100;
+  for (int i = 0; i <= kNumThreads; i++) {
+    pthread_t t;
+    pthread_create(&t, 0, Thread, i == kNumThreads ? &t : 0);
+    pthread_join(t, 0);
+  }
+  fprintf(stderr, "Not reached\n");
+  // CHECK: ERROR: AddressSanitizer: stack-use-after-return
+  // CHECK-NOT: Not reached
+  return 0;
+}
@@ -0,0 +1,39 @@
+// Check that the globals of a library that is loaded and unloaded many
+// times are still described right.
+// RUN: %clangxx_asan -O0 %p/SharedLibs/dlclose-test-so.cc \
+// RUN:     -fPIC -shared -o %t-so.so
+// RUN: %clangxx_asan -O0 %s -o %t && not %t 2>&1 | FileCheck %s
+
+#include <dlfcn.h>
+#include <stdio.h>
+
+#include <string>
+
+typedef int *(fun_t)();
+
+int main(int argc, char *argv[]) {
+  std::string path = std::string(argv[0]) + "-so.so";
+  void *lib = 0;
+  for (int i = 0; i < 100; i++) {
+    lib = dlopen(path.c_str(), RTLD_NOW);
+    if (!lib) {
+      printf("error in dlopen(): %s\n", dlerror());
+      return 1;
+    }
+    if (i == 99)
+      break;
+    dlclose(lib);
+  }
+  fun_t *get = (fun_t*)dlsym(lib, "get_address_of_static_var");
+  if (!get) {
+    printf("failed dlsym\n");
+    return 1;
+  }
+  int *addr = get();
+  fprintf(stderr, "LOADED\n");
+  // CHECK: LOADED
+  return addr[argc];
+  // CHECK: {{READ of size 4 at 0x.* thread T0}}
+  // CHECK: {{0x.* is located 0 bytes to the right of global variable}}
+  // CHECK:   {{.*static_var.* of size 4}}
+}
@@ -0,0 +1,37 @@
+// Test that with halt_on_error=0 the invalid accesses found by interceptors
+// are reported once per place and the program keeps running.
+// RUN: %clangxx_asan -O0 %s -o %t
+// RUN: ASAN_OPTIONS=halt_on_error=0 %t 2>&1 | FileCheck %s
+// RUN: not %t 2>&1 | FileCheck %s --check-prefix=CHECK-HALT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+char dst[100];
+char *volatile p;
+
+__attribute__((noinline)) void Copy1() { memcpy(dst, p, 20); }
+__attribute__((noinline)) void Copy2() { memcpy(dst, p, 20); }
+
+int main() {
+  p = (char *)malloc(10);
+  for (int i = 0; i < 100; i++)
+    Copy1();
+  Copy2();
+  fprintf(stderr, "Done\n");
+  free(p);
+  return 0;
+}
+// CHECK: heap-buffer-overflow
+// CHECK: {{#1 0x.* in .*Copy1}}
+// CHECK: heap-buffer-overflow
+// CHECK: {{#1 0x.* in .*Copy2}}
+// CHECK-NOT: heap-buffer-overflow
+// CHECK: Done
+// CHECK: 101 invalid access(es) at 2 place(s)
+// CHECK-DAG: READ, 100 time(s)
+// CHECK-DAG: READ, 1 time(s)
+
+// CHECK-HALT: heap-buffer-overflow
+// CHECK-HALT-NOT: Done
@@ -9,6 +9,8 @@
 #===------------------------------------------------------------------------===#
 import bisect
 import getopt
+import hashlib
+import multiprocessing
 import os
 import pty
 import re
@@ -20,11 +22,18 @@ llvm_symbolizer = None
 symbolizers = {}
 DEBUG = False
 demangle = False;
+# Path prefixes to cut from file names, passed as arguments.
+paths_to_cut = sys.argv[1:]
+# Used by the batch mode, see process_stdin_batch().
+jobs = 0
+cache_dir = None
+# The number of offsets one worker symbolizes at a time.
+BATCH_SIZE = 512
 
 
 # FIXME: merge the code that calls fix_filename().
 def fix_filename(file_name):
-  for path_to_cut in sys.argv[1:]:
+  for path_to_cut in paths_to_cut:
     file_name = re.sub('.*' + path_to_cut, '', file_name)
   file_name = re.sub('.*asan_[a-z_]*.cc:[0-9]*', '_asan_rtl_', file_name)
   file_name = re.sub('.*crtstuff.c:0', '???:0', file_name)
@@ -315,6 +324,110 @@ class BreakpadSymbolizer(Symbolizer):
       return None
 
 
+#0 0x7f6e35cf2e45  (/blah/foo.so+0x11fe45)
+stack_trace_line_format = (
+    '^( *#([0-9]+) *)(0x[0-9a-f]+) *\((.*)\+(0x[0-9a-f]+)\)')
+
+
+def get_build_id(binary):
+  """Returns a string identifying the contents of the binary.
+
+  This is the GNU build-id or the Mach-O UUID when the binary has one, or
+  else the path, size and modification time of the file.
+  """
+  try:
+    if os.uname()[0] == 'Darwin':
+      output = subprocess.Popen(['dwarfdump', '--uuid', binary],
+                                stdout=subprocess.PIPE).communicate()[0]
+      match = re.search('UUID: ([0-9A-F-]+)', output)
+    else:
+      output = subprocess.Popen(['readelf', '-n', binary],
+                                stdout=subprocess.PIPE,
+                                stderr=open(os.devnull, 'w')).communicate()[0]
+      match = re.search('Build ID: ([0-9a-f]+)', output)
+    if match:
+      return match.group(1)
+    st = os.stat(binary)
+  except (OSError, IOError):
+    return None
+  return hashlib.md5('%s %d %d' % (os.path.realpath(binary), st.st_size,
+                                   st.st_mtime)).hexdigest()
+
+
+class SymbolizationCache(object):
+  """On-disk cache of symbolized frames, one file per binary build-id.
+
+  Each line of a cache file is an offset followed by the frames of that
+  offset, separated with tabs. The frames are stored without the leading
+  address, which differs from run to run. The options that affect the
+  output (demangling, path prefixes to cut) are part of the file name.
+  """
+  def __init__(self, directory):
+    self.directory = directory
+    if not os.path.isdir(directory):
+      os.makedirs(directory)
+    self.options = hashlib.md5(repr((demangle, paths_to_cut))).hexdigest()[:8]
+    self.entries = {}
+    self.files = {}
+
+  def path(self, binary):
+    if not binary in self.files:
+      build_id = get_build_id(binary)
+      if build_id:
+        self.files[binary] = os.path.join(
+            self.directory, '%s.%s' % (build_id, self.options))
+      else:
+        self.files[binary] = None
+    return self.files[binary]
+
+  def load(self, binary):
+    """Returns a dict offset -> frames of the cached binary."""
+    if not binary in self.entries:
+      entries = {}
+      path = self.path(binary)
+      if path and os.path.exists(path):
+        for line in open(path):
+          fields = line.rstrip('\n').split('\t')
+          entries[fields[0]] = fields[1:]
+      self.entries[binary] = entries
+    return self.entries[binary]
+
+  def store(self, binary, new_entries):
+    self.load(binary).update(new_entries)
+    path = self.path(binary)
+    if not path or not new_entries:
+      return
+    # Append only: concurrent runs sharing the cache only ever add lines,
+    # and a line written twice just has the same contents.
+    f = open(path, 'a')
+    for offset, frames in new_entries.iteritems():
+      f.write('\t'.join([offset] + frames) + '\n')
+    f.close()
+
+
+# The symbolizers of a worker process, created by its first batch.
+worker_loop = None
+
+
+def symbolize_batch(batch):
+  """Symbolizes (addr, offset) pairs of a single binary in a worker.
+
+  Returns the frames of every offset with the addresses stripped, see
+  SymbolizationCache.
+  """
+  global worker_loop
+  binary, items = batch
+  if not worker_loop:
+    worker_loop = SymbolizationLoop()
+  result = {}
+  for addr, offset in items:
+    frames = worker_loop.symbolize_address(addr, binary, offset)
+    prefix = addr + ' in '
+    result[offset] = [f[len(prefix):] if f.startswith(prefix) else f
+                      for f in frames]
+  return binary, result
+
+
 class SymbolizationLoop(object):
   def __init__(self, binary_name_filter=None):
     # Used by clients who may want to supply a different binary name.
@@ -352,15 +465,15 @@ class SymbolizationLoop(object):
         self.frame_no += 1
 
   def process_stdin(self):
+    if jobs or cache_dir:
+      self.process_stdin_batch()
+      return
     self.frame_no = 0
     while True:
       line = sys.stdin.readline()
       if not line:
         break
       self.current_line = line.rstrip()
-      #0 0x7f6e35cf2e45  (/blah/foo.so+0x11fe45)
-      stack_trace_line_format = (
-          '^( *#([0-9]+) *)(0x[0-9a-f]+) *\((.*)\+(0x[0-9a-f]+)\)')
       match = re.match(stack_trace_line_format, line)
       if not match:
         print self.current_line
@@ -380,11 +493,73 @@ class SymbolizationLoop(object):
           symbolized_line = self.symbolize_address(addr, binary, offset)
       self.print_symbolized_lines(symbolized_line)
 
+  def process_stdin_batch(self):
+    """Symbolizes the whole input at once, for large logs.
+
+    Every (binary, offset) pair is symbolized once, however many reports
+    it appears in. The pairs missing from the cache are split into batches
+    which are symbolized by a pool of worker processes, each running its
+    own symbolizers.
+    """
+    lines = sys.stdin.readlines()
+    frames = []
+    pending = {}
+    cache = SymbolizationCache(cache_dir) if cache_dir else None
+    symbolized = {}
+    for line in lines:
+      match = re.match(stack_trace_line_format, line)
+      if not match:
+        frames.append(None)
+        continue
+      _, frameno_str, addr, binary, offset = match.groups()
+      if self.binary_name_filter:
+        binary = self.binary_name_filter(binary)
+      frames.append((frameno_str, addr, binary, offset))
+      if not binary in symbolized:
+        symbolized[binary] = cache.load(binary).copy() if cache else {}
+      if not offset in symbolized[binary]:
+        pending.setdefault(binary, {}).setdefault(offset, addr)
+    batches = []
+    for binary, offsets in pending.iteritems():
+      items = [(addr, offset) for offset, addr in offsets.iteritems()]
+      for i in range(0, len(items), BATCH_SIZE):
+        batches.append((binary, items[i:i + BATCH_SIZE]))
+    if batches:
+      if jobs > 1:
+        pool = multiprocessing.Pool(jobs)
+        results = pool.imap_unordered(symbolize_batch, batches)
+      else:
+        results = map(symbolize_batch, batches)
+      for binary, result in results:
+        symbolized[binary].update(result)
+        if cache:
+          cache.store(binary, result)
+      if jobs > 1:
+        pool.close()
+        pool.join()
+    self.frame_no = 0
+    for line, frame in zip(lines, frames):
+      self.current_line = line.rstrip()
+      if not frame:
+        print self.current_line
+        continue
+      frameno_str, addr, binary, offset = frame
+      if frameno_str == '0':
+        self.frame_no = 0
+      self.print_symbolized_lines(
+          ['%s in %s' % (addr, f) for f in symbolized[binary][offset]])
+
 
 if __name__ == '__main__':
-  opts, args = getopt.getopt(sys.argv[1:], "d", ["demangle"])
+  opts, args = getopt.getopt(sys.argv[1:], "dj:",
+                             ["demangle", "jobs=", "cache-dir="])
   for o, a in opts:
     if o in ("-d", "--demangle"):
       demangle = True;
+    elif o in ("-j", "--jobs"):
+      jobs = int(a)
+    elif o == "--cache-dir":
+      cache_dir = a
+  paths_to_cut = args
   loop = SymbolizationLoop()
   loop.process_stdin()
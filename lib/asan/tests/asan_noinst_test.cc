@@ -15,6 +15,7 @@
 #include "asan_allocator.h"
 #include "asan_internal.h"
 #include "asan_mapping.h"
+#include "asan_poisoning.h"
 #include "asan_test_utils.h"
 
 #include <assert.h>
@@ -347,6 +348,51 @@ TEST(AddressSanitizer, MemsetWildAddressTest) {
                "unknown-crash.*high shadow");
 }
 
+TEST(AddressSanitizer, LargeReallocInPlaceTest) {
+  bool old_flag = __asan::flags()->large_realloc_in_place;
+  __asan::flags()->large_realloc_in_place = true;
+  const uptr kSize = 1 << 20;
+  char *p = Ident((char*)malloc(kSize));
+  memset(p, 0xab, kSize);
+  for (uptr size = 2 * kSize; size <= 32 * kSize; size *= 2) {
+    p = Ident((char*)realloc(p, size + 3));
+    EXPECT_EQ(size + 3, __asan_get_allocated_size(p));
+    EXPECT_EQ(0U, __asan_region_is_poisoned((uptr)p, size + 3));
+    EXPECT_TRUE(__asan_address_is_poisoned(p + size + 3));
+    EXPECT_EQ((char)0xab, p[kSize - 1]);
+  }
+  // Shrink while staying in the secondary allocator.
+  p = Ident((char*)realloc(p, kSize));
+  EXPECT_EQ(kSize, __asan_get_allocated_size(p));
+  EXPECT_TRUE(__asan_address_is_poisoned(p + kSize));
+  EXPECT_EQ((char)0xab, p[kSize - 1]);
+  free(p);
+  __asan::flags()->large_realloc_in_place = old_flag;
+}
+
+TEST(AddressSanitizer, ShadowPoisonBatchTest) {
+  using __asan::ShadowPoisonBatch;
+  const uptr kSize = 1 << 20;
+  char *p = Ident((char*)malloc(kSize));
+  uptr beg = (uptr)p;
+  ShadowPoisonBatch batch;
+  batch.Add(beg, 64, __asan::kAsanHeapLeftRedzoneMagic);
+  batch.Add(beg + 64, 64, __asan::kAsanHeapLeftRedzoneMagic);
+  batch.Add(beg + 256, 64, __asan::kAsanHeapLeftRedzoneMagic);
+  EXPECT_EQ(0U, __asan_region_is_poisoned(beg, kSize));
+  batch.Flush();
+  EXPECT_EQ(beg, __asan_region_is_poisoned(beg, kSize));
+  EXPECT_TRUE(__asan_address_is_poisoned(p + 127));
+  EXPECT_EQ(0U, __asan_region_is_poisoned(beg + 128, 128));
+  EXPECT_EQ(beg + 256, __asan_region_is_poisoned(beg + 128, kSize - 128));
+  EXPECT_EQ(0U, __asan_region_is_poisoned(beg + 320, kSize - 320));
+  // Large ranges are unpoisoned in a different way.
+  batch.Add(beg, kSize, 0);
+  batch.Flush();
+  EXPECT_EQ(0U, __asan_region_is_poisoned(beg, kSize));
+  free(p);
+}
+
 TEST(AddressSanitizerInterface, GetEstimatedAllocatedSize) {
   EXPECT_EQ(0U, __asan_get_estimated_allocated_size(0));
   const size_t sizes[] = { 1, 30, 1<<30 };
@@ -416,6 +462,30 @@ TEST(AddressSanitizerInterface, GetCurrentAllocatedBytesTest) {
   EXPECT_EQ(before_malloc, after_free);
 }
 
+TEST(AddressSanitizerInterface, GetStatsTest) {
+  const size_t kMallocSize = 100;
+  __asan_heap_stats *before = new __asan_heap_stats;
+  __asan_heap_stats *after = new __asan_heap_stats;
+  __asan_get_stats(before);
+  char *array = Ident((char*)malloc(kMallocSize));
+  free(array);
+  __asan_get_stats(after);
+  EXPECT_LE(before->mallocs + 1, after->mallocs);
+  EXPECT_LE(before->malloced + kMallocSize, after->malloced);
+  EXPECT_LE(before->frees + 1, after->frees);
+  EXPECT_GT(after->num_size_classes, 0U);
+  size_t class_mallocs = 0, class_bytes = 0;
+  for (size_t i = 0; i < after->num_size_classes; i++) {
+    class_mallocs += after->mallocs_by_class[i] - before->mallocs_by_class[i];
+    if (after->mallocs_by_class[i] != before->mallocs_by_class[i])
+      class_bytes = after->class_size[i];
+  }
+  EXPECT_LE(1U, class_mallocs);
+  EXPECT_LE(kMallocSize, class_bytes);
+  delete before;
+  delete after;
+}
+
 static void DoDoubleFree() {
   int *x = Ident(new int);
   delete Ident(x);
@@ -656,6 +726,57 @@ TEST(AddressSanitizerInterface, PoisoningStressTest) {
   }
 }
 
+// The bulk calls leave the same shadow as the calls for a single region.
+TEST(AddressSanitizerInterface, BulkPoisonMemoryRegionsTest) {
+  const size_t kSize = 512;
+  const size_t kNumRegions = 16;
+  char *arr = Ident((char*)malloc(kSize));
+  bool expected[kSize];
+  const void *addrs[kNumRegions];
+  size_t sizes[kNumRegions];
+  u32 seed = my_rand();
+  for (int iter = 0; iter < 100; iter++) {
+    for (size_t i = 0; i < kNumRegions; i++) {
+      size_t beg = my_rand_r(&seed) % kSize;
+      addrs[i] = arr + beg;
+      sizes[i] = my_rand_r(&seed) % (kSize - beg) % 64;
+    }
+    for (int poison = 0; poison < 2; poison++) {
+      __asan_unpoison_memory_region(arr, kSize);
+      if (!poison)
+        __asan_poison_memory_region(arr, kSize);
+      for (size_t i = 0; i < kNumRegions; i++) {
+        if (poison)
+          __asan_poison_memory_region(addrs[i], sizes[i]);
+        else
+          __asan_unpoison_memory_region(addrs[i], sizes[i]);
+      }
+      for (size_t i = 0; i < kSize; i++)
+        expected[i] = __asan_address_is_poisoned(arr + i);
+
+      __asan_unpoison_memory_region(arr, kSize);
+      if (poison) {
+        __asan_poison_memory_regions(addrs, sizes, kNumRegions);
+      } else {
+        __asan_poison_memory_region(arr, kSize);
+        __asan_unpoison_memory_regions(addrs, sizes, kNumRegions);
+      }
+      for (size_t i = 0; i < kSize; i++)
+        ASSERT_EQ(expected[i], __asan_address_is_poisoned(arr + i));
+
+      if (poison)
+        continue;
+      __asan_unpoison_memory_region(arr, kSize);
+      __asan_poison_memory_region_except(arr, kSize, addrs, sizes,
+                                         kNumRegions);
+      for (size_t i = 0; i < kSize; i++)
+        ASSERT_EQ(expected[i], __asan_address_is_poisoned(arr + i));
+    }
+  }
+  __asan_unpoison_memory_region(arr, kSize);
+  free(arr);
+}
+
 TEST(AddressSanitizerInterface, PoisonedRegion) {
   size_t rz = 16;
   for (size_t size = 1; size <= 64; size++) {
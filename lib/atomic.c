@@ -43,14 +43,22 @@
 #pragma redefine_extname __atomic_compare_exchange_c __atomic_compare_exchange
 #endif
 
-/// Number of locks.  This allocates one page on 32-bit platforms, two on
-/// 64-bit.  This can be specified externally if a different trade between
-/// memory usage and contention probability is required for a given platform.
+/// Number of locks.  Each lock takes a cache line, so this allocates 64KB.
+/// This can be specified externally if a different trade between memory usage
+/// and contention probability is required for a given platform.
 #ifndef SPINLOCK_COUNT
 #define SPINLOCK_COUNT (1<<10)
 #endif
 static const long SPINLOCK_MASK = SPINLOCK_COUNT - 1;
 
+/// The locks are padded to this size, so that the threads using neighbouring
+/// locks don't contend for the same cache line.
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+#define PADDED_LOCK(Lock) \
+  struct { Lock lock; char pad[CACHE_LINE_SIZE - sizeof(Lock)]; }
+
 ////////////////////////////////////////////////////////////////////////////////
 // Platform-specific lock implementation.  Falls back to spinlocks if none is
 // defined.  Each platform should define the Lock type, and corresponding
@@ -77,7 +85,8 @@ inline static void lock(Lock *l) {
   }
 }
 /// locks for atomic operations
-static Lock locks[SPINLOCK_COUNT] = { [0 ...  SPINLOCK_COUNT-1] = {0,1,0} };
+static PADDED_LOCK(Lock) locks[SPINLOCK_COUNT] __attribute__((aligned(CACHE_LINE_SIZE))) =
+    { [0 ...  SPINLOCK_COUNT-1] = { .lock = {0,1,0} } };
 
 #elif defined(__APPLE__)
 #include <libkern/OSAtomic.h>
@@ -90,7 +99,8 @@ inline static void unlock(Lock *l) {
 inline static void lock(Lock *l) {  
   OSSpinLockLock(l);
 }
-static Lock locks[SPINLOCK_COUNT]; // initialized to OS_SPINLOCK_INIT which is 0
+// initialized to OS_SPINLOCK_INIT which is 0
+static PADDED_LOCK(Lock) locks[SPINLOCK_COUNT] __attribute__((aligned(CACHE_LINE_SIZE)));
 
 #else
 typedef _Atomic(uintptr_t) Lock;
@@ -107,7 +117,7 @@ inline static void lock(Lock *l) {
     old = 0;
 }
 /// locks for atomic operations
-static Lock locks[SPINLOCK_COUNT];
+static PADDED_LOCK(Lock) locks[SPINLOCK_COUNT] __attribute__((aligned(CACHE_LINE_SIZE)));
 #endif
 
 
@@ -125,8 +135,130 @@ static inline Lock *lock_for_pointer(void *ptr) {
   hash >>= 16;
   hash ^= low;
   // Return a pointer to the word to use
-  return locks + (hash & SPINLOCK_MASK);
+  return &locks[hash & SPINLOCK_MASK].lock;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 16-byte atomics.  The compiler only emits cmpxchg16b inline when targeting
+// CPUs which are known to have it, but almost all x86-64 CPUs do, so check at
+// run time.  The choice between the lock and the instruction only depends on
+// the CPU and the alignment of the object, so all the accesses to an object
+// agree on it.
+////////////////////////////////////////////////////////////////////////////////
+#if defined(__x86_64__) && defined(__SIZEOF_INT128__)
+#define HAVE_CMPXCHG16B 1
+
+/// 0 until checked, then 1 if the CPU has no cmpxchg16b and 2 if it has.
+static _Atomic(int) cmpxchg16b_state;
+
+static int cpu_has_cmpxchg16b(void) {
+  int state = __c11_atomic_load(&cmpxchg16b_state, __ATOMIC_RELAXED);
+  if (!state) {
+    uint32_t eax = 1, ebx, ecx, edx;
+    __asm__("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    state = (ecx & (1 << 13)) ? 2 : 1;
+    __c11_atomic_store(&cmpxchg16b_state, state, __ATOMIC_RELAXED);
+  }
+  return state == 2;
+}
+
+/// Returns whether the 16-byte operations on ptr use cmpxchg16b, which
+/// requires 16-byte alignment.
+static inline int use_cmpxchg16b(void *ptr) {
+  return ((uintptr_t)ptr & 15) == 0 && cpu_has_cmpxchg16b();
+}
+
+/// Compare and exchange with cmpxchg16b.  It is a full barrier, so it is
+/// valid for every memory model.
+static inline int cmpxchg16b(__uint128_t *ptr, __uint128_t *expected,
+                             __uint128_t desired) {
+  uint64_t lo = (uint64_t)*expected, hi = (uint64_t)(*expected >> 64);
+  char success;
+  __asm__ __volatile__("lock cmpxchg16b %1\n\tsete %0"
+                       : "=q"(success), "+m"(*ptr), "+a"(lo), "+d"(hi)
+                       : "b"((uint64_t)desired), "c"((uint64_t)(desired >> 64))
+                       : "memory", "cc");
+  if (!success)
+    *expected = ((__uint128_t)hi << 64) | lo;
+  return success;
+}
+
+__uint128_t __atomic_load_16(__uint128_t *src, int model) {
+  if (use_cmpxchg16b(src)) {
+    // Fails unless *src is 0, and either way returns the current value.
+    __uint128_t val = 0;
+    cmpxchg16b(src, &val, 0);
+    return val;
+  }
+  Lock *l = lock_for_pointer(src);
+  lock(l);
+  __uint128_t val = *src;
+  unlock(l);
+  return val;
+}
+
+__uint128_t __atomic_exchange_16(__uint128_t *dest, __uint128_t val,
+                                 int model) {
+  if (use_cmpxchg16b(dest)) {
+    // A torn read of the initial guess only costs an iteration.
+    __uint128_t old = *dest;
+    while (!cmpxchg16b(dest, &old, val))
+      ;
+    return old;
+  }
+  Lock *l = lock_for_pointer(dest);
+  lock(l);
+  __uint128_t tmp = *dest;
+  *dest = val;
+  unlock(l);
+  return tmp;
+}
+
+void __atomic_store_16(__uint128_t *dest, __uint128_t val, int model) {
+  __atomic_exchange_16(dest, val, model);
+}
+
+int __atomic_compare_exchange_16(__uint128_t *ptr, __uint128_t *expected,
+    __uint128_t desired, int success, int failure) {
+  if (use_cmpxchg16b(ptr))
+    return cmpxchg16b(ptr, expected, desired);
+  Lock *l = lock_for_pointer(ptr);
+  lock(l);
+  if (*ptr == *expected) {
+    *ptr = desired;
+    unlock(l);
+    return 1;
+  }
+  *expected = *ptr;
+  unlock(l);
+  return 0;
+}
+
+#define ATOMIC_RMW_16(opname, op) \
+__uint128_t __atomic_fetch_##opname##_16(__uint128_t *ptr, __uint128_t val,\
+                                         int model) {\
+  if (use_cmpxchg16b(ptr)) {\
+    __uint128_t old = *ptr;\
+    while (!cmpxchg16b(ptr, &old, old op val))\
+      ;\
+    return old;\
+  }\
+  Lock *l = lock_for_pointer(ptr);\
+  lock(l);\
+  __uint128_t tmp = *ptr;\
+  *ptr = tmp op val;\
+  unlock(l);\
+  return tmp;\
 }
+ATOMIC_RMW_16(add, +)
+ATOMIC_RMW_16(sub, -)
+ATOMIC_RMW_16(and, &)
+ATOMIC_RMW_16(or, |)
+ATOMIC_RMW_16(xor, ^)
+#undef ATOMIC_RMW_16
+#else
+#define HAVE_CMPXCHG16B 0
+#endif
 
 /// Macros for determining whether a size is lock free.  Clang can not yet
 /// codegen __atomic_is_lock_free(16), so for now we assume 16-byte values are
@@ -170,6 +302,12 @@ void __atomic_load_c(int size, void *src, void *dest, int model) {
     *((type*)dest) = __c11_atomic_load((_Atomic(type)*)src, model);\
     return;
   LOCK_FREE_CASES();
+#if HAVE_CMPXCHG16B
+  if (size == 16 && use_cmpxchg16b(src)) {
+    *(__uint128_t*)dest = __atomic_load_16(src, model);
+    return;
+  }
+#endif
 #undef LOCK_FREE_ACTION
   Lock *l = lock_for_pointer(src);
   lock(l);
@@ -185,6 +323,12 @@ void __atomic_store_c(int size, void *dest, void *src, int model) {
     return;
   LOCK_FREE_CASES();
 #undef LOCK_FREE_ACTION
+#if HAVE_CMPXCHG16B
+  if (size == 16 && use_cmpxchg16b(dest)) {
+    __atomic_store_16(dest, *(__uint128_t*)src, model);
+    return;
+  }
+#endif
   Lock *l = lock_for_pointer(dest);
   lock(l);
   memcpy(dest, src, size);
@@ -203,6 +347,12 @@ int __atomic_compare_exchange_c(int size, void *ptr, void *expected,
       *(type*)desired, success, failure)
   LOCK_FREE_CASES();
 #undef LOCK_FREE_ACTION
+#if HAVE_CMPXCHG16B
+  if (size == 16 && use_cmpxchg16b(ptr))
+    return __atomic_compare_exchange_16(ptr, expected,
+                                        *(__uint128_t*)desired, success,
+                                        failure);
+#endif
   Lock *l = lock_for_pointer(ptr);
   lock(l);
   if (memcmp(ptr, expected, size) == 0) {
@@ -224,6 +374,12 @@ void __atomic_exchange_c(int size, void *ptr, void *val, void *old, int model) {
     return;
   LOCK_FREE_CASES();
 #undef LOCK_FREE_ACTION
+#if HAVE_CMPXCHG16B
+  if (size == 16 && use_cmpxchg16b(ptr)) {
+    *(__uint128_t*)old = __atomic_exchange_16(ptr, *(__uint128_t*)val, model);
+    return;
+  }
+#endif
   Lock *l = lock_for_pointer(ptr);
   lock(l);
   memcpy(old, ptr, size);
@@ -240,7 +396,8 @@ void __atomic_exchange_c(int size, void *ptr, void *val, void *old, int model) {
   OPTIMISED_CASE(2, IS_LOCK_FREE_2, uint16_t)\
   OPTIMISED_CASE(4, IS_LOCK_FREE_4, uint32_t)\
   OPTIMISED_CASE(8, IS_LOCK_FREE_8, uint64_t)\
-  /* FIXME: __uint128_t isn't available on 32 bit platforms.
+  /* FIXME: __uint128_t isn't available on 32 bit platforms.  The 16-byte
+  versions for x86-64 are defined with cmpxchg16b above.
   OPTIMISED_CASE(16, IS_LOCK_FREE_16, __uint128_t)*/\
 
 #define OPTIMISED_CASE(n, lockfree, type)\
@@ -9,18 +9,122 @@
  */
 
 #include "int_lib.h"
+#include <stddef.h>
 
 #if __APPLE__
   #include <libkern/OSCacheControl.h>
 #endif
+#if defined(__linux__) && defined(__arm__)
+  #include <asm/unistd.h>
+  #ifndef __ARM_NR_cacheflush
+    #define __ARM_NR_cacheflush 0x0f0002
+  #endif
+#endif
+#if defined(__linux__) && defined(__mips__)
+  #include <sys/cachectl.h>
+#endif
 
 /*
- * The compiler generates calls to __clear_cache() when creating 
+ * The compiler generates calls to __clear_cache() when creating
  * trampoline functions on the stack for use with nested functions.
- * It is expected to invalidate the instruction cache for the 
+ * It is expected to invalidate the instruction cache for the
  * specified range.
+ *
+ * JITs which patch many small pieces of code at once can call
+ * __clear_cache_ranges() instead, which pays for the barriers once for all
+ * the ranges where the architecture allows it.
  */
 
+void __clear_cache_ranges(void* const* starts, void* const* ends, size_t count);
+
+#if __aarch64__
+/*
+ * Cleans the data cache lines to the point of unification and invalidates
+ * the instruction cache lines, using the line sizes from CTR_EL0.
+ */
+static void aarch64_clean_dcache(uintptr_t start, uintptr_t end,
+                                 uint64_t ctr)
+{
+    const uintptr_t dcache_line = (uintptr_t)4 << ((ctr >> 16) & 15);
+    uintptr_t addr;
+    for (addr = start & ~(dcache_line - 1); addr < end; addr += dcache_line)
+        __asm __volatile("dc cvau, %0" :: "r"(addr) : "memory");
+}
+
+static void aarch64_invalidate_icache(uintptr_t start, uintptr_t end,
+                                      uint64_t ctr)
+{
+    const uintptr_t icache_line = (uintptr_t)4 << (ctr & 15);
+    uintptr_t addr;
+    for (addr = start & ~(icache_line - 1); addr < end; addr += icache_line)
+        __asm __volatile("ic ivau, %0" :: "r"(addr) : "memory");
+}
+
+static uint64_t aarch64_cache_type(void)
+{
+    uint64_t ctr;
+    __asm __volatile("mrs %0, ctr_el0" : "=r"(ctr));
+    return ctr;
+}
+#endif
+
+#if defined(__linux__) && defined(__arm__)
+/* The kernel does the maintenance and the barriers for each range. */
+static void arm_cacheflush(void* start, void* end)
+{
+    register int start_reg __asm("r0") = (int)(intptr_t)start;
+    const register int end_reg __asm("r1") = (int)(intptr_t)end;
+    const register int flags __asm("r2") = 0;
+    const register int syscall_nr __asm("r7") = __ARM_NR_cacheflush;
+    __asm __volatile("svc #0x0"
+                     : "=r"(start_reg)
+                     : "r"(syscall_nr), "r"(start_reg), "r"(end_reg),
+                       "r"(flags)
+                     : "memory");
+    if (start_reg != 0)
+        compilerrt_abort();
+}
+#endif
+
+#if defined(__linux__) && defined(__mips__) && __mips_isa_rev >= 2
+/* synci writes back the data cache line and invalidates the instruction
+ * cache line of the address, the step is read from hardware register 1.
+ */
+static void mips_synci(uintptr_t start, uintptr_t end)
+{
+    uintptr_t step, addr;
+    __asm __volatile("rdhwr %0, $1" : "=r"(step));
+    /* A zero step means that the caches need no synchronization. */
+    if (!step)
+        return;
+    for (addr = start & ~(step - 1); addr < end; addr += step)
+        __asm __volatile("synci 0(%0)" :: "r"(addr) : "memory");
+}
+
+/* Waits for the synci operations, then clears the instruction hazards by
+ * returning to the next instruction with jr.hb.
+ */
+static void mips_synci_barrier(void)
+{
+#if _MIPS_SIM == _ABI64
+    #define PTR_ADDIU "daddiu"
+#else
+    #define PTR_ADDIU "addiu"
+#endif
+    __asm __volatile("sync\n\t"
+                     ".set push\n\t"
+                     ".set noreorder\n\t"
+                     "bal 1f\n\t"
+                     "nop\n"
+                     "1:\t" PTR_ADDIU " $31, $31, 12\n\t"
+                     "jr.hb $31\n\t"
+                     "nop\n\t"
+                     ".set pop"
+                     ::: "$31", "memory");
+#undef PTR_ADDIU
+}
+#endif
+
 void __clear_cache(void* start, void* end)
 {
 #if __i386__ || __x86_64__
@@ -28,6 +132,20 @@ void __clear_cache(void* start, void* end)
  * Intel processors have a unified instruction and data cache
  * so there is nothing to do
  */
+#elif __aarch64__
+    void* starts[1] = { start };
+    void* ends[1] = { end };
+    __clear_cache_ranges(starts, ends, 1);
+#elif defined(__linux__) && defined(__arm__)
+    arm_cacheflush(start, end);
+#elif defined(__linux__) && defined(__mips__)
+    #if __mips_isa_rev >= 2
+        mips_synci((uintptr_t)start, (uintptr_t)end);
+        mips_synci_barrier();
+    #else
+        if (cacheflush(start, (uintptr_t)end - (uintptr_t)start, BCACHE) != 0)
+            compilerrt_abort();
+    #endif
 #else
     #if __APPLE__
         /* On Darwin, sys_icache_invalidate() provides this functionality */
@@ -38,3 +156,33 @@ void __clear_cache(void* start, void* end)
 #endif
 }
 
+/*
+ * Invalidates the instruction cache for the count ranges [starts[i], ends[i]).
+ */
+void __clear_cache_ranges(void* const* starts, void* const* ends, size_t count)
+{
+#if __i386__ || __x86_64__
+    (void)starts;
+    (void)ends;
+    (void)count;
+#elif __aarch64__
+    const uint64_t ctr = aarch64_cache_type();
+    size_t i;
+    for (i = 0; i < count; ++i)
+        aarch64_clean_dcache((uintptr_t)starts[i], (uintptr_t)ends[i], ctr);
+    __asm __volatile("dsb ish" ::: "memory");
+    for (i = 0; i < count; ++i)
+        aarch64_invalidate_icache((uintptr_t)starts[i], (uintptr_t)ends[i],
+                                  ctr);
+    __asm __volatile("dsb ish\n\tisb" ::: "memory");
+#elif defined(__linux__) && defined(__mips__) && __mips_isa_rev >= 2
+    size_t i;
+    for (i = 0; i < count; ++i)
+        mips_synci((uintptr_t)starts[i], (uintptr_t)ends[i]);
+    mips_synci_barrier();
+#else
+    size_t i;
+    for (i = 0; i < count; ++i)
+        __clear_cache(starts[i], ends[i]);
+#endif
+}
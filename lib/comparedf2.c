@@ -40,6 +40,30 @@
 #define DOUBLE_PRECISION
 #include "fp_lib.h"
 
+// Maps the representation of a number to a signed integer with the same
+// order, with both zeros mapped to 0: the magnitude, negated for negative
+// numbers.  Together with the NaN mask below this avoids the data-dependent
+// branches, which the soft-float targets mispredict in sorting and min/max
+// loops.
+static inline srep_t orderKey(srep_t aInt) {
+    const srep_t negative = aInt >> (typeWidth - 1);
+    return ((aInt & absMask) ^ negative) - negative;
+}
+
+// -1, 0 or 1 as the numbers a and b compare, ignoring NaN.
+static inline int compareOrdered(fp_t a, fp_t b) {
+    const srep_t aKey = orderKey(toRep(a));
+    const srep_t bKey = orderKey(toRep(b));
+    return (aKey > bKey) - (aKey < bKey);
+}
+
+// 1 if either a or b is NaN, 0 otherwise.
+static inline int isUnordered(fp_t a, fp_t b) {
+    const rep_t aAbs = toRep(a) & absMask;
+    const rep_t bAbs = toRep(b) & absMask;
+    return (aAbs > infRep) | (bAbs > infRep);
+}
+
 enum LE_RESULT {
     LE_LESS      = -1,
     LE_EQUAL     =  0,
@@ -48,35 +72,10 @@ enum LE_RESULT {
 };
 
 enum LE_RESULT __ledf2(fp_t a, fp_t b) {
-    
-    const srep_t aInt = toRep(a);
-    const srep_t bInt = toRep(b);
-    const rep_t aAbs = aInt & absMask;
-    const rep_t bAbs = bInt & absMask;
-    
-    // If either a or b is NaN, they are unordered.
-    if (aAbs > infRep || bAbs > infRep) return LE_UNORDERED;
-    
-    // If a and b are both zeros, they are equal.
-    if ((aAbs | bAbs) == 0) return LE_EQUAL;
-    
-    // If at least one of a and b is positive, we get the same result comparing
-    // a and b as signed integers as we would with a floating-point compare.
-    if ((aInt & bInt) >= 0) {
-        if (aInt < bInt) return LE_LESS;
-        else if (aInt == bInt) return LE_EQUAL;
-        else return LE_GREATER;
-    }
-    
-    // Otherwise, both are negative, so we need to flip the sense of the
-    // comparison to get the correct result.  (This assumes a twos- or ones-
-    // complement integer representation; if integers are represented in a
-    // sign-magnitude representation, then this flip is incorrect).
-    else {
-        if (aInt > bInt) return LE_LESS;
-        else if (aInt == bInt) return LE_EQUAL;
-        else return LE_GREATER;
-    }
+    // Unordered is the same as greater.
+    const int unordered = isUnordered(a, b);
+    return (enum LE_RESULT)((compareOrdered(a, b) & (unordered - 1)) |
+                            unordered);
 }
 
 enum GE_RESULT {
@@ -87,31 +86,14 @@ enum GE_RESULT {
 };
 
 enum GE_RESULT __gedf2(fp_t a, fp_t b) {
-    
-    const srep_t aInt = toRep(a);
-    const srep_t bInt = toRep(b);
-    const rep_t aAbs = aInt & absMask;
-    const rep_t bAbs = bInt & absMask;
-    
-    if (aAbs > infRep || bAbs > infRep) return GE_UNORDERED;
-    if ((aAbs | bAbs) == 0) return GE_EQUAL;
-    if ((aInt & bInt) >= 0) {
-        if (aInt < bInt) return GE_LESS;
-        else if (aInt == bInt) return GE_EQUAL;
-        else return GE_GREATER;
-    } else {
-        if (aInt > bInt) return GE_LESS;
-        else if (aInt == bInt) return GE_EQUAL;
-        else return GE_GREATER;
-    }
+    // Unordered is the same as less, i.e. all bits set.
+    return (enum GE_RESULT)(compareOrdered(a, b) | -isUnordered(a, b));
 }
 
 ARM_EABI_FNALIAS(dcmpun, unorddf2)
 
 int __unorddf2(fp_t a, fp_t b) {
-    const rep_t aAbs = toRep(a) & absMask;
-    const rep_t bAbs = toRep(b) & absMask;
-    return aAbs > infRep || bAbs > infRep;
+    return isUnordered(a, b);
 }
 
 // The following are alternative names for the preceeding routines.
@@ -0,0 +1,139 @@
+/* ===-- cpu_model.c - Detect the CPU features for the builtins -----------===
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is dual licensed under the MIT and the University of Illinois Open
+ * Source Licenses. See LICENSE.TXT for details.
+ *
+ * ===----------------------------------------------------------------------===
+ *
+ * This file sets __compilerrt_cpu_features, see int_cpu_model.h.
+ *
+ * ===----------------------------------------------------------------------===
+ */
+
+#include "int_cpu_model.h"
+
+#if __i386__ || __x86_64__
+#include <cpuid.h>
+#elif __arm__ && defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+__attribute__((visibility("hidden")))
+unsigned __compilerrt_cpu_features = 0;
+
+#if __i386__ || __x86_64__
+
+#define CPUID1_ECX_SSE4_2   (1u << 20)
+#define CPUID1_ECX_POPCNT   (1u << 23)
+#define CPUID1_ECX_OSXSAVE  (1u << 27)
+#define CPUID1_ECX_AVX      (1u << 28)
+#define CPUID1_ECX_F16C     (1u << 29)
+#define CPUID7_EBX_AVX2     (1u << 5)
+#define CPUID7_EBX_BMI2     (1u << 8)
+#define CPUID81_ECX_LZCNT   (1u << 5)
+
+/* The SSE and AVX state saved by the OS, which AVX needs. */
+#define XCR0_SSE_AVX        6u
+
+static unsigned detect_features(void)
+{
+    unsigned eax, ebx, ecx, edx;
+    unsigned features = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return 0;
+    if (ecx & CPUID1_ECX_SSE4_2)
+        features |= COMPILERRT_CPU_X86_SSE4_2;
+    if (ecx & CPUID1_ECX_POPCNT)
+        features |= COMPILERRT_CPU_X86_POPCNT;
+    bool avx = false;
+    if ((ecx & CPUID1_ECX_OSXSAVE) && (ecx & CPUID1_ECX_AVX)) {
+        unsigned xcr0, xcr0_hi;
+        __asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0_hi) : "c"(0));
+        avx = (xcr0 & XCR0_SSE_AVX) == XCR0_SSE_AVX;
+    }
+    if (avx) {
+        features |= COMPILERRT_CPU_X86_AVX;
+        if (ecx & CPUID1_ECX_F16C)
+            features |= COMPILERRT_CPU_X86_F16C;
+    }
+    unsigned max_leaf = __get_cpuid_max(0, 0);
+    if (max_leaf >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        if (avx && (ebx & CPUID7_EBX_AVX2))
+            features |= COMPILERRT_CPU_X86_AVX2;
+        if (ebx & CPUID7_EBX_BMI2)
+            features |= COMPILERRT_CPU_X86_BMI2;
+    }
+    if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) &&
+        (ecx & CPUID81_ECX_LZCNT))
+        features |= COMPILERRT_CPU_X86_LZCNT;
+    return features;
+}
+
+#elif __arm__ && defined(__linux__)
+
+#define AT_NULL 0
+#define AT_HWCAP 16
+#define HWCAP_NEON (1 << 12)
+#define HWCAP_VFPV4 (1 << 16)
+#define HWCAP_IDIVA (1 << 17)
+
+/* getauxval() is missing from older C libraries (Android before 4.3), so
+ * read the auxiliary vector from /proc.
+ */
+static unsigned detect_features(void)
+{
+    unsigned features = 0;
+    unsigned long entry[2];
+    int fd = open("/proc/self/auxv", O_RDONLY);
+    if (fd < 0)
+        return 0;
+    while (read(fd, entry, sizeof(entry)) == sizeof(entry) &&
+           entry[0] != AT_NULL)
+    {
+        if (entry[0] == AT_HWCAP)
+        {
+            if (entry[1] & HWCAP_NEON)
+                features |= COMPILERRT_CPU_ARM_NEON;
+            if (entry[1] & HWCAP_VFPV4)
+                features |= COMPILERRT_CPU_ARM_VFPV4;
+            if (entry[1] & HWCAP_IDIVA)
+                features |= COMPILERRT_CPU_ARM_IDIVA;
+            break;
+        }
+    }
+    close(fd);
+    return features;
+}
+
+#else
+
+static unsigned detect_features(void)
+{
+    return 0;
+}
+
+#endif
+
+/* Racing callers compute the same value, so no lock is needed. */
+unsigned __compilerrt_cpu_init(void)
+{
+    unsigned features = __compilerrt_cpu_features;
+    if (!features) {
+        features = detect_features() | COMPILERRT_CPU_INITIALIZED;
+        __compilerrt_cpu_features = features;
+    }
+    return features;
+}
+
+/* Detect early, so that the function pointer dispatch of the first calls
+ * does not have to.
+ */
+__attribute__((constructor))
+static void cpu_model_init(void)
+{
+    __compilerrt_cpu_init();
+}
@@ -15,11 +15,39 @@
 #include "int_lib.h"
 #include "int_math.h"
 
+/* Returns: true if x is zero or 2^-500 < |x| < 2^500, so that sums and products
+ * of two such values can neither overflow nor lose bits to underflow.
+ */
+
+static inline bool
+well_scaled(double x)
+{
+    return (crt_fabs(x) < 0x1p500 && crt_fabs(x) > 0x1p-500) || x == 0;
+}
+
 /* Returns: the quotient of (a + ib) / (c + id) */
 
 double _Complex
 __divdc3(double __a, double __b, double __c, double __d)
 {
+    /* Without the scaling by the power of two the arithmetic is the same,
+     * as is the rounding unless the quotient is denormal, so well scaled
+     * operands skip the logb and scalbn calls.
+     */
+    if (well_scaled(__a) && well_scaled(__b) && well_scaled(__c) &&
+        well_scaled(__d))
+    {
+        double __denom = __c * __c + __d * __d;
+        double __x = __a * __c + __b * __d;
+        double __y = __b * __c - __a * __d;
+        double _Complex z;
+        __real__ z = __x / __denom;
+        __imag__ z = __y / __denom;
+        if (__denom != 0 &&
+            (crt_fabs(__real__ z) >= DBL_MIN || __x == 0) &&
+            (crt_fabs(__imag__ z) >= DBL_MIN || __y == 0))
+            return z;
+    }
     int __ilogbw = 0;
     double __logbw = crt_logb(crt_fmax(crt_fabs(__c), crt_fabs(__d)));
     if (crt_isfinite(__logbw))
@@ -18,6 +18,7 @@
 
 #define DOUBLE_PRECISION
 #include "fp_lib.h"
+#include "fp_div_table.h"
 
 ARM_EABI_FNALIAS(ddiv, divdf3)
 
@@ -76,31 +77,26 @@ fp_t __divdf3(fp_t a, fp_t b) {
     int quotientExponent = aExponent - bExponent + scale;
     
     // Align the significand of b as a Q31 fixed-point number in the range
-    // [1, 2.0) and get a Q32 approximate reciprocal using a small minimax
-    // polynomial approximation: reciprocal = 3/4 + 1/sqrt(2) - b/2.  This
-    // is accurate to about 3.5 binary digits.
+    // [1, 2.0) and look up a Q32 approximate reciprocal, accurate to about 9
+    // binary digits.
     const uint32_t q31b = bSignificand >> 21;
-    uint32_t recip32 = UINT32_C(0x7504f333) - q31b;
+    uint32_t recip32 = reciprocalSeed(q31b);
     
     // Now refine the reciprocal estimate using a Newton-Raphson iteration:
     //
     //     x1 = x0 * (2 - x0 * b)
     //
     // This doubles the number of correct binary digits in the approximation
-    // with each iteration, so after three iterations, we have about 28 binary
+    // with each iteration, so after two iterations, we have about 30 binary
     // digits of accuracy.
     uint32_t correction32;
     correction32 = -((uint64_t)recip32 * q31b >> 32);
     recip32 = (uint64_t)recip32 * correction32 >> 31;
     correction32 = -((uint64_t)recip32 * q31b >> 32);
     recip32 = (uint64_t)recip32 * correction32 >> 31;
-    correction32 = -((uint64_t)recip32 * q31b >> 32);
-    recip32 = (uint64_t)recip32 * correction32 >> 31;
     
-    // recip32 might have overflowed to exactly zero in the preceeding
-    // computation if the high word of b is exactly 1.0.  This would sabotage
-    // the full-width final stage of the computation that follows, so we adjust
-    // recip32 downward by one bit.
+    // Adjust recip32 downward by one bit, so that the full-width final stage
+    // of the computation that follows starts from below the reciprocal.
     recip32--;
     
     // We need to perform one more iteration to get us to 56 binary digits;
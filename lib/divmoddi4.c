@@ -14,14 +14,22 @@
 
 #include "int_lib.h"
 
-extern COMPILER_RT_ABI di_int __divdi3(di_int a, di_int b);
+du_int COMPILER_RT_ABI __udivmoddi4(du_int a, du_int b, du_int* rem);
 
 /* Returns: a / b, *rem = a % b  */
 
 COMPILER_RT_ABI di_int
 __divmoddi4(di_int a, di_int b, di_int* rem)
 {
-  di_int d = __divdi3(a,b);
-  *rem = a - (d*b);
-  return d;
+    const int bits_in_dword_m1 = (int)(sizeof(di_int) * CHAR_BIT) - 1;
+    di_int s_a = a >> bits_in_dword_m1;           /* s_a = a < 0 ? -1 : 0 */
+    di_int s_b = b >> bits_in_dword_m1;           /* s_b = b < 0 ? -1 : 0 */
+    a = (a ^ s_a) - s_a;                         /* negate if s_a == -1 */
+    b = (b ^ s_b) - s_b;                         /* negate if s_b == -1 */
+    du_int r;
+    /* The remainder comes with the quotient, so there is no multiply. */
+    di_int q = __udivmoddi4(a, b, &r);
+    *rem = (r ^ s_a) - s_a;                      /* sign of the dividend */
+    s_a ^= s_b;                                  /* sign of quotient */
+    return (q ^ s_a) - s_a;                      /* negate if s_a == -1 */
 }
@@ -15,11 +15,39 @@
 #include "int_lib.h"
 #include "int_math.h"
 
+/* Returns: true if x is zero or 2^-60 < |x| < 2^60, so that sums and products
+ * of two such values can neither overflow nor lose bits to underflow.
+ */
+
+static inline bool
+well_scaled(float x)
+{
+    return (crt_fabsf(x) < 0x1p60f && crt_fabsf(x) > 0x1p-60f) || x == 0;
+}
+
 /* Returns: the quotient of (a + ib) / (c + id) */
 
 float _Complex
 __divsc3(float __a, float __b, float __c, float __d)
 {
+    /* Without the scaling by the power of two the arithmetic is the same,
+     * as is the rounding unless the quotient is denormal, so well scaled
+     * operands skip the logb and scalbn calls.
+     */
+    if (well_scaled(__a) && well_scaled(__b) && well_scaled(__c) &&
+        well_scaled(__d))
+    {
+        float __denom = __c * __c + __d * __d;
+        float __x = __a * __c + __b * __d;
+        float __y = __b * __c - __a * __d;
+        float _Complex z;
+        __real__ z = __x / __denom;
+        __imag__ z = __y / __denom;
+        if (__denom != 0 &&
+            (crt_fabsf(__real__ z) >= FLT_MIN || __x == 0) &&
+            (crt_fabsf(__imag__ z) >= FLT_MIN || __y == 0))
+            return z;
+    }
     int __ilogbw = 0;
     float __logbw = crt_logbf(crt_fmaxf(crt_fabsf(__c), crt_fabsf(__d)));
     if (crt_isfinite(__logbw))
@@ -18,6 +18,7 @@
 
 #define SINGLE_PRECISION
 #include "fp_lib.h"
+#include "fp_div_table.h"
 
 ARM_EABI_FNALIAS(fdiv, divsf3)
 
@@ -76,33 +77,28 @@ fp_t __divsf3(fp_t a, fp_t b) {
     int quotientExponent = aExponent - bExponent + scale;
     
     // Align the significand of b as a Q31 fixed-point number in the range
-    // [1, 2.0) and get a Q32 approximate reciprocal using a small minimax
-    // polynomial approximation: reciprocal = 3/4 + 1/sqrt(2) - b/2.  This
-    // is accurate to about 3.5 binary digits.
+    // [1, 2.0) and look up a Q32 approximate reciprocal, accurate to about 9
+    // binary digits.
     uint32_t q31b = bSignificand << 8;
-    uint32_t reciprocal = UINT32_C(0x7504f333) - q31b;
+    uint32_t reciprocal = reciprocalSeed(q31b);
     
     // Now refine the reciprocal estimate using a Newton-Raphson iteration:
     //
     //     x1 = x0 * (2 - x0 * b)
     //
     // This doubles the number of correct binary digits in the approximation
-    // with each iteration, so after three iterations, we have about 28 binary
+    // with each iteration, so after two iterations, we have about 30 binary
     // digits of accuracy.
     uint32_t correction;
     correction = -((uint64_t)reciprocal * q31b >> 32);
     reciprocal = (uint64_t)reciprocal * correction >> 31;
     correction = -((uint64_t)reciprocal * q31b >> 32);
     reciprocal = (uint64_t)reciprocal * correction >> 31;
-    correction = -((uint64_t)reciprocal * q31b >> 32);
-    reciprocal = (uint64_t)reciprocal * correction >> 31;
     
-    // Exhaustive testing shows that the error in reciprocal after three steps
-    // is in the interval [-0x1.f58108p-31, 0x1.d0e48cp-29], in line with our
-    // expectations.  We bump the reciprocal by a tiny value to force the error
-    // to be strictly positive (in the range [0x1.4fdfp-37,0x1.287246p-29], to
-    // be specific).  This also causes 1/1 to give a sensible approximation
-    // instead of zero (due to overflow).
+    // Exhaustive testing shows that the error in reciprocal after two steps
+    // is in the interval [-0x1.fe8f7p-32, 0x1.0abcbp-32].  We bump the
+    // reciprocal by a tiny value to force the error to be strictly positive
+    // (in the range [0x1.709p-40, 0x1.855e58p-31], to be specific).
     reciprocal -= 2;
     
     // The numerical reciprocal is accurate to within 2^-28, lies in the
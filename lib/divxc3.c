@@ -16,11 +16,39 @@
 #include "int_lib.h"
 #include "int_math.h"
 
+/* Returns: true if x is zero or 2^-500 < |x| < 2^500, so that sums and products
+ * of two such values can neither overflow nor lose bits to underflow.
+ */
+
+static inline bool
+well_scaled(long double x)
+{
+    return (crt_fabsl(x) < 0x1p500L && crt_fabsl(x) > 0x1p-500L) || x == 0;
+}
+
 /* Returns: the quotient of (a + ib) / (c + id) */
 
 long double _Complex
 __divxc3(long double __a, long double __b, long double __c, long double __d)
 {
+    /* Without the scaling by the power of two the arithmetic is the same,
+     * as is the rounding unless the quotient is denormal, so well scaled
+     * operands skip the logb and scalbn calls.
+     */
+    if (well_scaled(__a) && well_scaled(__b) && well_scaled(__c) &&
+        well_scaled(__d))
+    {
+        long double __denom = __c * __c + __d * __d;
+        long double __x = __a * __c + __b * __d;
+        long double __y = __b * __c - __a * __d;
+        long double _Complex z;
+        __real__ z = __x / __denom;
+        __imag__ z = __y / __denom;
+        if (__denom != 0 &&
+            (crt_fabsl(__real__ z) >= LDBL_MIN || __x == 0) &&
+            (crt_fabsl(__imag__ z) >= LDBL_MIN || __y == 0))
+            return z;
+    }
     int __ilogbw = 0;
     long double __logbw = crt_logbl(crt_fmaxl(crt_fabsl(__c), crt_fabsl(__d)));
     if (crt_isfinite(__logbw))
@@ -0,0 +1,172 @@
+//===-- lib/extendhfsf2.c - half -> single conversion -------------*- C -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the half to single precision conversion, with the
+// algorithm of extendsfdf2.c.  Half precision values are passed as their
+// uint16_t representation.  The F16C and ARM half-precision conversion
+// instructions are used when the target is known to have them.
+//
+//===----------------------------------------------------------------------===//
+
+#include "int_lib.h"
+#include <stddef.h>
+
+#if __F16C__
+#include <immintrin.h>
+#define HAVE_HW_F16 1
+#elif defined(__ARM_FP16_FORMAT_IEEE) && defined(__ARM_FP) && (__ARM_FP & 2)
+#define HAVE_HW_F16 1
+#else
+#define HAVE_HW_F16 0
+#endif
+
+#if HAVE_HW_F16 && defined(__ARM_NEON__) && defined(__ARM_NEON_FP) && \
+    (__ARM_NEON_FP & 2)
+#include <arm_neon.h>
+#define HAVE_NEON_F16 1
+#else
+#define HAVE_NEON_F16 0
+#endif
+
+typedef uint16_t src_t;
+typedef uint16_t src_rep_t;
+#define SRC_REP_C UINT16_C
+// Only differences of the counts are used, so the promotion doesn't matter.
+#define src_rep_t_clz __builtin_clz
+
+typedef float dst_t;
+typedef uint32_t dst_rep_t;
+#define DST_REP_C UINT32_C
+
+#if !HAVE_HW_F16
+static const int srcSigBits = 10;
+static const int dstSigBits = 23;
+
+static inline src_rep_t srcToRep(src_t x) {
+    return x;
+}
+
+static inline dst_t dstFromRep(dst_rep_t x) {
+    const union { dst_t f; dst_rep_t i; } rep = {.i = x};
+    return rep.f;
+}
+
+static inline dst_t extendhfsf2(src_t a) {
+    
+    // Various constants whose values follow from the type parameters.
+    // Any reasonable optimizer will fold and propagate all of these.
+    const int srcBits = sizeof(src_t)*CHAR_BIT;
+    const int srcExpBits = srcBits - srcSigBits - 1;
+    const int srcInfExp = (1 << srcExpBits) - 1;
+    const int srcExpBias = srcInfExp >> 1;
+    
+    const src_rep_t srcMinNormal = SRC_REP_C(1) << srcSigBits;
+    const src_rep_t srcInfinity = (src_rep_t)srcInfExp << srcSigBits;
+    const src_rep_t srcSignMask = SRC_REP_C(1) << (srcSigBits + srcExpBits);
+    const src_rep_t srcAbsMask = srcSignMask - 1;
+    const src_rep_t srcQNaN = SRC_REP_C(1) << (srcSigBits - 1);
+    const src_rep_t srcNaNCode = srcQNaN - 1;
+    
+    const int dstBits = sizeof(dst_t)*CHAR_BIT;
+    const int dstExpBits = dstBits - dstSigBits - 1;
+    const int dstInfExp = (1 << dstExpBits) - 1;
+    const int dstExpBias = dstInfExp >> 1;
+    
+    const dst_rep_t dstMinNormal = DST_REP_C(1) << dstSigBits;
+    
+    // Break a into a sign and representation of the absolute value
+    const src_rep_t aRep = srcToRep(a);
+    const src_rep_t aAbs = aRep & srcAbsMask;
+    const src_rep_t sign = aRep & srcSignMask;
+    dst_rep_t absResult;
+    
+    // The casts keep the 16-bit representation from being promoted to int.
+    if ((src_rep_t)(aAbs - srcMinNormal) <
+        (src_rep_t)(srcInfinity - srcMinNormal)) {
+        // a is a normal number.
+        // Extend to the destination type by shifting the significand and
+        // exponent into the proper position and rebiasing the exponent.
+        absResult = (dst_rep_t)aAbs << (dstSigBits - srcSigBits);
+        absResult += (dst_rep_t)(dstExpBias - srcExpBias) << dstSigBits;
+    }
+    
+    else if (aAbs >= srcInfinity) {
+        // a is NaN or infinity.
+        // Conjure the result by beginning with infinity, then inserting the
+        // trailing NaN payload field and quieting a signaling NaN.  The
+        // payload is left-aligned, as the hardware conversions do, so that it
+        // survives the round trip through half.
+        absResult = (dst_rep_t)dstInfExp << dstSigBits;
+        absResult |= (dst_rep_t)(aAbs & (srcQNaN | srcNaNCode))
+                         << (dstSigBits - srcSigBits);
+        if (aAbs != srcInfinity)
+            absResult |= (dst_rep_t)srcQNaN << (dstSigBits - srcSigBits);
+    }
+    
+    else if (aAbs) {
+        // a is denormal.
+        // renormalize the significand and clear the leading bit, then insert
+        // the correct adjusted exponent in the destination type.
+        const int scale = src_rep_t_clz(aAbs) - src_rep_t_clz(srcMinNormal);
+        absResult = (dst_rep_t)aAbs << (dstSigBits - srcSigBits + scale);
+        absResult ^= dstMinNormal;
+        const int resultExponent = dstExpBias - srcExpBias - scale + 1;
+        absResult |= (dst_rep_t)resultExponent << dstSigBits;
+    }
+
+    else {
+        // a is zero.
+        absResult = 0;
+    }
+    
+    // Apply the signbit to (dst_t)abs(a).
+    const dst_rep_t result = absResult | (dst_rep_t)sign << (dstBits - srcBits);
+    return dstFromRep(result);
+}
+#endif
+
+static inline dst_t extendhfsf2_inline(src_t a) {
+#if __F16C__
+    return _cvtsh_ss(a);
+#elif HAVE_HW_F16
+    const union { src_rep_t i; __fp16 h; } rep = {.i = a};
+    return rep.h;
+#else
+    return extendhfsf2(a);
+#endif
+}
+
+ARM_EABI_FNALIAS(h2f, extendhfsf2)
+
+COMPILER_RT_ABI dst_t
+__extendhfsf2(src_t a) {
+    return extendhfsf2_inline(a);
+}
+
+COMPILER_RT_ABI dst_t
+__gnu_h2f_ieee(src_t a) {
+    return extendhfsf2_inline(a);
+}
+
+// Converts count values from src to dst.
+void __extendhfsf2_array(dst_t *dst, const src_t *src, size_t count) {
+    size_t i = 0;
+#if __F16C__
+    for (; i + 4 <= count; i += 4) {
+        const __m128i h = _mm_loadl_epi64((const __m128i *)(src + i));
+        _mm_storeu_ps(dst + i, _mm_cvtph_ps(h));
+    }
+#elif HAVE_NEON_F16
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(dst + i,
+                  vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src + i))));
+#endif
+    for (; i < count; ++i)
+        dst[i] = extendhfsf2_inline(src[i]);
+}
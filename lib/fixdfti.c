@@ -31,8 +31,9 @@ __fixdfti(double a)
     double_bits fb;
     fb.f = a;
     int e = ((fb.u.s.high & 0x7FF00000) >> 20) - 1023;
-    if (e < 0)
-        return 0;
+    /* |a| < 2^63 takes a single hardware conversion. */
+    if (e < 63)
+        return (di_int)a;
     ti_int s = (si_int)(fb.u.s.high & 0x80000000) >> 31;
     ti_int r = 0x0010000000000000uLL | (0x000FFFFFFFFFFFFFuLL & fb.u.all);
     if (e > 52)
@@ -0,0 +1,41 @@
+//===-- lib/fixtfdi.c - Quad-precision -> di_int conversion -------*- C -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements quad-precision to integer conversion for the
+// compiler-rt library.  No range checking is performed; the behavior of this
+// conversion is undefined for out of range values in the C standard.
+//
+//===----------------------------------------------------------------------===//
+
+#define QUAD_PRECISION
+#include "fp_lib.h"
+
+#if defined(CRT_HAS_TF_MODE)
+
+COMPILER_RT_ABI di_int
+__fixtfdi(fp_t a) {
+    
+    // Break a into sign, exponent, significand
+    const rep_t aRep = toRep(a);
+    const rep_t aAbs = aRep & absMask;
+    const int exponent = (int)(aAbs >> significandBits) - exponentBias;
+    const rep_t significand = (aAbs & significandMask) | implicitBit;
+    
+    // If exponent is negative, the result is zero.
+    if (exponent < 0)
+        return 0;
+    
+    // Otherwise right shift to get the result.  The exponent of an in range
+    // value is smaller than significandBits, so no left shift is needed.  The
+    // negation is done unsigned to get the minimum value right.
+    const du_int result = significand >> (significandBits - exponent);
+    return aRep & signBit ? -result : result;
+}
+
+#endif
@@ -0,0 +1,39 @@
+//===-- lib/fixunstfsi.c - Quad-precision -> uint conversion ------*- C -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements quad-precision to unsigned integer conversion for the
+// compiler-rt library.  No range checking is performed; the behavior of this
+// conversion is undefined for out of range values in the C standard.
+//
+//===----------------------------------------------------------------------===//
+
+#define QUAD_PRECISION
+#include "fp_lib.h"
+
+#if defined(CRT_HAS_TF_MODE)
+
+COMPILER_RT_ABI su_int
+__fixunstfsi(fp_t a) {
+    
+    // Break a into sign, exponent, significand
+    const rep_t aRep = toRep(a);
+    const int exponent = (int)(aRep >> significandBits & maxExponent) -
+                         exponentBias;
+    const rep_t significand = (aRep & significandMask) | implicitBit;
+    
+    // If a is negative or smaller than one, the result is zero.
+    if (aRep & signBit || exponent < 0)
+        return 0;
+    
+    // Otherwise right shift to get the result.  The exponent of an in range
+    // value is smaller than significandBits, so no left shift is needed.
+    return significand >> (significandBits - exponent);
+}
+
+#endif
@@ -13,70 +13,84 @@
  */
 
 #include "int_lib.h"
+#include <stddef.h>
+#if __AVX512DQ__ && __AVX512VL__
+#include <immintrin.h>
+#endif
 
 #if __x86_64
 
-/* Returns: convert a to a double, rounding toward even. */
+/* Returns: convert a to a double, rounding toward even.*/
 
-/* Assumption: double is a IEEE 64 bit floating point type 
- *             tu_int is a 128 bit integral type
+/* Assumption: double is a IEEE 64 bit floating point type
+ *            tu_int is a 128 bit integral type
  */
 
 /* seee eeee eeee mmmm mmmm mmmm mmmm mmmm | mmmm mmmm mmmm mmmm mmmm mmmm mmmm mmmm */
 
-si_int __clzti2(ti_int a);
+/* Returns: convert a >= 2^63 to a double, rounding toward even.
+ *
+ * The top 63 significant bits of a, with the rest folded into a sticky bit,
+ * round to the same double as a itself, so a single signed 64-bit hardware
+ * conversion and an exact scaling by a power of two give the result.
+ */
+
+static inline double
+double_from_wide(tu_int a)
+{
+    const du_int hi = (du_int)(a >> 64);
+    const int sd = hi ? 128 - __builtin_clzll(hi) : 64; /* significant digits */
+    const int shift = sd - 63;
+    const du_int m = (du_int)(a >> shift) |
+                     ((a & (((tu_int)1 << shift) - 1)) != 0);
+    double_bits scale;
+    scale.u.all = (du_int)(1023 + shift) << 52;
+    return (double)(di_int)m * scale.f;
+}
 
 double
 __floatuntidf(tu_int a)
 {
-    if (a == 0)
-        return 0.0;
-    const unsigned N = sizeof(tu_int) * CHAR_BIT;
-    int sd = N - __clzti2(a);  /* number of significant digits */
-    int e = sd - 1;             /* exponent */
-    if (sd > DBL_MANT_DIG)
+    /* Values which fit in 63 bits take a single hardware conversion. */
+    if (a <= (tu_int)INT64_MAX)
+        return (double)(di_int)a;
+    return double_from_wide(a);
+}
+
+/* Converts count values from src to dst.  Groups of four values which all
+ * fit in 64 bits, the common case for accumulators, use one AVX-512 vector
+ * conversion.
+ */
+
+void
+__floatuntidf_array(double* dst, const tu_int* src, size_t count)
+{
+    size_t i = 0;
+#if __AVX512DQ__ && __AVX512VL__
+    for (; i + 4 <= count; i += 4)
     {
-        /*  start:  0000000000000000000001xxxxxxxxxxxxxxxxxxxxxxPQxxxxxxxxxxxxxxxxxx
-         *  finish: 000000000000000000000000000000000000001xxxxxxxxxxxxxxxxxxxxxxPQR
-         *                                                12345678901234567890123456
-         *  1 = msb 1 bit
-         *  P = bit DBL_MANT_DIG-1 bits to the right of 1
-         *  Q = bit DBL_MANT_DIG bits to the right of 1
-         *  R = "or" of all bits to the right of Q
-	 */
-        switch (sd)
+        const __m256i a01 = _mm256_loadu_si256((const __m256i*)(src + i));
+        const __m256i a23 = _mm256_loadu_si256((const __m256i*)(src + i + 2));
+        /* lo0 lo2 lo1 lo3 and hi0 hi2 hi1 hi3 */
+        const __m256i lo = _mm256_unpacklo_epi64(a01, a23);
+        const __m256i hi = _mm256_unpackhi_epi64(a01, a23);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi64(hi,
+                _mm256_setzero_si256())) == -1)
         {
-        case DBL_MANT_DIG + 1:
-            a <<= 1;
-            break;
-        case DBL_MANT_DIG + 2:
-            break;
-        default:
-            a = (a >> (sd - (DBL_MANT_DIG+2))) |
-                ((a & ((tu_int)(-1) >> ((N + DBL_MANT_DIG+2) - sd))) != 0);
-        };
-        /* finish: */
-        a |= (a & 4) != 0;  /* Or P into R */
-        ++a;  /* round - this step may add a significant bit */
-        a >>= 2;  /* dump Q and R */
-        /* a is now rounded to DBL_MANT_DIG or DBL_MANT_DIG+1 bits */
-        if (a & ((tu_int)1 << DBL_MANT_DIG))
+            const __m256d r = _mm256_cvtepu64_pd(
+                _mm256_permute4x64_epi64(lo, _MM_SHUFFLE(3, 1, 2, 0)));
+            _mm256_storeu_pd(dst + i, r);
+        }
+        else
         {
-            a >>= 1;
-            ++e;
+            size_t j;
+            for (j = i; j < i + 4; ++j)
+                dst[j] = __floatuntidf(src[j]);
         }
-        /* a is now rounded to DBL_MANT_DIG bits */
     }
-    else
-    {
-        a <<= (DBL_MANT_DIG - sd);
-        /* a is now rounded to DBL_MANT_DIG bits */
-    }
-    double_bits fb;
-    fb.u.s.high = ((e + 1023) << 20)      |        /* exponent */
-                ((su_int)(a >> 32) & 0x000FFFFF); /* mantissa-high */
-    fb.u.s.low = (su_int)a;                         /* mantissa-low */
-    return fb.f;
+#endif
+    for (; i < count; ++i)
+        dst[i] = __floatuntidf(src[i]);
 }
 
 #endif
@@ -16,66 +16,41 @@
 
 #if __x86_64
 
-/* Returns: convert a to a float, rounding toward even. */
+/* Returns: convert a to a float, rounding toward even.*/
 
-/* Assumption: float is a IEEE 32 bit floating point type 
- *             tu_int is a 128 bit integral type
+/* Assumption: float is a IEEE 32 bit floating point type
+ *            tu_int is a 128 bit integral type
  */
 
 /* seee eeee emmm mmmm mmmm mmmm mmmm mmmm */
 
-si_int __clzti2(ti_int a);
+/* Returns: convert a >= 2^63 to a float, rounding toward even.
+ *
+ * The top 63 significant bits of a, with the rest folded into a sticky bit,
+ * round to the same float as a itself, so a single signed 64-bit hardware
+ * conversion and an exact scaling by a power of two give the result.
+ */
+
+static inline float
+float_from_wide(tu_int a)
+{
+    const du_int hi = (du_int)(a >> 64);
+    const int sd = hi ? 128 - __builtin_clzll(hi) : 64; /* significant digits */
+    const int shift = sd - 63;
+    const du_int m = (du_int)(a >> shift) |
+                     ((a & (((tu_int)1 << shift) - 1)) != 0);
+    float_bits scale;
+    scale.u = (su_int)(127 + shift) << 23;
+    return (float)(di_int)m * scale.f;
+}
 
 float
 __floatuntisf(tu_int a)
 {
-    if (a == 0)
-        return 0.0F;
-    const unsigned N = sizeof(tu_int) * CHAR_BIT;
-    int sd = N - __clzti2(a);  /* number of significant digits */
-    int e = sd - 1;             /* exponent */
-    if (sd > FLT_MANT_DIG)
-    {
-        /*  start:  0000000000000000000001xxxxxxxxxxxxxxxxxxxxxxPQxxxxxxxxxxxxxxxxxx
-         *  finish: 000000000000000000000000000000000000001xxxxxxxxxxxxxxxxxxxxxxPQR
-         *                                                12345678901234567890123456
-         *  1 = msb 1 bit
-         *  P = bit FLT_MANT_DIG-1 bits to the right of 1
-         *  Q = bit FLT_MANT_DIG bits to the right of 1
-         *  R = "or" of all bits to the right of Q
-	 */
-        switch (sd)
-        {
-        case FLT_MANT_DIG + 1:
-            a <<= 1;
-            break;
-        case FLT_MANT_DIG + 2:
-            break;
-        default:
-            a = (a >> (sd - (FLT_MANT_DIG+2))) |
-                ((a & ((tu_int)(-1) >> ((N + FLT_MANT_DIG+2) - sd))) != 0);
-        };
-        /* finish: */
-        a |= (a & 4) != 0;  /* Or P into R */
-        ++a;  /* round - this step may add a significant bit */
-        a >>= 2;  /* dump Q and R */
-        /* a is now rounded to FLT_MANT_DIG or FLT_MANT_DIG+1 bits */
-        if (a & ((tu_int)1 << FLT_MANT_DIG))
-        {
-            a >>= 1;
-            ++e;
-        }
-        /* a is now rounded to FLT_MANT_DIG bits */
-    }
-    else
-    {
-        a <<= (FLT_MANT_DIG - sd);
-        /* a is now rounded to FLT_MANT_DIG bits */
-    }
-    float_bits fb;
-    fb.u = ((e + 127) << 23)       |  /* exponent */
-           ((su_int)a & 0x007FFFFF);  /* mantissa */
-    return fb.f;
+    /* Values which fit in 63 bits take a single hardware conversion. */
+    if (a <= (tu_int)INT64_MAX)
+        return (float)(di_int)a;
+    return float_from_wide(a);
 }
 
 #endif
@@ -0,0 +1,65 @@
+//===-- lib/fp_div_table.h - Reciprocal seeds for division -------*- C -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a private header, used by divsf3.c, divdf3.c and divtf3.c to
+// seed the Newton-Raphson reciprocal iterations.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef FP_DIV_TABLE_HEADER
+#define FP_DIV_TABLE_HEADER
+
+#include <stdint.h>
+
+// The top 16 bits of the Q32 reciprocal of the midpoint of each of the 256
+// intervals [1 + i/256, 1 + (i+1)/256).  The seed is accurate to about 9
+// binary digits over the interval, against about 3.5 for the linear
+// approximation 3/4 + 1/sqrt(2) - b/2, which saves one iteration.
+static const uint16_t reciprocalSeeds[256] = {
+    0xff80, 0xfe82, 0xfd86, 0xfc8c, 0xfb94, 0xfa9e, 0xf9a9, 0xf8b7,
+    0xf7c6, 0xf6d7, 0xf5ea, 0xf4ff, 0xf415, 0xf32d, 0xf247, 0xf163,
+    0xf080, 0xef9f, 0xeebf, 0xede1, 0xed05, 0xec2a, 0xeb51, 0xea7a,
+    0xe9a4, 0xe8cf, 0xe7fc, 0xe72b, 0xe65b, 0xe58c, 0xe4bf, 0xe3f4,
+    0xe329, 0xe260, 0xe199, 0xe0d3, 0xe00e, 0xdf4b, 0xde88, 0xddc8,
+    0xdd08, 0xdc4a, 0xdb8d, 0xdad1, 0xda17, 0xd95e, 0xd8a6, 0xd7ef,
+    0xd73a, 0xd685, 0xd5d2, 0xd520, 0xd46f, 0xd3bf, 0xd311, 0xd263,
+    0xd1b7, 0xd10c, 0xd062, 0xcfb9, 0xcf11, 0xce6a, 0xcdc4, 0xcd1f,
+    0xcc7b, 0xcbd8, 0xcb36, 0xca96, 0xc9f6, 0xc957, 0xc8b9, 0xc81c,
+    0xc780, 0xc6e5, 0xc64b, 0xc5b2, 0xc51a, 0xc482, 0xc3ec, 0xc357,
+    0xc2c2, 0xc22e, 0xc19b, 0xc109, 0xc078, 0xbfe8, 0xbf59, 0xbeca,
+    0xbe3c, 0xbdaf, 0xbd23, 0xbc98, 0xbc0d, 0xbb83, 0xbafb, 0xba72,
+    0xb9eb, 0xb964, 0xb8de, 0xb859, 0xb7d5, 0xb751, 0xb6ce, 0xb64c,
+    0xb5cb, 0xb54a, 0xb4ca, 0xb44b, 0xb3cc, 0xb34e, 0xb2d1, 0xb254,
+    0xb1d8, 0xb15d, 0xb0e3, 0xb069, 0xaff0, 0xaf77, 0xaeff, 0xae88,
+    0xae11, 0xad9b, 0xad26, 0xacb1, 0xac3d, 0xabc9, 0xab56, 0xaae4,
+    0xaa72, 0xaa01, 0xa990, 0xa920, 0xa8b1, 0xa842, 0xa7d3, 0xa766,
+    0xa6f8, 0xa68c, 0xa620, 0xa5b4, 0xa549, 0xa4df, 0xa475, 0xa40c,
+    0xa3a3, 0xa33a, 0xa2d3, 0xa26b, 0xa204, 0xa19e, 0xa138, 0xa0d3,
+    0xa06e, 0xa00a, 0x9fa6, 0x9f43, 0x9ee0, 0x9e7e, 0x9e1c, 0x9dba,
+    0x9d59, 0x9cf9, 0x9c99, 0x9c39, 0x9bda, 0x9b7c, 0x9b1d, 0x9ac0,
+    0x9a62, 0x9a05, 0x99a9, 0x994d, 0x98f1, 0x9896, 0x983b, 0x97e1,
+    0x9787, 0x972e, 0x96d5, 0x967c, 0x9624, 0x95cc, 0x9574, 0x951d,
+    0x94c7, 0x9470, 0x941b, 0x93c5, 0x9370, 0x931b, 0x92c7, 0x9273,
+    0x921f, 0x91cc, 0x9179, 0x9127, 0x90d5, 0x9083, 0x9032, 0x8fe1,
+    0x8f90, 0x8f40, 0x8ef0, 0x8ea0, 0x8e51, 0x8e02, 0x8db3, 0x8d65,
+    0x8d17, 0x8cc9, 0x8c7c, 0x8c2f, 0x8be2, 0x8b96, 0x8b4a, 0x8aff,
+    0x8ab3, 0x8a68, 0x8a1e, 0x89d3, 0x8989, 0x8940, 0x88f6, 0x88ad,
+    0x8864, 0x881c, 0x87d3, 0x878c, 0x8744, 0x86fd, 0x86b6, 0x866f,
+    0x8628, 0x85e2, 0x859c, 0x8557, 0x8511, 0x84cc, 0x8488, 0x8443,
+    0x83ff, 0x83bb, 0x8377, 0x8334, 0x82f1, 0x82ae, 0x826b, 0x8229,
+    0x81e7, 0x81a5, 0x8164, 0x8123, 0x80e2, 0x80a1, 0x8060, 0x8020,
+};
+
+// Returns a Q32 approximation of the reciprocal of the Q31 number q31b in
+// [1, 2.0).
+static inline uint32_t reciprocalSeed(uint32_t q31b) {
+    return (uint32_t)reciprocalSeeds[(q31b >> 23) & 0xff] << 16;
+}
+
+#endif // FP_DIV_TABLE_HEADER
@@ -14,7 +14,8 @@
 //
 // Assumes that float and double correspond to the IEEE-754 binary32 and
 // binary64 types, respectively, and that integer endianness matches floating
-// point endianness on the target platform.
+// point endianness on the target platform.  The QUAD_PRECISION routines are
+// only built when the target has a binary128 type, see CRT_HAS_TF_MODE.
 //
 //===----------------------------------------------------------------------===//
 
@@ -84,9 +85,58 @@ static inline void wideMultiply(rep_t a, rep_t b, rep_t *hi, rep_t *lo) {
     *hi = hiWord(plohi) + hiWord(philo) + hiWord(r1) + phihi;
 }
 
+#elif defined QUAD_PRECISION
+
+// binary128 needs 128-bit integers for its representation.  It is the type of
+// long double on the targets where long double has a 113-bit significand, and
+// __float128 on x86_64, where it also uses the tf names.  (On PowerPC the tf
+// names belong to the IBM double-double long double, see lib/ppc.)
+#if defined(__SIZEOF_INT128__) && \
+    (__LDBL_MANT_DIG__ == 113 || \
+     (defined(__x86_64__) && defined(__SIZEOF_FLOAT128__)))
+#define CRT_HAS_TF_MODE
+
+typedef __uint128_t rep_t;
+typedef __int128_t srep_t;
+#if __LDBL_MANT_DIG__ == 113
+typedef long double fp_t;
 #else
-#error Either SINGLE_PRECISION or DOUBLE_PRECISION must be defined.
+typedef __float128 fp_t;
 #endif
+#define REP_C (__uint128_t)
+#define significandBits 112
+
+static inline int rep_clz(rep_t a) {
+    const uint64_t hi = a >> 64;
+    if (hi)
+        return __builtin_clzll(hi);
+    else
+        return 64 + __builtin_clzll((uint64_t)a);
+}
+
+// 128x128 -> 256 wide multiply from the 64x64 -> 128 products, which are a
+// single instruction on the targets with 128-bit integers.
+static inline void wideMultiply(rep_t a, rep_t b, rep_t *hi, rep_t *lo) {
+    const uint64_t aLo = a, aHi = a >> 64;
+    const uint64_t bLo = b, bHi = b >> 64;
+    const rep_t plolo = (rep_t)aLo * bLo;
+    const rep_t plohi = (rep_t)aLo * bHi;
+    const rep_t philo = (rep_t)aHi * bLo;
+    const rep_t phihi = (rep_t)aHi * bHi;
+    // Sum the 64-bit terms that contribute to lo, the sum can't overflow.
+    const rep_t mid = (plolo >> 64) + (uint64_t)plohi + (uint64_t)philo;
+    *lo = (uint64_t)plolo | mid << 64;
+    *hi = phihi + (plohi >> 64) + (philo >> 64) + (mid >> 64);
+}
+
+#endif // __SIZEOF_INT128__ ...
+
+#else
+#error One of SINGLE_PRECISION, DOUBLE_PRECISION or QUAD_PRECISION must be \
+       defined.
+#endif
+
+#if !defined(QUAD_PRECISION) || defined(CRT_HAS_TF_MODE)
 
 #define typeWidth       (sizeof(rep_t)*CHAR_BIT)
 #define exponentBits    (typeWidth - significandBits - 1)
@@ -141,4 +191,6 @@ static inline void wideRightShiftWithSticky(rep_t *hi, rep_t *lo, unsigned int c
     }
 }
 
+#endif // !QUAD_PRECISION || CRT_HAS_TF_MODE
+
 #endif // FP_LIB_HEADER
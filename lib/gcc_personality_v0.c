@@ -88,7 +88,7 @@ static uintptr_t readULEB128(const uint8_t** data)
     const uint8_t* p = *data;
     do {
         byte = *p++;
-        result |= (byte & 0x7f) << shift;
+        result |= (uintptr_t)(byte & 0x7f) << shift;
         shift += 7;
     } while (byte & 0x80);
     *data = p;
@@ -214,7 +214,11 @@ _Unwind_Reason_Code __gcc_personality_v0(int version, _Unwind_Action actions,
     if (ttypeEncoding != DW_EH_PE_omit) {
         readULEB128(&lsda);  
     }
-    /* Walk call-site table looking for range that includes current PC. */
+    /* Walk call-site table looking for range that includes current PC.
+     * The entries are sorted by start address, so the walk stops at the first
+     * one which starts past the PC instead of decoding the rest of the table
+     * on every frame.
+     */
     uint8_t         callSiteEncoding = *lsda++;
     uint32_t        callSiteTableLength = readULEB128(&lsda);
     const uint8_t*  callSiteTableStart = lsda;
@@ -222,6 +226,8 @@ _Unwind_Reason_Code __gcc_personality_v0(int version, _Unwind_Action actions,
     const uint8_t* p=callSiteTableStart;
     while (p < callSiteTableEnd) {
         uintptr_t start = readEncodedPointer(&p, callSiteEncoding);
+        if ( pcOffset < start )
+            break; /* no later entry can include the PC */
         uintptr_t length = readEncodedPointer(&p, callSiteEncoding);
         uintptr_t landingPad = readEncodedPointer(&p, callSiteEncoding);
         readULEB128(&p); /* action value not used for C code */
@@ -0,0 +1,108 @@
+/* ===-- int_cpu_model.h - CPU features for the builtins ------------------===
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is dual licensed under the MIT and the University of Illinois Open
+ * Source Licenses. See LICENSE.TXT for details.
+ *
+ * ===----------------------------------------------------------------------===
+ *
+ * The builtins which have faster versions for some CPUs of the target select
+ * them at run time with the features detected by cpu_model.c, from cpuid on
+ * x86 and from AT_HWCAP on Linux ARM.
+ *
+ * COMPILERRT_MULTIVERSION defines a builtin which calls the version picked
+ * by an expression of __compilerrt_cpu_has().  Where the platform has ifunc
+ * the dynamic linker resolves the builtin once, so the calls go straight to
+ * the selected version.  Elsewhere the first call selects it and stores it in
+ * a function pointer, which the later calls go through.
+ *
+ * This file is not part of the interface of this library.
+ *
+ * ===----------------------------------------------------------------------===
+ */
+
+#ifndef INT_CPU_MODEL_H
+#define INT_CPU_MODEL_H
+
+#include "int_lib.h"
+
+/* Feature bits of __compilerrt_cpu_features. */
+#define COMPILERRT_CPU_INITIALIZED  (1u << 0)
+#if __i386__ || __x86_64__
+#define COMPILERRT_CPU_X86_SSE4_2   (1u << 1)
+#define COMPILERRT_CPU_X86_POPCNT   (1u << 2)
+#define COMPILERRT_CPU_X86_F16C     (1u << 3)
+#define COMPILERRT_CPU_X86_AVX      (1u << 4)
+#define COMPILERRT_CPU_X86_AVX2     (1u << 5)
+#define COMPILERRT_CPU_X86_BMI2     (1u << 6)
+#define COMPILERRT_CPU_X86_LZCNT    (1u << 7)
+#elif __arm__
+#define COMPILERRT_CPU_ARM_NEON     (1u << 1)
+#define COMPILERRT_CPU_ARM_VFPV4    (1u << 2)
+#define COMPILERRT_CPU_ARM_IDIVA    (1u << 3)
+#endif
+
+/* Zero until the first __compilerrt_cpu_init(). */
+extern __attribute__((visibility("hidden"))) unsigned __compilerrt_cpu_features;
+
+/* Detects the features, if not done yet, and returns them.  It makes no
+ * library calls on x86, so it may run from an ifunc resolver.
+ */
+__attribute__((visibility("hidden"))) unsigned __compilerrt_cpu_init(void);
+
+static __inline bool __compilerrt_cpu_has(unsigned feature)
+{
+    unsigned features = __compilerrt_cpu_features;
+    if (!features)
+        features = __compilerrt_cpu_init();
+    return (features & feature) != 0;
+}
+
+/* The ifunc resolvers run while the dynamic linker relocates the program,
+ * before the C library is initialized, so they are only used where
+ * detection needs no library calls.  Build with -DCOMPILERRT_HAS_IFUNC=0 to
+ * use the function pointers everywhere.
+ */
+#ifndef COMPILERRT_HAS_IFUNC
+#if defined(__ELF__) && defined(__linux__) && (__i386__ || __x86_64__) && \
+    !defined(__clang__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 6))
+#define COMPILERRT_HAS_IFUNC 1
+#else
+#define COMPILERRT_HAS_IFUNC 0
+#endif
+#endif
+
+/* Defines R name params, which calls the function select evaluates to, with
+ * args, e.g.
+ *
+ *   COMPILERRT_MULTIVERSION(si_int, __popcountdi2, (di_int a), (a),
+ *       __compilerrt_cpu_has(COMPILERRT_CPU_X86_POPCNT) ? popcnt_version
+ *                                                       : soft_version)
+ */
+#if COMPILERRT_HAS_IFUNC
+#define COMPILERRT_MULTIVERSION(R, name, params, args, select)               \
+    typedef R (*name##_fn) params;                                           \
+    static name##_fn name##_resolve(void)                                    \
+    {                                                                        \
+        return select;                                                       \
+    }                                                                        \
+    COMPILER_RT_ABI R name params __attribute__((ifunc(#name "_resolve")));
+#else
+#define COMPILERRT_MULTIVERSION(R, name, params, args, select)               \
+    typedef R (*name##_fn) params;                                           \
+    static R name##_first params;                                            \
+    static name##_fn name##_impl = name##_first;                             \
+    static R name##_first params                                             \
+    {                                                                        \
+        name##_impl = select;                                                \
+        return name##_impl args;                                             \
+    }                                                                        \
+    COMPILER_RT_ABI R name params                                            \
+    {                                                                        \
+        return name##_impl args;                                             \
+    }
+#endif
+
+#endif /* INT_CPU_MODEL_H */
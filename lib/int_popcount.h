@@ -0,0 +1,60 @@
+/* ===-- int_popcount.h - The x86 popcnt instruction ----------------------===
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is dual licensed under the MIT and the University of Illinois Open
+ * Source Licenses. See LICENSE.TXT for details.
+ *
+ * ===----------------------------------------------------------------------===
+ *
+ * The compiler only calls __popcount[sdt]i2 when the target is not known to
+ * have a population count instruction, which on x86 means builds without
+ * -mpopcnt.  Such builds still mostly run on CPUs with popcnt (every x86 CPU
+ * since 2008), so the popcount routines select a version with popcnt at run
+ * time (see int_cpu_model.h), and only use the bit tricks on the other CPUs.
+ *
+ * The instruction is emitted with inline assembly: __builtin_popcount would
+ * compile back into a call to these routines.
+ *
+ * This file is not part of the interface of this library.
+ *
+ * ===----------------------------------------------------------------------===
+ */
+
+#ifndef INT_POPCOUNT_H
+#define INT_POPCOUNT_H
+
+#include "int_cpu_model.h"
+
+#if (__i386__ || __x86_64__) && !__POPCNT__
+#define COMPILERRT_POPCNT_DISPATCH 1
+#else
+#define COMPILERRT_POPCNT_DISPATCH 0
+#endif
+
+#if COMPILERRT_POPCNT_DISPATCH
+
+static __inline si_int popcnt32(su_int a)
+{
+    su_int r;
+    __asm__("popcntl %1, %0" : "=r"(r) : "rm"(a) : "cc");
+    return r;
+}
+
+#if __x86_64__
+static __inline si_int popcnt64(du_int a)
+{
+    du_int r;
+    __asm__("popcntq %1, %0" : "=r"(r) : "rm"(a) : "cc");
+    return r;
+}
+#else
+static __inline si_int popcnt64(du_int a)
+{
+    return popcnt32((su_int)a) + popcnt32((su_int)(a >> 32));
+}
+#endif
+
+#endif /* COMPILERRT_POPCNT_DISPATCH */
+
+#endif /* INT_POPCOUNT_H */
@@ -17,11 +17,264 @@
 
 #include <stddef.h>  // for NULL
 #include <dlfcn.h>   // for dlsym
+#include <link.h>    // for dl_phdr_info, ElfW
+
+#ifndef STT_GNU_IFUNC
+# define STT_GNU_IFUNC 10
+#endif
+#ifndef STB_GNU_UNIQUE
+# define STB_GNU_UNIQUE 10
+#endif
 
 namespace __interception {
+
+// dlsym(RTLD_NEXT) walks the whole link map and the hash table of every
+// object on each call, which adds up for hundreds of interceptors and
+// hundreds of DSOs. Instead, the link map is walked once to collect the
+// dynamic symbol tables of the objects that follow the one containing the
+// runtime, and names are looked up there through the GNU hash tables, whose
+// Bloom filters reject most objects without touching the symbol table.
+// Anything this index is unsure about is left to dlsym.
+
+namespace {
+
+struct DynamicObject {
+  uptr base;
+  const ElfW(Sym) *symtab;
+  const char *strtab;
+  const ElfW(Half) *versym;
+  // DT_GNU_HASH: nbuckets, symoffset, bloom_size, bloom_shift, bloom[],
+  // buckets[], chains[].
+  const Elf32_Word *gnu_hash;
+};
+
+typedef int (*dl_iterate_phdr_f)(int (*)(dl_phdr_info *, size_t, void *),
+                                 void *);
+
+const int kMaxDynamicObjects = 512;
+DynamicObject dynamic_objects[kMaxDynamicObjects];
+int num_dynamic_objects;
+// False if some object can not be searched without dlsym.
+bool index_usable;
+bool index_initialized;
+dl_iterate_phdr_f real_dl_iterate_phdr;
+// Number of objects ever loaded when the index was built, or 0 if the
+// loader does not report it.
+unsigned long long index_generation;
+
+struct IndexBuildState {
+  bool found_self;
+};
+
+unsigned long long GetGeneration(dl_phdr_info *info, size_t size) {
+  if (size < offsetof(dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs))
+    return 0;
+  return info->dlpi_adds;
+}
+
+bool ContainsAddress(dl_phdr_info *info, uptr addr) {
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+    if (phdr->p_type != PT_LOAD)
+      continue;
+    uptr beg = info->dlpi_addr + phdr->p_vaddr;
+    if (addr >= beg && addr < beg + phdr->p_memsz)
+      return true;
+  }
+  return false;
+}
+
+bool HasPrefix(const char *s, const char *prefix) {
+  for (; *prefix; s++, prefix++) {
+    if (*s != *prefix)
+      return false;
+  }
+  return true;
+}
+
+bool StringsEqual(const char *s1, const char *s2) {
+  for (; *s1 == *s2; s1++, s2++) {
+    if (*s1 == '\0')
+      return true;
+  }
+  return false;
+}
+
+int AddDynamicObject(dl_phdr_info *info, size_t size, void *arg) {
+  IndexBuildState *state = (IndexBuildState *)arg;
+  index_generation = GetGeneration(info, size);
+  // RTLD_NEXT semantics: only objects after the one with the runtime.
+  if (!state->found_self) {
+    state->found_self = ContainsAddress(info, (uptr)&AddDynamicObject);
+    return 0;
+  }
+  // The vDSO is in the link map, but not in the global lookup scope.
+  if (info->dlpi_name && (HasPrefix(info->dlpi_name, "linux-vdso") ||
+                          HasPrefix(info->dlpi_name, "linux-gate")))
+    return 0;
+  const ElfW(Dyn) *dynamic = 0;
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    if (info->dlpi_phdr[i].p_type == PT_DYNAMIC)
+      dynamic = (const ElfW(Dyn) *)(info->dlpi_addr +
+                                    info->dlpi_phdr[i].p_vaddr);
+  }
+  if (!dynamic)
+    return 0;
+  if (num_dynamic_objects == kMaxDynamicObjects) {
+    index_usable = false;
+    return 1;
+  }
+  DynamicObject *obj = &dynamic_objects[num_dynamic_objects];
+  uptr base = info->dlpi_addr;
+  uptr symtab = 0, strtab = 0, versym = 0, gnu_hash = 0;
+  for (; dynamic->d_tag != DT_NULL; dynamic++) {
+    uptr ptr = dynamic->d_un.d_ptr;
+    switch (dynamic->d_tag) {
+      case DT_SYMTAB: symtab = ptr; break;
+      case DT_STRTAB: strtab = ptr; break;
+      case DT_VERSYM: versym = ptr; break;
+      case DT_GNU_HASH: gnu_hash = ptr; break;
+    }
+  }
+  if (!symtab || !strtab || !gnu_hash) {
+    // E.g. an object with DT_HASH only.
+    index_usable = false;
+    return 1;
+  }
+  // glibc relocates these entries in place, other loaders may not.
+  obj->base = base;
+  obj->symtab = (const ElfW(Sym) *)(symtab < base ? symtab + base : symtab);
+  obj->strtab = (const char *)(strtab < base ? strtab + base : strtab);
+  obj->versym = versym ? (const ElfW(Half) *)(versym < base ? versym + base
+                                                            : versym)
+                       : 0;
+  obj->gnu_hash = (const Elf32_Word *)(gnu_hash < base ? gnu_hash + base
+                                                      : gnu_hash);
+  num_dynamic_objects++;
+  return 0;
+}
+
+void InitializeIndex() {
+  index_initialized = true;
+  // dl_iterate_phdr itself may be intercepted by the tool.
+  real_dl_iterate_phdr =
+      (dl_iterate_phdr_f)dlsym(RTLD_NEXT, "dl_iterate_phdr");
+  if (!real_dl_iterate_phdr)
+    return;
+  index_usable = true;
+  IndexBuildState state = { false };
+  real_dl_iterate_phdr(AddDynamicObject, &state);
+  if (!state.found_self)
+    index_usable = false;
+}
+
+Elf32_Word GnuHash(const char *name) {
+  Elf32_Word h = 5381;
+  for (const unsigned char *c = (const unsigned char *)name; *c; c++)
+    h = h * 33 + *c;
+  return h;
+}
+
+// Possible outcomes of looking a name up in one object.
+enum LookupResult {
+  kNotFound,
+  kFound,
+  kUnsure
+};
+
+// Follows check_match() of glibc for an unversioned dlsym lookup:
+// unversioned definitions win, otherwise the single non-hidden versioned
+// one is used.
+LookupResult LookupInObject(const DynamicObject *obj, const char *name,
+                            Elf32_Word hash, uptr *func_addr) {
+  const Elf32_Word nbuckets = obj->gnu_hash[0];
+  const Elf32_Word symoffset = obj->gnu_hash[1];
+  const Elf32_Word bloom_size = obj->gnu_hash[2];
+  const Elf32_Word bloom_shift = obj->gnu_hash[3];
+  if (nbuckets == 0)
+    return kNotFound;
+  const uptr *bloom = (const uptr *)&obj->gnu_hash[4];
+  const Elf32_Word *buckets = (const Elf32_Word *)&bloom[bloom_size];
+  const Elf32_Word *chains = &buckets[nbuckets] - symoffset;
+  const Elf32_Word kBloomBits = sizeof(uptr) * 8;
+  uptr word = bloom[(hash / kBloomBits) & (bloom_size - 1)];
+  uptr mask = ((uptr)1 << (hash % kBloomBits)) |
+              ((uptr)1 << ((hash >> bloom_shift) % kBloomBits));
+  if ((word & mask) != mask)
+    return kNotFound;
+  Elf32_Word idx = buckets[hash % nbuckets];
+  if (idx < symoffset)
+    return kNotFound;
+  const ElfW(Sym) *match = 0;
+  int num_versions = 0;
+  for (;; idx++) {
+    Elf32_Word chain_hash = chains[idx];
+    const ElfW(Sym) *sym = &obj->symtab[idx];
+    if ((chain_hash | 1) == (hash | 1) && sym->st_shndx != SHN_UNDEF &&
+        StringsEqual(obj->strtab + sym->st_name, name)) {
+      // st_info is encoded in the same way for both ELF classes.
+      int type = ELF32_ST_TYPE(sym->st_info);
+      int bind = ELF32_ST_BIND(sym->st_info);
+      if (type == STT_GNU_IFUNC || type == STT_TLS)
+        return kUnsure;
+      if ((bind == STB_GLOBAL || bind == STB_WEAK ||
+           bind == STB_GNU_UNIQUE) &&
+          (type == STT_FUNC || type == STT_OBJECT || type == STT_NOTYPE) &&
+          (sym->st_value != 0 || sym->st_shndx == SHN_ABS)) {
+        if (!obj->versym || (obj->versym[idx] & 0x7fff) < 2) {
+          match = sym;
+          num_versions = 1;
+          break;
+        }
+        if ((obj->versym[idx] & 0x8000) == 0 && num_versions++ == 0)
+          match = sym;
+      }
+    }
+    if (chain_hash & 1)
+      break;
+  }
+  if (num_versions != 1)
+    return num_versions == 0 ? kNotFound : kUnsure;
+  *func_addr = match->st_shndx == SHN_ABS
+                   ? match->st_value
+                   : obj->base + match->st_value;
+  return kFound;
+}
+
+int GetCurrentGeneration(dl_phdr_info *info, size_t size, void *arg) {
+  *(unsigned long long *)arg = GetGeneration(info, size);
+  return 1;
+}
+
+// Returns false if dlsym has to be asked.
+bool LookupInIndex(const char *func_name, uptr *func_addr) {
+  if (!index_initialized)
+    InitializeIndex();
+  if (!index_usable)
+    return false;
+  Elf32_Word hash = GnuHash(func_name);
+  for (int i = 0; i < num_dynamic_objects; i++) {
+    switch (LookupInObject(&dynamic_objects[i], func_name, hash, func_addr)) {
+      case kFound: return true;
+      case kUnsure: return false;
+      case kNotFound: break;
+    }
+  }
+  // Not found, unless it is in an object loaded after the index was built.
+  unsigned long long generation = 0;
+  real_dl_iterate_phdr(GetCurrentGeneration, &generation);
+  if (generation == 0 || generation != index_generation)
+    return false;
+  *func_addr = 0;
+  return true;
+}
+
+}  // namespace
+
 bool GetRealFunctionAddress(const char *func_name, uptr *func_addr,
     uptr real, uptr wrapper) {
-  *func_addr = (uptr)dlsym(RTLD_NEXT, func_name);
+  if (!LookupInIndex(func_name, func_addr))
+    *func_addr = (uptr)dlsym(RTLD_NEXT, func_name);
   return real == wrapper;
 }
 }  // namespace __interception
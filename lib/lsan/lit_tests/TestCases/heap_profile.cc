@@ -0,0 +1,25 @@
+// Test for __sanitizer_dump_heap_profile() and heap_profile_interval_ms.
+// RUN: %clangxx_lsan %s -o %t
+// RUN: rm -f %t.prof.*
+// RUN: LSAN_OPTIONS=heap_profile_path=%t.prof %t
+// RUN: FileCheck %s < %t.prof.*.0.heap
+// RUN: rm -f %t.prof.*
+// RUN: LSAN_OPTIONS=heap_profile_path=%t.prof:heap_profile_interval_ms=50 %t
+// RUN: ls %t.prof.*.1.heap
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sanitizer/common_interface_defs.h>
+
+void *volatile p[10];
+
+int main() {
+  for (int i = 0; i < 10; i++)
+    p[i] = malloc(1 << 20);
+  __sanitizer_dump_heap_profile();
+  usleep(300000);
+  return 0;
+}
+// CHECK: heap profile: {{[0-9]+: [0-9]+ \[[0-9]+: [0-9]+\]}} @ heapprofile
+// CHECK: 10: 10485760 [10: 10485760] @ 0x
+// CHECK: MAPPED_LIBRARIES:
@@ -0,0 +1,37 @@
+// Test that leaks are found when reachable chunks are marked in parallel.
+// RUN: LSAN_BASE="report_objects=1:use_stacks=0:use_registers=0"
+// RUN: %clangxx_lsan %s -o %t
+// RUN: LSAN_OPTIONS=$LSAN_BASE:"marking_threads=1" not %t 2>&1 | FileCheck %s
+// RUN: LSAN_OPTIONS=$LSAN_BASE:"marking_threads=4" not %t 2>&1 | FileCheck %s
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct Node {
+  Node *left, *right;
+};
+
+// A tree which is too big for a single marker to hold in its frontier, and a
+// global array which is split into several root ranges.
+static Node *Build(int depth) {
+  Node *node = (Node *)malloc(sizeof(Node));
+  node->left = depth ? Build(depth - 1) : 0;
+  node->right = depth ? Build(depth - 1) : 0;
+  return node;
+}
+
+const int kRoots = 1 << 18;
+Node *roots[kRoots];
+
+int main() {
+  for (int i = 0; i < kRoots; i += 1 << 12)
+    roots[i] = Build(8);
+  Node *leaked = Build(2);
+  fprintf(stderr, "Test alloc: %p.\n", leaked);
+  leaked = 0;
+  return 0;
+}
+// CHECK: Test alloc: [[ADDR:.*]].
+// CHECK: Directly leaked 16 byte object at [[ADDR]]
+// CHECK: LeakSanitizer: detected memory leaks
+// CHECK: SUMMARY: LeakSanitizer: 112 byte(s) leaked in 7 allocation(s)
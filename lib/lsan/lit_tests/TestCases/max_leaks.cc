@@ -0,0 +1,41 @@
+// Test that max_leaks limits the report to the largest leaks.
+// RUN: LSAN_BASE="use_stacks=0:use_registers=0"
+// RUN: %clangxx_lsan %s -o %t
+// RUN: LSAN_OPTIONS=$LSAN_BASE:"max_leaks=2" not %t 2>&1 | FileCheck %s
+// RUN: LSAN_OPTIONS=$LSAN_BASE not %t 2>&1 | FileCheck %s --check-prefix=CHECK-ALL
+
+#include <stdio.h>
+#include <stdlib.h>
+
+void **sink;
+
+__attribute__((noinline)) void *LeakObjects(int size, int count) {
+  for (int i = 0; i < count; i++)
+    sink = (void **)malloc(size);
+  return sink;
+}
+
+int main() {
+  LeakObjects(10, 20);
+  LeakObjects(3000, 1);
+  LeakObjects(100, 5);
+  void **p = (void **)malloc(1000);
+  for (int i = 0; i < 2; i++)
+    p[i] = malloc(7);
+  sink = 0;
+  return 0;
+}
+// CHECK: The 2 largest leak(s):
+// CHECK-NEXT: Direct leak of 3000 byte(s) in 1 object(s)
+// CHECK: Direct leak of 1000 byte(s) in 1 object(s)
+// CHECK-NOT: leak of
+// CHECK: Omitting 3 more leak(s).
+// CHECK: SUMMARY: LeakSanitizer: 4714 byte(s) leaked in 29 allocation(s)
+
+// CHECK-ALL-NOT: largest leak
+// CHECK-ALL: Direct leak of 3000 byte(s) in 1 object(s)
+// CHECK-ALL: Direct leak of 1000 byte(s) in 1 object(s)
+// CHECK-ALL: Direct leak of 500 byte(s) in 5 object(s)
+// CHECK-ALL: Direct leak of 200 byte(s) in 20 object(s)
+// CHECK-ALL: Indirect leak of 14 byte(s) in 2 object(s)
+// CHECK-ALL-NOT: Omitting
@@ -0,0 +1,40 @@
+// Test that with new_leaks_only the repeated leak checks report only the new
+// leaks and the leaks that have grown.
+// RUN: LSAN_BASE="use_stacks=0:use_registers=0:new_leaks_only=1"
+// RUN: %clangxx_lsan %s -o %t
+// RUN: LSAN_OPTIONS=$LSAN_BASE not %t 2>&1 | FileCheck %s
+// RUN: LSAN_OPTIONS=$LSAN_BASE:"concurrent_marking=1" not %t 2>&1 | FileCheck %s
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sanitizer/lsan_interface.h>
+
+void *volatile p;
+
+__attribute__((noinline)) void LeakFirst() { p = malloc(1337); p = 0; }
+__attribute__((noinline)) void LeakSecond() { p = malloc(42); p = 0; }
+
+int main() {
+  LeakFirst();
+  fprintf(stderr, "Check 1: %d\n", __lsan_do_recoverable_leak_check());
+  for (int i = 2; i <= 3; i++) {
+    LeakSecond();
+    fprintf(stderr, "Check %d: %d\n", i, __lsan_do_recoverable_leak_check());
+  }
+  fprintf(stderr, "Check 4: %d\n", __lsan_do_recoverable_leak_check());
+  return 0;
+}
+// CHECK: Direct leak of 1337 byte(s) in 1 object(s)
+// CHECK-NOT: Direct leak
+// CHECK: Check 1: 1
+// CHECK-NOT: 1337 byte
+// CHECK: Direct leak of 42 byte(s) in 1 object(s)
+// CHECK-NOT: Direct leak
+// CHECK: Check 2: 1
+// CHECK-NOT: 1337 byte
+// CHECK: Direct leak of 84 byte(s) in 2 object(s)
+// CHECK-NOT: Direct leak
+// CHECK: Check 3: 1
+// CHECK-NOT: Direct leak
+// CHECK: Check 4: 1
+// CHECK-NOT: Direct leak
@@ -0,0 +1,27 @@
+// Test for on-demand leak checking, with and without concurrent marking.
+// RUN: LSAN_BASE="use_stacks=0:use_registers=0"
+// RUN: %clangxx_lsan %s -o %t
+// RUN: LSAN_OPTIONS=$LSAN_BASE not %t 2>&1 | FileCheck %s
+// RUN: LSAN_OPTIONS=$LSAN_BASE:"concurrent_marking=1" not %t 2>&1 | FileCheck %s
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sanitizer/lsan_interface.h>
+
+void *volatile p;
+
+int main() {
+  p = malloc(1337);
+  fprintf(stderr, "Leaks: %d\n", __lsan_do_recoverable_leak_check());
+  p = 0;
+  fprintf(stderr, "Leaks: %d\n", __lsan_do_recoverable_leak_check());
+  fprintf(stderr, "Leaks: %d\n", __lsan_do_recoverable_leak_check());
+  return 0;
+}
+// CHECK: Leaks: 0
+// CHECK: Direct leak of 1337 byte(s) in 1 object(s)
+// CHECK: Leaks: 1
+// CHECK: Direct leak of 1337 byte(s) in 1 object(s)
+// CHECK: Leaks: 1
+// CHECK: Direct leak of 1337 byte(s) in 1 object(s)
+// CHECK: SUMMARY: LeakSanitizer:
@@ -0,0 +1,42 @@
+// Test that a scoped leak check reports only the leaks allocated in the scope.
+// RUN: LSAN_BASE="report_objects=1:use_stacks=0:use_registers=0"
+// RUN: %clangxx_lsan %s -o %t
+// RUN: LSAN_OPTIONS=$LSAN_BASE not %t 2>&1 | FileCheck %s
+// RUN: LSAN_OPTIONS=$LSAN_BASE:"concurrent_marking=1" not %t 2>&1 | FileCheck %s
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sanitizer/lsan_interface.h>
+
+void *kept;
+
+int main() {
+  void *old = malloc(1337);
+  fprintf(stderr, "Old leak: %p.\n", old);
+  old = 0;
+
+  __lsan_begin_scope();
+  kept = malloc(100);
+  void *leaked = malloc(1338);
+  fprintf(stderr, "Scope leak: %p.\n", leaked);
+  leaked = 0;
+  void *volatile freed = malloc(1339);
+  free(freed);
+  fprintf(stderr, "Scope check returned %d.\n", __lsan_end_scope_check());
+
+  __lsan_begin_scope();
+  kept = malloc(10);
+  fprintf(stderr, "Scope check returned %d.\n", __lsan_end_scope_check());
+  return 0;
+}
+// CHECK: Old leak: [[OLD:.*]].
+// CHECK: Scope leak: [[ADDR:.*]].
+// CHECK-NOT: [[OLD]]
+// CHECK: Directly leaked 1338 byte object at [[ADDR]]
+// CHECK-NOT: [[OLD]]
+// CHECK: SUMMARY: LeakSanitizer: 1338 byte(s) leaked in 1 allocation(s)
+// CHECK: Scope check returned 1.
+// CHECK-NOT: LeakSanitizer
+// CHECK: Scope check returned 0.
+// CHECK: ERROR: LeakSanitizer: detected memory leaks
+// CHECK: SUMMARY: LeakSanitizer: 2775 byte(s) leaked in 3 allocation(s)
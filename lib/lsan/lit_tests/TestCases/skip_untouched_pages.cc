@@ -0,0 +1,25 @@
+// Test that pointers in the touched pages of a large, mostly untouched global
+// array are found.
+// RUN: LSAN_BASE="report_objects=1:use_stacks=0:use_registers=0"
+// RUN: %clangxx_lsan %s -o %t
+// RUN: LSAN_OPTIONS=$LSAN_BASE:"skip_untouched_pages=1" not %t 2>&1 | FileCheck %s
+// RUN: LSAN_OPTIONS=$LSAN_BASE:"skip_untouched_pages=0" not %t 2>&1 | FileCheck %s
+
+#include <stdio.h>
+#include <stdlib.h>
+
+const int kWordsPerPage = 4096 / sizeof(void *);
+void *bss_array[1 << 24];
+
+int main() {
+  bss_array[(1 << 23) - 1] = malloc(1337);
+  bss_array[(1 << 23) + kWordsPerPage * 7] = malloc(1338);
+  void *leaked = malloc(1339);
+  fprintf(stderr, "Test alloc: %p.\n", leaked);
+  leaked = 0;
+  return 0;
+}
+// CHECK: Test alloc: [[ADDR:.*]].
+// CHECK: Directly leaked 1339 byte object at [[ADDR]]
+// CHECK: LeakSanitizer: detected memory leaks
+// CHECK: SUMMARY: LeakSanitizer: 1339 byte(s) leaked in 1 allocation(s)
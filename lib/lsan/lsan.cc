@@ -14,8 +14,10 @@
 
 #include "lsan.h"
 
+#include "sanitizer_common/sanitizer_coverage.h"
 #include "sanitizer_common/sanitizer_flags.h"
 #include "sanitizer_common/sanitizer_stacktrace.h"
+#include "sanitizer_common/sanitizer_timing.h"
 #include "lsan_allocator.h"
 #include "lsan_common.h"
 #include "lsan_thread.h"
@@ -29,6 +31,9 @@ static void InitializeCommonFlags() {
       cf->external_symbolizer_path[0]);
   cf->strip_path_prefix = "";
   cf->fast_unwind_on_malloc = true;
+  cf->use_shadow_call_stack = false;
+  cf->compress_stack_depot = false;
+  cf->stack_depot_max_mb = 0;
   cf->malloc_context_size = 30;
   cf->detect_leaks = true;
   cf->leak_check_at_exit = true;
@@ -56,10 +61,20 @@ void Init() {
   const char* external_symbolizer = common_flags()->external_symbolizer_path;
   if (common_flags()->symbolize && external_symbolizer &&
       external_symbolizer[0]) {
-    InitializeExternalSymbolizer(external_symbolizer);
+    if (common_flags()->fast_init)
+      InitializeExternalSymbolizerLazily(external_symbolizer);
+    else
+      InitializeExternalSymbolizer(external_symbolizer);
   }
 
   InitCommonLsan();
+  if (common_flags()->timing_sample_rate) {
+    InitializeTiming(common_flags()->timing_sample_rate);
+    Atexit(PrintTimingStats);
+  }
+  InitializeCoverage(common_flags()->coverage_dir);
+  if (common_flags()->coverage)
+    Atexit(DumpCoverage);
   if (common_flags()->detect_leaks && common_flags()->leak_check_at_exit)
     Atexit(DoLeakCheck);
 }
@@ -15,9 +15,11 @@
 #include "lsan_allocator.h"
 
 #include "sanitizer_common/sanitizer_allocator.h"
+#include "sanitizer_common/sanitizer_atomic.h"
 #include "sanitizer_common/sanitizer_internal_defs.h"
 #include "sanitizer_common/sanitizer_stackdepot.h"
 #include "sanitizer_common/sanitizer_stacktrace.h"
+#include "sanitizer_common/sanitizer_timing.h"
 #include "lsan_common.h"
 
 namespace __lsan {
@@ -42,6 +44,7 @@ typedef CombinedAllocator<PrimaryAllocator, AllocatorCache,
 
 static Allocator allocator;
 static THREADLOCAL AllocatorCache cache;
+static THREADLOCAL StackDepotCache stack_depot_cache;
 
 void InitializeAllocator() {
   allocator.Init();
@@ -60,9 +63,11 @@ static void RegisterAllocation(const StackTrace &stack, void *p, uptr size) {
   ChunkMetadata *m = Metadata(p);
   CHECK(m);
   m->tag = DisabledInThisThread() ? kIgnored : kDirectlyLeaked;
-  m->stack_trace_id = StackDepotPut(stack.trace, stack.size);
+  m->stack_trace_id =
+      StackDepotPutCached(&stack_depot_cache, stack.trace, stack.size);
   m->requested_size = size;
   atomic_store(reinterpret_cast<atomic_uint8_t *>(m), 1, memory_order_relaxed);
+  RecordScopedAllocation(reinterpret_cast<uptr>(p));
 }
 
 static void RegisterDeallocation(void *p) {
@@ -74,6 +79,7 @@ static void RegisterDeallocation(void *p) {
 
 void *Allocate(const StackTrace &stack, uptr size, uptr alignment,
                bool cleared) {
+  ScopedTiming timing(kTimingMalloc);
   if (size == 0)
     size = 1;
   if (size > kMaxAllowedMallocSize) {
@@ -86,6 +92,7 @@ void *Allocate(const StackTrace &stack, uptr size, uptr alignment,
 }
 
 void Deallocate(void *p) {
+  ScopedTiming timing(kTimingFree);
   RegisterDeallocation(p);
   allocator.Deallocate(&cache, p);
 }
@@ -129,6 +136,12 @@ void GetAllocatorGlobalRange(uptr *begin, uptr *end) {
   *end = *begin + sizeof(allocator);
 }
 
+void GetAllocatorChunkRangesLocked(uptr *primary_begin, uptr *primary_end,
+                                   uptr *secondary_begin, uptr *secondary_end) {
+  allocator.GetAddressRangesLocked(primary_begin, primary_end,
+                                   secondary_begin, secondary_end);
+}
+
 uptr PointsIntoChunk(void* p) {
   uptr addr = reinterpret_cast<uptr>(p);
   uptr chunk = reinterpret_cast<uptr>(allocator.GetBlockBeginFastLocked(p));
@@ -156,6 +169,10 @@ bool LsanMetadata::allocated() const {
   return reinterpret_cast<ChunkMetadata *>(metadata_)->allocated;
 }
 
+void LsanMetadata::prefetch() const {
+  PREFETCH(metadata_);
+}
+
 ChunkTag LsanMetadata::tag() const {
   return reinterpret_cast<ChunkMetadata *>(metadata_)->tag;
 }
@@ -164,6 +181,22 @@ void LsanMetadata::set_tag(ChunkTag value) {
   reinterpret_cast<ChunkMetadata *>(metadata_)->tag = value;
 }
 
+bool LsanMetadata::compare_and_set_tag(ChunkTag cmp, ChunkTag value) {
+  // The tag shares the first word with the other fields, which do not change
+  // during leak checking.
+  atomic_uint64_t *word = reinterpret_cast<atomic_uint64_t *>(metadata_);
+  u64 old_word = atomic_load(word, memory_order_relaxed);
+  ChunkMetadata m;
+  internal_memcpy(&m, &old_word, sizeof(old_word));
+  if (m.tag != cmp)
+    return false;
+  m.tag = value;
+  u64 new_word;
+  internal_memcpy(&new_word, &m, sizeof(new_word));
+  return atomic_compare_exchange_strong(word, &old_word, new_word,
+                                        memory_order_relaxed);
+}
+
 uptr LsanMetadata::requested_size() const {
   return reinterpret_cast<ChunkMetadata *>(metadata_)->requested_size;
 }
@@ -176,6 +209,10 @@ void ForEachChunk(ForEachChunkCallback callback, void *arg) {
   allocator.ForEachChunk(callback, arg);
 }
 
+void ForEachChunkWithRegionLocks(ForEachChunkCallback callback, void *arg) {
+  allocator.ForEachChunkWithRegionLocks(callback, arg);
+}
+
 IgnoreObjectResult IgnoreObjectLocked(const void *p) {
   void *chunk = allocator.GetBlockBegin(p);
   if (!chunk || p < chunk) return kIgnoreObjectInvalid;
@@ -14,13 +14,16 @@
 
 #include "lsan_common.h"
 
+#include "sanitizer_common/sanitizer_atomic.h"
 #include "sanitizer_common/sanitizer_common.h"
 #include "sanitizer_common/sanitizer_flags.h"
+#include "sanitizer_common/sanitizer_mutex.h"
 #include "sanitizer_common/sanitizer_placement_new.h"
 #include "sanitizer_common/sanitizer_stackdepot.h"
 #include "sanitizer_common/sanitizer_stacktrace.h"
 #include "sanitizer_common/sanitizer_stoptheworld.h"
 #include "sanitizer_common/sanitizer_suppressions.h"
+#include "sanitizer_common/sanitizer_timing.h"
 
 #if CAN_SANITIZE_LEAKS
 namespace __lsan {
@@ -31,6 +34,55 @@ BlockingMutex global_mutex(LINKER_INITIALIZED);
 THREADLOCAL int disable_counter;
 bool DisabledInThisThread() { return disable_counter > 0; }
 
+// A chunk allocated in a leak checking scope. The stack trace id tells it
+// apart from a later allocation at the same address.
+struct ScopedChunk {
+  uptr chunk;
+  u32 stack_trace_id;
+};
+
+typedef InternalMmapVector<ScopedChunk> ScopedChunks;
+
+// The allocations of this thread in the current scope, or 0 outside of scopes.
+static THREADLOCAL ScopedChunks *scoped_chunks;
+
+void RecordScopedAllocation(uptr chunk) {
+  if (!scoped_chunks) return;
+  ScopedChunk c = {chunk, LsanMetadata(chunk).stack_trace_id()};
+  scoped_chunks->push_back(c);
+}
+
+// Must be called with the allocator locked.
+static bool IsLiveScopedChunk(const ScopedChunk &c) {
+  if (PointsIntoChunk(reinterpret_cast<void *>(c.chunk)) != c.chunk)
+    return false;
+  LsanMetadata m(c.chunk);
+  return m.allocated() && m.stack_trace_id() == c.stack_trace_id;
+}
+
+static bool ScopedChunkLess(const ScopedChunk &a, const ScopedChunk &b) {
+  if (a.chunk != b.chunk)
+    return a.chunk < b.chunk;
+  return a.stack_trace_id < b.stack_trace_id;
+}
+
+// A chunk which is freed and allocated again at the same place in the scope is
+// recorded more than once.
+static void RemoveDuplicates(ScopedChunks *scope) {
+  InternalSort(scope, scope->size(), ScopedChunkLess);
+  ScopedChunks unique(Max<uptr>(1, scope->size()));
+  for (uptr i = 0; i < scope->size(); i++) {
+    const ScopedChunk &c = (*scope)[i];
+    if (unique.size() && unique.back().chunk == c.chunk &&
+        unique.back().stack_trace_id == c.stack_trace_id)
+      continue;
+    unique.push_back(c);
+  }
+  scope->clear();
+  for (uptr i = 0; i < unique.size(); i++)
+    scope->push_back(unique[i]);
+}
+
 Flags lsan_flags;
 
 static void InitializeFlags() {
@@ -41,33 +93,51 @@ static void InitializeFlags() {
   f->max_leaks = 0;
   f->exitcode = 23;
   f->suppressions="";
+  f->new_leaks_only = false;
   f->use_registers = true;
   f->use_globals = true;
   f->use_stacks = true;
   f->use_tls = true;
   f->use_unaligned = false;
   f->verbosity = 0;
+  f->marking_threads = 1;
+  f->concurrent_marking = false;
+  f->skip_untouched_pages = true;
   f->log_pointers = false;
   f->log_threads = false;
+  f->heap_profile_path = "heapprof";
+  f->heap_profile_interval_ms = 0;
 
   const char *options = GetEnv("LSAN_OPTIONS");
   if (options) {
-    ParseFlag(options, &f->use_registers, "use_registers");
-    ParseFlag(options, &f->use_globals, "use_globals");
-    ParseFlag(options, &f->use_stacks, "use_stacks");
-    ParseFlag(options, &f->use_tls, "use_tls");
-    ParseFlag(options, &f->use_unaligned, "use_unaligned");
-    ParseFlag(options, &f->report_objects, "report_objects");
-    ParseFlag(options, &f->resolution, "resolution");
+    FlagParser parser;
+    parser.AddFlag(&f->use_registers, "use_registers");
+    parser.AddFlag(&f->use_globals, "use_globals");
+    parser.AddFlag(&f->use_stacks, "use_stacks");
+    parser.AddFlag(&f->use_tls, "use_tls");
+    parser.AddFlag(&f->use_unaligned, "use_unaligned");
+    parser.AddFlag(&f->report_objects, "report_objects");
+    parser.AddFlag(&f->resolution, "resolution");
+    parser.AddFlag(&f->max_leaks, "max_leaks");
+    parser.AddFlag(&f->verbosity, "verbosity");
+    parser.AddFlag(&f->marking_threads, "marking_threads");
+    parser.AddFlag(&f->concurrent_marking, "concurrent_marking");
+    parser.AddFlag(&f->skip_untouched_pages, "skip_untouched_pages");
+    parser.AddFlag(&f->log_pointers, "log_pointers");
+    parser.AddFlag(&f->log_threads, "log_threads");
+    parser.AddFlag(&f->exitcode, "exitcode");
+    parser.AddFlag(&f->suppressions, "suppressions");
+    parser.AddFlag(&f->new_leaks_only, "new_leaks_only");
+    parser.AddFlag(&f->heap_profile_path, "heap_profile_path");
+    parser.AddFlag(&f->heap_profile_interval_ms, "heap_profile_interval_ms");
+    parser.ParseString(options);
     CHECK_GE(&f->resolution, 0);
-    ParseFlag(options, &f->max_leaks, "max_leaks");
     CHECK_GE(&f->max_leaks, 0);
-    ParseFlag(options, &f->verbosity, "verbosity");
-    ParseFlag(options, &f->log_pointers, "log_pointers");
-    ParseFlag(options, &f->log_threads, "log_threads");
-    ParseFlag(options, &f->exitcode, "exitcode");
-    ParseFlag(options, &f->suppressions, "suppressions");
+    CHECK_GE(f->marking_threads, 1);
   }
+  // Pointer logging must not be interleaved.
+  if (f->log_pointers)
+    f->marking_threads = 1;
 }
 
 SuppressionContext *suppression_ctx;
@@ -94,19 +164,53 @@ void InitCommonLsan() {
   InitializeFlags();
   InitializeSuppressions();
   InitializePlatformSpecificModules();
+  InitHeapProfile();
 }
 
+// The address ranges which contain all the allocator chunks. They are set in
+// ClassifyAllChunks, while the allocator is locked. This also makes the
+// secondary allocator sort its chunks, which it would otherwise do lazily on
+// the first lookup, racing with the other markers.
+static uptr primary_begin, primary_size;
+static uptr secondary_begin, secondary_size;
+
+static void InitHeapRanges() {
+  uptr primary_end, secondary_end;
+  GetAllocatorChunkRangesLocked(&primary_begin, &primary_end,
+                                &secondary_begin, &secondary_end);
+  primary_size = primary_end - primary_begin;
+  secondary_size = secondary_end - secondary_begin;
+}
+
+// Branch-free, so that several words can be tested at once.
 static inline bool CanBeAHeapPointer(uptr p) {
-  // Since our heap is located in mmap-ed memory, we can assume a sensible lower
-  // bound on heap addresses.
-  const uptr kMinAddress = 4 * 4096;
-  if (p < kMinAddress) return false;
-#ifdef __x86_64__
-  // Accept only canonical form user-space addresses.
-  return ((p >> 47) == 0);
-#else
-  return true;
-#endif
+  return (p - primary_begin < primary_size) |
+         (p - secondary_begin < secondary_size);
+}
+
+// Reachable beats ignored beats leaked. Returns true if the tag was changed.
+// Markers may race on the same chunk, so the tag is changed atomically.
+static inline bool UpgradeTag(LsanMetadata *m, ChunkTag tag) {
+  for (;;) {
+    ChunkTag old_tag = m->tag();
+    if (old_tag == tag || old_tag == kReachable) return false;
+    if (old_tag == kIgnored && tag != kReachable) return false;
+    if (m->compare_and_set_tag(old_tag, tag)) return true;
+  }
+}
+
+static inline void ScanWord(uptr pp, Frontier *frontier, ChunkTag tag) {
+  void *p = *reinterpret_cast<void **>(pp);
+  if (!CanBeAHeapPointer(reinterpret_cast<uptr>(p))) return;
+  uptr chunk = PointsIntoChunk(p);
+  if (!chunk) return;
+  LsanMetadata m(chunk);
+  if (!UpgradeTag(&m, tag)) return;
+  if (flags()->log_pointers)
+    Report("%p: found %p pointing into chunk %p-%p of size %zu.\n", pp, p,
+           chunk, chunk + m.requested_size(), m.requested_size());
+  if (frontier)
+    frontier->push_back(chunk);
 }
 
 // Scans the memory range, looking for byte patterns that point into allocator
@@ -124,31 +228,52 @@ void ScanRangeForPointers(uptr begin, uptr end,
   uptr pp = begin;
   if (pp % alignment)
     pp = pp + alignment - pp % alignment;
-  for (; pp + sizeof(void *) <= end; pp += alignment) {  // NOLINT
-    void *p = *reinterpret_cast<void **>(pp);
-    if (!CanBeAHeapPointer(reinterpret_cast<uptr>(p))) continue;
-    uptr chunk = PointsIntoChunk(p);
-    if (!chunk) continue;
-    LsanMetadata m(chunk);
-    // Reachable beats ignored beats leaked.
-    if (m.tag() == kReachable) continue;
-    if (m.tag() == kIgnored && tag != kReachable) continue;
-    m.set_tag(tag);
-    if (flags()->log_pointers)
-      Report("%p: found %p pointing into chunk %p-%p of size %zu.\n", pp, p,
-             chunk, chunk + m.requested_size(), m.requested_size());
-    if (frontier)
-      frontier->push_back(chunk);
-  }
-}
-
-// Scans thread data (stacks and TLS) for heap pointers.
+  if (alignment == sizeof(uptr)) {
+    // Most words are not heap pointers, skip them 4 at a time.
+    const uptr kGroup = 4 * sizeof(uptr);
+    for (; pp + kGroup <= end; pp += kGroup) {
+      const uptr *w = reinterpret_cast<const uptr *>(pp);
+      if (!(CanBeAHeapPointer(w[0]) | CanBeAHeapPointer(w[1]) |
+            CanBeAHeapPointer(w[2]) | CanBeAHeapPointer(w[3])))
+        continue;
+      for (uptr i = 0; i < 4; i++)
+        ScanWord(pp + i * sizeof(uptr), frontier, tag);
+    }
+  }
+  for (; pp + sizeof(void *) <= end; pp += alignment)  // NOLINT
+    ScanWord(pp, frontier, tag);
+}
+
+// Root ranges are split into pieces of this size for parallel marking.
+static const uptr kRootRangePiece = 1 << 20;
+
+void AddRootRange(RootRanges *roots, uptr begin, uptr end,
+                  const char *region_type) {
+  if (begin >= end) return;
+  if (flags()->marking_threads == 1) {
+    RootRange range = {begin, end, region_type};
+    roots->push_back(range);
+    return;
+  }
+  // A piece also covers the pointers that start in it and cross its end.
+  for (uptr b = begin; b < end;) {
+    uptr next = RoundDownTo(b, kRootRangePiece) + kRootRangePiece;
+    RootRange range = {b, Min(end, next + sizeof(uptr) - 1), region_type};
+    roots->push_back(range);
+    b = next;
+  }
+}
+
+// Collects thread data (registers, stacks and TLS). |registers| holds
+// RegisterCount() words for each suspended thread.
 static void ProcessThreads(SuspendedThreadsList const &suspended_threads,
-                           Frontier *frontier) {
-  InternalScopedBuffer<uptr> registers(SuspendedThreadsList::RegisterCount());
-  uptr registers_begin = reinterpret_cast<uptr>(registers.data());
-  uptr registers_end = registers_begin + registers.size();
+                           uptr *registers, RootRanges *roots) {
   for (uptr i = 0; i < suspended_threads.thread_count(); i++) {
+    uptr *thread_registers =
+        registers + i * SuspendedThreadsList::RegisterCount();
+    uptr registers_begin = reinterpret_cast<uptr>(thread_registers);
+    uptr registers_end = reinterpret_cast<uptr>(
+        thread_registers + SuspendedThreadsList::RegisterCount());
     uptr os_id = static_cast<uptr>(suspended_threads.GetThreadID(i));
     if (flags()->log_threads) Report("Processing thread %d.\n", os_id);
     uptr stack_begin, stack_end, tls_begin, tls_end, cache_begin, cache_end;
@@ -164,7 +289,7 @@ static void ProcessThreads(SuspendedThreadsList const &suspended_threads,
     }
     uptr sp;
     bool have_registers =
-        (suspended_threads.GetRegistersAndSP(i, registers.data(), &sp) == 0);
+        (suspended_threads.GetRegistersAndSP(i, thread_registers, &sp) == 0);
     if (!have_registers) {
       Report("Unable to get registers from thread %d.\n");
       // If unable to get SP, consider the entire stack to be reachable.
@@ -172,8 +297,7 @@ static void ProcessThreads(SuspendedThreadsList const &suspended_threads,
     }
 
     if (flags()->use_registers && have_registers)
-      ScanRangeForPointers(registers_begin, registers_end, frontier,
-                           "REGISTERS", kReachable);
+      AddRootRange(roots, registers_begin, registers_end, "REGISTERS");
 
     if (flags()->use_stacks) {
       if (flags()->log_threads)
@@ -188,36 +312,225 @@ static void ProcessThreads(SuspendedThreadsList const &suspended_threads,
         // Shrink the stack range to ignore out-of-scope values.
         stack_begin = sp;
       }
-      ScanRangeForPointers(stack_begin, stack_end, frontier, "STACK",
-                           kReachable);
+      AddRootRange(roots, stack_begin, stack_end, "STACK");
     }
 
     if (flags()->use_tls) {
       if (flags()->log_threads) Report("TLS at %p-%p.\n", tls_begin, tls_end);
       if (cache_begin == cache_end) {
-        ScanRangeForPointers(tls_begin, tls_end, frontier, "TLS", kReachable);
+        AddRootRange(roots, tls_begin, tls_end, "TLS");
       } else {
         // Because LSan should not be loaded with dlopen(), we can assume
         // that allocator cache will be part of static TLS image.
         CHECK_LE(tls_begin, cache_begin);
         CHECK_GE(tls_end, cache_end);
         if (tls_begin < cache_begin)
-          ScanRangeForPointers(tls_begin, cache_begin, frontier, "TLS",
-                               kReachable);
+          AddRootRange(roots, tls_begin, cache_begin, "TLS");
         if (tls_end > cache_end)
-          ScanRangeForPointers(cache_end, tls_end, frontier, "TLS", kReachable);
+          AddRootRange(roots, cache_end, tls_end, "TLS");
       }
     }
   }
 }
 
+// Chunks taken from the frontier wait in a small ring before they are
+// scanned. Their metadata and first bytes are prefetched when they enter the
+// ring, so that the cache misses overlap with scanning the preceding chunks.
+struct ChunkRing {
+  static const uptr kSize = 8;
+  uptr chunks[kSize];
+  uptr head;
+  uptr count;
+
+  void Init() {
+    head = 0;
+    count = 0;
+  }
+
+  void Fill(Frontier *frontier) {
+    while (count < kSize && frontier->size()) {
+      uptr chunk = frontier->back();
+      frontier->pop_back();
+      LsanMetadata(chunk).prefetch();
+      PREFETCH(reinterpret_cast<void *>(chunk));
+      chunks[(head + count) % kSize] = chunk;
+      count++;
+    }
+  }
+
+  uptr Pop() {
+    CHECK_GT(count, 0);
+    uptr chunk = chunks[head];
+    head = (head + 1) % kSize;
+    count--;
+    return chunk;
+  }
+};
+
+static void ScanChunk(uptr chunk, Frontier *frontier, ChunkTag tag) {
+  LsanMetadata m(chunk);
+  ScanRangeForPointers(chunk, chunk + m.requested_size(), frontier, "HEAP",
+                       tag);
+}
+
 static void FloodFillTag(Frontier *frontier, ChunkTag tag) {
-  while (frontier->size()) {
-    uptr next_chunk = frontier->back();
+  ChunkRing ring;
+  ring.Init();
+  for (;;) {
+    ring.Fill(frontier);
+    if (!ring.count) break;
+    ScanChunk(ring.Pop(), frontier, tag);
+  }
+}
+
+// Parallel marking. Each marker floods the chunks found in root ranges taken
+// from a shared cursor using a private frontier. When its frontier grows
+// large, the marker moves half of it to its public queue, from which idle
+// markers steal. Marking is done when all markers are idle and there are no
+// roots or queued chunks left.
+
+static const uptr kMaxMarkingThreads = 64;
+// Frontier size above which a marker shares chunks with the others.
+static const uptr kShareThreshold = 64;
+
+struct MarkerQueue {
+  SpinMutex mutex;
+  Frontier *chunks;
+  atomic_uintptr_t size;
+};
+
+struct ParallelMarker {
+  const RootRanges *roots;
+  atomic_uintptr_t next_root;
+  ChunkTag tag;
+  uptr n_markers;
+  MarkerQueue queues[kMaxMarkingThreads];
+  atomic_uintptr_t n_active;
+};
+
+static bool HasWork(ParallelMarker *pm) {
+  if (atomic_load(&pm->next_root, memory_order_relaxed) < pm->roots->size())
+    return true;
+  for (uptr i = 0; i < pm->n_markers; i++)
+    if (atomic_load(&pm->queues[i].size, memory_order_acquire))
+      return true;
+  return false;
+}
+
+// Moves up to |max| chunks from |q| to |frontier|.
+static uptr MoveChunks(MarkerQueue *q, Frontier *frontier, uptr max) {
+  SpinMutexLock l(&q->mutex);
+  uptr n = Min(max, q->chunks->size());
+  for (uptr i = 0; i < n; i++) {
+    frontier->push_back(q->chunks->back());
+    q->chunks->pop_back();
+  }
+  atomic_store(&q->size, q->chunks->size(), memory_order_release);
+  return n;
+}
+
+static void ShareChunks(ParallelMarker *pm, uptr index, Frontier *frontier) {
+  MarkerQueue *q = &pm->queues[index];
+  if (atomic_load(&q->size, memory_order_relaxed))
+    return;
+  SpinMutexLock l(&q->mutex);
+  for (uptr n = frontier->size() / 2; n > 0; n--) {
+    q->chunks->push_back(frontier->back());
     frontier->pop_back();
-    LsanMetadata m(next_chunk);
-    ScanRangeForPointers(next_chunk, next_chunk + m.requested_size(), frontier,
-                         "HEAP", tag);
+  }
+  atomic_store(&q->size, q->chunks->size(), memory_order_release);
+}
+
+// Takes chunks from the own queue or steals half of another queue.
+static bool TakeChunks(ParallelMarker *pm, uptr index, Frontier *frontier) {
+  for (uptr i = 0; i < pm->n_markers; i++) {
+    MarkerQueue *q = &pm->queues[(index + i) % pm->n_markers];
+    uptr size = atomic_load(&q->size, memory_order_acquire);
+    if (!size) continue;
+    if (MoveChunks(q, frontier, i == 0 ? size : (size + 1) / 2))
+      return true;
+  }
+  return false;
+}
+
+static void RunMarker(void *arg, uptr index) {
+  ParallelMarker *pm = reinterpret_cast<ParallelMarker *>(arg);
+  Frontier frontier(GetPageSizeCached());
+  ChunkRing ring;
+  ring.Init();
+  atomic_fetch_add(&pm->n_active, 1, memory_order_seq_cst);
+  for (;;) {
+    for (;;) {
+      ring.Fill(&frontier);
+      if (ring.count) {
+        ScanChunk(ring.Pop(), &frontier, pm->tag);
+        if (frontier.size() > kShareThreshold)
+          ShareChunks(pm, index, &frontier);
+        continue;
+      }
+      uptr i = atomic_fetch_add(&pm->next_root, 1, memory_order_relaxed);
+      if (i < pm->roots->size()) {
+        const RootRange &range = (*pm->roots)[i];
+        ScanRangeForPointers(range.begin, range.end, &frontier,
+                             range.region_type, pm->tag);
+        continue;
+      }
+      if (!TakeChunks(pm, index, &frontier))
+        break;
+    }
+    atomic_fetch_sub(&pm->n_active, 1, memory_order_seq_cst);
+    for (;;) {
+      if (HasWork(pm)) {
+        atomic_fetch_add(&pm->n_active, 1, memory_order_seq_cst);
+        if (TakeChunks(pm, index, &frontier) ||
+            atomic_load(&pm->next_root, memory_order_relaxed) <
+                pm->roots->size())
+          break;
+        atomic_fetch_sub(&pm->n_active, 1, memory_order_seq_cst);
+      } else if (atomic_load(&pm->n_active, memory_order_seq_cst) == 0) {
+        return;
+      }
+      internal_sched_yield();
+    }
+  }
+}
+
+// Scans |roots| and floods the chunks found there and in |frontier| with
+// |tag|. Empties |frontier|.
+static void MarkChunks(const RootRanges &roots, Frontier *frontier,
+                       ChunkTag tag) {
+  uptr n_markers = Min<uptr>(flags()->marking_threads, kMaxMarkingThreads);
+  if (n_markers == 1) {
+    for (uptr i = 0; i < roots.size(); i++)
+      ScanRangeForPointers(roots[i].begin, roots[i].end, frontier,
+                           roots[i].region_type, tag);
+    FloodFillTag(frontier, tag);
+    return;
+  }
+  ParallelMarker pm;
+  pm.roots = &roots;
+  atomic_store(&pm.next_root, 0, memory_order_relaxed);
+  pm.tag = tag;
+  pm.n_markers = n_markers;
+  atomic_store(&pm.n_active, 0, memory_order_relaxed);
+  InternalScopedBuffer<char> queue_storage(n_markers * sizeof(Frontier));
+  Frontier *queue_chunks = reinterpret_cast<Frontier *>(queue_storage.data());
+  for (uptr i = 0; i < n_markers; i++) {
+    MarkerQueue *q = &pm.queues[i];
+    q->mutex.Init();
+    q->chunks = new(&queue_chunks[i]) Frontier(GetPageSizeCached());
+  }
+  for (uptr i = 0; i < frontier->size(); i++)
+    pm.queues[i % n_markers].chunks->push_back((*frontier)[i]);
+  frontier->clear();
+  for (uptr i = 0; i < n_markers; i++) {
+    MarkerQueue *q = &pm.queues[i];
+    atomic_store(&q->size, q->chunks->size(), memory_order_relaxed);
+  }
+  RunTracerHelpers(RunMarker, &pm, n_markers);
+  for (uptr i = 0; i < n_markers; i++) {
+    CHECK_EQ(0, pm.queues[i].chunks->size());
+    pm.queues[i].chunks->~Frontier();
   }
 }
 
@@ -242,26 +555,38 @@ static void CollectIgnoredCb(uptr chunk, void *arg) {
     reinterpret_cast<Frontier *>(arg)->push_back(chunk);
 }
 
+// ForEachChunk callback. Clears the tags left by a previous leak check.
+static void ResetTagsCb(uptr chunk, void *arg) {
+  chunk = GetUserBegin(chunk);
+  LsanMetadata m(chunk);
+  if (m.allocated() && m.tag() != kIgnored)
+    m.set_tag(kDirectlyLeaked);
+}
+
 // Sets the appropriate tag on each chunk.
-static void ClassifyAllChunks(SuspendedThreadsList const &suspended_threads) {
+static void ClassifyAllChunks(const RootRanges &roots) {
+  // Set if the tags were changed in this process by a previous leak check.
+  static bool tags_used;
+  if (tags_used)
+    ForEachChunk(ResetTagsCb, 0 /* arg */);
+  tags_used = true;
+  InitHeapRanges();
   // Holds the flood fill frontier.
   Frontier frontier(GetPageSizeCached());
+  RootRanges no_roots(1);
 
-  if (flags()->use_globals)
-    ProcessGlobalRegions(&frontier);
-  ProcessThreads(suspended_threads, &frontier);
-  FloodFillTag(&frontier, kReachable);
+  MarkChunks(roots, &frontier, kReachable);
   // The check here is relatively expensive, so we do this in a separate flood
   // fill. That way we can skip the check for chunks that are reachable
   // otherwise.
   ProcessPlatformSpecificAllocations(&frontier);
-  FloodFillTag(&frontier, kReachable);
+  MarkChunks(no_roots, &frontier, kReachable);
 
   if (flags()->log_pointers)
     Report("Scanning ignored chunks.\n");
   CHECK_EQ(0, frontier.size());
   ForEachChunk(CollectIgnoredCb, &frontier);
-  FloodFillTag(&frontier, kIgnored);
+  MarkChunks(no_roots, &frontier, kIgnored);
 
   // Iterate over leaked chunks and mark those that are reachable from other
   // leaked chunks.
@@ -271,36 +596,56 @@ static void ClassifyAllChunks(SuspendedThreadsList const &suspended_threads) {
 }
 
 static void PrintStackTraceById(u32 stack_trace_id) {
-  CHECK(stack_trace_id);
+  if (stack_trace_id == 0) {
+    // E.g. the allocations that ASan did not sample (see sample_allocations).
+    Printf("    <allocation stack not recorded>\n");
+    return;
+  }
   uptr size = 0;
   const uptr *trace = StackDepotGet(stack_trace_id, &size);
   StackTrace::PrintStack(trace, size, common_flags()->symbolize,
                          common_flags()->strip_path_prefix, 0);
 }
 
+static void AddLeak(LeakReport *leak_report, u32 stack_trace_id,
+                    uptr leaked_size, ChunkTag tag, uptr hit_count) {
+  uptr resolution = flags()->resolution;
+  if (resolution > 0) {
+    uptr size = 0;
+    const uptr *trace = StackDepotGet(stack_trace_id, &size);
+    size = Min(size, resolution);
+    stack_trace_id = StackDepotPut(trace, size);
+  }
+  leak_report->Add(stack_trace_id, leaked_size, tag, hit_count);
+}
+
+// Adds the user chunk to the LeakReport if it is unreachable.
+static void CollectLeak(uptr chunk, LeakReport *leak_report) {
+  LsanMetadata m(chunk);
+  if (!m.allocated()) return;
+  if (m.tag() == kDirectlyLeaked || m.tag() == kIndirectlyLeaked)
+    AddLeak(leak_report, m.stack_trace_id(), m.requested_size(), m.tag(), 1);
+}
+
 // ForEachChunk callback. Aggregates unreachable chunks into a LeakReport.
 static void CollectLeaksCb(uptr chunk, void *arg) {
   CHECK(arg);
-  LeakReport *leak_report = reinterpret_cast<LeakReport *>(arg);
-  chunk = GetUserBegin(chunk);
-  LsanMetadata m(chunk);
-  if (!m.allocated()) return;
-  if (m.tag() == kDirectlyLeaked || m.tag() == kIndirectlyLeaked) {
-    uptr resolution = flags()->resolution;
-    if (resolution > 0) {
-      uptr size = 0;
-      const uptr *trace = StackDepotGet(m.stack_trace_id(), &size);
-      size = Min(size, resolution);
-      leak_report->Add(StackDepotPut(trace, size), m.requested_size(), m.tag());
-    } else {
-      leak_report->Add(m.stack_trace_id(), m.requested_size(), m.tag());
-    }
+  CollectLeak(GetUserBegin(chunk), reinterpret_cast<LeakReport *>(arg));
+}
+
+// Aggregates the unreachable chunks, only those in |scope| if it is not 0.
+static void CollectLeaks(LeakReport *leak_report, const ScopedChunks *scope) {
+  if (!scope) {
+    ForEachChunk(CollectLeaksCb, leak_report);
+    return;
   }
+  for (uptr i = 0; i < scope->size(); i++)
+    if (IsLiveScopedChunk((*scope)[i]))
+      CollectLeak((*scope)[i].chunk, leak_report);
 }
 
-// ForEachChunkCallback. Prints addresses of unreachable chunks.
-static void PrintLeakedCb(uptr chunk, void *arg) {
-  chunk = GetUserBegin(chunk);
+// Prints the address of the user chunk if it is unreachable.
+static void PrintLeakedChunk(uptr chunk) {
   LsanMetadata m(chunk);
   if (!m.allocated()) return;
   if (m.tag() == kDirectlyLeaked || m.tag() == kIndirectlyLeaked) {
@@ -310,6 +655,11 @@ static void PrintLeakedCb(uptr chunk, void *arg) {
   }
 }
 
+// ForEachChunkCallback. Prints addresses of unreachable chunks.
+static void PrintLeakedCb(uptr chunk, void *arg) {
+  PrintLeakedChunk(GetUserBegin(chunk));
+}
+
 static void PrintMatchedSuppressions() {
   InternalMmapVector<Suppression *> matched(1);
   suppression_ctx->GetMatched(&matched);
@@ -325,15 +675,81 @@ static void PrintMatchedSuppressions() {
   Printf("%s\n\n", line);
 }
 
-static void PrintLeaked() {
+static void PrintLeaked(const ScopedChunks *scope) {
   Printf("\n");
   Printf("Reporting individual objects:\n");
-  ForEachChunk(PrintLeakedCb, 0 /* arg */);
+  if (!scope) {
+    ForEachChunk(PrintLeakedCb, 0 /* arg */);
+    return;
+  }
+  for (uptr i = 0; i < scope->size(); i++)
+    if (IsLiveScopedChunk((*scope)[i]))
+      PrintLeakedChunk((*scope)[i].chunk);
+}
+
+// Concurrent marking. The threads are stopped only to collect the roots and
+// to fork a copy of the process. The copy classifies the chunks in its
+// snapshot of the heap, prints the objects if requested and writes the Leak
+// records, terminated by one with zero hit_count, to a pipe. The stack ids it
+// adds to the depot are not seen in this process, so the resolution is
+// applied here.
+
+struct SnapshotParam {
+  const RootRanges *roots;
+  const ScopedChunks *scope;
+};
+
+static void ClassifyInSnapshot(void *arg, fd_t fd) {
+  const SnapshotParam *param = reinterpret_cast<const SnapshotParam *>(arg);
+  flags()->resolution = 0;
+  ClassifyAllChunks(*param->roots);
+  LeakReport leak_report;
+  CollectLeaks(&leak_report, param->scope);
+  if (!leak_report.IsEmpty() && flags()->report_objects)
+    PrintLeaked(param->scope);
+  Leak end = {};
+  for (uptr i = 0; i <= leak_report.leaks().size(); i++) {
+    const Leak *leak = i < leak_report.leaks().size() ? &leak_report.leaks()[i]
+                                                      : &end;
+    uptr res = internal_write(fd, leak, sizeof(*leak));
+    if (internal_iserror(res) || res != sizeof(*leak))
+      return;
+  }
+}
+
+static bool ReadFully(fd_t fd, void *buf, uptr size) {
+  char *p = reinterpret_cast<char *>(buf);
+  while (size) {
+    uptr res = internal_read(fd, p, size);
+    if (internal_iserror(res) || res == 0)
+      return false;
+    p += res;
+    size -= res;
+  }
+  return true;
+}
+
+// Returns false if the snapshot process did not complete.
+static bool ReadSnapshotLeaks(fd_t fd, LeakReport *leak_report) {
+  for (;;) {
+    Leak leak;
+    if (!ReadFully(fd, &leak, sizeof(leak)))
+      return false;
+    if (!leak.hit_count)
+      return true;
+    AddLeak(leak_report, leak.stack_trace_id, leak.total_size,
+            leak.is_directly_leaked ? kDirectlyLeaked : kIndirectlyLeaked,
+            leak.hit_count);
+  }
 }
 
 struct DoLeakCheckParam {
   bool success;
+  // If not 0, only these chunks are reported.
+  const ScopedChunks *scope;
   LeakReport leak_report;
+  // The read end of the pipe from the snapshot process.
+  fd_t snapshot_fd;
 };
 
 static void DoLeakCheckCallback(const SuspendedThreadsList &suspended_threads,
@@ -342,50 +758,138 @@ static void DoLeakCheckCallback(const SuspendedThreadsList &suspended_threads,
   CHECK(param);
   CHECK(!param->success);
   CHECK(param->leak_report.IsEmpty());
-  ClassifyAllChunks(suspended_threads);
-  ForEachChunk(CollectLeaksCb, &param->leak_report);
+  RootRanges roots(GetPageSizeCached());
+  InternalScopedBuffer<uptr> registers(
+      Max<uptr>(1, suspended_threads.thread_count()) *
+      SuspendedThreadsList::RegisterCount());
+  if (flags()->use_globals)
+    ProcessGlobalRegions(&roots);
+  ProcessThreads(suspended_threads, registers.data(), &roots);
+  if (flags()->skip_untouched_pages)
+    FilterUntouchedPages(&roots);
+  if (flags()->concurrent_marking) {
+    SnapshotParam snapshot_param = {&roots, param->scope};
+    param->snapshot_fd = RunInForkedCopy(ClassifyInSnapshot, &snapshot_param);
+    if (param->snapshot_fd == kInvalidFd)
+      Report("LeakSanitizer: failed to fork a snapshot of the process.\n");
+    else
+      param->success = true;
+    return;
+  }
+  ClassifyAllChunks(roots);
+  CollectLeaks(&param->leak_report, param->scope);
   if (!param->leak_report.IsEmpty() && flags()->report_objects)
-    PrintLeaked();
+    PrintLeaked(param->scope);
   param->success = true;
 }
 
-void DoLeakCheck() {
-  EnsureMainThreadIDIsCorrect();
-  BlockingMutexLock l(&global_mutex);
-  static bool already_done;
-  if (already_done) return;
-  already_done = true;
-  if (&__lsan_is_turned_off && __lsan_is_turned_off())
-    return;
+// With new_leaks_only, the leaks found by the earlier checks, with the most
+// objects seen so far and whether they are suppressed.
+static LeakReport *known_leaks;
+
+static LeakReport *GetKnownLeaks() {
+  if (!known_leaks) {
+    ALIGNED(64) static char placeholder[sizeof(LeakReport)];
+    known_leaks = new(placeholder) LeakReport;
+  }
+  return known_leaks;
+}
 
+// Returns true if there are unsuppressed leaks, reported by this check or
+// by an earlier one.
+static bool CheckForLeaks(const ScopedChunks *scope) {
+  ScopedTiming timing(kTimingLeakCheck);
   DoLeakCheckParam param;
   param.success = false;
+  param.scope = scope;
+  param.snapshot_fd = kInvalidFd;
   LockThreadRegistry();
   LockAllocator();
   StopTheWorld(DoLeakCheckCallback, &param);
   UnlockAllocator();
   UnlockThreadRegistry();
 
+  if (param.snapshot_fd != kInvalidFd) {
+    param.success = ReadSnapshotLeaks(param.snapshot_fd, &param.leak_report);
+    internal_close(param.snapshot_fd);
+  }
   if (!param.success) {
     Report("LeakSanitizer has encountered a fatal error.\n");
     Die();
   }
-  uptr have_unsuppressed = param.leak_report.ApplySuppressions();
-  if (have_unsuppressed) {
+  // A scoped check reports all of its leaks and does not hide them from the
+  // later checks.
+  LeakReport *known = flags()->new_leaks_only && !scope ? GetKnownLeaks() : 0;
+  uptr have_unsuppressed = param.leak_report.ApplySuppressions(known);
+  uptr have_new = have_unsuppressed;
+  if (known)
+    have_new = param.leak_report.UpdateKnownLeaks(known);
+  if (have_new) {
     Printf("\n"
            "================================================================="
            "\n");
     Report("ERROR: LeakSanitizer: detected memory leaks\n");
     param.leak_report.PrintLargest(flags()->max_leaks);
   }
-  if (have_unsuppressed || (flags()->verbosity >= 1)) {
+  if (have_new || (flags()->verbosity >= 1)) {
     PrintMatchedSuppressions();
     param.leak_report.PrintSummary();
   }
-  if (have_unsuppressed && flags()->exitcode)
+  return have_unsuppressed;
+}
+
+void DoLeakCheck() {
+  EnsureMainThreadIDIsCorrect();
+  BlockingMutexLock l(&global_mutex);
+  static bool already_done;
+  if (already_done && !flags()->new_leaks_only) return;
+  already_done = true;
+  if (&__lsan_is_turned_off && __lsan_is_turned_off())
+    return;
+
+  bool have_leaks = CheckForLeaks(0);
+  if (have_leaks && flags()->exitcode)
     internal__exit(flags()->exitcode);
 }
 
+int DoRecoverableLeakCheck() {
+  EnsureMainThreadIDIsCorrect();
+  BlockingMutexLock l(&global_mutex);
+  if (&__lsan_is_turned_off && __lsan_is_turned_off())
+    return 0;
+  return CheckForLeaks(0);
+}
+
+static void BeginScope() {
+  if (scoped_chunks) {
+    Report("Nested call to __lsan_begin_scope().\n");
+    Die();
+  }
+  void *mem = MmapOrDie(sizeof(ScopedChunks), "ScopedChunks");
+  scoped_chunks = new(mem) ScopedChunks(GetPageSizeCached() /
+                                        sizeof(ScopedChunk));
+}
+
+static int EndScopeCheck() {
+  if (!scoped_chunks) {
+    Report("Unmatched call to __lsan_end_scope_check().\n");
+    Die();
+  }
+  ScopedChunks *scope = scoped_chunks;
+  scoped_chunks = 0;
+  int have_leaks = 0;
+  if (common_flags()->detect_leaks &&
+      !(&__lsan_is_turned_off && __lsan_is_turned_off())) {
+    EnsureMainThreadIDIsCorrect();
+    RemoveDuplicates(scope);
+    BlockingMutexLock l(&global_mutex);
+    have_leaks = CheckForLeaks(scope);
+  }
+  scope->~ScopedChunks();
+  UnmapOrDie(scope, sizeof(ScopedChunks));
+  return have_leaks;
+}
+
 static Suppression *GetSuppressionForAddr(uptr addr) {
   static const uptr kMaxAddrFrames = 16;
   InternalScopedBuffer<AddressInfo> addr_frames(kMaxAddrFrames);
@@ -402,40 +906,96 @@ static Suppression *GetSuppressionForAddr(uptr addr) {
   return 0;
 }
 
-static Suppression *GetSuppressionForStack(u32 stack_trace_id) {
+// Remembers the suppressions found for the recently looked up pcs. Leaked
+// stacks tend to share most of their frames.
+struct SuppressionCache {
+  static const uptr kSize = 4096;
+  uptr pcs[kSize];
+  Suppression *suppressions[kSize];
+};
+
+static Suppression *GetSuppressionForStack(u32 stack_trace_id,
+                                           SuppressionCache *cache) {
   uptr size = 0;
   const uptr *trace = StackDepotGet(stack_trace_id, &size);
   for (uptr i = 0; i < size; i++) {
-    Suppression *s =
-        GetSuppressionForAddr(StackTrace::GetPreviousInstructionPc(trace[i]));
-    if (s) return s;
+    uptr pc = StackTrace::GetPreviousInstructionPc(trace[i]);
+    uptr idx = (pc * 2654435761U) % SuppressionCache::kSize;
+    if (cache->pcs[idx] != pc) {
+      cache->pcs[idx] = pc;
+      cache->suppressions[idx] = GetSuppressionForAddr(pc);
+    }
+    if (cache->suppressions[idx]) return cache->suppressions[idx];
   }
   return 0;
 }
 
 ///// LeakReport implementation. /////
 
-// A hard limit on the number of distinct leaks, to avoid quadratic complexity
-// in LeakReport::Add(). We don't expect to ever see this many leaks in
-// real-world applications.
-// FIXME: Get rid of this limit by changing the implementation of LeakReport to
-// use a hash table.
-const uptr kMaxLeaksConsidered = 5000;
+static uptr LeakHash(u32 stack_trace_id, bool is_directly_leaked) {
+  u64 key = (static_cast<u64>(stack_trace_id) << 1) | is_directly_leaked;
+  return static_cast<uptr>((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+LeakReport::~LeakReport() {
+  if (index_)
+    UnmapOrDie(index_, index_size_ * sizeof(index_[0]));
+}
+
+// Keeps the index at most half full.
+void LeakReport::GrowIndex() {
+  if (index_)
+    UnmapOrDie(index_, index_size_ * sizeof(index_[0]));
+  index_size_ = index_size_ ? index_size_ * 2
+                            : GetPageSizeCached() / sizeof(index_[0]);
+  index_ = reinterpret_cast<u32 *>(
+      MmapOrDie(index_size_ * sizeof(index_[0]), "LeakReport"));
+  for (uptr i = 0; i < leaks_.size(); i++) {
+    uptr h = LeakHash(leaks_[i].stack_trace_id, leaks_[i].is_directly_leaked);
+    while (index_[h & (index_size_ - 1)]) h++;
+    index_[h & (index_size_ - 1)] = i + 1;
+  }
+}
+
+Leak *LeakReport::Find(u32 stack_trace_id, bool is_directly_leaked) {
+  if (!index_)
+    return 0;
+  for (uptr h = LeakHash(stack_trace_id, is_directly_leaked);; h++) {
+    u32 slot = index_[h & (index_size_ - 1)];
+    if (!slot)
+      return 0;
+    Leak *leak = &leaks_[slot - 1];
+    if (leak->stack_trace_id == stack_trace_id &&
+        leak->is_directly_leaked == is_directly_leaked)
+      return leak;
+  }
+}
 
-void LeakReport::Add(u32 stack_trace_id, uptr leaked_size, ChunkTag tag) {
+void LeakReport::Add(u32 stack_trace_id, uptr leaked_size, ChunkTag tag,
+                     uptr hit_count) {
   CHECK(tag == kDirectlyLeaked || tag == kIndirectlyLeaked);
   bool is_directly_leaked = (tag == kDirectlyLeaked);
-  for (uptr i = 0; i < leaks_.size(); i++)
-    if (leaks_[i].stack_trace_id == stack_trace_id &&
-        leaks_[i].is_directly_leaked == is_directly_leaked) {
-      leaks_[i].hit_count++;
-      leaks_[i].total_size += leaked_size;
+  if (2 * (leaks_.size() + 1) > index_size_)
+    GrowIndex();
+  uptr h = LeakHash(stack_trace_id, is_directly_leaked);
+  for (;; h++) {
+    u32 *slot = &index_[h & (index_size_ - 1)];
+    if (!*slot) {
+      Leak leak = { hit_count, leaked_size, stack_trace_id,
+                    is_directly_leaked, /* is_suppressed */ false,
+                    /* is_reported */ false };
+      leaks_.push_back(leak);
+      *slot = leaks_.size();
+      return;
+    }
+    Leak *leak = &leaks_[*slot - 1];
+    if (leak->stack_trace_id == stack_trace_id &&
+        leak->is_directly_leaked == is_directly_leaked) {
+      leak->hit_count += hit_count;
+      leak->total_size += leaked_size;
       return;
     }
-  if (leaks_.size() == kMaxLeaksConsidered) return;
-  Leak leak = { /* hit_count */ 1, leaked_size, stack_trace_id,
-                is_directly_leaked, /* is_suppressed */ false };
-  leaks_.push_back(leak);
+  }
 }
 
 static bool LeakComparator(const Leak &leak1, const Leak &leak2) {
@@ -445,39 +1005,71 @@ static bool LeakComparator(const Leak &leak1, const Leak &leak2) {
     return leak1.is_directly_leaked;
 }
 
+// The largest leaks are selected in a heap ordered like in InternalSort, so
+// that its top is the smallest of them.
+static void SiftLeakUp(InternalMmapVector<Leak> *heap, uptr j) {
+  for (uptr p; j > 0; j = p) {
+    p = (j - 1) / 2;
+    if (!LeakComparator((*heap)[p], (*heap)[j]))
+      break;
+    Swap((*heap)[j], (*heap)[p]);
+  }
+}
+
+static void SiftLeakDown(InternalMmapVector<Leak> *heap, uptr j) {
+  for (;;) {
+    uptr left = 2 * j + 1;
+    uptr right = 2 * j + 2;
+    uptr max_ind = j;
+    if (left < heap->size() && LeakComparator((*heap)[max_ind], (*heap)[left]))
+      max_ind = left;
+    if (right < heap->size() &&
+        LeakComparator((*heap)[max_ind], (*heap)[right]))
+      max_ind = right;
+    if (max_ind == j)
+      break;
+    Swap((*heap)[j], (*heap)[max_ind]);
+    j = max_ind;
+  }
+}
+
 void LeakReport::PrintLargest(uptr num_leaks_to_print) {
-  CHECK(leaks_.size() <= kMaxLeaksConsidered);
   Printf("\n");
-  if (leaks_.size() == kMaxLeaksConsidered)
-    Printf("Too many leaks! Only the first %zu leaks encountered will be "
-           "reported.\n",
-           kMaxLeaksConsidered);
-
   uptr unsuppressed_count = 0;
   for (uptr i = 0; i < leaks_.size(); i++)
-    if (!leaks_[i].is_suppressed) unsuppressed_count++;
+    if (!leaks_[i].is_suppressed && !leaks_[i].is_reported)
+      unsuppressed_count++;
   if (num_leaks_to_print > 0 && num_leaks_to_print < unsuppressed_count)
     Printf("The %zu largest leak(s):\n", num_leaks_to_print);
-  InternalSort(&leaks_, leaks_.size(), LeakComparator);
-  uptr leaks_printed = 0;
-  for (uptr i = 0; i < leaks_.size(); i++) {
-    if (leaks_[i].is_suppressed) continue;
+  uptr max_printed = unsuppressed_count;
+  if (num_leaks_to_print > 0)
+    max_printed = Min(max_printed, num_leaks_to_print);
+  InternalMmapVector<Leak> largest(Max<uptr>(1, max_printed));
+  for (uptr i = 0; i < leaks_.size() && max_printed; i++) {
+    if (leaks_[i].is_suppressed || leaks_[i].is_reported) continue;
+    if (largest.size() < max_printed) {
+      largest.push_back(leaks_[i]);
+      SiftLeakUp(&largest, largest.size() - 1);
+    } else if (LeakComparator(leaks_[i], largest[0])) {
+      largest[0] = leaks_[i];
+      SiftLeakDown(&largest, 0);
+    }
+  }
+  InternalSort(&largest, largest.size(), LeakComparator);
+  for (uptr i = 0; i < largest.size(); i++) {
     Printf("%s leak of %zu byte(s) in %zu object(s) allocated from:\n",
-           leaks_[i].is_directly_leaked ? "Direct" : "Indirect",
-           leaks_[i].total_size, leaks_[i].hit_count);
-    PrintStackTraceById(leaks_[i].stack_trace_id);
+           largest[i].is_directly_leaked ? "Direct" : "Indirect",
+           largest[i].total_size, largest[i].hit_count);
+    PrintStackTraceById(largest[i].stack_trace_id);
     Printf("\n");
-    leaks_printed++;
-    if (leaks_printed == num_leaks_to_print) break;
   }
-  if (leaks_printed < unsuppressed_count) {
-    uptr remaining = unsuppressed_count - leaks_printed;
+  if (largest.size() < unsuppressed_count) {
+    uptr remaining = unsuppressed_count - largest.size();
     Printf("Omitting %zu more leak(s).\n", remaining);
   }
 }
 
 void LeakReport::PrintSummary() {
-  CHECK(leaks_.size() <= kMaxLeaksConsidered);
   uptr bytes = 0, allocations = 0;
   for (uptr i = 0; i < leaks_.size(); i++) {
       if (leaks_[i].is_suppressed) continue;
@@ -492,10 +1084,23 @@ void LeakReport::PrintSummary() {
   __sanitizer_report_error_summary(summary.data());
 }
 
-uptr LeakReport::ApplySuppressions() {
+uptr LeakReport::ApplySuppressions(LeakReport *known) {
+  if (!suppression_ctx->SuppressionCount())
+    return leaks_.size();
+  InternalScopedBuffer<SuppressionCache> cache(1);
+  internal_memset(cache.data(), 0, sizeof(SuppressionCache));
   uptr unsuppressed_count = 0;
   for (uptr i = 0; i < leaks_.size(); i++) {
-    Suppression *s = GetSuppressionForStack(leaks_[i].stack_trace_id);
+    Leak *k = known ? known->Find(leaks_[i].stack_trace_id,
+                                  leaks_[i].is_directly_leaked) : 0;
+    if (k) {
+      leaks_[i].is_suppressed = k->is_suppressed;
+      if (!k->is_suppressed)
+        unsuppressed_count++;
+      continue;
+    }
+    Suppression *s = GetSuppressionForStack(leaks_[i].stack_trace_id,
+                                            cache.data());
     if (s) {
       s->weight += leaks_[i].total_size;
       s->hit_count += leaks_[i].hit_count;
@@ -506,6 +1111,30 @@ uptr LeakReport::ApplySuppressions() {
   }
   return unsuppressed_count;
 }
+
+uptr LeakReport::UpdateKnownLeaks(LeakReport *known) {
+  uptr new_count = 0;
+  for (uptr i = 0; i < leaks_.size(); i++) {
+    Leak *leak = &leaks_[i];
+    Leak *k = known->Find(leak->stack_trace_id, leak->is_directly_leaked);
+    if (!k) {
+      known->Add(leak->stack_trace_id, leak->total_size,
+                 leak->is_directly_leaked ? kDirectlyLeaked
+                                          : kIndirectlyLeaked,
+                 leak->hit_count);
+      k = known->Find(leak->stack_trace_id, leak->is_directly_leaked);
+      k->is_suppressed = leak->is_suppressed;
+    } else if (leak->hit_count <= k->hit_count) {
+      leak->is_reported = true;
+    } else {
+      k->hit_count = leak->hit_count;
+      k->total_size = leak->total_size;
+    }
+    if (!leak->is_suppressed && !leak->is_reported)
+      new_count++;
+  }
+  return new_count;
+}
 }  // namespace __lsan
 #endif  // CAN_SANITIZE_LEAKS
 
@@ -555,6 +1184,30 @@ void __lsan_do_leak_check() {
 #endif  // CAN_SANITIZE_LEAKS
 }
 
+SANITIZER_INTERFACE_ATTRIBUTE
+int __lsan_do_recoverable_leak_check() {
+#if CAN_SANITIZE_LEAKS
+  if (common_flags()->detect_leaks)
+    return __lsan::DoRecoverableLeakCheck();
+#endif  // CAN_SANITIZE_LEAKS
+  return 0;
+}
+
+SANITIZER_INTERFACE_ATTRIBUTE
+void __lsan_begin_scope() {
+#if CAN_SANITIZE_LEAKS
+  __lsan::BeginScope();
+#endif  // CAN_SANITIZE_LEAKS
+}
+
+SANITIZER_INTERFACE_ATTRIBUTE
+int __lsan_end_scope_check() {
+#if CAN_SANITIZE_LEAKS
+  return __lsan::EndScopeCheck();
+#endif  // CAN_SANITIZE_LEAKS
+  return 0;
+}
+
 #if !SANITIZER_SUPPORTS_WEAK_HOOKS
 SANITIZER_WEAK_ATTRIBUTE SANITIZER_INTERFACE_ATTRIBUTE
 int __lsan_is_turned_off() {
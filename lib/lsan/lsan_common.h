@@ -53,6 +53,10 @@ struct Flags {
   int exitcode;
   // Suppressions file name.
   const char* suppressions;
+  // Report only the leaks which are new or have more objects than when an
+  // earlier check reported them. The leaks found before are not matched
+  // against the suppressions again. Allows repeated __lsan_do_leak_check().
+  bool new_leaks_only;
 
   // Flags controlling the root set of reachable memory.
   // Global variables (.data and .bss).
@@ -70,9 +74,25 @@ struct Flags {
   // User-visible verbosity.
   int verbosity;
 
+  // Number of threads that mark reachable chunks (1 - mark on the
+  // StopTheWorld tracer thread only).
+  int marking_threads;
+  // Mark chunks in a forked copy of the process, so that the threads are
+  // stopped only while the roots are collected.
+  bool concurrent_marking;
+  // Don't scan the pages of the root regions which were never written by the
+  // process (e.g. the untouched parts of large .bss arrays).
+  bool skip_untouched_pages;
+
   // Debug logging.
   bool log_pointers;
   bool log_threads;
+
+  // Heap profiles written by __sanitizer_dump_heap_profile() go to
+  // <heap_profile_path>.<pid>.<n>.heap.
+  const char *heap_profile_path;
+  // If positive, a heap profile is also written every that many ms.
+  int heap_profile_interval_ms;
 };
 
 extern Flags lsan_flags;
@@ -84,27 +104,62 @@ struct Leak {
   u32 stack_trace_id;
   bool is_directly_leaked;
   bool is_suppressed;
+  // An earlier check reported the leak with at least as many objects.
+  bool is_reported;
 };
 
 // Aggregates leaks by stack trace prefix.
 class LeakReport {
  public:
-  LeakReport() : leaks_(1) {}
-  void Add(u32 stack_trace_id, uptr leaked_size, ChunkTag tag);
+  LeakReport() : leaks_(1), index_(0), index_size_(0) {}
+  ~LeakReport();
+  void Add(u32 stack_trace_id, uptr leaked_size, ChunkTag tag,
+           uptr hit_count);
   void PrintLargest(uptr max_leaks);
   void PrintSummary();
   bool IsEmpty() { return leaks_.size() == 0; }
-  uptr ApplySuppressions();
+  // Takes the suppression of the leaks in |known| from there. Returns the
+  // number of unsuppressed leaks.
+  uptr ApplySuppressions(LeakReport *known);
+  // Marks the leaks which |known| already has with as many objects and adds
+  // the others to it. Returns the number of unsuppressed leaks not marked.
+  uptr UpdateKnownLeaks(LeakReport *known);
+  const InternalMmapVector<Leak> &leaks() const { return leaks_; }
  private:
+  void GrowIndex();
+  Leak *Find(u32 stack_trace_id, bool is_directly_leaked);
   InternalMmapVector<Leak> leaks_;
+  // Open addressing hash table of positions in leaks_ plus one, keyed by the
+  // stack trace id and the leak kind. 0 marks an empty slot.
+  u32 *index_;
+  uptr index_size_;
 };
 
 typedef InternalMmapVector<uptr> Frontier;
 
+// A range of memory that is scanned for pointers to reachable chunks.
+struct RootRange {
+  uptr begin;
+  uptr end;
+  const char *region_type;
+};
+
+typedef InternalMmapVector<RootRange> RootRanges;
+
+void AddRootRange(RootRanges *roots, uptr begin, uptr end,
+                  const char *region_type);
+
 // Platform-specific functions.
 void InitializePlatformSpecificModules();
-void ProcessGlobalRegions(Frontier *frontier);
+void ProcessGlobalRegions(RootRanges *roots);
 void ProcessPlatformSpecificAllocations(Frontier *frontier);
+// Removes the pages which can't contain pointers written by the process from
+// the root ranges.
+void FilterUntouchedPages(RootRanges *roots);
+typedef void (*ForkedCopyCallback)(void *arg, fd_t fd);
+// Forks a copy of the process which runs callback(arg, fd) and exits, fd is
+// the write end of a pipe. Returns the read end, or kInvalidFd on failure.
+fd_t RunInForkedCopy(ForkedCopyCallback callback, void *arg);
 
 void ScanRangeForPointers(uptr begin, uptr end,
                           Frontier *frontier,
@@ -118,14 +173,33 @@ enum IgnoreObjectResult {
 
 // Functions called from the parent tool.
 void InitCommonLsan();
+// Writes a heap profile of the live chunks, see lsan_common_heap_profile.cc.
+void DumpHeapProfile();
+// Starts the periodic heap profile dumps, if enabled by the flags.
+void InitHeapProfile();
 void DoLeakCheck();
+// Unlike DoLeakCheck, may be called repeatedly and never exits. Returns
+// nonzero if there are unsuppressed leaks.
+int DoRecoverableLeakCheck();
 bool DisabledInThisThread();
+// Records the user chunk if this thread is in a leak checking scope. Must be
+// called after the chunk's metadata is set.
+void RecordScopedAllocation(uptr chunk);
 
 // The following must be implemented in the parent tool.
 
 void ForEachChunk(ForEachChunkCallback callback, void *arg);
+// Same, but the allocator must not be locked: it is locked one size class at
+// a time, while the other threads keep running.
+void ForEachChunkWithRegionLocks(ForEachChunkCallback callback, void *arg);
+// Starts a thread which is not registered with the tool, for background work.
+bool StartInternalThread(void *(*func)(void *arg), void *arg);
 // Returns the address range occupied by the global allocator object.
 void GetAllocatorGlobalRange(uptr *begin, uptr *end);
+// Returns the address ranges which contain all the allocator chunks. Must be
+// called with the allocator locked.
+void GetAllocatorChunkRangesLocked(uptr *primary_begin, uptr *primary_end,
+                                   uptr *secondary_begin, uptr *secondary_end);
 // Wrappers for allocator's ForceLock()/ForceUnlock().
 void LockAllocator();
 void UnlockAllocator();
@@ -157,6 +231,10 @@ class LsanMetadata {
   bool allocated() const;
   ChunkTag tag() const;
   void set_tag(ChunkTag value);
+  // Atomically replaces the tag if it is equal to cmp.
+  bool compare_and_set_tag(ChunkTag cmp, ChunkTag value);
+  // Hints that the metadata is about to be accessed.
+  void prefetch() const;
   uptr requested_size() const;
   u32 stack_trace_id() const;
  private:
@@ -0,0 +1,238 @@
+//=-- lsan_common_heap_profile.cc -----------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of LeakSanitizer.
+// Heap profiles of the live chunks, shared between ASan and LSan.
+//
+// The live bytes and chunk counts are aggregated by allocation stack id and
+// written in the text format of the tcmalloc heap profiler, which pprof
+// reads. The allocator is walked one size class at a time under the region
+// locks, so the other threads keep running and the profile is a racy
+// snapshot: a chunk allocated or freed during the walk may or may not be
+// counted.
+//
+//===----------------------------------------------------------------------===//
+
+#include "lsan_common.h"
+
+#include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_flags.h"
+#include "sanitizer_common/sanitizer_libc.h"
+#include "sanitizer_common/sanitizer_mutex.h"
+#include "sanitizer_common/sanitizer_stackdepot.h"
+
+#if CAN_SANITIZE_LEAKS
+namespace __lsan {
+
+struct HeapProfileEntry {
+  u32 stack_id;
+  u32 count;
+  uptr bytes;
+};
+
+// Open addressing hash table of the stack ids. The chunk callback may not
+// allocate from the allocator, so the table is mmapped.
+class HeapProfileTable {
+ public:
+  void Init() {
+    capacity_ = 1 << 12;
+    size_ = 0;
+    entries_ = Allocate(capacity_);
+  }
+
+  void Destroy() {
+    UnmapOrDie(entries_, capacity_ * sizeof(entries_[0]));
+  }
+
+  void Add(u32 stack_id, uptr bytes) {
+    if (2 * (size_ + 1) > capacity_)
+      Grow();
+    HeapProfileEntry *e = Find(entries_, capacity_, stack_id);
+    if (e->stack_id == 0) {
+      e->stack_id = stack_id;
+      size_++;
+    }
+    e->count++;
+    e->bytes += bytes;
+  }
+
+  uptr capacity() const { return capacity_; }
+  const HeapProfileEntry &operator[](uptr i) const { return entries_[i]; }
+
+ private:
+  static HeapProfileEntry *Allocate(uptr capacity) {
+    // MmapOrDie returns zeroed memory, i.e. empty slots.
+    return (HeapProfileEntry *)MmapOrDie(capacity * sizeof(HeapProfileEntry),
+                                         "HeapProfileTable");
+  }
+
+  static HeapProfileEntry *Find(HeapProfileEntry *entries, uptr capacity,
+                                u32 stack_id) {
+    uptr i = (stack_id * 2654435761u) & (capacity - 1);
+    while (entries[i].stack_id != 0 && entries[i].stack_id != stack_id)
+      i = (i + 1) & (capacity - 1);
+    return &entries[i];
+  }
+
+  void Grow() {
+    uptr new_capacity = capacity_ * 2;
+    HeapProfileEntry *new_entries = Allocate(new_capacity);
+    for (uptr i = 0; i < capacity_; i++) {
+      if (entries_[i].stack_id != 0)
+        *Find(new_entries, new_capacity, entries_[i].stack_id) = entries_[i];
+    }
+    UnmapOrDie(entries_, capacity_ * sizeof(entries_[0]));
+    entries_ = new_entries;
+    capacity_ = new_capacity;
+  }
+
+  HeapProfileEntry *entries_;
+  uptr capacity_;
+  uptr size_;
+};
+
+// ForEachChunkWithRegionLocks callback.
+static void CollectHeapProfileCb(uptr chunk, void *arg) {
+  chunk = GetUserBegin(chunk);
+  LsanMetadata m(chunk);
+  if (!m.allocated()) return;
+  // Chunks without a stack depot id (not sampled, or stored without a stack
+  // depot) cannot be attributed to a stack.
+  u32 stack_id = m.stack_trace_id();
+  if (stack_id == 0 || (stack_id >> 31))
+    return;
+  reinterpret_cast<HeapProfileTable *>(arg)->Add(stack_id, m.requested_size());
+}
+
+// Buffers the output, the file is written with a few large writes.
+class HeapProfileWriter {
+ public:
+  explicit HeapProfileWriter(fd_t fd) : fd_(fd), buf_(1 << 16), pos_(0) {}
+  ~HeapProfileWriter() { Flush(); }
+
+  // The format prints the count and bytes twice, as in-use and allocated.
+  void Counts(const char *format, uptr count, uptr bytes) {
+    if (pos_ + kMaxLine > buf_.size())
+      Flush();
+    pos_ += internal_snprintf(buf_.data() + pos_, kMaxLine, format, count,
+                              bytes, count, bytes);
+  }
+
+  void Pc(uptr pc) {
+    if (pos_ + kMaxLine > buf_.size())
+      Flush();
+    pos_ += internal_snprintf(buf_.data() + pos_, kMaxLine, " 0x%zx", pc);
+  }
+
+  void Write(const char *str) { Write(str, internal_strlen(str)); }
+  void Write(const char *data, uptr size) {
+    Flush();
+    internal_write(fd_, data, size);
+  }
+
+  void Flush() {
+    if (pos_)
+      internal_write(fd_, buf_.data(), pos_);
+    pos_ = 0;
+  }
+
+ private:
+  static const uptr kMaxLine = 128;
+  fd_t fd_;
+  InternalScopedBuffer<char> buf_;
+  uptr pos_;
+};
+
+static void WriteHeapProfile(fd_t fd, const HeapProfileTable &table) {
+  uptr total_count = 0, total_bytes = 0;
+  for (uptr i = 0; i < table.capacity(); i++) {
+    total_count += table[i].count;
+    total_bytes += table[i].bytes;
+  }
+  HeapProfileWriter w(fd);
+  // Only the live chunks are known: the cumulative allocation counts are
+  // reported equal to the live ones.
+  w.Counts("heap profile: %zu: %zu [%zu: %zu] @ heapprofile\n", total_count,
+           total_bytes);
+  for (uptr i = 0; i < table.capacity(); i++) {
+    const HeapProfileEntry &e = table[i];
+    if (e.stack_id == 0)
+      continue;
+    uptr size;
+    const uptr *pcs = StackDepotGet(e.stack_id, &size);
+    w.Counts("%zu: %zu [%zu: %zu] @", e.count, e.bytes);
+    for (uptr j = 0; j < size; j++)
+      w.Pc(pcs[j]);
+    w.Write("\n");
+  }
+  // pprof symbolizes the pcs with the mappings.
+  w.Write("\nMAPPED_LIBRARIES:\n");
+  char *maps = 0;
+  uptr maps_size = 0;
+  uptr maps_len = ReadFileToBuffer("/proc/self/maps", &maps, &maps_size,
+                                   1 << 26);
+  if (maps_len)
+    w.Write(maps, maps_len);
+  if (maps)
+    UnmapOrDie(maps, maps_size);
+}
+
+static BlockingMutex heap_profile_mutex(LINKER_INITIALIZED);
+static uptr heap_profile_seq;
+
+void DumpHeapProfile() {
+  // Also serializes the dumps, so that they get distinct file names.
+  BlockingMutexLock l(&heap_profile_mutex);
+  HeapProfileTable table;
+  table.Init();
+  ForEachChunkWithRegionLocks(CollectHeapProfileCb, &table);
+  InternalScopedBuffer<char> path(4096);
+  internal_snprintf(path.data(), path.size(), "%s.%zu.%zu.heap",
+                    flags()->heap_profile_path, internal_getpid(),
+                    heap_profile_seq++);
+  uptr fd = OpenFile(path.data(), true);
+  if (internal_iserror(fd)) {
+    Report("ERROR: Can't open heap profile file: %s\n", path.data());
+  } else {
+    WriteHeapProfile(fd, table);
+    internal_close(fd);
+    if (flags()->verbosity)
+      Report("Heap profile written to %s\n", path.data());
+  }
+  table.Destroy();
+}
+
+static void *HeapProfileThread(void *arg) {
+  for (;;) {
+    SleepForMillis(flags()->heap_profile_interval_ms);
+    DumpHeapProfile();
+  }
+  return 0;
+}
+
+void InitHeapProfile() {
+  if (flags()->heap_profile_interval_ms <= 0)
+    return;
+  if (!StartInternalThread(HeapProfileThread, 0))
+    Report("ERROR: Can't start the heap profile thread\n");
+}
+
+}  // namespace __lsan
+#endif  // CAN_SANITIZE_LEAKS
+
+using namespace __lsan;  // NOLINT
+
+extern "C" {
+SANITIZER_INTERFACE_ATTRIBUTE
+void __sanitizer_dump_heap_profile() {
+#if CAN_SANITIZE_LEAKS
+  DumpHeapProfile();
+#endif  // CAN_SANITIZE_LEAKS
+}
+}  // extern "C"
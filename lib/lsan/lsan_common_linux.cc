@@ -17,6 +17,7 @@
 
 #if CAN_SANITIZE_LEAKS && SANITIZER_LINUX
 #include <link.h>
+#include <unistd.h>
 
 #include "sanitizer_common/sanitizer_common.h"
 #include "sanitizer_common/sanitizer_linux.h"
@@ -53,7 +54,7 @@ void InitializePlatformSpecificModules() {
 
 static int ProcessGlobalRegionsCallback(struct dl_phdr_info *info, size_t size,
                                         void *data) {
-  Frontier *frontier = reinterpret_cast<Frontier *>(data);
+  RootRanges *roots = reinterpret_cast<RootRanges *>(data);
   for (uptr j = 0; j < info->dlpi_phnum; j++) {
     const ElfW(Phdr) *phdr = &(info->dlpi_phdr[j]);
     // We're looking for .data and .bss sections, which reside in writeable,
@@ -69,25 +70,23 @@ static int ProcessGlobalRegionsCallback(struct dl_phdr_info *info, size_t size,
       CHECK_LE(allocator_begin, allocator_end);
       CHECK_LT(allocator_end, end);
       if (begin < allocator_begin)
-        ScanRangeForPointers(begin, allocator_begin, frontier, "GLOBAL",
-                             kReachable);
+        AddRootRange(roots, begin, allocator_begin, "GLOBAL");
       if (allocator_end < end)
-        ScanRangeForPointers(allocator_end, end, frontier, "GLOBAL",
-                             kReachable);
+        AddRootRange(roots, allocator_end, end, "GLOBAL");
     } else {
-      ScanRangeForPointers(begin, end, frontier, "GLOBAL", kReachable);
+      AddRootRange(roots, begin, end, "GLOBAL");
     }
   }
   return 0;
 }
 
-// Scans global variables for heap pointers.
-void ProcessGlobalRegions(Frontier *frontier) {
+// Collects the ranges of global variables.
+void ProcessGlobalRegions(RootRanges *roots) {
   // FIXME: dl_iterate_phdr acquires a linker lock, so we run a risk of
   // deadlocking by running this under StopTheWorld. However, the lock is
   // reentrant, so we should be able to fix this by acquiring the lock before
   // suspending threads.
-  dl_iterate_phdr(ProcessGlobalRegionsCallback, frontier);
+  dl_iterate_phdr(ProcessGlobalRegionsCallback, roots);
 }
 
 static uptr GetCallerPC(u32 stack_id) {
@@ -122,5 +121,108 @@ void ProcessPlatformSpecificAllocations(Frontier *frontier) {
   ForEachChunk(ProcessPlatformSpecificAllocationsCb, frontier);
 }
 
+// A page which is neither present nor swapped out has never been written by
+// the process (or was discarded with MADV_DONTNEED). It holds zeroes or the
+// contents of the mapped file, so it can't contain pointers to heap chunks.
+static const u64 kPagemapPresent = 1ULL << 63;
+static const u64 kPagemapSwapped = 1ULL << 62;
+static const uptr kPagemapBatch = 512;
+
+// Reads the pagemap entries of |n| pages starting at the page |addr|.
+static bool ReadPagemap(fd_t fd, uptr addr, u64 *entries, uptr n) {
+  OFF_T offset = addr / GetPageSizeCached() * sizeof(u64);
+  if (internal_iserror(internal_lseek(fd, offset, SEEK_SET)))
+    return false;
+  char *p = reinterpret_cast<char *>(entries);
+  uptr size = n * sizeof(u64);
+  while (size) {
+    uptr res = internal_read(fd, p, size);
+    if (internal_iserror(res) || res == 0)
+      return false;
+    p += res;
+    size -= res;
+  }
+  return true;
+}
+
+// Appends the parts of |range| which lie in touched pages to |filtered|.
+// Returns false if the pagemap could not be read.
+static bool AddTouchedParts(fd_t fd, const RootRange &range,
+                            RootRanges *filtered, u64 *entries) {
+  uptr page_size = GetPageSizeCached();
+  uptr run_begin = 0;
+  bool in_run = false;
+  for (uptr batch = RoundDownTo(range.begin, page_size); batch < range.end;
+       batch += kPagemapBatch * page_size) {
+    uptr n = Min(kPagemapBatch,
+                 (RoundUpTo(range.end, page_size) - batch) / page_size);
+    if (!ReadPagemap(fd, batch, entries, n))
+      return false;
+    for (uptr i = 0; i < n; i++) {
+      uptr page = batch + i * page_size;
+      bool touched = entries[i] & (kPagemapPresent | kPagemapSwapped);
+      if (touched && !in_run) {
+        run_begin = Max(page, range.begin);
+        in_run = true;
+      } else if (!touched && in_run) {
+        // Keep the unaligned pointers which cross into the untouched page.
+        RootRange part = {run_begin, Min(range.end, page + sizeof(uptr) - 1),
+                          range.region_type};
+        filtered->push_back(part);
+        in_run = false;
+      }
+    }
+  }
+  if (in_run) {
+    RootRange part = {run_begin, range.end, range.region_type};
+    filtered->push_back(part);
+  }
+  return true;
+}
+
+void FilterUntouchedPages(RootRanges *roots) {
+  uptr fd = OpenFile("/proc/self/pagemap", false);
+  if (internal_iserror(fd))
+    return;
+  InternalScopedBuffer<u64> entries(kPagemapBatch);
+  // Don't trust a pagemap which doesn't show our own stack as present.
+  uptr stack_addr = reinterpret_cast<uptr>(&fd);
+  if (!ReadPagemap(fd, stack_addr, entries.data(), 1) ||
+      !(entries[0] & kPagemapPresent)) {
+    internal_close(fd);
+    return;
+  }
+  RootRanges filtered(GetPageSizeCached());
+  for (uptr i = 0; i < roots->size(); i++) {
+    if (!AddTouchedParts(fd, (*roots)[i], &filtered, entries.data())) {
+      internal_close(fd);
+      return;
+    }
+  }
+  internal_close(fd);
+  roots->clear();
+  for (uptr i = 0; i < filtered.size(); i++)
+    roots->push_back(filtered[i]);
+}
+
+fd_t RunInForkedCopy(ForkedCopyCallback callback, void *arg) {
+  int fds[2];
+  if (internal_iserror(internal_pipe(fds)))
+    return kInvalidFd;
+  uptr pid = internal_fork();
+  if (internal_iserror(pid)) {
+    internal_close(fds[0]);
+    internal_close(fds[1]);
+    return kInvalidFd;
+  }
+  if (pid == 0) {
+    internal_close(fds[0]);
+    callback(arg, fds[1]);
+    internal__exit(0);
+  }
+  internal_close(fds[1]);
+  return fds[0];
+}
+
 }  // namespace __lsan
 #endif  // CAN_SANITIZE_LEAKS && SANITIZER_LINUX
@@ -255,6 +255,11 @@ INTERCEPTOR(int, pthread_join, void *th, void **ret) {
 
 namespace __lsan {
 
+bool StartInternalThread(void *(*func)(void *arg), void *arg) {
+  void *th;
+  return REAL(pthread_create)(&th, 0, func, arg) == 0;
+}
+
 void InitializeInterceptors() {
   INTERCEPT_FUNCTION(malloc);
   INTERCEPT_FUNCTION(free);
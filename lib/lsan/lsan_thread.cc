@@ -17,6 +17,7 @@
 #include "sanitizer_common/sanitizer_common.h"
 #include "sanitizer_common/sanitizer_placement_new.h"
 #include "sanitizer_common/sanitizer_thread_registry.h"
+#include "sanitizer_common/sanitizer_timing.h"
 #include "lsan_allocator.h"
 
 namespace __lsan {
@@ -96,6 +97,7 @@ void ThreadStart(u32 tid, uptr os_id) {
 
 void ThreadFinish() {
   thread_registry->FinishThread(GetCurrentThread());
+  TimingThreadFinish();
 }
 
 ThreadContext *CurrentThreadContext() {
@@ -125,7 +127,7 @@ void ThreadJoin(u32 tid) {
 
 void EnsureMainThreadIDIsCorrect() {
   if (GetCurrentThread() == 0)
-    CurrentThreadContext()->os_id = GetTid();
+    thread_registry->SetThreadOsId(0, GetTid());
 }
 
 ///// Interface to the common LSan module. /////
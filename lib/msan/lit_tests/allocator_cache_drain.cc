@@ -0,0 +1,46 @@
+// The allocator caches of the exited threads, and with
+// allocator_cache_drain_interval_ms of the idle ones, go back to the
+// allocator. The chunks handed out again must still be poisoned.
+// RUN: %clangxx_msan -m64 -O0 %s -o %t && not %t >%t.out 2>&1
+// RUN: FileCheck %s < %t.out
+// RUN: MSAN_OPTIONS=allocator_cache_drain_interval_ms=10 not %t >%t.out 2>&1
+// RUN: FileCheck %s < %t.out
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+void *Churn(void *arg) {
+  void *p[100];
+  for (int i = 0; i < 100; i++)
+    p[i] = malloc(32);
+  for (int i = 0; i < 100; i++)
+    free(p[i]);
+  if (arg)
+    pthread_exit(0);
+  return 0;
+}
+
+void *Idle(void *arg) {
+  Churn(0);
+  sleep(1);
+  return 0;
+}
+
+int main() {
+  pthread_t idle;
+  pthread_create(&idle, 0, Idle, 0);
+  for (int i = 0; i < 100; i++) {
+    pthread_t t;
+    pthread_create(&t, 0, Churn, i % 2 ? &t : 0);
+    pthread_join(t, 0);
+  }
+  usleep(100000);
+  int *volatile x = (int *)malloc(32);
+  if (*x)
+    exit(0);
+  // CHECK: WARNING: MemorySanitizer: use-of-uninitialized-value
+  // CHECK: {{#0 0x.* in main .*allocator_cache_drain.cc:}}[[@LINE-3]]
+  pthread_join(idle, 0);
+  return 0;
+}
@@ -0,0 +1,35 @@
+// RUN: %clangxx_msan -fsanitize-memory-track-origins -m64 -O0 %s -o %t && \
+// RUN:     MSAN_OPTIONS=origin_history_size=4 not %t >%t.out 2>&1
+// RUN: FileCheck %s < %t.out
+// RUN: %clangxx_msan -fsanitize-memory-track-origins -m64 -O2 %s -o %t && \
+// RUN:     MSAN_OPTIONS=origin_history_size=4 not %t >%t.out 2>&1
+// RUN: FileCheck %s < %t.out
+// RUN: %clangxx_msan -fsanitize-memory-track-origins -m64 -O2 %s -o %t && \
+// RUN:     not %t >%t.out 2>&1
+// RUN: FileCheck %s --check-prefix=CHECK-NO-HISTORY < %t.out
+
+#include <stdlib.h>
+#include <string.h>
+
+__attribute__((noinline)) void copy(char *dst, char *src) {
+  memcpy(dst, src, 8);
+}
+
+int main(int argc, char **argv) {
+  char *volatile x = (char*)malloc(8);
+  char *volatile y = (char*)malloc(8);
+  copy(y, x);
+  if (y[argc])
+    exit(0);
+  // CHECK: WARNING: MemorySanitizer: use-of-uninitialized-value
+  // CHECK: {{#0 0x.* in main .*chained-origin.cc:}}[[@LINE-3]]
+
+  // CHECK: Uninitialized value was stored to memory at
+  // CHECK: {{#.* in copy.*chained-origin.cc:}}[[@LINE-13]]
+  // CHECK: Uninitialized value was created by a heap allocation
+  // CHECK: {{#1 0x.* in main .*chained-origin.cc:}}[[@LINE-11]]
+
+  // CHECK-NO-HISTORY-NOT: stored to memory
+  // CHECK-NO-HISTORY: Uninitialized value was created by a heap allocation
+  return 0;
+}
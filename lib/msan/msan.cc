@@ -15,9 +15,11 @@
 #include "msan.h"
 #include "sanitizer_common/sanitizer_atomic.h"
 #include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_coverage.h"
 #include "sanitizer_common/sanitizer_flags.h"
 #include "sanitizer_common/sanitizer_libc.h"
 #include "sanitizer_common/sanitizer_procmaps.h"
+#include "sanitizer_common/sanitizer_stackdepot.h"
 #include "sanitizer_common/sanitizer_stacktrace.h"
 #include "sanitizer_common/sanitizer_symbolizer.h"
 
@@ -60,6 +62,7 @@ static THREADLOCAL struct {
 
 static THREADLOCAL bool is_in_symbolizer;
 static THREADLOCAL bool is_in_loader;
+static THREADLOCAL StackDepotCache stack_depot_cache;
 
 extern "C" SANITIZER_WEAK_ATTRIBUTE const int __msan_track_origins;
 
@@ -91,6 +94,10 @@ void EnterSymbolizer() { is_in_symbolizer = true; }
 void ExitSymbolizer()  { is_in_symbolizer = false; }
 bool IsInSymbolizer() { return is_in_symbolizer; }
 
+u32 StackDepotPutCurrentThread(StackTrace *stack) {
+  return StackDepotPutCached(&stack_depot_cache, stack->trace, stack->size);
+}
+
 void EnterLoader() { is_in_loader = true; }
 void ExitLoader()  { is_in_loader = false; }
 
@@ -117,20 +124,26 @@ static const char *StackOriginDescr[kNumStackOriginDescrs];
 static atomic_uint32_t NumStackOriginDescrs;
 
 static void ParseFlagsFromString(Flags *f, const char *str) {
-  ParseCommonFlagsFromString(str);
-  ParseFlag(str, &f->poison_heap_with_zeroes, "poison_heap_with_zeroes");
-  ParseFlag(str, &f->poison_stack_with_zeroes, "poison_stack_with_zeroes");
-  ParseFlag(str, &f->poison_in_malloc, "poison_in_malloc");
-  ParseFlag(str, &f->exit_code, "exit_code");
+  FlagParser parser;
+  RegisterCommonFlags(&parser);
+  parser.AddFlag(&f->poison_heap_with_zeroes, "poison_heap_with_zeroes");
+  parser.AddFlag(&f->poison_stack_with_zeroes, "poison_stack_with_zeroes");
+  parser.AddFlag(&f->poison_in_malloc, "poison_in_malloc");
+  parser.AddFlag(&f->exit_code, "exit_code");
+  parser.AddFlag(&f->report_umrs, "report_umrs");
+  parser.AddFlag(&f->verbosity, "verbosity");
+  parser.AddFlag(&f->wrap_signals, "wrap_signals");
+  parser.AddFlag(&f->keep_going, "keep_going");
+  parser.AddFlag(&f->origin_history_size, "origin_history_size");
+  parser.AddFlag(&f->origin_history_memory_mb, "origin_history_memory_mb");
+  parser.AddFlag(&f->allocator_cache_drain_interval_ms,
+                 "allocator_cache_drain_interval_ms");
+  parser.ParseString(str);
   if (f->exit_code < 0 || f->exit_code > 127) {
     Printf("Exit code not in [0, 128) range: %d\n", f->exit_code);
     f->exit_code = 1;
     Die();
   }
-  ParseFlag(str, &f->report_umrs, "report_umrs");
-  ParseFlag(str, &f->verbosity, "verbosity");
-  ParseFlag(str, &f->wrap_signals, "wrap_signals");
-  ParseFlag(str, &f->keep_going, "keep_going");
 }
 
 static void InitializeFlags(Flags *f, const char *options) {
@@ -139,9 +152,18 @@ static void InitializeFlags(Flags *f, const char *options) {
   cf->strip_path_prefix = "";
   cf->fast_unwind_on_fatal = false;
   cf->fast_unwind_on_malloc = true;
+  cf->use_shadow_call_stack = false;
+  cf->compress_stack_depot = false;
+  cf->stack_depot_max_mb = 0;
   cf->malloc_context_size = 20;
   cf->handle_ioctl = true;
   cf->log_path = 0;
+  cf->shadow_huge_pages = 0;
+  cf->prefault_shadow = false;
+  cf->fast_init = false;
+  cf->timing_sample_rate = 0;
+  cf->coverage = false;
+  cf->coverage_dir = "";
 
   internal_memset(f, 0, sizeof(*f));
   f->poison_heap_with_zeroes = false;
@@ -152,6 +174,9 @@ static void InitializeFlags(Flags *f, const char *options) {
   f->verbosity = 0;
   f->wrap_signals = true;
   f->keep_going = !!&__msan_keep_going;
+  f->origin_history_size = 0;
+  f->origin_history_memory_mb = 64;
+  f->allocator_cache_drain_interval_ms = 0;
 
   // Override from user-specified string.
   if (__msan_default_options)
@@ -182,6 +207,9 @@ void GetStackTrace(StackTrace *stack, uptr max_s, uptr pc, uptr bp,
 
   uptr stack_top, stack_bottom;
   GetCurrentStackBounds(&stack_top, &stack_bottom);
+  if (common_flags()->use_shadow_call_stack &&
+      stack->ShadowCallStackUnwind(pc, bp, stack_top, stack_bottom, max_s))
+    return;
   stack->size = 0;
   stack->trace[0] = pc;
   stack->max_size = max_s;
@@ -221,10 +249,6 @@ void PrintWarningWithOrigin(uptr pc, uptr bp, u32 origin) {
   }
 }
 
-void UnpoisonParam(uptr n) {
-  internal_memset(__msan_param_tls, 0, n * sizeof(*__msan_param_tls));
-}
-
 }  // namespace __msan
 
 // Interface.
@@ -291,15 +315,30 @@ void __msan_init() {
     DumpProcessMap();
     Die();
   }
+  if (__msan_get_track_origins())
+    InitializeOriginHistory();
 
   const char *external_symbolizer = common_flags()->external_symbolizer_path;
   if (external_symbolizer && external_symbolizer[0]) {
-    CHECK(InitializeExternalSymbolizer(external_symbolizer));
+    if (common_flags()->fast_init)
+      InitializeExternalSymbolizerLazily(external_symbolizer);
+    else
+      CHECK(InitializeExternalSymbolizer(external_symbolizer));
   }
+  InitializeCoverage(common_flags()->coverage_dir);
+  if (common_flags()->coverage)
+    Atexit(DumpCoverage);
 
   GetThreadStackTopAndBottom(/* at_initialization */true,
                              &__msan_stack_bounds.stack_top,
                              &__msan_stack_bounds.stack_bottom);
+  if (common_flags()->prefault_shadow) {
+    // The top of the stack is the part in use.
+    const uptr kMaxPrefaultedStack = 1 << 23;
+    uptr size = Min(__msan_stack_bounds.stack_top -
+                    __msan_stack_bounds.stack_bottom, kMaxPrefaultedStack);
+    PrefaultRegion(MEM_TO_SHADOW(__msan_stack_bounds.stack_top - size), size);
+  }
   if (flags()->verbosity)
     Printf("MemorySanitizer init done\n");
   msan_init_is_running = 0;
@@ -408,6 +447,22 @@ void __msan_load_unpoisoned(void *src, uptr size, void *dst) {
   __msan_unpoison(dst, size);
 }
 
+// Origins are only read when a report is printed, so large origin fills use
+// non-temporal stores and don't evict the application data from the cache.
+static const uptr kOriginStreamingThreshold = 1 << 16;
+
+// Fills the 16-byte aligned range [beg, end) with v.
+static void FillOrigin128(uptr beg, uptr end, u64x2 v) {
+  if (end - beg < kOriginStreamingThreshold) {
+    for (uptr addr = beg; addr < end; addr += 16)
+      *(u64x2*)addr = v;
+    return;
+  }
+  for (uptr addr = beg; addr < end; addr += 16)
+    __asm__("movntdq %1, %0" : "=m"(*(u64x2*)addr) : "x"(v));
+  __asm__ __volatile__("sfence" ::: "memory");
+}
+
 void __msan_set_origin(const void *a, uptr size, u32 origin) {
   // Origin mapping is 4 bytes per 4 bytes of application memory.
   // Here we extend the range such that its left and right bounds are both
@@ -417,12 +472,21 @@ void __msan_set_origin(const void *a, uptr size, u32 origin) {
   uptr beg = x & ~3UL;  // align down.
   uptr end = (x + size + 3) & ~3UL;  // align up.
   u64 origin64 = ((u64)origin << 32) | origin;
-  // This is like memset, but the value is 32-bit. We unroll by 2 two write
-  // 64-bits at once. May want to unroll further to get 128-bit stores.
+  // This is like memset, but the value is 32-bit. We align the range up to 8
+  // and 16 bytes and write 128 bits at once.
   if (beg & 7ULL) {
     *(u32*)beg = origin;
     beg += 4;
   }
+  if (end > beg && end - beg >= 64) {
+    if (beg & 15ULL) {
+      *(u64*)beg = origin64;
+      beg += 8;
+    }
+    u64x2 origin128 = {origin64, origin64};
+    FillOrigin128(beg, end & ~15UL, origin128);
+    beg = end & ~15UL;
+  }
   for (uptr addr = beg; addr < (end & ~7UL); addr += 8)
     *(u64*)addr = origin64;
   if (end & 7ULL)
@@ -455,7 +519,7 @@ void __msan_set_alloca_origin(void *a, uptr size, const char *descr) {
 }
 
 const char *__msan_get_origin_descr_if_stack(u32 id) {
-  if ((id >> 31) == 0) return 0;
+  if ((id >> 31) == 0 || IsChainedOrigin(id)) return 0;
   id &= (1U << 31) - 1;
   CHECK_LT(id, kNumStackOriginDescrs);
   return StackOriginDescr[id];
@@ -31,6 +31,10 @@
 #define MEM_IS_SHADOW(mem) ((uptr)mem >=         0x200000000000ULL && \
                             (uptr)mem <=         0x400000000000ULL)
 
+typedef __sanitizer::u64 u64x2 __attribute__((vector_size(16)));
+typedef __sanitizer::u64 u64x2_unaligned
+    __attribute__((vector_size(16), aligned(1)));
+
 const int kMsanParamTlsSizeInWords = 100;
 const int kMsanRetvalTlsSizeInWords = 100;
 
@@ -43,6 +47,10 @@ bool ProtectRange(uptr beg, uptr end);
 bool InitShadow(bool prot1, bool prot2, bool map_shadow, bool init_origins);
 char *GetProcSelfMaps();
 void InitializeInterceptors();
+bool StartInternalThread(void *(*func)(void *arg), void *arg);
+
+void MsanTSDInit(void (*destructor)(void *tsd));
+void MsanTSDSet(void *tsd);
 
 void *MsanReallocate(StackTrace *stack, void *oldp, uptr size,
                      uptr alignment, bool zeroise);
@@ -66,16 +74,47 @@ void ExitLoader();
 void MsanDie();
 void PrintWarning(uptr pc, uptr bp);
 void PrintWarningWithOrigin(uptr pc, uptr bp, u32 origin);
+bool OriginIsValid(u32 origin);
+
+// Origin history. A chained origin id says that a value with the previous
+// origin was stored to memory at the given stack. Stack origins have only the
+// top bit of the two set, heap origins have neither.
+const u32 kChainedOriginMask = 3U << 30;
+inline bool IsChainedOrigin(u32 origin) {
+  return (origin & kChainedOriginMask) == kChainedOriginMask;
+}
+void InitializeOriginHistory();
+// Returns prev if the history is disabled, full, or the chain is too long.
+u32 ChainOrigin(u32 prev, u32 stack_id);
+void GetChainedOrigin(u32 id, u32 *prev, u32 *stack_id);
 
 void GetStackTrace(StackTrace *stack, uptr max_s, uptr pc, uptr bp,
                    bool fast);
 
+// Stores the stack in StackDepot using the current thread's cache.
+u32 StackDepotPutCurrentThread(StackTrace *stack);
+
 void ReportUMR(StackTrace *stack, u32 origin);
 void ReportExpectedUMRNotFound(StackTrace *stack);
 void ReportAtExitStatistics();
 
-// Unpoison first n function arguments.
-void UnpoisonParam(uptr n);
+}  // namespace __msan
+
+extern "C" THREADLOCAL __sanitizer::u64
+    __msan_param_tls[kMsanParamTlsSizeInWords];
+
+namespace __msan {
+
+// Unpoison first n function arguments. Callbacks called from interceptors do
+// this on every call with a small constant n, so the slots are cleared inline.
+inline void UnpoisonParam(uptr n) {
+  for (uptr i = 0; i < n; i++)
+    __msan_param_tls[i] = 0;
+}
+
+// Unpoisons [a, a + size) and drops its origins. The shadow and origin pages
+// inside the range are released rather than written.
+void ReleaseShadowAndOrigins(const void *a, uptr size);
 
 #define GET_MALLOC_STACK_TRACE                                     \
   StackTrace stack;                                                \
@@ -85,6 +124,8 @@ void UnpoisonParam(uptr n);
         StackTrace::GetCurrentPc(), GET_CURRENT_FRAME(),           \
         common_flags()->fast_unwind_on_malloc)
 
+#define GET_STORE_STACK_TRACE GET_MALLOC_STACK_TRACE
+
 }  // namespace __msan
 
 #define MSAN_MALLOC_HOOK(ptr, size) \
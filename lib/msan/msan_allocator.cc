@@ -13,8 +13,13 @@
 //===----------------------------------------------------------------------===//
 
 #include "sanitizer_common/sanitizer_allocator.h"
+#include "sanitizer_common/sanitizer_flags.h"
+#include "sanitizer_common/sanitizer_mutex.h"
+#include "sanitizer_common/sanitizer_placement_new.h"
 #include "sanitizer_common/sanitizer_stackdepot.h"
+#include "sanitizer_common/sanitizer_thread_registry.h"
 #include "msan.h"
+#include "msan_flags.h"
 
 namespace __msan {
 
@@ -33,9 +38,124 @@ typedef LargeMmapAllocator<> SecondaryAllocator;
 typedef CombinedAllocator<PrimaryAllocator, AllocatorCache,
                           SecondaryAllocator> Allocator;
 
-static THREADLOCAL AllocatorCache cache;
 static Allocator allocator;
 
+// Each thread registers its allocator cache on first use. The cache is
+// drained when the thread exits, from a TSD destructor so that pthread_exit()
+// is covered too, and with allocator_cache_drain_interval_ms when the thread
+// stays idle. Otherwise the chunks cached by dead and idle threads are lost
+// to the other threads.
+struct ThreadAllocatorCache {
+  AllocatorCache cache;
+  // Taken by the owner only if the idle caches are drained.
+  StaticSpinMutex mu;
+  uptr n_ops;  // Allocations and deallocations, under mu.
+  uptr n_ops_at_last_check;  // Used by the drain thread, under mu.
+  u32 tid;
+  bool registered;
+  bool finished;  // The TSD destructor has run.
+};
+
+static THREADLOCAL ThreadAllocatorCache thread_cache;
+// Used by the threads which run TSD destructors after their own one.
+static AllocatorCache fallback_cache;
+static StaticSpinMutex fallback_mu;
+static bool drain_idle_caches;
+
+class MsanThreadContext : public ThreadContextBase {
+ public:
+  explicit MsanThreadContext(u32 tid) : ThreadContextBase(tid), cache(0) {}
+  // The cache of the running thread, set and reset under the registry lock.
+  ThreadAllocatorCache *cache;
+
+  void OnStarted(void *arg) { cache = (ThreadAllocatorCache *)arg; }
+  void OnFinished() { cache = 0; }
+};
+
+static const u32 kMaxNumberOfThreads = 1 << 22;
+// The contexts of the finished threads are reused after this many others.
+static const u32 kThreadQuarantineSize = 64;
+
+static ALIGNED(16) char thread_registry_placeholder[sizeof(ThreadRegistry)];
+static ThreadRegistry *thread_registry;
+
+static ThreadContextBase *CreateThreadContext(u32 tid) {
+  // Called under the registry lock.
+  static LowLevelAllocator allocator_for_contexts;
+  void *mem = allocator_for_contexts.Allocate(sizeof(MsanThreadContext));
+  return new(mem) MsanThreadContext(tid);
+}
+
+static void ThreadAllocatorCacheTSDDtor(void *tsd) {
+  ThreadAllocatorCache *tc = (ThreadAllocatorCache *)tsd;
+  {
+    SpinMutexLock l(&tc->mu);
+    tc->finished = true;
+    allocator.SwallowCache(&tc->cache);
+  }
+  thread_registry->FinishThread(tc->tid);
+}
+
+static NOINLINE void RegisterThreadAllocatorCache(ThreadAllocatorCache *tc) {
+  tc->registered = true;
+  tc->tid = thread_registry->CreateThread(0, /* detached */ true, 0, 0);
+  thread_registry->StartThread(tc->tid, GetTid(), tc);
+  MsanTSDSet(tc);
+}
+
+// Gives the allocator cache of the current thread, locked if needed.
+class ScopedAllocatorCache {
+ public:
+  ScopedAllocatorCache() {
+    ThreadAllocatorCache *tc = &thread_cache;
+    if (UNLIKELY(!tc->registered))
+      RegisterThreadAllocatorCache(tc);
+    if (UNLIKELY(tc->finished)) {
+      mu_ = &fallback_mu;
+      cache_ = &fallback_cache;
+      mu_->Lock();
+      return;
+    }
+    cache_ = &tc->cache;
+    mu_ = 0;
+    if (drain_idle_caches) {
+      mu_ = &tc->mu;
+      mu_->Lock();
+      tc->n_ops++;
+    }
+  }
+  ~ScopedAllocatorCache() {
+    if (mu_)
+      mu_->Unlock();
+  }
+  AllocatorCache *get() { return cache_; }
+
+ private:
+  StaticSpinMutex *mu_;
+  AllocatorCache *cache_;
+};
+
+// RunCallbackForEachThreadLocked callback.
+static void DrainIfIdle(ThreadContextBase *tctx, void *arg) {
+  ThreadAllocatorCache *tc = static_cast<MsanThreadContext *>(tctx)->cache;
+  // A busy thread is not idle.
+  if (!tc || !tc->mu.TryLock())
+    return;
+  if (tc->n_ops == tc->n_ops_at_last_check)
+    allocator.SwallowCache(&tc->cache);
+  tc->n_ops_at_last_check = tc->n_ops;
+  tc->mu.Unlock();
+}
+
+static void *AllocatorCacheDrainThread(void *arg) {
+  for (;;) {
+    SleepForMillis(flags()->allocator_cache_drain_interval_ms);
+    ThreadRegistryLock l(thread_registry);
+    thread_registry->RunCallbackForEachThreadLocked(DrainIfIdle, 0);
+  }
+  return 0;
+}
+
 static int inited = 0;
 
 static inline void Init() {
@@ -43,20 +163,49 @@ static inline void Init() {
   __msan_init();
   inited = true;  // this must happen before any threads are created.
   allocator.Init();
+  thread_registry = new(thread_registry_placeholder) ThreadRegistry(
+      CreateThreadContext, kMaxNumberOfThreads, kThreadQuarantineSize);
+  MsanTSDInit(ThreadAllocatorCacheTSDDtor);
+  // The shadow and origins of the allocator space are the most densely used.
+  int huge_pages = common_flags()->shadow_huge_pages;
+  SetShadowHugePages(huge_pages, MEM_TO_SHADOW(kAllocatorSpace),
+                     kAllocatorSize, /*dense*/ true);
+  if (__msan_get_track_origins())
+    SetShadowHugePages(huge_pages, MEM_TO_ORIGIN(kAllocatorSpace),
+                       kAllocatorSize, /*dense*/ true);
+  if (flags()->allocator_cache_drain_interval_ms > 0) {
+    // No other thread allocates yet, so all of them take the cache locks.
+    drain_idle_caches = true;
+    if (!StartInternalThread(AllocatorCacheDrainThread, 0)) {
+      Printf("FATAL: MemorySanitizer can not start the allocator cache "
+             "drain thread.\n");
+      Die();
+    }
+  }
 }
 
 static void *MsanAllocate(StackTrace *stack, uptr size,
                           uptr alignment, bool zeroise) {
   Init();
-  void *res = allocator.Allocate(&cache, size, alignment, false);
+  void *res;
+  bool zero;
+  {
+    ScopedAllocatorCache cache;
+    res = allocator.AllocateCheckZero(cache.get(), size, alignment, &zero);
+  }
   Metadata *meta = reinterpret_cast<Metadata*>(allocator.GetMetaData(res));
   meta->requested_size = size;
-  if (zeroise)
-    __msan_clear_and_unpoison(res, size);
-  else if (flags()->poison_in_malloc)
+  if (zeroise) {
+    // Fresh chunks, e.g. all of the secondary allocator, are zero already.
+    if (!zero)
+      __msan_clear_and_unpoison(res, size);
+    else
+      __msan_unpoison(res, size);
+  } else if (flags()->poison_in_malloc)
     __msan_poison(res, size);
-  if (__msan_get_track_origins()) {
-    u32 stack_id = StackDepotPut(stack->trace, stack->size);
+  // Origins of unpoisoned memory are never reported.
+  if (__msan_get_track_origins() && !zeroise) {
+    u32 stack_id = StackDepotPutCurrentThread(stack);
     CHECK(stack_id);
     CHECK_EQ((stack_id >> 31), 0);  // Higher bit is occupied by stack origins.
     __msan_set_origin(res, size, stack_id);
@@ -72,12 +221,80 @@ void MsanDeallocate(void *p) {
   Metadata *meta = reinterpret_cast<Metadata*>(allocator.GetMetaData(p));
   uptr size = meta->requested_size;
   meta->requested_size = 0;
-  // This memory will not be reused by anyone else, so we are free to keep it
-  // poisoned.
-  __msan_poison(p, size);
-  if (__msan_get_track_origins())
-    __msan_set_origin(p, size, -1);
-  allocator.Deallocate(&cache, p);
+  if (allocator.FromPrimary(p)) {
+    // This memory will not be reused by anyone else, so we are free to keep
+    // it poisoned.
+    __msan_poison(p, size);
+    if (__msan_get_track_origins())
+      __msan_set_origin(p, size, -1);
+  } else {
+    // The chunk is unmapped, don't spend time and memory on its shadow.
+    ReleaseShadowAndOrigins(p, size);
+  }
+  ScopedAllocatorCache cache;
+  allocator.Deallocate(cache.get(), p);
+}
+
+// Shadow of moved chunks at least this large is moved by remapping its pages.
+// Each remap splits the shadow mapping, so smaller ranges are copied.
+static const uptr kShadowRemapThreshold = 1 << 20;
+
+// Moves the shadow or origins of a chunk which has moved from old_p to new_p.
+static void MoveShadowRange(uptr old_p, uptr new_p, uptr size) {
+  uptr page_size = GetPageSizeCached();
+  size = RoundUpTo(size, page_size);
+  if (size >= kShadowRemapThreshold &&
+      !internal_iserror(internal_mremap_fixed((void*)old_p, size,
+                                              (void*)new_p))) {
+    // Put fresh pages into the hole left in the shadow.
+    MmapFixedNoReserve(old_p, size);
+    SetShadowHugePages(common_flags()->shadow_huge_pages, old_p, size,
+                       /*dense*/ false);
+    return;
+  }
+  internal_memcpy((void*)new_p, (void*)old_p, size);
+}
+
+// Resizes a chunk of the secondary allocator without copying it: the app
+// pages, and for large chunks the shadow and origin pages, get remapped.
+// Returns the new chunk or 0 if the chunk can't be resized this way.
+static void *ReallocateSecondaryInPlace(StackTrace *stack, void *old_p,
+                                        uptr old_size, uptr new_size,
+                                        bool zeroise) {
+  if (allocator.FromPrimary(old_p) ||
+      PrimaryAllocator::CanAllocate(new_size, sizeof(u64)))
+    return 0;
+  void *new_p = allocator.ResizeSecondary(old_p, new_size);
+  if (!new_p)
+    return 0;
+  Metadata *meta = reinterpret_cast<Metadata*>(allocator.GetMetaData(new_p));
+  meta->requested_size = new_size;
+  uptr kept_size = Min(old_size, new_size);
+  // Secondary chunks are page aligned, and so are their shadow and origins.
+  if (new_p != old_p && kept_size) {
+    MoveShadowRange(MEM_TO_SHADOW(old_p), MEM_TO_SHADOW(new_p), kept_size);
+    if (__msan_get_track_origins())
+      MoveShadowRange(MEM_TO_ORIGIN(old_p), MEM_TO_ORIGIN(new_p), kept_size);
+  }
+  if (new_size > old_size) {
+    void *tail = (char*)new_p + old_size;
+    uptr tail_size = new_size - old_size;
+    if (zeroise) {
+      __msan_clear_and_unpoison(tail, tail_size);
+    } else {
+      if (flags()->poison_in_malloc)
+        __msan_poison(tail, tail_size);
+      if (__msan_get_track_origins()) {
+        u32 stack_id = StackDepotPutCurrentThread(stack);
+        CHECK(stack_id);
+        CHECK_EQ((stack_id >> 31), 0);
+        __msan_set_origin(tail, tail_size, stack_id);
+      }
+    }
+  }
+  MSAN_FREE_HOOK(old_p);
+  MSAN_MALLOC_HOOK(new_p, new_size);
+  return new_p;
 }
 
 void *MsanReallocate(StackTrace *stack, void *old_p, uptr new_size,
@@ -98,6 +315,9 @@ void *MsanReallocate(StackTrace *stack, void *old_p, uptr new_size,
       __msan_poison((char*)old_p + old_size, new_size - old_size);
     return old_p;
   }
+  if (void *new_p = ReallocateSecondaryInPlace(stack, old_p, old_size,
+                                               new_size, zeroise))
+    return new_p;
   uptr memcpy_size = Min(new_size, old_size);
   void *new_p = MsanAllocate(stack, new_size, alignment, zeroise);
   // Printf("realloc: old_size %zd new_size %zd\n", old_size, new_size);
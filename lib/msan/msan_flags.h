@@ -26,6 +26,15 @@ struct Flags {
   bool report_umrs;
   bool wrap_signals;
   bool keep_going;
+  // If positive, record up to this many stores of an uninitialized value
+  // in its origin.
+  int origin_history_size;  // default: 0
+  // Memory limit for the recorded stores.
+  int origin_history_memory_mb;  // default: 64
+  // If positive, the allocator caches of the threads which did not allocate
+  // or free during the last this many milliseconds are drained, by a thread
+  // which checks them at this interval.
+  int allocator_cache_drain_interval_ms;  // default: 0
 };
 
 Flags *flags();
@@ -794,7 +794,7 @@ void __msan_allocated_memory(const void* data, uptr size) {
   if (flags()->poison_in_malloc)
     __msan_poison(data, size);
   if (__msan_get_track_origins()) {
-    u32 stack_id = StackDepotPut(stack.trace, stack.size);
+    u32 stack_id = StackDepotPutCurrentThread(&stack);
     CHECK(stack_id);
     CHECK_EQ((stack_id >> 31), 0);  // Higher bit is occupied by stack origins.
     __msan_set_origin(data, size, stack_id);
@@ -1014,6 +1014,13 @@ INTERCEPTOR(int, pthread_join, void *th, void **retval) {
   return res;
 }
 
+namespace __msan {
+bool StartInternalThread(void *(*func)(void *arg), void *arg) {
+  void *th;
+  return REAL(pthread_create)(&th, 0, func, arg) == 0;
+}
+}  // namespace __msan
+
 struct MSanInterceptorContext {
   bool in_interceptor_scope;
 };
@@ -1091,11 +1098,44 @@ void *fast_memcpy(void *dst, const void *src, SIZE_T n) {
   return internal_memcpy(dst, src, n);
 }
 
+// Shadow ranges at least this large are cleared with
+// FlushUnneededShadowMemory, which replaces the whole pages with fresh zero
+// pages instead of writing them.
+static const uptr kShadowReleaseThreshold = 1 << 16;
+
+// Zeroes the shadow or origins in [beg, beg + size).
+static void ClearShadowRange(uptr beg, uptr size) {
+  if (size >= kShadowReleaseThreshold) {
+    uptr page_size = GetPageSizeCached();
+    uptr page_beg = RoundUpTo(beg, page_size);
+    uptr page_end = RoundDownTo(beg + size, page_size);
+    fast_memset((void*)beg, 0, page_beg - beg);
+    FlushUnneededShadowMemory(page_beg, page_end - page_beg);
+    fast_memset((void*)page_end, 0, beg + size - page_end);
+    return;
+  }
+  fast_memset((void*)beg, 0, size);
+}
+
+namespace __msan {
+void ReleaseShadowAndOrigins(const void *a, uptr size) {
+  if (!MEM_IS_APP(a)) return;
+  ClearShadowRange(MEM_TO_SHADOW((uptr)a), size);
+  if (__msan_get_track_origins())
+    ClearShadowRange(MEM_TO_ORIGIN((uptr)a), size);
+}
+}  // namespace __msan
+
 // These interface functions reside here so that they can use
 // fast_memset, etc.
 void __msan_unpoison(const void *a, uptr size) {
   if (!MEM_IS_APP(a)) return;
-  fast_memset((void*)MEM_TO_SHADOW((uptr)a), 0, size);
+  ClearShadowRange(MEM_TO_SHADOW((uptr)a), size);
+  // Origins of unpoisoned memory are never reported, so the origin pages of
+  // a large range go back to the zero page, e.g. when a new heap block is
+  // initialized with memset.
+  if (size >= kShadowReleaseThreshold && __msan_get_track_origins())
+    ClearShadowRange(MEM_TO_ORIGIN((uptr)a), size);
 }
 
 void __msan_poison(const void *a, uptr size) {
@@ -1112,12 +1152,35 @@ void __msan_poison_stack(void *a, uptr size) {
 
 void __msan_clear_and_unpoison(void *a, uptr size) {
   fast_memset(a, 0, size);
-  fast_memset((void*)MEM_TO_SHADOW((uptr)a), 0, size);
+  __msan_unpoison(a, size);
+}
+
+// Records the current stack in the origins of the poisoned words of the
+// copied range [dst, dst + size).
+static void ChainCopiedOrigins(uptr dst, uptr size) {
+  uptr beg = dst & ~3UL;  // align down.
+  uptr end = (dst + size + 3) & ~3UL;  // align up.
+  u32 stack_id = 0;
+  u32 last_origin = 0, last_chained = 0;
+  for (uptr a = beg; a < end; a += 4) {
+    if (!*(u32*)MEM_TO_SHADOW(a)) continue;
+    u32 *o = (u32*)MEM_TO_ORIGIN(a);
+    if (!OriginIsValid(*o)) continue;
+    if (*o != last_origin) {
+      if (!stack_id) {
+        GET_STORE_STACK_TRACE;
+        stack_id = StackDepotPutCurrentThread(&stack);
+        if (!stack_id) return;
+      }
+      last_origin = *o;
+      last_chained = ChainOrigin(*o, stack_id);
+    }
+    *o = last_chained;
+  }
 }
 
-void __msan_copy_origin(void *dst, const void *src, uptr size) {
-  if (!__msan_get_track_origins()) return;
-  if (!MEM_IS_APP(dst) || !MEM_IS_APP(src)) return;
+// Copies the origins without recording the copy in the origin history.
+static void CopyOrigins(uptr dst, uptr src, uptr size) {
   uptr d = MEM_TO_ORIGIN(dst);
   uptr s = MEM_TO_ORIGIN(src);
   uptr beg = d & ~3UL;  // align down.
@@ -1126,6 +1189,14 @@ void __msan_copy_origin(void *dst, const void *src, uptr size) {
   fast_memcpy((void*)beg, (void*)s, end - beg);
 }
 
+void __msan_copy_origin(void *dst, const void *src, uptr size) {
+  if (!__msan_get_track_origins()) return;
+  if (!MEM_IS_APP(dst) || !MEM_IS_APP(src)) return;
+  CopyOrigins((uptr)dst, (uptr)src, size);
+  if (flags()->origin_history_size)
+    ChainCopiedOrigins((uptr)dst, size);
+}
+
 void __msan_copy_poison(void *dst, const void *src, uptr size) {
   if (!MEM_IS_APP(dst)) return;
   if (!MEM_IS_APP(src)) return;
@@ -1142,22 +1213,102 @@ void __msan_move_poison(void *dst, const void *src, uptr size) {
   __msan_copy_origin(dst, src, size);
 }
 
+// Below this size the separate passes over the data, shadow and origins are
+// cheaper than splitting the range for the fused loops.
+static const uptr kFusedCopyMinSize = 64;
+
+// Copies the 16-byte blocks of data at dst, which must be 16-byte aligned,
+// together with their shadow. The origins of a block are only copied if it is
+// poisoned: the origins of initialized memory are never read.
+static void CopyWithShadow128(uptr dst, uptr src, uptr size,
+                              bool copy_origins) {
+  for (uptr i = 0; i < size; i += 16) {
+    *(u64x2*)(dst + i) = *(const u64x2_unaligned*)(src + i);
+    u64x2 shadow = *(const u64x2_unaligned*)MEM_TO_SHADOW(src + i);
+    *(u64x2*)MEM_TO_SHADOW(dst + i) = shadow;
+    if (copy_origins && (shadow[0] | shadow[1]))
+      *(u64x2*)MEM_TO_ORIGIN(dst + i) =
+          *(const u64x2_unaligned*)MEM_TO_ORIGIN(src + i);
+  }
+}
+
+static void CopyWithShadowSlow(uptr dst, uptr src, uptr size,
+                               bool copy_origins) {
+  fast_memcpy((void*)dst, (void*)src, size);
+  fast_memcpy((void*)MEM_TO_SHADOW(dst), (void*)MEM_TO_SHADOW(src), size);
+  if (copy_origins)
+    CopyOrigins(dst, src, size);
+}
+
+// Same as memcpy followed by __msan_copy_poison, but goes over the memory once.
+// The ranges must not overlap.
+static void CopyWithPoison(void *dst, const void *src, uptr size) {
+  uptr d = (uptr)dst;
+  uptr s = (uptr)src;
+  // Words of origins can be copied as a whole only if they are at the same
+  // offset in the source, the destination and their origin words.
+  if (size < kFusedCopyMinSize || ((d ^ s) & 3) || !MEM_IS_APP(d) ||
+      !MEM_IS_APP(s)) {
+    fast_memcpy(dst, src, size);
+    __msan_copy_poison(dst, src, size);
+    return;
+  }
+  bool copy_origins = __msan_get_track_origins();
+  uptr head = RoundUpTo(d, 16) - d;
+  uptr bulk = RoundDownTo(size - head, 16);
+  CopyWithShadowSlow(d, s, head, copy_origins);
+  CopyWithShadow128(d + head, s + head, bulk, copy_origins);
+  CopyWithShadowSlow(d + head + bulk, s + head + bulk, size - head - bulk,
+                     copy_origins);
+  if (copy_origins && flags()->origin_history_size)
+    ChainCopiedOrigins(d, size);
+}
+
+// Same as memset followed by __msan_unpoison, but goes over the memory once.
+static void SetAndUnpoison(void *ptr, int c, uptr size) {
+  uptr p = (uptr)ptr;
+  if (size < kFusedCopyMinSize || size >= kShadowReleaseThreshold ||
+      !MEM_IS_APP(p)) {
+    fast_memset(ptr, c, size);
+    __msan_unpoison(ptr, size);
+    return;
+  }
+  uptr head = RoundUpTo(p, 16) - p;
+  uptr bulk = RoundDownTo(size - head, 16);
+  uptr tail = size - head - bulk;
+  internal_memset(ptr, c, head);
+  internal_memset((void*)MEM_TO_SHADOW(p), 0, head);
+  u64 word = 0x0101010101010101ULL * (u8)c;
+  u64x2 value = {word, word};
+  u64x2 zero = {0, 0};
+  for (uptr i = p + head; i < p + head + bulk; i += 16) {
+    *(u64x2*)i = value;
+    *(u64x2*)MEM_TO_SHADOW(i) = zero;
+  }
+  internal_memset((void*)(p + head + bulk), c, tail);
+  internal_memset((void*)MEM_TO_SHADOW(p + head + bulk), 0, tail);
+}
+
 void *__msan_memcpy(void *dest, const void *src, SIZE_T n) {
   ENSURE_MSAN_INITED();
-  void *res = fast_memcpy(dest, src, n);
-  __msan_copy_poison(dest, src, n);
-  return res;
+  CopyWithPoison(dest, src, n);
+  return dest;
 }
 
 void *__msan_memset(void *s, int c, SIZE_T n) {
   ENSURE_MSAN_INITED();
-  void *res = fast_memset(s, c, n);
-  __msan_unpoison(s, n);
-  return res;
+  SetAndUnpoison(s, c, n);
+  return s;
 }
 
 void *__msan_memmove(void *dest, const void *src, SIZE_T n) {
   ENSURE_MSAN_INITED();
+  uptr d = (uptr)dest;
+  uptr s = (uptr)src;
+  if (d + n <= s || s + n <= d) {
+    CopyWithPoison(dest, src, n);
+    return dest;
+  }
   void *res = REAL(memmove)(dest, src, n);
   __msan_move_poison(dest, src, n);
   return res;
@@ -74,6 +74,9 @@ SANITIZER_INTERFACE_ATTRIBUTE
 void __msan_set_alloca_origin(void *a, uptr size, const char *descr);
 SANITIZER_INTERFACE_ATTRIBUTE
 u32 __msan_get_origin(const void *a);
+// Returns the origin of a value with the given origin stored at the caller.
+SANITIZER_INTERFACE_ATTRIBUTE
+u32 __msan_chain_origin(u32 id);
 
 SANITIZER_INTERFACE_ATTRIBUTE
 void __msan_clear_on_return();
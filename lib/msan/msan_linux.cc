@@ -19,6 +19,7 @@
 
 #include <elf.h>
 #include <link.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
@@ -29,6 +30,7 @@
 #include <sys/resource.h>
 
 #include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_flags.h"
 #include "sanitizer_common/sanitizer_procmaps.h"
 
 namespace __msan {
@@ -64,13 +66,19 @@ bool InitShadow(bool prot1, bool prot2, bool map_shadow, bool init_origins) {
     return false;
   if (prot2 && !Mprotect(kBad2Beg, kBad2End - kBad2Beg))
     return false;
+  // The allocator marks the shadow and origins of its space as dense.
+  int huge_pages = common_flags()->shadow_huge_pages;
   if (map_shadow) {
     void *shadow = MmapFixedNoReserve(kShadowBeg, kShadowEnd - kShadowBeg);
     if (shadow != (void*)kShadowBeg) return false;
+    SetShadowHugePages(huge_pages, kShadowBeg, kShadowEnd - kShadowBeg,
+                       /*dense*/ false);
   }
   if (init_origins) {
     void *origins = MmapFixedNoReserve(kOriginsBeg, kOriginsEnd - kOriginsBeg);
     if (origins != (void*)kOriginsBeg) return false;
+    SetShadowHugePages(huge_pages, kOriginsBeg, kOriginsEnd - kOriginsBeg,
+                       /*dense*/ false);
   }
   return true;
 }
@@ -91,6 +99,21 @@ void InstallAtExitHandler() {
   atexit(MsanAtExit);
 }
 
+// ---------------------- TSD ---------------- {{{1
+
+static pthread_key_t tsd_key;
+static bool tsd_key_inited = false;
+void MsanTSDInit(void (*destructor)(void *tsd)) {
+  CHECK(!tsd_key_inited);
+  tsd_key_inited = true;
+  CHECK_EQ(0, pthread_key_create(&tsd_key, destructor));
+}
+
+void MsanTSDSet(void *tsd) {
+  CHECK(tsd_key_inited);
+  pthread_setspecific(tsd_key, tsd);
+}
+
 }  // namespace __msan
 
 #endif  // __linux__
@@ -0,0 +1,147 @@
+//===-- msan_origin.cc ----------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of MemorySanitizer.
+//
+// Origin history: a depot of (previous origin, store stack) pairs.
+//===----------------------------------------------------------------------===//
+
+#include "msan.h"
+#include "sanitizer_common/sanitizer_atomic.h"
+#include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_mutex.h"
+
+// ACHTUNG! No system header includes in this file.
+
+using namespace __sanitizer;
+
+namespace __msan {
+
+// Chain links are hash-consed: storing the same value from the same place
+// over and over again creates a single link. The links are never freed, so
+// the depot is a preallocated array which stops growing once it is full.
+struct ChainedOrigin {
+  u32 prev;
+  u32 stack_id;
+  // Number of stores recorded in the chain which ends with this link.
+  u32 depth;
+  // Index of the next link in the same hash bucket, 0 ends the list.
+  u32 next;
+};
+
+static ChainedOrigin *chain_links;  // chain_links[0] is not used.
+static uptr max_chain_links;
+static atomic_uint32_t *chain_buckets;
+static uptr chain_buckets_mask;
+static atomic_uint32_t num_chain_links;
+static StaticSpinMutex chain_mutex;
+static bool chain_depot_full;
+
+static const uptr kMaxChainLinks = 1U << 30;
+
+void InitializeOriginHistory() {
+  if (!flags()->origin_history_size) return;
+  uptr bytes = (uptr)flags()->origin_history_memory_mb << 20;
+  // Each link takes a slot in the array and (roughly) one bucket head.
+  uptr n = bytes / (sizeof(ChainedOrigin) + sizeof(u32));
+  n = Min(n, kMaxChainLinks);
+  if (n < 2) return;
+  uptr buckets = 1;
+  while (buckets * 2 <= n)
+    buckets *= 2;
+  // The memory is committed page by page as the links get added.
+  chain_links =
+      (ChainedOrigin*)MmapOrDie(n * sizeof(ChainedOrigin), "OriginHistory");
+  chain_buckets =
+      (atomic_uint32_t*)MmapOrDie(buckets * sizeof(u32), "OriginHistory");
+  max_chain_links = n;
+  chain_buckets_mask = buckets - 1;
+  atomic_store(&num_chain_links, 1, memory_order_relaxed);
+  if (flags()->verbosity)
+    Printf("Origin history: %zd links of up to %d stores\n", n - 1,
+           flags()->origin_history_size);
+}
+
+static uptr ChainHash(u32 prev, u32 stack_id) {
+  u64 h = ((u64)prev << 32) | stack_id;
+  h *= 0x9E3779B97F4A7C15ULL;
+  return (uptr)(h >> 32) & chain_buckets_mask;
+}
+
+static u32 FindChainedOrigin(u32 head, u32 prev, u32 stack_id) {
+  for (u32 i = head; i; i = chain_links[i].next) {
+    if (chain_links[i].prev == prev && chain_links[i].stack_id == stack_id)
+      return i;
+  }
+  return 0;
+}
+
+static u32 ChainedOriginId(u32 idx) { return kChainedOriginMask | idx; }
+
+static u32 ChainedOriginIndex(u32 id) {
+  u32 idx = id & ~kChainedOriginMask;
+  CHECK_GT(idx, 0);
+  CHECK_LT(idx, atomic_load(&num_chain_links, memory_order_acquire));
+  return idx;
+}
+
+u32 ChainOrigin(u32 prev, u32 stack_id) {
+  if (!chain_links || !OriginIsValid(prev) || !stack_id)
+    return prev;
+  u32 depth = 1;
+  if (IsChainedOrigin(prev))
+    depth += chain_links[ChainedOriginIndex(prev)].depth;
+  // Keep the oldest stores: the allocation is usually the most useful part.
+  if (depth > (u32)flags()->origin_history_size)
+    return prev;
+  atomic_uint32_t *bucket = &chain_buckets[ChainHash(prev, stack_id)];
+  // Published links are immutable, so the lookup takes no lock.
+  u32 idx = FindChainedOrigin(atomic_load(bucket, memory_order_acquire), prev,
+                              stack_id);
+  if (idx)
+    return ChainedOriginId(idx);
+  SpinMutexLock l(&chain_mutex);
+  u32 head = atomic_load(bucket, memory_order_relaxed);
+  idx = FindChainedOrigin(head, prev, stack_id);
+  if (idx)
+    return ChainedOriginId(idx);
+  idx = atomic_load(&num_chain_links, memory_order_relaxed);
+  if (idx >= max_chain_links) {
+    if (!chain_depot_full && flags()->verbosity)
+      Printf("Origin history is full, new stores are not recorded\n");
+    chain_depot_full = true;
+    return prev;
+  }
+  ChainedOrigin *link = &chain_links[idx];
+  link->prev = prev;
+  link->stack_id = stack_id;
+  link->depth = depth;
+  link->next = head;
+  atomic_store(&num_chain_links, idx + 1, memory_order_release);
+  atomic_store(bucket, idx, memory_order_release);
+  return ChainedOriginId(idx);
+}
+
+void GetChainedOrigin(u32 id, u32 *prev, u32 *stack_id) {
+  CHECK(IsChainedOrigin(id));
+  const ChainedOrigin &link = chain_links[ChainedOriginIndex(id)];
+  *prev = link.prev;
+  *stack_id = link.stack_id;
+}
+
+}  // namespace __msan
+
+using namespace __msan;
+
+u32 __msan_chain_origin(u32 id) {
+  if (!__msan_get_track_origins() || !chain_links || !OriginIsValid(id))
+    return id;
+  GET_STORE_STACK_TRACE;
+  return ChainOrigin(id, StackDepotPutCurrentThread(&stack));
+}
@@ -54,6 +54,16 @@ static void DescribeOrigin(u32 origin) {
   Decorator d;
   if (flags()->verbosity)
     Printf("  raw origin id: %d\n", origin);
+  while (IsChainedOrigin(origin)) {
+    u32 prev, stack_id;
+    GetChainedOrigin(origin, &prev, &stack_id);
+    uptr size = 0;
+    const uptr *trace = StackDepotGet(stack_id, &size);
+    Printf("  %sUninitialized value was stored to memory at%s\n",
+           d.Origin(), d.End());
+    PrintStack(trace, size);
+    origin = prev;
+  }
   if (const char *so = __msan_get_origin_descr_if_stack(origin)) {
     char* s = internal_strdup(so);
     char* sep = internal_strchr(s, '@');
@@ -92,6 +102,7 @@ void ReportUMR(StackTrace *stack, u32 origin) {
   if (!__msan::flags()->report_umrs) return;
 
   SpinMutexLock l(&CommonSanitizerReportMutex);
+  ScopedReportBuffer report_buffer;
 
   Decorator d;
   Printf("%s", d.Warning());
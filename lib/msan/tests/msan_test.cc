@@ -314,6 +314,31 @@ TEST(MemorySanitizer, Realloc) {
   free(x);
 }
 
+// Large chunks are resized by remapping, together with their shadow.
+TEST(MemorySanitizer, ReallocLarge) {
+  size_t size = 1 << 20;
+  char *x = (char*)Ident(malloc(size));
+  x[0] = 1;
+  x[size - 1] = 2;
+  char *blocker = 0;
+  for (int i = 0; i < 4; i++) {
+    // Make the next realloc move the chunk more often than not.
+    free(blocker);
+    blocker = (char*)Ident(malloc(size));
+    x = (char*)Ident(realloc(x, 2 * size));
+    EXPECT_NOT_POISONED(x[0]);
+    EXPECT_POISONED(x[1]);
+    EXPECT_NOT_POISONED(x[size - 1]);
+    EXPECT_EQ(2, x[size - 1]);
+    EXPECT_POISONED(x[size]);
+    EXPECT_POISONED(x[2 * size - 1]);
+    x[2 * size - 1] = 2;
+    size *= 2;
+  }
+  free(blocker);
+  free(x);
+}
+
 TEST(MemorySanitizer, Calloc) {
   S4 *x = (int*)Ident(calloc(1, sizeof(S4)));
   EXPECT_NOT_POISONED(*x);  // Should not be poisoned.
@@ -321,6 +346,25 @@ TEST(MemorySanitizer, Calloc) {
   free(x);
 }
 
+// Large chunks get their shadow as fresh pages instead of writing it.
+TEST(MemorySanitizer, CallocLarge) {
+  const size_t kSize = 16 << 20;
+  for (int i = 0; i < 2; i++) {
+    char *x = (char*)Ident(malloc(kSize));
+    EXPECT_POISONED(x[0]);
+    EXPECT_POISONED(x[kSize / 2]);
+    EXPECT_POISONED(x[kSize - 1]);
+    x[kSize / 2] = 1;
+    free(x);
+    x = (char*)Ident(calloc(1, kSize));
+    EXPECT_NOT_POISONED(x[0]);
+    EXPECT_NOT_POISONED(x[kSize / 2]);
+    EXPECT_NOT_POISONED(x[kSize - 1]);
+    EXPECT_EQ(0, x[kSize / 2]);
+    free(x);
+  }
+}
+
 TEST(MemorySanitizer, AndOr) {
   U4 *p = GetPoisoned<U4>();
   // We poison two bytes in the midle of a 4-byte word to make the test
@@ -1025,6 +1069,36 @@ TEST(MemorySanitizer, memmove) {
   EXPECT_POISONED(y[1]);
 }
 
+// Large copies go through the fused data, shadow and origin loops.
+TEST(MemorySanitizer, memcpy_large) {
+  const int kSize = 1000;
+  for (int offset = 0; offset < 8; offset++) {
+    char *x = new char[kSize + 8];
+    char *y = new char[kSize + 8];
+    memset(x, 0, kSize + 8);
+    __msan_poison(x + offset + 100, 3);
+    __msan_set_origin(x + offset + 100, 3, 0x1234 + offset);
+    __msan_poison(x + offset + kSize - 1, 1);
+    memcpy(y + offset, x + offset, kSize);
+    EXPECT_NOT_POISONED(y[offset]);
+    EXPECT_NOT_POISONED(y[offset + 99]);
+    EXPECT_POISONED_O(y[offset + 100], 0x1234 + offset);
+    EXPECT_POISONED(y[offset + 102]);
+    EXPECT_NOT_POISONED(y[offset + 103]);
+    EXPECT_POISONED(y[offset + kSize - 1]);
+    // Misaligned copies must give the same shadow.
+    memmove(y + 1, x + offset, kSize);
+    EXPECT_NOT_POISONED(y[100]);
+    EXPECT_POISONED(y[101]);
+    EXPECT_POISONED(y[kSize]);
+    memset(y, 42, kSize + 8);
+    for (int i = 0; i < kSize + 8; i++)
+      EXPECT_NOT_POISONED(y[i]);
+    delete [] x;
+    delete [] y;
+  }
+}
+
 TEST(MemorySanitizer, bcopy) {
   char* x = new char[2];
   char* y = new char[2];
@@ -2504,6 +2578,16 @@ TEST(MemorySanitizerOrigins, SetGet) {
   EXPECT_EQ(0, __msan_get_origin(&x));
 }
 
+TEST(MemorySanitizerOrigins, UnpoisonReleasesOrigins) {
+  if (!TrackingOrigins()) return;
+  const size_t kSize = 1 << 20;
+  char *x = (char*)malloc(kSize);
+  EXPECT_NE(0U, __msan_get_origin(x + kSize / 2));
+  memset(x, 0, kSize);
+  EXPECT_EQ(0U, __msan_get_origin(x + kSize / 2));
+  free(x);
+}
+
 namespace {
 struct S {
   U4 dummy;
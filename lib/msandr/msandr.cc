@@ -172,111 +172,199 @@ bool WantToInstrument(instr_t *instr) {
 #define PRE(at, what) instrlist_meta_preinsert(bb, at, INSTR_CREATE_##what);
 #define PREF(at, what) instrlist_meta_preinsert(bb, at, what);
 
+// Registers that the instrumentation may use, in order of preference.
+const reg_id_t kScratchRegs[] = {
+  DR_REG_XAX, DR_REG_XBX, DR_REG_XCX, DR_REG_XDX,
+  DR_REG_R8, DR_REG_R9, DR_REG_R10, DR_REG_R11
+};
+
+// Returns true if the value of reg before instr is never read, i.e. reg is
+// overwritten before it is read in the rest of the basic block. Control
+// transfers end the scan, the value is then assumed to be live.
+bool RegIsDeadAt(instr_t *instr, reg_id_t reg) {
+  for (instr_t *i = instr; i != NULL; i = instr_get_next(i)) {
+    if (instr_is_label(i))
+      continue;
+    if (instr_is_cti(i) || instr_is_syscall(i) || instr_is_interrupt(i))
+      return false;
+    if (instr_reads_from_reg(i, reg))
+      return false;
+    // Writes to the 32-bit register zero the upper half. Conditional moves
+    // may leave the register intact.
+    if (!instr_is_cmovcc(i) &&
+        (instr_writes_to_exact_reg(i, reg) ||
+         instr_writes_to_exact_reg(i, reg_64_to_32(reg))))
+      return true;
+  }
+  return false;
+}
+
+// Same as RegIsDeadAt for the 6 arithmetic flags.
+bool ArithFlagsAreDeadAt(instr_t *instr) {
+  uint written = 0;
+  for (instr_t *i = instr; i != NULL; i = instr_get_next(i)) {
+    if (instr_is_label(i))
+      continue;
+    if (instr_is_cti(i) || instr_is_syscall(i) || instr_is_interrupt(i))
+      return false;
+    uint flags = instr_get_arith_flags(i);
+    if (TESTANY(EFLAGS_READ_6 & ~EFLAGS_WRITE_TO_READ(written), flags))
+      return false;
+    written |= flags & EFLAGS_WRITE_6;
+    if (TESTALL(EFLAGS_WRITE_6, written))
+      return true;
+  }
+  return false;
+}
+
+// Unpoisons access_size bytes at the address of the memory operand op before
+// instr. Spills only the registers and flags which are live at instr.
+// Clobbers nothing except registers and flags dead at instr.
 void InstrumentMops(void *drcontext, instrlist_t *bb, instr_t *instr, opnd_t op,
-                    bool is_write) {
-  bool need_to_restore_eflags = false;
-  uint flags = instr_get_arith_flags(instr);
-  // TODO: do something smarter with flags and spills in general?
-  // For example, spill them only once for a sequence of instrumented
-  // instructions that don't change/read flags.
-
-  if (!TESTALL(EFLAGS_WRITE_6, flags) || TESTANY(EFLAGS_READ_6, flags)) {
+                    uint access_size) {
+  bool flags_dead = ArithFlagsAreDeadAt(instr);
+  bool xax_dead = RegIsDeadAt(instr, DR_REG_XAX);
+  if (!flags_dead) {
     if (VERBOSITY > 1)
       dr_printf("Spilling eflags...\n");
-    need_to_restore_eflags = true;
     // TODO: Maybe sometimes don't need to 'seto'.
-    // TODO: Maybe sometimes don't want to spill XAX here?
-    // TODO: No need to spill XAX here if XAX is not used in the BB.
-    dr_save_reg(drcontext, bb, instr, DR_REG_XAX, SPILL_SLOT_1);
+    if (!xax_dead)
+      dr_save_reg(drcontext, bb, instr, DR_REG_XAX, SPILL_SLOT_1);
     dr_save_arith_flags_to_xax(drcontext, bb, instr);
     dr_save_reg(drcontext, bb, instr, DR_REG_XAX, SPILL_SLOT_3);
-    dr_restore_reg(drcontext, bb, instr, DR_REG_XAX, SPILL_SLOT_1);
+    if (!xax_dead)
+      dr_restore_reg(drcontext, bb, instr, DR_REG_XAX, SPILL_SLOT_1);
   }
 
-#if 0
-  dr_printf("==DRMSAN== DEBUG: %d %d %d %d %d %d\n",
-            opnd_is_memory_reference(op), opnd_is_base_disp(op),
-            opnd_is_base_disp(op) ? opnd_get_index(op) : -1,
-            opnd_is_far_memory_reference(op), opnd_is_reg_pointer_sized(op),
-            opnd_is_base_disp(op) ? opnd_get_disp(op) : -1);
-#endif
-
-  reg_id_t R1;
+  // Pick R1 for the shadow address, preferably a dead register which the
+  // operand doesn't use.
+  reg_id_t R1 = DR_REG_NULL;
+  bool R1_dead = false;
+  for (uint j = 0; j < sizeof(kScratchRegs) / sizeof(kScratchRegs[0]); j++) {
+    reg_id_t reg = kScratchRegs[j];
+    if (opnd_uses_reg(op, reg))
+      continue;
+    bool dead = reg == DR_REG_XAX ? xax_dead : RegIsDeadAt(instr, reg);
+    if (dead) {
+      R1 = reg;
+      R1_dead = true;
+      break;
+    }
+    if (R1 == DR_REG_NULL)
+      R1 = reg;
+  }
+  // With nothing dead, a simple access with no offset or index may turn its
+  // base into the shadow address, which saves the lea.
   bool address_in_R1 = false;
-  if (opnd_is_base_disp(op) && opnd_get_index(op) == DR_REG_NULL &&
-      opnd_get_disp(op) == 0) {
-    // If this is a simple access with no offset or index, we can just use the
-    // base for R1.
+  if (!R1_dead && opnd_get_index(op) == DR_REG_NULL && opnd_get_disp(op) == 0 &&
+      opnd_get_base(op) != DR_REG_NULL) {
     address_in_R1 = true;
     R1 = opnd_get_base(op);
-  } else {
-    // Otherwise, we need to compute the addr into R1.
-    // TODO: reuse some spare register? e.g. r15 on x64
-    // TODO: might be used as a non-mem-ref register?
-    R1 = DR_REG_XAX;
   }
-  CHECK(reg_is_pointer_sized(R1)); // otherwise R2 may be wrong.
-
-  // Pick R2 that's not R1 or used by the operand.  It's OK if the instr uses
-  // R2 elsewhere, since we'll restore it before instr.
-  reg_id_t GPR_TO_USE_FOR_R2[] = {
-    DR_REG_XAX, DR_REG_XBX, DR_REG_XCX, DR_REG_XDX
-    // Don't forget to update the +4 below if you add anything else!
-  };
-  std::set<reg_id_t> unused_registers(GPR_TO_USE_FOR_R2, GPR_TO_USE_FOR_R2 + 4);
-  unused_registers.erase(R1);
-  for (int j = 0; j < opnd_num_regs_used(op); j++) {
-    unused_registers.erase(opnd_get_reg_used(op, j));
+  CHECK(R1 != DR_REG_NULL);
+  CHECK(reg_is_pointer_sized(R1));
+
+  if (!R1_dead)
+    dr_save_reg(drcontext, bb, instr, R1, SPILL_SLOT_1);
+  if (!address_in_R1) {
+    // FS and GS based operands are not instrumented, so the address is flat.
+    PRE(instr, lea(drcontext, opnd_create_reg(R1),
+                   opnd_create_base_disp(opnd_get_base(op), opnd_get_index(op),
+                                         opnd_get_scale(op), opnd_get_disp(op),
+                                         OPSZ_lea)));
   }
-
-  CHECK(unused_registers.size() > 0);
-  reg_id_t R2 = *unused_registers.begin();
-  CHECK(R1 != R2);
-
-  // Save the current values of R1 and R2.
-  dr_save_reg(drcontext, bb, instr, R1, SPILL_SLOT_1);
-  // TODO: Something smarter than spilling a "fixed" register R2?
-  dr_save_reg(drcontext, bb, instr, R2, SPILL_SLOT_2);
-
-  if (!address_in_R1)
-    CHECK(drutil_insert_get_mem_addr(drcontext, bb, instr, op, R1, R2));
-  PRE(instr, mov_imm(drcontext, opnd_create_reg(R2),
-                     OPND_CREATE_INT64(0xffffbfffffffffff)));
-  PRE(instr, and(drcontext, opnd_create_reg(R1), opnd_create_reg(R2)));
-  // There is no mov_st of a 64-bit immediate, so...
-  opnd_size_t op_size = opnd_get_size(op);
-  CHECK(op_size != OPSZ_NA);
-  uint access_size = opnd_size_in_bytes(op_size);
-  if (access_size <= 4) {
+  // Shadow address is the address with bit 46 cleared.
+  PRE(instr, btr(drcontext, opnd_create_reg(R1), OPND_CREATE_INT8(46)));
+  CHECK(access_size > 0);
+  uint ofs = 0;
+  // There is no mov_st of a 64-bit immediate, but a 32-bit one is sign
+  // extended.
+  for (; ofs + 8 <= access_size; ofs += 8)
     PRE(instr,
-        mov_st(drcontext, opnd_create_base_disp(R1, DR_REG_NULL, 0, 0, op_size),
-               opnd_create_immed_int((ptr_int_t) 0, op_size)));
-  } else {
-    // FIXME: tail?
-    for (uint ofs = 0; ofs < access_size; ofs += 4) {
-      PRE(instr,
-          mov_st(drcontext, OPND_CREATE_MEM32(R1, ofs), OPND_CREATE_INT32(0)));
-    }
+        mov_st(drcontext, OPND_CREATE_MEM64(R1, ofs), OPND_CREATE_INT32(0)));
+  if (ofs + 4 <= access_size) {
+    PRE(instr,
+        mov_st(drcontext, OPND_CREATE_MEM32(R1, ofs), OPND_CREATE_INT32(0)));
+    ofs += 4;
+  }
+  if (ofs + 2 <= access_size) {
+    PRE(instr,
+        mov_st(drcontext, OPND_CREATE_MEM16(R1, ofs), OPND_CREATE_INT16(0)));
+    ofs += 2;
   }
+  if (ofs < access_size)
+    PRE(instr,
+        mov_st(drcontext, OPND_CREATE_MEM8(R1, ofs), OPND_CREATE_INT8(0)));
 
   // Restore the registers and flags.
-  dr_restore_reg(drcontext, bb, instr, R1, SPILL_SLOT_1);
-  dr_restore_reg(drcontext, bb, instr, R2, SPILL_SLOT_2);
+  if (!R1_dead)
+    dr_restore_reg(drcontext, bb, instr, R1, SPILL_SLOT_1);
 
-  if (need_to_restore_eflags) {
+  if (!flags_dead) {
     if (VERBOSITY > 1)
       dr_printf("Restoring eflags\n");
-    // TODO: Check if it's reverse to the dr_restore_reg above and optimize.
-    dr_save_reg(drcontext, bb, instr, DR_REG_XAX, SPILL_SLOT_1);
+    if (!xax_dead)
+      dr_save_reg(drcontext, bb, instr, DR_REG_XAX, SPILL_SLOT_1);
     dr_restore_reg(drcontext, bb, instr, DR_REG_XAX, SPILL_SLOT_3);
     dr_restore_arith_flags_from_xax(drcontext, bb, instr);
-    dr_restore_reg(drcontext, bb, instr, DR_REG_XAX, SPILL_SLOT_1);
+    if (!xax_dead)
+      dr_restore_reg(drcontext, bb, instr, DR_REG_XAX, SPILL_SLOT_1);
   }
 
   // The original instruction is left untouched. The above instrumentation is just
   // a prefix.
 }
 
+// Returns the first memory destination of instr which needs to be unpoisoned.
+bool GetStoreOperand(instr_t *instr, opnd_t *op) {
+  if (!instr_writes_memory(instr))
+    return false;
+  for (int d = 0; d < instr_num_dsts(instr); d++) {
+    *op = instr_get_dst(instr, d);
+    if (OperandIsInteresting(*op))
+      return true;
+  }
+  return false;
+}
+
+// Stores through the same base register which are close to each other get a
+// single shadow update before the first of them.
+const int kMaxCoalescedStoresRange = 64;
+
+// Collects the stores after first which can share its shadow update, stopping
+// at control transfers and writes to the base register. Widens [*lo, *hi),
+// the range of offsets from the base, to cover them. MSanDR only unpoisons,
+// so unpoisoning a few instructions early is harmless: uninstrumented code
+// doesn't look at the shadow.
+void CollectCoalescedStores(instr_t *first, opnd_t op, int *lo, int *hi,
+                            std::set<instr_t *> *coalesced) {
+  reg_id_t base = opnd_get_base(op);
+  if (base == DR_REG_NULL || opnd_get_index(op) != DR_REG_NULL ||
+      instr_writes_to_reg(first, base))
+    return;
+  for (instr_t *i = instr_get_next(first); i != NULL; i = instr_get_next(i)) {
+    if (instr_is_label(i) || instr_is_cti(i) || instr_is_syscall(i) ||
+        instr_is_interrupt(i) || instr_writes_to_reg(i, base))
+      return;
+    opnd_t other;
+    if (!GetStoreOperand(i, &other))
+      continue;
+    opnd_size_t other_size = opnd_get_size(other);
+    if (!WantToInstrument(i) || other_size == OPSZ_NA ||
+        opnd_get_base(other) != base || opnd_get_index(other) != DR_REG_NULL)
+      return;
+    int other_lo = opnd_get_disp(other);
+    int other_hi = other_lo + opnd_size_in_bytes(other_size);
+    int new_lo = other_lo < *lo ? other_lo : *lo;
+    int new_hi = other_hi > *hi ? other_hi : *hi;
+    if (new_hi - new_lo > kMaxCoalescedStoresRange)
+      return;
+    *lo = new_lo;
+    *hi = new_hi;
+    coalesced->insert(i);
+  }
+}
+
 void InstrumentReturn(void *drcontext, instrlist_t *bb, instr_t *instr) {
   dr_save_reg(drcontext, bb, instr, DR_REG_XAX, SPILL_SLOT_1);
 
@@ -419,6 +507,8 @@ dr_emit_flags_t event_basic_block(void *drcontext, void *tag, instrlist_t *bb,
     }
   }
 
+  // Stores which got their shadow updated along with an earlier one.
+  std::set<instr_t *> coalesced;
   for (instr_t *i = instrlist_first(bb); i != NULL; i = instr_get_next(i)) {
     int opcode = instr_get_opcode(i);
     if (opcode == OP_ret || opcode == OP_ret_far) {
@@ -448,19 +538,19 @@ dr_emit_flags_t event_basic_block(void *drcontext, void *tag, instrlist_t *bb,
           instr_get_app_pc(i) - orig_pc, instr_get_opcode(i), flags);
     }
 
-    if (instr_writes_memory(i)) {
-      // Instrument memory writes
-      // bool instrumented_anything = false;
-      for (int d = 0; d < instr_num_dsts(i); d++) {
-        opnd_t op = instr_get_dst(i, d);
-        if (!OperandIsInteresting(op))
-          continue;
-
-        // CHECK(!instrumented_anything);
-        // instrumented_anything = true;
-        InstrumentMops(drcontext, bb, i, op, true);
-        break; // only instrumenting the first dst
-      }
+    if (coalesced.count(i))
+      continue;
+    opnd_t op;
+    if (GetStoreOperand(i, &op)) {
+      opnd_size_t op_size = opnd_get_size(op);
+      CHECK(op_size != OPSZ_NA);
+      int lo = opnd_get_disp(op);
+      int hi = lo + opnd_size_in_bytes(op_size);
+      CollectCoalescedStores(i, op, &lo, &hi, &coalesced);
+      if (lo != opnd_get_disp(op))
+        op = opnd_create_base_disp(opnd_get_base(op), DR_REG_NULL, 0, lo,
+                                   op_size);
+      InstrumentMops(drcontext, bb, i, op, hi - lo);
     }
   }
 
@@ -656,6 +746,56 @@ void event_post_syscall(void *drcontext, int sysnum) {
   }
 }
 
+// Instrumented blocks are DR_EMIT_PERSISTABLE, so with DR's -persist option
+// the code cache of each module is saved when the process exits, and later
+// runs load it instead of instrumenting the module again. DR keys the caches
+// by module and checks them against the module file. The instrumentation also
+// depends on the TLS layout of the MSan runtime and on the module blacklist,
+// so these are saved with each cache, and caches made with other ones are
+// rejected.
+const unsigned kPersistedStateMagic = 0x4d53414e;  // "MSAN"
+const unsigned kPersistedStateVersion = 1;
+
+struct PersistedState {
+  unsigned magic;
+  unsigned version;
+  int retval_tls_offset;
+  int param_tls_offset;
+  int should_instrument;
+};
+
+void GetPersistedState(void *perscxt, PersistedState *state) {
+  memset(state, 0, sizeof(*state));
+  state->magic = kPersistedStateMagic;
+  state->version = kPersistedStateVersion;
+  state->retval_tls_offset = msan_retval_tls_offset;
+  state->param_tls_offset = msan_param_tls_offset;
+  state->should_instrument = ShouldInstrumentPc(dr_persist_start(perscxt), NULL);
+}
+
+size_t event_persist_ro_size(void *drcontext, void *perscxt, size_t file_offs,
+                             void **user_data) {
+  return sizeof(PersistedState);
+}
+
+bool event_persist_ro(void *drcontext, void *perscxt, file_t fd,
+                      void *user_data) {
+  PersistedState state;
+  GetPersistedState(perscxt, &state);
+  return dr_write_file(fd, &state, sizeof(state)) == (ssize_t)sizeof(state);
+}
+
+bool event_resurrect_ro(void *drcontext, void *perscxt, byte **map) {
+  PersistedState state;
+  GetPersistedState(perscxt, &state);
+  bool match = memcmp(*map, &state, sizeof(state)) == 0;
+  *map += sizeof(state);
+  if (VERBOSITY > 0)
+    dr_printf("==DRMSAN== %s persisted code at %p\n",
+              match ? "Reusing" : "Rejecting", dr_persist_start(perscxt));
+  return match;
+}
+
 } // namespace
 
 DR_EXPORT void dr_init(client_id_t id) {
@@ -721,6 +861,8 @@ DR_EXPORT void dr_init(client_id_t id) {
   drmgr_register_bb_instru2instru_event(event_basic_block, &priority);
   drmgr_register_module_load_event(event_module_load);
   drmgr_register_module_unload_event(event_module_unload);
+  CHECK(dr_register_persist_ro(event_persist_ro_size, event_persist_ro,
+                               event_resurrect_ro));
   if (VERBOSITY > 0)
     dr_printf("==MSANDR== Starting!\n");
 }
@@ -24,39 +24,27 @@ ti_int
 __muloti4(ti_int a, ti_int b, int* overflow)
 {
     const int N = (int)(sizeof(ti_int) * CHAR_BIT);
-    const ti_int MIN = (ti_int)1 << (N-1);
-    const ti_int MAX = ~MIN;
-    *overflow = 0;
-    ti_int result = a * b;
-    if (a == MIN)
-    {
-        if (b != 0 && b != 1)
-	    *overflow = 1;
-	return result;
-    }
-    if (b == MIN)
-    {
-        if (a != 0 && a != 1)
-	    *overflow = 1;
-        return result;
-    }
-    ti_int sa = a >> (N - 1);
-    ti_int abs_a = (a ^ sa) - sa;
-    ti_int sb = b >> (N - 1);
-    ti_int abs_b = (b ^ sb) - sb;
-    if (abs_a < 2 || abs_b < 2)
-        return result;
-    if (sa == sb)
-    {
-        if (abs_a > MAX / abs_b)
-            *overflow = 1;
-    }
-    else
-    {
-        if (abs_a > MIN / -abs_b)
-            *overflow = 1;
-    }
-    return result;
+    /* Multiply the magnitudes in halves.  At most one of the cross products
+     * may be non-zero and it must fit in a half, the final sum must not
+     * carry, and the magnitude must not exceed MAX for a positive result or
+     * MAX + 1 for a negative one.
+     */
+    const ti_int sa = a >> (N - 1);
+    const ti_int sb = b >> (N - 1);
+    const tu_int abs_a = ((tu_int)a ^ sa) - sa;
+    const tu_int abs_b = ((tu_int)b ^ sb) - sb;
+    const du_int ah = (du_int)(abs_a >> (N / 2));
+    const du_int al = (du_int)abs_a;
+    const du_int bh = (du_int)(abs_b >> (N / 2));
+    const du_int bl = (du_int)abs_b;
+    const tu_int limit = (((tu_int)1 << (N - 1)) - 1) + ((tu_int)(sa ^ sb) & 1);
+    const tu_int cross = (tu_int)ah * bl + (tu_int)al * bh;
+    const tu_int low = (tu_int)al * bl;
+    const tu_int abs_p = low + (cross << (N / 2));
+    const int ovf = ((ah != 0) & (bh != 0)) | ((cross >> (N / 2)) != 0) |
+                    (abs_p < low) | (abs_p > limit);
+    *overflow = ovf;
+    return (ti_int)((tu_int)a * (tu_int)b);
 }
 
 #endif
@@ -21,36 +21,35 @@
 di_int
 __mulvdi3(di_int a, di_int b)
 {
+#if __SIZEOF_INT128__
+    /* The 128-bit product of two 64-bit values is a single widening
+     * multiply; the result overflows if it does not sign-extend from 64 bits.
+     */
+    const __int128 product = (__int128)a * b;
+    const int ovf = product != (di_int)product;
+#else
     const int N = (int)(sizeof(di_int) * CHAR_BIT);
-    const di_int MIN = (di_int)1 << (N-1);
-    const di_int MAX = ~MIN;
-    if (a == MIN)
-    {
-        if (b == 0 || b == 1)
-            return a * b;
+    /* Multiply the magnitudes in halves.  At most one of the cross products
+     * may be non-zero and it must fit in a half, the final sum must not
+     * carry, and the magnitude must not exceed MAX for a positive result or
+     * MAX + 1 for a negative one.
+     */
+    const di_int sa = a >> (N - 1);
+    const di_int sb = b >> (N - 1);
+    const du_int abs_a = ((du_int)a ^ sa) - sa;
+    const du_int abs_b = ((du_int)b ^ sb) - sb;
+    const su_int ah = (su_int)(abs_a >> (N / 2));
+    const su_int al = (su_int)abs_a;
+    const su_int bh = (su_int)(abs_b >> (N / 2));
+    const su_int bl = (su_int)abs_b;
+    const du_int limit = (((du_int)1 << (N - 1)) - 1) + ((du_int)(sa ^ sb) & 1);
+    const du_int cross = (du_int)ah * bl + (du_int)al * bh;
+    const du_int low = (du_int)al * bl;
+    const du_int abs_p = low + (cross << (N / 2));
+    const int ovf = ((ah != 0) & (bh != 0)) | ((cross >> (N / 2)) != 0) |
+                    (abs_p < low) | (abs_p > limit);
+#endif
+    if (ovf)
         compilerrt_abort();
-    }
-    if (b == MIN)
-    {
-        if (a == 0 || a == 1)
-            return a * b;
-        compilerrt_abort();
-    }
-    di_int sa = a >> (N - 1);
-    di_int abs_a = (a ^ sa) - sa;
-    di_int sb = b >> (N - 1);
-    di_int abs_b = (b ^ sb) - sb;
-    if (abs_a < 2 || abs_b < 2)
-        return a * b;
-    if (sa == sb)
-    {
-        if (abs_a > MAX / abs_b)
-            compilerrt_abort();
-    }
-    else
-    {
-        if (abs_a > MIN / -abs_b)
-            compilerrt_abort();
-    }
-    return a * b;
+    return (di_int)((du_int)a * (du_int)b);
 }
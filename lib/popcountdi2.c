@@ -12,12 +12,12 @@
  * ===----------------------------------------------------------------------===
  */
 
-#include "int_lib.h"
+#include "int_popcount.h"
 
 /* Returns: count of 1 bits */
 
-COMPILER_RT_ABI si_int
-__popcountdi2(di_int a)
+static si_int
+popcountdi2_soft(di_int a)
 {
     du_int x2 = (du_int)a;
     x2 = x2 - ((x2 >> 1) & 0x5555555555555555uLL);
@@ -34,3 +34,25 @@ __popcountdi2(di_int a)
     /*   Upper 16 bits are garbage */
     return (x + (x >> 8)) & 0x0000007F;  /* (7 significant bits) */
 }
+
+#if COMPILERRT_POPCNT_DISPATCH
+
+static si_int
+popcountdi2_popcnt(di_int a)
+{
+    return popcnt64((du_int)a);
+}
+
+COMPILERRT_MULTIVERSION(si_int, __popcountdi2, (di_int a), (a),
+    __compilerrt_cpu_has(COMPILERRT_CPU_X86_POPCNT) ? popcountdi2_popcnt
+                                                    : popcountdi2_soft)
+
+#else
+
+COMPILER_RT_ABI si_int
+__popcountdi2(di_int a)
+{
+    return popcountdi2_soft(a);
+}
+
+#endif
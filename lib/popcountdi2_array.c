@@ -0,0 +1,123 @@
+/* ===-- popcountdi2_array.c - Implement __popcountdi2_array ---------------===
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is dual licensed under the MIT and the University of Illinois Open
+ * Source Licenses. See LICENSE.TXT for details.
+ *
+ * ===----------------------------------------------------------------------===
+ *
+ * This file implements __popcountdi2_array for the compiler_rt library: the
+ * count of 1 bits of a buffer of 64 bit words, e.g. of a bitmap.  It uses
+ * popcnt when the CPU has it (see int_popcount.h), NEON vcnt when the target
+ * has NEON, and otherwise the bit tricks of __popcountdi2 with the partial
+ * sums of several words added before the final reduction.
+ *
+ * ===----------------------------------------------------------------------===
+ */
+
+#include "int_popcount.h"
+#include <stddef.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_NEON_POPCOUNT 1
+#else
+#define HAVE_NEON_POPCOUNT 0
+#endif
+
+/* Every byte of the per-word sum holds at most 8, so the sums of this many
+ * words fit in a byte.
+ */
+#define SOFT_WORDS_PER_SUM 31
+
+static du_int popcount_soft(const du_int *a, size_t count)
+{
+    du_int total = 0;
+    while (count)
+    {
+        const size_t n = count < SOFT_WORDS_PER_SUM ? count
+                                                    : SOFT_WORDS_PER_SUM;
+        du_int sum = 0;
+        size_t i;
+        for (i = 0; i < n; ++i)
+        {
+            du_int x = a[i];
+            x = x - ((x >> 1) & 0x5555555555555555uLL);
+            x = ((x >> 2) & 0x3333333333333333uLL) +
+                (x & 0x3333333333333333uLL);
+            sum += (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FuLL;
+        }
+        /* Four 16 bit sums of at most 496, then their total in the low 16
+         * bits.
+         */
+        sum = (sum & 0x00FF00FF00FF00FFuLL) +
+              ((sum >> 8) & 0x00FF00FF00FF00FFuLL);
+        sum = sum + (sum >> 16);
+        sum = sum + (sum >> 32);
+        total += sum & 0xFFFF;
+        a += n;
+        count -= n;
+    }
+    return total;
+}
+
+#if COMPILERRT_POPCNT_DISPATCH
+/* Independent sums, as popcnt has a latency of 3 cycles. */
+static du_int popcount_popcnt(const du_int *a, size_t count)
+{
+    du_int s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        s0 += popcnt64(a[i]);
+        s1 += popcnt64(a[i + 1]);
+        s2 += popcnt64(a[i + 2]);
+        s3 += popcnt64(a[i + 3]);
+    }
+    for (; i < count; ++i)
+        s0 += popcnt64(a[i]);
+    return s0 + s1 + s2 + s3;
+}
+#endif
+
+#if HAVE_NEON_POPCOUNT
+/* Each iteration adds at most 16 to the 16 bit lanes. */
+#define NEON_PAIRS_PER_SUM 4096
+
+static du_int popcount_neon(const du_int *a, size_t count)
+{
+    uint64x2_t total = vdupq_n_u64(0);
+    size_t i = 0;
+    while (i + 2 <= count)
+    {
+        size_t end = count - (count - i) % 2;
+        if (end - i > 2 * NEON_PAIRS_PER_SUM)
+            end = i + 2 * NEON_PAIRS_PER_SUM;
+        uint16x8_t sum = vdupq_n_u16(0);
+        for (; i < end; i += 2)
+            sum = vpadalq_u8(sum, vcntq_u8(vld1q_u8((const uint8_t *)(a + i))));
+        total = vpadalq_u32(total, vpaddlq_u16(sum));
+    }
+    du_int r = vgetq_lane_u64(total, 0) + vgetq_lane_u64(total, 1);
+    if (i < count)
+        r += popcount_soft(a + i, count - i);
+    return r;
+}
+#endif
+
+/* Returns: count of 1 bits of the count words at a */
+
+COMPILER_RT_ABI du_int
+__popcountdi2_array(const du_int *a, size_t count)
+{
+#if COMPILERRT_POPCNT_DISPATCH
+    if (__compilerrt_cpu_has(COMPILERRT_CPU_X86_POPCNT))
+        return popcount_popcnt(a, count);
+#endif
+#if HAVE_NEON_POPCOUNT
+    return popcount_neon(a, count);
+#else
+    return popcount_soft(a, count);
+#endif
+}
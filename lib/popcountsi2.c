@@ -12,12 +12,12 @@
  * ===----------------------------------------------------------------------===
  */
 
-#include "int_lib.h"
+#include "int_popcount.h"
 
 /* Returns: count of 1 bits */
 
-COMPILER_RT_ABI si_int
-__popcountsi2(si_int a)
+static si_int
+popcountsi2_soft(si_int a)
 {
     su_int x = (su_int)a;
     x = x - ((x >> 1) & 0x55555555);
@@ -31,3 +31,25 @@ __popcountsi2(si_int a)
     /*    Upper 16 bits are garbage */
     return (x + (x >> 8)) & 0x0000003F;  /* (6 significant bits) */
 }
+
+#if COMPILERRT_POPCNT_DISPATCH
+
+static si_int
+popcountsi2_popcnt(si_int a)
+{
+    return popcnt32((su_int)a);
+}
+
+COMPILERRT_MULTIVERSION(si_int, __popcountsi2, (si_int a), (a),
+    __compilerrt_cpu_has(COMPILERRT_CPU_X86_POPCNT) ? popcountsi2_popcnt
+                                                    : popcountsi2_soft)
+
+#else
+
+COMPILER_RT_ABI si_int
+__popcountsi2(si_int a)
+{
+    return popcountsi2_soft(a);
+}
+
+#endif
@@ -12,14 +12,14 @@
  * ===----------------------------------------------------------------------===
  */
 
-#include "int_lib.h"
+#include "int_popcount.h"
 
 #if __x86_64
 
 /* Returns: count of 1 bits */
 
-si_int
-__popcountti2(ti_int a)
+static si_int
+popcountti2_soft(ti_int a)
 {
     tu_int x3 = (tu_int)a;
     x3 = x3 - ((x3 >> 1) & (((tu_int)0x5555555555555555uLL << 64) |
@@ -41,4 +41,26 @@ __popcountti2(ti_int a)
     return (x + (x >> 8)) & 0xFF;  /* (8 significant bits) */
 }
 
+#if COMPILERRT_POPCNT_DISPATCH
+
+static si_int
+popcountti2_popcnt(ti_int a)
+{
+    return popcnt64((du_int)a) + popcnt64((du_int)((tu_int)a >> 64));
+}
+
+COMPILERRT_MULTIVERSION(si_int, __popcountti2, (ti_int a), (a),
+    __compilerrt_cpu_has(COMPILERRT_CPU_X86_POPCNT) ? popcountti2_popcnt
+                                                    : popcountti2_soft)
+
+#else
+
+si_int
+__popcountti2(ti_int a)
+{
+    return popcountti2_soft(a);
+}
+
+#endif
+
 #endif
@@ -19,6 +19,16 @@ typedef union {
 #define LOWORDER(xy,xHi,xLo,yHi,yLo) \
 	(((((xHi)*(yHi) - (xy)) + (xHi)*(yLo)) + (xLo)*(yHi)) + (xLo)*(yLo))
 
+/* With a fused multiply-add (fmadd, on every POWER with an FPU) the rounding
+ * error of a product is a single instruction, instead of the 26 bit
+ * splitting of LOWORDER.  Build with -DCRT_DD_NO_FMA to keep the splitting.
+ */
+#if defined(__FP_FAST_FMA) && !defined(CRT_DD_NO_FMA)
+#define DD_HAVE_FMA 1
+#else
+#define DD_HAVE_FMA 0
+#endif
+
 static inline double __attribute__((always_inline))
 fabs(double x)
 {
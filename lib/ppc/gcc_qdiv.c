@@ -17,8 +17,7 @@ long double __gcc_qdiv(long double a, long double b)
 	register double x = dst.s.hi, x1 = dst.s.lo,
 					y = src.s.hi, y1 = src.s.lo;
 	
-    double yHi, yLo, qHi, qLo;
-    double yq, tmp, q;
+    double tmp, q;
 	
     q = x / y;
 	
@@ -36,6 +35,12 @@ long double __gcc_qdiv(long double a, long double b)
 		return dst.ld;
 	}
 	
+#if DD_HAVE_FMA
+    /* The remainder of the rounded quotient, exactly. */
+    tmp = __builtin_fma(-y, q, x);
+    tmp = __builtin_fma(-y1, q, tmp + x1) / y;
+#else
+    double yHi, yLo, qHi, qLo, yq;
     yHi = high26bits(y);
     qHi = high26bits(q);
 	
@@ -46,6 +51,7 @@ long double __gcc_qdiv(long double a, long double b)
     tmp = LOWORDER(yq, yHi, yLo, qHi, qLo);
     tmp = (x - yq) - tmp;
     tmp = ((tmp + x1) - y1 * q) / y;
+#endif
     x = q + tmp;
 	
     dst.s.lo = (q - x) + tmp;
@@ -17,7 +17,6 @@ long double __gcc_qmul(long double x, long double y)
 	register double A = dst.s.hi, a = dst.s.lo,
 					B = src.s.hi, b = src.s.lo;
 	
-	double aHi, aLo, bHi, bLo;
     double ab, tmp, tau;
 	
 	ab = A * B;
@@ -37,6 +36,11 @@ long double __gcc_qmul(long double x, long double y)
 	}
 	
 	/* Generic cases handled here. */
+#if DD_HAVE_FMA
+    tmp = __builtin_fma(A, B, -ab);
+    tmp += __builtin_fma(A, b, a * B);
+#else
+    double aHi, aLo, bHi, bLo;
     aHi = high26bits(A);
     bHi = high26bits(B);
     aLo = A - aHi;
@@ -44,6 +48,7 @@ long double __gcc_qmul(long double x, long double y)
 	
     tmp = LOWORDER(ab, aHi, aLo, bHi, bLo);
     tmp += (A * b + a * B);
+#endif
     tau = ab + tmp;
 	
     dst.s.lo = (ab - tau) + tmp;
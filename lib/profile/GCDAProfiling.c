@@ -32,6 +32,23 @@
 #include <direct.h>
 #endif
 
+#if defined(__linux__)
+/* Files are written out by several threads, see llvm_writeout_files(). */
+#define GCDA_PARALLEL_WRITEOUT 1
+#include <pthread.h>
+#include <sys/file.h>
+#include <unistd.h>
+/* Don't require the program to link against libpthread. */
+#pragma weak pthread_create
+#pragma weak pthread_join
+#pragma weak pthread_key_create
+#pragma weak pthread_setspecific
+#define GCDA_THREAD_LOCAL __thread
+#else
+#define GCDA_PARALLEL_WRITEOUT 0
+#define GCDA_THREAD_LOCAL
+#endif
+
 #ifndef _MSC_VER
 #include <stdint.h>
 #else
@@ -45,26 +62,40 @@ typedef unsigned int uint64_t;
  * --- GCOV file format I/O primitives ---
  */
 
+/*
+ * The state of the file being written is per thread, as each writeout
+ * function writes its files from start to end in the same thread.
+ */
+
 /*
  * The current file name we're outputting. Used primarily for error logging.
  */
-static char *filename = NULL;
+static GCDA_THREAD_LOCAL char *filename = NULL;
 
 /*
  * The current file we're outputting.
  */ 
-static FILE *output_file = NULL;
+static GCDA_THREAD_LOCAL FILE *output_file = NULL;
 
 /*
  * Buffer that we write things into.
  */
 #define WRITE_BUFFER_SIZE (128 * 1024)
-static char *write_buffer = NULL;
-static uint64_t cur_buffer_size = 0;
-static uint64_t cur_pos = 0;
-static uint64_t file_size = 0;
-static int new_file = 0;
-static int fd = -1;
+static GCDA_THREAD_LOCAL char *write_buffer = NULL;
+static GCDA_THREAD_LOCAL uint64_t cur_buffer_size = 0;
+static GCDA_THREAD_LOCAL uint64_t cur_pos = 0;
+static GCDA_THREAD_LOCAL uint64_t file_size = 0;
+static GCDA_THREAD_LOCAL int new_file = 0;
+static GCDA_THREAD_LOCAL int fd = -1;
+
+/*
+ * Set while a writeout function is run only to find out whether its files
+ * need to be written: nothing is opened, dry_run_dirty is set if there are
+ * nonzero counters to merge, and dry_run_missing if a file doesn't exist yet.
+ */
+static GCDA_THREAD_LOCAL int dry_run = 0;
+static GCDA_THREAD_LOCAL int dry_run_dirty = 0;
+static GCDA_THREAD_LOCAL int dry_run_missing = 0;
 
 /*
  * A list of functions to write out the data.
@@ -92,10 +123,82 @@ struct flush_fn_node {
 static struct flush_fn_node *flush_fn_head = NULL;
 static struct flush_fn_node *flush_fn_tail = NULL;
 
+/*
+ * With GCOV_KEEP_MAPPED=1 in the environment, the existing .gcda files stay
+ * open and mapped after they are written. Later writeouts update the mapping
+ * in place and only schedule it to be written back (MS_ASYNC), so a periodic
+ * __gcov_flush() neither reopens every file nor waits for the disk. Since the
+ * mapping is shared, the data is visible to the readers of the file as soon
+ * as it is written.
+ */
+struct mapped_file {
+  char *filename;
+  /* Held while the mapping is written, the list itself has its own lock. */
+  volatile int lock;
+  FILE *file;
+  int fd;
+  char *buffer;
+  uint64_t size;
+  struct mapped_file *next;
+};
+
+static struct mapped_file *mapped_files = NULL;
+static volatile int mapped_files_lock = 0;
+static GCDA_THREAD_LOCAL struct mapped_file *cur_mapped_file = NULL;
+static int keep_mapped = -1;
+
+static void spin_lock(volatile int *lock) {
+#if GCDA_PARALLEL_WRITEOUT
+  while (__sync_lock_test_and_set(lock, 1))
+    sched_yield();
+#endif
+}
+
+static void spin_unlock(volatile int *lock) {
+#if GCDA_PARALLEL_WRITEOUT
+  __sync_lock_release(lock);
+#endif
+}
+
+/* Serializes the writers of a file, in this and in the other processes. */
+static void lock_file(int fd) {
+#if GCDA_PARALLEL_WRITEOUT
+  while (flock(fd, LOCK_EX) == -1 && errno == EINTR) { }
+#endif
+}
+
+static void unlock_file(int fd) {
+#if GCDA_PARALLEL_WRITEOUT
+  flock(fd, LOCK_UN);
+#endif
+}
+
+static int keep_files_mapped() {
+  if (keep_mapped == -1) {
+    const char *env = getenv("GCOV_KEEP_MAPPED");
+    keep_mapped = env && atoi(env) != 0;
+  }
+  return keep_mapped;
+}
+
+static struct mapped_file *find_mapped_file(const char *name) {
+  struct mapped_file *curr;
+  spin_lock(&mapped_files_lock);
+  for (curr = mapped_files; curr; curr = curr->next) {
+    if (strcmp(curr->filename, name) == 0)
+      break;
+  }
+  spin_unlock(&mapped_files_lock);
+  return curr;
+}
+
 static void resize_write_buffer(uint64_t size) {
   if (!new_file) return;
   size += cur_pos;
   if (size <= cur_buffer_size) return;
+  /* Grow geometrically, so that large files are not copied over and over. */
+  if (size < cur_buffer_size * 2)
+    size = cur_buffer_size * 2;
   size = (size - 1) / WRITE_BUFFER_SIZE + 1;
   size *= WRITE_BUFFER_SIZE;
   write_buffer = realloc(write_buffer, size);
@@ -218,6 +321,35 @@ static int map_file() {
 }
 
 static void unmap_file() {
+  if (keep_files_mapped()) {
+    /* Keep the mapping for the next writeout, don't wait for the disk. */
+    if (msync(write_buffer, file_size, MS_ASYNC) == -1) {
+      int errnum = errno;
+      fprintf(stderr, "profiling: %s: cannot msync: %s\n", filename,
+              strerror(errnum));
+    }
+    unlock_file(fd);
+    if (cur_mapped_file) {
+      spin_unlock(&cur_mapped_file->lock);
+    } else {
+      struct mapped_file *m = malloc(sizeof(struct mapped_file));
+      m->filename = strdup(filename);
+      m->lock = 0;
+      m->file = output_file;
+      m->fd = fd;
+      m->buffer = write_buffer;
+      m->size = file_size;
+      spin_lock(&mapped_files_lock);
+      m->next = mapped_files;
+      mapped_files = m;
+      spin_unlock(&mapped_files_lock);
+    }
+    cur_mapped_file = NULL;
+    write_buffer = NULL;
+    file_size = 0;
+    return;
+  }
+
   if (msync(write_buffer, file_size, MS_SYNC) == -1) {
     int errnum = errno;
     fprintf(stderr, "profiling: %s: cannot msync: %s\n", filename,
@@ -244,6 +376,31 @@ void llvm_gcda_start_file(const char *orig_filename, const char version[4]) {
   const char *mode = "r+b";
   filename = mangle_filename(orig_filename);
 
+  if (dry_run) {
+    if (access(filename, F_OK) != 0)
+      dry_run_missing = 1;
+    free(filename);
+    filename = NULL;
+    return;
+  }
+
+  if (keep_files_mapped()) {
+    cur_mapped_file = find_mapped_file(filename);
+    if (cur_mapped_file) {
+      /* Reuse the mapping of the previous writeout. */
+      spin_lock(&cur_mapped_file->lock);
+      lock_file(cur_mapped_file->fd);
+      new_file = 0;
+      output_file = cur_mapped_file->file;
+      fd = cur_mapped_file->fd;
+      write_buffer = cur_mapped_file->buffer;
+      file_size = cur_mapped_file->size;
+      cur_buffer_size = 0;
+      cur_pos = 0;
+      goto write_header;
+    }
+  }
+
   /* Try just opening the file. */
   new_file = 0;
   fd = open(filename, O_RDWR);
@@ -267,6 +424,7 @@ void llvm_gcda_start_file(const char *orig_filename, const char version[4]) {
     }
   }
 
+  lock_file(fd);
   output_file = fdopen(fd, mode);
 
   /* Initialize the write buffer. */
@@ -288,6 +446,7 @@ void llvm_gcda_start_file(const char *orig_filename, const char version[4]) {
     }
   }
 
+write_header:
   /* gcda file, version, stamp LLVM. */
   write_bytes("adcg", 4);
   write_bytes(version, 4);
@@ -298,6 +457,124 @@ void llvm_gcda_start_file(const char *orig_filename, const char version[4]) {
 #endif
 }
 
+#if GCDA_PARALLEL_WRITEOUT
+/*
+ * With GCOV_SHARDED_COUNTERS=1 in the environment, the indirect counters are
+ * not incremented in place. Each thread accumulates the increments in its own
+ * small direct-mapped table, and adds them to the counters when an entry is
+ * evicted, when the thread exits and before the files are written out. The
+ * counts of hot counters shared by many threads are then neither lost nor
+ * bounced between the caches.
+ */
+#define COUNTER_SHARD_SIZE 256
+
+struct counter_shard {
+  uint64_t *counters[COUNTER_SHARD_SIZE];
+  /* Only the owner thread increments the counts, the part up to folded is
+   * already added to the counter. */
+  volatile uint64_t counts[COUNTER_SHARD_SIZE];
+  uint64_t folded[COUNTER_SHARD_SIZE];
+  /* Held while an entry is replaced and while the shard is folded. */
+  volatile int lock;
+  volatile int in_use;
+  struct counter_shard *next;
+};
+
+static struct counter_shard *counter_shards = NULL;
+static GCDA_THREAD_LOCAL struct counter_shard *thread_counter_shard = NULL;
+static int sharded_counters = -1;
+static pthread_key_t counter_shard_key;
+
+/* Must be called with the shard locked. */
+static void fold_counter_shard_entry(struct counter_shard *shard, int i) {
+  uint64_t count = shard->counts[i];
+  if (count != shard->folded[i]) {
+    __sync_fetch_and_add(shard->counters[i], count - shard->folded[i]);
+    shard->folded[i] = count;
+  }
+}
+
+static void fold_counter_shard(struct counter_shard *shard) {
+  int i;
+  spin_lock(&shard->lock);
+  for (i = 0; i < COUNTER_SHARD_SIZE; ++i) {
+    if (shard->counters[i])
+      fold_counter_shard_entry(shard, i);
+  }
+  spin_unlock(&shard->lock);
+}
+
+static void fold_counter_shards() {
+  struct counter_shard *shard;
+  for (shard = counter_shards; shard; shard = shard->next)
+    fold_counter_shard(shard);
+}
+
+static void release_counter_shard(void *arg) {
+  struct counter_shard *shard = arg;
+  fold_counter_shard(shard);
+  __sync_lock_release(&shard->in_use);
+}
+
+static void init_sharded_counters() {
+  static volatile int init_lock = 0;
+  const char *env;
+  spin_lock(&init_lock);
+  if (sharded_counters == -1) {
+    env = getenv("GCOV_SHARDED_COUNTERS");
+    sharded_counters = env && atoi(env) != 0 && pthread_key_create &&
+                       pthread_setspecific &&
+                       pthread_key_create(&counter_shard_key,
+                                          release_counter_shard) == 0;
+  }
+  spin_unlock(&init_lock);
+}
+
+static struct counter_shard *get_counter_shard() {
+  struct counter_shard *shard;
+  /* Reuse the shard of an exited thread. */
+  for (shard = counter_shards; shard; shard = shard->next) {
+    if (!shard->in_use && !__sync_lock_test_and_set(&shard->in_use, 1))
+      break;
+  }
+  if (!shard) {
+    shard = calloc(1, sizeof(struct counter_shard));
+    if (!shard)
+      return NULL;
+    shard->in_use = 1;
+    do
+      shard->next = counter_shards;
+    while (!__sync_bool_compare_and_swap(&counter_shards, shard->next, shard));
+  }
+  pthread_setspecific(counter_shard_key, shard);
+  return shard;
+}
+
+/* Returns 0 if the counter has to be incremented in place. */
+static int increment_sharded_counter(uint64_t *counter) {
+  struct counter_shard *shard = thread_counter_shard;
+  uintptr_t idx;
+
+  if (!shard) {
+    shard = thread_counter_shard = get_counter_shard();
+    if (!shard)
+      return 0;
+  }
+  idx = ((uintptr_t)counter / sizeof(uint64_t)) % COUNTER_SHARD_SIZE;
+  if (shard->counters[idx] != counter) {
+    spin_lock(&shard->lock);
+    if (shard->counters[idx])
+      fold_counter_shard_entry(shard, idx);
+    shard->counters[idx] = counter;
+    shard->counts[idx] = shard->folded[idx] = 0;
+    spin_unlock(&shard->lock);
+  }
+  /* A plain increment: only this thread writes the count. */
+  shard->counts[idx]++;
+  return 1;
+}
+#endif
+
 /* Given an array of pointers to counters (counters), increment the n-th one,
  * where we're also given a pointer to n (predecessor).
  */
@@ -313,8 +590,15 @@ void llvm_gcda_increment_indirect_counter(uint32_t *predecessor,
 
   /* Don't crash if the pred# is out of sync. This can happen due to threads,
      or because of a TODO in GCOVProfiling.cpp buildEdgeLookupTable(). */
-  if (counter)
+  if (counter) {
+#if GCDA_PARALLEL_WRITEOUT
+    if (sharded_counters == -1)
+      init_sharded_counters();
+    if (sharded_counters && increment_sharded_counter(counter))
+      return;
+#endif
     ++*counter;
+  }
 #ifdef DEBUG_GCDAPROFILING
   else
     fprintf(stderr,
@@ -350,9 +634,19 @@ void llvm_gcda_emit_function(uint32_t ident, const char *function_name,
 
 void llvm_gcda_emit_arcs(uint32_t num_counters, uint64_t *counters) {
   uint32_t i;
-  uint64_t *old_ctrs = NULL;
   uint32_t val = 0;
   uint64_t save_cur_pos = cur_pos;
+  char *file_ctrs;
+
+  if (dry_run) {
+    for (i = 0; i < num_counters; ++i) {
+      if (counters[i]) {
+        dry_run_dirty = 1;
+        break;
+      }
+    }
+    return;
+  }
 
   if (!output_file) return;
 
@@ -371,23 +665,31 @@ void llvm_gcda_emit_arcs(uint32_t num_counters, uint64_t *counters) {
       return;
     }
 
-    old_ctrs = malloc(sizeof(uint64_t) * num_counters);
-    for (i = 0; i < num_counters; ++i)
-      old_ctrs[i] = read_64bit_value();
-  }
+    if (cur_pos + (uint64_t)num_counters * 8 > file_size) {
+      fprintf(stderr, "profiling: %s: truncated file\n", filename);
+      return;
+    }
 
-  cur_pos = save_cur_pos;
+    /* Merge in place in the mapped file, the record header stays as is. The
+     * counters are only 4-byte aligned in the file. */
+    file_ctrs = &write_buffer[cur_pos];
+    for (i = 0; i < num_counters; ++i) {
+      uint64_t old_ctr;
+      memcpy(&old_ctr, file_ctrs + i * 8, 8);
+      counters[i] += old_ctr;
+      memcpy(file_ctrs + i * 8, &counters[i], 8);
+    }
+    cur_pos += (uint64_t)num_counters * 8;
+  } else {
+    cur_pos = save_cur_pos;
 
-  /* Counter #1 (arcs) tag */
-  write_bytes("\0\0\xa1\1", 4);
-  write_32bit_value(num_counters * 2);
-  for (i = 0; i < num_counters; ++i) {
-    counters[i] += (old_ctrs ? old_ctrs[i] : 0);
-    write_64bit_value(counters[i]);
+    /* Counter #1 (arcs) tag */
+    resize_write_buffer(8 + (uint64_t)num_counters * 8);
+    write_bytes("\0\0\xa1\1", 4);
+    write_32bit_value(num_counters * 2);
+    write_bytes((const char *)counters, (size_t)num_counters * 8);
   }
 
-  free(old_ctrs);
-
 #ifdef DEBUG_GCDAPROFILING
   fprintf(stderr, "llvmgcda:   %u arcs\n", num_counters);
   for (i = 0; i < num_counters; ++i)
@@ -396,6 +698,9 @@ void llvm_gcda_emit_arcs(uint32_t num_counters, uint64_t *counters) {
 }
 
 void llvm_gcda_end_file() {
+  if (dry_run)
+    return;
+
   /* Write out EOF record. */
   if (output_file) {
     write_bytes("\0\0\0\0\0\0\0\0", 8);
@@ -403,11 +708,13 @@ void llvm_gcda_end_file() {
     if (new_file) {
       fwrite(write_buffer, cur_pos, 1, output_file);
       free(write_buffer);
+      fclose(output_file);
     } else {
       unmap_file();
+      if (!keep_files_mapped())
+        fclose(output_file);
     }
 
-    fclose(output_file);
     output_file = NULL;
     write_buffer = NULL;
   }
@@ -431,11 +738,104 @@ void llvm_register_writeout_function(writeout_fn fn) {
   }
 }
 
+/*
+ * Runs the writeout function unless all its files already exist and all its
+ * counters are zero (e.g. nothing ran since the last __gcov_flush()), in
+ * which case merging would not change the files.
+ */
+static void run_writeout_function(writeout_fn fn) {
+  dry_run = 1;
+  dry_run_dirty = 0;
+  dry_run_missing = 0;
+  fn();
+  dry_run = 0;
+  if (dry_run_dirty || dry_run_missing)
+    fn();
+}
+
+#if GCDA_PARALLEL_WRITEOUT
+#define MAX_WRITEOUT_THREADS 16
+
+static struct writeout_fn_node **writeout_queue = NULL;
+static int writeout_queue_size = 0;
+static int writeout_queue_next = 0;
+
+static void *writeout_worker(void *arg) {
+  int i;
+  (void)arg;
+  while ((i = __sync_fetch_and_add(&writeout_queue_next, 1)) <
+         writeout_queue_size)
+    run_writeout_function(writeout_queue[i]->fn);
+  return NULL;
+}
+
+/*
+ * The number of threads writing the files, set with GCOV_WRITEOUT_THREADS.
+ * Defaults to the number of CPUs, up to 8.
+ */
+static int num_writeout_threads(int num_files) {
+  const char *env = getenv("GCOV_WRITEOUT_THREADS");
+  long n = env ? atoi(env) : sysconf(_SC_NPROCESSORS_ONLN);
+  if (!env && n > 8)
+    n = 8;
+  if (n > MAX_WRITEOUT_THREADS)
+    n = MAX_WRITEOUT_THREADS;
+  if (n > num_files)
+    n = num_files;
+  return n < 1 ? 1 : (int)n;
+}
+
+/* Returns 0 if the files could not be written in parallel. */
+static int writeout_files_parallel() {
+  pthread_t threads[MAX_WRITEOUT_THREADS];
+  struct writeout_fn_node *curr;
+  int num_files = 0, num_threads, started = 0, i;
+
+  if (!pthread_create || !pthread_join)
+    return 0;
+  for (curr = writeout_fn_head; curr; curr = curr->next)
+    ++num_files;
+  num_threads = num_writeout_threads(num_files);
+  if (num_threads < 2)
+    return 0;
+  writeout_queue = malloc(sizeof(*writeout_queue) * num_files);
+  if (!writeout_queue)
+    return 0;
+  for (curr = writeout_fn_head, i = 0; curr; curr = curr->next, ++i)
+    writeout_queue[i] = curr;
+  writeout_queue_size = num_files;
+  writeout_queue_next = 0;
+  /* Read the environment before the threads need it. */
+  keep_files_mapped();
+
+  /* This thread is one of the workers. */
+  for (i = 1; i < num_threads; ++i) {
+    if (pthread_create(&threads[started], NULL, writeout_worker, NULL) != 0)
+      break;
+    ++started;
+  }
+  writeout_worker(NULL);
+  for (i = 0; i < started; ++i)
+    pthread_join(threads[i], NULL);
+
+  free(writeout_queue);
+  writeout_queue = NULL;
+  writeout_queue_size = 0;
+  return 1;
+}
+#endif
+
 void llvm_writeout_files() {
   struct writeout_fn_node *curr = writeout_fn_head;
 
+#if GCDA_PARALLEL_WRITEOUT
+  fold_counter_shards();
+  if (writeout_files_parallel())
+    return;
+#endif
+
   while (curr) {
-    curr->fn();
+    run_writeout_function(curr->fn);
     curr = curr->next;
   }
 }
@@ -466,6 +866,10 @@ void llvm_register_flush_function(flush_fn fn) {
 void __gcov_flush() {
   struct flush_fn_node *curr = flush_fn_head;
 
+#if GCDA_PARALLEL_WRITEOUT
+  fold_counter_shards();
+#endif
+
   while (curr) {
     curr->fn();
     curr = curr->next;
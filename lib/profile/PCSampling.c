@@ -0,0 +1,374 @@
+/*===- PCSampling.c - Timer-driven PC sampling profiler -------------------===*\
+|*
+|*                     The LLVM Compiler Infrastructure
+|*
+|* This file is distributed under the University of Illinois Open Source
+|* License. See LICENSE.TXT for details.
+|*
+|*===----------------------------------------------------------------------===*|
+|*
+|* This file implements a statistical profiler which samples the pc of the
+|* running thread on SIGPROF. It needs no instrumentation and is enabled with
+|* LLVM_PROFILE_SAMPLE_FILE=<path> (and optionally LLVM_PROFILE_SAMPLE_RATE,
+|* 100 Hz by default) in the environment, or by calling
+|* llvm_profile_sampling_start(). As this file is only linked in when it is
+|* referenced, the environment is only checked in the programs which call
+|* the API or are linked with -Wl,-u,llvm_profile_sampling_start.
+|*
+|* The signal handler stores the pc in a ring buffer of the current thread.
+|* The rings are drained into a table of counts when the profile is written:
+|* at exit, on llvm_profile_sampling_flush(), and every
+|* LLVM_PROFILE_SAMPLE_FLUSH_SECS seconds if that is set. The file is a text
+|* list of "<module> 0x<offset> <count>" lines, where the offset is relative
+|* to the module load address, so that the profiles from many processes can be
+|* merged. It is written to a temporary file and renamed, so it can be read at
+|* any time.
+|*
+\*===----------------------------------------------------------------------===*/
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__i386__))
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <link.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+/* Don't require the program to link against libpthread. */
+#pragma weak pthread_create
+
+/*
+ * --- Per-thread sample rings ---
+ */
+
+#define SAMPLE_RING_SIZE 4096
+
+struct sample_ring {
+  /* Only the signal handler of the owner thread writes head and dropped, only
+   * the thread draining the rings writes tail. */
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  volatile uint32_t dropped;
+  struct sample_ring *next;
+  uintptr_t pcs[SAMPLE_RING_SIZE];
+};
+
+/* All the rings ever created. The rings of the exited threads are kept, since
+ * the handler can't tell when its thread goes away. */
+static struct sample_ring *sample_rings = NULL;
+static __thread struct sample_ring *thread_sample_ring = NULL;
+
+static char *sample_filename = NULL;
+static int sample_rate = 0;
+static uint64_t samples_dropped = 0;
+
+static struct sample_ring *new_sample_ring() {
+  /* mmap is async-signal-safe, malloc is not. */
+  struct sample_ring *ring = mmap(0, sizeof(struct sample_ring),
+                                  PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring == MAP_FAILED)
+    return NULL;
+  do
+    ring->next = sample_rings;
+  while (!__sync_bool_compare_and_swap(&sample_rings, ring->next, ring));
+  return ring;
+}
+
+static void sample_handler(int sig, siginfo_t *info, void *context) {
+  ucontext_t *uc = context;
+  struct sample_ring *ring = thread_sample_ring;
+  int saved_errno = errno;
+  uint32_t head;
+  uintptr_t pc;
+
+  (void)sig;
+  (void)info;
+#if defined(__x86_64__)
+  pc = uc->uc_mcontext.gregs[REG_RIP];
+#else
+  pc = uc->uc_mcontext.gregs[REG_EIP];
+#endif
+  if (!ring) {
+    ring = thread_sample_ring = new_sample_ring();
+    if (!ring) {
+      errno = saved_errno;
+      return;
+    }
+  }
+  head = ring->head;
+  if (head - ring->tail >= SAMPLE_RING_SIZE) {
+    ring->dropped++;
+  } else {
+    ring->pcs[head % SAMPLE_RING_SIZE] = pc;
+    /* Publish the pc before the new head. */
+    __sync_synchronize();
+    ring->head = head + 1;
+  }
+  errno = saved_errno;
+}
+
+/*
+ * --- Sample counts ---
+ */
+
+struct pc_count {
+  uintptr_t pc;
+  uint64_t count;
+};
+
+/* Open addressing hash table, pc 0 marks an empty entry. */
+static struct pc_count *pc_counts = NULL;
+static size_t pc_counts_size = 0;
+static size_t pc_counts_used = 0;
+static volatile int pc_counts_lock = 0;
+
+static size_t hash_pc(uintptr_t pc, size_t size) {
+  return (size_t)(((uint64_t)pc * 0x9E3779B97F4A7C15ULL) >> 32) & (size - 1);
+}
+
+static struct pc_count *find_pc_count(struct pc_count *table, size_t size,
+                                      uintptr_t pc) {
+  size_t i = hash_pc(pc, size);
+  while (table[i].pc && table[i].pc != pc)
+    i = (i + 1) & (size - 1);
+  return &table[i];
+}
+
+static int grow_pc_counts() {
+  size_t new_size = pc_counts_size ? pc_counts_size * 2 : 4096;
+  struct pc_count *table = calloc(new_size, sizeof(struct pc_count));
+  size_t i;
+  if (!table)
+    return -1;
+  for (i = 0; i < pc_counts_size; ++i) {
+    if (pc_counts[i].pc)
+      *find_pc_count(table, new_size, pc_counts[i].pc) = pc_counts[i];
+  }
+  free(pc_counts);
+  pc_counts = table;
+  pc_counts_size = new_size;
+  return 0;
+}
+
+static void add_sample(uintptr_t pc) {
+  struct pc_count *entry;
+  if (!pc)
+    return;
+  if ((pc_counts_used + 1) * 4 > pc_counts_size * 3 && grow_pc_counts() == -1) {
+    ++samples_dropped;
+    return;
+  }
+  entry = find_pc_count(pc_counts, pc_counts_size, pc);
+  if (!entry->pc) {
+    entry->pc = pc;
+    ++pc_counts_used;
+  }
+  ++entry->count;
+}
+
+/* Must be called with pc_counts_lock held. */
+static void drain_sample_rings() {
+  struct sample_ring *ring;
+  for (ring = sample_rings; ring; ring = ring->next) {
+    uint32_t tail = ring->tail;
+    uint32_t head = ring->head;
+    uint32_t dropped = ring->dropped;
+    __sync_synchronize();
+    for (; tail != head; ++tail)
+      add_sample(ring->pcs[tail % SAMPLE_RING_SIZE]);
+    ring->tail = tail;
+    /* Only the total matters, so don't race with the handler for a reset. */
+    samples_dropped += dropped;
+    __sync_fetch_and_sub(&ring->dropped, dropped);
+  }
+}
+
+/*
+ * --- Profile output ---
+ */
+
+struct module_range {
+  uintptr_t begin;
+  uintptr_t end;
+  uintptr_t base;
+  const char *name;
+};
+
+struct module_list {
+  struct module_range *modules;
+  size_t size;
+  size_t capacity;
+};
+
+static int add_module(struct dl_phdr_info *info, size_t size, void *arg) {
+  struct module_list *list = arg;
+  int i;
+  (void)size;
+  for (i = 0; i < info->dlpi_phnum; ++i) {
+    const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+    struct module_range *m;
+    if (phdr->p_type != PT_LOAD || !(phdr->p_flags & PF_X))
+      continue;
+    if (list->size == list->capacity) {
+      size_t capacity = list->capacity ? list->capacity * 2 : 64;
+      struct module_range *modules =
+          realloc(list->modules, capacity * sizeof(struct module_range));
+      if (!modules)
+        return 1;
+      list->modules = modules;
+      list->capacity = capacity;
+    }
+    m = &list->modules[list->size++];
+    m->begin = info->dlpi_addr + phdr->p_vaddr;
+    m->end = m->begin + phdr->p_memsz;
+    m->base = info->dlpi_addr;
+    m->name = info->dlpi_name;
+  }
+  return 0;
+}
+
+static const struct module_range *find_module(const struct module_list *list,
+                                              uintptr_t pc) {
+  size_t i;
+  for (i = 0; i < list->size; ++i) {
+    if (pc >= list->modules[i].begin && pc < list->modules[i].end)
+      return &list->modules[i];
+  }
+  return NULL;
+}
+
+/* Must be called with pc_counts_lock held. */
+static void write_profile() {
+  struct module_list modules = { NULL, 0, 0 };
+  char exe[4096];
+  char *tmp_filename;
+  ssize_t exe_len;
+  FILE *file;
+  size_t i;
+
+  tmp_filename = malloc(strlen(sample_filename) + 5);
+  if (!tmp_filename)
+    return;
+  strcpy(tmp_filename, sample_filename);
+  strcat(tmp_filename, ".tmp");
+  file = fopen(tmp_filename, "w");
+  if (!file) {
+    int errnum = errno;
+    fprintf(stderr, "profiling: %s: cannot open: %s\n", tmp_filename,
+            strerror(errnum));
+    free(tmp_filename);
+    return;
+  }
+
+  exe_len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+  exe[exe_len > 0 ? exe_len : 0] = '\0';
+  dl_iterate_phdr(add_module, &modules);
+
+  fprintf(file, "# pc samples at %d Hz, %llu dropped\n", sample_rate,
+          (unsigned long long)samples_dropped);
+  for (i = 0; i < pc_counts_size; ++i) {
+    const struct module_range *m;
+    uintptr_t pc = pc_counts[i].pc;
+    if (!pc)
+      continue;
+    m = find_module(&modules, pc);
+    if (m)
+      fprintf(file, "%s 0x%llx %llu\n", *m->name ? m->name : exe,
+              (unsigned long long)(pc - m->base),
+              (unsigned long long)pc_counts[i].count);
+    else
+      fprintf(file, "<unknown> 0x%llx %llu\n", (unsigned long long)pc,
+              (unsigned long long)pc_counts[i].count);
+  }
+  free(modules.modules);
+
+  if (fclose(file) != 0 || rename(tmp_filename, sample_filename) != 0) {
+    int errnum = errno;
+    fprintf(stderr, "profiling: %s: cannot write: %s\n", sample_filename,
+            strerror(errnum));
+  }
+  free(tmp_filename);
+}
+
+/*
+ * --- Sampling API ---
+ */
+
+void llvm_profile_sampling_flush() {
+  if (!sample_filename)
+    return;
+  while (__sync_lock_test_and_set(&pc_counts_lock, 1))
+    sched_yield();
+  drain_sample_rings();
+  write_profile();
+  __sync_lock_release(&pc_counts_lock);
+}
+
+static void *flush_thread(void *arg) {
+  unsigned secs = (unsigned)(uintptr_t)arg;
+  for (;;) {
+    sleep(secs);
+    llvm_profile_sampling_flush();
+  }
+  return NULL;
+}
+
+/* Starts sampling all the threads rate_hz times per second of their CPU
+ * time, writing the profile to filename. Returns 0 on success.
+ */
+int llvm_profile_sampling_start(const char *filename, int rate_hz) {
+  struct sigaction sa;
+  struct itimerval timer;
+  const char *flush_secs;
+  long period_usec;
+
+  if (sample_filename || !filename || rate_hz <= 0 || rate_hz > 1000000)
+    return -1;
+  sample_filename = strdup(filename);
+  sample_rate = rate_hz;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = sample_handler;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGPROF, &sa, NULL) != 0)
+    return -1;
+
+  period_usec = 1000000 / rate_hz;
+  timer.it_interval.tv_sec = period_usec / 1000000;
+  timer.it_interval.tv_usec = period_usec % 1000000;
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, NULL) != 0)
+    return -1;
+
+  atexit(llvm_profile_sampling_flush);
+
+  flush_secs = getenv("LLVM_PROFILE_SAMPLE_FLUSH_SECS");
+  if (flush_secs && atoi(flush_secs) > 0 && pthread_create) {
+    pthread_t thread;
+    pthread_create(&thread, NULL, flush_thread,
+                   (void *)(uintptr_t)atoi(flush_secs));
+  }
+  return 0;
+}
+
+__attribute__((constructor))
+static void init_sampling_from_env() {
+  const char *filename = getenv("LLVM_PROFILE_SAMPLE_FILE");
+  const char *rate = getenv("LLVM_PROFILE_SAMPLE_RATE");
+  if (filename && *filename)
+    llvm_profile_sampling_start(filename, rate ? atoi(rate) : 100);
+}
+
+#endif
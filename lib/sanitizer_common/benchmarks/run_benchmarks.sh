@@ -0,0 +1,58 @@
+#!/bin/bash
+#
+# Builds and runs the sanitizer benchmarks, printing one JSON object per
+# result line (see sanitizer_benchmark.h).
+#
+# Usage: run_benchmarks.sh [benchmark flags, e.g. --reps=3 --filter=mop/]
+# Environment:
+#   CXX    compiler with -fsanitize support (default: clang++)
+#   TOOLS  instrumented builds to run (default: "none asan tsan msan lsan")
+#   OUT    file to write the results to (default: stdout)
+#
+# The runtimes used for asan/tsan/msan/lsan are the ones CXX links by
+# default, so point CXX at a compiler built from this tree. Leak reports of
+# the lsan/report benchmark and tool output go to $BUILD/*.log.
+set -e
+
+ROOT="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+LIB="$ROOT/../.."
+CXX=${CXX:-clang++}
+TOOLS=${TOOLS:-"none asan tsan msan lsan"}
+BUILD=${BUILD:-$ROOT/build}
+FLAGS="-O2 -g -fno-rtti -Wall -Werror -I$LIB -I$LIB/../include"
+
+mkdir -p $BUILD
+if [ "$OUT" != "" ]; then
+  exec > $OUT
+fi
+
+# sanitizer_common itself, built from source like the runtimes. StopTheWorld
+# is not benchmarked here.
+SRCS=""
+for F in $LIB/sanitizer_common/*.cc; do
+  case $F in
+    *_mac.cc|*_win.cc|*_stoptheworld_*) ;;
+    *) SRCS+=" $F" ;;
+  esac
+done
+$CXX -O2 -g -fno-rtti -fno-exceptions -fno-builtin -DSANITIZER_DEBUG=0 \
+  -I$LIB $ROOT/sanitizer_common_benchmarks.cc $SRCS \
+  -o $BUILD/sanitizer_common_benchmarks -lpthread -ldl >&2
+$BUILD/sanitizer_common_benchmarks "$@" 2>$BUILD/sanitizer_common.log
+
+# The same instrumented program under every tool.
+for T in $TOOLS; do
+  case $T in
+    none) TOOL_FLAGS="" ;;
+    asan) TOOL_FLAGS="-fsanitize=address" ;;
+    tsan) TOOL_FLAGS="-fsanitize=thread -fPIE -pie" ;;
+    msan) TOOL_FLAGS="-fsanitize=memory -fPIE -pie" ;;
+    lsan) TOOL_FLAGS="-fsanitize=leak" ;;
+    *) echo "Unknown tool $T" >&2; exit 1 ;;
+  esac
+  $CXX $FLAGS $TOOL_FLAGS -DSANITIZER_BENCHMARK_TOOL=\"$T\" \
+    $ROOT/sanitizer_tool_benchmarks.cc \
+    -o $BUILD/sanitizer_tool_benchmarks.$T -lpthread >&2
+  ASAN_OPTIONS=detect_leaks=1 TSAN_OPTIONS=report_bugs=0 \
+    $BUILD/sanitizer_tool_benchmarks.$T "$@" 2>$BUILD/$T.log
+done
@@ -0,0 +1,203 @@
+//===-- sanitizer_benchmark.h -----------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of *Sanitizer runtime.
+// A tiny harness shared by the sanitizer benchmark programs.
+//
+// Each benchmark runs a fixed number of operations on a fixed number of
+// threads (no auto-scaling), is repeated several times, and is reported as a
+// single JSON object per line, so that the output of several programs and
+// tools can be concatenated and compared between runtime revisions:
+//   {"suite":"...","tool":"...","name":"...","arg":16,"threads":4,
+//    "ops":1048576,"reps":5,"ns_per_op":12.5,"ns_per_op_min":12.1}
+// "ns_per_op" is the median over repetitions of wall time divided by the
+// total number of operations of all threads.
+//
+// Flags: --filter=<substring> --reps=<N> --scale=<percent> --list
+//
+// The harness uses only libc, so it can be included both into programs
+// linked with the sanitizer_common object files and into programs built
+// with -fsanitize=<tool>.
+//===----------------------------------------------------------------------===//
+#ifndef SANITIZER_BENCHMARK_H
+#define SANITIZER_BENCHMARK_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if !defined(__has_feature)
+# define __has_feature(x) 0
+#endif
+
+#ifndef SANITIZER_BENCHMARK_TOOL
+# if __has_feature(address_sanitizer) || defined(__SANITIZE_ADDRESS__)
+#  define SANITIZER_BENCHMARK_TOOL "asan"
+# elif __has_feature(thread_sanitizer) || defined(__SANITIZE_THREAD__)
+#  define SANITIZER_BENCHMARK_TOOL "tsan"
+# elif __has_feature(memory_sanitizer)
+#  define SANITIZER_BENCHMARK_TOOL "msan"
+# else
+#  define SANITIZER_BENCHMARK_TOOL "none"
+# endif
+#endif
+
+namespace __sanitizer_benchmark {
+
+// Runs ops operations on behalf of thread thread_idx (0 <= thread_idx <
+// threads). arg is benchmark specific (e.g. an allocation size).
+typedef void (*BenchmarkFunc)(unsigned long arg, int thread_idx,
+                              unsigned long ops);
+// Called once, single-threaded, before the first repetition.
+typedef void (*BenchmarkSetupFunc)(unsigned long arg, int threads);
+
+const int kMaxBenchmarkThreads = 64;
+const int kMaxBenchmarkReps = 32;
+
+struct BenchmarkOptions {
+  const char *suite;
+  const char *filter;
+  int reps;
+  int scale;  // In percent of the default op counts.
+  bool list;
+};
+
+inline BenchmarkOptions *benchmark_options() {
+  static BenchmarkOptions options = { "", 0, 5, 100, false };
+  return &options;
+}
+
+inline void ParseBenchmarkFlags(const char *suite, int argc, char **argv) {
+  BenchmarkOptions *o = benchmark_options();
+  o->suite = suite;
+  for (int i = 1; i < argc; i++) {
+    const char *a = argv[i];
+    if (strncmp(a, "--filter=", 9) == 0) {
+      o->filter = a + 9;
+    } else if (strncmp(a, "--reps=", 7) == 0) {
+      o->reps = atoi(a + 7);
+    } else if (strncmp(a, "--scale=", 8) == 0) {
+      o->scale = atoi(a + 8);
+    } else if (strcmp(a, "--list") == 0) {
+      o->list = true;
+    } else {
+      fprintf(stderr, "usage: %s [--filter=<substring>] [--reps=<N>] "
+              "[--scale=<percent>] [--list]\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (o->reps < 1) o->reps = 1;
+  if (o->reps > kMaxBenchmarkReps) o->reps = kMaxBenchmarkReps;
+  if (o->scale < 1) o->scale = 1;
+}
+
+inline unsigned long long BenchmarkNanoTime() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Keeps the compiler from optimizing away benchmarked computations.
+template<typename T>
+inline void BenchmarkUse(T *x) {
+  __asm__ __volatile__("" : : "r"(x) : "memory");
+}
+
+struct BenchmarkThreadArgs {
+  BenchmarkFunc func;
+  unsigned long arg;
+  int thread_idx;
+  unsigned long ops;
+  pthread_barrier_t *barrier;
+  unsigned long long start;
+  unsigned long long end;
+};
+
+inline void *BenchmarkThread(void *p) {
+  BenchmarkThreadArgs *a = (BenchmarkThreadArgs *)p;
+  pthread_barrier_wait(a->barrier);
+  a->start = BenchmarkNanoTime();
+  a->func(a->arg, a->thread_idx, a->ops);
+  a->end = BenchmarkNanoTime();
+  return 0;
+}
+
+// Returns the wall time of one repetition in nanoseconds.
+inline unsigned long long RunBenchmarkOnce(BenchmarkFunc func,
+                                           unsigned long arg, int threads,
+                                           unsigned long ops) {
+  if (threads == 1) {
+    unsigned long long start = BenchmarkNanoTime();
+    func(arg, 0, ops);
+    return BenchmarkNanoTime() - start;
+  }
+  pthread_barrier_t barrier;
+  pthread_barrier_init(&barrier, 0, threads);
+  pthread_t tids[kMaxBenchmarkThreads];
+  BenchmarkThreadArgs args[kMaxBenchmarkThreads];
+  for (int i = 0; i < threads; i++) {
+    BenchmarkThreadArgs a = { func, arg, i, ops, &barrier, 0, 0 };
+    args[i] = a;
+    pthread_create(&tids[i], 0, BenchmarkThread, &args[i]);
+  }
+  // Thread creation is not measured: the time runs from the first thread
+  // leaving the barrier to the last thread finishing its operations.
+  unsigned long long start = ~0ULL, end = 0;
+  for (int i = 0; i < threads; i++) {
+    pthread_join(tids[i], 0);
+    if (args[i].start < start) start = args[i].start;
+    if (args[i].end > end) end = args[i].end;
+  }
+  pthread_barrier_destroy(&barrier);
+  return end - start;
+}
+
+// Runs the benchmark name with ops operations per thread (scaled by
+// --scale) and prints the result. Returns false if it was filtered out.
+inline bool RunBenchmark(const char *name, BenchmarkFunc func,
+                         unsigned long arg, int threads, unsigned long ops,
+                         BenchmarkSetupFunc setup = 0) {
+  const BenchmarkOptions *o = benchmark_options();
+  if (o->filter && !strstr(name, o->filter))
+    return false;
+  if (o->list) {
+    printf("%s arg=%lu threads=%d\n", name, arg, threads);
+    return true;
+  }
+  if (threads < 1) threads = 1;
+  if (threads > kMaxBenchmarkThreads) threads = kMaxBenchmarkThreads;
+  ops = ops / 100 * o->scale;
+  if (ops == 0) ops = 1;
+  if (setup)
+    setup(arg, threads);
+  double ns[kMaxBenchmarkReps];
+  double total_ops = (double)ops * threads;
+  for (int r = 0; r < o->reps; r++) {
+    ns[r] = RunBenchmarkOnce(func, arg, threads, ops) / total_ops;
+    // Insertion sort, the arrays are tiny.
+    for (int i = r; i > 0 && ns[i - 1] > ns[i]; i--) {
+      double t = ns[i];
+      ns[i] = ns[i - 1];
+      ns[i - 1] = t;
+    }
+  }
+  printf("{\"suite\":\"%s\",\"tool\":\"%s\",\"name\":\"%s\",\"arg\":%lu,"
+         "\"threads\":%d,\"ops\":%lu,\"reps\":%d,\"ns_per_op\":%.3f,"
+         "\"ns_per_op_min\":%.3f}\n",
+         o->suite, SANITIZER_BENCHMARK_TOOL, name, arg, threads, ops,
+         o->reps, ns[o->reps / 2], ns[0]);
+  fflush(stdout);
+  return true;
+}
+
+}  // namespace __sanitizer_benchmark
+
+#endif  // SANITIZER_BENCHMARK_H
@@ -0,0 +1,298 @@
+//===-- sanitizer_common_benchmarks.cc ------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of *Sanitizer runtime.
+// Benchmarks for the sanitizer_common building blocks shared by the tools:
+// the primary allocator with per-thread caches, the stack depot and the
+// quarantine. Linked with the sanitizer_common object files, not
+// instrumented. See sanitizer_benchmark.h for the output format.
+// The sizeclassmap/ results measure memory instead of time and have their
+// own fields, see RunSizeClassMapBenchmarks().
+//===----------------------------------------------------------------------===//
+#include "sanitizer_common/sanitizer_allocator.h"
+#include "sanitizer_common/sanitizer_allocator_internal.h"
+#include "sanitizer_common/sanitizer_atomic.h"
+#include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_quarantine.h"
+#include "sanitizer_common/sanitizer_stackdepot.h"
+#include "sanitizer_benchmark.h"
+
+using namespace __sanitizer;  // NOLINT
+using namespace __sanitizer_benchmark;  // NOLINT
+
+static const int kThreadCounts[] = { 1, 2, 4, 8 };
+
+// ---------------------- Allocator ---------------------- {{{1
+#if SANITIZER_WORDSIZE == 64
+static const uptr kAllocatorSpace = 0x700000000000ULL;
+static const uptr kAllocatorSize  = 0x010000000000ULL;  // 1T.
+typedef SizeClassAllocator64<
+  kAllocatorSpace, kAllocatorSize, 16, DefaultSizeClassMap> BenchAllocator;
+#else
+static const uptr kRegionSizeLog = 20;
+static const uptr kFlatByteMapSize = (1ULL << 32) >> kRegionSizeLog;
+typedef SizeClassAllocator32<
+  0, 1ULL << 32, 16, CompactSizeClassMap, kRegionSizeLog,
+  FlatByteMap<kFlatByteMapSize> > BenchAllocator;
+#endif
+typedef SizeClassAllocatorLocalCache<BenchAllocator> BenchAllocatorCache;
+
+static BenchAllocator *allocator;
+
+static void AllocatorSetup(unsigned long size, int threads) {
+  if (!allocator) {
+    allocator = new BenchAllocator;
+    allocator->Init();
+  }
+}
+
+// Allocates and frees kBatch chunks at a time, so that both the cache fast
+// path and the refills/drains of the per-thread cache are exercised.
+static void AllocatorAllocFree(unsigned long size, int thread_idx,
+                               unsigned long ops) {
+  static const uptr kBatch = 256;
+  BenchAllocatorCache cache;
+  internal_memset(&cache, 0, sizeof(cache));
+  cache.Init(0);
+  uptr class_id = BenchAllocator::SizeClassMapT::ClassID(size);
+  void *chunks[kBatch];
+  for (unsigned long done = 0; done < ops; done += kBatch) {
+    for (uptr i = 0; i < kBatch; i++) {
+      chunks[i] = cache.Allocate(allocator, class_id);
+      *(uptr *)chunks[i] = i;
+    }
+    BenchmarkUse(chunks);
+    for (uptr i = 0; i < kBatch; i++)
+      cache.Deallocate(allocator, class_id, chunks[i]);
+  }
+  cache.Drain(allocator);
+}
+
+static void RunAllocatorBenchmarks() {
+  for (uptr class_id = 1; class_id < BenchAllocator::kNumClasses;
+       class_id++) {
+    uptr size = BenchAllocator::SizeClassMapT::Size(class_id);
+    // Every size class up to 1K, then powers of two.
+    if (size > 1024 && !IsPowerOfTwo(size))
+      continue;
+    for (uptr t = 0; t < ARRAY_SIZE(kThreadCounts); t++) {
+      unsigned long ops = size <= (1 << 16) ? (1 << 20) : (1 << 14);
+      RunBenchmark("allocator/alloc_free", AllocatorAllocFree, size,
+                   kThreadCounts[t], ops, AllocatorSetup);
+    }
+  }
+}
+
+// ---------------------- Size class maps ---------------------- {{{1
+#if SANITIZER_WORDSIZE == 64
+// Away from kAllocatorSpace and the bitmaps which follow that allocator.
+static const uptr kWasteAllocatorSpace = 0x720000000000ULL;
+
+// Deterministic size distributions, from a LCG.
+struct SizeDistribution {
+  const char *name;
+  uptr (*next)(u64 *state);
+};
+
+static u64 NextRandom(u64 *state) {
+  *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+  return *state >> 33;
+}
+
+static uptr UniformSize1K(u64 *state) { return 1 + NextRandom(state) % 1024; }
+
+static uptr UniformSize64K(u64 *state) {
+  return 1 + NextRandom(state) % 65536;
+}
+
+// As many chunks between 16 and 32 bytes as between 64K and 128K.
+static uptr LogUniformSize(u64 *state) {
+  uptr log = 4 + NextRandom(state) % 13;
+  return (1UL << log) + NextRandom(state) % (1UL << log);
+}
+
+// Mostly small objects with a tail of buffers, the shape of typical C and
+// C++ heaps.
+static uptr MixedSize(u64 *state) {
+  if (NextRandom(state) % 10 < 8)
+    return 1 + NextRandom(state) % 256;
+  return LogUniformSize(state) % 65536 + 1;
+}
+
+static const SizeDistribution kSizeDistributions[] = {
+  { "uniform_1k", UniformSize1K },
+  { "uniform_64k", UniformSize64K },
+  { "log_uniform", LogUniformSize },
+  { "mixed", MixedSize },
+};
+
+// Allocates kNumChunks chunks of the distribution and reports the bytes lost
+// to the rounding to size classes, and the bytes carved out of the regions
+// (what becomes resident once the chunks are used) over the requested ones.
+template <class SizeClassMapT>
+static void RunSizeClassMapWaste(const char *map_name,
+                                 const SizeDistribution &dist) {
+  typedef SizeClassAllocator64<kWasteAllocatorSpace, kAllocatorSize, 0,
+                               SizeClassMapT> WasteAllocator;
+  static const uptr kNumChunks = 1 << 18;
+  char name[64];
+  internal_snprintf(name, sizeof(name), "sizeclassmap/%s", dist.name);
+  const BenchmarkOptions *o = benchmark_options();
+  if (o->filter && !strstr(name, o->filter))
+    return;
+  if (o->list) {
+    printf("%s map=%s\n", name, map_name);
+    return;
+  }
+  WasteAllocator *a = new WasteAllocator;
+  a->Init();
+  SizeClassAllocatorLocalCache<WasteAllocator> *cache =
+      new SizeClassAllocatorLocalCache<WasteAllocator>;
+  internal_memset(cache, 0, sizeof(*cache));
+  cache->Init(0);
+  u64 state = 42;
+  uptr requested = 0, rounded = 0;
+  for (uptr i = 0; i < kNumChunks; i++) {
+    uptr size = dist.next(&state);
+    uptr class_id = SizeClassMapT::ClassID(size);
+    requested += size;
+    rounded += SizeClassMapT::Size(class_id);
+    BenchmarkUse(cache->Allocate(a, class_id));
+  }
+  uptr used = a->TotalMemoryUsed();
+  printf("{\"suite\":\"%s\",\"tool\":\"%s\",\"name\":\"%s\","
+         "\"map\":\"%s\",\"chunks\":%zu,\"requested_bytes\":%zu,"
+         "\"rounding_waste_pct\":%.2f,\"used_overhead_pct\":%.2f}\n",
+         o->suite, SANITIZER_BENCHMARK_TOOL, name, map_name, kNumChunks,
+         requested, 100.0 * (rounded - requested) / requested,
+         100.0 * (used - requested) / requested);
+  fflush(stdout);
+  a->TestOnlyUnmap();
+  delete cache;
+  delete a;
+}
+
+static void RunSizeClassMapBenchmarks() {
+  for (uptr d = 0; d < ARRAY_SIZE(kSizeDistributions); d++) {
+    RunSizeClassMapWaste<DefaultSizeClassMap>("default",
+                                              kSizeDistributions[d]);
+    RunSizeClassMapWaste<DenseSizeClassMap>("dense", kSizeDistributions[d]);
+  }
+}
+#else
+static void RunSizeClassMapBenchmarks() {}
+#endif
+
+// ---------------------- Stack depot ---------------------- {{{1
+static const uptr kStackSize = 16;
+// Makes the stacks of different repetitions distinct.
+static atomic_uint64_t stack_seed;
+
+static void FillStack(uptr *stack, uptr seed) {
+  for (uptr i = 0; i < kStackSize; i++)
+    stack[i] = 0x400000 + seed * kStackSize + i;
+}
+
+static void DepotPutNew(unsigned long arg, int thread_idx,
+                        unsigned long ops) {
+  u64 seed = atomic_fetch_add(&stack_seed, ops, memory_order_relaxed);
+  uptr stack[kStackSize];
+  for (unsigned long i = 0; i < ops; i++) {
+    FillStack(stack, seed + i);
+    StackDepotPut(stack, kStackSize);
+  }
+}
+
+// Stacks that are already in the depot, the common case in the tools.
+static void DepotPutExisting(unsigned long ndistinct, int thread_idx,
+                             unsigned long ops) {
+  uptr stack[kStackSize];
+  for (unsigned long i = 0; i < ops; i++) {
+    FillStack(stack, (1ULL << 40) + i % ndistinct);
+    StackDepotPut(stack, kStackSize);
+  }
+}
+
+static void DepotPutExistingCached(unsigned long ndistinct, int thread_idx,
+                                   unsigned long ops) {
+  StackDepotCache cache;
+  internal_memset(&cache, 0, sizeof(cache));
+  uptr stack[kStackSize];
+  for (unsigned long i = 0; i < ops; i++) {
+    FillStack(stack, (1ULL << 40) + i % ndistinct);
+    StackDepotPutCached(&cache, stack, kStackSize);
+  }
+}
+
+static void RunStackDepotBenchmarks() {
+  for (uptr t = 0; t < ARRAY_SIZE(kThreadCounts); t++) {
+    int threads = kThreadCounts[t];
+    RunBenchmark("stackdepot/put_new", DepotPutNew, kStackSize, threads,
+                 1 << 16);
+    RunBenchmark("stackdepot/put_existing", DepotPutExisting, 64, threads,
+                 1 << 20);
+    RunBenchmark("stackdepot/put_existing", DepotPutExisting, 1 << 14,
+                 threads, 1 << 20);
+    RunBenchmark("stackdepot/put_existing_cached", DepotPutExistingCached, 64,
+                 threads, 1 << 20);
+  }
+}
+
+// ---------------------- Quarantine ---------------------- {{{1
+struct BenchQuarantineNode {
+  uptr size;
+};
+
+struct BenchQuarantineCallback {
+  void RecycleBatch(BenchQuarantineNode **nodes, uptr n) {
+    BenchmarkUse(nodes);
+  }
+  void *Allocate(uptr size) {
+    return InternalAlloc(size);
+  }
+  void Deallocate(void *p) {
+    InternalFree(p);
+  }
+};
+
+typedef Quarantine<BenchQuarantineCallback, BenchQuarantineNode, 8>
+    BenchQuarantine;
+static BenchQuarantine quarantine(LINKER_INITIALIZED);
+static BenchQuarantineNode quarantine_node;
+
+static void QuarantineSetup(unsigned long node_size, int threads) {
+  quarantine.Init(1 << 22, 1 << 18);
+}
+
+// Every Put eventually goes through a drain of the per-thread cache and a
+// recycle of the oldest batches.
+static void QuarantinePutDrain(unsigned long node_size, int thread_idx,
+                               unsigned long ops) {
+  BenchQuarantine::Cache cache;
+  for (unsigned long i = 0; i < ops; i++)
+    quarantine.Put(&cache, BenchQuarantineCallback(), &quarantine_node,
+                   node_size);
+  quarantine.Drain(&cache, BenchQuarantineCallback());
+}
+
+static void RunQuarantineBenchmarks() {
+  for (uptr t = 0; t < ARRAY_SIZE(kThreadCounts); t++) {
+    RunBenchmark("quarantine/put_drain", QuarantinePutDrain, 64,
+                 kThreadCounts[t], 1 << 20, QuarantineSetup);
+  }
+}
+
+int main(int argc, char **argv) {
+  ParseBenchmarkFlags("sanitizer_common", argc, argv);
+  RunAllocatorBenchmarks();
+  RunSizeClassMapBenchmarks();
+  RunStackDepotBenchmarks();
+  RunQuarantineBenchmarks();
+  return 0;
+}
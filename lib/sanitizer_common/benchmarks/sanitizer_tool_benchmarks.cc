@@ -0,0 +1,278 @@
+//===-- sanitizer_tool_benchmarks.cc --------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of *Sanitizer runtime.
+// Benchmarks of instrumented code. The same program is built without
+// instrumentation and with each of -fsanitize=address,thread,memory,leak,
+// so the "tool" field of the results gives the overhead of every tool for
+// the same operations:
+//   mop/*        memory accesses (shadow checks in asan/msan, mops in tsan)
+//   malloc/*     the tool allocator, per size and thread count
+//   sync/*       mutexes and atomics
+//   thread/*     thread creation and joining
+//   lsan/*       leak checker scan rate and report latency (asan, lsan)
+// See sanitizer_benchmark.h for the output format.
+//===----------------------------------------------------------------------===//
+#include "sanitizer_benchmark.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+using namespace __sanitizer_benchmark;  // NOLINT
+
+extern "C" int __lsan_do_recoverable_leak_check() __attribute__((weak));
+
+static const int kThreadCounts[] = { 1, 2, 4, 8 };
+static const int kNumThreadCounts =
+    sizeof(kThreadCounts) / sizeof(kThreadCounts[0]);
+
+// ---------------------- Memory accesses ---------------------- {{{1
+static const unsigned long kMopBufferSize = 1 << 12;
+static char mop_buffers[kMaxBenchmarkThreads][kMopBufferSize]
+    __attribute__((aligned(64)));
+static char shared_buffer[kMopBufferSize] __attribute__((aligned(64)));
+
+template<typename T>
+__attribute__((noinline))
+static void MopWrite(char *buf, unsigned long ops) {
+  const unsigned long n = kMopBufferSize / sizeof(T);
+  volatile T *p = (volatile T *)buf;
+  for (unsigned long done = 0; done < ops; done += n) {
+    for (unsigned long i = 0; i < n; i++)
+      p[i] = (T)i;
+  }
+}
+
+template<typename T>
+__attribute__((noinline))
+static void MopRead(char *buf, unsigned long ops) {
+  const unsigned long n = kMopBufferSize / sizeof(T);
+  volatile T *p = (volatile T *)buf;
+  T sum = 0;
+  for (unsigned long done = 0; done < ops; done += n) {
+    for (unsigned long i = 0; i < n; i++)
+      sum += p[i];
+  }
+  BenchmarkUse(&sum);
+}
+
+template<typename T>
+static void DispatchMop(char *buf, bool write, unsigned long ops) {
+  if (write)
+    MopWrite<T>(buf, ops);
+  else
+    MopRead<T>(buf, ops);
+}
+
+static void Mop(unsigned long size, char *buf, bool write,
+                unsigned long ops) {
+  switch (size) {
+    case 1: DispatchMop<unsigned char>(buf, write, ops); break;
+    case 2: DispatchMop<unsigned short>(buf, write, ops); break;
+    case 4: DispatchMop<unsigned int>(buf, write, ops); break;
+    case 8: DispatchMop<unsigned long long>(buf, write, ops); break;
+  }
+}
+
+static void MopLocalWrite(unsigned long size, int thread_idx,
+                          unsigned long ops) {
+  Mop(size, mop_buffers[thread_idx], true, ops);
+}
+
+static void MopLocalRead(unsigned long size, int thread_idx,
+                         unsigned long ops) {
+  Mop(size, mop_buffers[thread_idx], false, ops);
+}
+
+// All threads read the same memory, the tsan shadow then holds accesses
+// of several threads.
+static void MopSharedRead(unsigned long size, int thread_idx,
+                          unsigned long ops) {
+  Mop(size, shared_buffer, false, ops);
+}
+
+static void MemcpyLocal(unsigned long size, int thread_idx,
+                        unsigned long ops) {
+  char *buf = mop_buffers[thread_idx];
+  for (unsigned long i = 0; i < ops; i++) {
+    memcpy(buf + kMopBufferSize / 2, buf, size);
+    BenchmarkUse(buf);
+  }
+}
+
+static void RunMopBenchmarks() {
+  for (int t = 0; t < kNumThreadCounts; t++) {
+    for (unsigned long size = 1; size <= 8; size *= 2) {
+      RunBenchmark("mop/local_write", MopLocalWrite, size, kThreadCounts[t],
+                   1 << 24);
+      RunBenchmark("mop/local_read", MopLocalRead, size, kThreadCounts[t],
+                   1 << 24);
+    }
+    RunBenchmark("mop/shared_read", MopSharedRead, 8, kThreadCounts[t],
+                 1 << 24);
+    for (unsigned long size = 16; size <= kMopBufferSize / 2; size *= 8)
+      RunBenchmark("mop/memcpy", MemcpyLocal, size, kThreadCounts[t],
+                   1 << 20);
+  }
+}
+
+// ---------------------- Allocator ---------------------- {{{1
+static void MallocFree(unsigned long size, int thread_idx,
+                       unsigned long ops) {
+  static const unsigned long kBatch = 64;
+  void *chunks[kBatch];
+  for (unsigned long done = 0; done < ops; done += kBatch) {
+    for (unsigned long i = 0; i < kBatch; i++)
+      chunks[i] = malloc(size);
+    BenchmarkUse(chunks);
+    for (unsigned long i = 0; i < kBatch; i++)
+      free(chunks[i]);
+  }
+}
+
+static void RunMallocBenchmarks() {
+  for (int t = 0; t < kNumThreadCounts; t++) {
+    for (unsigned long size = 16; size <= (1 << 20); size *= 4) {
+      RunBenchmark("malloc/malloc_free", MallocFree, size, kThreadCounts[t],
+                   size <= (1 << 12) ? (1 << 20) : (1 << 14));
+    }
+  }
+}
+
+// ---------------------- Synchronization ---------------------- {{{1
+static pthread_mutex_t mutexes[kMaxBenchmarkThreads];
+static pthread_mutex_t shared_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long shared_counter;
+
+static void SyncSetup(unsigned long arg, int threads) {
+  for (int i = 0; i < kMaxBenchmarkThreads; i++)
+    pthread_mutex_init(&mutexes[i], 0);
+}
+
+static void MutexLocal(unsigned long arg, int thread_idx,
+                       unsigned long ops) {
+  pthread_mutex_t *m = &mutexes[thread_idx];
+  for (unsigned long i = 0; i < ops; i++) {
+    pthread_mutex_lock(m);
+    pthread_mutex_unlock(m);
+  }
+}
+
+static void MutexShared(unsigned long arg, int thread_idx,
+                        unsigned long ops) {
+  for (unsigned long i = 0; i < ops; i++) {
+    pthread_mutex_lock(&shared_mutex);
+    shared_counter++;
+    pthread_mutex_unlock(&shared_mutex);
+  }
+}
+
+static void AtomicShared(unsigned long arg, int thread_idx,
+                         unsigned long ops) {
+  for (unsigned long i = 0; i < ops; i++)
+    __sync_fetch_and_add(&shared_counter, 1);
+}
+
+static void RunSyncBenchmarks() {
+  for (int t = 0; t < kNumThreadCounts; t++) {
+    RunBenchmark("sync/mutex_local", MutexLocal, 0, kThreadCounts[t], 1 << 20,
+                 SyncSetup);
+    RunBenchmark("sync/mutex_shared", MutexShared, 0, kThreadCounts[t],
+                 1 << 20);
+    RunBenchmark("sync/atomic_shared", AtomicShared, 0, kThreadCounts[t],
+                 1 << 20);
+  }
+}
+
+// ---------------------- Threads ---------------------- {{{1
+static void *EmptyThread(void *arg) {
+  return arg;
+}
+
+static void ThreadCreateJoin(unsigned long arg, int thread_idx,
+                             unsigned long ops) {
+  for (unsigned long i = 0; i < ops; i++) {
+    pthread_t t;
+    pthread_create(&t, 0, EmptyThread, 0);
+    pthread_join(t, 0);
+  }
+}
+
+static void RunThreadBenchmarks() {
+  for (int t = 0; t < kNumThreadCounts; t++) {
+    RunBenchmark("thread/create_join", ThreadCreateJoin, 0, kThreadCounts[t],
+                 1 << 10);
+  }
+}
+
+// ---------------------- Leak checking ---------------------- {{{1
+static void **live_blocks;
+static unsigned long num_live_blocks;
+
+// arg blocks of 64 bytes, all reachable from a global.
+static void LeakCheckSetup(unsigned long nblocks, int threads) {
+  for (unsigned long i = 0; i < num_live_blocks; i++)
+    free(live_blocks[i]);
+  free(live_blocks);
+  live_blocks = (void **)malloc(nblocks * sizeof(void *));
+  for (unsigned long i = 0; i < nblocks; i++)
+    live_blocks[i] = malloc(64);
+  num_live_blocks = nblocks;
+}
+
+// Each op is a full leak check, without leaks: this is the scan rate.
+static void LeakCheckNoLeaks(unsigned long nblocks, int thread_idx,
+                             unsigned long ops) {
+  for (unsigned long i = 0; i < ops; i++)
+    __lsan_do_recoverable_leak_check();
+}
+
+// Allocates a block depth frames down, so that blocks allocated at different
+// depths have different stacks and are reported separately.
+__attribute__((noinline))
+static void *AllocateAtDepth(unsigned long depth) {
+  void *p = depth ? AllocateAtDepth(depth - 1) : malloc(64);
+  BenchmarkUse(&p);  // Not a tail call.
+  return p;
+}
+
+// arg leaked blocks with distinct allocation stacks are reported on every
+// check: this is the report latency.
+static void LeakReportSetup(unsigned long nleaks, int threads) {
+  for (unsigned long i = 0; i < nleaks; i++) {
+    void *p = AllocateAtDepth(i);
+    BenchmarkUse(&p);
+  }
+}
+
+static void LeakCheckWithLeaks(unsigned long nleaks, int thread_idx,
+                               unsigned long ops) {
+  for (unsigned long i = 0; i < ops; i++)
+    __lsan_do_recoverable_leak_check();
+}
+
+static void RunLeakCheckBenchmarks() {
+  if (!&__lsan_do_recoverable_leak_check)
+    return;
+  for (unsigned long n = 1 << 10; n <= (1 << 20); n *= 32)
+    RunBenchmark("lsan/scan", LeakCheckNoLeaks, n, 1, 20, LeakCheckSetup);
+  // The reports go to stderr.
+  RunBenchmark("lsan/report", LeakCheckWithLeaks, 16, 1, 20,
+               LeakReportSetup);
+}
+
+int main(int argc, char **argv) {
+  ParseBenchmarkFlags("tool", argc, argv);
+  RunMopBenchmarks();
+  RunMallocBenchmarks();
+  RunSyncBenchmarks();
+  RunThreadBenchmarks();
+  RunLeakCheckBenchmarks();
+  return 0;
+}
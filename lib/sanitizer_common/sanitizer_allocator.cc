@@ -110,18 +110,27 @@ void InternalFree(void *addr, InternalAllocatorCache *cache) {
 // LowLevelAllocator
 static LowLevelAllocateCallback low_level_alloc_callback;
 
+// Every mapping costs a syscall and a VMA, so small requests are carved from
+// chunks of this size.
+static const uptr kLowLevelAllocatorChunkSize = 1 << 16;
+
+static char *LowLevelMap(uptr size) {
+  char *res = (char*)MmapOrDie(size, "LowLevelAllocator");
+  if (low_level_alloc_callback)
+    low_level_alloc_callback((uptr)res, size);
+  return res;
+}
+
 void *LowLevelAllocator::Allocate(uptr size) {
   // Align allocation size.
   size = RoundUpTo(size, 8);
   if (allocated_end_ - allocated_current_ < (sptr)size) {
-    uptr size_to_allocate = Max(size, GetPageSizeCached());
-    allocated_current_ =
-        (char*)MmapOrDie(size_to_allocate, __FUNCTION__);
-    allocated_end_ = allocated_current_ + size_to_allocate;
-    if (low_level_alloc_callback) {
-      low_level_alloc_callback((uptr)allocated_current_,
-                               size_to_allocate);
-    }
+    // Large requests get a mapping of their own, so that the rest of the
+    // current chunk is not thrown away.
+    if (size > kLowLevelAllocatorChunkSize / 4)
+      return LowLevelMap(RoundUpTo(size, GetPageSizeCached()));
+    allocated_current_ = LowLevelMap(kLowLevelAllocatorChunkSize);
+    allocated_end_ = allocated_current_ + kLowLevelAllocatorChunkSize;
   }
   CHECK(allocated_end_ - allocated_current_ >= (sptr)size);
   void *res = allocated_current_;
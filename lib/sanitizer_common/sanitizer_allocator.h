@@ -83,25 +83,36 @@ namespace __sanitizer {
 // c51 => s: 114688 diff: +16384 16% l 16 cached: 1 114688; id 51
 //
 // c52 => s: 131072 diff: +16384 14% l 17 cached: 1 131072; id 52
-
-template <uptr kMaxSizeLog, uptr kMaxNumCachedT, uptr kMaxBytesCachedLog>
+//
+// kNumBits is the log of the number of classes per power of two above
+// kMidSize (2 above, i.e. 4 classes). With kNumBits = 3 the classes are
+// 2^k + i * 2^(k-3) (i = 1 to 8): the difference between two consequent size
+// classes is at most 12.5%, at the price of twice as many classes above
+// kMidSize. See DenseSizeClassMap.
+template <uptr kMaxSizeLog, uptr kMaxNumCachedT, uptr kMaxBytesCachedLog,
+          uptr kNumBits = 2>
 class SizeClassMap {
   static const uptr kMinSizeLog = 4;
   static const uptr kMidSizeLog = kMinSizeLog + 4;
   static const uptr kMinSize = 1 << kMinSizeLog;
   static const uptr kMidSize = 1 << kMidSizeLog;
   static const uptr kMidClass = kMidSize / kMinSize;
-  static const uptr S = 2;
+  static const uptr S = kNumBits;
   static const uptr M = (1 << S) - 1;
+  COMPILER_CHECK(S >= 1 && S <= kMidSizeLog - kMinSizeLog);
 
  public:
   static const uptr kMaxNumCached = kMaxNumCachedT;
+  static const uptr kMaxBytesCached = 1UL << kMaxBytesCachedLog;
   // We transfer chunks between central and thread-local free lists in batches.
   // For small size classes we allocate batches separately.
   // For large size classes we use one of the chunks to store the batch.
+  // A pristine batch holds chunks that were never handed out, so they are
+  // still zero, except for the batch itself if it is stored in a chunk.
   struct TransferBatch {
     TransferBatch *next;
-    uptr count;
+    u32 count;
+    u32 pristine;
     void *batch[kMaxNumCached];
   };
 
@@ -133,6 +144,9 @@ class SizeClassMap {
     return kMidClass + (l1 << S) + hbits + (lbits > 0);
   }
 
+  // Nothing to precompute for this size class map.
+  static void Init() { }
+
   static uptr MaxCached(uptr class_id) {
     if (class_id == 0) return 0;
     uptr n = (1UL << kMaxBytesCachedLog) / Size(class_id);
@@ -191,6 +205,85 @@ class SizeClassMap {
 
 typedef SizeClassMap<17, 128, 16> DefaultSizeClassMap;
 typedef SizeClassMap<17, 64,  14> CompactSizeClassMap;
+// For the tools which are bound by memory rather than by CPU: 8 classes per
+// power of two, so that at most 1/9 of a chunk above 256 bytes is lost to
+// rounding (1/5 with DefaultSizeClassMap). There are 89 classes instead of
+// 53, so half as many chunks and bytes are cached per class: a full
+// thread-local cache holds about as much as with the default map (2.9M vs
+// 2.5M) and a TransferBatch of 64 chunks takes 528 bytes instead of 1040.
+typedef SizeClassMap<17, 64,  15, 3> DenseSizeClassMap;
+
+// TableSizeClassMap has the same size classes as SizeClassMap, but computes
+// ClassID() with a table lookup instead of MostSignificantSetBitIndex and
+// branches.
+// Sizes up to kL1MaxSize are looked up with kMinSize granularity. Above that
+// the distance between two size classes is at least kL2Granularity, so the
+// second level table has kL2Granularity granularity. For the default maps
+// both tables together take 384 bytes.
+// The tables are filled by Init(), which is called by the primary allocators.
+// Until then ClassID() falls back to the computation.
+template <uptr kMaxSizeLog, uptr kMaxNumCachedT, uptr kMaxBytesCachedLog,
+          uptr kNumBits = 2>
+class TableSizeClassMap
+    : public SizeClassMap<kMaxSizeLog, kMaxNumCachedT, kMaxBytesCachedLog,
+                          kNumBits> {
+  typedef SizeClassMap<kMaxSizeLog, kMaxNumCachedT, kMaxBytesCachedLog,
+                       kNumBits> Base;
+  static const uptr kMinSizeLog = 4;
+  static const uptr kL1MaxSizeLog = 12;
+  static const uptr kL1MaxSize = 1 << kL1MaxSizeLog;
+  static const uptr kL2GranularityLog = kL1MaxSizeLog - kNumBits;
+  static const uptr kL2Granularity = 1 << kL2GranularityLog;
+  COMPILER_CHECK(kMaxSizeLog > kL1MaxSizeLog);
+
+ public:
+  static const uptr kL1TableSize = (kL1MaxSize >> kMinSizeLog) + 1;
+  static const uptr kL2TableSize = (Base::kMaxSize >> kL2GranularityLog) + 1;
+
+  static void Init() {
+    for (uptr i = 0; i < kL1TableSize; i++)
+      l1_table_[i] = static_cast<u8>(Base::ClassID(i << kMinSizeLog));
+    for (uptr i = 0; i < kL2TableSize; i++)
+      l2_table_[i] = static_cast<u8>(Base::ClassID(i << kL2GranularityLog));
+  }
+
+  static uptr ClassID(uptr size) {
+    uptr res;
+    if (size <= kL1MaxSize)
+      res = l1_table_[(size + (1 << kMinSizeLog) - 1) >> kMinSizeLog];
+    else if (size <= Base::kMaxSize)
+      res = l2_table_[(size + kL2Granularity - 1) >> kL2GranularityLog];
+    else
+      return 0;
+    if (LIKELY(res))
+      return res;
+    return Base::ClassID(size);
+  }
+
+  static void Validate() {
+    Init();
+    for (uptr s = 0; s <= Base::kMaxSize + 1; s++)
+      CHECK_EQ(ClassID(s), Base::ClassID(s));
+    Base::Validate();
+  }
+
+ private:
+  static u8 l1_table_[kL1TableSize];
+  static u8 l2_table_[kL2TableSize];
+};
+
+template <uptr kMaxSizeLog, uptr kMaxNumCachedT, uptr kMaxBytesCachedLog,
+          uptr kNumBits>
+u8 TableSizeClassMap<kMaxSizeLog, kMaxNumCachedT, kMaxBytesCachedLog,
+                     kNumBits>::l1_table_[kL1TableSize];
+template <uptr kMaxSizeLog, uptr kMaxNumCachedT, uptr kMaxBytesCachedLog,
+          uptr kNumBits>
+u8 TableSizeClassMap<kMaxSizeLog, kMaxNumCachedT, kMaxBytesCachedLog,
+                     kNumBits>::l2_table_[kL2TableSize];
+
+typedef TableSizeClassMap<17, 128, 16> DefaultTableSizeClassMap;
+typedef TableSizeClassMap<17, 64,  14> CompactTableSizeClassMap;
+typedef TableSizeClassMap<17, 64,  15, 3> DenseTableSizeClassMap;
 template<class SizeClassAllocator> struct SizeClassAllocatorLocalCache;
 
 // Memory allocator statistics
@@ -199,6 +292,8 @@ enum AllocatorStat {
   AllocatorStatFreed,
   AllocatorStatMmapped,
   AllocatorStatUnmapped,
+  AllocatorStatRefills,  // Calls to LocalCache::Refill.
+  AllocatorStatDrains,   // Calls to LocalCache::Drain for one class.
   AllocatorStatCount
 };
 
@@ -273,10 +368,12 @@ class AllocatorGlobalStats : public AllocatorStats {
   mutable SpinMutex mu_;
 };
 
-// Allocators call these callbacks on mmap/munmap.
+// Allocators call these callbacks on mmap/munmap, and OnRelease when the
+// pages of free chunks are returned to the OS (the range stays mapped).
 struct NoOpMapUnmapCallback {
   void OnMap(uptr p, uptr size) const { }
   void OnUnmap(uptr p, uptr size) const { }
+  void OnRelease(uptr p, uptr size) const { }
 };
 
 // Callback type for iterating over chunks.
@@ -298,20 +395,57 @@ typedef void (*ForEachChunkCallback)(uptr chunk, void *arg);
 //
 // A Region looks like this:
 // UserChunk1 ... UserChunkN <gap> MetaChunkN ... MetaChunk1
+//
+// Each Region keeps its free TransferBatches in kNumFreeListShards lock-free
+// stacks. A thread-local cache always uses the same shard (chosen by hashing
+// the address of its stats), so with many threads the CAS traffic on hot size
+// classes is spread over several cache lines. A cache steals from the other
+// shards only when its own shard is empty.
+//
+// With kNumNodes > 1 each Region is further split into kNumNodes NodeRegions
+// with their own chunks, metadata and free lists. In NUMA mode a cache gets
+// its chunks from the NodeRegion of the NUMA node it runs on, and the
+// chunks go back to the NodeRegion they came from, so memory keeps being
+// used by the node which touched it (and its shadow) first. Otherwise the
+// NodeRegions are used in turn as they fill up.
+//
+// Each NodeRegion also has a bitmap with one bit per chunk, set while the
+// chunk is out of the free lists (allocated, or in a local cache). The bits
+// are updated in AllocateBatch() and DeallocateBatch(), so ForEachChunk()
+// only visits these chunks instead of every chunk ever carved out of the
+// NodeRegion. The bitmaps live in a NORESERVE mapping after the RegionInfo
+// array; if that range can not be mapped, all the chunks are visited.
 template <const uptr kSpaceBeg, const uptr kSpaceSize,
           const uptr kMetadataSize, class SizeClassMap,
-          class MapUnmapCallback = NoOpMapUnmapCallback>
+          class MapUnmapCallback = NoOpMapUnmapCallback,
+          const uptr kNumFreeListShards = 1, const uptr kNumNodes = 1>
 class SizeClassAllocator64 {
  public:
   typedef typename SizeClassMap::TransferBatch Batch;
   typedef SizeClassAllocator64<kSpaceBeg, kSpaceSize, kMetadataSize,
-      SizeClassMap, MapUnmapCallback> ThisT;
+      SizeClassMap, MapUnmapCallback, kNumFreeListShards, kNumNodes> ThisT;
   typedef SizeClassAllocatorLocalCache<ThisT> AllocatorCache;
 
   void Init() {
     CHECK_EQ(kSpaceBeg,
              reinterpret_cast<uptr>(Mprotect(kSpaceBeg, kSpaceSize)));
     MapWithCallback(kSpaceEnd, AdditionalSize());
+    SizeClassMap::Init();
+    InitLiveChunkBitmaps();
+    release_to_os_interval_ms_ = -1;
+    atomic_store(&last_release_ns_, 0, memory_order_relaxed);
+    numa_mode_ = false;
+  }
+
+  // If interval_ms is non-negative, DeallocateBatch() calls ReleaseToOS()
+  // at most once per interval_ms milliseconds.
+  void SetReleaseToOSIntervalMs(s32 interval_ms) {
+    release_to_os_interval_ms_ = interval_ms;
+  }
+
+  // Has no effect unless kNumNodes > 1.
+  void SetNumaMode(bool enable) {
+    numa_mode_ = enable;
   }
 
   void MapWithCallback(uptr beg, uptr size) {
@@ -332,25 +466,59 @@ class SizeClassAllocator64 {
   NOINLINE Batch* AllocateBatch(AllocatorStats *stat, AllocatorCache *c,
                                 uptr class_id) {
     CHECK_LT(class_id, kNumClasses);
-    RegionInfo *region = GetRegionInfo(class_id);
-    Batch *b = region->free_list.Pop();
-    if (b == 0)
-      b = PopulateFreeList(stat, c, class_id, region);
+    uptr node = kNumNodes > 1 && numa_mode_ ? GetCurrentNumaNode() : 0;
+    RegionInfo *region = GetRegionInfo(class_id, node % kNumNodes);
+    uptr shard = GetShardIdx(stat);
+    Batch *b = PopFromShards(region, shard);
+    // Fall back to the other nodes when the NodeRegion is full.
+    for (uptr i = 0; b == 0 && i < kNumNodes; i++) {
+      uptr n = (node + i) % kNumNodes;
+      region = GetRegionInfo(class_id, n);
+      b = PopulateFreeList(stat, c, class_id, n, region, shard);
+    }
+    if (b == 0) {
+      Printf("%s: Out of memory. Dying. ", SanitizerToolName);
+      Printf("The process has exhausted %zuMB for size class %zu.\n",
+          kRegionSize / 1024 / 1024, SizeClassMap::Size(class_id));
+      Die();
+    }
     region->n_allocated += b->count;
+    MarkLiveChunks(class_id, b, true);
     return b;
   }
 
   NOINLINE void DeallocateBatch(AllocatorStats *stat, uptr class_id, Batch *b) {
-    RegionInfo *region = GetRegionInfo(class_id);
     CHECK_GT(b->count, 0);
-    region->free_list.Push(b);
+    RegionInfo *region = GetRegionInfo(class_id, GetNode(b->batch[0]));
+    // Before the push: once in the free list, the chunks may be handed out
+    // again and marked live by another thread.
+    MarkLiveChunks(class_id, b, false);
+    region->shards[GetShardIdx(stat)].free_list.Push(b);
     region->n_freed += b->count;
+    if (release_to_os_interval_ms_ >= 0)
+      MaybeReleaseToOS();
+  }
+
+  // Returns the pages which are entirely covered by free chunks to the OS.
+  // The memory stays mapped and reads as zeroes when it is touched again.
+  void ReleaseToOS() {
+    InternalMmapVector<Batch *> batches(1 << 10);
+    InternalMmapVector<uptr> chunks(1 << 12);
+    for (uptr class_id = 1; class_id < kNumClasses; class_id++)
+      for (uptr node = 0; node < kNumNodes; node++)
+        ReleaseFreeMemoryToOS(class_id, node, &batches, &chunks);
   }
 
   static bool PointerIsMine(const void *p) {
     return reinterpret_cast<uptr>(p) / kSpaceSize == kSpaceBeg / kSpaceSize;
   }
 
+  // Returns the range which contains all the chunks.
+  static void GetAddressRange(uptr *begin, uptr *end) {
+    *begin = kSpaceBeg;
+    *end = kSpaceBeg + kSpaceSize;
+  }
+
   static uptr GetSizeClass(const void *p) {
     return (reinterpret_cast<uptr>(p) / kRegionSize) % kNumClassesRounded;
   }
@@ -360,11 +528,11 @@ class SizeClassAllocator64 {
     uptr size = SizeClassMap::Size(class_id);
     if (!size) return 0;
     uptr chunk_idx = GetChunkIdx((uptr)p, size);
-    uptr reg_beg = (uptr)p & ~(kRegionSize - 1);
+    uptr reg_beg = (uptr)p & ~(kNodeRegionSize - 1);
     uptr beg = chunk_idx * size;
     uptr next_beg = beg + size;
     if (class_id >= kNumClasses) return 0;
-    RegionInfo *region = GetRegionInfo(class_id);
+    RegionInfo *region = GetRegionInfo(class_id, GetNode(p));
     if (region->mapped_user >= next_beg)
       return reinterpret_cast<void*>(reg_beg + beg);
     return 0;
@@ -381,74 +549,106 @@ class SizeClassAllocator64 {
     uptr class_id = GetSizeClass(p);
     uptr size = SizeClassMap::Size(class_id);
     uptr chunk_idx = GetChunkIdx(reinterpret_cast<uptr>(p), size);
-    return reinterpret_cast<void*>(kSpaceBeg + (kRegionSize * (class_id + 1)) -
+    uptr reg_beg = reinterpret_cast<uptr>(p) & ~(kNodeRegionSize - 1);
+    return reinterpret_cast<void*>(reg_beg + kNodeRegionSize -
                                    (1 + chunk_idx) * kMetadataSize);
   }
 
   uptr TotalMemoryUsed() {
     uptr res = 0;
-    for (uptr i = 0; i < kNumClasses; i++)
-      res += GetRegionInfo(i)->allocated_user;
+    for (uptr i = 0; i < kNumClasses * kNumNodes; i++)
+      res += GetRegionInfo(i / kNumNodes, i % kNumNodes)->allocated_user;
+    return res;
+  }
+
+  // Total number of bytes returned to the OS by ReleaseToOS() so far.
+  // The same page is counted again each time it is released.
+  uptr TotalMemoryReleased() {
+    uptr res = 0;
+    for (uptr i = 0; i < kNumClasses * kNumNodes; i++)
+      res += GetRegionInfo(i / kNumNodes, i % kNumNodes)->released_user;
     return res;
   }
 
   // Test-only.
   void TestOnlyUnmap() {
     UnmapWithCallback(kSpaceBeg, kSpaceSize + AdditionalSize());
+    if (live_bitmaps_size_)
+      UnmapOrDie(reinterpret_cast<void *>(kSpaceEnd + AdditionalSize()),
+                 live_bitmaps_size_);
   }
 
   void PrintStats() {
     uptr total_mapped = 0;
+    uptr total_released = 0;
     uptr n_allocated = 0;
     uptr n_freed = 0;
-    for (uptr class_id = 1; class_id < kNumClasses; class_id++) {
-      RegionInfo *region = GetRegionInfo(class_id);
+    for (uptr i = kNumNodes; i < kNumClasses * kNumNodes; i++) {
+      RegionInfo *region = GetRegionInfo(i / kNumNodes, i % kNumNodes);
       total_mapped += region->mapped_user;
+      total_released += region->released_user;
       n_allocated += region->n_allocated;
       n_freed += region->n_freed;
     }
     Printf("Stats: SizeClassAllocator64: %zdM mapped in %zd allocations; "
-           "remains %zd\n",
-           total_mapped >> 20, n_allocated, n_allocated - n_freed);
+           "remains %zd; released %zdM\n",
+           total_mapped >> 20, n_allocated, n_allocated - n_freed,
+           total_released >> 20);
     for (uptr class_id = 1; class_id < kNumClasses; class_id++) {
-      RegionInfo *region = GetRegionInfo(class_id);
-      if (region->mapped_user == 0) continue;
-      Printf("  %02zd (%zd): total: %zd K allocs: %zd remains: %zd\n",
+      uptr mapped = 0, released = 0, allocated = 0, freed = 0;
+      for (uptr node = 0; node < kNumNodes; node++) {
+        RegionInfo *region = GetRegionInfo(class_id, node);
+        mapped += region->mapped_user;
+        released += region->released_user;
+        allocated += region->n_allocated;
+        freed += region->n_freed;
+      }
+      if (mapped == 0) continue;
+      Printf("  %02zd (%zd): total: %zd K allocs: %zd remains: %zd "
+             "released: %zd K\n",
              class_id,
              SizeClassMap::Size(class_id),
-             region->mapped_user >> 10,
-             region->n_allocated,
-             region->n_allocated - region->n_freed);
+             mapped >> 10,
+             allocated,
+             allocated - freed,
+             released >> 10);
     }
   }
 
   // ForceLock() and ForceUnlock() are needed to implement Darwin malloc zone
   // introspection API.
   void ForceLock() {
-    for (uptr i = 0; i < kNumClasses; i++) {
-      GetRegionInfo(i)->mutex.Lock();
+    for (uptr i = 0; i < kNumClasses * kNumNodes; i++) {
+      GetRegionInfo(i / kNumNodes, i % kNumNodes)->mutex.Lock();
     }
   }
 
   void ForceUnlock() {
-    for (int i = (int)kNumClasses - 1; i >= 0; i--) {
-      GetRegionInfo(i)->mutex.Unlock();
+    for (int i = (int)(kNumClasses * kNumNodes) - 1; i >= 0; i--) {
+      GetRegionInfo(i / kNumNodes, i % kNumNodes)->mutex.Unlock();
     }
   }
 
-  // Iterate over all existing chunks.
+  // Iterate over all existing chunks which are not in the free lists, i.e.
+  // allocated or held by a local cache.
   // The allocator must be locked when calling this function.
   void ForEachChunk(ForEachChunkCallback callback, void *arg) {
-    for (uptr class_id = 1; class_id < kNumClasses; class_id++) {
-      RegionInfo *region = GetRegionInfo(class_id);
-      uptr chunk_size = SizeClassMap::Size(class_id);
-      uptr region_beg = kSpaceBeg + class_id * kRegionSize;
-      for (uptr chunk = region_beg;
-           chunk < region_beg + region->allocated_user;
-           chunk += chunk_size) {
-        // Too slow: CHECK_EQ((void *)chunk, GetBlockBegin((void *)chunk));
-        callback(chunk, arg);
-      }
+    for (uptr i = kNumNodes; i < kNumClasses * kNumNodes; i++) {
+      uptr class_id = i / kNumNodes;
+      RegionInfo *region = GetRegionInfo(class_id, i % kNumNodes);
+      ForEachChunkInRegion(class_id, i % kNumNodes, region, callback, arg);
+    }
+  }
+
+  // Same, but locks one region at a time instead of the whole allocator, so
+  // that other threads are only blocked on refilling or draining their caches
+  // of that size class. The chunks of the caches are visited too.
+  void ForEachChunkWithRegionLocks(ForEachChunkCallback callback, void *arg) {
+    for (uptr i = kNumNodes; i < kNumClasses * kNumNodes; i++) {
+      uptr class_id = i / kNumNodes;
+      RegionInfo *region = GetRegionInfo(class_id, i % kNumNodes);
+      BlockingMutexLock l(&region->mutex);
+      ForEachChunkInRegion(class_id, i % kNumNodes, region, callback, arg);
     }
   }
 
@@ -458,10 +658,12 @@ class SizeClassAllocator64 {
 
  private:
   static const uptr kRegionSize = kSpaceSize / kNumClassesRounded;
+  static const uptr kNodeRegionSize = kRegionSize / kNumNodes;
   static const uptr kSpaceEnd = kSpaceBeg + kSpaceSize;
   COMPILER_CHECK(kSpaceBeg % kSpaceSize == 0);
-  // kRegionSize must be >= 2^32.
-  COMPILER_CHECK((kRegionSize) >= (1ULL << (SANITIZER_WORDSIZE / 2)));
+  // kNodeRegionSize must be >= 2^32 and a power of two.
+  COMPILER_CHECK((kNodeRegionSize) >= (1ULL << (SANITIZER_WORDSIZE / 2)));
+  COMPILER_CHECK((kNumNodes & (kNumNodes - 1)) == 0);
   // Populate the free list with at most this number of bytes at once
   // or with one element if its size is greater.
   static const uptr kPopulateSize = 1 << 14;
@@ -470,30 +672,214 @@ class SizeClassAllocator64 {
   // Call mmap for metadata memory with at least this size.
   static const uptr kMetaMapSize = 1 << 16;
 
+  COMPILER_CHECK(kNumFreeListShards > 0 && kNumFreeListShards <= 64);
+
+  // Each shard occupies its own cache line to avoid false sharing.
+  struct FreeListShard {
+    LFStack<Batch> free_list;
+    char padding[kCacheLineSize - sizeof(LFStack<Batch>)];
+  };
+  COMPILER_CHECK(sizeof(FreeListShard) == kCacheLineSize);
+
   struct RegionInfo {
+    FreeListShard shards[kNumFreeListShards];
     BlockingMutex mutex;
-    LFStack<Batch> free_list;
     uptr allocated_user;  // Bytes allocated for user memory.
     uptr allocated_meta;  // Bytes allocated for metadata.
     uptr mapped_user;  // Bytes mapped for user memory.
     uptr mapped_meta;  // Bytes mapped for metadata.
+    uptr released_user;  // Bytes returned to the OS by ReleaseToOS().
     uptr n_allocated, n_freed;  // Just stats.
+    atomic_uint64_t *live_chunks;  // One bit per chunk, see above.
+    StaticSpinMutex live_chunks_mu;  // Serializes the bitmap updates.
   };
   COMPILER_CHECK(sizeof(RegionInfo) >= kCacheLineSize);
 
   static uptr AdditionalSize() {
-    return RoundUpTo(sizeof(RegionInfo) * kNumClassesRounded,
+    return RoundUpTo(sizeof(RegionInfo) * kNumClassesRounded * kNumNodes,
                      GetPageSizeCached());
   }
 
-  RegionInfo *GetRegionInfo(uptr class_id) {
+  RegionInfo *GetRegionInfo(uptr class_id, uptr node) {
     CHECK_LT(class_id, kNumClasses);
     RegionInfo *regions = reinterpret_cast<RegionInfo*>(kSpaceBeg + kSpaceSize);
-    return &regions[class_id];
+    return &regions[class_id * kNumNodes + node];
+  }
+
+  static uptr GetNode(const void *p) {
+    return (reinterpret_cast<uptr>(p) / kNodeRegionSize) % kNumNodes;
+  }
+
+  static uptr GetNodeRegionBeg(uptr class_id, uptr node) {
+    return kSpaceBeg + kRegionSize * class_id + kNodeRegionSize * node;
+  }
+
+  // All batches handed out to (or returned from) one local cache go through
+  // the same shard. The stats object lives inside the cache, so its address
+  // is a cheap per-thread key.
+  static uptr GetShardIdx(AllocatorStats *stat) {
+    if (kNumFreeListShards == 1)
+      return 0;
+    uptr h = reinterpret_cast<uptr>(stat) >> 6;
+    h ^= h >> 15;
+    h *= FIRST_32_SECOND_64(0x9E3779B1U, 0x9E3779B97F4A7C15ULL);
+    return (h >> (SANITIZER_WORDSIZE / 2)) % kNumFreeListShards;
+  }
+
+  // Pops a batch from the given shard, stealing from the others if it is
+  // empty.
+  static Batch *PopFromShards(RegionInfo *region, uptr shard) {
+    Batch *b = region->shards[shard].free_list.Pop();
+    for (uptr i = 1; b == 0 && i < kNumFreeListShards; i++)
+      b = region->shards[(shard + i) % kNumFreeListShards].free_list.Pop();
+    return b;
+  }
+
+  void MaybeReleaseToOS() {
+    u64 interval_ns = (u64)release_to_os_interval_ms_ * 1000 * 1000;
+    u64 now = NanoTime();
+    u64 last = atomic_load(&last_release_ns_, memory_order_relaxed);
+    if (now < last + interval_ns)
+      return;
+    // Only one thread does the release pass.
+    if (!atomic_compare_exchange_strong(&last_release_ns_, &last, now,
+                                        memory_order_relaxed))
+      return;
+    ReleaseToOS();
+  }
+
+  void ReleaseFreeRange(RegionInfo *region, uptr beg, uptr end) {
+    uptr page_size = GetPageSizeCached();
+    beg = RoundUpTo(beg, page_size);
+    end = RoundDownTo(end, page_size);
+    if (beg >= end)
+      return;
+    // This just madvises the range away, which is exactly what we need.
+    FlushUnneededShadowMemory(beg, end - beg);
+    MapUnmapCallback().OnRelease(beg, end - beg);
+    region->released_user += end - beg;
+  }
+
+  // Temporarily takes all free batches of the class from the free lists,
+  // finds runs of adjacent free chunks and releases the pages they cover.
+  // The region mutex prevents PopulateFreeList() from running meanwhile; other
+  // threads that find the free lists empty will wait for it.
+  void ReleaseFreeMemoryToOS(uptr class_id, uptr node,
+                             InternalMmapVector<Batch *> *batches,
+                             InternalMmapVector<uptr> *chunks) {
+    RegionInfo *region = GetRegionInfo(class_id, node);
+    uptr chunk_size = SizeClassMap::Size(class_id);
+    if (region->allocated_user == 0)
+      return;
+    BlockingMutexLock l(&region->mutex);
+    batches->clear();
+    chunks->clear();
+    for (uptr i = 0; i < kNumFreeListShards; i++)
+      while (Batch *b = region->shards[i].free_list.Pop())
+        batches->push_back(b);
+    for (uptr i = 0; i < batches->size(); i++) {
+      Batch *b = (*batches)[i];
+      for (uptr j = 0; j < b->count; j++) {
+        // The batch itself may live in one of its chunks; keep that one.
+        if (b->batch[j] != (void*)b)
+          chunks->push_back(reinterpret_cast<uptr>(b->batch[j]));
+      }
+    }
+    uptr n = chunks->size();
+    if (n) {
+      SortArray(chunks->data(), n);
+      uptr range_beg = (*chunks)[0];
+      uptr range_end = range_beg + chunk_size;
+      for (uptr i = 1; i < n; i++) {
+        uptr chunk = (*chunks)[i];
+        if (chunk != range_end) {
+          ReleaseFreeRange(region, range_beg, range_end);
+          range_beg = chunk;
+        }
+        range_end = chunk + chunk_size;
+      }
+      ReleaseFreeRange(region, range_beg, range_end);
+    }
+    for (uptr i = 0; i < batches->size(); i++)
+      region->shards[i % kNumFreeListShards].free_list.Push((*batches)[i]);
+  }
+
+  // The bitmap covers the chunks of a full NodeRegion.
+  static uptr LiveChunkBitmapSize(uptr class_id) {
+    uptr size = SizeClassMap::Size(class_id);
+    if (size == 0) return 0;
+    return RoundUpTo(RoundUpTo(kNodeRegionSize / size, 64) / 8,
+                     GetPageSizeCached());
+  }
+
+  void InitLiveChunkBitmaps() {
+    uptr total = 0;
+    for (uptr class_id = 1; class_id < kNumClasses; class_id++)
+      total += LiveChunkBitmapSize(class_id) * kNumNodes;
+    uptr beg = kSpaceEnd + AdditionalSize();
+    // The pages are only touched for the chunks actually handed out.
+    live_bitmaps_size_ = TryMmapFixedNoReserve(beg, total) ? total : 0;
+    for (uptr i = kNumNodes; i < kNumClasses * kNumNodes; i++) {
+      uptr class_id = i / kNumNodes;
+      RegionInfo *region = GetRegionInfo(class_id, i % kNumNodes);
+      region->live_chunks = 0;
+      if (live_bitmaps_size_) {
+        region->live_chunks = reinterpret_cast<atomic_uint64_t *>(beg);
+        beg += LiveChunkBitmapSize(class_id);
+      }
+    }
+  }
+
+  // The chunks of a batch recycled through the caches are scattered over
+  // the bitmap, an atomic RMW per chunk would cost more than the rest of the
+  // batch transfer. Instead the bits are updated under a spin lock taken
+  // once per batch (the chunks of a batch normally share the NodeRegion).
+  void MarkLiveChunks(uptr class_id, Batch *b, bool live) {
+    if (!live_bitmaps_size_) return;
+    uptr size = SizeClassMap::Size(class_id);
+    RegionInfo *region = 0;
+    for (uptr i = 0; i < b->count; i++) {
+      RegionInfo *r = GetRegionInfo(class_id, GetNode(b->batch[i]));
+      if (r != region) {
+        if (region) region->live_chunks_mu.Unlock();
+        region = r;
+        region->live_chunks_mu.Lock();
+      }
+      uptr idx = GetChunkIdx(reinterpret_cast<uptr>(b->batch[i]), size);
+      atomic_uint64_t *word = &region->live_chunks[idx / 64];
+      u64 bit = 1ULL << (idx % 64);
+      u64 bits = atomic_load(word, memory_order_relaxed);
+      atomic_store(word, live ? bits | bit : bits & ~bit, memory_order_relaxed);
+    }
+    if (region) region->live_chunks_mu.Unlock();
+  }
+
+  void ForEachChunkInRegion(uptr class_id, uptr node, RegionInfo *region,
+                            ForEachChunkCallback callback, void *arg) {
+    uptr chunk_size = SizeClassMap::Size(class_id);
+    uptr region_beg = GetNodeRegionBeg(class_id, node);
+    if (!region->live_chunks) {
+      for (uptr chunk = region_beg;
+           chunk < region_beg + region->allocated_user;
+           chunk += chunk_size) {
+        // Too slow: CHECK_EQ((void *)chunk, GetBlockBegin((void *)chunk));
+        callback(chunk, arg);
+      }
+      return;
+    }
+    uptr n_chunks = region->allocated_user / chunk_size;
+    for (uptr w = 0; w * 64 < n_chunks; w++) {
+      u64 bits = atomic_load(&region->live_chunks[w], memory_order_relaxed);
+      while (bits) {
+        uptr idx = w * 64 + LeastSignificantSetBitIndex(bits);
+        bits &= bits - 1;
+        callback(region_beg + idx * chunk_size, arg);
+      }
+    }
   }
 
   static uptr GetChunkIdx(uptr chunk, uptr size) {
-    uptr offset = chunk % kRegionSize;
+    uptr offset = chunk % kNodeRegionSize;
     // Here we divide by a non-constant. This is costly.
     // size always fits into 32-bits. If the offset fits too, use 32-bit div.
     if (offset >> (SANITIZER_WORDSIZE / 2))
@@ -501,53 +887,60 @@ class SizeClassAllocator64 {
     return (u32)offset / (u32)size;
   }
 
+  // Returns 0 if the NodeRegion is full.
   NOINLINE Batch* PopulateFreeList(AllocatorStats *stat, AllocatorCache *c,
-                                   uptr class_id, RegionInfo *region) {
+                                   uptr class_id, uptr node,
+                                   RegionInfo *region, uptr shard) {
     BlockingMutexLock l(&region->mutex);
-    Batch *b = region->free_list.Pop();
+    Batch *b = PopFromShards(region, shard);
     if (b)
       return b;
     uptr size = SizeClassMap::Size(class_id);
     uptr count = size < kPopulateSize ? SizeClassMap::MaxCached(class_id) : 1;
     uptr beg_idx = region->allocated_user;
     uptr end_idx = beg_idx + count * size;
-    uptr region_beg = kSpaceBeg + kRegionSize * class_id;
+    uptr region_beg = GetNodeRegionBeg(class_id, node);
+    // Find out how much user memory and metadata to map first, so that
+    // nothing is mapped when the NodeRegion is full.
+    uptr user_map_size = 0;
     if (end_idx + size > region->mapped_user) {
+      user_map_size = kUserMapSize;
+      while (end_idx + size > region->mapped_user + user_map_size)
+        user_map_size += kUserMapSize;
+    }
+    uptr mapped_user = region->mapped_user + user_map_size;
+    CHECK_GE(mapped_user, end_idx);
+    uptr total_count = (mapped_user - beg_idx - size) / size / count * count;
+    uptr allocated_meta = region->allocated_meta + total_count * kMetadataSize;
+    uptr meta_map_size = 0;
+    if (allocated_meta > region->mapped_meta) {
+      meta_map_size = kMetaMapSize;
+      while (allocated_meta > region->mapped_meta + meta_map_size)
+        meta_map_size += kMetaMapSize;
+    }
+    if (mapped_user + region->mapped_meta + meta_map_size > kNodeRegionSize)
+      return 0;
+    if (user_map_size) {
       // Do the mmap for the user memory.
-      uptr map_size = kUserMapSize;
-      while (end_idx + size > region->mapped_user + map_size)
-        map_size += kUserMapSize;
-      CHECK_GE(region->mapped_user + map_size, end_idx);
-      MapWithCallback(region_beg + region->mapped_user, map_size);
-      stat->Add(AllocatorStatMmapped, map_size);
-      region->mapped_user += map_size;
+      MapWithCallback(region_beg + region->mapped_user, user_map_size);
+      stat->Add(AllocatorStatMmapped, user_map_size);
+      region->mapped_user = mapped_user;
     }
-    uptr total_count = (region->mapped_user - beg_idx - size)
-        / size / count * count;
-    region->allocated_meta += total_count * kMetadataSize;
-    if (region->allocated_meta > region->mapped_meta) {
-      uptr map_size = kMetaMapSize;
-      while (region->allocated_meta > region->mapped_meta + map_size)
-        map_size += kMetaMapSize;
+    region->allocated_meta = allocated_meta;
+    if (meta_map_size) {
       // Do the mmap for the metadata.
-      CHECK_GE(region->mapped_meta + map_size, region->allocated_meta);
-      MapWithCallback(region_beg + kRegionSize -
-                      region->mapped_meta - map_size, map_size);
-      region->mapped_meta += map_size;
+      MapWithCallback(region_beg + kNodeRegionSize -
+                      region->mapped_meta - meta_map_size, meta_map_size);
+      region->mapped_meta += meta_map_size;
     }
     CHECK_LE(region->allocated_meta, region->mapped_meta);
-    if (region->mapped_user + region->mapped_meta > kRegionSize) {
-      Printf("%s: Out of memory. Dying. ", SanitizerToolName);
-      Printf("The process has exhausted %zuMB for size class %zu.\n",
-          kRegionSize / 1024 / 1024, size);
-      Die();
-    }
     for (;;) {
       if (SizeClassMap::SizeClassRequiresSeparateTransferBatch(class_id))
         b = (Batch*)c->Allocate(this, SizeClassMap::ClassID(sizeof(Batch)));
       else
         b = (Batch*)(region_beg + beg_idx);
       b->count = count;
+      b->pristine = 1;
       for (uptr i = 0; i < count; i++)
         b->batch[i] = (void*)(region_beg + beg_idx + i * size);
       region->allocated_user += count * size;
@@ -556,10 +949,15 @@ class SizeClassAllocator64 {
       if (beg_idx + count * size + size > region->mapped_user)
         break;
       CHECK_GT(b->count, 0);
-      region->free_list.Push(b);
+      region->shards[shard].free_list.Push(b);
     }
     return b;
   }
+
+  s32 release_to_os_interval_ms_;
+  atomic_uint64_t last_release_ns_;
+  bool numa_mode_;
+  uptr live_bitmaps_size_;  // 0 if the bitmaps could not be mapped.
 };
 
 // Maps integers in rage [0, kSize) to u8 values.
@@ -570,6 +968,8 @@ class FlatByteMap {
     internal_memset(map_, 0, sizeof(map_));
   }
 
+  void TestOnlyUnmap() { }
+
   void set(uptr idx, u8 val) {
     CHECK_LT(idx, kSize);
     CHECK_EQ(0U, map_[idx]);
@@ -584,7 +984,71 @@ class FlatByteMap {
   u8 map_[kSize];
 };
 
-// FIXME: Also implement TwoLevelByteMap.
+// Maps integers in range [0, kSize1*kSize2) to u8 values, like FlatByteMap,
+// but only keeps an array of kSize1 pointers inline. The second-level arrays
+// of kSize2 bytes are mmapped on the first set() into them, so a sparse map
+// over a 64-bit address space costs memory only for the parts in use.
+// set() may be called concurrently with operator[] and with other set()s.
+template <u64 kSize1, u64 kSize2, class MapUnmapCallback = NoOpMapUnmapCallback>
+class TwoLevelByteMap {
+ public:
+  void TestOnlyInit() {
+    internal_memset(map1_, 0, sizeof(map1_));
+    mu_.Init();
+  }
+
+  void TestOnlyUnmap() {
+    for (uptr i = 0; i < kSize1; i++) {
+      u8 *p = Get(i);
+      if (!p) continue;
+      MapUnmapCallback().OnUnmap(reinterpret_cast<uptr>(p), kSize2);
+      UnmapOrDie(p, kSize2);
+      atomic_store(&map1_[i], 0, memory_order_relaxed);
+    }
+  }
+
+  uptr size() const { return kSize1 * kSize2; }
+  uptr size1() const { return kSize1; }
+  uptr size2() const { return kSize2; }
+
+  void set(uptr idx, u8 val) {
+    CHECK_LT(idx, kSize1 * kSize2);
+    u8 *map2 = GetOrCreate(idx / kSize2);
+    CHECK_EQ(0U, map2[idx % kSize2]);
+    map2[idx % kSize2] = val;
+  }
+
+  u8 operator[] (uptr idx) const {
+    CHECK_LT(idx, kSize1 * kSize2);
+    u8 *map2 = Get(idx / kSize2);
+    if (!map2) return 0;
+    return map2[idx % kSize2];
+  }
+
+ private:
+  u8 *Get(uptr idx) const {
+    CHECK_LT(idx, kSize1);
+    return reinterpret_cast<u8 *>(
+        atomic_load(&map1_[idx], memory_order_acquire));
+  }
+
+  u8 *GetOrCreate(uptr idx) {
+    u8 *res = Get(idx);
+    if (!res) {
+      SpinMutexLock l(&mu_);
+      if (!(res = Get(idx))) {
+        res = (u8*)MmapOrDie(kSize2, "TwoLevelByteMap");
+        MapUnmapCallback().OnMap(reinterpret_cast<uptr>(res), kSize2);
+        atomic_store(&map1_[idx], reinterpret_cast<uptr>(res),
+                     memory_order_release);
+      }
+    }
+    return res;
+  }
+
+  atomic_uintptr_t map1_[kSize1];
+  StaticSpinMutex mu_;
+};
 
 // SizeClassAllocator32 -- allocator for 32-bit address space.
 // This allocator can theoretically be used on 64-bit arch, but there it is less
@@ -606,21 +1070,29 @@ class FlatByteMap {
 //
 // In order to avoid false sharing the objects of this class should be
 // chache-line aligned.
+//
+// If kLockFreeFreeList is true, TransferBatches are exchanged with the local
+// caches through a per-size-class LFStack, and the spin lock is only taken
+// when a new region has to be carved into batches. Otherwise every
+// AllocateBatch/DeallocateBatch takes the size class spin lock.
 template <const uptr kSpaceBeg, const u64 kSpaceSize,
           const uptr kMetadataSize, class SizeClassMap,
           const uptr kRegionSizeLog,
           class ByteMap,
-          class MapUnmapCallback = NoOpMapUnmapCallback>
+          class MapUnmapCallback = NoOpMapUnmapCallback,
+          const bool kLockFreeFreeList = false>
 class SizeClassAllocator32 {
  public:
   typedef typename SizeClassMap::TransferBatch Batch;
   typedef SizeClassAllocator32<kSpaceBeg, kSpaceSize, kMetadataSize,
-      SizeClassMap, kRegionSizeLog, ByteMap, MapUnmapCallback> ThisT;
+      SizeClassMap, kRegionSizeLog, ByteMap, MapUnmapCallback,
+      kLockFreeFreeList> ThisT;
   typedef SizeClassAllocatorLocalCache<ThisT> AllocatorCache;
 
   void Init() {
     possible_regions.TestOnlyInit();
     internal_memset(size_class_info_array, 0, sizeof(size_class_info_array));
+    SizeClassMap::Init();
   }
 
   void *MapWithCallback(uptr size) {
@@ -655,6 +1127,17 @@ class SizeClassAllocator32 {
                                 uptr class_id) {
     CHECK_LT(class_id, kNumClasses);
     SizeClassInfo *sci = GetSizeClassInfo(class_id);
+    if (kLockFreeFreeList) {
+      Batch *b = sci->lf_free_list.Pop();
+      if (b)
+        return b;
+      SpinMutexLock l(&sci->mutex);
+      // Other threads may pop the batches we have just pushed, so repeat
+      // until we get one.
+      while ((b = sci->lf_free_list.Pop()) == 0)
+        PopulateFreeList(stat, c, sci, class_id);
+      return b;
+    }
     SpinMutexLock l(&sci->mutex);
     if (sci->free_list.empty())
       PopulateFreeList(stat, c, sci, class_id);
@@ -667,8 +1150,12 @@ class SizeClassAllocator32 {
   NOINLINE void DeallocateBatch(AllocatorStats *stat, uptr class_id, Batch *b) {
     CHECK_LT(class_id, kNumClasses);
     SizeClassInfo *sci = GetSizeClassInfo(class_id);
-    SpinMutexLock l(&sci->mutex);
     CHECK_GT(b->count, 0);
+    if (kLockFreeFreeList) {
+      sci->lf_free_list.Push(b);
+      return;
+    }
+    SpinMutexLock l(&sci->mutex);
     sci->free_list.push_front(b);
   }
 
@@ -676,6 +1163,12 @@ class SizeClassAllocator32 {
     return GetSizeClass(p) != 0;
   }
 
+  // Returns the range which contains all the chunks.
+  static void GetAddressRange(uptr *begin, uptr *end) {
+    *begin = kSpaceBeg;
+    *end = kSpaceBeg + kSpaceSize;
+  }
+
   uptr GetSizeClass(const void *p) {
     return possible_regions[ComputeRegionId(reinterpret_cast<uptr>(p))];
   }
@@ -711,6 +1204,7 @@ class SizeClassAllocator32 {
     for (uptr i = 0; i < kNumPossibleRegions; i++)
       if (possible_regions[i])
         UnmapWithCallback((i * kRegionSize), kRegionSize);
+    possible_regions.TestOnlyUnmap();
   }
 
   // ForceLock() and ForceUnlock() are needed to implement Darwin malloc zone
@@ -744,9 +1238,33 @@ class SizeClassAllocator32 {
       }
   }
 
+  // Same, but locks one size class at a time instead of the whole allocator.
+  void ForEachChunkWithRegionLocks(ForEachChunkCallback callback, void *arg) {
+    for (uptr class_id = 1; class_id < kNumClasses; class_id++) {
+      SpinMutexLock l(&GetSizeClassInfo(class_id)->mutex);
+      for (uptr region = 0; region < kNumPossibleRegions; region++) {
+        if (possible_regions[region] != class_id)
+          continue;
+        uptr chunk_size = SizeClassMap::Size(class_id);
+        uptr max_chunks_in_region = kRegionSize / (chunk_size + kMetadataSize);
+        uptr region_beg = region * kRegionSize;
+        for (uptr chunk = region_beg;
+             chunk < region_beg + max_chunks_in_region * chunk_size;
+             chunk += chunk_size)
+          callback(chunk, arg);
+      }
+    }
+  }
+
   void PrintStats() {
   }
 
+  // Releasing free memory to the OS is not implemented for this allocator.
+  void SetReleaseToOSIntervalMs(s32 interval_ms) { }
+  void ReleaseToOS() { }
+  // There are no per-node regions in this allocator.
+  void SetNumaMode(bool enable) { }
+
   typedef SizeClassMap SizeClassMapT;
   static const uptr kNumClasses = SizeClassMap::kNumClasses;
 
@@ -756,8 +1274,10 @@ class SizeClassAllocator32 {
 
   struct SizeClassInfo {
     SpinMutex mutex;
-    IntrusiveList<Batch> free_list;
-    char padding[kCacheLineSize - sizeof(uptr) - sizeof(IntrusiveList<Batch>)];
+    IntrusiveList<Batch> free_list;  // Used if !kLockFreeFreeList.
+    LFStack<Batch> lf_free_list;  // Used if kLockFreeFreeList.
+    char padding[kCacheLineSize - sizeof(uptr) - sizeof(IntrusiveList<Batch>) -
+                 sizeof(LFStack<Batch>)];
   };
   COMPILER_CHECK(sizeof(SizeClassInfo) == kCacheLineSize);
 
@@ -801,18 +1321,24 @@ class SizeClassAllocator32 {
         else
           b = (Batch*)i;
         b->count = 0;
+        b->pristine = 1;
       }
       b->batch[b->count++] = (void*)i;
       if (b->count == max_count) {
-        CHECK_GT(b->count, 0);
-        sci->free_list.push_back(b);
+        PushPopulatedBatch(sci, b);
         b = 0;
       }
     }
-    if (b) {
-      CHECK_GT(b->count, 0);
+    if (b)
+      PushPopulatedBatch(sci, b);
+  }
+
+  void PushPopulatedBatch(SizeClassInfo *sci, Batch *b) {
+    CHECK_GT(b->count, 0);
+    if (kLockFreeFreeList)
+      sci->lf_free_list.Push(b);
+    else
       sci->free_list.push_back(b);
-    }
   }
 
   ByteMap possible_regions;
@@ -822,6 +1348,13 @@ class SizeClassAllocator32 {
 // Objects of this type should be used as local caches for SizeClassAllocator64
 // or SizeClassAllocator32. Since the typical use of this class is to have one
 // object per thread in TLS, is has to be POD.
+//
+// The number of chunks cached for each size class adapts to the usage:
+// max_count starts at MaxCached(class_id) (one batch), grows on every Refill
+// and shrinks on every Drain of a full class, and never exceeds
+// 2 * MaxCached(class_id). Growth above the initial value is limited by a
+// per-thread budget of kMaxExtraBytesCached bytes, so only the hot size
+// classes get the larger caches. Draining the whole cache resets the limits.
 template<class SizeClassAllocator>
 struct SizeClassAllocatorLocalCache {
   typedef SizeClassAllocator Allocator;
@@ -840,6 +1373,12 @@ struct SizeClassAllocatorLocalCache {
   }
 
   void *Allocate(SizeClassAllocator *allocator, uptr class_id) {
+    bool zero;
+    return Allocate(allocator, class_id, &zero);
+  }
+
+  // Sets *zero if the chunk was never handed out before, i.e. is still zero.
+  void *Allocate(SizeClassAllocator *allocator, uptr class_id, bool *zero) {
     CHECK_NE(class_id, 0UL);
     CHECK_LT(class_id, kNumClasses);
     stats_.Add(AllocatorStatMalloced, SizeClassMap::Size(class_id));
@@ -847,6 +1386,8 @@ struct SizeClassAllocatorLocalCache {
     if (UNLIKELY(c->count == 0))
       Refill(allocator, class_id);
     void *res = c->batch[--c->count];
+    *zero = c->count < c->pristine;
+    c->pristine = Min(c->pristine, c->count);
     PREFETCH(c->batch[c->count - 1]);
     return res;
   }
@@ -860,8 +1401,10 @@ struct SizeClassAllocatorLocalCache {
     stats_.Add(AllocatorStatFreed, SizeClassMap::Size(class_id));
     PerClass *c = &per_class_[class_id];
     CHECK_NE(c->max_count, 0UL);
-    if (UNLIKELY(c->count == c->max_count))
+    if (UNLIKELY(c->count >= c->max_count)) {
       Drain(allocator, class_id);
+      Shrink(class_id);
+    }
     c->batch[c->count++] = p;
   }
 
@@ -871,6 +1414,7 @@ struct SizeClassAllocatorLocalCache {
       while (c->count > 0)
         Drain(allocator, class_id);
     }
+    ResetMaxCounts();
   }
 
   // private:
@@ -879,46 +1423,102 @@ struct SizeClassAllocatorLocalCache {
   struct PerClass {
     uptr count;
     uptr max_count;
+    // batch[0, pristine) were never handed out. Deallocate pushes above them.
+    uptr pristine;
     void *batch[2 * SizeClassMap::kMaxNumCached];
   };
   PerClass per_class_[kNumClasses];
   AllocatorStats stats_;
+  // Sum of (max_count - MinCount()) * Size() over all size classes.
+  uptr extra_bytes_cached_;
+
+  static const uptr kMaxExtraBytesCached = SizeClassMap::kMaxBytesCached * 8;
+
+  static uptr MinCount(uptr class_id) {
+    return SizeClassMap::MaxCached(class_id);
+  }
+
+  static uptr MaxCount(uptr class_id) {
+    return 2 * SizeClassMap::MaxCached(class_id);
+  }
+
+  static uptr CountStep(uptr class_id) {
+    return Max<uptr>(1, SizeClassMap::MaxCached(class_id) / 4);
+  }
 
   void InitCache() {
     if (per_class_[1].max_count)
       return;
+    ResetMaxCounts();
+  }
+
+  void ResetMaxCounts() {
     for (uptr i = 0; i < kNumClasses; i++) {
       PerClass *c = &per_class_[i];
-      c->max_count = 2 * SizeClassMap::MaxCached(i);
+      c->max_count = MinCount(i);
     }
+    extra_bytes_cached_ = 0;
+  }
+
+  // Called on Refill: the class is hot, let it cache more chunks.
+  void Grow(uptr class_id) {
+    PerClass *c = &per_class_[class_id];
+    uptr step = Min(CountStep(class_id), MaxCount(class_id) - c->max_count);
+    uptr bytes = step * SizeClassMap::Size(class_id);
+    if (step == 0 || extra_bytes_cached_ + bytes > kMaxExtraBytesCached)
+      return;
+    c->max_count += step;
+    extra_bytes_cached_ += bytes;
+  }
+
+  // Called when a full class is drained: give some of the budget back.
+  void Shrink(uptr class_id) {
+    PerClass *c = &per_class_[class_id];
+    uptr step = Min(CountStep(class_id), c->max_count - MinCount(class_id));
+    c->max_count -= step;
+    extra_bytes_cached_ -= step * SizeClassMap::Size(class_id);
   }
 
   NOINLINE void Refill(SizeClassAllocator *allocator, uptr class_id) {
     InitCache();
+    stats_.Add(AllocatorStatRefills, 1);
     PerClass *c = &per_class_[class_id];
     Batch *b = allocator->AllocateBatch(&stats_, this, class_id);
     CHECK_GT(b->count, 0);
     for (uptr i = 0; i < b->count; i++)
       c->batch[i] = b->batch[i];
     c->count = b->count;
+    c->pristine = b->pristine ? b->count : 0;
+    Grow(class_id);
     if (SizeClassMap::SizeClassRequiresSeparateTransferBatch(class_id))
       Deallocate(allocator, SizeClassMap::ClassID(sizeof(Batch)), b);
+    else if (b->pristine)
+      // The batch is stored in its first chunk: clear what it has written.
+      internal_memset(b, 0, (uptr)&b->batch[b->count] - (uptr)b);
   }
 
   NOINLINE void Drain(SizeClassAllocator *allocator, uptr class_id) {
     InitCache();
+    stats_.Add(AllocatorStatDrains, 1);
     PerClass *c = &per_class_[class_id];
     Batch *b;
     if (SizeClassMap::SizeClassRequiresSeparateTransferBatch(class_id))
       b = (Batch*)Allocate(allocator, SizeClassMap::ClassID(sizeof(Batch)));
     else
       b = (Batch*)c->batch[0];
-    uptr cnt = Min(c->max_count / 2, c->count);
-    for (uptr i = 0; i < cnt; i++) {
+    // max_count never exceeds 2 * MaxCached(class_id), so the batch can always
+    // hold cnt chunks.
+    uptr cnt = Min(Max<uptr>(1, c->max_count / 2), c->count);
+    // Give away the oldest chunks and fill the hole with the newest ones.
+    uptr n_move = Min(cnt, c->count - cnt);
+    for (uptr i = 0; i < cnt; i++)
       b->batch[i] = c->batch[i];
-      c->batch[i] = c->batch[i + c->max_count / 2];
-    }
+    for (uptr i = 0; i < n_move; i++)
+      c->batch[i] = c->batch[c->count - n_move + i];
+    // Conservatively, only keep the pristine marks of fully pristine caches.
     b->count = cnt;
+    b->pristine = cnt <= c->pristine;
+    c->pristine = c->pristine == c->count ? c->count - cnt : 0;
     c->count -= cnt;
     CHECK_GT(b->count, 0);
     allocator->DeallocateBatch(&stats_, class_id, b);
@@ -942,15 +1542,27 @@ class LargeMmapAllocator {
     if (alignment > page_size_)
       map_size += alignment;
     if (map_size < size) return 0;  // Overflow.
-    uptr map_beg = reinterpret_cast<uptr>(
-        MmapOrDie(map_size, "LargeMmapAllocator"));
-    MapUnmapCallback().OnMap(map_beg, map_size);
+    uptr map_beg = 0;
+    if (cache_max_bytes_)
+      map_beg = TakeFromCache(stat, &map_size);
+    bool reused = map_beg != 0;
+    if (!reused) {
+      map_beg = reinterpret_cast<uptr>(
+          MmapOrDie(map_size, "LargeMmapAllocator"));
+      MapUnmapCallback().OnMap(map_beg, map_size);
+    }
     uptr map_end = map_beg + map_size;
     uptr res = map_beg + page_size_;
     if (res & (alignment - 1))  // Align.
       res += alignment - (res & (alignment - 1));
     CHECK_EQ(0, res & (alignment - 1));
     CHECK_LE(res + size, map_end);
+    // Fresh mappings are zero-filled, and callers (e.g. calloc) rely on that.
+    // Clear the header page too, so that the metadata appears fresh as well.
+    if (reused)
+      internal_memset(reinterpret_cast<void*>(res - page_size_), 0,
+                      page_size_ +
+                      Min(RoundUpTo(size, page_size_), map_end - res));
     Header *h = GetHeader(res);
     h->size = size;
     h->map_beg = map_beg;
@@ -969,7 +1581,8 @@ class LargeMmapAllocator {
       stats.max_allocated = Max(stats.max_allocated, stats.currently_allocated);
       stats.by_size_log[size_log]++;
       stat->Add(AllocatorStatMalloced, map_size);
-      stat->Add(AllocatorStatMmapped, map_size);
+      if (!reused)
+        stat->Add(AllocatorStatMmapped, map_size);
     }
     return reinterpret_cast<void*>(res);
   }
@@ -988,10 +1601,96 @@ class LargeMmapAllocator {
       stats.n_frees++;
       stats.currently_allocated -= h->map_size;
       stat->Add(AllocatorStatFreed, h->map_size);
-      stat->Add(AllocatorStatUnmapped, h->map_size);
     }
-    MapUnmapCallback().OnUnmap(h->map_beg, h->map_size);
-    UnmapOrDie(reinterpret_cast<void*>(h->map_beg), h->map_size);
+    uptr map_beg = h->map_beg;
+    uptr map_size = h->map_size;
+    if (cache_max_bytes_ && PutToCache(stat, map_beg, map_size))
+      return;
+    stat->Add(AllocatorStatUnmapped, map_size);
+    MapUnmapCallback().OnUnmap(map_beg, map_size);
+    UnmapOrDie(reinterpret_cast<void*>(map_beg), map_size);
+  }
+
+  // Makes the chunk p hold new_size bytes without copying its contents:
+  // in place if its mapping is large enough, otherwise with mremap, which may
+  // move the chunk. Only chunks allocated with alignment <= page size can be
+  // resized. Returns the new address of the chunk, or 0 if it can't be
+  // resized, in which case p is left intact.
+  void *Resize(AllocatorStats *stat, void *p, uptr new_size) {
+    Header *h = GetHeader(p);
+    if (h->map_beg + page_size_ != reinterpret_cast<uptr>(p))
+      return 0;
+    uptr new_map_size = RoundUpMapSize(new_size);
+    if (new_map_size < new_size) return 0;  // Overflow.
+    if (new_map_size <= h->map_size) {
+      h->size = new_size;
+      return p;
+    }
+#if SANITIZER_LINUX
+    uptr old_map_beg, old_map_size, map_beg;
+    {
+      // Other threads may look at the header while we move it.
+      SpinMutexLock l(&mutex_);
+      old_map_beg = h->map_beg;
+      old_map_size = h->map_size;
+      map_beg = internal_mremap(reinterpret_cast<void*>(old_map_beg),
+                                old_map_size, new_map_size);
+      if (internal_iserror(map_beg))
+        return 0;
+      h = reinterpret_cast<Header*>(map_beg);
+      h->size = new_size;
+      h->map_beg = map_beg;
+      h->map_size = new_map_size;
+      CHECK_LT(h->chunk_idx, n_chunks_);
+      chunks_[h->chunk_idx] = h;
+      chunks_sorted_ = false;
+      uptr delta = new_map_size - old_map_size;
+      stats.n_resizes++;
+      stats.currently_allocated += delta;
+      stats.max_allocated = Max(stats.max_allocated, stats.currently_allocated);
+      stat->Add(AllocatorStatMalloced, delta);
+      stat->Add(AllocatorStatMmapped, delta);
+    }
+    if (map_beg == old_map_beg) {
+      MapUnmapCallback().OnMap(old_map_beg + old_map_size,
+                               new_map_size - old_map_size);
+    } else {
+      MapUnmapCallback().OnUnmap(old_map_beg, old_map_size);
+      MapUnmapCallback().OnMap(map_beg, new_map_size);
+    }
+    return reinterpret_cast<void*>(map_beg + page_size_);
+#else
+    return 0;
+#endif
+  }
+
+  // Keeps up to max_cached_bytes of freed mappings around for reuse by
+  // subsequent allocations of a similar size. Cached mappings older than
+  // max_age_ms are unmapped (never, if max_age_ms is negative).
+  // max_cached_bytes == 0 disables the cache.
+  void SetCacheLimits(uptr max_cached_bytes, s32 max_age_ms) {
+    SpinMutexLock l(&cache_mutex_);
+    cache_max_bytes_ = max_cached_bytes;
+    cache_max_age_ms_ = max_age_ms;
+  }
+
+  // Unmaps all cached mappings.
+  void DrainCache(AllocatorStats *stat) {
+    CachedMapping evicted[kMaxCachedMappings];
+    uptr n_evicted = 0;
+    {
+      SpinMutexLock l(&cache_mutex_);
+      for (uptr i = 0; i < n_cached_; i++)
+        evicted[n_evicted++] = cached_[i];
+      n_cached_ = 0;
+      cached_bytes_ = 0;
+    }
+    UnmapEvicted(stat, evicted, n_evicted);
+  }
+
+  uptr TotalMemoryCached() {
+    SpinMutexLock l(&cache_mutex_);
+    return cached_bytes_;
   }
 
   uptr TotalMemoryUsed() {
@@ -1048,16 +1747,7 @@ class LargeMmapAllocator {
     uptr p = reinterpret_cast<uptr>(ptr);
     uptr n = n_chunks_;
     if (!n) return 0;
-    if (!chunks_sorted_) {
-      // Do one-time sort. chunks_sorted_ is reset in Allocate/Deallocate.
-      SortArray(reinterpret_cast<uptr*>(chunks_), n);
-      for (uptr i = 0; i < n; i++)
-        chunks_[i]->chunk_idx = i;
-      chunks_sorted_ = true;
-      min_mmap_ = reinterpret_cast<uptr>(chunks_[0]);
-      max_mmap_ = reinterpret_cast<uptr>(chunks_[n - 1]) +
-          chunks_[n - 1]->map_size;
-    }
+    EnsureSortedChunks();
     if (p < min_mmap_ || p >= max_mmap_)
       return 0;
     uptr beg = 0, end = n - 1;
@@ -1084,6 +1774,16 @@ class LargeMmapAllocator {
     return GetUser(h);
   }
 
+  // Returns a range which contains all the chunks (empty if there are none).
+  // Must be called with the allocator locked.
+  void GetAddressRangeLocked(uptr *begin, uptr *end) {
+    *begin = *end = 0;
+    if (!n_chunks_) return;
+    EnsureSortedChunks();
+    *begin = min_mmap_;
+    *end = max_mmap_;
+  }
+
   void PrintStats() {
     Printf("Stats: LargeMmapAllocator: allocated %zd times, "
            "remains %zd (%zd K) max %zd M; by size logs: ",
@@ -1095,6 +1795,12 @@ class LargeMmapAllocator {
       Printf("%zd:%zd; ", i, c);
     }
     Printf("\n");
+    if (cache_max_bytes_)
+      Printf("Stats: LargeMmapAllocator: cache hits %zd, cached %zd (%zd K)\n",
+             stats.n_cache_hits, n_cached_, cached_bytes_ >> 10);
+    if (stats.n_resizes)
+      Printf("Stats: LargeMmapAllocator: %zd chunks resized with mremap\n",
+             stats.n_resizes);
   }
 
   // ForceLock() and ForceUnlock() are needed to implement Darwin malloc zone
@@ -1114,6 +1820,11 @@ class LargeMmapAllocator {
       callback(reinterpret_cast<uptr>(GetUser(chunks_[i])), arg);
   }
 
+  void ForEachChunkWithRegionLocks(ForEachChunkCallback callback, void *arg) {
+    SpinMutexLock l(&mutex_);
+    ForEachChunk(callback, arg);
+  }
+
  private:
   static const int kMaxNumChunks = 1 << FIRST_32_SECOND_64(15, 18);
   struct Header {
@@ -1140,6 +1851,122 @@ class LargeMmapAllocator {
     return RoundUpTo(size, page_size_) + page_size_;
   }
 
+  void EnsureSortedChunks() {
+    if (chunks_sorted_) return;
+    // Do one-time sort. chunks_sorted_ is reset in Allocate/Deallocate.
+    uptr n = n_chunks_;
+    SortArray(reinterpret_cast<uptr*>(chunks_), n);
+    for (uptr i = 0; i < n; i++)
+      chunks_[i]->chunk_idx = i;
+    chunks_sorted_ = true;
+    min_mmap_ = reinterpret_cast<uptr>(chunks_[0]);
+    max_mmap_ = reinterpret_cast<uptr>(chunks_[n - 1]) +
+        chunks_[n - 1]->map_size;
+  }
+
+  // A freed mapping kept for reuse. The mapping stays registered with
+  // MapUnmapCallback while cached.
+  struct CachedMapping {
+    uptr map_beg;
+    uptr map_size;
+    u64 free_time_ns;
+  };
+  static const uptr kMaxCachedMappings = 32;
+
+  bool CacheEntryExpired(const CachedMapping &m, u64 now_ns) {
+    if (cache_max_age_ms_ < 0) return false;
+    return now_ns - m.free_time_ns >= (u64)cache_max_age_ms_ * 1000 * 1000;
+  }
+
+  // Moves expired entries to evicted. Must be called with cache_mutex_ held.
+  void EvictExpiredLocked(u64 now_ns, CachedMapping *evicted,
+                          uptr *n_evicted) {
+    for (uptr i = 0; i < n_cached_;) {
+      if (!CacheEntryExpired(cached_[i], now_ns)) {
+        i++;
+        continue;
+      }
+      evicted[(*n_evicted)++] = cached_[i];
+      cached_bytes_ -= cached_[i].map_size;
+      cached_[i] = cached_[--n_cached_];
+    }
+  }
+
+  void UnmapEvicted(AllocatorStats *stat, CachedMapping *evicted,
+                    uptr n_evicted) {
+    for (uptr i = 0; i < n_evicted; i++) {
+      stat->Add(AllocatorStatUnmapped, evicted[i].map_size);
+      MapUnmapCallback().OnUnmap(evicted[i].map_beg, evicted[i].map_size);
+      UnmapOrDie(reinterpret_cast<void*>(evicted[i].map_beg),
+                 evicted[i].map_size);
+    }
+  }
+
+  // Returns the smallest cached mapping of at least *map_size bytes that
+  // does not waste more than 1/8 of it, or 0. On success *map_size is set
+  // to the size of the returned mapping.
+  uptr TakeFromCache(AllocatorStats *stat, uptr *map_size) {
+    CachedMapping evicted[kMaxCachedMappings];
+    uptr n_evicted = 0;
+    uptr res = 0;
+    {
+      SpinMutexLock l(&cache_mutex_);
+      if (n_cached_ == 0) return 0;
+      EvictExpiredLocked(NanoTime(), evicted, &n_evicted);
+      uptr needed = *map_size;
+      uptr max_size = needed + needed / 8;
+      uptr best = n_cached_;
+      for (uptr i = 0; i < n_cached_; i++) {
+        uptr sz = cached_[i].map_size;
+        if (sz < needed || sz > max_size) continue;
+        if (best == n_cached_ || sz < cached_[best].map_size)
+          best = i;
+      }
+      if (best != n_cached_) {
+        res = cached_[best].map_beg;
+        *map_size = cached_[best].map_size;
+        cached_bytes_ -= *map_size;
+        cached_[best] = cached_[--n_cached_];
+        stats.n_cache_hits++;
+      }
+    }
+    UnmapEvicted(stat, evicted, n_evicted);
+    return res;
+  }
+
+  // Returns false if the mapping does not fit into the cache.
+  bool PutToCache(AllocatorStats *stat, uptr map_beg, uptr map_size) {
+    CachedMapping evicted[kMaxCachedMappings];
+    uptr n_evicted = 0;
+    bool cached = false;
+    {
+      SpinMutexLock l(&cache_mutex_);
+      if (map_size <= cache_max_bytes_) {
+        u64 now_ns = NanoTime();
+        EvictExpiredLocked(now_ns, evicted, &n_evicted);
+        // Make room by evicting the oldest entries.
+        while (n_cached_ > 0 && (n_cached_ == kMaxCachedMappings ||
+               cached_bytes_ + map_size > cache_max_bytes_)) {
+          uptr oldest = 0;
+          for (uptr i = 1; i < n_cached_; i++)
+            if (cached_[i].free_time_ns < cached_[oldest].free_time_ns)
+              oldest = i;
+          evicted[n_evicted++] = cached_[oldest];
+          cached_bytes_ -= cached_[oldest].map_size;
+          cached_[oldest] = cached_[--n_cached_];
+        }
+        CachedMapping *m = &cached_[n_cached_++];
+        m->map_beg = map_beg;
+        m->map_size = map_size;
+        m->free_time_ns = now_ns;
+        cached_bytes_ += map_size;
+        cached = true;
+      }
+    }
+    UnmapEvicted(stat, evicted, n_evicted);
+    return cached;
+  }
+
   uptr page_size_;
   Header *chunks_[kMaxNumChunks];
   uptr n_chunks_;
@@ -1147,8 +1974,17 @@ class LargeMmapAllocator {
   bool chunks_sorted_;
   struct Stats {
     uptr n_allocs, n_frees, currently_allocated, max_allocated, by_size_log[64];
+    uptr n_cache_hits;
+    uptr n_resizes;  // Chunks grown with mremap.
   } stats;
   SpinMutex mutex_;
+  // Cache of freed mappings, protected by cache_mutex_.
+  SpinMutex cache_mutex_;
+  CachedMapping cached_[kMaxCachedMappings];
+  uptr n_cached_;
+  uptr cached_bytes_;
+  uptr cache_max_bytes_;
+  s32 cache_max_age_ms_;
 };
 
 // This class implements a complete memory allocator by using two
@@ -1169,22 +2005,36 @@ class CombinedAllocator {
 
   void *Allocate(AllocatorCache *cache, uptr size, uptr alignment,
                  bool cleared = false) {
+    bool zero;
+    void *res = AllocateCheckZero(cache, size, alignment, &zero);
+    if (cleared && res && !zero)
+      internal_memset(res, 0, size);
+    return res;
+  }
+
+  // Sets *zero if the chunk is known to be all zero: chunks of the secondary
+  // allocator always are, and so are the primary chunks that were never
+  // handed out before. This lets calloc skip clearing most fresh memory.
+  void *AllocateCheckZero(AllocatorCache *cache, uptr size, uptr alignment,
+                          bool *zero) {
     // Returning 0 on malloc(0) may break a lot of code.
     if (size == 0)
       size = 1;
-    if (size + alignment < size)
+    if (size + alignment < size) {
+      *zero = false;
       return 0;
+    }
     if (alignment > 8)
       size = RoundUpTo(size, alignment);
     void *res;
-    if (primary_.CanAllocate(size, alignment))
-      res = cache->Allocate(&primary_, primary_.ClassID(size));
-    else
+    if (primary_.CanAllocate(size, alignment)) {
+      res = cache->Allocate(&primary_, primary_.ClassID(size), zero);
+    } else {
       res = secondary_.Allocate(&stats_, size, alignment);
+      *zero = true;
+    }
     if (alignment > 8)
       CHECK_EQ(reinterpret_cast<uptr>(res) & (alignment - 1), 0);
-    if (cleared && res)
-      internal_memset(res, 0, size);
     return res;
   }
 
@@ -1244,6 +2094,14 @@ class CombinedAllocator {
     return secondary_.GetBlockBeginFastLocked(p);
   }
 
+  // Returns the ranges which contain all the primary and secondary chunks.
+  // Must be called with the allocator locked.
+  void GetAddressRangesLocked(uptr *primary_begin, uptr *primary_end,
+                              uptr *secondary_begin, uptr *secondary_end) {
+    primary_.GetAddressRange(primary_begin, primary_end);
+    secondary_.GetAddressRangeLocked(secondary_begin, secondary_end);
+  }
+
   uptr GetActuallyAllocatedSize(void *p) {
     if (primary_.PointerIsMine(p))
       return primary_.GetActuallyAllocatedSize(p);
@@ -1277,6 +2135,37 @@ class CombinedAllocator {
     secondary_.PrintStats();
   }
 
+  // The secondary allocator unmaps freed memory right away, so only the
+  // primary allocator has something to release.
+  void SetReleaseToOSIntervalMs(s32 interval_ms) {
+    primary_.SetReleaseToOSIntervalMs(interval_ms);
+  }
+
+  void SetNumaMode(bool enable) {
+    primary_.SetNumaMode(enable);
+  }
+
+  void SetSecondaryCacheLimits(uptr max_cached_bytes, s32 max_age_ms) {
+    secondary_.SetCacheLimits(max_cached_bytes, max_age_ms);
+  }
+
+  // See LargeMmapAllocator::Resize.
+  void *ResizeSecondary(void *p, uptr new_size) {
+    return secondary_.Resize(&stats_, p, new_size);
+  }
+
+  void ReleaseToOS() {
+    primary_.ReleaseToOS();
+  }
+
+  // Unmaps the mappings kept by the secondary allocator for reuse and
+  // returns their total size.
+  uptr DrainSecondaryCache() {
+    uptr cached = secondary_.TotalMemoryCached();
+    secondary_.DrainCache(&stats_);
+    return cached;
+  }
+
   // ForceLock() and ForceUnlock() are needed to implement Darwin malloc zone
   // introspection API.
   void ForceLock() {
@@ -1296,6 +2185,14 @@ class CombinedAllocator {
     secondary_.ForEachChunk(callback, arg);
   }
 
+  // Iterates over all existing chunks without locking the whole allocator:
+  // the chunks of one size class are visited with only that class locked.
+  // The callback must not allocate from this allocator.
+  void ForEachChunkWithRegionLocks(ForEachChunkCallback callback, void *arg) {
+    primary_.ForEachChunkWithRegionLocks(callback, arg);
+    secondary_.ForEachChunkWithRegionLocks(callback, arg);
+  }
+
  private:
   PrimaryAllocator primary_;
   SecondaryAllocator secondary_;
@@ -31,12 +31,17 @@ static const uptr kInternalAllocatorRegionSizeLog = 20;
 static const u64 kInternalAllocatorSize = (1ULL << 47);
 static const uptr kInternalAllocatorRegionSizeLog = 24;
 #endif
-static const uptr kInternalAllocatorFlatByteMapSize =
+static const uptr kInternalAllocatorNumRegions =
     kInternalAllocatorSize >> kInternalAllocatorRegionSizeLog;
+#if SANITIZER_WORDSIZE == 32
+typedef FlatByteMap<kInternalAllocatorNumRegions> ByteMap;
+#else
+// A flat map of the 2^23 possible regions would take 8M.
+typedef TwoLevelByteMap<(kInternalAllocatorNumRegions >> 12), 1 << 12> ByteMap;
+#endif
 typedef SizeClassAllocator32<
     kInternalAllocatorSpace, kInternalAllocatorSize, 16, InternalSizeClassMap,
-    kInternalAllocatorRegionSizeLog,
-    FlatByteMap<kInternalAllocatorFlatByteMapSize> > PrimaryInternalAllocator;
+    kInternalAllocatorRegionSizeLog, ByteMap> PrimaryInternalAllocator;
 
 typedef SizeClassAllocatorLocalCache<PrimaryInternalAllocator>
     InternalAllocatorCache;
@@ -49,6 +54,7 @@ struct CrashOnMapUnmap {
   void OnUnmap(uptr p, uptr size) const {
     RAW_CHECK_MSG(0, "Unexpected munmap in InternalAllocator!");
   }
+  void OnRelease(uptr p, uptr size) const { }
 };
 
 typedef CombinedAllocator<PrimaryInternalAllocator, InternalAllocatorCache,
@@ -37,12 +37,18 @@ static char report_path_prefix[4096];  // Set via __sanitizer_set_report_path.
 // child thread will be different from |report_fd_pid|.
 static uptr report_fd_pid = 0;
 
+static void (*SandboxingCallback)(void);
+void SetSandboxingCallback(void (*callback)(void)) {
+  SandboxingCallback = callback;
+}
+
 static void (*DieCallback)(void);
 void SetDieCallback(void (*callback)(void)) {
   DieCallback = callback;
 }
 
 void NORETURN Die() {
+  FinishReportBuffering();
   if (DieCallback) {
     DieCallback();
   }
@@ -84,9 +90,8 @@ void MaybeOpenReportFile() {
   report_fd_pid = internal_getpid();
 }
 
-void RawWrite(const char *buffer) {
+static void WriteToReportFile(const char *buffer, uptr length) {
   static const char *kRawWriteError = "RawWrite can't output requested buffer!";
-  uptr length = (uptr)internal_strlen(buffer);
   MaybeOpenReportFile();
   if (length != internal_write(report_fd, buffer, length)) {
     internal_write(report_fd, kRawWriteError, internal_strlen(kRawWriteError));
@@ -94,6 +99,52 @@ void RawWrite(const char *buffer) {
   }
 }
 
+// The report buffer is shared and owned by the thread which holds
+// CommonSanitizerReportMutex and has called StartReportBuffering().
+static const uptr kReportBufferSize = 1 << 16;
+static char *report_buffer;
+static uptr report_buffer_pos;
+static THREADLOCAL bool buffering_report;
+
+static void FlushReportBuffer() {
+  uptr length = report_buffer_pos;
+  report_buffer_pos = 0;
+  if (length)
+    WriteToReportFile(report_buffer, length);
+}
+
+void StartReportBuffering() {
+  if (buffering_report)
+    return;
+  if (!report_buffer)
+    report_buffer = (char *)MmapOrDie(kReportBufferSize, "ReportBuffer");
+  report_buffer_pos = 0;
+  buffering_report = true;
+}
+
+void FinishReportBuffering() {
+  if (!buffering_report)
+    return;
+  buffering_report = false;
+  FlushReportBuffer();
+}
+
+void RawWrite(const char *buffer) {
+  uptr length = (uptr)internal_strlen(buffer);
+  if (!buffering_report) {
+    WriteToReportFile(buffer, length);
+    return;
+  }
+  if (report_buffer_pos + length > kReportBufferSize)
+    FlushReportBuffer();
+  if (length > kReportBufferSize) {
+    WriteToReportFile(buffer, length);
+    return;
+  }
+  internal_memcpy(report_buffer + report_buffer_pos, buffer, length);
+  report_buffer_pos += length;
+}
+
 uptr ReadFileToBuffer(const char *file_name, char **buff,
                       uptr *buff_size, uptr max_len) {
   uptr PageSize = GetPageSizeCached();
@@ -159,6 +210,14 @@ void *MmapAlignedOrDie(uptr size, uptr alignment, const char *mem_type) {
   return (void*)res;
 }
 
+void SetShadowHugePages(int policy, uptr addr, uptr size, bool dense) {
+  // 0 leaves the choice to the system.
+  if (policy == 1 && dense)
+    HugePagesInRegion(addr, size);
+  else if (policy == 1 || policy == 2)
+    NoHugePagesInRegion(addr, size);
+}
+
 void ReportErrorSummary(const char *error_type, const char *file,
                         int line, const char *function) {
   const int kMaxSize = 1024;  // We don't want a summary too long.
@@ -199,6 +258,8 @@ void __sanitizer_set_report_fd(int fd) {
 
 void NOINLINE __sanitizer_sandbox_on_notify(void *reserved) {
   (void)reserved;
+  if (SandboxingCallback)
+    SandboxingCallback();
   PrepareForSandboxing();
 }
 
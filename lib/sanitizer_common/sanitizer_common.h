@@ -44,6 +44,8 @@ uptr GetMmapGranularity();
 uptr GetMaxVirtualAddress();
 // Threads
 uptr GetTid();
+// The NUMA node of the CPU the thread runs on, 0 if unknown.
+uptr GetCurrentNumaNode();
 uptr GetThreadSelf();
 void GetThreadStackTopAndBottom(bool at_initialization, uptr *stack_top,
                                 uptr *stack_bottom);
@@ -52,8 +54,15 @@ void GetThreadStackAndTls(bool main, uptr *stk_addr, uptr *stk_size,
 
 // Memory management
 void *MmapOrDie(uptr size, const char *mem_type);
+// Like MmapOrDie, but the memory is not accounted until it is touched, for
+// large arrays that are mostly left unused.
+void *MmapNoReserveOrDie(uptr size, const char *mem_type);
 void UnmapOrDie(void *addr, uptr size);
 void *MmapFixedNoReserve(uptr fixed_addr, uptr size);
+// Like MmapFixedNoReserve, but only maps the range if no part of it is mapped
+// yet, which spares reading the process map to check that first. Returns
+// false if the range is not available.
+bool TryMmapFixedNoReserve(uptr fixed_addr, uptr size);
 void *MmapFixedOrDie(uptr fixed_addr, uptr size);
 void *Mprotect(uptr fixed_addr, uptr size);
 // Map aligned chunk of address space; size and alignment are powers of two.
@@ -61,6 +70,15 @@ void *MmapAlignedOrDie(uptr size, uptr alignment, const char *mem_type);
 // Used to check if we can map shadow memory to a fixed location.
 bool MemoryRangeIsAvailable(uptr range_start, uptr range_end);
 void FlushUnneededShadowMemory(uptr addr, uptr size);
+// Advise the kernel to back the range with transparent huge pages, or not to.
+void HugePagesInRegion(uptr addr, uptr size);
+void NoHugePagesInRegion(uptr addr, uptr size);
+// Backs the range with memory now instead of on the first access. The range
+// must not be written concurrently.
+void PrefaultRegion(uptr addr, uptr size);
+// Applies a shadow_huge_pages flag value to a shadow range which is expected
+// to be used densely (e.g. the shadow of the heap) or sparsely.
+void SetShadowHugePages(int policy, uptr addr, uptr size, bool dense);
 
 // InternalScopedBuffer can be used instead of large stack arrays to
 // keep frame size low.
@@ -115,6 +133,19 @@ extern StaticSpinMutex CommonSanitizerReportMutex;
 void MaybeOpenReportFile();
 extern fd_t report_fd;
 
+// Between these calls RawWrite (and thus Printf and Report) output of the
+// current thread is accumulated and written out in large chunks, so that a
+// report costs a few write() calls instead of one per line. Must be called
+// with CommonSanitizerReportMutex held. Die() flushes the buffer.
+void StartReportBuffering();
+void FinishReportBuffering();
+
+class ScopedReportBuffer {
+ public:
+  ScopedReportBuffer() { StartReportBuffering(); }
+  ~ScopedReportBuffer() { FinishReportBuffering(); }
+};
+
 uptr OpenFile(const char *filename, bool write);
 // Opens the file 'file_name" and reads up to 'max_len' bytes.
 // The resulting buffer is mmaped and stored in '*buff'.
@@ -139,6 +170,9 @@ void ReExec();
 bool StackSizeIsUnlimited();
 void SetStackSizeLimitInBytes(uptr limit);
 void PrepareForSandboxing();
+// Called by __sanitizer_sandbox_on_notify before PrepareForSandboxing, e.g.
+// to start subprocesses that could not be started in the sandbox.
+void SetSandboxingCallback(void (*callback)(void));
 
 void InitTlsSize();
 uptr GetTlsSize();
@@ -146,7 +180,9 @@ uptr GetTlsSize();
 // Other
 void SleepForSeconds(int seconds);
 void SleepForMillis(int millis);
+// Wall clock time, and time which never goes backwards, in nanoseconds.
 u64 NanoTime();
+u64 MonotonicNanoTime();
 int Atexit(void (*function)(void));
 void SortArray(uptr *array, uptr size);
 
@@ -201,6 +237,19 @@ INLINE uptr MostSignificantSetBitIndex(uptr x) {
   return up;
 }
 
+INLINE uptr LeastSignificantSetBitIndex(uptr x) {
+  CHECK_NE(x, 0U);
+  unsigned long up;  // NOLINT
+#if !SANITIZER_WINDOWS || defined(__clang__) || defined(__GNUC__)
+  up = __builtin_ctzl(x);
+#elif defined(_WIN64)
+  _BitScanForward64(&up, x);
+#else
+  _BitScanForward(&up, x);
+#endif
+  return up;
+}
+
 INLINE bool IsPowerOfTwo(uptr x) {
   return (x & (x - 1)) == 0;
 }
@@ -279,7 +328,7 @@ class InternalMmapVector {
  public:
   explicit InternalMmapVector(uptr initial_capacity) {
     CHECK_GT(initial_capacity, 0);
-    capacity_ = initial_capacity;
+    capacity_ = RoundUpCapacity(initial_capacity);
     size_ = 0;
     data_ = (T *)MmapOrDie(capacity_ * sizeof(T), "InternalMmapVector");
   }
@@ -313,17 +362,43 @@ class InternalMmapVector {
   uptr size() const {
     return size_;
   }
+  T *data() {
+    return data_;
+  }
   const T *data() const {
     return data_;
   }
   uptr capacity() const {
     return capacity_;
   }
+  void clear() { size_ = 0; }
+  // Like clear(), but also gives the pages back to the OS, e.g. after a
+  // vector that is reused has grown large once. The capacity is kept.
+  void clear_and_release() {
+    size_ = 0;
+    FlushUnneededShadowMemory((uptr)data_, capacity_ * sizeof(T));
+  }
 
  private:
+  // Mappings are made of whole pages, so use all of them.
+  static uptr RoundUpCapacity(uptr capacity) {
+    return RoundUpTo(capacity * sizeof(T), GetPageSizeCached()) / sizeof(T);
+  }
   void Resize(uptr new_capacity) {
     CHECK_GT(new_capacity, 0);
     CHECK_LE(size_, new_capacity);
+    new_capacity = RoundUpCapacity(new_capacity);
+#if SANITIZER_LINUX
+    // Let the kernel move the pages instead of copying them, which matters
+    // for vectors of hundreds of megabytes such as the LSan frontier.
+    uptr res = internal_mremap(data_, capacity_ * sizeof(T),
+                               new_capacity * sizeof(T));
+    if (!internal_iserror(res)) {
+      data_ = (T *)res;
+      capacity_ = new_capacity;
+      return;
+    }
+#endif
     T *new_data = (T *)MmapOrDie(new_capacity * sizeof(T),
                                  "InternalMmapVector");
     internal_memcpy(new_data, data_, size_ * sizeof(T));
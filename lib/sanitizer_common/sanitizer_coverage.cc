@@ -0,0 +1,171 @@
+//===-- sanitizer_coverage.cc ---------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is shared between AddressSanitizer, MemorySanitizer,
+// ThreadSanitizer and LeakSanitizer run-time libraries.
+//===----------------------------------------------------------------------===//
+
+#include "sanitizer_coverage.h"
+#include "sanitizer_common.h"
+#include "sanitizer_libc.h"
+#include "sanitizer_mutex.h"
+#include "sanitizer_procmaps.h"
+
+namespace __sanitizer {
+
+struct CoverageModule {
+  uptr pc;  // Of the guard initialization call, to find the module name.
+  u32 beg;  // The module's counters, [beg, end).
+  u32 end;
+};
+
+static const uptr kMaxCoverageModules = 1024;
+
+// Protects the modules and the counter numbering, not the counters.
+static StaticSpinMutex coverage_mu;
+static u8 *coverage_counters;
+// Next free counter index, 0 is the index of the guards that are off.
+static uptr coverage_counters_used;
+static CoverageModule coverage_modules[kMaxCoverageModules];
+static uptr coverage_module_count;
+static const char *coverage_dir;
+
+static void CoverageInitModule(u32 *start, u32 *stop, uptr pc) {
+  SpinMutexLock l(&coverage_mu);
+  uptr n = stop - start;
+  if (coverage_counters == 0) {
+    coverage_counters = (u8 *)MmapNoReserveOrDie(kMaxCoverageCounters,
+                                                 "coverage counters");
+    coverage_counters_used = 1;
+  }
+  if (coverage_module_count == kMaxCoverageModules ||
+      n > kMaxCoverageCounters - coverage_counters_used) {
+    // The guards stay 0, so the edges of the module are not counted.
+    Report("WARNING: %s: too many coverage modules or edges\n",
+           SanitizerToolName);
+    return;
+  }
+  CoverageModule *m = &coverage_modules[coverage_module_count++];
+  m->pc = pc;
+  m->beg = coverage_counters_used;
+  m->end = coverage_counters_used + n;
+  for (uptr i = 0; i < n; i++)
+    start[i] = m->beg + i;
+  coverage_counters_used = m->end;
+}
+
+uptr GetCoverageCounters(u8 **counters) {
+  SpinMutexLock l(&coverage_mu);
+  *counters = coverage_counters;
+  return coverage_counters_used;
+}
+
+uptr GetCoverageCount() {
+  SpinMutexLock l(&coverage_mu);
+  uptr count = 0;
+  for (uptr i = 1; i < coverage_counters_used; i++)
+    count += coverage_counters[i] != 0;
+  return count;
+}
+
+void ResetCoverage() {
+  SpinMutexLock l(&coverage_mu);
+  if (coverage_counters)
+    internal_memset(coverage_counters, 0, coverage_counters_used);
+}
+
+void InitializeCoverage(const char *dir) {
+  coverage_dir = dir;
+}
+
+static void GetCoverageModuleName(const CoverageModule &m, uptr idx,
+                                  char *name, uptr name_size) {
+#if !SANITIZER_WINDOWS
+  MemoryMappingLayout proc_maps(/*cache_enabled*/true);
+  uptr offset;
+  if (proc_maps.GetObjectNameAndOffset(m.pc, &offset, name, name_size, 0) &&
+      name[0]) {
+    const char *base = internal_strrchr(name, '/');
+    if (base)
+      internal_memmove(name, base + 1, internal_strlen(base + 1) + 1);
+    return;
+  }
+#endif
+  internal_snprintf(name, name_size, "module%zu", idx);
+}
+
+static void DumpCoverageModule(const CoverageModule &m, uptr idx) {
+  const uptr n = m.end - m.beg;
+  InternalScopedBuffer<char> name(4096);
+  GetCoverageModuleName(m, idx, name.data(), name.size());
+  InternalScopedBuffer<char> path(4096);
+  const char *dir = coverage_dir;
+  internal_snprintf(path.data(), path.size(), "%s/%s.%zu.sancov",
+                    dir && dir[0] ? dir : ".", name.data(),
+                    internal_getpid());
+  uptr fd = OpenFile(path.data(), true);
+  if (internal_iserror(fd)) {
+    Report("ERROR: Can't open coverage file: %s\n", path.data());
+    return;
+  }
+  InternalScopedBuffer<u64> data(2 + RoundUpTo(n, 64) / 64);
+  internal_memset(data.data(), 0, data.size());
+  data[0] = kCoverageMagic;
+  data[1] = n;
+  for (uptr i = 0; i < n; i++) {
+    if (coverage_counters[m.beg + i])
+      data[2 + i / 64] |= 1ULL << (i % 64);
+  }
+  internal_write(fd, data.data(), data.size());
+  internal_close(fd);
+}
+
+void DumpCoverage() {
+  SpinMutexLock l(&coverage_mu);
+  for (uptr i = 0; i < coverage_module_count; i++)
+    DumpCoverageModule(coverage_modules[i], i);
+}
+
+}  // namespace __sanitizer
+
+using namespace __sanitizer;  // NOLINT
+
+extern "C" {
+void __sanitizer_cov_trace_pc_guard_init(u32 *start, u32 *stop) {
+  // Already done if the module calls it from several constructors.
+  if (start == stop || *start)
+    return;
+  CoverageInitModule(start, stop, GET_CALLER_PC());
+}
+
+void __sanitizer_cov_trace_pc_guard(u32 *guard) {
+  u32 idx = *guard;
+  if (idx == 0)
+    return;
+  u8 *counter = &coverage_counters[idx];
+  if (*counter != 0xff)
+    ++*counter;
+}
+
+uptr __sanitizer_get_coverage_counters(u8 **counters) {
+  return GetCoverageCounters(counters);
+}
+
+uptr __sanitizer_get_total_unique_coverage() {
+  return GetCoverageCount();
+}
+
+void __sanitizer_reset_coverage() {
+  ResetCoverage();
+}
+
+void __sanitizer_cov_dump() {
+  DumpCoverage();
+}
+}  // extern "C"
@@ -0,0 +1,66 @@
+//===-- sanitizer_coverage.h ------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Edge coverage for in-process fuzzing, collected from code built with
+// -fsanitize-coverage=trace-pc-guard.
+//
+// Each instrumented module registers its guards (one u32 per edge) with
+// __sanitizer_cov_trace_pc_guard_init, which numbers them so that the edges
+// of a module get a contiguous range of one counter array. The array is
+// reserved once without backing memory, so only the pages of the counters
+// in use take memory. The callback on an edge increments its 8-bit counter,
+// saturating at 255, without synchronization: concurrent hits may be lost,
+// which is fine for coverage. Fuzzers read and reset the counters in place,
+// between inputs.
+//
+// With coverage=1 the tools write the edges hit by each module, as a bitmap,
+// to <coverage_dir>/<module>.<pid>.sancov at exit:
+//   u64 kCoverageMagic, u64 number of edges N, (N + 63) / 64 u64 words,
+//   where bit i is set if the i-th guard of the module was hit.
+//===----------------------------------------------------------------------===//
+#ifndef SANITIZER_COVERAGE_H
+#define SANITIZER_COVERAGE_H
+
+#include "sanitizer_internal_defs.h"
+
+namespace __sanitizer {
+
+// "SANCOVB1" in a little-endian file.
+const u64 kCoverageMagic = 0x3142564f434e4153ULL;
+// The counters of all modules, one byte each.
+const uptr kMaxCoverageCounters = 1 << 24;
+
+// Sets the directory of the .sancov files, the current one if empty.
+void InitializeCoverage(const char *dir);
+// Returns the number of counters, the first one (at index 0) is not used.
+uptr GetCoverageCounters(u8 **counters);
+// Number of edges hit since the start or the last reset.
+uptr GetCoverageCount();
+void ResetCoverage();
+// Writes the .sancov files of all modules.
+void DumpCoverage();
+
+}  // namespace __sanitizer
+
+extern "C" {
+  SANITIZER_INTERFACE_ATTRIBUTE
+  void __sanitizer_cov_trace_pc_guard_init(u32 *start, u32 *stop);
+  SANITIZER_INTERFACE_ATTRIBUTE
+  void __sanitizer_cov_trace_pc_guard(u32 *guard);
+  SANITIZER_INTERFACE_ATTRIBUTE
+  uptr __sanitizer_get_coverage_counters(u8 **counters);
+  SANITIZER_INTERFACE_ATTRIBUTE
+  uptr __sanitizer_get_total_unique_coverage();
+  SANITIZER_INTERFACE_ATTRIBUTE
+  void __sanitizer_reset_coverage();
+  SANITIZER_INTERFACE_ATTRIBUTE
+  void __sanitizer_cov_dump();
+}  // extern "C"
+
+#endif  // SANITIZER_COVERAGE_H
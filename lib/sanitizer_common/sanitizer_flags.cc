@@ -20,103 +20,189 @@ namespace __sanitizer {
 
 CommonFlags common_flags_dont_use_directly;
 
-void ParseCommonFlagsFromString(const char *str) {
+void RegisterCommonFlags(FlagParser *parser) {
   CommonFlags *f = common_flags();
-  ParseFlag(str, &f->malloc_context_size, "malloc_context_size");
-  ParseFlag(str, &f->strip_path_prefix, "strip_path_prefix");
-  ParseFlag(str, &f->fast_unwind_on_fatal, "fast_unwind_on_fatal");
-  ParseFlag(str, &f->fast_unwind_on_malloc, "fast_unwind_on_malloc");
-  ParseFlag(str, &f->symbolize, "symbolize");
-  ParseFlag(str, &f->handle_ioctl, "handle_ioctl");
-  ParseFlag(str, &f->log_path, "log_path");
-  ParseFlag(str, &f->detect_leaks, "detect_leaks");
-  ParseFlag(str, &f->leak_check_at_exit, "leak_check_at_exit");
-}
-
-static bool GetFlagValue(const char *env, const char *name,
-                         const char **value, int *value_length) {
-  if (env == 0)
-    return false;
-  const char *pos = 0;
-  for (;;) {
-    pos = internal_strstr(env, name);
-    if (pos == 0)
-      return false;
-    if (pos != env && ((pos[-1] >= 'a' && pos[-1] <= 'z') || pos[-1] == '_')) {
-      // Seems to be middle of another flag name or value.
-      env = pos + 1;
-      continue;
+  parser->AddFlag(&f->malloc_context_size, "malloc_context_size");
+  parser->AddFlag(&f->strip_path_prefix, "strip_path_prefix");
+  parser->AddFlag(&f->fast_unwind_on_fatal, "fast_unwind_on_fatal");
+  parser->AddFlag(&f->fast_unwind_on_malloc, "fast_unwind_on_malloc");
+  parser->AddFlag(&f->use_shadow_call_stack, "use_shadow_call_stack");
+  parser->AddFlag(&f->compress_stack_depot, "compress_stack_depot");
+  parser->AddFlag(&f->stack_depot_max_mb, "stack_depot_max_mb");
+  parser->AddFlag(&f->symbolize, "symbolize");
+  parser->AddFlag(&f->handle_ioctl, "handle_ioctl");
+  parser->AddFlag(&f->log_path, "log_path");
+  parser->AddFlag(&f->detect_leaks, "detect_leaks");
+  parser->AddFlag(&f->leak_check_at_exit, "leak_check_at_exit");
+  parser->AddFlag(&f->shadow_huge_pages, "shadow_huge_pages");
+  parser->AddFlag(&f->prefault_shadow, "prefault_shadow");
+  parser->AddFlag(&f->fast_init, "fast_init");
+  parser->AddFlag(&f->timing_sample_rate, "timing_sample_rate");
+  parser->AddFlag(&f->coverage, "coverage");
+  parser->AddFlag(&f->coverage_dir, "coverage_dir");
+}
+
+void ParseCommonFlagsFromString(const char *str) {
+  FlagParser parser;
+  RegisterCommonFlags(&parser);
+  parser.ParseString(str);
+}
+
+FlagParser::FlagParser()
+    : flags_(kMaxFlags), hash_table_(kHashTableSize), n_flags_(0) {
+}
+
+uptr FlagParser::HashName(const char *name, uptr length) {
+  uptr h = 0;
+  for (uptr i = 0; i < length; i++)
+    h = h * 31 + (u8)name[i];
+  return h & (kHashTableSize - 1);
+}
+
+void FlagParser::AddFlag(void *flag, FlagType type, const char *name) {
+  CHECK_LT(n_flags_, kMaxFlags);
+  FlagDescription *desc = &flags_[n_flags_];
+  desc->name = name;
+  desc->name_length = internal_strlen(name);
+  desc->type = type;
+  desc->value = flag;
+  desc->seen = false;
+  // Linear probing. The table is at most half full.
+  uptr h = HashName(name, desc->name_length);
+  while (hash_table_[h])
+    h = (h + 1) & (kHashTableSize - 1);
+  hash_table_[h] = ++n_flags_;
+}
+
+void FlagParser::AddFlag(bool *flag, const char *name) {
+  AddFlag(flag, kBoolFlag, name);
+}
+
+void FlagParser::AddFlag(int *flag, const char *name) {
+  AddFlag(flag, kIntFlag, name);
+}
+
+void FlagParser::AddFlag(const char **flag, const char *name) {
+  AddFlag(flag, kStringFlag, name);
+}
+
+static bool StartsWith(const char *flag, uptr flag_length, const char *value) {
+  uptr value_length = internal_strlen(value);
+  return (flag_length >= value_length) &&
+         (0 == internal_strncmp(flag, value, value_length));
+}
+
+static LowLevelAllocator allocator_for_flags;
+
+void FlagParser::SetFlag(FlagDescription *desc, const char *value,
+                         uptr value_length) {
+  switch (desc->type) {
+    case kBoolFlag: {
+      bool *flag = (bool *)desc->value;
+      if (StartsWith(value, value_length, "0") ||
+          StartsWith(value, value_length, "no") ||
+          StartsWith(value, value_length, "false"))
+        *flag = false;
+      if (StartsWith(value, value_length, "1") ||
+          StartsWith(value, value_length, "yes") ||
+          StartsWith(value, value_length, "true"))
+        *flag = true;
+      break;
     }
-    break;
-  }
-  pos += internal_strlen(name);
-  const char *end;
-  if (pos[0] != '=') {
-    end = pos;
-  } else {
-    pos += 1;
-    if (pos[0] == '"') {
-      pos += 1;
-      end = internal_strchr(pos, '"');
-    } else if (pos[0] == '\'') {
-      pos += 1;
-      end = internal_strchr(pos, '\'');
-    } else {
-      // Read until the next space or colon.
-      end = pos + internal_strcspn(pos, " :");
+    case kIntFlag:
+      // The value is followed by a separator, a quote or the end of string.
+      *(int *)desc->value = static_cast<int>(internal_atoll(value));
+      break;
+    case kStringFlag: {
+      // Copy the flag value. Don't use locks here, as flags are parsed at
+      // tool startup.
+      char *value_copy =
+          (char *)(allocator_for_flags.Allocate(value_length + 1));
+      internal_memcpy(value_copy, value, value_length);
+      value_copy[value_length] = '\0';
+      *(const char **)desc->value = value_copy;
+      break;
     }
-    if (end == 0)
-      end = pos + internal_strlen(pos);
   }
-  *value = pos;
-  *value_length = end - pos;
-  return true;
 }
 
-static bool StartsWith(const char *flag, int flag_length, const char *value) {
-  if (!flag || !value)
-    return false;
-  int value_length = internal_strlen(value);
-  return (flag_length >= value_length) &&
-         (0 == internal_strncmp(flag, value, value_length));
+void FlagParser::ApplyFlag(const char *name, uptr name_length,
+                           const char *value, uptr value_length) {
+  // Several flags can share a name (e.g. tool-specific and common ones).
+  for (uptr h = HashName(name, name_length); hash_table_[h];
+       h = (h + 1) & (kHashTableSize - 1)) {
+    FlagDescription *desc = &flags_[hash_table_[h] - 1];
+    if (desc->seen || desc->name_length != name_length ||
+        internal_strncmp(desc->name, name, name_length) != 0)
+      continue;
+    desc->seen = true;
+    SetFlag(desc, value, value_length);
+  }
 }
 
-void ParseFlag(const char *env, bool *flag, const char *name) {
-  const char *value;
-  int value_length;
-  if (!GetFlagValue(env, name, &value, &value_length))
-    return;
-  if (StartsWith(value, value_length, "0") ||
-      StartsWith(value, value_length, "no") ||
-      StartsWith(value, value_length, "false"))
-    *flag = false;
-  if (StartsWith(value, value_length, "1") ||
-      StartsWith(value, value_length, "yes") ||
-      StartsWith(value, value_length, "true"))
-    *flag = true;
+static bool IsSeparator(char c) {
+  return c == ' ' || c == ':' || c == '\t' || c == '\n' || c == '\r';
 }
 
-void ParseFlag(const char *env, int *flag, const char *name) {
-  const char *value;
-  int value_length;
-  if (!GetFlagValue(env, name, &value, &value_length))
+void FlagParser::ParseString(const char *str) {
+  if (str == 0)
     return;
-  *flag = static_cast<int>(internal_atoll(value));
+  for (uptr i = 0; i < n_flags_; i++)
+    flags_[i].seen = false;
+  const char *pos = str;
+  while (*pos) {
+    if (IsSeparator(*pos)) {
+      pos++;
+      continue;
+    }
+    const char *name = pos;
+    while (*pos && *pos != '=' && !IsSeparator(*pos))
+      pos++;
+    const char *name_end = pos;
+    // Accept "--name" and "-name".
+    while (name < name_end && *name == '-')
+      name++;
+    const char *value = "";
+    uptr value_length = 0;
+    if (*pos == '=') {
+      pos++;
+      if (*pos == '"' || *pos == '\'') {
+        char quote = *pos++;
+        value = pos;
+        while (*pos && *pos != quote)
+          pos++;
+        value_length = pos - value;
+        if (*pos)
+          pos++;
+      } else {
+        // Read until the next space or colon.
+        value = pos;
+        while (*pos && !IsSeparator(*pos))
+          pos++;
+        value_length = pos - value;
+      }
+    }
+    if (name < name_end)
+      ApplyFlag(name, name_end - name, value, value_length);
+  }
 }
 
-static LowLevelAllocator allocator_for_flags;
+void ParseFlag(const char *env, bool *flag, const char *name) {
+  FlagParser parser;
+  parser.AddFlag(flag, name);
+  parser.ParseString(env);
+}
+
+void ParseFlag(const char *env, int *flag, const char *name) {
+  FlagParser parser;
+  parser.AddFlag(flag, name);
+  parser.ParseString(env);
+}
 
 void ParseFlag(const char *env, const char **flag, const char *name) {
-  const char *value;
-  int value_length;
-  if (!GetFlagValue(env, name, &value, &value_length))
-    return;
-  // Copy the flag value. Don't use locks here, as flags are parsed at
-  // tool startup.
-  char *value_copy = (char*)(allocator_for_flags.Allocate(value_length + 1));
-  internal_memcpy(value_copy, value, value_length);
-  value_copy[value_length] = '\0';
-  *flag = value_copy;
+  FlagParser parser;
+  parser.AddFlag(flag, name);
+  parser.ParseString(env);
 }
 
 }  // namespace __sanitizer
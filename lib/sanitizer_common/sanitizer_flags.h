@@ -14,10 +14,53 @@
 #ifndef SANITIZER_FLAGS_H
 #define SANITIZER_FLAGS_H
 
+#include "sanitizer_common.h"
 #include "sanitizer_internal_defs.h"
 
 namespace __sanitizer {
 
+// Parses option strings like "name1=value1 name2='value 2':--name3" into the
+// flags registered with AddFlag(). The string is tokenized in a single pass
+// and names are looked up in a hash table, so the cost does not depend on the
+// number of flags. If a flag is given several times in one string, the first
+// occurrence wins. Unknown names are ignored.
+class FlagParser {
+ public:
+  FlagParser();
+  void AddFlag(bool *flag, const char *name);
+  void AddFlag(int *flag, const char *name);
+  void AddFlag(const char **flag, const char *name);
+  void ParseString(const char *str);
+
+ private:
+  enum FlagType {
+    kBoolFlag,
+    kIntFlag,
+    kStringFlag
+  };
+  struct FlagDescription {
+    const char *name;
+    uptr name_length;
+    FlagType type;
+    void *value;
+    bool seen;
+  };
+  static const uptr kMaxFlags = 256;
+  static const uptr kHashTableSize = 2 * kMaxFlags;
+
+  static uptr HashName(const char *name, uptr length);
+  void AddFlag(void *flag, FlagType type, const char *name);
+  void SetFlag(FlagDescription *desc, const char *value, uptr value_length);
+  void ApplyFlag(const char *name, uptr name_length, const char *value,
+                 uptr value_length);
+
+  InternalScopedBuffer<FlagDescription> flags_;
+  // Indices into flags_ plus 1, 0 means an empty slot.
+  InternalScopedBuffer<u16> hash_table_;
+  uptr n_flags_;
+};
+
+// Parse a single flag out of env. Prefer FlagParser for several flags.
 void ParseFlag(const char *env, bool *flag, const char *name);
 void ParseFlag(const char *env, int *flag, const char *name);
 void ParseFlag(const char *env, const char **flag, const char *name);
@@ -33,6 +76,15 @@ struct CommonFlags {
   bool fast_unwind_on_fatal;
   // Use fast (frame-pointer-based) unwinder on malloc/free (if available).
   bool fast_unwind_on_malloc;
+  // Take the stacks that use the fast unwinder (e.g. malloc/free) from
+  // the shadow call stack, if the code was instrumented to maintain it.
+  bool use_shadow_call_stack;
+  // Store stacks in the stack depot in a compressed form (about 3 bytes
+  // per frame instead of 8). Stacks are decompressed when requested.
+  bool compress_stack_depot;
+  // If positive, bounds the memory of the stack depot (in megabytes): new
+  // stacks are truncated past half of it and not stored past all of it.
+  int stack_depot_max_mb;
   // Intercept and handle ioctl requests.
   bool handle_ioctl;
   // Max number of stack frames kept for each allocation/deallocation.
@@ -45,6 +97,25 @@ struct CommonFlags {
   // detect_leaks=false, or if __lsan_do_leak_check() is called before the
   // handler has a chance to run.
   bool leak_check_at_exit;
+  // Transparent huge pages for the shadow memory: 0 - system default,
+  // 1 - use them for densely used shadow (e.g. of the heap) and not for the
+  // rest, 2 - never use them.
+  int shadow_huge_pages;
+  // Back the shadow of the main thread stack with memory at startup.
+  bool prefault_shadow;
+  // Defer startup work that only error reports need, e.g. starting the
+  // external symbolizer, until it is needed. Helps short-lived processes.
+  bool fast_init;
+  // Time one in that many entries into the runtime hot paths (allocator,
+  // interceptors) and every report, and print the histograms at exit.
+  // 0 - disabled.
+  int timing_sample_rate;
+  // If set, write the edges hit by the modules built with
+  // -fsanitize-coverage=trace-pc-guard to <coverage_dir>/<module>.<pid>.sancov
+  // at exit.
+  bool coverage;
+  // Directory of the coverage files, the current one if empty.
+  const char *coverage_dir;
 };
 
 extern CommonFlags common_flags_dont_use_directly;
@@ -53,6 +124,7 @@ inline CommonFlags *common_flags() {
   return &common_flags_dont_use_directly;
 }
 
+void RegisterCommonFlags(FlagParser *parser);
 void ParseCommonFlagsFromString(const char *str);
 
 }  // namespace __sanitizer
@@ -16,6 +16,33 @@
 
 namespace __sanitizer {
 
+#if defined(__GNUC__) && \
+    (defined(__SSE2__) || defined(__ARM_NEON__) || defined(__aarch64__))
+// SSE2 is a part of x86_64, so no run-time dispatch is needed there.
+# define SANITIZER_SIMD_MEM 1
+typedef u64 v2u64 __attribute__((vector_size(16)));
+#endif
+
+// The unit of the bulk loops in internal_memcpy() and internal_memcmp(): 16
+// byte vectors with SIMD, words otherwise. The loops align one pointer only;
+// the other is read through a type which may be unaligned on the
+// architectures where such loads are cheap, and must be aligned together with
+// the first one elsewhere.
+#if defined(SANITIZER_SIMD_MEM)
+typedef v2u64 mem_block __attribute__((may_alias));
+#else
+typedef uptr mem_block __attribute__((may_alias));
+#endif
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+static const bool kUnalignedLoadsAreCheap = true;
+typedef mem_block unaligned_mem_block __attribute__((aligned(1), may_alias));
+typedef uptr unaligned_uptr __attribute__((aligned(1), may_alias));
+#else
+static const bool kUnalignedLoadsAreCheap = false;
+typedef mem_block unaligned_mem_block __attribute__((may_alias));
+typedef uptr unaligned_uptr __attribute__((may_alias));
+#endif
+
 s64 internal_atoll(const char *nptr) {
   return internal_simple_strtoll(nptr, (char**)0, 10);
 }
@@ -31,16 +58,42 @@ void *internal_memchr(const void *s, int c, uptr n) {
 int internal_memcmp(const void* s1, const void* s2, uptr n) {
   const char* t1 = (char*)s1;
   const char* t2 = (char*)s2;
-  for (uptr i = 0; i < n; ++i, ++t1, ++t2)
-    if (*t1 != *t2)
-      return *t1 < *t2 ? -1 : 1;
+  uptr i = 0;
+  // Skip the equal prefix a word at a time, then find the first difference, if
+  // any, in the byte loop.
+  if (n >= 2 * sizeof(uptr) &&
+      (kUnalignedLoadsAreCheap || ((uptr)t1 - (uptr)t2) % sizeof(uptr) == 0)) {
+    for (; (uptr)(t1 + i) % sizeof(uptr) && t1[i] == t2[i]; ++i) {}
+    if ((uptr)(t1 + i) % sizeof(uptr) == 0) {
+      for (; i + sizeof(uptr) <= n; i += sizeof(uptr)) {
+        if (*(const unaligned_uptr*)(t1 + i) !=
+            *(const unaligned_uptr*)(t2 + i))
+          break;
+      }
+    }
+  }
+  for (; i < n; ++i)
+    if (t1[i] != t2[i])
+      return t1[i] < t2[i] ? -1 : 1;
   return 0;
 }
 
 void *internal_memcpy(void *dest, const void *src, uptr n) {
   char *d = (char*)dest;
   char *s = (char*)src;
-  for (uptr i = 0; i < n; ++i)
+  uptr i = 0;
+  // Copy the aligned middle part of the destination a block at a time. The
+  // volatile stores prevent Clang from making a call to memcpy(), as in
+  // internal_memset().
+  if (n >= 2 * sizeof(mem_block) &&
+      (kUnalignedLoadsAreCheap ||
+       ((uptr)d - (uptr)s) % sizeof(mem_block) == 0)) {
+    for (; (uptr)(d + i) % sizeof(mem_block); ++i)
+      d[i] = s[i];
+    for (; i + sizeof(mem_block) <= n; i += sizeof(mem_block))
+      *(mem_block volatile*)(d + i) = *(const unaligned_mem_block*)(s + i);
+  }
+  for (; i < n; ++i)
     d[i] = s[i];
   return dest;
 }
@@ -63,14 +116,25 @@ void *internal_memmove(void *dest, const void *src, uptr n) {
 }
 
 void *internal_memset(void* s, int c, uptr n) {
-  // The next line prevents Clang from making a call to memset() instead of the
-  // loop below.
+  // The volatile stores prevent Clang from making a call to memset() instead of
+  // the loops below.
   // FIXME: building the runtime with -ffreestanding is a better idea. However
   // there currently are linktime problems due to PR12396.
   char volatile *t = (char*)s;
-  for (uptr i = 0; i < n; ++i, ++t) {
-    *t = c;
+  uptr i = 0;
+  // Fill the aligned middle part a word at a time.
+  if (n >= 2 * sizeof(uptr)) {
+    for (; (uptr)(t + i) % sizeof(uptr); ++i)
+      t[i] = c;
+    uptr word = (u8)c * (~(uptr)0 / 0xff);
+    uptr volatile *w = (uptr volatile*)(t + i);
+    uptr n_words = (n - i) / sizeof(uptr);
+    for (uptr j = 0; j < n_words; ++j)
+      w[j] = word;
+    i += n_words * sizeof(uptr);
   }
+  for (; i < n; ++i)
+    t[i] = c;
   return s;
 }
 
@@ -206,9 +270,7 @@ s64 internal_simple_strtoll(const char *nptr, char **endptr, int base) {
   }
 }
 
-bool mem_is_zero(const char *beg, uptr size) {
-  CHECK_LE(size, 1ULL << FIRST_32_SECOND_64(30, 40));  // Sanity check.
-  const char *end = beg + size;
+static bool mem_is_zero_words(const char *beg, const char *end) {
   uptr *aligned_beg = (uptr *)RoundUpTo((uptr)beg, sizeof(uptr));
   uptr *aligned_end = (uptr *)RoundDownTo((uptr)end, sizeof(uptr));
   uptr all = 0;
@@ -225,4 +287,29 @@ bool mem_is_zero(const char *beg, uptr size) {
   return all == 0;
 }
 
+bool mem_is_zero(const char *beg, uptr size) {
+  CHECK_LE(size, 1ULL << FIRST_32_SECOND_64(30, 40));  // Sanity check.
+  const char *end = beg + size;
+#if defined(SANITIZER_SIMD_MEM)
+  // Large ranges are scanned 16 bytes per load, in blocks of kBlockSize
+  // bytes. Scanning stops at the first block with non-zero data.
+  const uptr kBlockSize = 256;
+  if (size >= 2 * kBlockSize) {
+    const char *vbeg = (const char *)RoundUpTo((uptr)beg, sizeof(v2u64));
+    const char *vend = vbeg + RoundDownTo(end - vbeg, kBlockSize);
+    if (!mem_is_zero_words(beg, vbeg))
+      return false;
+    for (const v2u64 *v = (const v2u64 *)vbeg; v < (const v2u64 *)vend;) {
+      v2u64 all = *v++;
+      for (uptr i = 1; i < kBlockSize / sizeof(v2u64); i++)
+        all |= *v++;
+      if (all[0] | all[1])
+        return false;
+    }
+    beg = vend;
+  }
+#endif
+  return mem_is_zero_words(beg, end);
+}
+
 }  // namespace __sanitizer
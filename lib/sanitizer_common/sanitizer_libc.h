@@ -56,6 +56,13 @@ bool mem_is_zero(const char *mem, uptr size);
 uptr internal_mmap(void *addr, uptr length, int prot, int flags,
                    int fd, u64 offset);
 uptr internal_munmap(void *addr, uptr length);
+#if SANITIZER_LINUX
+// Resizes a mapping; the mapping may be moved to a new address.
+uptr internal_mremap(void *addr, uptr old_length, uptr new_length);
+// Moves the pages of a mapping to new_addr, replacing whatever was mapped
+// there. The old range is left unmapped.
+uptr internal_mremap_fixed(void *addr, uptr length, void *new_addr);
+#endif
 
 // I/O
 const fd_t kInvalidFd = -1;
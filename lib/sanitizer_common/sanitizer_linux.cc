@@ -52,6 +52,17 @@ struct kernel_timeval {
   long tv_usec;
 };
 
+struct kernel_timespec {
+  long tv_sec;
+  long tv_nsec;
+};
+
+const int CLOCK_REALTIME_ID = 0;
+const int CLOCK_MONOTONIC_ID = 1;
+
+// <linux/auxvec.h>
+const uptr AT_SYSINFO_EHDR_TYPE = 33;
+
 // <linux/futex.h> is broken on some linux distributions.
 const int FUTEX_WAIT = 0;
 const int FUTEX_WAKE = 1;
@@ -87,6 +98,16 @@ uptr internal_munmap(void *addr, uptr length) {
   return internal_syscall(__NR_munmap, addr, length);
 }
 
+uptr internal_mremap(void *addr, uptr old_length, uptr new_length) {
+  return internal_syscall(__NR_mremap, addr, old_length, new_length,
+                          MREMAP_MAYMOVE);
+}
+
+uptr internal_mremap_fixed(void *addr, uptr length, void *new_addr) {
+  return internal_syscall(__NR_mremap, addr, length, length,
+                          MREMAP_MAYMOVE | MREMAP_FIXED, new_addr);
+}
+
 uptr internal_close(fd_t fd) {
   return internal_syscall(__NR_close, fd);
 }
@@ -215,10 +236,134 @@ uptr GetTid() {
   return internal_syscall(__NR_gettid);
 }
 
+// The kernel maps a vDSO which implements clock_gettime() without entering
+// the kernel. It is found from the AT_SYSINFO_EHDR entry of the auxiliary
+// vector and its dynamic symbol table, as in the kernel's
+// Documentation/vDSO/parse_vdso.c, so that libc isn't needed.
+typedef int (*vdso_clock_gettime_t)(int clock, kernel_timespec *ts);
+
+static uptr GetAuxvEntry(uptr type) {
+  char *buff;
+  uptr buff_size;
+  uptr len = ReadFileToBuffer("/proc/self/auxv", &buff, &buff_size, 1 << 16);
+  uptr value = 0;
+  const uptr *auxv = (const uptr *)buff;
+  for (uptr i = 0; i + 2 <= len / sizeof(uptr); i += 2) {
+    if (auxv[i] == type) {
+      value = auxv[i + 1];
+      break;
+    }
+  }
+  UnmapOrDie(buff, buff_size);
+  return value;
+}
+
+static uptr LookupVdsoSymbol(uptr base, const char *name) {
+  typedef ElfW(Ehdr) Elf_Ehdr;
+  typedef ElfW(Phdr) Elf_Phdr;
+  typedef ElfW(Dyn) Elf_Dyn;
+  typedef ElfW(Sym) Elf_Sym;
+  typedef ElfW(Word) Elf_Word;
+  const Elf_Ehdr *ehdr = (const Elf_Ehdr *)base;
+  // The vDSO isn't relocated, so the addresses in its dynamic section are
+  // the link time ones, relative to the first PT_LOAD segment.
+  uptr load_offset = 0;
+  bool found_load = false;
+  const Elf_Dyn *dyn = 0;
+  for (uptr i = 0; i < ehdr->e_phnum; i++) {
+    const Elf_Phdr *phdr =
+        (const Elf_Phdr *)(base + ehdr->e_phoff + i * ehdr->e_phentsize);
+    if (phdr->p_type == PT_LOAD && !found_load) {
+      load_offset = base + phdr->p_offset - phdr->p_vaddr;
+      found_load = true;
+    } else if (phdr->p_type == PT_DYNAMIC) {
+      dyn = (const Elf_Dyn *)(base + phdr->p_offset);
+    }
+  }
+  if (!found_load || !dyn)
+    return 0;
+  const char *strtab = 0;
+  const Elf_Sym *symtab = 0;
+  const Elf_Word *hash = 0;
+  for (; dyn->d_tag != DT_NULL; dyn++) {
+    if (dyn->d_tag == DT_STRTAB)
+      strtab = (const char *)(dyn->d_un.d_ptr + load_offset);
+    else if (dyn->d_tag == DT_SYMTAB)
+      symtab = (const Elf_Sym *)(dyn->d_un.d_ptr + load_offset);
+    else if (dyn->d_tag == DT_HASH)
+      hash = (const Elf_Word *)(dyn->d_un.d_ptr + load_offset);
+  }
+  if (!strtab || !symtab || !hash)
+    return 0;
+  // The second word of the hash table is the number of symbols.
+  for (Elf_Word i = 0; i < hash[1]; i++) {
+    const Elf_Sym *sym = &symtab[i];
+    if ((sym->st_info & 0xf) == STT_FUNC && sym->st_shndx != SHN_UNDEF &&
+        internal_strcmp(strtab + sym->st_name, name) == 0)
+      return sym->st_value + load_offset;
+  }
+  return 0;
+}
+
+// Returns the vDSO function with one of the given names (they depend on the
+// architecture), or 0. The result is cached in *fn_cache, which holds 0 until
+// the lookup and 1 if the vDSO has no such function.
+static uptr GetVdsoFunction(atomic_uintptr_t *fn_cache, const char *name,
+                            const char *alt_name) {
+  uptr fn = atomic_load(fn_cache, memory_order_acquire);
+  if (fn == 0) {
+    uptr base = GetAuxvEntry(AT_SYSINFO_EHDR_TYPE);
+    if (base) {
+      fn = LookupVdsoSymbol(base, name);
+      if (!fn)
+        fn = LookupVdsoSymbol(base, alt_name);
+    }
+    if (!fn)
+      fn = 1;
+    atomic_store(fn_cache, fn, memory_order_release);
+  }
+  return fn == 1 ? 0 : fn;
+}
+
+static atomic_uintptr_t vdso_clock_gettime;
+
+static vdso_clock_gettime_t GetVdsoClockGettime() {
+  return (vdso_clock_gettime_t)GetVdsoFunction(
+      &vdso_clock_gettime, "__vdso_clock_gettime", "__kernel_clock_gettime");
+}
+
+typedef int (*vdso_getcpu_t)(unsigned *cpu, unsigned *node, void *unused);
+static atomic_uintptr_t vdso_getcpu;
+
+static vdso_getcpu_t GetVdsoGetcpu() {
+  return (vdso_getcpu_t)GetVdsoFunction(&vdso_getcpu, "__vdso_getcpu",
+                                        "__kernel_getcpu");
+}
+
+uptr GetCurrentNumaNode() {
+  unsigned cpu = 0, node = 0;
+  vdso_getcpu_t vdso_fn = GetVdsoGetcpu();
+  if (!vdso_fn || vdso_fn(&cpu, &node, 0) != 0) {
+    if (internal_iserror(internal_syscall(__NR_getcpu, &cpu, &node, 0)))
+      return 0;
+  }
+  return node;
+}
+
+static u64 ClockNanoTime(int clock) {
+  kernel_timespec ts = {};
+  vdso_clock_gettime_t vdso_fn = GetVdsoClockGettime();
+  if (!vdso_fn || vdso_fn(clock, &ts) != 0)
+    internal_syscall(__NR_clock_gettime, clock, &ts);
+  return (u64)ts.tv_sec * 1000*1000*1000 + ts.tv_nsec;
+}
+
 u64 NanoTime() {
-  kernel_timeval tv = {};
-  internal_syscall(__NR_gettimeofday, &tv, 0);
-  return (u64)tv.tv_sec * 1000*1000*1000 + tv.tv_usec * 1000;
+  return ClockNanoTime(CLOCK_REALTIME_ID);
+}
+
+u64 MonotonicNanoTime() {
+  return ClockNanoTime(CLOCK_MONOTONIC_ID);
 }
 
 // Like getenv, but reads env directly from /proc and does not use libc.
@@ -309,6 +454,9 @@ void PrepareForSandboxing() {
   MemoryMappingLayout::CacheMemoryMappings();
   // Same for /proc/self/exe in the symbolizer.
   SymbolizerPrepareForSandboxing();
+  // And /proc/self/auxv, which gives the address of the vDSO.
+  GetVdsoClockGettime();
+  GetVdsoGetcpu();
 }
 
 // ----------------- sanitizer_procmaps.h
@@ -320,8 +468,9 @@ MemoryMappingLayout::MemoryMappingLayout(bool cache_enabled) {
   proc_self_maps_.len =
       ReadFileToBuffer("/proc/self/maps", &proc_self_maps_.data,
                        &proc_self_maps_.mmaped_size, 1 << 26);
+  bool read_succeeded = proc_self_maps_.mmaped_size != 0;
   if (cache_enabled) {
-    if (proc_self_maps_.mmaped_size == 0) {
+    if (!read_succeeded) {
       LoadFromCache();
       CHECK_GT(proc_self_maps_.len, 0);
     }
@@ -330,8 +479,10 @@ MemoryMappingLayout::MemoryMappingLayout(bool cache_enabled) {
   }
   Reset();
   // FIXME: in the future we may want to cache the mappings on demand only.
-  if (cache_enabled)
-    CacheMemoryMappings();
+  // Copy what was just read instead of reading /proc/self/maps again: the
+  // kernel has to format every mapping for each read.
+  if (cache_enabled && read_succeeded)
+    UpdateCache(proc_self_maps_);
 }
 
 MemoryMappingLayout::~MemoryMappingLayout() {
@@ -365,6 +516,20 @@ void MemoryMappingLayout::CacheMemoryMappings() {
   }
 }
 
+// static
+void MemoryMappingLayout::UpdateCache(const ProcSelfMapsBuff &proc_self_maps) {
+  ProcSelfMapsBuff copy;
+  copy.len = proc_self_maps.len;
+  copy.mmaped_size = RoundUpTo(copy.len + 1, GetPageSizeCached());
+  copy.data = (char *)MmapOrDie(copy.mmaped_size, "ProcSelfMapsCache");
+  internal_memcpy(copy.data, proc_self_maps.data, copy.len);
+  SpinMutexLock l(&cache_lock_);
+  ProcSelfMapsBuff old_proc_self_maps = cached_proc_self_maps_;
+  cached_proc_self_maps_ = copy;
+  if (old_proc_self_maps.mmaped_size)
+    UnmapOrDie(old_proc_self_maps.data, old_proc_self_maps.mmaped_size);
+}
+
 void MemoryMappingLayout::LoadFromCache() {
   SpinMutexLock l(&cache_lock_);
   if (cached_proc_self_maps_.data) {
@@ -477,6 +642,9 @@ enum MutexState {
   MtxSleeping = 2
 };
 
+// Lock attempts of a contended BlockingMutex before the futex wait.
+static const int kBlockingMutexSpinIters = 100;
+
 BlockingMutex::BlockingMutex(LinkerInitialized) {
   CHECK_EQ(owner_, 0);
 }
@@ -489,6 +657,16 @@ void BlockingMutex::Lock() {
   atomic_uint32_t *m = reinterpret_cast<atomic_uint32_t *>(&opaque_storage_);
   if (atomic_exchange(m, MtxLocked, memory_order_acquire) == MtxUnlocked)
     return;
+  // The critical sections are short, so spin for a while before paying for
+  // the futex wait and the wake.
+  for (int i = 0; i < kBlockingMutexSpinIters; i++) {
+    proc_yield(10);
+    u32 cmp = MtxUnlocked;
+    if (atomic_load(m, memory_order_relaxed) == MtxUnlocked &&
+        atomic_compare_exchange_strong(m, &cmp, MtxLocked,
+                                       memory_order_acquire))
+      return;
+  }
   while (atomic_exchange(m, MtxSleeping, memory_order_acquire) != MtxUnlocked)
     internal_syscall(__NR_futex, m, FUTEX_WAIT, MtxSleeping, 0, 0, 0);
 }
@@ -551,6 +729,18 @@ uptr internal_sigaltstack(const struct sigaltstack *ss,
   return internal_syscall(__NR_sigaltstack, ss, oss);
 }
 
+uptr internal_kill(int pid, int sig) {
+  return internal_syscall(__NR_kill, pid, sig);
+}
+
+uptr internal_fork() {
+  return internal_syscall(__NR_fork);
+}
+
+uptr internal_pipe(int pipefd[2]) {
+  return internal_syscall(__NR_pipe2, pipefd, O_CLOEXEC);
+}
+
 // ThreadLister implementation.
 ThreadLister::ThreadLister(int pid)
   : pid_(pid),
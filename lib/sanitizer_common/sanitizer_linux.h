@@ -29,6 +29,10 @@ uptr internal_getdents(fd_t fd, struct linux_dirent *dirp, unsigned int count);
 uptr internal_prctl(int option, uptr arg2, uptr arg3, uptr arg4, uptr arg5);
 uptr internal_sigaltstack(const struct sigaltstack* ss,
                           struct sigaltstack* oss);
+uptr internal_kill(int pid, int sig);
+uptr internal_fork();
+// The descriptors are created close-on-exec.
+uptr internal_pipe(int pipefd[2]);
 
 // This class reads thread IDs from /proc/<pid>/task using only syscalls.
 class ThreadLister {
@@ -150,7 +150,10 @@ void StackTrace::SlowUnwindStack(uptr pc, uptr max_depth) {
   this->size = 0;
   this->max_size = max_depth;
   if (max_depth > 1) {
-    _Unwind_Backtrace(Unwind_Trace, this);
+    if (!CfiUnwindStack(max_depth)) {
+      this->size = 0;
+      _Unwind_Backtrace(Unwind_Trace, this);
+    }
     // We need to pop a few frames so that pc is on top.
     // trace[0] belongs to the current function so we always pop it.
     int to_pop = 1;
@@ -132,6 +132,10 @@ uptr GetTid() {
   return reinterpret_cast<uptr>(pthread_self());
 }
 
+uptr GetCurrentNumaNode() {
+  return 0;
+}
+
 void GetThreadStackTopAndBottom(bool at_initialization, uptr *stack_top,
                                 uptr *stack_bottom) {
   CHECK(stack_top);
@@ -347,6 +351,10 @@ u64 NanoTime() {
   return 0;
 }
 
+u64 MonotonicNanoTime() {
+  return 0;
+}
+
 uptr GetTlsSize() {
   return 0;
 }
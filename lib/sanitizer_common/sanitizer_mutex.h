@@ -67,6 +67,109 @@ class SpinMutex : public StaticSpinMutex {
   void operator=(const SpinMutex&);
 };
 
+// Reader-writer spin mutex for read-mostly data. It prefers writers: once a
+// writer waits, new readers wait until it is done, so that a steady stream of
+// readers can't starve it.
+class RWMutex {
+ public:
+  explicit RWMutex(LinkerInitialized) {}
+
+  RWMutex() {
+    atomic_store(&state_, kUnlocked, memory_order_relaxed);
+  }
+
+  void Lock() {
+    uptr cmp = kUnlocked;
+    if (atomic_compare_exchange_strong(&state_, &cmp, kWriteLock,
+                                       memory_order_acquire))
+      return;
+    LockSlow();
+  }
+
+  void Unlock() {
+    uptr s = atomic_load(&state_, memory_order_relaxed);
+    for (;;) {
+      DCHECK_NE(s & kWriteLock, 0);
+      if (atomic_compare_exchange_weak(&state_, &s, s - kWriteLock,
+                                       memory_order_release))
+        return;
+    }
+  }
+
+  void ReadLock() {
+    uptr s = atomic_load(&state_, memory_order_relaxed);
+    if ((s & kNoReaders) == 0 &&
+        atomic_compare_exchange_weak(&state_, &s, s + kReadLock,
+                                     memory_order_acquire))
+      return;
+    ReadLockSlow();
+  }
+
+  void ReadUnlock() {
+    uptr s = atomic_load(&state_, memory_order_relaxed);
+    for (;;) {
+      DCHECK_NE(s & kReaderMask, 0);
+      if (atomic_compare_exchange_weak(&state_, &s, s - kReadLock,
+                                       memory_order_release))
+        return;
+    }
+  }
+
+  void CheckLocked() {
+    CHECK_NE(atomic_load(&state_, memory_order_relaxed), kUnlocked);
+  }
+
+ private:
+  // The state is the write lock bit, the number of waiting writers and the
+  // number of readers.
+  static const uptr kUnlocked = 0;
+  static const uptr kWriteLock = 1;
+  static const uptr kWriterWait = 2;
+  static const uptr kReadLock = 1 << 16;
+  static const uptr kWriterWaitMask = kReadLock - kWriterWait;
+  static const uptr kReaderMask = ~(kReadLock - 1);
+  // Readers wait while these bits are set.
+  static const uptr kNoReaders = kWriteLock | kWriterWaitMask;
+
+  atomic_uintptr_t state_;
+
+  static void Backoff(int i) {
+    if (i < 10)
+      proc_yield(10);
+    else
+      internal_sched_yield();
+  }
+
+  void NOINLINE LockSlow() {
+    uptr s = atomic_load(&state_, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak(&state_, &s, s + kWriterWait,
+                                         memory_order_relaxed)) {}
+    for (int i = 0;; i++) {
+      s = atomic_load(&state_, memory_order_relaxed);
+      if ((s & (kWriteLock | kReaderMask)) == 0 &&
+          atomic_compare_exchange_weak(&state_, &s,
+                                       s - kWriterWait + kWriteLock,
+                                       memory_order_acquire))
+        return;
+      Backoff(i);
+    }
+  }
+
+  void NOINLINE ReadLockSlow() {
+    for (int i = 0;; i++) {
+      uptr s = atomic_load(&state_, memory_order_relaxed);
+      if ((s & kNoReaders) == 0 &&
+          atomic_compare_exchange_weak(&state_, &s, s + kReadLock,
+                                       memory_order_acquire))
+        return;
+      Backoff(i);
+    }
+  }
+
+  RWMutex(const RWMutex&);
+  void operator=(const RWMutex&);
+};
+
 class BlockingMutex {
  public:
   explicit BlockingMutex(LinkerInitialized);
@@ -119,6 +222,8 @@ class GenericScopedReadLock {
 
 typedef GenericScopedLock<StaticSpinMutex> SpinMutexLock;
 typedef GenericScopedLock<BlockingMutex> BlockingMutexLock;
+typedef GenericScopedLock<RWMutex> RWMutexLock;
+typedef GenericScopedReadLock<RWMutex> RWMutexReadLock;
 
 }  // namespace __sanitizer
 
@@ -22,6 +22,10 @@
 
 #include <sys/mman.h>
 
+#if SANITIZER_LINUX && !defined(MAP_FIXED_NOREPLACE)
+# define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
 namespace __sanitizer {
 
 // ------------- sanitizer_common.h
@@ -70,6 +74,19 @@ void *MmapOrDie(uptr size, const char *mem_type) {
   return (void *)res;
 }
 
+void *MmapNoReserveOrDie(uptr size, const char *mem_type) {
+  size = RoundUpTo(size, GetPageSizeCached());
+  uptr res = internal_mmap(0, size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+  int reserrno;
+  if (internal_iserror(res, &reserrno)) {
+    Report("ERROR: %s failed to allocate noreserve 0x%zx (%zd) bytes of %s: "
+           "%d\n", SanitizerToolName, size, size, mem_type, reserrno);
+    CHECK("unable to mmap" && 0);
+  }
+  return (void *)res;
+}
+
 void UnmapOrDie(void *addr, uptr size) {
   if (!addr || !size) return;
   uptr res = internal_munmap(addr, size);
@@ -112,6 +129,26 @@ void *MmapFixedOrDie(uptr fixed_addr, uptr size) {
   return (void *)p;
 }
 
+bool TryMmapFixedNoReserve(uptr fixed_addr, uptr size) {
+  uptr PageSize = GetPageSizeCached();
+  CHECK_EQ(fixed_addr & (PageSize - 1), 0);
+  size = RoundUpTo(size, PageSize);
+  int flags = MAP_PRIVATE | MAP_ANON | MAP_NORESERVE;
+#if SANITIZER_LINUX
+  // Older kernels ignore the flag and treat the address as a hint.
+  flags |= MAP_FIXED_NOREPLACE;
+#endif
+  uptr p = internal_mmap((void*)fixed_addr, size, PROT_READ | PROT_WRITE,
+                         flags, -1, 0);
+  if (internal_iserror(p))
+    return false;
+  if (p != fixed_addr) {
+    internal_munmap((void*)p, size);
+    return false;
+  }
+  return true;
+}
+
 void *Mprotect(uptr fixed_addr, uptr size) {
   return (void *)internal_mmap((void*)fixed_addr, size,
                                PROT_NONE,
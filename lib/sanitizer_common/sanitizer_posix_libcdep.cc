@@ -16,6 +16,7 @@
 
 #if SANITIZER_LINUX || SANITIZER_MAC
 #include "sanitizer_common.h"
+#include "sanitizer_flags.h"
 #include "sanitizer_stacktrace.h"
 
 #include <errno.h>
@@ -41,6 +42,35 @@ void FlushUnneededShadowMemory(uptr addr, uptr size) {
   madvise((void*)addr, size, MADV_DONTNEED);
 }
 
+void HugePagesInRegion(uptr addr, uptr size) {
+#ifdef MADV_HUGEPAGE
+  madvise((void*)addr, size, MADV_HUGEPAGE);
+#endif
+}
+
+void NoHugePagesInRegion(uptr addr, uptr size) {
+#ifdef MADV_NOHUGEPAGE
+  madvise((void*)addr, size, MADV_NOHUGEPAGE);
+#endif
+}
+
+void PrefaultRegion(uptr addr, uptr size) {
+  uptr page_size = GetPageSizeCached();
+  uptr end = addr + size;
+#if SANITIZER_LINUX
+  // Linux 5.14+ populates the range in one call, without touching the data.
+  const int kMadvPopulateWrite = 23;
+  uptr beg = RoundDownTo(addr, page_size);
+  if (madvise((void*)beg, RoundUpTo(end, page_size) - beg,
+              kMadvPopulateWrite) == 0)
+    return;
+#endif
+  for (uptr p = addr; p < end; p = RoundDownTo(p, page_size) + page_size) {
+    volatile char *c = (volatile char*)p;
+    *c = *c;
+  }
+}
+
 void DisableCoreDumper() {
   struct rlimit nocore;
   nocore.rlim_cur = 0;
@@ -102,6 +132,9 @@ void GetStackTrace(StackTrace *stack, uptr max_s, uptr pc, uptr bp,
   if (!fast)
     return stack->SlowUnwindStack(pc, max_s);
 #endif  // SANITIZER_MAC
+  if (common_flags()->use_shadow_call_stack &&
+      stack->ShadowCallStackUnwind(pc, bp, stack_top, stack_bottom, max_s))
+    return;
   stack->size = 0;
   stack->trace[0] = pc;
   if (max_s > 1) {
@@ -99,6 +99,9 @@ class MemoryMappingLayout {
   }
 
 # if SANITIZER_LINUX
+  // Replaces the cache with a copy of the given buffer.
+  static void UpdateCache(const ProcSelfMapsBuff &proc_self_maps);
+
   ProcSelfMapsBuff proc_self_maps_;
   char *current_;
 
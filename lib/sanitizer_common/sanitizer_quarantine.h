@@ -34,22 +34,50 @@ struct QuarantineBatch {
 };
 
 // The callback interface is:
-// void Callback::Recycle(Node *ptr);
+// void Callback::RecycleBatch(Node **ptrs, uptr n);  // Recycles n nodes.
 // void *cb.Allocate(uptr size);
 // void cb.Deallocate(void *ptr);
-template<typename Callback, typename Node>
+// The global queue may be split into kNumShards independent shards, so that
+// draining and recycling in different threads do not contend. Per-thread
+// caches are drained into the shards in round-robin order, so that all
+// shards see memory of about the same age, and the FIFO order is
+// approximately preserved.
+template<typename Callback, typename Node, uptr kNumShards = 1>
 class Quarantine {
  public:
   typedef QuarantineCache<Callback> Cache;
 
-  explicit Quarantine(LinkerInitialized)
-      : cache_(LINKER_INITIALIZED) {
+  explicit Quarantine(LinkerInitialized) {
   }
 
   void Init(uptr size, uptr cache_size) {
-    max_size_ = size;
-    min_size_ = size / 10 * 9;  // 90% of max size.
+    // Small quarantines are not split, so that every shard can hold several
+    // drained per-thread caches.
+    num_shards_ = kNumShards;
+    while (num_shards_ > 1 &&
+           size / num_shards_ < cache_size * kMinCachesPerShard)
+      num_shards_ /= 2;
     max_cache_size_ = cache_size;
+    SetMaxSize(size);
+  }
+
+  // Changes the total size of the quarantine, e.g. to follow the heap size.
+  // The number of shards chosen in Init() is kept.
+  void SetMaxSize(uptr size) {
+    max_size_ = size / num_shards_;
+    min_size_ = max_size_ / 10 * 9;  // 90% of max size.
+  }
+
+  uptr GetMaxSize() const {
+    return max_size_ * num_shards_;
+  }
+
+  // Bytes in the global part of the quarantine; racy.
+  uptr GetSize() const {
+    uptr size = 0;
+    for (uptr i = 0; i < num_shards_; i++)
+      size += shards_[i].cache.Size();
+    return size;
   }
 
   void Put(Cache *c, Callback cb, Node *ptr, uptr size) {
@@ -59,48 +87,90 @@ class Quarantine {
   }
 
   void NOINLINE Drain(Cache *c, Callback cb) {
+    Shard *shard = &shards_[0];
+    if (num_shards_ > 1) {
+      uptr idx = atomic_fetch_add(&next_shard_, 1, memory_order_relaxed);
+      shard = &shards_[idx % num_shards_];
+    }
     {
-      SpinMutexLock l(&cache_mutex_);
-      cache_.Transfer(c);
+      SpinMutexLock l(&shard->cache_mutex);
+      shard->cache.Transfer(c);
     }
-    if (cache_.Size() > max_size_ && recycle_mutex_.TryLock())
-      Recycle(cb);
+    if (shard->cache.Size() > max_size_ && shard->recycle_mutex.TryLock())
+      Recycle(shard, cb);
+  }
+
+  // Recycles the oldest chunks of the global queue until at least size
+  // bytes are recycled (all of them if size is 0) or the queue is empty,
+  // e.g. under memory pressure. Returns the number of recycled bytes.
+  uptr Shrink(Callback cb, uptr size) {
+    uptr recycled = 0;
+    for (uptr i = 0; i < num_shards_; i++) {
+      // Every shard gives an equal part of what is left to recycle.
+      uptr target = (uptr)-1;
+      if (size) {
+        if (recycled >= size)
+          break;
+        uptr shards_left = num_shards_ - i;
+        target = (size - recycled + shards_left - 1) / shards_left;
+      }
+      Shard *shard = &shards_[i];
+      Cache tmp;
+      shard->recycle_mutex.Lock();
+      {
+        SpinMutexLock l(&shard->cache_mutex);
+        while (tmp.Size() < target) {
+          QuarantineBatch *b = shard->cache.DequeueBatch();
+          if (b == 0)
+            break;
+          tmp.EnqueueBatch(b);
+        }
+      }
+      shard->recycle_mutex.Unlock();
+      recycled += tmp.Size();
+      DoRecycle(&tmp, cb);
+    }
+    return recycled;
   }
 
  private:
+  struct Shard {
+    Shard() : cache(LINKER_INITIALIZED) {}
+    SpinMutex cache_mutex;
+    SpinMutex recycle_mutex;
+    Cache cache;
+    char pad[kCacheLineSize];
+  };
+
+  static const uptr kMinCachesPerShard = 8;
+
   // Read-only data.
   char pad0_[kCacheLineSize];
-  uptr max_size_;
-  uptr min_size_;
+  uptr num_shards_;  // Number of used shards, at most kNumShards.
+  uptr max_size_;  // Per shard.
+  uptr min_size_;  // Per shard.
   uptr max_cache_size_;
   char pad1_[kCacheLineSize];
-  SpinMutex cache_mutex_;
-  SpinMutex recycle_mutex_;
-  Cache cache_;
+  atomic_uintptr_t next_shard_;
   char pad2_[kCacheLineSize];
+  Shard shards_[kNumShards];
 
-  void NOINLINE Recycle(Callback cb) {
+  void NOINLINE Recycle(Shard *shard, Callback cb) {
     Cache tmp;
     {
-      SpinMutexLock l(&cache_mutex_);
-      while (cache_.Size() > min_size_) {
-        QuarantineBatch *b = cache_.DequeueBatch();
+      SpinMutexLock l(&shard->cache_mutex);
+      while (shard->cache.Size() > min_size_) {
+        QuarantineBatch *b = shard->cache.DequeueBatch();
         tmp.EnqueueBatch(b);
       }
     }
-    recycle_mutex_.Unlock();
+    shard->recycle_mutex.Unlock();
     DoRecycle(&tmp, cb);
   }
 
   void NOINLINE DoRecycle(Cache *c, Callback cb) {
     while (QuarantineBatch *b = c->DequeueBatch()) {
-      const uptr kPrefetch = 16;
-      for (uptr i = 0; i < kPrefetch; i++)
-        PREFETCH(b->batch[i]);
-      for (uptr i = 0; i < b->count; i++) {
-        PREFETCH(b->batch[i + kPrefetch]);
-        cb.Recycle((Node*)b->batch[i]);
-      }
+      cb.RecycleBatch(reinterpret_cast<Node**>(b->batch), b->count);
       cb.Deallocate(b);
     }
   }
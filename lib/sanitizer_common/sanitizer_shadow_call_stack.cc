@@ -0,0 +1,90 @@
+//===-- sanitizer_shadow_call_stack.cc ------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is shared between AddressSanitizer, MemorySanitizer and
+// LeakSanitizer run-time libraries.
+//===----------------------------------------------------------------------===//
+
+#include "sanitizer_shadow_call_stack.h"
+#include "sanitizer_common.h"
+#include "sanitizer_libc.h"
+#include "sanitizer_stacktrace.h"
+
+namespace __sanitizer {
+
+#if SANITIZER_CAN_USE_SHADOW_CALL_STACK
+// The stack grows down from the end of pcs, so that the active part
+// is a contiguous innermost-first trace. Frames above kStackTraceMax
+// are only counted.
+struct ShadowCallStack {
+  uptr depth;
+  uptr pcs[kStackTraceMax];
+};
+
+static THREADLOCAL ShadowCallStack shadow_call_stack;
+
+const uptr *GetShadowCallStack(uptr *size) {
+  ShadowCallStack *s = &shadow_call_stack;
+  uptr depth = s->depth;
+  if (depth == 0 || depth > kStackTraceMax)
+    return 0;
+  *size = depth;
+  return &s->pcs[kStackTraceMax - depth];
+}
+#else
+const uptr *GetShadowCallStack(uptr *size) {
+  (void)size;
+  return 0;
+}
+#endif  // SANITIZER_CAN_USE_SHADOW_CALL_STACK
+
+bool StackTrace::ShadowCallStackUnwind(uptr pc, uptr bp, uptr stack_top,
+                                       uptr stack_bottom, uptr max_depth) {
+  uptr n = 0;
+  const uptr *pcs = GetShadowCallStack(&n);
+  if (pcs == 0 || max_depth < 2)
+    return false;
+  // The innermost instrumented function is the caller of the current frame
+  // (or further up, if the caller is not instrumented), its pc is not on
+  // the shadow stack.
+  size = 0;
+  trace[0] = pc;
+  max_size = 2;
+  FastUnwindStack(pc, bp, stack_top, stack_bottom);
+  n = Min(n, max_depth - size);
+  internal_memcpy(&trace[size], pcs, n * sizeof(pcs[0]));
+  size += n;
+  max_size = max_depth;
+  return true;
+}
+
+}  // namespace __sanitizer
+
+using namespace __sanitizer;  // NOLINT
+
+extern "C" {
+void __sanitizer_shadow_call_stack_push(void *pc) {
+#if SANITIZER_CAN_USE_SHADOW_CALL_STACK
+  ShadowCallStack *s = &shadow_call_stack;
+  uptr depth = s->depth++;
+  if (depth < kStackTraceMax)
+    s->pcs[kStackTraceMax - 1 - depth] = (uptr)pc;
+#else
+  (void)pc;
+#endif
+}
+
+void __sanitizer_shadow_call_stack_pop() {
+#if SANITIZER_CAN_USE_SHADOW_CALL_STACK
+  ShadowCallStack *s = &shadow_call_stack;
+  if (s->depth > 0)
+    s->depth--;
+#endif
+}
+}  // extern "C"
@@ -0,0 +1,46 @@
+//===-- sanitizer_shadow_call_stack.h ---------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Per-thread shadow call stack, fed by instrumentation through
+// __sanitizer_shadow_call_stack_push/pop at function entry/exit.
+// It lets the tools take malloc/free stacks without walking frames.
+//===----------------------------------------------------------------------===//
+#ifndef SANITIZER_SHADOW_CALL_STACK_H
+#define SANITIZER_SHADOW_CALL_STACK_H
+
+#include "sanitizer_internal_defs.h"
+#include "sanitizer_platform.h"
+
+// The stack lives in TLS, which is not available everywhere.
+#if SANITIZER_LINUX && !SANITIZER_ANDROID
+# define SANITIZER_CAN_USE_SHADOW_CALL_STACK 1
+#else
+# define SANITIZER_CAN_USE_SHADOW_CALL_STACK 0
+#endif
+
+namespace __sanitizer {
+
+// Returns the return addresses pushed by the instrumented functions that are
+// currently active on this thread, innermost first (i.e. in StackTrace order,
+// the result can be passed to StackDepotPut as is). Returns 0 if there are
+// none, or if the stack is deeper than kStackTraceMax.
+const uptr *GetShadowCallStack(uptr *size);
+
+}  // namespace __sanitizer
+
+extern "C" {
+  // Called by instrumentation on function entry with the return address
+  // of the function, and on function exit.
+  SANITIZER_INTERFACE_ATTRIBUTE
+  void __sanitizer_shadow_call_stack_push(void *pc);
+  SANITIZER_INTERFACE_ATTRIBUTE
+  void __sanitizer_shadow_call_stack_pop();
+}  // extern "C"
+
+#endif  // SANITIZER_SHADOW_CALL_STACK_H
@@ -13,42 +13,120 @@
 
 #include "sanitizer_stackdepot.h"
 #include "sanitizer_common.h"
+#include "sanitizer_flags.h"
 #include "sanitizer_internal_defs.h"
 #include "sanitizer_mutex.h"
 #include "sanitizer_atomic.h"
+#include "sanitizer_stacktrace.h"
 
 namespace __sanitizer {
 
-const int kTabSize = 1024 * 1024;  // Hash table size.
+const int kTabSize = 1024 * 1024;  // Size of the first hash table.
+const int kMaxTabs = 8;  // Each next hash table is twice as large.
 const int kPartBits = 8;
 const int kPartShift = sizeof(u32) * 8 - kPartBits - 1;
-const int kPartCount = 1 << kPartBits;  // Number of subparts in the table.
-const int kPartSize = kTabSize / kPartCount;
+const int kPartCount = 1 << kPartBits;  // Number of subparts in the id space.
 const int kMaxId = 1 << kPartShift;
+// The id -> StackDesc map is split into lazily allocated chunks.
+const int kIdChunkSize = 4096;
+const int kIdChunkCount = kMaxId / kIdChunkSize * kPartCount;
+
+// Stacks up to this size are encoded if compress_stack_depot is set.
+const uptr kMaxEncodedFrames = kStackTraceMax;
+// Once the depot uses half of stack_depot_max_mb, the stacks which are not in
+// it yet are stored with at most this many top frames.
+const uptr kTruncatedStackFrames = 8;
 
 struct StackDesc {
   StackDesc *link;
   u32 id;
   u32 hash;
-  uptr size;
-  uptr stack[1];  // [size]
+  u32 size;
+  u32 encoded_size;  // 0 if the frames are stored as is.
+  // Followed by either uptr stack[size] or u8 encoded[encoded_size].
+
+  uptr *stack() {
+    return (uptr*)(this + 1);
+  }
+  u8 *encoded() {
+    return (u8*)(this + 1);
+  }
 };
 
+// New stacks are always inserted into the last (largest) hash table.
+// Once it holds about as many stacks as it has buckets, a twice larger table
+// is added, so the average chain length stays bounded without moving the
+// already published descriptors. Lookups scan the tables from the newest
+// to the oldest and never take locks.
 static struct {
-  StaticSpinMutex mtx;  // Protects alloc of new blocks for region allocator.
+  StaticSpinMutex mtx;  // Protects alloc of new blocks for region allocator
+                        // and creation of new hash tables and id chunks.
   atomic_uintptr_t region_pos;  // Region allocator for StackDesc's.
   atomic_uintptr_t region_end;
-  atomic_uintptr_t tab[kTabSize];  // Hash table of StackDesc's.
+  atomic_uintptr_t tab[kTabSize];  // First hash table of StackDesc's.
+  atomic_uintptr_t tabs[kMaxTabs];  // Hash tables added later, [0] unused.
+  atomic_uint32_t n_tabs;
+  atomic_uintptr_t n_uniq_ids;
+  atomic_uintptr_t allocated;
+  atomic_uintptr_t mapped;
+  atomic_uintptr_t n_truncated;
+  atomic_uintptr_t n_dropped;
+  atomic_uint8_t truncation_warned;
+  atomic_uint8_t full_warned;
+  atomic_uintptr_t n_cache_lookups;
+  atomic_uintptr_t n_cache_hits;
   atomic_uint32_t seq[kPartCount];  // Unique id generators.
+  atomic_uintptr_t id_chunks[kIdChunkCount];  // Maps id to StackDesc.
 } depot;
 
 static StackDepotStats stats;
 
+static uptr TabSize(uptr tab_idx) {
+  return (uptr)kTabSize << tab_idx;
+}
+
+static atomic_uintptr_t *GetTab(uptr tab_idx) {
+  if (tab_idx == 0)
+    return depot.tab;
+  return (atomic_uintptr_t*)atomic_load(&depot.tabs[tab_idx],
+                                        memory_order_consume);
+}
+
+static uptr NumTabs() {
+  uptr n = atomic_load(&depot.n_tabs, memory_order_acquire);
+  return n ? n : 1;
+}
+
 StackDepotStats *StackDepotGetStats() {
+  stats.n_uniq_ids = atomic_load(&depot.n_uniq_ids, memory_order_relaxed);
+  stats.allocated = atomic_load(&depot.allocated, memory_order_relaxed);
+  stats.mapped = atomic_load(&depot.mapped, memory_order_relaxed);
+  stats.n_truncated = atomic_load(&depot.n_truncated, memory_order_relaxed);
+  stats.n_dropped = atomic_load(&depot.n_dropped, memory_order_relaxed);
+  stats.n_cache_lookups = atomic_load(&depot.n_cache_lookups,
+                                      memory_order_relaxed);
+  stats.n_cache_hits = atomic_load(&depot.n_cache_hits, memory_order_relaxed);
+  stats.n_tabs = NumTabs();
+  stats.n_buckets = 0;
+  stats.max_chain_len = 0;
+  internal_memset(stats.chain_len_hist, 0, sizeof(stats.chain_len_hist));
+  for (uptr t = 0; t < stats.n_tabs; t++) {
+    atomic_uintptr_t *tab = GetTab(t);
+    uptr n = TabSize(t);
+    stats.n_buckets += n;
+    for (uptr i = 0; i < n; i++) {
+      uptr v = atomic_load(&tab[i], memory_order_consume);
+      uptr len = 0;
+      for (StackDesc *s = (StackDesc*)(v & ~1); s; s = s->link)
+        len++;
+      stats.max_chain_len = Max(stats.max_chain_len, len);
+      stats.chain_len_hist[Min(len, (uptr)kStackDepotChainHistSize - 1)]++;
+    }
+  }
   return &stats;
 }
 
-static u32 hash(const uptr *stack, uptr size) {
+static u32 hash_murmur2(const uptr *stack, uptr size) {
   // murmur2
   const u32 m = 0x5bd1e995;
   const u32 seed = 0x9747b28c;
@@ -68,7 +146,93 @@ static u32 hash(const uptr *stack, uptr size) {
   return h;
 }
 
-static StackDesc *tryallocDesc(uptr memsz) {
+#if SANITIZER_WORDSIZE == 64
+static u32 fold64(u64 h) {
+  // Final avalanche, so that both the high bits (used for the id part) and
+  // the low bits (used for the bucket index) depend on every input bit.
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return (u32)h;
+}
+
+static u32 hash_mul64(const uptr *stack, uptr size) {
+  // murmur64A: mixes whole 64-bit frames instead of their low halves.
+  const u64 m = 0xc6a4a7935bd1e995ULL;
+  const u64 r = 47;
+  u64 h = 0x9747b28cULL ^ (size * sizeof(uptr) * m);
+  for (uptr i = 0; i < size; i++) {
+    u64 k = stack[i];
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+  return fold64(h);
+}
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+# define SANITIZER_STACKDEPOT_CRC32 1
+static bool CpuHasCrc32() {
+  u32 eax, ebx, ecx, edx;
+  __asm__ __volatile__("cpuid"  // NOLINT
+      : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1), "c"(0));
+  return ecx & (1 << 20);  // SSE4.2
+}
+
+static u32 hash_crc32(const uptr *stack, uptr size) {
+  // crc32q is not available without -msse4.2, so it is emitted directly.
+  u64 h = size;
+  for (uptr i = 0; i < size; i++) {
+    u64 k = stack[i];
+    __asm__("crc32q %1, %0" : "+r"(h) : "rm"(k));  // NOLINT
+  }
+  return fold64(h);
+}
+#endif
+
+enum {
+  kHashUnknown = 0,
+  kHashMurmur2,
+  kHashMul64,
+  kHashCrc32
+};
+// The hash function is chosen once, so that all stacks are hashed the same.
+static atomic_uint32_t hash_kind;
+
+static u32 ChooseHash() {
+#if defined(SANITIZER_STACKDEPOT_CRC32)
+  if (CpuHasCrc32())
+    return kHashCrc32;
+#endif
+#if SANITIZER_WORDSIZE == 64
+  return kHashMul64;
+#else
+  return kHashMurmur2;
+#endif
+}
+
+static u32 hash(const uptr *stack, uptr size) {
+  u32 kind = atomic_load(&hash_kind, memory_order_relaxed);
+  if (kind == kHashUnknown) {
+    // Racing threads make the same choice.
+    kind = ChooseHash();
+    atomic_store(&hash_kind, kind, memory_order_relaxed);
+  }
+  switch (kind) {
+#if defined(SANITIZER_STACKDEPOT_CRC32)
+    case kHashCrc32: return hash_crc32(stack, size);
+#endif
+#if SANITIZER_WORDSIZE == 64
+    case kHashMul64: return hash_mul64(stack, size);
+#endif
+    default: return hash_murmur2(stack, size);
+  }
+}
+
+static uptr tryalloc(uptr memsz) {
   // Optimisic lock-free allocation, essentially try to bump the region ptr.
   for (;;) {
     uptr cmp = atomic_load(&depot.region_pos, memory_order_acquire);
@@ -78,49 +242,146 @@ static StackDesc *tryallocDesc(uptr memsz) {
     if (atomic_compare_exchange_weak(
         &depot.region_pos, &cmp, cmp + memsz,
         memory_order_acquire))
-      return (StackDesc*)cmp;
+      return cmp;
   }
 }
 
-static StackDesc *allocDesc(uptr size) {
-  // First, try to allocate optimisitically.
-  uptr memsz = sizeof(StackDesc) + (size - 1) * sizeof(uptr);
-  StackDesc *s = tryallocDesc(memsz);
-  if (s)
-    return s;
-  // If failed, lock, retry and alloc new superblock.
-  SpinMutexLock l(&depot.mtx);
+static uptr allocLocked(uptr memsz) {
   for (;;) {
-    s = tryallocDesc(memsz);
+    uptr s = tryalloc(memsz);
     if (s)
       return s;
     atomic_store(&depot.region_pos, 0, memory_order_relaxed);
+    // The slack at the end of the region lets DecodeStack over-read
+    // the last descriptor.
     uptr allocsz = 64 * 1024;
-    if (allocsz < memsz)
-      allocsz = memsz;
+    if (allocsz < memsz + StackTrace::kEncodedStackSlack)
+      allocsz = RoundUpTo(memsz + StackTrace::kEncodedStackSlack, 4096);
     uptr mem = (uptr)MmapOrDie(allocsz, "stack depot");
-    stats.mapped += allocsz;
-    atomic_store(&depot.region_end, mem + allocsz, memory_order_release);
+    atomic_fetch_add(&depot.mapped, allocsz, memory_order_relaxed);
+    atomic_store(&depot.region_end,
+                 mem + allocsz - StackTrace::kEncodedStackSlack,
+                 memory_order_release);
     atomic_store(&depot.region_pos, mem, memory_order_release);
   }
 }
 
-static u32 find(StackDesc *s, const uptr *stack, uptr size, u32 hash) {
+static uptr alloc(uptr memsz) {
+  memsz = RoundUpTo(memsz, sizeof(uptr));
+  // First, try to allocate optimisitically.
+  uptr mem = tryalloc(memsz);
+  if (mem)
+    return mem;
+  // If failed, lock, retry and alloc new superblock.
+  SpinMutexLock l(&depot.mtx);
+  return allocLocked(memsz);
+}
+
+static StackDesc *allocDesc(uptr size, uptr encoded_size) {
+  uptr memsz = sizeof(StackDesc);
+  if (encoded_size)
+    memsz += encoded_size;
+  else
+    memsz += size * sizeof(uptr);
+  atomic_fetch_add(&depot.allocated, RoundUpTo(memsz, sizeof(uptr)),
+                   memory_order_relaxed);
+  return (StackDesc*)alloc(memsz);
+}
+
+static uptr budget() {
+  return (uptr)common_flags()->stack_depot_max_mb << 20;
+}
+
+// Adds a new hash table if the last one is full. With a budget, the chains
+// get longer instead once the table would not fit.
+static void maybeGrow(uptr n_uniq_ids) {
+  uptr n = NumTabs();
+  if (n == kMaxTabs || n_uniq_ids < TabSize(n) - kTabSize)
+    return;
+  uptr memsz = TabSize(n) * sizeof(atomic_uintptr_t);
+  if (budget() &&
+      atomic_load(&depot.mapped, memory_order_relaxed) + memsz > budget())
+    return;
+  SpinMutexLock l(&depot.mtx);
+  if (NumTabs() != n)
+    return;
+  uptr mem = (uptr)MmapOrDie(memsz, "stack depot table");
+  atomic_fetch_add(&depot.mapped, memsz, memory_order_relaxed);
+  atomic_store(&depot.tabs[n], mem, memory_order_release);
+  atomic_store(&depot.n_tabs, n + 1, memory_order_release);
+}
+
+static atomic_uintptr_t *idSlot(u32 id, bool create) {
+  uptr part = id >> kPartShift;
+  uptr seq = id & (kMaxId - 1);
+  // Chunks of all parts with the same seq range are adjacent, so that
+  // small processes touch only the beginning of id_chunks.
+  atomic_uintptr_t *chunkp =
+      &depot.id_chunks[seq / kIdChunkSize * kPartCount + part];
+  uptr chunk = atomic_load(chunkp, memory_order_consume);
+  if (chunk == 0) {
+    if (!create)
+      return 0;
+    SpinMutexLock l(&depot.mtx);
+    chunk = atomic_load(chunkp, memory_order_relaxed);
+    if (chunk == 0) {
+      // Region memory comes from mmap and is zeroed.
+      chunk = allocLocked(kIdChunkSize * sizeof(atomic_uintptr_t));
+      atomic_store(chunkp, chunk, memory_order_release);
+    }
+  }
+  return (atomic_uintptr_t*)chunk + seq % kIdChunkSize;
+}
+
+// The stack being looked up or inserted, in the form it is stored in.
+struct StackKey {
+  const uptr *stack;
+  uptr size;
+  const u8 *encoded;  // 0 if the stack is not encoded.
+  uptr encoded_size;
+};
+
+static bool equal(StackDesc *s, const StackKey &key) {
+  if (s->size != key.size)
+    return false;
+  if (s->encoded_size) {
+    return s->encoded_size == key.encoded_size &&
+           internal_memcmp(s->encoded(), key.encoded, key.encoded_size) == 0;
+  }
+  const uptr *stack = s->stack();
+  for (uptr i = 0; i < key.size; i++) {
+    if (key.stack[i] != stack[i])
+      return false;
+  }
+  return true;
+}
+
+static u32 find(StackDesc *s, const StackKey &key, u32 hash) {
   // Searches linked list s for the stack, returns its id.
   for (; s; s = s->link) {
-    if (s->hash == hash && s->size == size) {
-      uptr i = 0;
-      for (; i < size; i++) {
-        if (stack[i] != s->stack[i])
-          break;
-      }
-      if (i == size)
-        return s->id;
-    }
+    if (s->hash == hash && equal(s, key))
+      return s->id;
   }
   return 0;
 }
 
+static void makeKey(StackKey *key, const uptr *stack, uptr size, u8 *buf) {
+  key->stack = stack;
+  key->size = size;
+  key->encoded = 0;
+  key->encoded_size = 0;
+  if (common_flags()->compress_stack_depot && size <= kMaxEncodedFrames) {
+    key->encoded_size = StackTrace::EncodeStack(stack, size, buf);
+    if (key->encoded_size)
+      key->encoded = buf;
+  }
+}
+
+// Big enough for makeKey.
+static const uptr kKeyBufSize =
+    (kMaxEncodedFrames + 3) / 4 + kMaxEncodedFrames * 6 +
+    StackTrace::kEncodedStackSlack;
+
 static StackDesc *lock(atomic_uintptr_t *p) {
   // Uses the pointer lsb as mutex.
   for (int i = 0;; i++) {
@@ -141,64 +402,219 @@ static void unlock(atomic_uintptr_t *p, StackDesc *s) {
   atomic_store(p, (uptr)s, memory_order_release);
 }
 
-u32 StackDepotPut(const uptr *stack, uptr size) {
-  if (stack == 0 || size == 0)
-    return 0;
+// Returns the id of the stack, or 0 if it is not in the depot and insert is
+// false.
+static u32 put(const uptr *stack, uptr size, bool insert) {
+  u8 buf[kKeyBufSize];
+  StackKey key;
+  makeKey(&key, stack, size, buf);
   uptr h = hash(stack, size);
-  atomic_uintptr_t *p = &depot.tab[h % kTabSize];
+  // First, try to find the existing stack.
+  uptr n_tabs = NumTabs();
+  atomic_uintptr_t *tab = GetTab(n_tabs - 1);
+  atomic_uintptr_t *p = &tab[h % TabSize(n_tabs - 1)];
   uptr v = atomic_load(p, memory_order_consume);
   StackDesc *s = (StackDesc*)(v & ~1);
-  // First, try to find the existing stack.
-  u32 id = find(s, stack, size, h);
+  u32 id = find(s, key, h);
   if (id)
     return id;
-  // If failed, lock, retry and insert new.
+  for (uptr t = n_tabs - 1; t > 0; t--) {
+    atomic_uintptr_t *old_tab = GetTab(t - 1);
+    uptr old_v = atomic_load(&old_tab[h % TabSize(t - 1)],
+                             memory_order_consume);
+    id = find((StackDesc*)(old_v & ~1), key, h);
+    if (id)
+      return id;
+  }
+  if (!insert)
+    return 0;
+  // If failed, lock, retry and insert new. If another thread adds a new
+  // table meanwhile, the same stack may get two different ids, which is
+  // harmless.
   StackDesc *s2 = lock(p);
   if (s2 != s) {
-    id = find(s2, stack, size, h);
+    id = find(s2, key, h);
     if (id) {
       unlock(p, s2);
       return id;
     }
   }
-  uptr part = (h % kTabSize) / kPartSize;
+  uptr part = h >> (sizeof(u32) * 8 - kPartBits);
   id = atomic_fetch_add(&depot.seq[part], 1, memory_order_relaxed) + 1;
-  stats.n_uniq_ids++;
   CHECK_LT(id, kMaxId);
   id |= part << kPartShift;
   CHECK_NE(id, 0);
   CHECK_EQ(id & (1u << 31), 0);
-  s = allocDesc(size);
+  s = allocDesc(size, key.encoded_size);
   s->id = id;
   s->hash = h;
   s->size = size;
-  internal_memcpy(s->stack, stack, size * sizeof(uptr));
+  s->encoded_size = key.encoded_size;
+  if (key.encoded) {
+    internal_memcpy(s->encoded(), key.encoded, key.encoded_size);
+  } else {
+    internal_memcpy(s->stack(), stack, size * sizeof(uptr));
+  }
   s->link = s2;
+  atomic_store(idSlot(id, true), (uptr)s, memory_order_release);
   unlock(p, s);
+  maybeGrow(atomic_fetch_add(&depot.n_uniq_ids, 1, memory_order_relaxed) + 1);
   return id;
 }
 
-const uptr *StackDepotGet(u32 id, uptr *size) {
+static void warnOnce(atomic_uint8_t *warned, const char *what) {
+  if (atomic_load(warned, memory_order_relaxed) ||
+      atomic_exchange(warned, 1, memory_order_relaxed))
+    return;
+  Report("WARNING: the stack depot uses %zuM of stack_depot_max_mb=%d, %s\n",
+         atomic_load(&depot.mapped, memory_order_relaxed) >> 20,
+         common_flags()->stack_depot_max_mb, what);
+}
+
+u32 StackDepotPut(const uptr *stack, uptr size) {
+  if (stack == 0 || size == 0)
+    return 0;
+  CHECK_LT(size, 1ULL << 32);
+  uptr max_mapped = budget();
+  uptr mapped = atomic_load(&depot.mapped, memory_order_relaxed);
+  if (max_mapped == 0 || mapped < max_mapped / 2)
+    return put(stack, size, true);
+  // Past half of the budget the new stacks are truncated, so that the deep
+  // stacks which only differ below their top frames (e.g. by the recursion
+  // depth) share an entry. Past the budget no stacks are added, and the
+  // ones which are not in the depot yet get id 0, i.e. no stack. The
+  // stacks already in the depot keep their ids.
+  bool full = mapped >= max_mapped;
+  u32 id;
+  if (size > kTruncatedStackFrames) {
+    id = put(stack, size, false);
+    if (id)
+      return id;
+    id = put(stack, kTruncatedStackFrames, !full);
+    if (id)
+      atomic_fetch_add(&depot.n_truncated, 1, memory_order_relaxed);
+  } else {
+    id = put(stack, size, !full);
+  }
+  if (full) {
+    warnOnce(&depot.full_warned, "no more stacks are stored");
+    if (!id)
+      atomic_fetch_add(&depot.n_dropped, 1, memory_order_relaxed);
+  } else {
+    warnOnce(&depot.truncation_warned, "new stacks are truncated");
+  }
+  return id;
+}
+
+static StackDesc *getDesc(u32 id) {
   if (id == 0)
     return 0;
   CHECK_EQ(id & (1u << 31), 0);
-  // High kPartBits contain part id, so we need to scan at most kPartSize lists.
-  uptr part = id >> kPartShift;
-  for (int i = 0; i != kPartSize; i++) {
-    uptr idx = part * kPartSize + i;
-    CHECK_LT(idx, kTabSize);
-    atomic_uintptr_t *p = &depot.tab[idx];
-    uptr v = atomic_load(p, memory_order_consume);
-    StackDesc *s = (StackDesc*)(v & ~1);
-    for (; s; s = s->link) {
-      if (s->id == id) {
-        *size = s->size;
-        return s->stack;
-      }
-    }
-  }
+  atomic_uintptr_t *slot = idSlot(id, false);
+  if (slot == 0)
+    return 0;
+  StackDesc *s = (StackDesc*)atomic_load(slot, memory_order_consume);
+  if (s)
+    CHECK_EQ(s->id, id);
+  return s;
+}
+
+const uptr *StackDepotGet(u32 id, uptr *size) {
   *size = 0;
-  return 0;
+  StackDesc *s = getDesc(id);
+  if (s == 0)
+    return 0;
+  *size = s->size;
+  if (s->encoded_size == 0)
+    return s->stack();
+  // Encoded stacks are decoded on the first request into a plain copy,
+  // which replaces the encoded descriptor in the id map (but not in the hash
+  // chains), so that the result stays valid forever as for plain stacks.
+  // Only the stacks that get into reports are normally requested.
+  StackDesc *copy = (StackDesc*)alloc(sizeof(StackDesc) +
+                                      s->size * sizeof(uptr));
+  copy->link = 0;
+  copy->id = s->id;
+  copy->hash = s->hash;
+  copy->size = s->size;
+  copy->encoded_size = 0;
+  StackTrace::DecodeStack(s->encoded(), s->size, copy->stack());
+  // If another thread wins, our copy leaks, which is harmless.
+  uptr cmp = (uptr)s;
+  if (!atomic_compare_exchange_strong(idSlot(id, false), &cmp, (uptr)copy,
+                                      memory_order_acq_rel))
+    return ((StackDesc*)cmp)->stack();
+  return copy->stack();
+}
+
+// Number of frames from the top of the stack used for the cache key.
+const uptr kCacheKeyFrames = 4;
+// Per-thread cache counters are added to the stats this often.
+const u32 kCacheStatsPeriod = 1024;
+
+static u32 cacheKey(const uptr *stack, uptr size) {
+  const u32 m = 0x5bd1e995;
+  u32 h = size;
+  uptr n = Min(size, kCacheKeyFrames);
+  for (uptr i = 0; i < n; i++) {
+    h ^= (u32)stack[i];
+    h *= m;
+    h ^= h >> 15;
+  }
+  return h;
+}
+
+static void flushCacheStats(StackDepotCache *cache) {
+  atomic_fetch_add(&depot.n_cache_lookups, cache->n_lookups,
+                   memory_order_relaxed);
+  atomic_fetch_add(&depot.n_cache_hits, cache->n_hits, memory_order_relaxed);
+  cache->n_lookups = 0;
+  cache->n_hits = 0;
+}
+
+static bool cacheEntryMatches(u32 id, const uptr *stack, uptr size) {
+  // The key is not unique, compare with the stored stack. Encoded stacks
+  // are compared in the encoded form, to not create the plain copies.
+  StackDesc *s = getDesc(id);
+  u8 buf[kKeyBufSize];
+  StackKey stack_key;
+  makeKey(&stack_key, stack, size, buf);
+  return s != 0 && equal(s, stack_key);
+}
+
+u32 StackDepotPutCached(StackDepotCache *cache, const uptr *stack, uptr size) {
+  if (cache == 0 || stack == 0 || size == 0)
+    return StackDepotPut(stack, size);
+  const uptr kWays = StackDepotCache::kWays;
+  u32 key = cacheKey(stack, size);
+  uptr set = key % StackDepotCache::kSize;
+  u32 *keys = cache->keys[set];
+  u32 *ids = cache->ids[set];
+  uptr way = 0;
+  for (; way < kWays; way++) {
+    if (ids[way] != 0 && keys[way] == key &&
+        cacheEntryMatches(ids[way], stack, size))
+      break;
+  }
+  bool hit = way < kWays;
+  u32 id;
+  if (hit) {
+    id = ids[way];
+  } else {
+    id = StackDepotPut(stack, size);
+    way = kWays - 1;  // Evict the least recently used entry.
+  }
+  // Move the entry to the front of the set.
+  for (; way > 0; way--) {
+    keys[way] = keys[way - 1];
+    ids[way] = ids[way - 1];
+  }
+  keys[0] = key;
+  ids[0] = id;
+  cache->n_hits += hit;
+  if (++cache->n_lookups == kCacheStatsPeriod)
+    flushCacheStats(cache);
+  return id;
 }
 
 }  // namespace __sanitizer
@@ -19,16 +19,52 @@ namespace __sanitizer {
 
 // StackDepot efficiently stores huge amounts of stack traces.
 
-// Maps stack trace to an unique id.
+// Maps stack trace to an unique id. The stacks are never removed, so the
+// memory of the depot can be bounded with stack_depot_max_mb: past half of
+// it the new stacks are truncated to their top frames, past all of it they
+// are not stored and get id 0 (as an empty stack).
 u32 StackDepotPut(const uptr *stack, uptr size);
 // Retrieves a stored stack trace by the id.
 const uptr *StackDepotGet(u32 id, uptr *size);
 
+// Small 2-way set associative cache of recently stored stack traces, kept per
+// thread in front of StackDepotPut. Must be zero-initialized.
+struct StackDepotCache {
+  static const uptr kSize = 64;  // Number of sets.
+  static const uptr kWays = 2;
+  // Hashes of the stack size and top frames, the most recently used way goes
+  // first.
+  u32 keys[kSize][kWays];
+  u32 ids[kSize][kWays];
+  u32 n_lookups;  // Not yet accounted in StackDepotStats.
+  u32 n_hits;
+};
+
+// Same as StackDepotPut, but first checks the cache (may be 0).
+u32 StackDepotPutCached(StackDepotCache *cache, const uptr *stack, uptr size);
+
+const uptr kStackDepotChainHistSize = 16;
+
 struct StackDepotStats {
   uptr n_uniq_ids;
   uptr mapped;
+  uptr allocated;  // Bytes of stack descriptors, without decoded copies.
+  uptr n_tabs;  // Number of hash tables.
+  uptr n_buckets;  // Total number of buckets in all hash tables.
+  uptr max_chain_len;
+  // chain_len_hist[i] is the number of buckets with chain length i,
+  // the last element also counts all longer chains.
+  uptr chain_len_hist[kStackDepotChainHistSize];
+  // StackDepotPutCached calls and the number of cache hits among them.
+  // Per-thread caches report these periodically.
+  uptr n_cache_lookups;
+  uptr n_cache_hits;
+  // New stacks stored truncated or not stored because of stack_depot_max_mb.
+  uptr n_truncated;
+  uptr n_dropped;
 };
 
+// Computes the stats, which involves a walk over the whole depot.
 StackDepotStats *StackDepotGetStats();
 
 }  // namespace __sanitizer
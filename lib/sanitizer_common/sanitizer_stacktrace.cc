@@ -265,4 +265,83 @@ void StackTrace::UncompressStack(StackTrace *stack,
 #endif  // SANITIZER_WORDSIZE
 }
 
+// Group varint encoding of zigzag deltas between adjacent pcs. Each group
+// of 4 deltas is preceded by a tag byte with a 2-bit length code per delta,
+// so decoding is a table lookup and a masked unaligned load per pc.
+// 6 bytes are enough for any delta between user space addresses on x86_64.
+static const u8 kEncodedLen[4] = {2, 3, 4, 6};
+static const u64 kEncodedMask[4] = {
+  0xffffULL, 0xffffffULL, 0xffffffffULL, 0xffffffffffffULL
+};
+
+static INLINE u32 EncodedLenCode(u64 v) {
+  return (v >> 16 != 0) + (v >> 24 != 0) + (v >> 32 != 0);
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static INLINE void StoreLE64(u8 *p, u64 v) {
+  for (uptr i = 0; i < 8; i++)
+    p[i] = v >> (8 * i);
+}
+
+static INLINE u64 LoadLE64(const u8 *p) {
+  u64 v = 0;
+  for (uptr i = 0; i < 8; i++)
+    v |= (u64)p[i] << (8 * i);
+  return v;
+}
+#else
+static INLINE void StoreLE64(u8 *p, u64 v) {
+  *(uu64*)p = v;
+}
+
+static INLINE u64 LoadLE64(const u8 *p) {
+  return *(const uu64*)p;
+}
+#endif
+
+uptr StackTrace::MaxEncodedStackSize(uptr size) {
+  return (size + 3) / 4 + size * 6 + kEncodedStackSlack;
+}
+
+uptr StackTrace::EncodeStack(const uptr *trace, uptr size, u8 *out) {
+  u8 *p = out;
+  uptr prev = 0;
+  for (uptr i = 0; i < size; i += 4) {
+    u8 *tag = p++;
+    u32 t = 0;
+    uptr n = Min<uptr>(size - i, 4);
+    for (uptr j = 0; j < n; j++) {
+      uptr d = trace[i + j] - prev;
+      prev = trace[i + j];
+      u64 z = (u64)((d << 1) ^ (uptr)((sptr)d >> (SANITIZER_WORDSIZE - 1)));
+      if (z >> 48)
+        return 0;
+      u32 c = EncodedLenCode(z);
+      t |= c << (2 * j);
+      // Writes up to 8 bytes, the excess is overwritten by the next pc
+      // or falls into the slack.
+      StoreLE64(p, z);
+      p += kEncodedLen[c];
+    }
+    *tag = t;
+  }
+  return p - out;
+}
+
+void StackTrace::DecodeStack(const u8 *in, uptr size, uptr *trace) {
+  const u8 *p = in;
+  uptr prev = 0;
+  for (uptr i = 0; i < size; i += 4) {
+    u32 t = *p++;
+    uptr n = Min<uptr>(size - i, 4);
+    for (uptr j = 0; j < n; j++, t >>= 2) {
+      u64 z = LoadLE64(p) & kEncodedMask[t & 3];
+      p += kEncodedLen[t & 3];
+      prev += (uptr)((z >> 1) ^ (0 - (z & 1)));
+      trace[i + j] = prev;
+    }
+  }
+}
+
 }  // namespace __sanitizer
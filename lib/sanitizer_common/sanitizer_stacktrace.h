@@ -54,6 +54,16 @@ struct StackTrace {
 
   void FastUnwindStack(uptr pc, uptr bp, uptr stack_top, uptr stack_bottom);
   void SlowUnwindStack(uptr pc, uptr max_depth);
+  // Unwinds the stack of the caller with .eh_frame CFI, caching the frame
+  // layout of every pc. Returns false if some frame can't be unwound this
+  // way (or the platform is not supported).
+  bool CfiUnwindStack(uptr max_depth);
+  // Takes pc and its caller from the frame at bp, and the rest of the stack
+  // from the shadow call stack of the thread (see
+  // sanitizer_shadow_call_stack.h). Returns false if the shadow call stack
+  // is not available.
+  bool ShadowCallStackUnwind(uptr pc, uptr bp, uptr stack_top,
+                             uptr stack_bottom, uptr max_depth);
 
   void PopStackFrames(uptr count);
 
@@ -64,6 +74,16 @@ struct StackTrace {
                             u32 *compressed, uptr size);
   static void UncompressStack(StackTrace *stack,
                               u32 *compressed, uptr size);
+
+  // Denser variable-length encoding of pc deltas, 2-6 bytes per pc.
+  // EncodeStack writes at most MaxEncodedStackSize(size) bytes (including
+  // kEncodedStackSlack bytes past the returned length, which it may clobber)
+  // and returns the encoded length, or 0 if some pcs are too far apart.
+  // DecodeStack reads up to kEncodedStackSlack bytes past the encoded data.
+  static const uptr kEncodedStackSlack = 8;
+  static uptr MaxEncodedStackSize(uptr size);
+  static uptr EncodeStack(const uptr *trace, uptr size, u8 *out);
+  static void DecodeStack(const u8 *in, uptr size, uptr *trace);
 };
 
 
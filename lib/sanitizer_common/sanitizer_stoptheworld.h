@@ -63,6 +63,16 @@ typedef void (*StopTheWorldCallback)(
 // This function should NOT be called from multiple threads simultaneously.
 void StopTheWorld(StopTheWorldCallback callback, void *argument);
 
+typedef void (*TracerHelperCallback)(void *argument, uptr index);
+
+// Runs callback(argument, i) for every i in [0, n) concurrently, i = 0 on the
+// calling task and the rest on helper tasks that share the address space.
+// May only be called from a StopTheWorld callback. The same restrictions
+// apply to the callback (the tasks also share TLS and errno). If a helper
+// can't be started, its callback runs on the calling task after the others
+// complete. Returns when all callbacks have returned.
+void RunTracerHelpers(TracerHelperCallback callback, void *argument, uptr n);
+
 }  // namespace __sanitizer
 
 #endif  // SANITIZER_STOPTHEWORLD_H
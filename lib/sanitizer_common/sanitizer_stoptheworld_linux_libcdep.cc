@@ -31,6 +31,14 @@
 #endif
 #include <sys/wait.h> // for signal-related stuff
 
+#ifndef PTRACE_SEIZE
+# define PTRACE_SEIZE 0x4206
+# define PTRACE_INTERRUPT 0x4207
+#endif
+#ifndef PTRACE_EVENT_STOP
+# define PTRACE_EVENT_STOP 128
+#endif
+
 #include "sanitizer_common.h"
 #include "sanitizer_libc.h"
 #include "sanitizer_linux.h"
@@ -72,15 +80,69 @@
 // sigdelset()
 // sigprocmask()
 // clone()
+// clone() is also called by the tracer to start helper tasks
+// (RunTracerHelpers). It is a thin wrapper over the syscall, which only
+// touches errno on failure, and then only before the helper exists.
 
 COMPILER_CHECK(sizeof(SuspendedThreadID) == sizeof(pid_t));
 
 namespace __sanitizer {
+// A set of thread ids with constant time insertion, so that a pass over the
+// thread list does not take quadratic time when there are many threads.
+class ThreadIdSet {
+ public:
+  ThreadIdSet() : size_(0), capacity_(0), ids_(0) {}
+  ~ThreadIdSet() {
+    if (ids_)
+      UnmapOrDie(ids_, capacity_ * sizeof(ids_[0]));
+  }
+  // Returns false if the id is already in the set.
+  bool Insert(SuspendedThreadID id) {
+    CHECK_GT(id, 0);
+    if (2 * (size_ + 1) > capacity_)
+      Grow();
+    uptr i = Find(ids_, capacity_, id);
+    if (ids_[i] == id)
+      return false;
+    ids_[i] = id;
+    size_++;
+    return true;
+  }
+
+ private:
+  // Returns the slot which holds id, or the empty slot where it belongs.
+  static uptr Find(SuspendedThreadID *ids, uptr capacity,
+                   SuspendedThreadID id) {
+    uptr i = (u32)id * 2654435761U & (capacity - 1);
+    while (ids[i] != 0 && ids[i] != id)
+      i = (i + 1) & (capacity - 1);
+    return i;
+  }
+
+  void Grow() {
+    uptr new_capacity = capacity_ ? 2 * capacity_ : 1024;
+    // Mmap-ed memory is zeroed, 0 marks an empty slot.
+    SuspendedThreadID *new_ids = (SuspendedThreadID *)MmapOrDie(
+        new_capacity * sizeof(new_ids[0]), "ThreadIdSet");
+    for (uptr i = 0; i < capacity_; i++)
+      if (ids_[i])
+        new_ids[Find(new_ids, new_capacity, ids_[i])] = ids_[i];
+    if (ids_)
+      UnmapOrDie(ids_, capacity_ * sizeof(ids_[0]));
+    ids_ = new_ids;
+    capacity_ = new_capacity;
+  }
+
+  uptr size_;
+  uptr capacity_;
+  SuspendedThreadID *ids_;
+};
+
 // This class handles thread suspending/unsuspending in the tracer thread.
 class ThreadSuspender {
  public:
   explicit ThreadSuspender(pid_t pid)
-    : pid_(pid) {
+    : pid_(pid), use_seize_(true), pending_signals_(1) {
       CHECK_GE(pid, 0);
     }
   bool SuspendAllThreads();
@@ -90,50 +152,94 @@ class ThreadSuspender {
     return suspended_threads_list_;
   }
  private:
+  // A signal which stopped a seized thread and must be delivered on detach.
+  struct PendingSignal {
+    SuspendedThreadID thread_id;
+    int signum;
+  };
+
   SuspendedThreadsList suspended_threads_list_;
   pid_t pid_;
-  bool SuspendThread(SuspendedThreadID thread_id);
+  // Threads we tried to attach to.
+  ThreadIdSet seen_threads_;
+  // Whether PTRACE_SEIZE works, it is not available before Linux 3.4.
+  bool use_seize_;
+  InternalMmapVector<PendingSignal> pending_signals_;
+  bool AttachThread(SuspendedThreadID thread_id);
+  bool WaitForThread(SuspendedThreadID thread_id);
 };
 
-bool ThreadSuspender::SuspendThread(SuspendedThreadID thread_id) {
+bool ThreadSuspender::AttachThread(SuspendedThreadID thread_id) {
   // Are we already attached to this thread?
-  // Currently this check takes linear time, however the number of threads is
-  // usually small.
-  if (suspended_threads_list_.Contains(thread_id))
+  if (!seen_threads_.Insert(thread_id))
     return false;
   int pterrno;
+  // PTRACE_ATTACH stops the thread with SIGSTOP, which stops the whole thread
+  // group, and every following attach waits for the target to switch from
+  // the group stop to a ptrace stop. PTRACE_INTERRUPT stops just the thread
+  // and does not wait, so all the threads stop in parallel.
+  if (use_seize_) {
+    if (!internal_iserror(internal_ptrace(PTRACE_SEIZE, thread_id, NULL, NULL),
+                          &pterrno)) {
+      internal_ptrace(PTRACE_INTERRUPT, thread_id, NULL, NULL);
+      if (SanitizerVerbosity > 0)
+        Report("Attached to thread %d.\n", thread_id);
+      return true;
+    }
+    if (pterrno != EIO && pterrno != EINVAL) {
+      Report("Could not attach to thread %d (errno %d).\n", thread_id,
+             pterrno);
+      return false;
+    }
+    use_seize_ = false;
+  }
   if (internal_iserror(internal_ptrace(PTRACE_ATTACH, thread_id, NULL, NULL),
                        &pterrno)) {
     // Either the thread is dead, or something prevented us from attaching.
     // Log this event and move on.
     Report("Could not attach to thread %d (errno %d).\n", thread_id, pterrno);
     return false;
-  } else {
-    if (SanitizerVerbosity > 0)
-      Report("Attached to thread %d.\n", thread_id);
-    // The thread is not guaranteed to stop before ptrace returns, so we must
-    // wait on it.
-    uptr waitpid_status;
-    HANDLE_EINTR(waitpid_status, internal_waitpid(thread_id, NULL, __WALL));
-    int wperrno;
-    if (internal_iserror(waitpid_status, &wperrno)) {
-      // Got a ECHILD error. I don't think this situation is possible, but it
-      // doesn't hurt to report it.
-      Report("Waiting on thread %d failed, detaching (errno %d).\n", thread_id,
-             wperrno);
-      internal_ptrace(PTRACE_DETACH, thread_id, NULL, NULL);
-      return false;
-    }
-    suspended_threads_list_.Append(thread_id);
-    return true;
   }
+  if (SanitizerVerbosity > 0)
+    Report("Attached to thread %d.\n", thread_id);
+  return true;
+}
+
+bool ThreadSuspender::WaitForThread(SuspendedThreadID thread_id) {
+  // The thread is not guaranteed to stop before ptrace returns, so we must
+  // wait on it.
+  uptr waitpid_status;
+  int status = 0;
+  HANDLE_EINTR(waitpid_status, internal_waitpid(thread_id, &status, __WALL));
+  int wperrno;
+  if (internal_iserror(waitpid_status, &wperrno)) {
+    // Got a ECHILD error. I don't think this situation is possible, but it
+    // doesn't hurt to report it.
+    Report("Waiting on thread %d failed, detaching (errno %d).\n", thread_id,
+           wperrno);
+    internal_ptrace(PTRACE_DETACH, thread_id, NULL, NULL);
+    return false;
+  }
+  // A seized thread may stop for an incoming signal before the interrupt.
+  // That signal would be lost on detach, unless it is passed on.
+  if (use_seize_ && WIFSTOPPED(status) && (status >> 16) == 0) {
+    PendingSignal pending = {thread_id, WSTOPSIG(status)};
+    pending_signals_.push_back(pending);
+  }
+  suspended_threads_list_.Append(thread_id);
+  return true;
 }
 
 void ThreadSuspender::ResumeAllThreads() {
   for (uptr i = 0; i < suspended_threads_list_.thread_count(); i++) {
     pid_t tid = suspended_threads_list_.GetThreadID(i);
+    uptr signum = 0;
+    for (uptr j = 0; j < pending_signals_.size(); j++)
+      if (pending_signals_[j].thread_id == tid)
+        signum = pending_signals_[j].signum;
     int pterrno;
-    if (!internal_iserror(internal_ptrace(PTRACE_DETACH, tid, NULL, NULL),
+    if (!internal_iserror(internal_ptrace(PTRACE_DETACH, tid, NULL,
+                                          (void *)signum),
                           &pterrno)) {
       if (SanitizerVerbosity > 0)
         Report("Detached from thread %d.\n", tid);
@@ -154,16 +260,22 @@ void ThreadSuspender::KillAllThreads() {
 
 bool ThreadSuspender::SuspendAllThreads() {
   ThreadLister thread_lister(pid_);
+  InternalMmapVector<SuspendedThreadID> attached(1024);
   bool added_threads;
   do {
-    // Run through the directory entries once.
+    // Run through the directory entries once. Attach to all the new threads
+    // before waiting for any of them, so that they stop in parallel.
     added_threads = false;
+    attached.clear();
     pid_t tid = thread_lister.GetNextTID();
     while (tid >= 0) {
-      if (SuspendThread(tid))
-        added_threads = true;
+      if (AttachThread(tid))
+        attached.push_back(tid);
       tid = thread_lister.GetNextTID();
     }
+    for (uptr i = 0; i < attached.size(); i++)
+      if (WaitForThread(attached[i]))
+        added_threads = true;
     if (thread_lister.error()) {
       // Detach threads and fail.
       ResumeAllThreads();
@@ -254,6 +366,43 @@ static int TracerThread(void* argument) {
   return exit_code;
 }
 
+// Helper tasks (see RunTracerHelpers) forward fatal signals to the tracer,
+// which then wakes up the suspended threads. The helpers die with the tracer.
+static pid_t tracer_pid_for_helpers;
+
+static void HelperSignalHandler(int signum, siginfo_t *siginfo, void *) {
+  internal_kill(tracer_pid_for_helpers, signum);
+  internal__exit(2);
+}
+
+struct HelperArgument {
+  TracerHelperCallback callback;
+  void *callback_argument;
+  uptr index;
+};
+
+static int HelperThread(void *argument) {
+  HelperArgument *arg = (HelperArgument *)argument;
+  internal_prctl(PR_SET_PDEATHSIG, SIGKILL, 0, 0, 0);
+  InternalScopedBuffer<char> handler_stack_memory(kHandlerStackSize);
+  struct sigaltstack handler_stack;
+  internal_memset(&handler_stack, 0, sizeof(handler_stack));
+  handler_stack.ss_sp = handler_stack_memory.data();
+  handler_stack.ss_size = kHandlerStackSize;
+  internal_sigaltstack(&handler_stack, NULL);
+  for (uptr signal_index = 0; signal_index < ARRAY_SIZE(kUnblockedSignals);
+       signal_index++) {
+    struct sigaction new_sigaction;
+    internal_memset(&new_sigaction, 0, sizeof(new_sigaction));
+    new_sigaction.sa_sigaction = HelperSignalHandler;
+    new_sigaction.sa_flags = SA_ONSTACK | SA_SIGINFO;
+    sigfillset(&new_sigaction.sa_mask);
+    sigaction(kUnblockedSignals[signal_index], &new_sigaction, NULL);
+  }
+  arg->callback(arg->callback_argument, arg->index);
+  return 0;
+}
+
 class ScopedStackSpaceWithGuard {
  public:
   explicit ScopedStackSpaceWithGuard(uptr stack_size) {
@@ -361,6 +510,41 @@ void StopTheWorld(StopTheWorldCallback callback, void *argument) {
   sigprocmask(SIG_SETMASK, &old_sigset, &old_sigset);
 }
 
+void RunTracerHelpers(TracerHelperCallback callback, void *argument,
+                      uptr n) {
+  CHECK_GT(n, 0);
+  const uptr kHelperStackSize = 1024 * 1024;
+  tracer_pid_for_helpers = internal_getpid();
+  InternalScopedBuffer<HelperArgument> args(n);
+  InternalScopedBuffer<ScopedStackSpaceWithGuard *> stacks(n);
+  InternalScopedBuffer<pid_t> pids(n);
+  InternalScopedBuffer<char> stack_space(n * sizeof(ScopedStackSpaceWithGuard));
+  for (uptr i = 1; i < n; i++) {
+    args[i].callback = callback;
+    args[i].callback_argument = argument;
+    args[i].index = i;
+    stacks[i] = new(&stack_space[i * sizeof(ScopedStackSpaceWithGuard)])
+        ScopedStackSpaceWithGuard(kHelperStackSize);
+    // The helpers do not need signal handlers of the tracer, but clone()
+    // gives them a copy, which they replace.
+    pids[i] = clone(HelperThread, stacks[i]->Bottom(),
+                    CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_UNTRACED,
+                    &args[i]);
+  }
+  callback(argument, 0);
+  for (uptr i = 1; i < n; i++) {
+    if (pids[i] < 0) {
+      callback(argument, i);
+    } else {
+      uptr waitpid_status = internal_waitpid(pids[i], NULL, __WALL);
+      int wperrno;
+      if (internal_iserror(waitpid_status, &wperrno))
+        Report("Waiting on a tracer helper failed (errno %d).\n", wperrno);
+    }
+    stacks[i]->~ScopedStackSpaceWithGuard();
+  }
+}
+
 // Platform-specific methods from SuspendedThreadsList.
 #if SANITIZER_ANDROID && defined(__arm__)
 typedef pt_regs regs_struct;
@@ -65,16 +65,123 @@ bool TemplateMatch(char *templ, const char *str) {
   return true;
 }
 
+// Finds the longest literal part of the template. Any matching string contains
+// it.
+static void GetLongestLiteral(const char *templ, const char **begin,
+                              uptr *size) {
+  *begin = templ;
+  *size = 0;
+  if (templ[0] == '^')
+    templ++;
+  while (templ[0] && templ[0] != '$') {
+    const char *end = templ;
+    while (end[0] && end[0] != '*' && end[0] != '$')
+      end++;
+    if ((uptr)(end - templ) > *size) {
+      *begin = templ;
+      *size = end - templ;
+    }
+    templ = end[0] == '*' ? end + 1 : end;
+  }
+}
+
+// Grams have at most 24 bits.
+static const u32 kNoGram = ~0U;
+
+static u32 GramAt(const char *str) {
+  return (u32)(u8)str[0] | ((u32)(u8)str[1] << 8) | ((u32)(u8)str[2] << 16);
+}
+
+static uptr GramBucket(u32 gram, uptr n_buckets) {
+  return (gram * 2654435761U) & (n_buckets - 1);
+}
+
+void SuppressionContext::BuildIndex() {
+  uptr n = suppressions_.size();
+  uptr n_buckets = RoundUpToPowerOfTwo(Max<uptr>(2 * n, 16));
+  for (uptr i = 0; i < n_buckets; i++)
+    buckets_.push_back(0);
+  // Index each template by the least frequent gram of its longest literal, so
+  // that similar templates end up in different buckets. The gram counts are
+  // approximated by the counts of their buckets.
+  InternalScopedBuffer<u32> gram_counts(n_buckets);
+  internal_memset(gram_counts.data(), 0, n_buckets * sizeof(u32));
+  for (uptr i = 0; i < n; i++) {
+    const char *literal;
+    uptr size;
+    GetLongestLiteral(suppressions_[i].templ, &literal, &size);
+    for (uptr pos = 0; pos + kGramSize <= size; pos++)
+      gram_counts[GramBucket(GramAt(literal + pos), n_buckets)]++;
+  }
+  for (uptr i = 0; i < n; i++) {
+    const char *literal;
+    uptr size;
+    GetLongestLiteral(suppressions_[i].templ, &literal, &size);
+    IndexEntry entry = {kNoGram, 0, 0};
+    u32 min_count = 0;
+    for (uptr pos = 0; pos + kGramSize <= size; pos++) {
+      u32 gram = GramAt(literal + pos);
+      u32 count = gram_counts[GramBucket(gram, n_buckets)];
+      if (entry.gram == kNoGram || count < min_count) {
+        entry.gram = gram;
+        min_count = count;
+      }
+    }
+    index_entries_.push_back(entry);
+    if (entry.gram == kNoGram)
+      unindexed_.push_back(i);
+  }
+  // Go backwards, so that each bucket lists the suppressions in order.
+  for (uptr i = n; i-- > 0;) {
+    IndexEntry &entry = index_entries_[i];
+    if (entry.gram == kNoGram)
+      continue;
+    u32 &head = buckets_[GramBucket(entry.gram, n_buckets)];
+    entry.next = head;
+    head = i + 1;
+  }
+}
+
+bool SuppressionContext::TryMatch(uptr i, const char *str,
+                                  SuppressionType type) {
+  IndexEntry &entry = index_entries_[i];
+  if (entry.tested_epoch == epoch_)
+    return false;
+  entry.tested_epoch = epoch_;
+  return type == suppressions_[i].type &&
+         TemplateMatch(suppressions_[i].templ, str);
+}
+
 bool SuppressionContext::Match(const char *str, SuppressionType type,
                                Suppression **s) {
-  can_parse_ = false;
-  uptr i;
-  for (i = 0; i < suppressions_.size(); i++)
-    if (type == suppressions_[i].type &&
-        TemplateMatch(suppressions_[i].templ, str))
-      break;
-  if (i == suppressions_.size()) return false;
-  *s = &suppressions_[i];
+  if (can_parse_) {
+    can_parse_ = false;
+    BuildIndex();
+  }
+  if (str == 0 || str[0] == 0 || suppressions_.size() == 0)
+    return false;
+  if (++epoch_ == 0) {
+    for (uptr i = 0; i < index_entries_.size(); i++)
+      index_entries_[i].tested_epoch = 0;
+    epoch_ = 1;
+  }
+  // The first matching suppression wins.
+  uptr best = suppressions_.size();
+  for (uptr i = 0; i < unindexed_.size() && unindexed_[i] < best; i++) {
+    if (TryMatch(unindexed_[i], str, type))
+      best = unindexed_[i];
+  }
+  uptr len = internal_strlen(str);
+  for (uptr pos = 0; pos + kGramSize <= len; pos++) {
+    u32 gram = GramAt(str + pos);
+    u32 next = buckets_[GramBucket(gram, buckets_.size())];
+    for (; next && next - 1 < best; next = index_entries_[next - 1].next) {
+      if (index_entries_[next - 1].gram == gram && TryMatch(next - 1, str, type))
+        best = next - 1;
+    }
+  }
+  if (best == suppressions_.size()) return false;
+  *s = &suppressions_[best];
   return true;
 }
 
@@ -37,15 +37,35 @@ struct Suppression {
 
 class SuppressionContext {
  public:
-  SuppressionContext() : suppressions_(1), can_parse_(true) {}
+  SuppressionContext()
+      : suppressions_(1), can_parse_(true), index_entries_(1), buckets_(1),
+        unindexed_(1), epoch_(0) {}
   void Parse(const char *str);
   bool Match(const char* str, SuppressionType type, Suppression **s);
   uptr SuppressionCount();
   void GetMatched(InternalMmapVector<Suppression *> *matched);
 
  private:
+  // The templates which contain a literal of at least kGramSize characters
+  // are indexed by one of its grams (substrings of kGramSize characters).
+  // Match only tries the unindexed templates and those indexed by a gram of
+  // the string.
+  static const uptr kGramSize = 3;
+  struct IndexEntry {
+    u32 gram;
+    u32 next;  // The next suppression in the bucket, plus one.
+    u32 tested_epoch;  // Equal to epoch_ if already tried by this Match.
+  };
+  void BuildIndex();
+  bool TryMatch(uptr i, const char *str, SuppressionType type);
+
   InternalMmapVector<Suppression> suppressions_;
   bool can_parse_;
+  InternalMmapVector<IndexEntry> index_entries_;
+  // The buckets hold the first (with the lowest index) suppression, plus one.
+  InternalMmapVector<u32> buckets_;
+  InternalMmapVector<u32> unindexed_;
+  u32 epoch_;
 
   friend class SuppressionContextTest;
 };
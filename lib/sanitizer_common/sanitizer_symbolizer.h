@@ -68,10 +68,17 @@ struct DataInfo {
 // This function should NOT be called from two threads simultaneously.
 uptr SymbolizeCode(uptr address, AddressInfo *frames, uptr max_frames)
     SANITIZER_WEAK_ATTRIBUTE;
+// Asks the external symbolizer about a batch of code addresses at once,
+// so that subsequent SymbolizeCode calls for them don't wait for the
+// symbolizer process one by one.
+void SymbolizeCodePrefetch(const uptr *addresses, uptr n);
 bool SymbolizeData(uptr address, DataInfo *info);
 
 bool IsSymbolizerAvailable();
 void FlushSymbolizer();  // releases internal caches (if any)
+// Drops cached results before the next symbolization, e.g. because a module
+// was unloaded. May be called from any thread.
+void InvalidateSymbolizerCache();
 
 // Attempts to demangle the provided C++ mangled name.
 const char *Demangle(const char *name);
@@ -81,17 +88,23 @@ const char *DemangleCXXABI(const char *name);
 // Starts external symbolizer program in a subprocess. Sanitizer communicates
 // with external symbolizer via pipes.
 bool InitializeExternalSymbolizer(const char *path_to_symbolizer);
-
-const int kSymbolizerStartupTimeMillis = 10;
+// Same, but only starts the subprocess when something has to be symbolized
+// (or before entering a sandbox), so that processes which never report
+// anything do not pay for it.
+void InitializeExternalSymbolizerLazily(const char *path_to_symbolizer);
 
 class LoadedModule {
  public:
   LoadedModule(const char *module_name, uptr base_address);
+  void clear();
   void addAddressRange(uptr beg, uptr end);
   bool containsAddress(uptr address) const;
 
   const char *full_name() const { return full_name_; }
   uptr base_address() const { return base_address_; }
+  uptr n_ranges() const { return n_ranges_; }
+  uptr range_beg(uptr i) const { return ranges_[i].beg; }
+  uptr range_end(uptr i) const { return ranges_[i].end; }
 
  private:
   struct AddressRange {
@@ -118,6 +131,10 @@ typedef bool (*string_predicate_t)(const char *);
 uptr GetListOfModules(LoadedModule *modules, uptr max_modules,
                       string_predicate_t filter);
 
+// OS-dependent function that returns a number that changes whenever a module
+// is loaded or unloaded, or 0 if the OS gives no cheap way to tell.
+uptr GetListOfModulesGeneration();
+
 void SymbolizerPrepareForSandboxing();
 
 }  // namespace __sanitizer
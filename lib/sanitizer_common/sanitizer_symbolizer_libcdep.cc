@@ -12,7 +12,9 @@
 //===----------------------------------------------------------------------===//
 
 #include "sanitizer_allocator_internal.h"
+#include "sanitizer_atomic.h"
 #include "sanitizer_common.h"
+#include "sanitizer_mutex.h"
 #include "sanitizer_placement_new.h"
 #include "sanitizer_procmaps.h"
 #include "sanitizer_symbolizer.h"
@@ -32,6 +34,12 @@ LoadedModule::LoadedModule(const char *module_name, uptr base_address) {
   n_ranges_ = 0;
 }
 
+void LoadedModule::clear() {
+  InternalFree(full_name_);
+  full_name_ = 0;
+  n_ranges_ = 0;
+}
+
 void LoadedModule::addAddressRange(uptr beg, uptr end) {
   CHECK_LT(n_ranges_, kMaxNumberOfAddressRanges);
   ranges_[n_ranges_].beg = beg;
@@ -86,6 +94,8 @@ static const char *ExtractUptr(const char *str, const char *delims,
   return ret;
 }
 
+static LowLevelAllocator symbolizer_allocator;  // Linker initialized.
+
 // ExternalSymbolizer encapsulates communication between the tool and
 // external symbolizer program, running in a different subprocess,
 // For now we assume the following protocol:
@@ -104,6 +114,8 @@ class ExternalSymbolizer {
       : path_(path),
         input_fd_(input_fd),
         output_fd_(output_fd),
+        owner_pid_(internal_getpid()),
+        batch_buffer_(0),
         times_restarted_(0) {
     CHECK(path_);
     CHECK_NE(input_fd_, kInvalidFd);
@@ -112,47 +124,94 @@ class ExternalSymbolizer {
 
   char *SendCommand(bool is_data, const char *module_name, uptr module_offset) {
     CHECK(module_name);
+    if (!StartInForkChildIfNeeded())
+      return 0;
     internal_snprintf(buffer_, kBufferSize, "%s\"%s\" 0x%zx\n",
                       is_data ? "DATA " : "", module_name, module_offset);
     if (!writeToSymbolizer(buffer_, internal_strlen(buffer_)))
       return 0;
-    if (!readFromSymbolizer(buffer_, kBufferSize))
+    if (!readFromSymbolizer(buffer_, kBufferSize, 1))
       return 0;
     return buffer_;
   }
 
+  // Sends n commands with one write and reads all n replies, which are
+  // returned back to back, each terminated by an empty line.
+  // The commands must fit into the pipe buffer, so that the symbolizer
+  // never blocks on writing replies while we are still writing commands.
+  char *SendCommands(const char *commands, uptr length, uptr n) {
+    CHECK_LE(length, kMaxBatchCommandsSize);
+    if (!StartInForkChildIfNeeded())
+      return 0;
+    if (batch_buffer_ == 0)
+      batch_buffer_ = (char*)symbolizer_allocator.Allocate(kBatchBufferSize);
+    if (!writeToSymbolizer(commands, length))
+      return 0;
+    if (!readFromSymbolizer(batch_buffer_, kBatchBufferSize, n))
+      return 0;
+    return batch_buffer_;
+  }
+
   bool Restart() {
     if (times_restarted_ >= kMaxTimesRestarted) return false;
     times_restarted_++;
-    internal_close(input_fd_);
-    internal_close(output_fd_);
-    return StartSymbolizerSubprocess(path_, &input_fd_, &output_fd_);
+    return StartSubprocess();
   }
 
   void Flush() {
   }
 
  private:
-  bool readFromSymbolizer(char *buffer, uptr max_length) {
+  bool StartSubprocess() {
+    if (input_fd_ != kInvalidFd)
+      internal_close(input_fd_);
+    if (output_fd_ != kInvalidFd)
+      internal_close(output_fd_);
+    input_fd_ = output_fd_ = kInvalidFd;
+    owner_pid_ = internal_getpid();
+    return StartSymbolizerSubprocess(path_, &input_fd_, &output_fd_);
+  }
+
+  // A fork child inherits the pipes of its parent, and the replies to the
+  // commands of both processes would interleave. The child starts its own
+  // subprocess when it first needs one, and has its own restart budget.
+  bool StartInForkChildIfNeeded() {
+    if (LIKELY(owner_pid_ == internal_getpid()))
+      return true;
+    times_restarted_ = 0;
+    return StartSubprocess();
+  }
+
+  // Reads until n replies are received.
+  bool readFromSymbolizer(char *buffer, uptr max_length, uptr n) {
     if (max_length == 0)
       return true;
     uptr read_len = 0;
+    uptr replies = 0;
     while (true) {
+      // Keep space for the terminating zero.
+      if (read_len + 1 >= max_length) {
+        Report("WARNING: Symbolizer output is too long\n");
+        return false;
+      }
       uptr just_read = internal_read(input_fd_, buffer + read_len,
-                                     max_length - read_len);
+                                     max_length - read_len - 1);
       // We can't read 0 bytes, as we don't expect external symbolizer to close
       // its stdout.
       if (just_read == 0 || just_read == (uptr)-1) {
         Report("WARNING: Can't read from symbolizer at fd %d\n", input_fd_);
         return false;
       }
-      read_len += just_read;
       // Empty line marks the end of symbolizer output.
-      if (read_len >= 2 && buffer[read_len - 1] == '\n' &&
-                           buffer[read_len - 2] == '\n') {
-        break;
+      for (uptr i = Max(read_len, (uptr)1); i < read_len + just_read; i++) {
+        if (buffer[i] == '\n' && buffer[i - 1] == '\n')
+          replies++;
       }
+      read_len += just_read;
+      if (replies >= n)
+        break;
     }
+    buffer[read_len] = 0;
     return true;
   }
 
@@ -170,16 +229,22 @@ class ExternalSymbolizer {
   const char *path_;
   int input_fd_;
   int output_fd_;
+  uptr owner_pid_;  // The process which started the subprocess.
 
   static const uptr kBufferSize = 16 * 1024;
   char buffer_[kBufferSize];
 
+ public:
+  static const uptr kMaxBatchCommandsSize = 4096;
+
+ private:
+  static const uptr kBatchBufferSize = 256 * 1024;
+  char *batch_buffer_;  // Leaked.
+
   static const uptr kMaxTimesRestarted = 5;
   uptr times_restarted_;
 };
 
-static LowLevelAllocator symbolizer_allocator;  // Linker initialized.
-
 #if SANITIZER_SUPPORTS_WEAK_HOOKS
 extern "C" {
 SANITIZER_WEAK_ATTRIBUTE SANITIZER_INTERFACE_ATTRIBUTE
@@ -267,12 +332,17 @@ class Symbolizer {
   uptr SymbolizeCode(uptr addr, AddressInfo *frames, uptr max_frames) {
     if (max_frames == 0)
       return 0;
+    DropStaleCodeCache();
+    if (uptr n = LookupCodeCache(addr, frames, max_frames))
+      return n;
     LoadedModule *module = FindModuleForAddress(addr);
     if (module == 0)
       return 0;
     const char *module_name = module->full_name();
     uptr module_offset = addr - module->base_address();
-    const char *str = SendCommand(false, module_name, module_offset);
+    char *prefetched = TakePrefetchedReply(addr);
+    const char *str = prefetched ? prefetched
+                                 : SendCommand(false, module_name, module_offset);
     if (str == 0) {
       // External symbolizer was not initialized or failed. Fill only data
       // about module name and offset.
@@ -321,9 +391,75 @@ class Symbolizer {
       info->FillAddressAndModuleInfo(addr, module_name, module_offset);
       frame_id = 1;
     }
+    if (prefetched)
+      InternalFree(prefetched);
+    InsertCodeCache(addr, frames, frame_id, frame_id == max_frames);
     return frame_id;
   }
 
+  // Symbolizes a batch of code addresses with as few round trips to the
+  // external symbolizer as possible. The replies are kept until the
+  // corresponding SymbolizeCode calls, or until the next prefetch.
+  void PrefetchCode(const uptr *addresses, uptr n) {
+    ClearPrefetchedReplies();
+    DropStaleCodeCache();
+    if (!IsSymbolizerAvailable() || internal_symbolizer_ != 0 ||
+        external_symbolizer_ == 0)
+      return;
+    if (n > kMaxPrefetchedReplies)
+      n = kMaxPrefetchedReplies;
+    const uptr kMaxLength = ExternalSymbolizer::kMaxBatchCommandsSize;
+    char *commands = (char*)InternalAlloc(kMaxLength);
+    uptr i = 0;
+    while (i < n) {
+      uptr first = n_prefetched_;
+      uptr length = 0;
+      for (; i < n; i++) {
+        CodeCacheEntry *e = GetCodeCacheEntry(addresses[i]);
+        if (e->frames != 0 && e->addr == addresses[i] && !e->truncated)
+          continue;
+        LoadedModule *module = FindModuleForAddress(addresses[i]);
+        if (module == 0)
+          continue;
+        uptr left = kMaxLength - length;
+        uptr len = internal_snprintf(commands + length, left, "\"%s\" 0x%zx\n",
+                                     module->full_name(),
+                                     addresses[i] - module->base_address());
+        if (len >= left)
+          break;
+        length += len;
+        prefetched_[n_prefetched_].addr = addresses[i];
+        prefetched_[n_prefetched_].reply = 0;
+        n_prefetched_++;
+      }
+      uptr count = n_prefetched_ - first;
+      if (count == 0)
+        break;
+      char *reply = external_symbolizer_->SendCommands(commands, length, count);
+      if (reply == 0) {
+        // The addresses that were not prefetched are symbolized one by one.
+        n_prefetched_ = first;
+        if (!external_symbolizer_->Restart()) {
+          ReportExternalSymbolizerError(
+              "WARNING: Failed to use and restart external symbolizer!\n");
+          external_symbolizer_ = 0;
+        }
+        break;
+      }
+      for (uptr j = first; j < n_prefetched_; j++) {
+        const char *end = internal_strstr(reply, "\n\n");
+        CHECK(end);
+        uptr len = end - reply + 2;
+        char *copy = (char*)InternalAlloc(len + 1);
+        internal_memcpy(copy, reply, len);
+        copy[len] = 0;
+        prefetched_[j].reply = copy;
+        reply += len;
+      }
+    }
+    InternalFree(commands);
+  }
+
   bool SymbolizeData(uptr addr, DataInfo *info) {
     LoadedModule *module = FindModuleForAddress(addr);
     if (module == 0)
@@ -354,13 +490,36 @@ class Symbolizer {
     return true;
   }
 
+  void InitializeExternalSymbolizerLazily(const char *path_to_symbolizer) {
+    pending_external_symbolizer_path_ = path_to_symbolizer;
+  }
+
+  void StartPendingExternalSymbolizer() {
+    SpinMutexLock l(&pending_external_symbolizer_mu_);
+    const char *path = pending_external_symbolizer_path_;
+    if (path == 0)
+      return;
+    pending_external_symbolizer_path_ = 0;
+    // The internal symbolizer is preferred when it is there.
+    if (external_symbolizer_ == 0 && InternalSymbolizer::get() == 0)
+      InitializeExternalSymbolizer(path);
+  }
+
   bool IsSymbolizerAvailable() {
     if (internal_symbolizer_ == 0)
       internal_symbolizer_ = InternalSymbolizer::get();
+    if (internal_symbolizer_ == 0 && pending_external_symbolizer_path_)
+      StartPendingExternalSymbolizer();
     return internal_symbolizer_ || external_symbolizer_;
   }
 
+  // May be called from any thread, e.g. when a module is unloaded.
+  void InvalidateCache() {
+    atomic_store(&code_cache_stale_, 1, memory_order_release);
+  }
+
   void Flush() {
+    ClearCodeCache();
     if (internal_symbolizer_)
       internal_symbolizer_->Flush();
     if (external_symbolizer_)
@@ -406,27 +565,154 @@ class Symbolizer {
     }
   }
 
-  LoadedModule *FindModuleForAddress(uptr address) {
-    bool modules_were_reloaded = false;
-    if (modules_ == 0 || !modules_fresh_) {
+  // Direct-mapped cache of SymbolizeCode results, shared by all reports.
+  struct CodeCacheEntry {
+    uptr addr;
+    uptr n_frames;
+    bool truncated;  // There may be more inlined frames.
+    AddressInfo *frames;
+  };
+
+  static void CopyAddressInfo(AddressInfo *dst, const AddressInfo &src) {
+    *dst = src;
+    dst->module = src.module ? internal_strdup(src.module) : 0;
+    dst->function = src.function ? internal_strdup(src.function) : 0;
+    dst->file = src.file ? internal_strdup(src.file) : 0;
+  }
+
+  CodeCacheEntry *GetCodeCacheEntry(uptr addr) {
+    return &code_cache_[(addr ^ (addr >> 12)) % kCodeCacheSize];
+  }
+
+  uptr LookupCodeCache(uptr addr, AddressInfo *frames, uptr max_frames) {
+    CodeCacheEntry *e = GetCodeCacheEntry(addr);
+    if (e->frames == 0 || e->addr != addr)
+      return 0;
+    // The cached result may miss inlined frames the caller is asking for.
+    if (e->truncated && max_frames > e->n_frames)
+      return 0;
+    uptr n = Min(max_frames, e->n_frames);
+    for (uptr i = 0; i < n; i++)
+      CopyAddressInfo(&frames[i], e->frames[i]);
+    return n;
+  }
+
+  void InsertCodeCache(uptr addr, const AddressInfo *frames, uptr n,
+                       bool truncated) {
+    CodeCacheEntry *e = GetCodeCacheEntry(addr);
+    ClearCodeCacheEntry(e);
+    e->frames = (AddressInfo*)InternalAlloc(n * sizeof(AddressInfo));
+    for (uptr i = 0; i < n; i++)
+      CopyAddressInfo(&e->frames[i], frames[i]);
+    e->addr = addr;
+    e->n_frames = n;
+    e->truncated = truncated;
+  }
+
+  void ClearCodeCacheEntry(CodeCacheEntry *e) {
+    if (e->frames == 0)
+      return;
+    for (uptr i = 0; i < e->n_frames; i++)
+      e->frames[i].Clear();
+    InternalFree(e->frames);
+    e->frames = 0;
+  }
+
+  void DropStaleCodeCache() {
+    if (atomic_exchange(&code_cache_stale_, 0, memory_order_acquire)) {
+      ClearCodeCache();
+      modules_fresh_ = false;
+    }
+  }
+
+  void ClearCodeCache() {
+    for (uptr i = 0; i < kCodeCacheSize; i++)
+      ClearCodeCacheEntry(&code_cache_[i]);
+  }
+
+  char *TakePrefetchedReply(uptr addr) {
+    for (uptr i = 0; i < n_prefetched_; i++) {
+      if (prefetched_[i].addr == addr && prefetched_[i].reply != 0) {
+        char *reply = prefetched_[i].reply;
+        prefetched_[i].reply = 0;
+        return reply;
+      }
+    }
+    return 0;
+  }
+
+  void ClearPrefetchedReplies() {
+    for (uptr i = 0; i < n_prefetched_; i++) {
+      if (prefetched_[i].reply)
+        InternalFree(prefetched_[i].reply);
+    }
+    n_prefetched_ = 0;
+  }
+
+  void ReloadModules() {
+    if (modules_ == 0) {
       modules_ = (LoadedModule*)(symbolizer_allocator.Allocate(
           kMaxNumberOfModuleContexts * sizeof(LoadedModule)));
       CHECK(modules_);
-      n_modules_ = GetListOfModules(modules_, kMaxNumberOfModuleContexts,
-                                    /* filter */ 0);
-      // FIXME: Return this check when GetListOfModules is implemented on Mac.
-      // CHECK_GT(n_modules_, 0);
-      CHECK_LT(n_modules_, kMaxNumberOfModuleContexts);
-      modules_fresh_ = true;
-      modules_were_reloaded = true;
     }
+    for (uptr i = 0; i < n_modules_; i++)
+      modules_[i].clear();
+    modules_generation_ = GetListOfModulesGeneration();
+    n_modules_ = GetListOfModules(modules_, kMaxNumberOfModuleContexts,
+                                  /* filter */ 0);
+    // FIXME: Return this check when GetListOfModules is implemented on Mac.
+    // CHECK_GT(n_modules_, 0);
+    CHECK_LT(n_modules_, kMaxNumberOfModuleContexts);
+    // Build the sorted index of address ranges of all modules.
+    if (segments_)
+      UnmapOrDie(segments_, segments_capacity_ * sizeof(Segment));
+    uptr n = 0;
+    for (uptr i = 0; i < n_modules_; i++)
+      n += modules_[i].n_ranges();
+    segments_capacity_ = Max(n, (uptr)1);
+    segments_ = (Segment*)MmapOrDie(segments_capacity_ * sizeof(Segment),
+                                    "SymbolizerSegments");
+    n_segments_ = 0;
     for (uptr i = 0; i < n_modules_; i++) {
-      if (modules_[i].containsAddress(address)) {
-        return &modules_[i];
+      for (uptr j = 0; j < modules_[i].n_ranges(); j++) {
+        Segment *s = &segments_[n_segments_++];
+        s->beg = modules_[i].range_beg(j);
+        s->end = modules_[i].range_end(j);
+        s->module = &modules_[i];
       }
     }
-    // Reload the modules and look up again, if we haven't tried it yet.
-    if (!modules_were_reloaded) {
+    InternalSort(&segments_, n_segments_, CompareSegments);
+    modules_fresh_ = true;
+  }
+
+  LoadedModule *LookupModule(uptr address) {
+    // Find the last segment that starts at or before address.
+    uptr lo = 0;
+    uptr hi = n_segments_;
+    while (lo < hi) {
+      uptr mid = lo + (hi - lo) / 2;
+      if (segments_[mid].beg <= address)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (lo == 0 || address >= segments_[lo - 1].end)
+      return 0;
+    return segments_[lo - 1].module;
+  }
+
+  LoadedModule *FindModuleForAddress(uptr address) {
+    bool modules_were_reloaded = false;
+    if (modules_ == 0 || !modules_fresh_ ||
+        modules_generation_ != GetListOfModulesGeneration()) {
+      ReloadModules();
+      modules_were_reloaded = true;
+    }
+    if (LoadedModule *module = LookupModule(address))
+      return module;
+    // If the OS can't tell us whether the list of modules has changed,
+    // reload the modules and look up again, if we haven't tried it yet.
+    if (!modules_were_reloaded && modules_generation_ == 0) {
       // FIXME: set modules_fresh_ from dlopen()/dlclose() interceptors.
       // It's too aggressive to reload the list of modules each time we fail
       // to find a module for a given address.
@@ -450,11 +736,39 @@ class Symbolizer {
   static const uptr kMaxNumberOfModuleContexts = 1 << 14;
   LoadedModule *modules_;  // Array of module descriptions is leaked.
   uptr n_modules_;
+  // Address ranges of all modules, sorted by beg.
+  struct Segment {
+    uptr beg;
+    uptr end;
+    LoadedModule *module;
+  };
+  static bool CompareSegments(const Segment &a, const Segment &b) {
+    return a.beg < b.beg;
+  }
+  Segment *segments_;
+  uptr n_segments_;
+  uptr segments_capacity_;
+  uptr modules_generation_;
   // If stale, need to reload the modules before looking up addresses.
   bool modules_fresh_;
 
   ExternalSymbolizer *external_symbolizer_;  // Leaked.
+  // Set by InitializeExternalSymbolizerLazily until the subprocess starts.
+  const char *pending_external_symbolizer_path_;
+  StaticSpinMutex pending_external_symbolizer_mu_;
   InternalSymbolizer *internal_symbolizer_;  // Leaked.
+
+  static const uptr kCodeCacheSize = 4096;
+  CodeCacheEntry code_cache_[kCodeCacheSize];
+  atomic_uint8_t code_cache_stale_;
+
+  struct PrefetchedReply {
+    uptr addr;
+    char *reply;
+  };
+  static const uptr kMaxPrefetchedReplies = 256;
+  PrefetchedReply prefetched_[kMaxPrefetchedReplies];
+  uptr n_prefetched_;
 };
 
 static Symbolizer symbolizer;  // Linker initialized.
@@ -463,6 +777,10 @@ uptr SymbolizeCode(uptr address, AddressInfo *frames, uptr max_frames) {
   return symbolizer.SymbolizeCode(address, frames, max_frames);
 }
 
+void SymbolizeCodePrefetch(const uptr *addresses, uptr n) {
+  symbolizer.PrefetchCode(addresses, n);
+}
+
 bool SymbolizeData(uptr address, DataInfo *info) {
   return symbolizer.SymbolizeData(address, info);
 }
@@ -471,6 +789,16 @@ bool InitializeExternalSymbolizer(const char *path_to_symbolizer) {
   return symbolizer.InitializeExternalSymbolizer(path_to_symbolizer);
 }
 
+static void StartPendingExternalSymbolizer() {
+  symbolizer.StartPendingExternalSymbolizer();
+}
+
+void InitializeExternalSymbolizerLazily(const char *path_to_symbolizer) {
+  symbolizer.InitializeExternalSymbolizerLazily(path_to_symbolizer);
+  // fork() and exec() are usually not allowed in a sandbox.
+  SetSandboxingCallback(StartPendingExternalSymbolizer);
+}
+
 bool IsSymbolizerAvailable() {
   return symbolizer.IsSymbolizerAvailable();
 }
@@ -479,6 +807,10 @@ void FlushSymbolizer() {
   symbolizer.Flush();
 }
 
+void InvalidateSymbolizerCache() {
+  symbolizer.InvalidateCache();
+}
+
 const char *Demangle(const char *name) {
   return symbolizer.Demangle(name);
 }
@@ -27,6 +27,7 @@
 #include <elf.h>
 #include <errno.h>
 #include <poll.h>
+#include <stddef.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -43,6 +44,10 @@ uptr GetListOfModules(LoadedModule *modules, uptr max_modules,
                       string_predicate_t filter) {
   return 0;
 }
+
+uptr GetListOfModulesGeneration() {
+  return 0;
+}
 #else  // SANITIZER_ANDROID
 typedef ElfW(Phdr) Elf_Phdr;
 
@@ -93,6 +98,21 @@ uptr GetListOfModules(LoadedModule *modules, uptr max_modules,
   dl_iterate_phdr(dl_iterate_phdr_cb, &data);
   return data.current_n;
 }
+
+static int generation_cb(dl_phdr_info *info, size_t size, void *arg) {
+  // Older loaders don't report the counters.
+  if (size < offsetof(dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs))
+    return 1;
+  // Both counters only grow. Never 0, which would mean "unknown".
+  *(uptr*)arg = 1 + info->dlpi_adds + info->dlpi_subs;
+  return 1;  // The counters are the same for all modules.
+}
+
+uptr GetListOfModulesGeneration() {
+  uptr generation = 0;
+  dl_iterate_phdr(generation_cb, &generation);
+  return generation;
+}
 #endif  // SANITIZER_ANDROID
 
 }  // namespace __sanitizer
@@ -53,6 +53,10 @@ uptr GetListOfModules(LoadedModule *modules, uptr max_modules,
   return n_modules;
 }
 
+uptr GetListOfModulesGeneration() {
+  return 0;
+}
+
 void SymbolizerPrepareForSandboxing() {
   // Do nothing on Mac.
 }
@@ -19,6 +19,7 @@
 #include "sanitizer_symbolizer.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -41,48 +42,60 @@ bool StartSymbolizerSubprocess(const char *path_to_symbolizer,
     return false;
   }
 
-  int *infd = NULL;
-  int *outfd = NULL;
   // The client program may close its stdin and/or stdout and/or stderr
-  // thus allowing socketpair to reuse file descriptors 0, 1 or 2.
+  // thus allowing pipe() to reuse file descriptors 0, 1 or 2.
   // In this case the communication between the forked processes may be
   // broken if either the parent or the child tries to close or duplicate
-  // these descriptors. The loop below produces two pairs of file
-  // descriptors, each greater than 2 (stderr).
-  int sock_pair[5][2];
-  for (int i = 0; i < 5; i++) {
-    if (pipe(sock_pair[i]) == -1) {
-      for (int j = 0; j < i; j++) {
-        internal_close(sock_pair[j][0]);
-        internal_close(sock_pair[j][1]);
-      }
+  // these descriptors. The loop below produces three pairs of file
+  // descriptors, each greater than 2 (stderr). At most two pipes can get
+  // descriptors below 3.
+  const int kNumPipes = 3;
+  int pipes[kNumPipes][2];
+  int num_pipes = 0;
+  int low_pipes[kNumPipes][2];
+  int num_low_pipes = 0;
+  while (num_pipes < kNumPipes) {
+    int *fds = pipes[num_pipes];
+    if (pipe(fds) == -1) {
       Report("WARNING: Can't create a socket pair to start "
              "external symbolizer (errno: %d)\n", errno);
-      return false;
-    } else if (sock_pair[i][0] > 2 && sock_pair[i][1] > 2) {
-      if (infd == NULL) {
-        infd = sock_pair[i];
-      } else {
-        outfd = sock_pair[i];
-        for (int j = 0; j < i; j++) {
-          if (sock_pair[j] == infd) continue;
-          internal_close(sock_pair[j][0]);
-          internal_close(sock_pair[j][1]);
-        }
-        break;
-      }
+      break;
     }
+    if (fds[0] > 2 && fds[1] > 2) {
+      num_pipes++;
+    } else {
+      CHECK_LT(num_low_pipes, kNumPipes);
+      low_pipes[num_low_pipes][0] = fds[0];
+      low_pipes[num_low_pipes][1] = fds[1];
+      num_low_pipes++;
+    }
+  }
+  for (int i = 0; i < num_low_pipes; i++) {
+    internal_close(low_pipes[i][0]);
+    internal_close(low_pipes[i][1]);
+  }
+  if (num_pipes < kNumPipes) {
+    for (int i = 0; i < num_pipes; i++) {
+      internal_close(pipes[i][0]);
+      internal_close(pipes[i][1]);
+    }
+    return false;
   }
-  CHECK(infd);
-  CHECK(outfd);
+  int *infd = pipes[0];
+  int *outfd = pipes[1];
+  // The child reports a failed exec through this pipe. The write end is
+  // closed on a successful exec, so the parent reads EOF exactly when the
+  // symbolizer binary is running, instead of sleeping for a fixed time.
+  int *statusfd = pipes[2];
+  fcntl(statusfd[1], F_SETFD, FD_CLOEXEC);
 
   int pid = fork();
   if (pid == -1) {
     // Fork() failed.
-    internal_close(infd[0]);
-    internal_close(infd[1]);
-    internal_close(outfd[0]);
-    internal_close(outfd[1]);
+    for (int i = 0; i < kNumPipes; i++) {
+      internal_close(pipes[i][0]);
+      internal_close(pipes[i][1]);
+    }
     Report("WARNING: failed to fork external symbolizer "
            " (errno: %d)\n", errno);
     return false;
@@ -96,28 +109,37 @@ bool StartSymbolizerSubprocess(const char *path_to_symbolizer,
     internal_close(outfd[1]);
     internal_close(infd[0]);
     internal_close(infd[1]);
-    for (int fd = getdtablesize(); fd > 2; fd--)
-      internal_close(fd);
+    internal_close(statusfd[0]);
+    for (int fd = getdtablesize(); fd > 2; fd--) {
+      if (fd != statusfd[1])
+        internal_close(fd);
+    }
     execl(path_to_symbolizer, path_to_symbolizer, kSymbolizerArch, (char*)0);
+    int exec_errno = errno;
+    internal_write(statusfd[1], &exec_errno, sizeof(exec_errno));
     internal__exit(1);
   }
 
   // Continue execution in parent process.
   internal_close(outfd[0]);
   internal_close(infd[1]);
-  *input_fd = infd[0];
-  *output_fd = outfd[1];
+  internal_close(statusfd[1]);
 
-  // Check that symbolizer subprocess started successfully.
-  int pid_status;
-  SleepForMillis(kSymbolizerStartupTimeMillis);
-  int exited_pid = waitpid(pid, &pid_status, WNOHANG);
-  if (exited_pid != 0) {
-    // Either waitpid failed, or child has already exited.
-    Report("WARNING: external symbolizer didn't start up correctly!\n");
+  // Wait for the exec in the child. Requests sent before the symbolizer
+  // has finished its own startup just wait in the pipe.
+  int exec_errno = 0;
+  uptr read_len = internal_read(statusfd[0], &exec_errno, sizeof(exec_errno));
+  internal_close(statusfd[0]);
+  if (read_len != 0) {
+    Report("WARNING: external symbolizer didn't start up correctly "
+           "(errno: %d)!\n", exec_errno);
+    internal_close(infd[0]);
+    internal_close(outfd[1]);
+    waitpid(pid, 0, 0);
     return false;
   }
-
+  *input_fd = infd[0];
+  *output_fd = outfd[1];
   return true;
 }
 
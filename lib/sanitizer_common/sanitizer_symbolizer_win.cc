@@ -31,6 +31,10 @@ uptr GetListOfModules(LoadedModule *modules, uptr max_modules,
   UNIMPLEMENTED();
 };
 
+uptr GetListOfModulesGeneration() {
+  return 0;
+}
+
 void SymbolizerPrepareForSandboxing() {
   // Do nothing on Windows.
 }
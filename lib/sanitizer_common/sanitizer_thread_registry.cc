@@ -18,7 +18,8 @@ namespace __sanitizer {
 
 ThreadContextBase::ThreadContextBase(u32 tid)
     : tid(tid), unique_id(0), os_id(0), user_id(0), status(ThreadStatusInvalid),
-      detached(false), reuse_count(0), parent_tid(0), next(0) {
+      detached(false), reuse_count(0), parent_tid(0), next(0),
+      next_with_os_id_hash(0) {
   name[0] = '\0';
 }
 
@@ -93,28 +94,32 @@ ThreadRegistry::ThreadRegistry(ThreadContextFactory factory, u32 max_threads,
       max_threads_(max_threads),
       thread_quarantine_size_(thread_quarantine_size),
       mtx_(),
-      n_contexts_(0),
-      total_threads_(0),
-      alive_threads_(0),
-      max_alive_threads_(0),
-      running_threads_(0) {
+      total_threads_(0) {
+  atomic_store(&n_contexts_, 0, memory_order_relaxed);
+  atomic_store(&alive_threads_, 0, memory_order_relaxed);
+  atomic_store(&max_alive_threads_, 0, memory_order_relaxed);
+  atomic_store(&running_threads_, 0, memory_order_relaxed);
   threads_ = (ThreadContextBase **)MmapOrDie(max_threads_ * sizeof(threads_[0]),
                                              "ThreadRegistry");
+  // Chains of about 4 threads when every context is in use.
+  os_id_hash_size_ = 1;
+  while (os_id_hash_size_ * 4 < max_threads_)
+    os_id_hash_size_ <<= 1;
+  os_id_hash_ = (ThreadContextBase **)MmapOrDie(
+      os_id_hash_size_ * sizeof(os_id_hash_[0]), "ThreadRegistry");
   dead_threads_.clear();
   invalid_threads_.clear();
 }
 
 void ThreadRegistry::GetNumberOfThreads(uptr *total, uptr *running,
                                         uptr *alive) {
-  BlockingMutexLock l(&mtx_);
-  if (total) *total = n_contexts_;
-  if (running) *running = running_threads_;
-  if (alive) *alive = alive_threads_;
+  if (total) *total = atomic_load(&n_contexts_, memory_order_relaxed);
+  if (running) *running = atomic_load(&running_threads_, memory_order_relaxed);
+  if (alive) *alive = atomic_load(&alive_threads_, memory_order_relaxed);
 }
 
 uptr ThreadRegistry::GetMaxAliveThreads() {
-  BlockingMutexLock l(&mtx_);
-  return max_alive_threads_;
+  return atomic_load(&max_alive_threads_, memory_order_relaxed);
 }
 
 u32 ThreadRegistry::CreateThread(uptr user_id, bool detached, u32 parent_tid,
@@ -122,13 +127,18 @@ u32 ThreadRegistry::CreateThread(uptr user_id, bool detached, u32 parent_tid,
   BlockingMutexLock l(&mtx_);
   u32 tid = kUnknownTid;
   ThreadContextBase *tctx = QuarantinePop();
+  u32 n_contexts = atomic_load(&n_contexts_, memory_order_relaxed);
   if (tctx) {
     tid = tctx->tid;
-  } else if (n_contexts_ < max_threads_) {
+  } else if (n_contexts < max_threads_) {
     // Allocate new thread context and tid.
-    tid = n_contexts_++;
+    tid = n_contexts;
     tctx = context_factory_(tid);
-    threads_[tid] = tctx;
+    atomic_store(reinterpret_cast<atomic_uintptr_t *>(&threads_[tid]),
+                 reinterpret_cast<uptr>(tctx), memory_order_release);
+    atomic_store(&n_contexts_, n_contexts + 1, memory_order_release);
+  } else if ((tctx = QuarantineEvict()) != 0) {
+    tid = tctx->tid;
   } else {
     Report("%s: Thread limit (%u threads) exceeded. Dying.\n",
            SanitizerToolName, max_threads_);
@@ -138,11 +148,10 @@ u32 ThreadRegistry::CreateThread(uptr user_id, bool detached, u32 parent_tid,
   CHECK_NE(tid, kUnknownTid);
   CHECK_LT(tid, max_threads_);
   CHECK_EQ(tctx->status, ThreadStatusInvalid);
-  alive_threads_++;
-  if (max_alive_threads_ < alive_threads_) {
-    max_alive_threads_++;
-    CHECK_EQ(alive_threads_, max_alive_threads_);
-  }
+  uptr alive = atomic_load(&alive_threads_, memory_order_relaxed) + 1;
+  atomic_store(&alive_threads_, alive, memory_order_relaxed);
+  if (atomic_load(&max_alive_threads_, memory_order_relaxed) < alive)
+    atomic_store(&max_alive_threads_, alive, memory_order_relaxed);
   tctx->SetCreated(user_id, total_threads_++, detached,
                    parent_tid, arg);
   return tid;
@@ -151,7 +160,8 @@ u32 ThreadRegistry::CreateThread(uptr user_id, bool detached, u32 parent_tid,
 void ThreadRegistry::RunCallbackForEachThreadLocked(ThreadCallback cb,
                                                     void *arg) {
   CheckLocked();
-  for (u32 tid = 0; tid < n_contexts_; tid++) {
+  u32 n_contexts = atomic_load(&n_contexts_, memory_order_relaxed);
+  for (u32 tid = 0; tid < n_contexts; tid++) {
     ThreadContextBase *tctx = threads_[tid];
     if (tctx == 0)
       continue;
@@ -161,7 +171,8 @@ void ThreadRegistry::RunCallbackForEachThreadLocked(ThreadCallback cb,
 
 u32 ThreadRegistry::FindThread(FindThreadCallback cb, void *arg) {
   BlockingMutexLock l(&mtx_);
-  for (u32 tid = 0; tid < n_contexts_; tid++) {
+  u32 n_contexts = atomic_load(&n_contexts_, memory_order_relaxed);
+  for (u32 tid = 0; tid < n_contexts; tid++) {
     ThreadContextBase *tctx = threads_[tid];
     if (tctx != 0 && cb(tctx, arg))
       return tctx->tid;
@@ -172,7 +183,8 @@ u32 ThreadRegistry::FindThread(FindThreadCallback cb, void *arg) {
 ThreadContextBase *
 ThreadRegistry::FindThreadContextLocked(FindThreadCallback cb, void *arg) {
   CheckLocked();
-  for (u32 tid = 0; tid < n_contexts_; tid++) {
+  u32 n_contexts = atomic_load(&n_contexts_, memory_order_relaxed);
+  for (u32 tid = 0; tid < n_contexts; tid++) {
     ThreadContextBase *tctx = threads_[tid];
     if (tctx != 0 && cb(tctx, arg))
       return tctx;
@@ -180,29 +192,42 @@ ThreadRegistry::FindThreadContextLocked(FindThreadCallback cb, void *arg) {
   return 0;
 }
 
-static bool FindThreadContextByOsIdCallback(ThreadContextBase *tctx,
-                                            void *arg) {
-  return (tctx->os_id == (uptr)arg && tctx->status != ThreadStatusInvalid &&
-      tctx->status != ThreadStatusDead);
-}
-
 ThreadContextBase *ThreadRegistry::FindThreadContextByOsIDLocked(uptr os_id) {
-  return FindThreadContextLocked(FindThreadContextByOsIdCallback,
-                                 (void *)os_id);
+  CheckLocked();
+  for (ThreadContextBase *tctx = os_id_hash_[OsIdHash(os_id)]; tctx;
+       tctx = tctx->next_with_os_id_hash) {
+    if (tctx->os_id == os_id)
+      return tctx;
+  }
+  return 0;
 }
 
 void ThreadRegistry::SetThreadName(u32 tid, const char *name) {
   BlockingMutexLock l(&mtx_);
-  CHECK_LT(tid, n_contexts_);
+  CHECK_LT(tid, atomic_load(&n_contexts_, memory_order_relaxed));
   ThreadContextBase *tctx = threads_[tid];
   CHECK_NE(tctx, 0);
   CHECK_EQ(ThreadStatusRunning, tctx->status);
   tctx->SetName(name);
 }
 
+void ThreadRegistry::SetThreadOsId(u32 tid, uptr os_id) {
+  BlockingMutexLock l(&mtx_);
+  CHECK_LT(tid, atomic_load(&n_contexts_, memory_order_relaxed));
+  ThreadContextBase *tctx = threads_[tid];
+  CHECK_NE(tctx, 0);
+  bool indexed = tctx->status == ThreadStatusRunning ||
+                 tctx->status == ThreadStatusFinished;
+  if (indexed)
+    OsIdHashRemove(tctx);
+  tctx->os_id = os_id;
+  if (indexed)
+    OsIdHashInsert(tctx);
+}
+
 void ThreadRegistry::DetachThread(u32 tid) {
   BlockingMutexLock l(&mtx_);
-  CHECK_LT(tid, n_contexts_);
+  CHECK_LT(tid, atomic_load(&n_contexts_, memory_order_relaxed));
   ThreadContextBase *tctx = threads_[tid];
   CHECK_NE(tctx, 0);
   if (tctx->status == ThreadStatusInvalid) {
@@ -210,6 +235,7 @@ void ThreadRegistry::DetachThread(u32 tid) {
     return;
   }
   if (tctx->status == ThreadStatusFinished) {
+    OsIdHashRemove(tctx);
     tctx->SetDead();
     QuarantinePush(tctx);
   } else {
@@ -219,7 +245,7 @@ void ThreadRegistry::DetachThread(u32 tid) {
 
 void ThreadRegistry::JoinThread(u32 tid, void *arg) {
   BlockingMutexLock l(&mtx_);
-  CHECK_LT(tid, n_contexts_);
+  CHECK_LT(tid, atomic_load(&n_contexts_, memory_order_relaxed));
   ThreadContextBase *tctx = threads_[tid];
   CHECK_NE(tctx, 0);
   if (tctx->status == ThreadStatusInvalid) {
@@ -227,21 +253,25 @@ void ThreadRegistry::JoinThread(u32 tid, void *arg) {
     return;
   }
   tctx->SetJoined(arg);
+  OsIdHashRemove(tctx);
   QuarantinePush(tctx);
 }
 
 void ThreadRegistry::FinishThread(u32 tid) {
   BlockingMutexLock l(&mtx_);
-  CHECK_GT(alive_threads_, 0);
-  alive_threads_--;
-  CHECK_GT(running_threads_, 0);
-  running_threads_--;
-  CHECK_LT(tid, n_contexts_);
+  uptr alive = atomic_load(&alive_threads_, memory_order_relaxed);
+  CHECK_GT(alive, 0);
+  atomic_store(&alive_threads_, alive - 1, memory_order_relaxed);
+  uptr running = atomic_load(&running_threads_, memory_order_relaxed);
+  CHECK_GT(running, 0);
+  atomic_store(&running_threads_, running - 1, memory_order_relaxed);
+  CHECK_LT(tid, atomic_load(&n_contexts_, memory_order_relaxed));
   ThreadContextBase *tctx = threads_[tid];
   CHECK_NE(tctx, 0);
   CHECK_EQ(ThreadStatusRunning, tctx->status);
   tctx->SetFinished();
   if (tctx->detached) {
+    OsIdHashRemove(tctx);
     tctx->SetDead();
     QuarantinePush(tctx);
   }
@@ -249,12 +279,36 @@ void ThreadRegistry::FinishThread(u32 tid) {
 
 void ThreadRegistry::StartThread(u32 tid, uptr os_id, void *arg) {
   BlockingMutexLock l(&mtx_);
-  running_threads_++;
-  CHECK_LT(tid, n_contexts_);
+  atomic_store(&running_threads_,
+               atomic_load(&running_threads_, memory_order_relaxed) + 1,
+               memory_order_relaxed);
+  CHECK_LT(tid, atomic_load(&n_contexts_, memory_order_relaxed));
   ThreadContextBase *tctx = threads_[tid];
   CHECK_NE(tctx, 0);
   CHECK_EQ(ThreadStatusCreated, tctx->status);
   tctx->SetStarted(os_id, arg);
+  OsIdHashInsert(tctx);
+}
+
+uptr ThreadRegistry::OsIdHash(uptr os_id) const {
+  // Thread ids are mostly consecutive, pthread_t-like ids are aligned.
+  return (os_id ^ (os_id >> 12)) & (os_id_hash_size_ - 1);
+}
+
+void ThreadRegistry::OsIdHashInsert(ThreadContextBase *tctx) {
+  uptr h = OsIdHash(tctx->os_id);
+  tctx->next_with_os_id_hash = os_id_hash_[h];
+  os_id_hash_[h] = tctx;
+}
+
+void ThreadRegistry::OsIdHashRemove(ThreadContextBase *tctx) {
+  ThreadContextBase **p = &os_id_hash_[OsIdHash(tctx->os_id)];
+  while (*p != tctx) {
+    CHECK_NE(*p, 0);
+    p = &(*p)->next_with_os_id_hash;
+  }
+  *p = tctx->next_with_os_id_hash;
+  tctx->next_with_os_id_hash = 0;
 }
 
 void ThreadRegistry::QuarantinePush(ThreadContextBase *tctx) {
@@ -268,6 +322,18 @@ void ThreadRegistry::QuarantinePush(ThreadContextBase *tctx) {
   invalid_threads_.push_back(tctx);
 }
 
+// Out of tids: reuse the thread that is dead for the longest time before its
+// quarantine is over. Only the reports that mention that thread get worse.
+ThreadContextBase *ThreadRegistry::QuarantineEvict() {
+  if (dead_threads_.size() == 0)
+    return 0;
+  ThreadContextBase *tctx = dead_threads_.front();
+  dead_threads_.pop_front();
+  CHECK_EQ(tctx->status, ThreadStatusDead);
+  tctx->Reset();
+  return tctx;
+}
+
 ThreadContextBase *ThreadRegistry::QuarantinePop() {
   if (invalid_threads_.size() == 0)
     return 0;
@@ -15,6 +15,7 @@
 #ifndef SANITIZER_THREAD_REGISTRY_H
 #define SANITIZER_THREAD_REGISTRY_H
 
+#include "sanitizer_atomic.h"
 #include "sanitizer_common.h"
 #include "sanitizer_list.h"
 #include "sanitizer_mutex.h"
@@ -48,6 +49,7 @@ class ThreadContextBase {
 
   u32 parent_tid;
   ThreadContextBase *next;  // For storing thread contexts in a list.
+  ThreadContextBase *next_with_os_id_hash;  // For the os_id index.
 
   void SetName(const char *new_name);
 
@@ -78,6 +80,8 @@ class ThreadRegistry {
 
   ThreadRegistry(ThreadContextFactory factory, u32 max_threads,
                  u32 thread_quarantine_size);
+  // The counters are read without the lock, so they need not be consistent
+  // with each other while threads are created or finished.
   void GetNumberOfThreads(uptr *total = 0, uptr *running = 0, uptr *alive = 0);
   uptr GetMaxAliveThreads();
 
@@ -85,10 +89,14 @@ class ThreadRegistry {
   void CheckLocked() { mtx_.CheckLocked(); }
   void Unlock() { mtx_.Unlock(); }
 
-  // Should be guarded by ThreadRegistryLock.
+  // Contexts are published with a release store and never freed, so getting
+  // one needs no lock. Reading the fields of a context of another thread
+  // still has to be guarded by ThreadRegistryLock.
   ThreadContextBase *GetThreadLocked(u32 tid) {
-    DCHECK_LT(tid, n_contexts_);
-    return threads_[tid];
+    DCHECK_LT(tid, atomic_load(&n_contexts_, memory_order_relaxed));
+    return reinterpret_cast<ThreadContextBase *>(atomic_load(
+        reinterpret_cast<atomic_uintptr_t *>(&threads_[tid]),
+        memory_order_acquire));
   }
 
   u32 CreateThread(uptr user_id, bool detached, u32 parent_tid, void *arg);
@@ -106,9 +114,13 @@ class ThreadRegistry {
   // is found.
   ThreadContextBase *FindThreadContextLocked(FindThreadCallback cb,
                                              void *arg);
+  // Finds a running or finished thread in O(1); the most recently started
+  // one if the OS has reused the id.
   ThreadContextBase *FindThreadContextByOsIDLocked(uptr os_id);
 
   void SetThreadName(u32 tid, const char *name);
+  // E.g. for the main thread after fork().
+  void SetThreadOsId(u32 tid, uptr os_id);
   void DetachThread(u32 tid);
   void JoinThread(u32 tid, void *arg);
   void FinishThread(u32 tid);
@@ -121,19 +133,28 @@ class ThreadRegistry {
 
   BlockingMutex mtx_;
 
-  u32 n_contexts_;      // Number of created thread contexts,
-                        // at most max_threads_.
+  // The counters are only modified under mtx_.
+  atomic_uint32_t n_contexts_;      // Number of created thread contexts,
+                                    // at most max_threads_.
   u64 total_threads_;   // Total number of created threads. May be greater than
                         // max_threads_ if contexts were reused.
-  uptr alive_threads_;  // Created or running.
-  uptr max_alive_threads_;
-  uptr running_threads_;
+  atomic_uintptr_t alive_threads_;  // Created or running.
+  atomic_uintptr_t max_alive_threads_;
+  atomic_uintptr_t running_threads_;
 
   ThreadContextBase **threads_;  // Array of thread contexts is leaked.
   IntrusiveList<ThreadContextBase> dead_threads_;
   IntrusiveList<ThreadContextBase> invalid_threads_;
 
+  // Chained hash table of the running and finished threads by os_id.
+  ThreadContextBase **os_id_hash_;
+  uptr os_id_hash_size_;  // A power of two.
+
+  uptr OsIdHash(uptr os_id) const;
+  void OsIdHashInsert(ThreadContextBase *tctx);
+  void OsIdHashRemove(ThreadContextBase *tctx);
   void QuarantinePush(ThreadContextBase *tctx);
+  ThreadContextBase *QuarantineEvict();
   ThreadContextBase *QuarantinePop();
 };
 
@@ -0,0 +1,190 @@
+//===-- sanitizer_timing.cc -----------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is shared between AddressSanitizer, ThreadSanitizer and
+// LeakSanitizer run-time libraries.
+//===----------------------------------------------------------------------===//
+
+#include "sanitizer_timing.h"
+#include "sanitizer_common.h"
+#include "sanitizer_libc.h"
+#include "sanitizer_mutex.h"
+
+namespace __sanitizer {
+
+u32 timing_sample_rate;
+
+#if SANITIZER_CAN_USE_TIMING
+static const char *const kTimingRegionNames[kTimingRegionCount] = {
+  "malloc",
+  "free",
+  "interceptor",
+  "memory range check",
+  "report",
+  "leak check"
+};
+
+// Bucket i counts the durations in [2^i, 2^(i+1)), the last one also
+// the longer ones.
+static const uptr kTimingBuckets = 40;
+
+struct TimingStats {
+  u64 count[kTimingRegionCount];
+  u64 total[kTimingRegionCount];
+  u64 hist[kTimingRegionCount][kTimingBuckets];
+  TimingStats *next;  // In all_stats or free_stats.
+};
+
+THREADLOCAL u32 timing_countdown;
+static THREADLOCAL TimingStats *thread_stats;
+
+// Per-thread stats are never unmapped: the stats of finished threads are
+// merged into finished_stats and their storage is reused.
+static StaticSpinMutex timing_mu;
+static TimingStats *all_stats;
+static TimingStats *free_stats;
+static TimingStats finished_stats;
+
+static TimingStats *AllocateTimingStats() {
+  SpinMutexLock l(&timing_mu);
+  TimingStats *s = free_stats;
+  if (s) {
+    free_stats = s->next;
+  } else {
+    static LowLevelAllocator timing_allocator;
+    s = (TimingStats *)timing_allocator.Allocate(sizeof(*s));
+  }
+  internal_memset(s, 0, sizeof(*s));
+  s->next = all_stats;
+  all_stats = s;
+  return s;
+}
+
+static void MergeTimingStats(TimingStats *to, const TimingStats *from) {
+  for (uptr r = 0; r < kTimingRegionCount; r++) {
+    to->count[r] += from->count[r];
+    to->total[r] += from->total[r];
+    for (uptr b = 0; b < kTimingBuckets; b++)
+      to->hist[r][b] += from->hist[r][b];
+  }
+}
+
+void RecordTiming(TimingRegion region, u64 duration) {
+  TimingStats *s = thread_stats;
+  if (UNLIKELY(s == 0))
+    s = thread_stats = AllocateTimingStats();
+  uptr bucket = duration ? MostSignificantSetBitIndex(duration) : 0;
+  if (bucket >= kTimingBuckets)
+    bucket = kTimingBuckets - 1;
+  s->count[region]++;
+  s->total[region] += duration;
+  s->hist[region][bucket]++;
+}
+
+void TimingThreadFinish() {
+  TimingStats *s = thread_stats;
+  if (s == 0)
+    return;
+  thread_stats = 0;
+  SpinMutexLock l(&timing_mu);
+  MergeTimingStats(&finished_stats, s);
+  for (TimingStats **p = &all_stats; *p; p = &(*p)->next) {
+    if (*p == s) {
+      *p = s->next;
+      break;
+    }
+  }
+  s->next = free_stats;
+  free_stats = s;
+}
+
+// Returns the upper bound of the bucket that holds the given quantile.
+static u64 TimingQuantile(const u64 *hist, u64 count, uptr percent) {
+  u64 rank = (count * percent + 99) / 100;
+  u64 seen = 0;
+  for (uptr b = 0; b < kTimingBuckets; b++) {
+    seen += hist[b];
+    if (seen >= rank)
+      return (u64)2 << b;
+  }
+  return (u64)2 << (kTimingBuckets - 1);
+}
+
+void PrintTimingStats() {
+  if (timing_sample_rate == 0)
+    return;
+  // Too large for the stack, protected by timing_mu.
+  static TimingStats sum;
+  SpinMutexLock l(&timing_mu);
+  // The counters of the running threads are read racily.
+  internal_memcpy(&sum, &finished_stats, sizeof(sum));
+  for (TimingStats *s = all_stats; s; s = s->next)
+    MergeTimingStats(&sum, s);
+#if defined(__x86_64__) || defined(__i386__)
+  const char *unit = "cycles";
+#else
+  const char *unit = "ns";
+#endif
+  Printf("Runtime timing (1 in %d sampled, %s):\n", timing_sample_rate,
+         unit);
+  for (uptr r = 0; r < kTimingRegionCount; r++) {
+    u64 count = sum.count[r];
+    if (count == 0)
+      continue;
+    u64 rate = r < kTimingFirstUnsampledRegion ? timing_sample_rate : 1;
+    Printf("  %s: %zu samples, mean %zu, p50 < %zu, p90 < %zu, p99 < %zu, "
+           "estimated total %zuM\n",
+           kTimingRegionNames[r], (uptr)count, (uptr)(sum.total[r] / count),
+           (uptr)TimingQuantile(sum.hist[r], count, 50),
+           (uptr)TimingQuantile(sum.hist[r], count, 90),
+           (uptr)TimingQuantile(sum.hist[r], count, 99),
+           (uptr)(sum.total[r] * rate / 1000000));
+  }
+}
+
+u64 GetTimingCount(TimingRegion region) {
+  SpinMutexLock l(&timing_mu);
+  u64 count = finished_stats.count[region];
+  for (TimingStats *s = all_stats; s; s = s->next)
+    count += s->count[region];
+  return count;
+}
+
+void ResetTimingStats() {
+  SpinMutexLock l(&timing_mu);
+  internal_memset(&finished_stats, 0, sizeof(finished_stats));
+  for (TimingStats *s = all_stats; s; s = s->next) {
+    TimingStats *next = s->next;
+    internal_memset(s, 0, sizeof(*s));
+    s->next = next;
+  }
+}
+#else
+void RecordTiming(TimingRegion region, u64 duration) {}
+void TimingThreadFinish() {}
+void PrintTimingStats() {}
+void ResetTimingStats() {}
+u64 GetTimingCount(TimingRegion region) { return 0; }
+#endif  // SANITIZER_CAN_USE_TIMING
+
+void InitializeTiming(int sample_rate) {
+  timing_sample_rate = sample_rate > 0 ? sample_rate : 0;
+}
+
+}  // namespace __sanitizer
+
+using namespace __sanitizer;  // NOLINT
+
+void __sanitizer_print_timing_stats() {
+  PrintTimingStats();
+}
+
+void __sanitizer_reset_timing_stats() {
+  ResetTimingStats();
+}
@@ -0,0 +1,111 @@
+//===-- sanitizer_timing.h --------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Sampled timing of the runtime hot paths (allocator, interceptors, reports),
+// to attribute the slowdown of a process to runtime components.
+//
+// With a sample rate N > 0, one in N entries into a timed region on every
+// thread is bracketed with the cycle counter and the duration is added to
+// a per-thread log2 histogram of the region. Rare regions (reports, leak
+// checks) are timed on every entry. PrintTimingStats() merges the
+// histograms of all threads. Durations are inclusive, e.g. the malloc
+// region is also counted inside the interceptor region of malloc(). With
+// the sampling off, a timed region costs a load and a branch.
+//===----------------------------------------------------------------------===//
+#ifndef SANITIZER_TIMING_H
+#define SANITIZER_TIMING_H
+
+#include "sanitizer_common.h"
+#include "sanitizer_platform.h"
+
+// The per-thread state lives in TLS, which is not available everywhere.
+#if SANITIZER_LINUX && !SANITIZER_ANDROID && !defined(SANITIZER_GO)
+# define SANITIZER_CAN_USE_TIMING 1
+#else
+# define SANITIZER_CAN_USE_TIMING 0
+#endif
+
+namespace __sanitizer {
+
+enum TimingRegion {
+  kTimingMalloc,
+  kTimingFree,
+  kTimingInterceptor,
+  kTimingMemoryRangeCheck,
+  // The regions starting from here are not sampled.
+  kTimingReport,
+  kTimingLeakCheck,
+  kTimingRegionCount
+};
+const TimingRegion kTimingFirstUnsampledRegion = kTimingReport;
+
+// One in sample_rate region entries is timed, 0 disables timing.
+void InitializeTiming(int sample_rate);
+// Prints the merged per-region histograms, if timing is enabled.
+void PrintTimingStats();
+void ResetTimingStats();
+// Number of timed entries into the region on all threads.
+u64 GetTimingCount(TimingRegion region);
+// Merges the stats of the current thread into the totals and releases its
+// per-thread storage. Called by the tools when a thread finishes.
+void TimingThreadFinish();
+
+// Implementation details of ScopedTiming.
+extern u32 timing_sample_rate;
+void RecordTiming(TimingRegion region, u64 duration);
+#if SANITIZER_CAN_USE_TIMING
+extern THREADLOCAL u32 timing_countdown;
+#endif
+
+INLINE u64 TimingClock() {
+#if defined(__x86_64__) || defined(__i386__)
+  u32 lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((u64)hi << 32) | lo;
+#else
+  return MonotonicNanoTime();
+#endif
+}
+
+class ScopedTiming {
+ public:
+  explicit ScopedTiming(TimingRegion region) : region_(region), start_(0) {
+#if SANITIZER_CAN_USE_TIMING
+    if (LIKELY(timing_sample_rate == 0))
+      return;
+    if (region < kTimingFirstUnsampledRegion) {
+      if (LIKELY(timing_countdown > 0)) {
+        timing_countdown--;
+        return;
+      }
+      timing_countdown = timing_sample_rate - 1;
+    }
+    start_ = TimingClock();
+#endif
+  }
+  ~ScopedTiming() {
+    if (UNLIKELY(start_ != 0))
+      RecordTiming(region_, TimingClock() - start_);
+  }
+
+ private:
+  TimingRegion region_;
+  u64 start_;
+};
+
+}  // namespace __sanitizer
+
+extern "C" {
+  SANITIZER_INTERFACE_ATTRIBUTE
+  void __sanitizer_print_timing_stats();
+  SANITIZER_INTERFACE_ATTRIBUTE
+  void __sanitizer_reset_timing_stats();
+}  // extern "C"
+
+#endif  // SANITIZER_TIMING_H
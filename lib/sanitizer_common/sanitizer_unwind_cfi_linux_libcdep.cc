@@ -0,0 +1,556 @@
+//===-- sanitizer_unwind_cfi_linux_libcdep.cc -----------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is shared between AddressSanitizer and ThreadSanitizer
+// run-time libraries.
+// Stack unwinder for code without frame pointers (x86_64 Linux).
+// The .eh_frame CFI of a pc is decoded only once; the resulting frame
+// layout (where the CFA, the return address and the saved rbp are) is kept
+// in a lock-free hash table, so steady-state unwinding costs a table lookup
+// and two loads per frame.
+//===----------------------------------------------------------------------===//
+
+#include "sanitizer_platform.h"
+#if SANITIZER_LINUX
+#include "sanitizer_atomic.h"
+#include "sanitizer_common.h"
+#include "sanitizer_stacktrace.h"
+#include "sanitizer_symbolizer.h"
+
+#if defined(__x86_64__) && !SANITIZER_ANDROID
+#include <link.h>
+#endif
+
+namespace __sanitizer {
+
+#if defined(__x86_64__) && !SANITIZER_ANDROID
+
+namespace {
+
+// DWARF register numbers.
+const uptr kRegRbp = 6;
+const uptr kRegRsp = 7;
+const uptr kRegRa = 16;
+
+// Pointer encodings.
+const u8 DW_EH_PE_omit = 0xff;
+const u8 DW_EH_PE_absptr = 0x00;
+const u8 DW_EH_PE_uleb128 = 0x01;
+const u8 DW_EH_PE_udata2 = 0x02;
+const u8 DW_EH_PE_udata4 = 0x03;
+const u8 DW_EH_PE_udata8 = 0x04;
+const u8 DW_EH_PE_sleb128 = 0x09;
+const u8 DW_EH_PE_sdata2 = 0x0a;
+const u8 DW_EH_PE_sdata4 = 0x0b;
+const u8 DW_EH_PE_sdata8 = 0x0c;
+const u8 DW_EH_PE_pcrel = 0x10;
+const u8 DW_EH_PE_datarel = 0x30;
+const u8 DW_EH_PE_indirect = 0x80;
+
+// Frame layout of a pc. All offsets are relative to the CFA.
+struct FrameRule {
+  bool cfa_is_rbp;  // Otherwise the CFA is based on rsp.
+  sptr cfa_off;
+  sptr ra_off;
+  sptr rbp_off;     // 0 if rbp is not saved in this frame.
+  bool last;        // The return address is undefined (outermost frame).
+};
+
+// Forward-only reader of CFI data. Sets failed on anything unsupported.
+struct CfiReader {
+  const u8 *p;
+  const u8 *end;
+  bool failed;
+
+  u8 U8() {
+    if (p >= end) {
+      failed = true;
+      return 0;
+    }
+    return *p++;
+  }
+
+  uptr Uleb() {
+    uptr res = 0;
+    for (uptr shift = 0; ; shift += 7) {
+      u8 b = U8();
+      if (shift < 64)
+        res |= (uptr)(b & 0x7f) << shift;
+      if ((b & 0x80) == 0 || failed)
+        return res;
+    }
+  }
+
+  sptr Sleb() {
+    uptr res = 0;
+    uptr shift = 0;
+    u8 b;
+    do {
+      b = U8();
+      if (shift < 64)
+        res |= (uptr)(b & 0x7f) << shift;
+      shift += 7;
+    } while ((b & 0x80) && !failed);
+    if (shift < 64 && (b & 0x40))
+      res |= ~(uptr)0 << shift;
+    return (sptr)res;
+  }
+
+  template<typename T>
+  T Fixed() {
+    if (p + sizeof(T) > end) {
+      failed = true;
+      return 0;
+    }
+    T v;
+    internal_memcpy(&v, p, sizeof(v));
+    p += sizeof(T);
+    return v;
+  }
+
+  uptr Pointer(u8 enc) {
+    if (enc == DW_EH_PE_omit)
+      return 0;
+    const u8 *start = p;
+    uptr v = 0;
+    switch (enc & 0x0f) {
+      case DW_EH_PE_absptr: v = Fixed<u64>(); break;
+      case DW_EH_PE_uleb128: v = Uleb(); break;
+      case DW_EH_PE_udata2: v = Fixed<u16>(); break;
+      case DW_EH_PE_udata4: v = Fixed<u32>(); break;
+      case DW_EH_PE_udata8: v = Fixed<u64>(); break;
+      case DW_EH_PE_sleb128: v = Sleb(); break;
+      case DW_EH_PE_sdata2: v = (sptr)Fixed<s16>(); break;
+      case DW_EH_PE_sdata4: v = (sptr)Fixed<s32>(); break;
+      case DW_EH_PE_sdata8: v = Fixed<s64>(); break;
+      default: failed = true; return 0;
+    }
+    switch (enc & 0x70) {
+      case DW_EH_PE_absptr: break;
+      case DW_EH_PE_pcrel: v += (uptr)start; break;
+      default: failed = true; return 0;
+    }
+    if (enc & DW_EH_PE_indirect)
+      v = *(uptr*)v;
+    return v;
+  }
+};
+
+struct Cie {
+  uptr code_align;
+  sptr data_align;
+  uptr ra_reg;
+  u8 fde_enc;
+  bool has_aug_data;
+  const u8 *insns;
+  const u8 *insns_end;
+};
+
+static bool ParseCie(const u8 *cie, Cie *res) {
+  CfiReader r = {cie, cie + 4, false};
+  u32 len = r.Fixed<u32>();
+  if (len == 0 || len == 0xffffffff)
+    return false;
+  r.end = cie + 4 + len;
+  if (r.Fixed<u32>() != 0)  // CIE id.
+    return false;
+  u8 version = r.U8();
+  const char *aug = (const char*)r.p;
+  while (r.U8() != 0 && !r.failed) {}
+  res->code_align = r.Uleb();
+  res->data_align = r.Sleb();
+  res->ra_reg = version == 1 ? r.U8() : r.Uleb();
+  res->fde_enc = DW_EH_PE_absptr;
+  res->has_aug_data = aug[0] == 'z';
+  if (res->has_aug_data) {
+    r.Uleb();  // Augmentation data length.
+    for (const char *a = aug + 1; *a && !r.failed; a++) {
+      if (*a == 'R') {
+        res->fde_enc = r.U8();
+      } else if (*a == 'P') {
+        u8 enc = r.U8();
+        // Don't dereference the personality, just skip it.
+        r.Pointer(enc & ~DW_EH_PE_indirect);
+      } else if (*a == 'L') {
+        r.U8();
+      } else if (*a != 'S') {
+        return false;
+      }
+    }
+  } else if (aug[0] != 0) {
+    return false;
+  }
+  res->insns = r.p;
+  res->insns_end = r.end;
+  return !r.failed;
+}
+
+struct CfiState {
+  uptr cfa_reg;
+  sptr cfa_off;
+  sptr ra_off;
+  sptr rbp_off;
+  bool ra_undefined;
+};
+
+// Runs CFA instructions until the location passes pc.
+static bool RunCfi(const Cie &cie, const u8 *insns, const u8 *end, uptr loc,
+                   uptr pc, const CfiState &initial, CfiState *state) {
+  const uptr kMaxRemembered = 8;
+  CfiState remembered[kMaxRemembered];
+  uptr nremembered = 0;
+  CfiReader r = {insns, end, false};
+  while (r.p < r.end && !r.failed) {
+    u8 op = r.U8();
+    u8 arg = op & 0x3f;
+    uptr reg = 0;
+    sptr off = 0;
+    switch (op & 0xc0) {
+      case 0x40:  // DW_CFA_advance_loc
+        loc += arg * cie.code_align;
+        if (loc > pc)
+          return true;
+        continue;
+      case 0x80:  // DW_CFA_offset
+        reg = arg;
+        off = (sptr)r.Uleb() * cie.data_align;
+        goto set_offset;
+      case 0xc0:  // DW_CFA_restore
+        reg = arg;
+        goto restore;
+    }
+    switch (op) {
+      case 0x00:  // DW_CFA_nop
+        continue;
+      case 0x01:  // DW_CFA_set_loc
+        loc = r.Pointer(cie.fde_enc);
+        if (loc > pc)
+          return true;
+        continue;
+      case 0x02:  // DW_CFA_advance_loc1
+        loc += r.Fixed<u8>() * cie.code_align;
+        if (loc > pc)
+          return true;
+        continue;
+      case 0x03:  // DW_CFA_advance_loc2
+        loc += r.Fixed<u16>() * cie.code_align;
+        if (loc > pc)
+          return true;
+        continue;
+      case 0x04:  // DW_CFA_advance_loc4
+        loc += r.Fixed<u32>() * cie.code_align;
+        if (loc > pc)
+          return true;
+        continue;
+      case 0x05:  // DW_CFA_offset_extended
+        reg = r.Uleb();
+        off = (sptr)r.Uleb() * cie.data_align;
+        goto set_offset;
+      case 0x11:  // DW_CFA_offset_extended_sf
+        reg = r.Uleb();
+        off = r.Sleb() * cie.data_align;
+        goto set_offset;
+      case 0x06:  // DW_CFA_restore_extended
+        reg = r.Uleb();
+        goto restore;
+      case 0x07:  // DW_CFA_undefined
+      case 0x08:  // DW_CFA_same_value
+        reg = r.Uleb();
+        if (reg == kRegRa)
+          state->ra_undefined = op == 0x07;
+        else if (reg == kRegRbp)
+          state->rbp_off = 0;
+        continue;
+      case 0x09:  // DW_CFA_register
+        reg = r.Uleb();
+        r.Uleb();
+        if (reg == kRegRa || reg == kRegRbp)
+          return false;
+        continue;
+      case 0x0a:  // DW_CFA_remember_state
+        if (nremembered == kMaxRemembered)
+          return false;
+        remembered[nremembered++] = *state;
+        continue;
+      case 0x0b:  // DW_CFA_restore_state
+        if (nremembered == 0)
+          return false;
+        *state = remembered[--nremembered];
+        continue;
+      case 0x0c:  // DW_CFA_def_cfa
+        state->cfa_reg = r.Uleb();
+        state->cfa_off = r.Uleb();
+        continue;
+      case 0x12:  // DW_CFA_def_cfa_sf
+        state->cfa_reg = r.Uleb();
+        state->cfa_off = r.Sleb() * cie.data_align;
+        continue;
+      case 0x0d:  // DW_CFA_def_cfa_register
+        state->cfa_reg = r.Uleb();
+        continue;
+      case 0x0e:  // DW_CFA_def_cfa_offset
+        state->cfa_off = r.Uleb();
+        continue;
+      case 0x13:  // DW_CFA_def_cfa_offset_sf
+        state->cfa_off = r.Sleb() * cie.data_align;
+        continue;
+      case 0x10:  // DW_CFA_expression
+      case 0x16:  // DW_CFA_val_expression
+        reg = r.Uleb();
+        r.p += r.Uleb();
+        if (reg == kRegRa || reg == kRegRbp)
+          return false;
+        continue;
+      case 0x14:  // DW_CFA_val_offset
+        reg = r.Uleb();
+        r.Uleb();
+        if (reg == kRegRa || reg == kRegRbp)
+          return false;
+        continue;
+      case 0x15:  // DW_CFA_val_offset_sf
+        reg = r.Uleb();
+        r.Sleb();
+        if (reg == kRegRa || reg == kRegRbp)
+          return false;
+        continue;
+      case 0x2e:  // DW_CFA_GNU_args_size
+        r.Uleb();
+        continue;
+      case 0x2f:  // DW_CFA_GNU_negative_offset_extended
+        reg = r.Uleb();
+        off = -(sptr)r.Uleb() * cie.data_align;
+        goto set_offset;
+      default:
+        // Including DW_CFA_def_cfa_expression (signal frames, PLT).
+        return false;
+    }
+   set_offset:
+    if (reg == kRegRa)
+      state->ra_off = off;
+    else if (reg == kRegRbp)
+      state->rbp_off = off;
+    continue;
+   restore:
+    if (reg == kRegRa)
+      state->ra_off = initial.ra_off;
+    else if (reg == kRegRbp)
+      state->rbp_off = initial.rbp_off;
+  }
+  return !r.failed;
+}
+
+static bool ParseFde(const u8 *fde, uptr pc, FrameRule *rule) {
+  CfiReader r = {fde, fde + 8, false};
+  u32 len = r.Fixed<u32>();
+  if (len == 0 || len == 0xffffffff)
+    return false;
+  r.end = fde + 4 + len;
+  const u8 *cie_ptr_pos = r.p;
+  u32 cie_off = r.Fixed<u32>();
+  if (cie_off == 0)  // This is a CIE.
+    return false;
+  Cie cie;
+  if (!ParseCie(cie_ptr_pos - cie_off, &cie))
+    return false;
+  if (cie.ra_reg != kRegRa)
+    return false;
+  uptr pc_begin = r.Pointer(cie.fde_enc);
+  uptr pc_range = r.Pointer(cie.fde_enc & 0x0f);
+  if (r.failed || pc < pc_begin || pc >= pc_begin + pc_range)
+    return false;
+  if (cie.has_aug_data) {
+    uptr aug_len = r.Uleb();
+    r.p += aug_len;
+  }
+  if (r.failed || r.p > r.end)
+    return false;
+  CfiState initial = {kRegRsp, 8, -8, 0, false};
+  if (!RunCfi(cie, cie.insns, cie.insns_end, pc_begin, pc, initial, &initial))
+    return false;
+  CfiState state = initial;
+  if (!RunCfi(cie, r.p, r.end, pc_begin, pc, initial, &state))
+    return false;
+  if (state.cfa_reg != kRegRsp && state.cfa_reg != kRegRbp)
+    return false;
+  rule->cfa_is_rbp = state.cfa_reg == kRegRbp;
+  rule->cfa_off = state.cfa_off;
+  rule->ra_off = state.ra_off;
+  rule->rbp_off = state.rbp_off;
+  rule->last = state.ra_undefined;
+  return true;
+}
+
+struct FindFdeCtx {
+  uptr pc;
+  const u8 *fde;
+  bool found_module;
+};
+
+static int FindFdeCallback(dl_phdr_info *info, size_t size, void *arg) {
+  FindFdeCtx *ctx = (FindFdeCtx*)arg;
+  const ElfW(Phdr) *eh_frame_hdr = 0;
+  bool contains = false;
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+    uptr beg = info->dlpi_addr + phdr->p_vaddr;
+    if (phdr->p_type == PT_LOAD && ctx->pc >= beg &&
+        ctx->pc < beg + phdr->p_memsz)
+      contains = true;
+    else if (phdr->p_type == PT_GNU_EH_FRAME)
+      eh_frame_hdr = phdr;
+  }
+  if (!contains)
+    return 0;
+  ctx->found_module = true;
+  if (eh_frame_hdr == 0)
+    return 1;
+  const u8 *hdr = (const u8*)(info->dlpi_addr + eh_frame_hdr->p_vaddr);
+  // version, eh_frame_ptr_enc, fde_count_enc, table_enc.
+  if (hdr[0] != 1 || hdr[3] != (DW_EH_PE_datarel | DW_EH_PE_sdata4))
+    return 1;
+  CfiReader r = {hdr + 4, hdr + eh_frame_hdr->p_memsz, false};
+  r.Pointer(hdr[1]);
+  uptr count = r.Pointer(hdr[2]);
+  if (r.failed || r.p + count * 8 > r.end)
+    return 1;
+  // The table is sorted by initial location, relative to hdr.
+  const s32 *table = (const s32*)r.p;
+  sptr rel_pc = (sptr)(ctx->pc - (uptr)hdr);
+  uptr lo = 0;
+  uptr hi = count;
+  while (lo < hi) {
+    uptr mid = lo + (hi - lo) / 2;
+    if (table[mid * 2] <= rel_pc)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo != 0)
+    ctx->fde = hdr + table[(lo - 1) * 2 + 1];
+  return 1;
+}
+
+// Cache entries are two words: the pc and the packed rule. The rule word
+// carries a hash of the pc, so that a torn entry (pc from one writer,
+// rule from another) is recognized and ignored.
+//   [63:40] pc hash  [39] valid  [38] cfa_is_rbp  [37] last
+//   [36:16] cfa_off  [15:8] ra_off / 8  [7:0] rbp_off / 8
+const uptr kRuleCacheSize = 1 << 14;
+const uptr kMaxCfaOff = 1 << 21;
+atomic_uint64_t rule_cache[kRuleCacheSize][2];  // Linker initialized.
+atomic_uintptr_t rule_cache_generation;
+
+static u64 PcHash(uptr pc) {
+  return ((pc * 0x9E3779B97F4A7C15ULL) >> 40) & 0xffffff;
+}
+
+static bool PackRule(uptr pc, bool valid, const FrameRule &rule, u64 *res) {
+  if (!valid) {
+    *res = PcHash(pc) << 40;
+    return true;
+  }
+  if (rule.cfa_off < 0 || rule.cfa_off >= (sptr)kMaxCfaOff ||
+      rule.ra_off % 8 || rule.rbp_off % 8 ||
+      rule.ra_off < -1024 || rule.ra_off >= 1024 ||
+      rule.rbp_off < -1024 || rule.rbp_off >= 1024)
+    return false;
+  *res = (PcHash(pc) << 40) | (1ULL << 39) |
+      ((u64)rule.cfa_is_rbp << 38) | ((u64)rule.last << 37) |
+      ((u64)rule.cfa_off << 16) | ((u64)(u8)(rule.ra_off / 8) << 8) |
+      (u64)(u8)(rule.rbp_off / 8);
+  return true;
+}
+
+static bool UnpackRule(u64 v, FrameRule *rule) {
+  if ((v & (1ULL << 39)) == 0)
+    return false;
+  rule->cfa_is_rbp = v & (1ULL << 38);
+  rule->last = v & (1ULL << 37);
+  rule->cfa_off = (v >> 16) & (kMaxCfaOff - 1);
+  rule->ra_off = (sptr)(s8)(u8)(v >> 8) * 8;
+  rule->rbp_off = (sptr)(s8)(u8)v * 8;
+  return true;
+}
+
+static void CheckRuleCacheGeneration() {
+  // Code of an unloaded module may be replaced by a different one.
+  uptr generation = GetListOfModulesGeneration();
+  if (atomic_load(&rule_cache_generation, memory_order_relaxed) ==
+      generation)
+    return;
+  for (uptr i = 0; i < kRuleCacheSize; i++)
+    atomic_store(&rule_cache[i][0], 0, memory_order_relaxed);
+  atomic_store(&rule_cache_generation, generation, memory_order_relaxed);
+}
+
+// Returns false if the frame can't be unwound with the cached rules.
+static bool GetFrameRule(uptr pc, FrameRule *rule) {
+  atomic_uint64_t *e = rule_cache[(pc ^ (pc >> 14)) % kRuleCacheSize];
+  if (atomic_load(&e[0], memory_order_acquire) == pc) {
+    u64 v = atomic_load(&e[1], memory_order_acquire);
+    if ((v >> 40) == PcHash(pc))
+      return UnpackRule(v, rule);
+  }
+  FindFdeCtx ctx = {pc, 0, false};
+  dl_iterate_phdr(FindFdeCallback, &ctx);
+  bool valid = ctx.fde != 0 && ParseFde(ctx.fde, pc, rule);
+  u64 v;
+  if (PackRule(pc, valid, *rule, &v)) {
+    atomic_store(&e[0], 0, memory_order_relaxed);
+    atomic_store(&e[1], v, memory_order_release);
+    atomic_store(&e[0], pc, memory_order_release);
+  }
+  return valid;
+}
+
+}  // namespace
+
+bool StackTrace::CfiUnwindStack(uptr max_depth) {
+  uptr pc, sp, bp;
+  // Our own frame is described by our own CFI at the label.
+  __asm__ __volatile__("lea 0(%%rip), %0\n"
+                       "mov %%rsp, %1\n"
+                       "mov %%rbp, %2\n"
+                       : "=r"(pc), "=r"(sp), "=r"(bp));
+  CheckRuleCacheGeneration();
+  size = 0;
+  for (uptr depth = 0; size < max_depth; depth++) {
+    FrameRule rule;
+    // Return addresses point past the call.
+    if (!GetFrameRule(depth == 0 ? pc : pc - 1, &rule))
+      return false;
+    if (rule.last)
+      return true;
+    uptr cfa = (rule.cfa_is_rbp ? bp : sp) + rule.cfa_off;
+    if (cfa <= sp || cfa % sizeof(uptr))
+      return size != 0;
+    uptr ra = *(uptr*)(cfa + rule.ra_off);
+    if (rule.rbp_off)
+      bp = *(uptr*)(cfa + rule.rbp_off);
+    sp = cfa;
+    pc = ra;
+    if (pc == 0)
+      return true;
+    // Like _Unwind_Backtrace, the first reported frame is our caller.
+    trace[size++] = pc;
+  }
+  return true;
+}
+
+#else  // defined(__x86_64__) && !SANITIZER_ANDROID
+
+bool StackTrace::CfiUnwindStack(uptr max_depth) {
+  return false;
+}
+
+#endif  // defined(__x86_64__) && !SANITIZER_ANDROID
+
+}  // namespace __sanitizer
+
+#endif  // SANITIZER_LINUX
@@ -21,6 +21,7 @@
 #include <io.h>
 #include <windows.h>
 
+#include "sanitizer_atomic.h"
 #include "sanitizer_common.h"
 #include "sanitizer_libc.h"
 #include "sanitizer_mutex.h"
@@ -60,6 +61,10 @@ uptr GetTid() {
   return GetCurrentThreadId();
 }
 
+uptr GetCurrentNumaNode() {
+  return 0;
+}
+
 uptr GetThreadSelf() {
   return GetTid();
 }
@@ -87,6 +92,11 @@ void *MmapOrDie(uptr size, const char *mem_type) {
   return rv;
 }
 
+void *MmapNoReserveOrDie(uptr size, const char *mem_type) {
+  // Committed pages take physical memory only when touched.
+  return MmapOrDie(size, mem_type);
+}
+
 void UnmapOrDie(void *addr, uptr size) {
   if (VirtualFree(addr, size, MEM_DECOMMIT) == 0) {
     Report("ERROR: Failed to deallocate 0x%zx (%zd) bytes at address %p\n",
@@ -110,6 +120,13 @@ void *MmapFixedOrDie(uptr fixed_addr, uptr size) {
   return MmapFixedNoReserve(fixed_addr, size);
 }
 
+bool TryMmapFixedNoReserve(uptr fixed_addr, uptr size) {
+  // The callers fall back to MemoryRangeIsAvailable and MmapFixedNoReserve.
+  (void)fixed_addr;
+  (void)size;
+  return false;
+}
+
 void *Mprotect(uptr fixed_addr, uptr size) {
   return VirtualAlloc((LPVOID)fixed_addr, size,
                       MEM_RESERVE | MEM_COMMIT, PAGE_NOACCESS);
@@ -120,6 +137,17 @@ void FlushUnneededShadowMemory(uptr addr, uptr size) {
   // FIXME: add madvice-analog when we move to 64-bits.
 }
 
+void HugePagesInRegion(uptr addr, uptr size) {
+  // FIXME: implement using large pages.
+}
+
+void NoHugePagesInRegion(uptr addr, uptr size) {
+}
+
+void PrefaultRegion(uptr addr, uptr size) {
+  // MmapFixedNoReserve commits the memory on Windows.
+}
+
 bool MemoryRangeIsAvailable(uptr range_start, uptr range_end) {
   // FIXME: shall we do anything here on Windows?
   return true;
@@ -208,6 +236,10 @@ u64 NanoTime() {
   return 0;
 }
 
+u64 MonotonicNanoTime() {
+  return 0;
+}
+
 void Abort() {
   abort();
   _exit(-1);  // abort is not NORETURN on Windows.
@@ -366,18 +398,100 @@ void GetThreadStackAndTls(bool main, uptr *stk_addr, uptr *stk_size,
 #endif
 }
 
+#if defined(_WIN64)
+// RtlLookupFunctionEntry searches the module list and then the function
+// table of the module for every frame, which dominates the unwinding of the
+// malloc stacks. Its results are cached by pc. An entry is written with pc
+// cleared and read optimistically, dropping it if pc has changed meanwhile;
+// the function entry of a pc does not change while its module is loaded.
+struct FunctionEntryCacheEntry {
+  atomic_uintptr_t pc;
+  uptr image_base;
+  PRUNTIME_FUNCTION function_entry;
+};
+
+static const uptr kFunctionEntryCacheSize = 4096;
+static FunctionEntryCacheEntry function_entry_cache[kFunctionEntryCacheSize];
+
+static PRUNTIME_FUNCTION LookupFunctionEntry(uptr pc, uptr *image_base) {
+  FunctionEntryCacheEntry *e =
+      &function_entry_cache[(pc * 2654435761U) % kFunctionEntryCacheSize];
+  if (atomic_load(&e->pc, memory_order_acquire) == pc) {
+    uptr base = e->image_base;
+    PRUNTIME_FUNCTION entry = e->function_entry;
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load(&e->pc, memory_order_relaxed) == pc) {
+      *image_base = base;
+      return entry;
+    }
+  }
+  DWORD64 base = 0;
+  PRUNTIME_FUNCTION entry = RtlLookupFunctionEntry(pc, &base, 0);
+  atomic_store(&e->pc, 0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  e->image_base = base;
+  e->function_entry = entry;
+  atomic_store(&e->pc, pc, memory_order_release);
+  *image_base = base;
+  return entry;
+}
+
+// Unwinds the stack of the caller into trace with the unwind info of the
+// modules, like CaptureStackBackTrace but with the cached function entries.
+// Returns the number of frames.
+static NOINLINE uptr UnwindStackX64(uptr *trace, uptr max_depth) {
+  CONTEXT ctx;
+  RtlCaptureContext(&ctx);
+  uptr size = 0;
+  for (uptr i = 0; size < max_depth; i++) {
+    uptr pc = ctx.Rip;
+    if (pc == 0)
+      break;
+    // Skip the frame of this function.
+    if (i > 0)
+      trace[size++] = pc;
+    uptr image_base;
+    PRUNTIME_FUNCTION entry = LookupFunctionEntry(pc, &image_base);
+    if (!entry) {
+      // A leaf function, the return address is on the top of the stack.
+      ctx.Rip = *(DWORD64 *)ctx.Rsp;
+      ctx.Rsp += 8;
+      continue;
+    }
+    PVOID handler_data;
+    DWORD64 establisher_frame;
+    RtlVirtualUnwind(UNW_FLAG_NHANDLER, image_base, pc, entry, &ctx,
+                     &handler_data, &establisher_frame, 0);
+  }
+  return size;
+}
+#endif  // defined(_WIN64)
+
 void GetStackTrace(StackTrace *stack, uptr max_s, uptr pc, uptr bp,
                    uptr stack_top, uptr stack_bottom, bool fast) {
-  (void)fast;
-  (void)stack_top;
-  (void)stack_bottom;
+  // Frame pointers are only reliable in the code built with /Oy-, so the
+  // fast unwinding is what the tool asks for, with fast_unwind_on_malloc
+  // (the default) or fast_unwind_on_fatal, and only when the thread stack
+  // bounds are known.
+  if (fast && stack_top) {
+    stack->size = 0;
+    stack->trace[0] = pc;
+    if (max_s > 1) {
+      stack->max_size = max_s;
+      stack->FastUnwindStack(pc, bp, stack_top, stack_bottom);
+    }
+    return;
+  }
   stack->max_size = max_s;
   void *tmp[kStackTraceMax];
 
-  // FIXME: CaptureStackBackTrace might be too slow for us.
   // FIXME: Compare with StackWalk64.
   // FIXME: Look at LLVMUnhandledExceptionFilter in Signals.inc
+#if defined(_WIN64)
+  uptr cs_ret = UnwindStackX64((uptr *)tmp, stack->max_size);
+#else
   uptr cs_ret = CaptureStackBackTrace(1, stack->max_size, tmp, 0);
+#endif
   uptr offset = 0;
   // Skip the RTL frames by searching for the PC in the stacktrace.
   // FIXME: this doesn't work well for the malloc/free stacks yet.
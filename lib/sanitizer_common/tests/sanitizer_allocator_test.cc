@@ -38,6 +38,23 @@ typedef SizeClassAllocator64<
 
 typedef SizeClassAllocator64<
   kAllocatorSpace, kAllocatorSize, 16, CompactSizeClassMap> Allocator64Compact;
+
+typedef SizeClassAllocator64<
+  kAllocatorSpace, kAllocatorSize, 16, DefaultSizeClassMap,
+  NoOpMapUnmapCallback, /*kNumFreeListShards*/8> Allocator64Sharded;
+
+static const uptr kNumaNodes = 4;
+typedef SizeClassAllocator64<
+  kAllocatorSpace, kAllocatorSize, 16, DefaultSizeClassMap,
+  NoOpMapUnmapCallback, /*kNumFreeListShards*/1, kNumaNodes> Allocator64Numa;
+
+typedef SizeClassAllocator64<
+  kAllocatorSpace, kAllocatorSize, 16, DefaultTableSizeClassMap>
+  Allocator64Table;
+
+typedef SizeClassAllocator64<
+  kAllocatorSpace, kAllocatorSize, 16, DenseTableSizeClassMap>
+  Allocator64Dense;
 #else
 static const u64 kAddressSpaceSize = 1ULL << 32;
 #endif
@@ -45,14 +62,30 @@ static const u64 kAddressSpaceSize = 1ULL << 32;
 static const uptr kRegionSizeLog = FIRST_32_SECOND_64(20, 24);
 static const uptr kFlatByteMapSize = kAddressSpaceSize >> kRegionSizeLog;
 
+#if SANITIZER_WORDSIZE == 32
+typedef FlatByteMap<kFlatByteMapSize> ByteMap;
+#else
+typedef TwoLevelByteMap<(kFlatByteMapSize >> 12), 1 << 12> ByteMap;
+#endif
+
 typedef SizeClassAllocator32<
   0, kAddressSpaceSize,
   /*kMetadataSize*/16,
   CompactSizeClassMap,
   kRegionSizeLog,
-  FlatByteMap<kFlatByteMapSize> >
+  ByteMap>
   Allocator32Compact;
 
+typedef SizeClassAllocator32<
+  0, kAddressSpaceSize,
+  /*kMetadataSize*/16,
+  CompactSizeClassMap,
+  kRegionSizeLog,
+  ByteMap,
+  NoOpMapUnmapCallback,
+  /*kLockFreeFreeList*/true>
+  Allocator32CompactLockFree;
+
 template <class SizeClassMap>
 void TestSizeClassMap() {
   typedef SizeClassMap SCMap;
@@ -72,6 +105,32 @@ TEST(SanitizerCommon, InternalSizeClassMap) {
   TestSizeClassMap<InternalSizeClassMap>();
 }
 
+TEST(SanitizerCommon, DefaultTableSizeClassMap) {
+  TestSizeClassMap<DefaultTableSizeClassMap>();
+}
+
+TEST(SanitizerCommon, CompactTableSizeClassMap) {
+  TestSizeClassMap<CompactTableSizeClassMap>();
+}
+
+TEST(SanitizerCommon, DenseSizeClassMap) {
+  TestSizeClassMap<DenseSizeClassMap>();
+}
+
+TEST(SanitizerCommon, DenseTableSizeClassMap) {
+  TestSizeClassMap<DenseTableSizeClassMap>();
+}
+
+// Above kMidSize the classes are at most 12.5% apart.
+TEST(SanitizerCommon, DenseSizeClassMapRounding) {
+  for (uptr c = DenseSizeClassMap::ClassID(256) + 1;
+       c < DenseSizeClassMap::kNumClasses; c++) {
+    uptr size = DenseSizeClassMap::Size(c);
+    uptr prev = DenseSizeClassMap::Size(c - 1);
+    EXPECT_LE((size - prev) * 8, prev);
+  }
+}
+
 template <class Allocator>
 void TestSizeClassAllocator() {
   Allocator *a = new Allocator;
@@ -147,12 +206,91 @@ TEST(SanitizerCommon, SizeClassAllocator64) {
 TEST(SanitizerCommon, SizeClassAllocator64Compact) {
   TestSizeClassAllocator<Allocator64Compact>();
 }
+
+TEST(SanitizerCommon, SizeClassAllocator64Sharded) {
+  TestSizeClassAllocator<Allocator64Sharded>();
+}
+
+TEST(SanitizerCommon, SizeClassAllocator64Table) {
+  TestSizeClassAllocator<Allocator64Table>();
+}
+
+TEST(SanitizerCommon, SizeClassAllocator64Dense) {
+  TestSizeClassAllocator<Allocator64Dense>();
+}
 #endif
 
 TEST(SanitizerCommon, SizeClassAllocator32Compact) {
   TestSizeClassAllocator<Allocator32Compact>();
 }
 
+TEST(SanitizerCommon, SizeClassAllocator32CompactLockFree) {
+  TestSizeClassAllocator<Allocator32CompactLockFree>();
+}
+
+template <class Allocator>
+struct ThreadedAllocatorParams {
+  Allocator *allocator;
+  uptr class_id;
+};
+
+template <class Allocator>
+void *ThreadedAllocatorWorker(void *arg) {
+  ThreadedAllocatorParams<Allocator> *p =
+      reinterpret_cast<ThreadedAllocatorParams<Allocator> *>(arg);
+  SizeClassAllocatorLocalCache<Allocator> cache;
+  memset(&cache, 0, sizeof(cache));
+  cache.Init(0);
+  static const uptr kNumAllocs = 1000;
+  void *allocated[kNumAllocs];
+  for (int it = 0; it < 100; it++) {
+    for (uptr i = 0; i < kNumAllocs; i++) {
+      allocated[i] = cache.Allocate(p->allocator, p->class_id);
+      *reinterpret_cast<uptr *>(allocated[i]) = i;
+    }
+    for (uptr i = 0; i < kNumAllocs; i++) {
+      CHECK_EQ(i, *reinterpret_cast<uptr *>(allocated[i]));
+      cache.Deallocate(p->allocator, p->class_id, allocated[i]);
+    }
+  }
+  cache.Drain(p->allocator);
+  return 0;
+}
+
+// Many threads refill and drain their caches for the same size classes.
+template <class Allocator>
+void TestSizeClassAllocatorThreaded() {
+  Allocator *a = new Allocator;
+  a->Init();
+  static const int kNumThreads = 8;
+  pthread_t t[kNumThreads];
+  ThreadedAllocatorParams<Allocator> params[kNumThreads];
+  for (int i = 0; i < kNumThreads; i++) {
+    params[i].allocator = a;
+    params[i].class_id = 1 + i % 3;
+    EXPECT_EQ(0, pthread_create(&t[i], 0, ThreadedAllocatorWorker<Allocator>,
+                                &params[i]));
+  }
+  for (int i = 0; i < kNumThreads; i++)
+    EXPECT_EQ(0, pthread_join(t[i], 0));
+  a->TestOnlyUnmap();
+  delete a;
+}
+
+TEST(SanitizerCommon, SizeClassAllocator32CompactThreaded) {
+  TestSizeClassAllocatorThreaded<Allocator32Compact>();
+}
+
+TEST(SanitizerCommon, SizeClassAllocator32CompactLockFreeThreaded) {
+  TestSizeClassAllocatorThreaded<Allocator32CompactLockFree>();
+}
+
+#if SANITIZER_WORDSIZE == 64
+TEST(SanitizerCommon, SizeClassAllocator64ShardedThreaded) {
+  TestSizeClassAllocatorThreaded<Allocator64Sharded>();
+}
+#endif
+
 template <class Allocator>
 void SizeClassAllocatorMetadataStress() {
   Allocator *a = new Allocator;
@@ -234,11 +372,14 @@ TEST(SanitizerCommon, SizeClassAllocator32CompactGetBlockBegin) {
 
 struct TestMapUnmapCallback {
   static int map_count, unmap_count;
+  static uptr released_bytes;
   void OnMap(uptr p, uptr size) const { map_count++; }
   void OnUnmap(uptr p, uptr size) const { unmap_count++; }
+  void OnRelease(uptr p, uptr size) const { released_bytes += size; }
 };
 int TestMapUnmapCallback::map_count;
 int TestMapUnmapCallback::unmap_count;
+uptr TestMapUnmapCallback::released_bytes;
 
 #if SANITIZER_WORDSIZE == 64
 TEST(SanitizerCommon, SizeClassAllocator64MapUnmapCallback) {
@@ -261,6 +402,30 @@ TEST(SanitizerCommon, SizeClassAllocator64MapUnmapCallback) {
   EXPECT_EQ(TestMapUnmapCallback::unmap_count, 1);  // The whole thing.
   delete a;
 }
+
+TEST(SanitizerCommon, SizeClassAllocator64ReleaseCallback) {
+  TestMapUnmapCallback::released_bytes = 0;
+  typedef SizeClassAllocator64<
+      kAllocatorSpace, kAllocatorSize, 16, DefaultSizeClassMap,
+      TestMapUnmapCallback> Allocator64WithCallBack;
+  Allocator64WithCallBack *a = new Allocator64WithCallBack;
+  a->Init();
+  SizeClassAllocatorLocalCache<Allocator64WithCallBack> cache;
+  memset(&cache, 0, sizeof(cache));
+  cache.Init(0);
+  uptr class_id = DefaultSizeClassMap::ClassID(5000);
+  std::vector<void *> allocated;
+  for (uptr i = 0; i < 1000; i++)
+    allocated.push_back(cache.Allocate(a, class_id));
+  for (uptr i = 0; i < allocated.size(); i++)
+    cache.Deallocate(a, class_id, allocated[i]);
+  cache.Drain(a);
+  a->ReleaseToOS();
+  EXPECT_GT(TestMapUnmapCallback::released_bytes, 0U);
+  EXPECT_EQ(TestMapUnmapCallback::released_bytes, a->TotalMemoryReleased());
+  a->TestOnlyUnmap();
+  delete a;
+}
 #endif
 
 TEST(SanitizerCommon, SizeClassAllocator32MapUnmapCallback) {
@@ -305,6 +470,90 @@ TEST(SanitizerCommon, LargeMmapAllocatorMapUnmapCallback) {
   EXPECT_EQ(TestMapUnmapCallback::unmap_count, 1);
 }
 
+TEST(SanitizerCommon, LargeMmapAllocatorCache) {
+  TestMapUnmapCallback::map_count = 0;
+  TestMapUnmapCallback::unmap_count = 0;
+  LargeMmapAllocator<TestMapUnmapCallback> a;
+  a.Init();
+  a.SetCacheLimits(8 << 20, -1);
+  AllocatorStats stats;
+  stats.Init();
+  const uptr kSize = 1 << 20;
+  char *x = (char *)a.Allocate(&stats, kSize, 1);
+  memset(x, 0xab, kSize);
+  a.Deallocate(&stats, x);
+  EXPECT_EQ(TestMapUnmapCallback::unmap_count, 0);
+  EXPECT_GT(a.TotalMemoryCached(), kSize);
+  EXPECT_FALSE(a.PointerIsMine(x));
+  // A slightly smaller allocation reuses the cached mapping, zeroed.
+  char *y = (char *)a.Allocate(&stats, kSize - 4096, 1);
+  EXPECT_EQ(x, y);
+  EXPECT_EQ(TestMapUnmapCallback::map_count, 1);
+  EXPECT_EQ(a.TotalMemoryCached(), 0U);
+  for (uptr i = 0; i < kSize - 4096; i++)
+    ASSERT_EQ(0, y[i]);
+  EXPECT_EQ(0U, *reinterpret_cast<uptr*>(a.GetMetaData(y)));
+  a.Deallocate(&stats, y);
+  // A much smaller allocation does not.
+  char *z = (char *)a.Allocate(&stats, kSize / 4, 1);
+  EXPECT_EQ(TestMapUnmapCallback::map_count, 2);
+  a.Deallocate(&stats, z);
+  // Mappings larger than the cap are never cached.
+  char *big = (char *)a.Allocate(&stats, 16 << 20, 1);
+  a.Deallocate(&stats, big);
+  EXPECT_EQ(TestMapUnmapCallback::unmap_count, 1);
+  uptr cached = a.TotalMemoryCached();
+  EXPECT_GT(cached, 0U);
+  EXPECT_LE(cached, (uptr)(8 << 20));
+  a.DrainCache(&stats);
+  EXPECT_EQ(a.TotalMemoryCached(), 0U);
+  EXPECT_EQ(TestMapUnmapCallback::unmap_count, 3);
+  EXPECT_EQ(TestMapUnmapCallback::map_count, 3);
+
+  // With a zero age limit, cached mappings expire right away.
+  a.SetCacheLimits(8 << 20, 0);
+  x = (char *)a.Allocate(&stats, kSize, 1);
+  a.Deallocate(&stats, x);
+  y = (char *)a.Allocate(&stats, kSize, 1);
+  EXPECT_EQ(TestMapUnmapCallback::map_count, 5);
+  a.Deallocate(&stats, y);
+  a.DrainCache(&stats);
+  EXPECT_EQ(TestMapUnmapCallback::unmap_count, 5);
+}
+
+#if SANITIZER_LINUX
+TEST(SanitizerCommon, LargeMmapAllocatorResize) {
+  TestMapUnmapCallback::map_count = 0;
+  TestMapUnmapCallback::unmap_count = 0;
+  LargeMmapAllocator<TestMapUnmapCallback> a;
+  a.Init();
+  AllocatorStats stats;
+  stats.Init();
+  const uptr kSize = 1 << 20;
+  char *x = (char *)a.Allocate(&stats, kSize, 1);
+  memset(x, 0xab, kSize);
+  // Shrinking and growing within the mapping keeps the chunk in place.
+  EXPECT_EQ(x, a.Resize(&stats, x, kSize / 2));
+  EXPECT_EQ(x, a.Resize(&stats, x, kSize));
+  EXPECT_EQ(TestMapUnmapCallback::map_count, 1);
+  // Growing further remaps the chunk without losing its contents.
+  char *y = (char *)a.Resize(&stats, x, kSize * 16);
+  ASSERT_NE((char*)0, y);
+  EXPECT_GE(TestMapUnmapCallback::map_count, 2);
+  EXPECT_EQ(y, a.GetBlockBegin(y + kSize * 16 - 1));
+  EXPECT_EQ(RoundUpTo(kSize * 16, GetPageSizeCached()),
+            a.GetActuallyAllocatedSize(y));
+  for (uptr i = 0; i < kSize; i++)
+    ASSERT_EQ((char)0xab, y[i]);
+  memset(y, 0xcd, kSize * 16);
+  if (x != y)
+    EXPECT_FALSE(a.PointerIsMine(x));
+  a.Deallocate(&stats, y);
+  EXPECT_EQ(0U, a.TotalMemoryUsed());
+  EXPECT_EQ(stats.Get(AllocatorStatMmapped), stats.Get(AllocatorStatUnmapped));
+}
+#endif
+
 template<class Allocator>
 void FailInAssertionOnOOM() {
   Allocator a;
@@ -474,6 +723,85 @@ TEST(SanitizerCommon, CombinedAllocator32Compact) {
       SizeClassAllocatorLocalCache<Allocator32Compact> > ();
 }
 
+static bool IsZero(void *p, uptr size) {
+  for (uptr i = 0; i < size; i++)
+    if (reinterpret_cast<u8*>(p)[i])
+      return false;
+  return true;
+}
+
+template
+<class PrimaryAllocator, class SecondaryAllocator, class AllocatorCache>
+void TestCombinedAllocatorKnownZero() {
+  typedef
+      CombinedAllocator<PrimaryAllocator, AllocatorCache, SecondaryAllocator>
+      Allocator;
+  Allocator *a = new Allocator;
+  a->Init();
+
+  AllocatorCache cache;
+  memset(&cache, 0, sizeof(cache));
+  a->InitCache(&cache);
+
+  const uptr kNumAllocs = 20000;
+  const uptr kNumIter = 4;
+  for (uptr iter = 0; iter < kNumIter; iter++) {
+    std::vector<void*> allocated;
+    uptr n_zero = 0;
+    for (uptr i = 0; i < kNumAllocs; i++) {
+      uptr size = (i % 3000) + 1;
+      if ((i % 1024) == 0)
+        size = 1 << (10 + (i % 11));
+      bool zero = false;
+      void *x;
+      // Alternate the calloc path with the one that reports fresh chunks.
+      if (i % 2) {
+        x = a->Allocate(&cache, size, 1, true);
+        zero = true;
+      } else {
+        x = a->AllocateCheckZero(&cache, size, 1, &zero);
+      }
+      if (zero) {
+        CHECK(IsZero(x, size));
+        n_zero++;
+      }
+      memset(x, 0xab, size);
+      allocated.push_back(x);
+    }
+    // Only the separately allocated transfer batches were freed before the
+    // first round.
+    if (iter == 0)
+      EXPECT_GT(n_zero, kNumAllocs * 9 / 10);
+
+    for (uptr i = 0; i < kNumAllocs; i++) {
+      uptr j = (i * 7919) % kNumAllocs;
+      a->Deallocate(&cache, allocated[j]);
+    }
+    if (iter % 2)
+      a->SwallowCache(&cache);
+  }
+  // Failed allocations clear the flag too.
+  bool zero = true;
+  EXPECT_EQ(a->AllocateCheckZero(&cache, -1, 1024, &zero), (void*)0);
+  EXPECT_FALSE(zero);
+  a->DestroyCache(&cache);
+  a->TestOnlyUnmap();
+}
+
+#if SANITIZER_WORDSIZE == 64
+TEST(SanitizerCommon, CombinedAllocator64KnownZero) {
+  TestCombinedAllocatorKnownZero<Allocator64,
+      LargeMmapAllocator<>,
+      SizeClassAllocatorLocalCache<Allocator64> > ();
+}
+#endif
+
+TEST(SanitizerCommon, CombinedAllocator32CompactKnownZero) {
+  TestCombinedAllocatorKnownZero<Allocator32Compact,
+      LargeMmapAllocator<>,
+      SizeClassAllocatorLocalCache<Allocator32Compact> > ();
+}
+
 template <class AllocatorCache>
 void TestSizeClassAllocatorLocalCache() {
   AllocatorCache cache;
@@ -526,6 +854,180 @@ TEST(SanitizerCommon, SizeClassAllocator32CompactLocalCache) {
 }
 
 #if SANITIZER_WORDSIZE == 64
+template <class Allocator>
+void TestSizeClassAllocatorReleaseToOS() {
+  Allocator *a = new Allocator;
+  a->Init();
+  SizeClassAllocatorLocalCache<Allocator> cache;
+  memset(&cache, 0, sizeof(cache));
+  cache.Init(0);
+
+  static const uptr sizes[] = {16, 100, 1000, 5000, 40000};
+  std::vector<std::pair<uptr, void *> > allocated;
+  for (uptr s = 0; s < ARRAY_SIZE(sizes); s++) {
+    uptr class_id = Allocator::SizeClassMapT::ClassID(sizes[s]);
+    for (uptr i = 0; i < (1 << 22) / sizes[s]; i++) {
+      char *x = (char*)cache.Allocate(a, class_id);
+      memset(x, 0xab, sizes[s]);
+      allocated.push_back(std::make_pair(class_id, (void*)x));
+    }
+  }
+  EXPECT_EQ(0U, a->TotalMemoryReleased());
+  for (uptr i = 0; i < allocated.size(); i++)
+    cache.Deallocate(a, allocated[i].first, allocated[i].second);
+  cache.Drain(a);
+  uptr total_used = a->TotalMemoryUsed();
+  a->ReleaseToOS();
+  EXPECT_GT(a->TotalMemoryReleased(), (uptr)(1 << 22) * ARRAY_SIZE(sizes) / 2);
+
+  // All the chunks must still be usable and the allocator must not grow.
+  for (uptr i = 0; i < allocated.size(); i++) {
+    char *x = (char*)cache.Allocate(a, allocated[i].first);
+    x[0] = 1;
+    allocated[i].second = x;
+  }
+  EXPECT_EQ(total_used, a->TotalMemoryUsed());
+  for (uptr i = 0; i < allocated.size(); i++)
+    cache.Deallocate(a, allocated[i].first, allocated[i].second);
+  cache.Drain(a);
+
+  a->TestOnlyUnmap();
+  delete a;
+}
+
+TEST(SanitizerCommon, SizeClassAllocator64Numa) {
+  TestSizeClassAllocator<Allocator64Numa>();
+}
+
+// In NUMA mode the chunks come from the NodeRegion of the current node.
+TEST(SanitizerCommon, SizeClassAllocator64NumaMode) {
+  typedef SizeClassAllocatorLocalCache<Allocator64Numa> NumaCache;
+  const uptr kNodeRegionSize =
+      kAllocatorSize / Allocator64Numa::kNumClassesRounded / kNumaNodes;
+  Allocator64Numa *a = new Allocator64Numa;
+  a->Init();
+  a->SetNumaMode(true);
+  NumaCache cache;
+  memset(&cache, 0, sizeof(cache));
+  cache.Init(0);
+  const uptr kNumAllocs = 10000;
+  const uptr class_id = 7;
+  std::vector<void *> allocated;
+  uptr saved_total = 0;
+  for (int i = 0; i < 3; i++) {
+    uptr node = GetCurrentNumaNode() % kNumaNodes;
+    for (uptr j = 0; j < kNumAllocs; j++) {
+      void *x = cache.Allocate(a, class_id);
+      allocated.push_back(x);
+      EXPECT_EQ(x, a->GetBlockBegin(x));
+      EXPECT_EQ(class_id, a->GetSizeClass(x));
+    }
+    // The thread may have moved to another node meanwhile.
+    if (node == GetCurrentNumaNode() % kNumaNodes)
+      EXPECT_EQ(node, ((uptr)allocated.back() / kNodeRegionSize) % kNumaNodes);
+    for (uptr j = 0; j < kNumAllocs; j++)
+      cache.Deallocate(a, class_id, allocated[j]);
+    cache.Drain(a);
+    allocated.clear();
+    uptr total = a->TotalMemoryUsed();
+    if (i)
+      EXPECT_EQ(saved_total, total);
+    saved_total = total;
+  }
+  a->ReleaseToOS();
+  a->TestOnlyUnmap();
+  delete a;
+}
+
+TEST(SanitizerCommon, SizeClassAllocator64ReleaseToOS) {
+  TestSizeClassAllocatorReleaseToOS<Allocator64>();
+}
+
+TEST(SanitizerCommon, SizeClassAllocator64ShardedReleaseToOS) {
+  TestSizeClassAllocatorReleaseToOS<Allocator64Sharded>();
+}
+
+// Chunks drained by one cache must be reused by another cache even if the two
+// caches are mapped to different free list shards.
+TEST(SanitizerCommon, SizeClassAllocator64ShardedStealing) {
+  typedef SizeClassAllocatorLocalCache<Allocator64Sharded> ShardedCache;
+  Allocator64Sharded *a = new Allocator64Sharded;
+  a->Init();
+  static const int kNumCaches = 16;
+  ShardedCache *caches = new ShardedCache[kNumCaches];
+  memset(caches, 0, sizeof(ShardedCache) * kNumCaches);
+  const uptr kNumAllocs = 10000;
+  const uptr class_id = 7;
+  std::vector<void *> allocated;
+  uptr saved_total = 0;
+  for (int i = 0; i < kNumCaches; i++) {
+    ShardedCache *cache = &caches[i];
+    cache->Init(0);
+    for (uptr j = 0; j < kNumAllocs; j++)
+      allocated.push_back(cache->Allocate(a, class_id));
+    std::set<void *> unique(allocated.begin(), allocated.end());
+    EXPECT_EQ(allocated.size(), unique.size());
+    for (uptr j = 0; j < kNumAllocs; j++)
+      cache->Deallocate(a, class_id, allocated[j]);
+    cache->Drain(a);
+    allocated.clear();
+    uptr total = a->TotalMemoryUsed();
+    if (i)
+      EXPECT_EQ(saved_total, total);
+    saved_total = total;
+  }
+  delete[] caches;
+  a->TestOnlyUnmap();
+  delete a;
+}
+
+TEST(SanitizerCommon, SizeClassAllocatorLocalCacheAdaptiveMaxCount) {
+  typedef SizeClassAllocatorLocalCache<Allocator64> Cache;
+  typedef Allocator64::SizeClassMapT SCMap;
+  Allocator64 *a = new Allocator64;
+  a->Init();
+  Cache *cache = new Cache;
+  memset(cache, 0, sizeof(*cache));
+  cache->Init(0);
+
+  const uptr hot_class = 10;
+  std::vector<void *> allocated;
+  for (uptr i = 0; i < 100 * SCMap::MaxCached(hot_class); i++)
+    allocated.push_back(cache->Allocate(a, hot_class));
+  // Refills of the hot class have grown its cache to the maximum.
+  EXPECT_EQ(2 * SCMap::MaxCached(hot_class),
+            cache->per_class_[hot_class].max_count);
+  // Idle classes are still at the minimum.
+  EXPECT_EQ(SCMap::MaxCached(hot_class + 1),
+            cache->per_class_[hot_class + 1].max_count);
+
+  // Grow many classes: the total growth must stay within the budget.
+  for (uptr class_id = 1; class_id < 40; class_id++)
+    for (uptr i = 0; i < 10 * SCMap::MaxCached(class_id); i++)
+      allocated.push_back(cache->Allocate(a, class_id));
+  uptr extra = 0;
+  for (uptr class_id = 1; class_id < Cache::kNumClasses; class_id++) {
+    uptr max_count = cache->per_class_[class_id].max_count;
+    EXPECT_GE(max_count, SCMap::MaxCached(class_id));
+    EXPECT_LE(max_count, 2 * SCMap::MaxCached(class_id));
+    extra += (max_count - SCMap::MaxCached(class_id)) * SCMap::Size(class_id);
+  }
+  EXPECT_EQ(extra, cache->extra_bytes_cached_);
+  uptr budget = Cache::kMaxExtraBytesCached;
+  EXPECT_LE(extra, budget);
+
+  for (uptr i = 0; i < allocated.size(); i++)
+    cache->Deallocate(a, a->GetSizeClass(allocated[i]), allocated[i]);
+  cache->Drain(a);
+  EXPECT_EQ(0U, cache->extra_bytes_cached_);
+  EXPECT_EQ(SCMap::MaxCached(hot_class),
+            cache->per_class_[hot_class].max_count);
+
+  delete cache;
+  a->TestOnlyUnmap();
+  delete a;
+}
+
 typedef SizeClassAllocatorLocalCache<Allocator64> AllocatorCache;
 static AllocatorCache static_allocator_cache;
 
@@ -621,6 +1123,24 @@ TEST(Allocator, InternalAllocFailure) {
                "Unexpected mmap in InternalAllocator!");
 }
 
+static LowLevelAllocator low_level_allocator;  // Linker initialized.
+
+TEST(Allocator, LowLevelAllocator) {
+  char *prev = (char*)low_level_allocator.Allocate(24);
+  internal_memset(prev, 1, 24);
+  // A large request must not throw away the rest of the current chunk.
+  char *large = (char*)low_level_allocator.Allocate(1 << 20);
+  internal_memset(large, 2, 1 << 20);
+  char *next = (char*)low_level_allocator.Allocate(24);
+  EXPECT_EQ(prev + 24, next);
+  EXPECT_EQ(1, prev[23]);
+  for (int i = 0; i < 10000; i++) {
+    char *p = (char*)low_level_allocator.Allocate(i % 100 + 1);
+    EXPECT_EQ(0U, (uptr)p % 8);
+    internal_memset(p, 3, i % 100 + 1);
+  }
+}
+
 TEST(Allocator, ScopedBuffer) {
   const int kSize = 512;
   {
@@ -640,7 +1160,7 @@ void IterationTestCallback(uptr chunk, void *arg) {
 }
 
 template <class Allocator>
-void TestSizeClassAllocatorIteration() {
+void TestSizeClassAllocatorIteration(bool with_region_locks = false) {
   Allocator *a = new Allocator;
   a->Init();
   SizeClassAllocatorLocalCache<Allocator> cache;
@@ -667,9 +1187,13 @@ void TestSizeClassAllocatorIteration() {
   }
 
   std::set<uptr> reported_chunks;
-  a->ForceLock();
-  a->ForEachChunk(IterationTestCallback, &reported_chunks);
-  a->ForceUnlock();
+  if (with_region_locks) {
+    a->ForEachChunkWithRegionLocks(IterationTestCallback, &reported_chunks);
+  } else {
+    a->ForceLock();
+    a->ForEachChunk(IterationTestCallback, &reported_chunks);
+    a->ForceUnlock();
+  }
 
   for (uptr i = 0; i < allocated.size(); i++) {
     // Don't use EXPECT_NE. Reporting the first mismatch is enough.
@@ -685,12 +1209,71 @@ void TestSizeClassAllocatorIteration() {
 TEST(SanitizerCommon, SizeClassAllocator64Iteration) {
   TestSizeClassAllocatorIteration<Allocator64>();
 }
+
+TEST(SanitizerCommon, SizeClassAllocator64IterationWithRegionLocks) {
+  TestSizeClassAllocatorIteration<Allocator64>(true);
+}
+
+// The chunks which went back to the free lists are not visited.
+TEST(SanitizerCommon, SizeClassAllocator64IterationSkipsFreeChunks) {
+  Allocator64 *a = new Allocator64;
+  a->Init();
+  SizeClassAllocatorLocalCache<Allocator64> cache;
+  memset(&cache, 0, sizeof(cache));
+  cache.Init(0);
+
+  static const uptr sizes[] = {1000, 4000, 10000, 100000};
+  std::vector<std::pair<uptr, void *> > allocated;
+  for (uptr s = 0; s < ARRAY_SIZE(sizes); s++) {
+    uptr class_id = Allocator64::SizeClassMapT::ClassID(sizes[s]);
+    // The separate TransferBatches are chunks of another size class, which
+    // stay out of the free lists.
+    if (Allocator64::SizeClassMapT::SizeClassRequiresSeparateTransferBatch(
+            class_id))
+      continue;
+    uptr n_iter = std::max((uptr)100, 1000000 / sizes[s]);
+    for (uptr j = 0; j < n_iter; j++)
+      allocated.push_back(std::make_pair(class_id,
+                                         cache.Allocate(a, class_id)));
+  }
+  std::set<uptr> live_chunks;
+  for (uptr i = 0; i < allocated.size(); i++) {
+    if (i % 3 == 0)
+      live_chunks.insert(reinterpret_cast<uptr>(allocated[i].second));
+    else
+      cache.Deallocate(a, allocated[i].first, allocated[i].second);
+  }
+  cache.Drain(a);
+
+  std::set<uptr> reported_chunks;
+  a->ForceLock();
+  a->ForEachChunk(IterationTestCallback, &reported_chunks);
+  a->ForceUnlock();
+  EXPECT_EQ(live_chunks, reported_chunks);
+
+  for (std::set<uptr>::iterator it = live_chunks.begin();
+       it != live_chunks.end(); ++it) {
+    void *p = reinterpret_cast<void *>(*it);
+    cache.Deallocate(a, a->GetSizeClass(p), p);
+  }
+  cache.Drain(a);
+  reported_chunks.clear();
+  a->ForEachChunkWithRegionLocks(IterationTestCallback, &reported_chunks);
+  EXPECT_TRUE(reported_chunks.empty());
+
+  a->TestOnlyUnmap();
+  delete a;
+}
 #endif
 
 TEST(SanitizerCommon, SizeClassAllocator32Iteration) {
   TestSizeClassAllocatorIteration<Allocator32Compact>();
 }
 
+TEST(SanitizerCommon, SizeClassAllocator32IterationWithRegionLocks) {
+  TestSizeClassAllocatorIteration<Allocator32Compact>(true);
+}
+
 TEST(SanitizerCommon, LargeMmapAllocatorIteration) {
   LargeMmapAllocator<> a;
   a.Init();
@@ -749,8 +1332,17 @@ TEST(SanitizerCommon, LargeMmapAllocatorBlockBegin) {
     EXPECT_EQ((void *)0, a.GetBlockBeginFastLocked(p));
   }
 
+  uptr range_begin, range_end;
+  a.GetAddressRangeLocked(&range_begin, &range_end);
+  for (uptr i = 0; i < kNumAllocs; i++) {
+    EXPECT_LE(range_begin, (uptr)allocated[i]);
+    EXPECT_GE(range_end, (uptr)allocated[i] + size);
+  }
+
   for (uptr i = 0; i < kNumAllocs; i++)
     a.Deallocate(&stats, allocated[i]);
+  a.GetAddressRangeLocked(&range_begin, &range_end);
+  EXPECT_EQ(range_begin, range_end);
 }
 
 
@@ -781,6 +1373,92 @@ TEST(SanitizerCommon, SizeClassAllocator64PopulateFreeListOOM) {
   a->TestOnlyUnmap();
   delete a;
 }
+
+// A full NodeRegion makes the allocator use the next one.
+TEST(SanitizerCommon, SizeClassAllocator64NumaOverflow) {
+  typedef SizeClassMap<63, 128, 16> SpecialSizeClassMap;
+  typedef SizeClassAllocator64<kAllocatorSpace, 2 * kAllocatorSize, 0,
+                               SpecialSizeClassMap, NoOpMapUnmapCallback,
+                               /*kNumFreeListShards*/1, /*kNumNodes*/2>
+      SpecialAllocator64;
+  const uptr kNodeRegionSize =
+      kAllocatorSize / SpecialSizeClassMap::kNumClassesRounded;
+  SpecialAllocator64 *a = new SpecialAllocator64;
+  a->Init();
+  SizeClassAllocatorLocalCache<SpecialAllocator64> cache;
+  memset(&cache, 0, sizeof(cache));
+  cache.Init(0);
+
+  // Each NodeRegion has room for one chunk.
+  const uptr kClassID = 107;
+  uptr p0 = (uptr)cache.Allocate(a, kClassID);
+  uptr p1 = (uptr)cache.Allocate(a, kClassID);
+  EXPECT_EQ(0U, (p0 / kNodeRegionSize) % 2);
+  EXPECT_EQ(1U, (p1 / kNodeRegionSize) % 2);
+  EXPECT_DEATH(cache.Allocate(a, kClassID), "The process has exhausted");
+  a->TestOnlyUnmap();
+  delete a;
+}
 #endif
 
+TEST(SanitizerCommon, TwoLevelByteMap) {
+  const u64 kSize1 = 1 << 6, kSize2 = 1 << 12;
+  const u64 n = kSize1 * kSize2;
+  TwoLevelByteMap<kSize1, kSize2> m;
+  m.TestOnlyInit();
+  for (u64 i = 0; i < n; i += 7) {
+    m.set(i, (i % 100) + 1);
+  }
+  for (u64 j = 0; j < n; j++) {
+    if (j % 7)
+      EXPECT_EQ(m[j], 0);
+    else
+      EXPECT_EQ(m[j], (j % 100) + 1);
+  }
+
+  m.TestOnlyUnmap();
+}
+
+typedef TwoLevelByteMap<1 << 8, 1 << 13, TestMapUnmapCallback> TestByteMap;
+
+struct TestByteMapParam {
+  TestByteMap *m;
+  size_t shard;
+  size_t num_shards;
+};
+
+void *TwoLevelByteMapUserThread(void *param) {
+  TestByteMapParam *p = (TestByteMapParam*)param;
+  for (size_t i = p->shard; i < p->m->size(); i += p->num_shards) {
+    size_t val = (i % 100) + 1;
+    p->m->set(i, val);
+    EXPECT_EQ((*p->m)[i], val);
+  }
+  return 0;
+}
+
+TEST(SanitizerCommon, ThreadedTwoLevelByteMap) {
+  TestByteMap m;
+  m.TestOnlyInit();
+  TestMapUnmapCallback::map_count = 0;
+  TestMapUnmapCallback::unmap_count = 0;
+  static const int kNumThreads = 4;
+  pthread_t t[kNumThreads];
+  TestByteMapParam p[kNumThreads];
+  for (int i = 0; i < kNumThreads; i++) {
+    p[i].m = &m;
+    p[i].shard = i;
+    p[i].num_shards = kNumThreads;
+    pthread_create(&t[i], 0, TwoLevelByteMapUserThread, &p[i]);
+  }
+  for (int i = 0; i < kNumThreads; i++) {
+    pthread_join(t[i], 0);
+  }
+  EXPECT_EQ((uptr)TestMapUnmapCallback::map_count, m.size1());
+  EXPECT_EQ((uptr)TestMapUnmapCallback::unmap_count, 0UL);
+  m.TestOnlyUnmap();
+  EXPECT_EQ((uptr)TestMapUnmapCallback::map_count, m.size1());
+  EXPECT_EQ((uptr)TestMapUnmapCallback::unmap_count, m.size1());
+}
+
 #endif  // #if TSAN_DEBUG==0
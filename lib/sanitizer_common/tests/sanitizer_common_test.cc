@@ -80,6 +80,23 @@ TEST(SanitizerCommon, MmapAlignedOrDie) {
   }
 }
 
+#if !SANITIZER_WINDOWS
+TEST(SanitizerCommon, TryMmapFixedNoReserve) {
+  uptr PageSize = GetPageSizeCached();
+  uptr size = 16 * PageSize;
+  // Find a free range, then release it.
+  uptr addr = (uptr)MmapOrDie(size, "TryMmapFixedNoReserveTest");
+  UnmapOrDie((void*)addr, size);
+  ASSERT_TRUE(TryMmapFixedNoReserve(addr, size));
+  internal_memset((void*)addr, 1, size);
+  // Neither the same range nor a partially overlapping one are available.
+  EXPECT_FALSE(TryMmapFixedNoReserve(addr, size));
+  EXPECT_FALSE(TryMmapFixedNoReserve(addr + size / 2, size));
+  EXPECT_EQ(1, ((char*)addr)[size / 2]);
+  UnmapOrDie((void*)addr, size);
+}
+#endif
+
 #if SANITIZER_LINUX
 TEST(SanitizerCommon, SanitizerSetThreadName) {
   const char *names[] = {
@@ -113,6 +130,23 @@ TEST(SanitizerCommon, InternalMmapVector) {
   }
 }
 
+TEST(SanitizerCommon, InternalMmapVectorGrowAndRelease) {
+  InternalMmapVector<u32> vector(1);
+  EXPECT_EQ(GetPageSizeCached() / sizeof(u32), vector.capacity());
+  const u32 kSize = 1 << 20;
+  for (u32 i = 0; i < kSize; i++)
+    vector.push_back(i);
+  for (u32 i = 0; i < kSize; i += 1000)
+    EXPECT_EQ(i, vector[i]);
+  uptr capacity = vector.capacity();
+  EXPECT_GE(capacity, kSize);
+  vector.clear_and_release();
+  EXPECT_EQ(0U, vector.size());
+  EXPECT_EQ(capacity, vector.capacity());
+  vector.push_back(42);
+  EXPECT_EQ(42U, vector[0]);
+}
+
 void TestThreadInfo(bool main) {
   uptr stk_addr = 0;
   uptr stk_size = 0;
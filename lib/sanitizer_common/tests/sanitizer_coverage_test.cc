@@ -0,0 +1,60 @@
+//===-- sanitizer_coverage_test.cc ----------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of ThreadSanitizer/AddressSanitizer runtime.
+//
+//===----------------------------------------------------------------------===//
+#include "sanitizer_common/sanitizer_coverage.h"
+#include "gtest/gtest.h"
+
+namespace __sanitizer {
+
+TEST(SanitizerCommon, CoverageCounters) {
+  static u32 guards1[10];
+  static u32 guards2[5];
+  u8 *counters = 0;
+  uptr beg = GetCoverageCounters(&counters);
+  if (beg == 0)
+    beg = 1;
+  __sanitizer_cov_trace_pc_guard_init(guards1, guards1 + 10);
+  __sanitizer_cov_trace_pc_guard_init(guards2, guards2 + 5);
+  // A repeated initialization keeps the numbering.
+  __sanitizer_cov_trace_pc_guard_init(guards1, guards1 + 10);
+  EXPECT_EQ(beg + 15, GetCoverageCounters(&counters));
+  ASSERT_NE((u8 *)0, counters);
+  // The modules get consecutive indices.
+  for (uptr i = 0; i < 10; i++)
+    EXPECT_EQ(beg + i, guards1[i]);
+  for (uptr i = 0; i < 5; i++)
+    EXPECT_EQ(beg + 10 + i, guards2[i]);
+
+  ResetCoverage();
+  EXPECT_EQ(0U, GetCoverageCount());
+  __sanitizer_cov_trace_pc_guard(&guards1[3]);
+  __sanitizer_cov_trace_pc_guard(&guards1[3]);
+  __sanitizer_cov_trace_pc_guard(&guards2[4]);
+  EXPECT_EQ(2, counters[guards1[3]]);
+  EXPECT_EQ(1, counters[guards2[4]]);
+  EXPECT_EQ(0, counters[guards1[4]]);
+  EXPECT_EQ(2U, GetCoverageCount());
+  // The counters saturate.
+  for (int i = 0; i < 300; i++)
+    __sanitizer_cov_trace_pc_guard(&guards2[0]);
+  EXPECT_EQ(255, counters[guards2[0]]);
+  EXPECT_EQ(3U, GetCoverageCount());
+  // Guards that are off are not counted.
+  u32 off = 0;
+  __sanitizer_cov_trace_pc_guard(&off);
+  EXPECT_EQ(3U, GetCoverageCount());
+  ResetCoverage();
+  EXPECT_EQ(0U, GetCoverageCount());
+  EXPECT_EQ(0, counters[guards2[0]]);
+}
+
+}  // namespace __sanitizer
@@ -83,4 +83,53 @@ TEST(SanitizerCommon, MultipleFlags) {
   TestTwoFlags("flag2=qxx:flag1=yes", true, "qxx");
 }
 
+TEST(SanitizerCommon, FlagParser) {
+  bool flag1 = false, flag1_prefix = false, flag1_alias = false;
+  int flag2 = 0;
+  const char *flag3 = "";
+  FlagParser parser;
+  parser.AddFlag(&flag1, "flag1");
+  parser.AddFlag(&flag1_prefix, "flag1_prefix");
+  parser.AddFlag(&flag2, "flag2");
+  parser.AddFlag(&flag3, "flag3");
+  parser.AddFlag(&flag1_alias, "flag1");
+  // Names are matched exactly, the first occurrence wins.
+  parser.ParseString("flag1_prefix=1 --flag2=7:flag3='a b:c' flag2=8\n"
+                     "x=flag1 flag1=1 flag1=0 unknown=2");
+  EXPECT_TRUE(flag1);
+  EXPECT_TRUE(flag1_prefix);
+  EXPECT_TRUE(flag1_alias);
+  EXPECT_EQ(7, flag2);
+  EXPECT_EQ(0, internal_strcmp(flag3, "a b:c"));
+  // In the next string the flags may be given again.
+  parser.ParseString("flag1=no -flag2=-3 flag3=\"d\"");
+  EXPECT_FALSE(flag1);
+  EXPECT_FALSE(flag1_alias);
+  EXPECT_EQ(-3, flag2);
+  EXPECT_EQ(0, internal_strcmp(flag3, "d"));
+  parser.ParseString(0);
+  parser.ParseString("");
+  parser.ParseString(" :: flag3=");
+  EXPECT_EQ(0, internal_strcmp(flag3, ""));
+}
+
+TEST(SanitizerCommon, FlagParserManyFlags) {
+  static const int kNumFlags = 100;
+  static char names[kNumFlags][16];
+  int flags[kNumFlags];
+  FlagParser parser;
+  for (int i = 0; i < kNumFlags; i++) {
+    internal_snprintf(names[i], sizeof(names[i]), "flag_%d", i);
+    flags[i] = -1;
+    parser.AddFlag(&flags[i], names[i]);
+  }
+  char str[2048];
+  char *pos = str;
+  for (int i = 0; i < kNumFlags; i += 2)
+    pos += internal_snprintf(pos, str + sizeof(str) - pos, "flag_%d=%d:", i, i);
+  parser.ParseString(str);
+  for (int i = 0; i < kNumFlags; i++)
+    EXPECT_EQ(i % 2 ? -1 : i, flags[i]);
+}
+
 }  // namespace __sanitizer
@@ -74,4 +74,16 @@ TEST(SanitizerIoctl, Fixup) {
   EXPECT_EQ(EVIOCGKEY(0), desc->req);
 }
 
+TEST(SanitizerIoctl, Lookup) {
+  for (unsigned i = 0; i < ioctl_table_size; ++i)
+    EXPECT_EQ(ioctl_table + i, ioctl_table_lookup(ioctl_table[i].req));
+  EXPECT_EQ(0, ioctl_table_lookup(0));
+  EXPECT_EQ(0, ioctl_table_lookup(0xdeadbeef));
+
+  const ioctl_desc *desc = ioctl_lookup(FIONBIO);
+  ASSERT_NE((void *)0, desc);
+  EXPECT_EQ((unsigned)FIONBIO, desc->req);
+  EXPECT_EQ(ioctl_desc::READ, desc->type);
+}
+
 #endif // SANITIZER_LINUX
@@ -30,6 +30,56 @@ TEST(SanitizerCommon, InternalMemmoveRegression) {
   EXPECT_EQ(dest[4], src[4]);
 }
 
+TEST(SanitizerCommon, InternalMemset) {
+  char buf[64];
+  for (size_t beg = 0; beg < 16; beg++) {
+    for (size_t size = 0; beg + size <= sizeof(buf); size++) {
+      memset(buf, 'x', sizeof(buf));
+      __sanitizer::internal_memset(buf + beg, 0xAB, size);
+      for (size_t i = 0; i < sizeof(buf); i++)
+        EXPECT_EQ(beg <= i && i < beg + size ? '\xAB' : 'x', buf[i]);
+    }
+  }
+}
+
+TEST(SanitizerCommon, InternalMemcpy) {
+  char src[80], dst[80];
+  for (size_t i = 0; i < sizeof(src); i++)
+    src[i] = (char)(i * 7 + 1);
+  for (size_t src_beg = 0; src_beg < 16; src_beg++) {
+    for (size_t beg = 0; beg < 16; beg++) {
+      for (size_t size = 0; beg + size <= 64; size++) {
+        memset(dst, 'x', sizeof(dst));
+        __sanitizer::internal_memcpy(dst + beg, src + src_beg, size);
+        for (size_t i = 0; i < sizeof(dst); i++)
+          EXPECT_EQ(beg <= i && i < beg + size ? src[src_beg + i - beg] : 'x',
+                    dst[i]);
+      }
+    }
+  }
+}
+
+TEST(SanitizerCommon, InternalMemcmp) {
+  char a[80], b[80];
+  for (size_t i = 0; i < sizeof(a); i++)
+    a[i] = (char)i;
+  for (size_t a_beg = 0; a_beg < 16; a_beg++) {
+    for (size_t b_beg = 0; b_beg < 16; b_beg++) {
+      size_t size = 64;
+      memcpy(b + b_beg, a + a_beg, size);
+      EXPECT_EQ(0, __sanitizer::internal_memcmp(a + a_beg, b + b_beg, size));
+      for (size_t pos = 0; pos < size; pos++) {
+        b[b_beg + pos]++;
+        EXPECT_EQ(-1,
+                  __sanitizer::internal_memcmp(a + a_beg, b + b_beg, size));
+        EXPECT_EQ(1, __sanitizer::internal_memcmp(b + b_beg, a + a_beg, size));
+        EXPECT_EQ(0, __sanitizer::internal_memcmp(a + a_beg, b + b_beg, pos));
+        b[b_beg + pos]--;
+      }
+    }
+  }
+}
+
 TEST(SanitizerCommon, mem_is_zero) {
   size_t size = 128;
   char *x = new char[size];
@@ -50,6 +100,47 @@ TEST(SanitizerCommon, mem_is_zero) {
   delete [] x;
 }
 
+TEST(SanitizerCommon, mem_is_zero_large) {
+  size_t size = 4096 + 64;
+  char *x = new char[size];
+  memset(x, 0, size);
+  for (size_t beg = 0; beg < 32; beg += 3) {
+    for (size_t end = size - 32; end <= size; end += 5) {
+      EXPECT_TRUE(__sanitizer::mem_is_zero(x + beg, end - beg));
+      for (size_t pos = beg; pos < end; pos += 61) {
+        x[pos] = 1;
+        EXPECT_FALSE(__sanitizer::mem_is_zero(x + beg, end - beg));
+        x[pos] = 0;
+      }
+      x[end - 1] = 1;
+      EXPECT_FALSE(__sanitizer::mem_is_zero(x + beg, end - beg));
+      x[end - 1] = 0;
+      if (end < size) {
+        x[end] = 1;
+        EXPECT_TRUE(__sanitizer::mem_is_zero(x + beg, end - beg));
+        x[end] = 0;
+      }
+    }
+  }
+  delete [] x;
+}
+
+#if SANITIZER_LINUX
+TEST(SanitizerCommon, InternalMremapFixed) {
+  uptr page_size = GetPageSizeCached();
+  char *from = (char*)MmapOrDie(2 * page_size, "InternalMremapFixed");
+  char *to = (char*)MmapOrDie(2 * page_size, "InternalMremapFixed");
+  from[0] = 1;
+  from[page_size] = 2;
+  uptr res = internal_mremap_fixed(from, 2 * page_size, to);
+  ASSERT_FALSE(internal_iserror(res));
+  EXPECT_EQ((uptr)to, res);
+  EXPECT_EQ(1, to[0]);
+  EXPECT_EQ(2, to[page_size]);
+  UnmapOrDie(to, 2 * page_size);
+}
+#endif
+
 struct stat_and_more {
   struct stat st;
   unsigned char z;
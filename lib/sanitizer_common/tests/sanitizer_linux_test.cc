@@ -22,6 +22,7 @@
 #include <pthread.h>
 #include <sched.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <algorithm>
 #include <vector>
@@ -255,6 +256,26 @@ TEST(SanitizerCommon, LibraryNameIs) {
     }
 }
 
+TEST(SanitizerLinux, NanoTime) {
+  struct timespec ts;
+  ASSERT_EQ(0, clock_gettime(CLOCK_REALTIME, &ts));
+  u64 libc_time = (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  u64 time = NanoTime();
+  EXPECT_LE(libc_time, time);
+  EXPECT_GT(libc_time + 1000000000, time);
+
+  ASSERT_EQ(0, clock_gettime(CLOCK_MONOTONIC, &ts));
+  libc_time = (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  u64 prev = MonotonicNanoTime();
+  EXPECT_LE(libc_time, prev);
+  EXPECT_GT(libc_time + 1000000000, prev);
+  for (int i = 0; i < 1000; i++) {
+    u64 cur = MonotonicNanoTime();
+    EXPECT_LE(prev, cur);
+    prev = cur;
+  }
+}
+
 }  // namespace __sanitizer
 
 #endif  // SANITIZER_LINUX
@@ -36,6 +36,14 @@ class TestData {
     }
   }
 
+  void Read() {
+    ReadLock l(mtx_);
+    T v0 = data_[0];
+    for (int i = 0; i < kSize; i++) {
+      CHECK_EQ(data_[i], v0);
+    }
+  }
+
   void TryWrite() {
     if (!mtx_->TryLock())
       return;
@@ -57,6 +65,7 @@ class TestData {
 
  private:
   typedef GenericScopedLock<MutexType> Lock;
+  typedef GenericScopedReadLock<MutexType> ReadLock;
   static const int kSize = 64;
   typedef u64 T;
   MutexType *mtx_;
@@ -82,6 +91,19 @@ static void *lock_thread(void *param) {
   return 0;
 }
 
+template<typename MutexType>
+static void *read_write_thread(void *param) {
+  TestData<MutexType> *data = (TestData<MutexType>*)param;
+  for (int i = 0; i < kIters; i++) {
+    if ((i % kWriteRate) == 0)
+      data->Write();
+    else
+      data->Read();
+    data->Backoff();
+  }
+  return 0;
+}
+
 template<typename MutexType>
 static void *try_thread(void *param) {
   TestData<MutexType> *data = (TestData<MutexType>*)param;
@@ -132,4 +154,30 @@ TEST(SanitizerCommon, BlockingMutex) {
   check_locked(mtx);
 }
 
+TEST(SanitizerCommon, RWMutex) {
+  RWMutex mtx;
+  TestData<RWMutex> data(&mtx);
+  pthread_t threads[kThreads];
+  for (int i = 0; i < kThreads; i++)
+    pthread_create(&threads[i], 0, lock_thread<RWMutex>, &data);
+  for (int i = 0; i < kThreads; i++)
+    pthread_join(threads[i], 0);
+  check_locked(&mtx);
+}
+
+TEST(SanitizerCommon, RWMutexRead) {
+  RWMutex mtx;
+  TestData<RWMutex> data(&mtx);
+  pthread_t threads[kThreads];
+  for (int i = 0; i < kThreads; i++)
+    pthread_create(&threads[i], 0, read_write_thread<RWMutex>, &data);
+  for (int i = 0; i < kThreads; i++)
+    pthread_join(threads[i], 0);
+  mtx.ReadLock();
+  mtx.ReadLock();
+  mtx.CheckLocked();
+  mtx.ReadUnlock();
+  mtx.ReadUnlock();
+}
+
 }  // namespace __sanitizer
@@ -16,6 +16,10 @@
 
 #include <string.h>
 #include <limits.h>
+#if !SANITIZER_WINDOWS
+#include <stdio.h>
+#include <unistd.h>
+#endif
 
 namespace __sanitizer {
 
@@ -136,4 +140,45 @@ TEST(Printf, Padding) {
   TestAgainstLibc<int>("%03d - %03d", -12, -1234);
 }
 
+#if !SANITIZER_WINDOWS
+static uptr ReportFileSize(fd_t fd) {
+  return (uptr)lseek(fd, 0, SEEK_END);
+}
+
+TEST(Printf, ReportBuffering) {
+  FILE *f = tmpfile();
+  ASSERT_NE((FILE *)0, f);
+  fd_t old_report_fd = report_fd;
+  report_fd = fileno(f);
+  {
+    SpinMutexLock l(&CommonSanitizerReportMutex);
+    ScopedReportBuffer report_buffer;
+    Printf("%s", "first ");
+    Printf("%d\n", 42);
+    EXPECT_EQ(0U, ReportFileSize(report_fd));
+    // Larger than the buffer: flushed in order.
+    const uptr kLen = 100000;
+    char *big = (char *)MmapOrDie(kLen + 1, "ReportBufferingTest");
+    internal_memset(big, 'x', kLen);
+    big[kLen] = '\0';
+    RawWrite(big);
+    EXPECT_EQ(9 + kLen, ReportFileSize(report_fd));
+    UnmapOrDie(big, kLen + 1);
+    Printf("last\n");
+    EXPECT_EQ(9 + kLen, ReportFileSize(report_fd));
+  }
+  EXPECT_EQ(9 + 100000 + 5, ReportFileSize(report_fd));
+  // Not buffered outside of the scope.
+  Printf("x");
+  EXPECT_EQ(9 + 100000 + 6, ReportFileSize(report_fd));
+  char buf[16];
+  EXPECT_EQ(9, pread(report_fd, buf, 9, 0));
+  EXPECT_EQ(0, internal_memcmp(buf, "first 42\n", 9));
+  EXPECT_EQ(5, pread(report_fd, buf, 5, 9 + 100000));
+  EXPECT_EQ(0, internal_memcmp(buf, "last\n", 5));
+  report_fd = old_report_fd;
+  fclose(f);
+}
+#endif
+
 }  // namespace __sanitizer
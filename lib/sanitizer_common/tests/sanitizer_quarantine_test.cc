@@ -0,0 +1,141 @@
+//===-- sanitizer_quarantine_test.cc --------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of ThreadSanitizer/AddressSanitizer runtime.
+//
+//===----------------------------------------------------------------------===//
+#include "sanitizer_common/sanitizer_atomic.h"
+#include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_quarantine.h"
+#include "gtest/gtest.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+namespace __sanitizer {
+
+struct QuarantineNode {
+  uptr size;
+};
+
+static atomic_uintptr_t recycled_bytes;
+
+struct TestQuarantineCallback {
+  void RecycleBatch(QuarantineNode **nodes, uptr n) {
+    for (uptr i = 0; i < n; i++) {
+      atomic_fetch_add(&recycled_bytes, nodes[i]->size, memory_order_relaxed);
+      delete nodes[i];
+    }
+  }
+  void *Allocate(uptr size) {
+    return malloc(size);
+  }
+  void Deallocate(void *p) {
+    free(p);
+  }
+};
+
+template<uptr kNumShards>
+struct TestQuarantine {
+  typedef Quarantine<TestQuarantineCallback, QuarantineNode, kNumShards> Type;
+};
+
+static const uptr kQuarantineSize = 1 << 20;
+static const uptr kCacheSize = 1 << 12;
+static const uptr kNodeSize = 64;
+
+template<class Q>
+void PutMany(Q *q, typename Q::Cache *c, uptr n) {
+  for (uptr i = 0; i < n; i++) {
+    QuarantineNode *node = new QuarantineNode;
+    node->size = kNodeSize;
+    q->Put(c, TestQuarantineCallback(), node, kNodeSize);
+  }
+}
+
+template<uptr kNumShards>
+void TestQuarantineBounded() {
+  typedef typename TestQuarantine<kNumShards>::Type Q;
+  static Q q(LINKER_INITIALIZED);
+  q.Init(kQuarantineSize, kCacheSize);
+  typename Q::Cache c;
+  atomic_store(&recycled_bytes, 0, memory_order_relaxed);
+  uptr n = 4 * kQuarantineSize / kNodeSize;
+  PutMany(&q, &c, n);
+  uptr put = n * kNodeSize;
+  uptr recycled = atomic_load(&recycled_bytes, memory_order_relaxed);
+  // Everything above the quarantine size (plus the last cache) is recycled,
+  // and at least 90% of the quarantine size stays in it.
+  EXPECT_GE(recycled, put - kQuarantineSize - 2 * kCacheSize);
+  EXPECT_LE(recycled, put - kQuarantineSize / 10 * 9 + kCacheSize);
+}
+
+TEST(SanitizerCommon, QuarantineBounded) {
+  TestQuarantineBounded<1>();
+}
+
+TEST(SanitizerCommon, QuarantineShardedBounded) {
+  TestQuarantineBounded<4>();
+}
+
+template<uptr kNumShards>
+void TestQuarantineShrink() {
+  typedef typename TestQuarantine<kNumShards>::Type Q;
+  static Q q(LINKER_INITIALIZED);
+  q.Init(kQuarantineSize, kCacheSize);
+  typename Q::Cache c;
+  PutMany(&q, &c, kQuarantineSize / kNodeSize / 2);
+  q.Drain(&c, TestQuarantineCallback());
+  uptr size = q.GetSize();
+  EXPECT_GT(size, kQuarantineSize / 4);
+  atomic_store(&recycled_bytes, 0, memory_order_relaxed);
+  uptr goal = size / 2;
+  uptr recycled = q.Shrink(TestQuarantineCallback(), goal);
+  EXPECT_GE(recycled, goal);
+  // Whole batches are recycled.
+  EXPECT_LE(recycled, goal + kNumShards * QuarantineBatch::kSize * kNodeSize);
+  EXPECT_EQ(recycled, atomic_load(&recycled_bytes, memory_order_relaxed));
+  EXPECT_EQ(size - recycled, q.GetSize());
+  recycled += q.Shrink(TestQuarantineCallback(), 0);
+  EXPECT_EQ(size, recycled);
+  EXPECT_EQ(0U, q.GetSize());
+}
+
+TEST(SanitizerCommon, QuarantineShrink) {
+  TestQuarantineShrink<1>();
+  TestQuarantineShrink<4>();
+}
+
+typedef TestQuarantine<8>::Type ThreadedQuarantine;
+static ThreadedQuarantine threaded_quarantine(LINKER_INITIALIZED);
+static const uptr kNumThreads = 8;
+static const uptr kNodesPerThread = 10000;
+
+static void *QuarantineThread(void *arg) {
+  ThreadedQuarantine::Cache c;
+  PutMany(&threaded_quarantine, &c, kNodesPerThread);
+  threaded_quarantine.Drain(&c, TestQuarantineCallback());
+  return 0;
+}
+
+TEST(SanitizerCommon, QuarantineShardedThreaded) {
+  threaded_quarantine.Init(kQuarantineSize, kCacheSize);
+  atomic_store(&recycled_bytes, 0, memory_order_relaxed);
+  pthread_t t[kNumThreads];
+  for (uptr i = 0; i < kNumThreads; i++)
+    pthread_create(&t[i], 0, QuarantineThread, 0);
+  for (uptr i = 0; i < kNumThreads; i++)
+    pthread_join(t[i], 0);
+  uptr put = kNumThreads * kNodesPerThread * kNodeSize;
+  uptr recycled = atomic_load(&recycled_bytes, memory_order_relaxed);
+  EXPECT_GT(recycled, 0U);
+  EXPECT_LE(recycled, put - kQuarantineSize / 10 * 9 + kCacheSize);
+}
+
+}  // namespace __sanitizer
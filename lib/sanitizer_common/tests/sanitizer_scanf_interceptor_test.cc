@@ -176,3 +176,29 @@ TEST(SanitizerCommonInterceptors, Scanf) {
   testScanfPartial("%d%n%n%d %s %s", 4, 6, I, I, I, I, scanf_buf_size,
                    scanf_buf_size);
 }
+
+TEST(SanitizerCommonInterceptors, ScanfCache) {
+  const unsigned I = sizeof(int);          // NOLINT
+  const unsigned L = sizeof(long);         // NOLINT
+  const unsigned S = sizeof(short);        // NOLINT
+  internal_memset(scanf_cache, 0, sizeof(scanf_cache));
+  ScanfCacheEntry local;
+  // The same format buffer with another format in it.
+  char format[kScanfCacheMaxFormat];
+  for (int i = 0; i < 2; i++) {
+    internal_strncpy(format, "%d %ld", sizeof(format));
+    testScanf(format, 2, I, L);
+    EXPECT_NE(&local, scanf_cache_get(format, true, &local));
+    internal_strncpy(format, "%hd %d %ld", sizeof(format));
+    testScanf(format, 3, S, I, L);
+    testScanfNoGnuMalloc(format, 3, S, I, L);
+    testScanfPartial(format, 2, 2, S, I);
+  }
+  // The formats too long to be cached.
+  char long_format[2 * kScanfCacheMaxFormat];
+  internal_memset(long_format, ' ', sizeof(long_format));
+  internal_memcpy(long_format + sizeof(long_format) - 7, "%d %ld", 7);
+  for (int i = 0; i < 2; i++)
+    testScanf(long_format, 2, I, L);
+  EXPECT_EQ(0, scanf_cache_get(long_format, true, &local));
+}
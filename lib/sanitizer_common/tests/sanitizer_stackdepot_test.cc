@@ -11,6 +11,7 @@
 //
 //===----------------------------------------------------------------------===//
 #include "sanitizer_common/sanitizer_stackdepot.h"
+#include "sanitizer_common/sanitizer_flags.h"
 #include "sanitizer_common/sanitizer_internal_defs.h"
 #include "sanitizer_common/sanitizer_libc.h"
 #include "gtest/gtest.h"
@@ -66,4 +67,178 @@ TEST(SanitizerCommon, StackDepotSeveral) {
   EXPECT_NE(i1, i2);
 }
 
+TEST(SanitizerCommon, StackDepotMany) {
+  const uptr kNumStacks = 10000;
+  u32 ids[kNumStacks];
+  for (uptr i = 0; i < kNumStacks; i++) {
+    uptr s[] = {100, 200, i};
+    ids[i] = StackDepotPut(s, ARRAY_SIZE(s));
+  }
+  for (uptr i = 0; i < kNumStacks; i++) {
+    uptr s[] = {100, 200, i};
+    EXPECT_EQ(ids[i], StackDepotPut(s, ARRAY_SIZE(s)));
+    uptr sz = 0;
+    const uptr *sp = StackDepotGet(ids[i], &sz);
+    ASSERT_NE(sp, (uptr*)0);
+    EXPECT_EQ(sz, ARRAY_SIZE(s));
+    EXPECT_EQ(internal_memcmp(sp, s, sizeof(s)), 0);
+  }
+}
+
+TEST(SanitizerCommon, StackDepotStats) {
+  uptr n_uniq_ids = StackDepotGetStats()->n_uniq_ids;
+  uptr s1[] = {1, 2, 3, 4, 10};
+  StackDepotPut(s1, ARRAY_SIZE(s1));
+  StackDepotPut(s1, ARRAY_SIZE(s1));
+  StackDepotStats *stats = StackDepotGetStats();
+  EXPECT_EQ(n_uniq_ids + 1, stats->n_uniq_ids);
+  EXPECT_GE(stats->n_tabs, 1U);
+  uptr n_buckets = 0, n_descs = 0;
+  for (uptr i = 0; i < kStackDepotChainHistSize; i++) {
+    n_buckets += stats->chain_len_hist[i];
+    n_descs += i * stats->chain_len_hist[i];
+  }
+  EXPECT_EQ(stats->n_buckets, n_buckets);
+  EXPECT_GE(stats->max_chain_len, 1U);
+  if (stats->max_chain_len < kStackDepotChainHistSize)
+    EXPECT_EQ(stats->n_uniq_ids, n_descs);
+}
+
+TEST(SanitizerCommon, StackDepotCache) {
+  StackDepotCache cache;
+  internal_memset(&cache, 0, sizeof(cache));
+  uptr s1[] = {1, 2, 3, 4, 11};
+  uptr s2[] = {1, 2, 3, 4, 12};  // Same top frames as s1.
+  u32 i1 = StackDepotPut(s1, ARRAY_SIZE(s1));
+  u32 i2 = StackDepotPut(s2, ARRAY_SIZE(s2));
+  EXPECT_EQ(i1, StackDepotPutCached(&cache, s1, ARRAY_SIZE(s1)));
+  EXPECT_EQ(0U, cache.n_hits);
+  EXPECT_EQ(i1, StackDepotPutCached(&cache, s1, ARRAY_SIZE(s1)));
+  EXPECT_EQ(1U, cache.n_hits);
+  EXPECT_EQ(i2, StackDepotPutCached(&cache, s2, ARRAY_SIZE(s2)));
+  EXPECT_EQ(1U, cache.n_hits);
+  EXPECT_EQ(i1, StackDepotPutCached(&cache, s1, ARRAY_SIZE(s1)));
+  EXPECT_EQ(i1, StackDepotPutCached(0, s1, ARRAY_SIZE(s1)));
+  EXPECT_EQ(0U, StackDepotPutCached(&cache, 0, 0));
+  EXPECT_EQ(4U, cache.n_lookups);
+
+  uptr n_lookups = StackDepotGetStats()->n_cache_lookups;
+  uptr n_hits = StackDepotGetStats()->n_cache_hits;
+  for (int i = 0; i < 2000; i++)
+    EXPECT_EQ(i1, StackDepotPutCached(&cache, s1, ARRAY_SIZE(s1)));
+  StackDepotStats *stats = StackDepotGetStats();
+  EXPECT_GT(stats->n_cache_lookups, n_lookups);
+  EXPECT_GT(stats->n_cache_hits, n_hits);
+  EXPECT_LE(stats->n_cache_hits, stats->n_cache_lookups);
+}
+
+TEST(SanitizerCommon, StackDepotCacheWays) {
+  StackDepotCache cache;
+  internal_memset(&cache, 0, sizeof(cache));
+  // Fewer stacks than the cache entries: with two ways per set all of them
+  // stay cached, unless the key hashes of three land in one set.
+  const uptr kNumStacks = StackDepotCache::kSize / 4;
+  uptr stacks[kNumStacks][5];
+  u32 ids[kNumStacks];
+  for (uptr i = 0; i < kNumStacks; i++) {
+    for (uptr j = 0; j < 5; j++)
+      stacks[i][j] = 0x500000 + i * 0x100 + j;
+    ids[i] = StackDepotPutCached(&cache, stacks[i], 5);
+  }
+  for (uptr i = 0; i < kNumStacks; i++)
+    EXPECT_EQ(ids[i], StackDepotPutCached(&cache, stacks[i], 5));
+  EXPECT_EQ(kNumStacks, cache.n_hits);
+}
+
+TEST(SanitizerCommon, StackDepotCompressed) {
+  const uptr kNumStacks = 1000;
+  const uptr kDepth = 30;
+  uptr stacks[kNumStacks][kDepth];
+  for (uptr i = 0; i < kNumStacks; i++) {
+    for (uptr j = 0; j < kDepth; j++)
+      stacks[i][j] = 0x7f0000000000ULL + (j % 3) * 0x10000000 + i * 64 + j;
+  }
+  common_flags()->compress_stack_depot = true;
+  uptr allocated = StackDepotGetStats()->allocated;
+  u32 ids[kNumStacks];
+  for (uptr i = 0; i < kNumStacks; i++)
+    ids[i] = StackDepotPut(stacks[i], kDepth);
+  uptr compressed = StackDepotGetStats()->allocated - allocated;
+  StackDepotCache cache;
+  internal_memset(&cache, 0, sizeof(cache));
+  for (uptr i = 0; i < kNumStacks; i++) {
+    EXPECT_EQ(ids[i], StackDepotPut(stacks[i], kDepth));
+    EXPECT_EQ(ids[i], StackDepotPutCached(&cache, stacks[i], kDepth));
+    EXPECT_EQ(ids[i], StackDepotPutCached(&cache, stacks[i], kDepth));
+    uptr sz = 0;
+    const uptr *sp = StackDepotGet(ids[i], &sz);
+    ASSERT_NE(sp, (uptr*)0);
+    EXPECT_EQ(kDepth, sz);
+    EXPECT_EQ(0, internal_memcmp(sp, stacks[i], sizeof(stacks[i])));
+    // The decoded copy is kept.
+    EXPECT_EQ(sp, StackDepotGet(ids[i], &sz));
+  }
+  common_flags()->compress_stack_depot = false;
+  allocated = StackDepotGetStats()->allocated;
+  for (uptr i = 0; i < kNumStacks; i++)
+    stacks[i][0]++;
+  for (uptr i = 0; i < kNumStacks; i++)
+    StackDepotPut(stacks[i], kDepth);
+  uptr plain = StackDepotGetStats()->allocated - allocated;
+  EXPECT_LT(compressed * 3, plain * 2);
+}
+
+TEST(SanitizerCommon, StackDepotBudget) {
+  const uptr kDepth = 20;
+  uptr stack[kDepth];
+  for (uptr j = 0; j < kDepth; j++)
+    stack[j] = 0x600000 + j;
+  u32 old_id = StackDepotPut(stack, kDepth);
+  // Fill the depot past 2M, then make that between half of the budget and
+  // the budget, with some room left.
+  for (uptr i = 0; StackDepotGetStats()->mapped < (2 << 20); i++) {
+    stack[kDepth - 1] = 0x700000 + i;
+    StackDepotPut(stack, kDepth);
+  }
+  stack[kDepth - 1] = 0x600000 + kDepth - 1;
+  common_flags()->stack_depot_max_mb =
+      (StackDepotGetStats()->mapped >> 20) + 2;
+  uptr n_truncated = StackDepotGetStats()->n_truncated;
+
+  // The stacks already in the depot keep their full ids.
+  EXPECT_EQ(old_id, StackDepotPut(stack, kDepth));
+  // New deep stacks are stored truncated, and share the entry when they only
+  // differ below the top frames.
+  stack[0] = 0x610000;
+  u32 id1 = StackDepotPut(stack, kDepth);
+  stack[kDepth - 1] = 0x610001;
+  u32 id2 = StackDepotPut(stack, kDepth);
+  EXPECT_NE(0U, id1);
+  EXPECT_EQ(id1, id2);
+  uptr sz = 0;
+  const uptr *sp = StackDepotGet(id1, &sz);
+  ASSERT_NE(sp, (uptr*)0);
+  EXPECT_EQ(8U, sz);
+  EXPECT_EQ(0, internal_memcmp(sp, stack, sz * sizeof(uptr)));
+  EXPECT_EQ(n_truncated + 2, StackDepotGetStats()->n_truncated);
+  uptr short_stack[] = {0x620000, 0x620001};
+  EXPECT_NE(0U, StackDepotPut(short_stack, ARRAY_SIZE(short_stack)));
+
+  // Past the budget only the stacks already in the depot are found.
+  common_flags()->stack_depot_max_mb = StackDepotGetStats()->mapped >> 20;
+  uptr n_dropped = StackDepotGetStats()->n_dropped;
+  uptr old_stack[kDepth];
+  for (uptr j = 0; j < kDepth; j++)
+    old_stack[j] = 0x600000 + j;
+  EXPECT_EQ(old_id, StackDepotPut(old_stack, kDepth));
+  EXPECT_EQ(id1, StackDepotPut(stack, kDepth));
+  short_stack[1]++;
+  EXPECT_EQ(0U, StackDepotPut(short_stack, ARRAY_SIZE(short_stack)));
+  stack[0]++;
+  EXPECT_EQ(0U, StackDepotPut(stack, kDepth));
+  EXPECT_EQ(n_dropped + 2, StackDepotGetStats()->n_dropped);
+  common_flags()->stack_depot_max_mb = 0;
+  EXPECT_NE(0U, StackDepotPut(stack, kDepth));
+}
+
 }  // namespace __sanitizer
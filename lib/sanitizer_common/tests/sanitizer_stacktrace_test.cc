@@ -12,9 +12,14 @@
 //===----------------------------------------------------------------------===//
 
 #include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_shadow_call_stack.h"
 #include "sanitizer_common/sanitizer_stacktrace.h"
 #include "gtest/gtest.h"
 
+#if SANITIZER_LINUX && defined(__x86_64__) && !SANITIZER_ANDROID
+#include <unwind.h>
+#endif
+
 namespace __sanitizer {
 
 class FastUnwindTest : public ::testing::Test {
@@ -92,5 +97,118 @@ TEST_F(FastUnwindTest, MisalignedFramePointer) {
   }
 }
 
+TEST(SanitizerCommon, EncodeStack) {
+  uptr trace[] = {0x7fff12345678ULL, 0x7fff12345600ULL, 0x400123, 0x400456,
+                  0x7f0000001000ULL, 0, (uptr)-1, 1, 0x401000};
+  const uptr n = ARRAY_SIZE(trace);
+  for (uptr size = 0; size <= n; size++) {
+    u8 buf[256];
+    ASSERT_LE(StackTrace::MaxEncodedStackSize(size), sizeof(buf));
+    uptr len = StackTrace::EncodeStack(trace, size, buf);
+    EXPECT_LE(len + StackTrace::kEncodedStackSlack,
+              StackTrace::MaxEncodedStackSize(size));
+    uptr decoded[n + 1];
+    decoded[size] = 42;
+    StackTrace::DecodeStack(buf, size, decoded);
+    for (uptr i = 0; i < size; i++)
+      EXPECT_EQ(trace[i], decoded[i]);
+    EXPECT_EQ(42U, decoded[size]);
+  }
+  // Close pcs take 2 bytes each.
+  uptr close[] = {0x400100, 0x400200, 0x400180, 0x400300};
+  u8 buf[64];
+  EXPECT_EQ(1U + 3 + 2 * 3,
+            StackTrace::EncodeStack(close, ARRAY_SIZE(close), buf));
+#if SANITIZER_WORDSIZE == 64
+  // Pcs too far apart are not encoded.
+  uptr far[] = {0x400100, 0x8000000000400100ULL};
+  EXPECT_EQ(0U, StackTrace::EncodeStack(far, ARRAY_SIZE(far), buf));
+#endif
+}
+
+#if SANITIZER_CAN_USE_SHADOW_CALL_STACK
+TEST_F(FastUnwindTest, ShadowCallStack) {
+  uptr size = 0;
+  EXPECT_EQ(0, GetShadowCallStack(&size));
+  EXPECT_FALSE(trace.ShadowCallStackUnwind(start_pc, (uptr)&fake_stack[0],
+                                           fake_top, fake_bottom, 10));
+  for (uptr i = 0; i < 3; i++)
+    __sanitizer_shadow_call_stack_push((void*)(0x1000 + i));
+  const uptr *pcs = GetShadowCallStack(&size);
+  ASSERT_NE((const uptr*)0, pcs);
+  EXPECT_EQ(3U, size);
+  EXPECT_EQ(0x1002U, pcs[0]);
+  EXPECT_EQ(0x1000U, pcs[2]);
+  // The current pc and its caller come from the frame.
+  EXPECT_TRUE(trace.ShadowCallStackUnwind(start_pc, (uptr)&fake_stack[0],
+                                          fake_top, fake_bottom, 10));
+  EXPECT_EQ(5U, trace.size);
+  EXPECT_EQ(start_pc, trace.trace[0]);
+  EXPECT_EQ(PC(1), trace.trace[1]);
+  EXPECT_EQ(0x1002U, trace.trace[2]);
+  EXPECT_EQ(0x1000U, trace.trace[4]);
+  trace.size = 0;
+  EXPECT_TRUE(trace.ShadowCallStackUnwind(start_pc, (uptr)&fake_stack[0],
+                                          fake_top, fake_bottom, 3));
+  EXPECT_EQ(3U, trace.size);
+  EXPECT_EQ(0x1002U, trace.trace[2]);
+  // Too deep stacks are not used.
+  for (uptr i = 3; i <= kStackTraceMax; i++)
+    __sanitizer_shadow_call_stack_push((void*)(0x1000 + i));
+  EXPECT_EQ(0, GetShadowCallStack(&size));
+  for (uptr i = 3; i <= kStackTraceMax; i++)
+    __sanitizer_shadow_call_stack_pop();
+  pcs = GetShadowCallStack(&size);
+  EXPECT_EQ(3U, size);
+  EXPECT_EQ(0x1002U, pcs[0]);
+  for (uptr i = 0; i < 3; i++)
+    __sanitizer_shadow_call_stack_pop();
+  EXPECT_EQ(0, GetShadowCallStack(&size));
+}
+#endif
+
+#if SANITIZER_LINUX && defined(__x86_64__) && !SANITIZER_ANDROID
+struct UnwindBacktraceData {
+  uptr *pcs;
+  uptr n;
+};
+
+static _Unwind_Reason_Code CollectPc(_Unwind_Context *ctx, void *arg) {
+  UnwindBacktraceData *data = (UnwindBacktraceData*)arg;
+  if (data->n == kStackTraceMax)
+    return _URC_NORMAL_STOP;
+  data->pcs[data->n++] = _Unwind_GetIP(ctx);
+  return _URC_NO_REASON;
+}
+
+static NOINLINE void CompareWithUnwindBacktrace(int depth) {
+  if (depth > 0) {
+    CompareWithUnwindBacktrace(depth - 1);
+    // Prevent the tail call.
+    __asm__ __volatile__("" ::: "memory");
+    return;
+  }
+  // Run twice to check the cached frame layouts as well.
+  for (int i = 0; i < 2; i++) {
+    StackTrace cfi;
+    ASSERT_TRUE(cfi.CfiUnwindStack(kStackTraceMax));
+    uptr pcs[kStackTraceMax];
+    UnwindBacktraceData data = {pcs, 0};
+    _Unwind_Backtrace(CollectPc, &data);
+    // _Unwind_Backtrace may report a zero pc past the outermost frame.
+    while (data.n > 0 && pcs[data.n - 1] == 0)
+      data.n--;
+    // The top frames are this function, but at different calls.
+    ASSERT_EQ(data.n, cfi.size);
+    ASSERT_GT(cfi.size, (uptr)depth);
+    for (uptr j = 1; j < cfi.size; j++)
+      EXPECT_EQ(pcs[j], cfi.trace[j]);
+  }
+}
+
+TEST(SanitizerCommon, CfiUnwindStack) {
+  CompareWithUnwindBacktrace(10);
+}
+#endif
 
 }  // namespace __sanitizer
@@ -147,4 +147,62 @@ TEST_F(SuppressionContextTest, ParseType) {
   EXPECT_EQ(0, strcmp((*Suppressions())[0].templ, "foo"));
 }
 
+TEST_F(SuppressionContextTest, MatchFirst) {
+  ctx_->Parse(
+    "race:foo*bar\n"
+    "leak:*barbaz$\n"
+    "leak:ab\n"
+    "leak:^quux\n"
+    "leak:foo*bar\n"
+    "leak:f*o\n"
+  );  // NOLINT
+  Suppression *s = 0;
+  EXPECT_TRUE(ctx_->Match("foo_bar", SuppressionRace, &s));
+  EXPECT_EQ(&(*Suppressions())[0], s);
+  EXPECT_TRUE(ctx_->Match("foo_bar", SuppressionLeak, &s));
+  EXPECT_EQ(&(*Suppressions())[4], s);
+  EXPECT_TRUE(ctx_->Match("foo_barbaz", SuppressionLeak, &s));
+  EXPECT_EQ(&(*Suppressions())[1], s);
+  EXPECT_TRUE(ctx_->Match("quux_ab", SuppressionLeak, &s));
+  EXPECT_EQ(&(*Suppressions())[2], s);
+  EXPECT_TRUE(ctx_->Match("quux", SuppressionLeak, &s));
+  EXPECT_EQ(&(*Suppressions())[3], s);
+  EXPECT_TRUE(ctx_->Match("fo", SuppressionLeak, &s));
+  EXPECT_EQ(&(*Suppressions())[5], s);
+  EXPECT_FALSE(ctx_->Match("xquux", SuppressionLeak, &s));
+  EXPECT_FALSE(ctx_->Match("foo_bar", SuppressionThread, &s));
+  EXPECT_FALSE(ctx_->Match("", SuppressionLeak, &s));
+  EXPECT_FALSE(ctx_->Match(0, SuppressionLeak, &s));
+}
+
+TEST_F(SuppressionContextTest, MatchSameAsTemplateMatch) {
+  const char *templates[] = {
+    "foo", "^foo", "foo$", "*foo*", "fo*o", "o*f", "bar*baz$", "^b*z",
+    "aaa", "aaaa*b", "$", "*", "^", "xyz*", "*zzz", "oob"
+  };
+  const char *strings[] = {
+    "foo", "xfoo", "foox", "fooo", "barbaz", "bar_baz_", "bz", "aaaa",
+    "aaab", "aaaaab", "a", "zzz", "xyzzz", "foobar", "oob"
+  };
+  char buf[1024] = "";
+  for (uptr i = 0; i < ARRAY_SIZE(templates); i++) {
+    strcat(buf, "leak:");  // NOLINT
+    strcat(buf, templates[i]);  // NOLINT
+    strcat(buf, "\n");  // NOLINT
+  }
+  ctx_->Parse(buf);
+  const uptr n = ARRAY_SIZE(templates);
+  for (uptr j = 0; j < ARRAY_SIZE(strings); j++) {
+    uptr expected = n;
+    for (uptr i = 0; i < n && expected == n; i++)
+      if (MyMatch(templates[i], strings[j]))
+        expected = i;
+    Suppression *s = 0;
+    bool matched = ctx_->Match(strings[j], SuppressionLeak, &s);
+    EXPECT_EQ(expected != n, matched) << strings[j];
+    if (matched)
+      EXPECT_EQ(&(*Suppressions())[expected], s) << strings[j];
+  }
+}
+
 }  // namespace __sanitizer
@@ -0,0 +1,47 @@
+//===-- sanitizer_symbolizer_test.cc --------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Tests for sanitizer_symbolizer.h
+//
+//===----------------------------------------------------------------------===//
+
+#include "sanitizer_common/sanitizer_platform.h"
+#if SANITIZER_POSIX
+
+#include "sanitizer_common/sanitizer_symbolizer.h"
+#include "gtest/gtest.h"
+
+#include <unistd.h>
+
+namespace __sanitizer {
+
+static int LowestFreeFd() {
+  int fd = dup(2);
+  close(fd);
+  return fd;
+}
+
+TEST(Symbolizer, SubprocessExecFailure) {
+  int free_fd = LowestFreeFd();
+  int input_fd = -1, output_fd = -1;
+  // Exists, but is not executable: the failed exec is reported back
+  // by the child.
+  EXPECT_FALSE(StartSymbolizerSubprocess("/etc/passwd", &input_fd,
+                                         &output_fd));
+  EXPECT_EQ(-1, input_fd);
+  EXPECT_EQ(-1, output_fd);
+  // All the pipes are closed.
+  EXPECT_EQ(free_fd, LowestFreeFd());
+  EXPECT_FALSE(StartSymbolizerSubprocess("/nonexistent/symbolizer",
+                                         &input_fd, &output_fd));
+}
+
+}  // namespace __sanitizer
+
+#endif  // SANITIZER_POSIX
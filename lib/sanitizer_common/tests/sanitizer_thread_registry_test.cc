@@ -147,6 +147,81 @@ TEST(SanitizerCommon, ThreadRegistryTest) {
   TestRegistry(&no_quarantine_registry, false);
 }
 
+TEST(SanitizerCommon, ThreadRegistryQuarantineEvict) {
+  const u32 kThreads = 4;
+  ThreadRegistry registry(GetThreadContext<ThreadContextBase>, kThreads,
+                          kThreads);
+  for (u32 i = 0; i < kThreads; i++) {
+    EXPECT_EQ(i, registry.CreateThread(get_uid(i), true, 0, 0));
+    registry.StartThread(i, 0, 0);
+  }
+  registry.FinishThread(2);
+  registry.FinishThread(1);
+  // All tids are alive or quarantined, the oldest dead one is reused.
+  EXPECT_EQ(2U, registry.CreateThread(get_uid(4), true, 0, 0));
+  EXPECT_EQ(1U, registry.CreateThread(get_uid(5), true, 0, 0));
+  CheckThreadQuantity(&registry, kThreads, 2, kThreads);
+}
+
+TEST(SanitizerCommon, ThreadRegistryOsIdIndex) {
+  ThreadRegistry registry(GetThreadContext<ThreadContextBase>,
+                          kMaxRegistryThreads, kRegistryQuarantine);
+  const u32 kThreads = 100;
+  // os ids that collide in a small hash as well as consecutive ones.
+  for (u32 i = 0; i < kThreads; i++) {
+    EXPECT_EQ(i, registry.CreateThread(get_uid(i), is_detached(i), 0, 0));
+    registry.StartThread(i, 0x1000 + (i << 12), 0);
+  }
+  registry.Lock();
+  for (u32 i = 0; i < kThreads; i++) {
+    ThreadContextBase *tctx =
+        registry.FindThreadContextByOsIDLocked(0x1000 + (i << 12));
+    ASSERT_NE((ThreadContextBase *)0, tctx);
+    EXPECT_EQ(i, tctx->tid);
+    EXPECT_EQ(tctx, registry.GetThreadLocked(i));
+  }
+  EXPECT_EQ((ThreadContextBase *)0,
+            registry.FindThreadContextByOsIDLocked(0x1000 + (kThreads << 12)));
+  registry.Unlock();
+  // Finished, but not yet joined threads can still be found.
+  for (u32 i = 1; i < kThreads; i++)
+    registry.FinishThread(i);
+  CheckThreadQuantity(&registry, kThreads, 1, 1);
+  registry.Lock();
+  for (u32 i = 1; i < kThreads; i++) {
+    bool found = registry.FindThreadContextByOsIDLocked(0x1000 + (i << 12));
+    EXPECT_EQ(!is_detached(i), found);
+  }
+  registry.Unlock();
+  for (u32 i = 1; i < kThreads; i++) {
+    if (!is_detached(i))
+      registry.JoinThread(i, 0);
+  }
+  CheckThreadQuantity(&registry, kThreads, 1, 1);
+  registry.Lock();
+  for (u32 i = 1; i < kThreads; i++) {
+    EXPECT_EQ((ThreadContextBase *)0,
+              registry.FindThreadContextByOsIDLocked(0x1000 + (i << 12)));
+  }
+  registry.Unlock();
+  // A reused os id finds the new thread.
+  u32 tid = registry.CreateThread(get_uid(kThreads), false, 0, 0);
+  registry.StartThread(tid, 0x1000 + (1 << 12), 0);
+  // The main thread gets a new os id, e.g. after fork().
+  registry.SetThreadOsId(0, 0x42);
+  registry.Lock();
+  ThreadContextBase *tctx =
+      registry.FindThreadContextByOsIDLocked(0x1000 + (1 << 12));
+  ASSERT_NE((ThreadContextBase *)0, tctx);
+  EXPECT_EQ(tid, tctx->tid);
+  EXPECT_EQ((ThreadContextBase *)0,
+            registry.FindThreadContextByOsIDLocked(0x1000));
+  tctx = registry.FindThreadContextByOsIDLocked(0x42);
+  ASSERT_NE((ThreadContextBase *)0, tctx);
+  EXPECT_EQ(0U, tctx->tid);
+  registry.Unlock();
+}
+
 static const int kThreadsPerShard = 20;
 static const int kNumShards = 25;
 
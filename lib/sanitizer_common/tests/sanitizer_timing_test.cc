@@ -0,0 +1,55 @@
+//===-- sanitizer_timing_test.cc ------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of ThreadSanitizer/AddressSanitizer runtime.
+//
+//===----------------------------------------------------------------------===//
+#include "sanitizer_common/sanitizer_timing.h"
+#include "gtest/gtest.h"
+
+#include <pthread.h>
+
+namespace __sanitizer {
+
+#if SANITIZER_CAN_USE_TIMING
+static void EnterRegion(TimingRegion region, int n) {
+  for (int i = 0; i < n; i++) {
+    ScopedTiming timing(region);
+  }
+}
+
+static void *TimingThread(void *arg) {
+  EnterRegion(kTimingFree, 40);
+  TimingThreadFinish();
+  return 0;
+}
+
+TEST(SanitizerCommon, TimingSampling) {
+  InitializeTiming(4);
+  ResetTimingStats();
+  EnterRegion(kTimingMalloc, 100);
+  EXPECT_EQ(25U, GetTimingCount(kTimingMalloc));
+  // Reports are timed on every entry.
+  EnterRegion(kTimingReport, 3);
+  EXPECT_EQ(3U, GetTimingCount(kTimingReport));
+  // The stats of finished threads are kept.
+  pthread_t t;
+  EXPECT_EQ(0, pthread_create(&t, 0, TimingThread, 0));
+  EXPECT_EQ(0, pthread_join(t, 0));
+  EXPECT_EQ(10U, GetTimingCount(kTimingFree));
+  ResetTimingStats();
+  EXPECT_EQ(0U, GetTimingCount(kTimingMalloc));
+  EXPECT_EQ(0U, GetTimingCount(kTimingFree));
+  InitializeTiming(0);
+  EnterRegion(kTimingReport, 3);
+  EXPECT_EQ(0U, GetTimingCount(kTimingReport));
+}
+#endif  // SANITIZER_CAN_USE_TIMING
+
+}  // namespace __sanitizer
@@ -0,0 +1,198 @@
+//===-- lib/truncsfhf2.c - single -> half conversion --------------*- C -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the single to half precision conversion, with the
+// algorithm of truncdfsf2.c in the default (round to nearest, ties to even)
+// rounding mode.  Half precision values are passed as their uint16_t
+// representation.  The F16C and ARM half-precision conversion instructions
+// are used when the target is known to have them.
+//
+//===----------------------------------------------------------------------===//
+
+#include "int_lib.h"
+#include <stddef.h>
+
+#if __F16C__
+#include <immintrin.h>
+#define HAVE_HW_F16 1
+#elif defined(__ARM_FP16_FORMAT_IEEE) && defined(__ARM_FP) && (__ARM_FP & 2)
+#define HAVE_HW_F16 1
+#else
+#define HAVE_HW_F16 0
+#endif
+
+#if HAVE_HW_F16 && defined(__ARM_NEON__) && defined(__ARM_NEON_FP) && \
+    (__ARM_NEON_FP & 2)
+#include <arm_neon.h>
+#define HAVE_NEON_F16 1
+#else
+#define HAVE_NEON_F16 0
+#endif
+
+typedef float src_t;
+typedef uint32_t src_rep_t;
+#define SRC_REP_C UINT32_C
+
+typedef uint16_t dst_t;
+typedef uint16_t dst_rep_t;
+#define DST_REP_C UINT16_C
+
+#if !HAVE_HW_F16
+static const int srcSigBits = 23;
+static const int dstSigBits = 10;
+
+static inline src_rep_t srcToRep(src_t x) {
+    const union { src_t f; src_rep_t i; } rep = {.f = x};
+    return rep.i;
+}
+
+static inline dst_t dstFromRep(dst_rep_t x) {
+    return x;
+}
+
+static inline dst_t truncsfhf2(src_t a) {
+    
+    // Various constants whose values follow from the type parameters.
+    // Any reasonable optimizer will fold and propagate all of these.
+    const int srcBits = sizeof(src_t)*CHAR_BIT;
+    const int srcExpBits = srcBits - srcSigBits - 1;
+    const int srcInfExp = (1 << srcExpBits) - 1;
+    const int srcExpBias = srcInfExp >> 1;
+    
+    const src_rep_t srcMinNormal = SRC_REP_C(1) << srcSigBits;
+    const src_rep_t significandMask = srcMinNormal - 1;
+    const src_rep_t srcInfinity = (src_rep_t)srcInfExp << srcSigBits;
+    const src_rep_t srcSignMask = SRC_REP_C(1) << (srcSigBits + srcExpBits);
+    const src_rep_t srcAbsMask = srcSignMask - 1;
+    const src_rep_t roundMask = (SRC_REP_C(1) << (srcSigBits - dstSigBits)) - 1;
+    const src_rep_t halfway = SRC_REP_C(1) << (srcSigBits - dstSigBits - 1);
+    
+    const int dstBits = sizeof(dst_t)*CHAR_BIT;
+    const int dstExpBits = dstBits - dstSigBits - 1;
+    const int dstInfExp = (1 << dstExpBits) - 1;
+    const int dstExpBias = dstInfExp >> 1;
+    
+    const int underflowExponent = srcExpBias + 1 - dstExpBias;
+    const int overflowExponent = srcExpBias + dstInfExp - dstExpBias;
+    const src_rep_t underflow = (src_rep_t)underflowExponent << srcSigBits;
+    const src_rep_t overflow = (src_rep_t)overflowExponent << srcSigBits;
+    
+    const dst_rep_t dstQNaN = DST_REP_C(1) << (dstSigBits - 1);
+    const dst_rep_t dstNaNCode = dstQNaN - 1;
+
+    // Break a into a sign and representation of the absolute value
+    const src_rep_t aRep = srcToRep(a);
+    const src_rep_t aAbs = aRep & srcAbsMask;
+    const src_rep_t sign = aRep & srcSignMask;
+    dst_rep_t absResult;
+    
+    if (aAbs - underflow < aAbs - overflow) {
+        // The exponent of a is within the range of normal numbers in the
+        // destination format.  We can convert by simply right-shifting with
+        // rounding and adjusting the exponent.
+        absResult = aAbs >> (srcSigBits - dstSigBits);
+        absResult -= (dst_rep_t)(srcExpBias - dstExpBias) << dstSigBits;
+        
+        const src_rep_t roundBits = aAbs & roundMask;
+        
+        // Round to nearest
+        if (roundBits > halfway)
+            absResult++;
+        
+        // Ties to even
+        else if (roundBits == halfway)
+            absResult += absResult & 1;
+    }
+    
+    else if (aAbs > srcInfinity) {
+        // a is NaN.
+        // Conjure the result by beginning with infinity, setting the qNaN
+        // bit and inserting the top bits of the trailing NaN field, as the
+        // hardware conversions do.
+        absResult = (dst_rep_t)dstInfExp << dstSigBits;
+        absResult |= dstQNaN;
+        absResult |= (aAbs >> (srcSigBits - dstSigBits)) & dstNaNCode;
+    }
+    
+    else if (aAbs >= overflow) {
+        // a overflows to infinity.
+        absResult = (dst_rep_t)dstInfExp << dstSigBits;
+    }
+    
+    else {
+        // a underflows on conversion to the destination type or is an exact
+        // zero.  The result may be a denormal or zero.  Extract the exponent
+        // to get the shift amount for the denormalization.
+        const int aExp = aAbs >> srcSigBits;
+        const int shift = srcExpBias - dstExpBias - aExp + 1;
+        
+        const src_rep_t significand = (aRep & significandMask) | srcMinNormal;
+        
+        // Right shift by the denormalization amount with sticky.
+        if (shift > srcSigBits) {
+            absResult = 0;
+        } else {
+            const bool sticky = significand << (srcBits - shift);
+            src_rep_t denormalizedSignificand = significand >> shift | sticky;
+            absResult = denormalizedSignificand >> (srcSigBits - dstSigBits);
+            const src_rep_t roundBits = denormalizedSignificand & roundMask;
+            // Round to nearest
+            if (roundBits > halfway)
+                absResult++;
+            // Ties to even
+            else if (roundBits == halfway)
+                absResult += absResult & 1;
+        }
+    }
+    
+    // Apply the signbit to (dst_t)abs(a).
+    const dst_rep_t result = absResult | sign >> (srcBits - dstBits);
+    return dstFromRep(result);
+}
+#endif
+
+static inline dst_t truncsfhf2_inline(src_t a) {
+#if __F16C__
+    return _cvtss_sh(a, _MM_FROUND_TO_NEAREST_INT);
+#elif HAVE_HW_F16
+    const union { __fp16 h; dst_rep_t i; } rep = {.h = a};
+    return rep.i;
+#else
+    return truncsfhf2(a);
+#endif
+}
+
+ARM_EABI_FNALIAS(f2h, truncsfhf2)
+
+COMPILER_RT_ABI dst_t
+__truncsfhf2(src_t a) {
+    return truncsfhf2_inline(a);
+}
+
+COMPILER_RT_ABI dst_t
+__gnu_f2h_ieee(src_t a) {
+    return truncsfhf2_inline(a);
+}
+
+// Converts count values from src to dst.
+void __truncsfhf2_array(dst_t *dst, const src_t *src, size_t count) {
+    size_t i = 0;
+#if __F16C__
+    for (; i + 4 <= count; i += 4)
+        _mm_storel_epi64((__m128i *)(dst + i),
+                         _mm_cvtps_ph(_mm_loadu_ps(src + i),
+                                      _MM_FROUND_TO_NEAREST_INT));
+#elif HAVE_NEON_F16
+    for (; i + 4 <= count; i += 4)
+        vst1_u16(dst + i,
+                 vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src + i))));
+#endif
+    for (; i < count; ++i)
+        dst[i] = truncsfhf2_inline(src[i]);
+}
@@ -22,6 +22,7 @@ SRCS="
 	../../sanitizer_common/sanitizer_printf.cc
 	../../sanitizer_common/sanitizer_suppressions.cc
 	../../sanitizer_common/sanitizer_thread_registry.cc
+	../../sanitizer_common/sanitizer_timing.cc
 "
 
 if [ "`uname -a | grep Linux`" != "" ]; then
@@ -24,6 +24,8 @@ void __tsan_func_enter(void *thr, void *pc);
 void __tsan_func_exit(void *thr);
 void __tsan_malloc(void *thr, void *p, unsigned long sz, void *pc);
 void __tsan_free(void *p);
+void __tsan_access_range_batch(void *thr, void *a, unsigned long n);
+void __tsan_malloc_batch(void *thr, void *m, unsigned long n);
 void __tsan_acquire(void *thr, void *addr);
 void __tsan_release(void *thr, void *addr);
 void __tsan_release_merge(void *thr, void *addr);
@@ -48,6 +50,13 @@ int main(void) {
   __tsan_acquire(thr1, buf);
   __tsan_go_end(thr1);
   __tsan_read(thr0, buf, 0);
+  unsigned long mallocs[] = {(unsigned long)buf, sizeof(buf), 0};
+  __tsan_malloc_batch(thr0, mallocs, 1);
+  unsigned long accesses[] = {
+    (unsigned long)buf, 4, 0, 1,
+    (unsigned long)buf + 4, 4, 0, 0,
+  };
+  __tsan_access_range_batch(thr0, accesses, 2);
   __tsan_free(buf);
   __tsan_func_exit(thr0);
   __tsan_fini();
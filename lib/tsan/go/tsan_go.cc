@@ -14,6 +14,7 @@
 #include "tsan_rtl.h"
 #include "tsan_symbolize.h"
 #include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_mutex.h"
 #include <stdlib.h>
 
 namespace __tsan {
@@ -74,17 +75,79 @@ ReportStack *SymbolizeCode(uptr addr) {
   return s;
 }
 
+// One element of a __tsan_access_range_batch call.
+// The layout must match the Go runtime.
+struct GoRangeAccess {
+  uptr addr;
+  uptr size;
+  uptr pc;
+  uptr is_write;
+};
+
+// One element of a __tsan_malloc_batch call.
+struct GoMalloc {
+  uptr p;
+  uptr size;
+  uptr pc;
+};
+
 extern "C" {
 
 static ThreadState *main_thr;
 
+// States of finished goroutines, linked through their first word. Programs
+// that start lots of short goroutines would otherwise allocate and clear
+// the whole state, mostly the 128K vector clock, for each of them.
+static const uptr kMaxFreeGoroutines = 1024;
+static StaticSpinMutex free_goroutines_mu;
+static ThreadState *free_goroutines;
+static uptr free_goroutine_count;
+
 static ThreadState *AllocGoroutine() {
-  ThreadState *thr = (ThreadState*)internal_alloc(MBlockThreadContex,
-      sizeof(ThreadState));
-  internal_memset(thr, 0, sizeof(*thr));
+  ThreadState *thr = 0;
+  {
+    SpinMutexLock l(&free_goroutines_mu);
+    thr = free_goroutines;
+    if (thr) {
+      free_goroutines = *(ThreadState**)thr;
+      free_goroutine_count--;
+    }
+  }
+  if (thr == 0) {
+    thr = (ThreadState*)internal_alloc(MBlockThreadContex,
+        sizeof(ThreadState));
+    internal_memset(thr, 0, sizeof(*thr));
+    return thr;
+  }
+  // The used part of the clock was cleared when the goroutine finished
+  // (see ThreadContext::OnFinished), the rest is cleared here, except for
+  // the shadow stack which is reused as well.
+  uptr *shadow_stack = thr->shadow_stack;
+  uptr *shadow_stack_end = thr->shadow_stack_end;
+  char *beg = (char*)thr;
+  char *clock_beg = (char*)&thr->clock;
+  char *clock_end = clock_beg + sizeof(thr->clock);
+  internal_memset(beg, 0, clock_beg - beg);
+  internal_memset(clock_end, 0, beg + sizeof(*thr) - clock_end);
+  thr->shadow_stack = shadow_stack;
+  thr->shadow_stack_end = shadow_stack_end;
   return thr;
 }
 
+static void FreeGoroutine(ThreadState *thr) {
+  {
+    SpinMutexLock l(&free_goroutines_mu);
+    if (free_goroutine_count < kMaxFreeGoroutines) {
+      *(ThreadState**)thr = free_goroutines;
+      free_goroutines = thr;
+      free_goroutine_count++;
+      return;
+    }
+  }
+  internal_free(thr->shadow_stack);
+  internal_free(thr);
+}
+
 void __tsan_init(ThreadState **thrp) {
   ThreadState *thr = AllocGoroutine();
   main_thr = *thrp = thr;
@@ -126,6 +189,13 @@ void __tsan_write_range(ThreadState *thr, void *addr, uptr size, uptr step,
   MemoryAccessRange(thr, (uptr)pc, (uptr)addr, size, true);
 }
 
+// The Go runtime may buffer independent range accesses of a goroutine
+// (e.g. until function exit) and flush them with one call.
+void __tsan_access_range_batch(ThreadState *thr, GoRangeAccess *a, uptr n) {
+  for (uptr i = 0; i < n; i++)
+    MemoryAccessRange(thr, a[i].pc, a[i].addr, a[i].size, a[i].is_write);
+}
+
 void __tsan_func_enter(ThreadState *thr, void *pc) {
   FuncEntry(thr, (uptr)pc);
 }
@@ -142,6 +212,15 @@ void __tsan_malloc(ThreadState *thr, void *p, uptr sz, void *pc) {
   thr->in_rtl--;
 }
 
+void __tsan_malloc_batch(ThreadState *thr, GoMalloc *m, uptr n) {
+  if (thr == 0)  // probably before __tsan_init()
+    return;
+  thr->in_rtl++;
+  for (uptr i = 0; i < n; i++)
+    MemoryResetRange(thr, m[i].pc, m[i].p, m[i].size);
+  thr->in_rtl--;
+}
+
 void __tsan_free(void *p) {
   (void)p;
 }
@@ -161,7 +240,7 @@ void __tsan_go_end(ThreadState *thr) {
   thr->in_rtl++;
   ThreadFinish(thr);
   thr->in_rtl--;
-  internal_free(thr);
+  FreeGoroutine(thr);
 }
 
 void __tsan_acquire(ThreadState *thr, void *addr) {
@@ -0,0 +1,43 @@
+// RUN: %clangxx_tsan -O1 %s -o %t && %t 2>&1 | FileCheck %s --check-prefix=SHARED
+// RUN: TSAN_OPTIONS="$TSAN_OPTIONS io_sync=3" not %t 2>&1 | FileCheck %s --check-prefix=PRECISE
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+int X;
+int fd1, fd2;
+
+void *Thread1(void *x) {
+  X = 42;
+  write(fd1, "a", 1);
+  return NULL;
+}
+
+void *Thread2(void *x) {
+  sleep(1);
+  char c;
+  read(fd2, &c, 1);
+  X = 43;
+  return NULL;
+}
+
+int main() {
+  // All files synchronize through one object by default,
+  // but not with io_sync=3.
+  fd1 = open("/dev/null", O_WRONLY);
+  fd2 = open("/dev/null", O_RDONLY);
+  pthread_t t[2];
+  pthread_create(&t[0], NULL, Thread1, NULL);
+  pthread_create(&t[1], NULL, Thread2, NULL);
+  pthread_join(t[0], NULL);
+  pthread_join(t[1], NULL);
+  close(fd1);
+  close(fd2);
+  printf("OK\n");
+}
+
+// SHARED-NOT: WARNING: ThreadSanitizer: data race
+// SHARED: OK
+// PRECISE: WARNING: ThreadSanitizer: data race
+// PRECISE: OK
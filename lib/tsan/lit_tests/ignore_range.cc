@@ -0,0 +1,36 @@
+// RUN: %clang_tsan -O1 %s -o %t && %t 2>&1 | FileCheck %s
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+long Stats[4];
+long Global;
+
+extern "C" void AnnotateIgnoreRangeBegin(const char *f, int l,
+                                         void *mem, unsigned long size);
+extern "C" void AnnotateIgnoreRangeEnd(const char *f, int l,
+                                       void *mem, unsigned long size);
+
+void *Thread(void *x) {
+  Stats[1]++;
+  Global = 42;
+  return 0;
+}
+
+int main() {
+  AnnotateIgnoreRangeBegin(__FILE__, __LINE__, Stats, sizeof(Stats));
+  pthread_t t;
+  pthread_create(&t, 0, Thread, 0);
+  sleep(1);
+  Stats[1]++;
+  Global = 43;
+  pthread_join(t, 0);
+  AnnotateIgnoreRangeEnd(__FILE__, __LINE__, Stats, sizeof(Stats));
+  printf("OK\n");
+}
+
+// Only the race on Global is reported.
+// CHECK: WARNING: ThreadSanitizer: data race
+// CHECK: Location is global 'Global'
+// CHECK-NOT: WARNING: ThreadSanitizer: data race
+// CHECK: OK
@@ -0,0 +1,30 @@
+// RUN: %clang_tsan -O1 %s -o %t && %t 2>&1 | FileCheck %s
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+long Counter;
+
+extern "C" void AnnotateThreadIgnoreBegin(const char *f, int l,
+                                          void *mem, unsigned long size);
+extern "C" void AnnotateThreadIgnoreEnd(const char *f, int l,
+                                        void *mem, unsigned long size);
+
+void *Thread(void *x) {
+  AnnotateThreadIgnoreBegin(__FILE__, __LINE__, &Counter, sizeof(Counter));
+  Counter++;
+  AnnotateThreadIgnoreEnd(__FILE__, __LINE__, &Counter, sizeof(Counter));
+  return 0;
+}
+
+int main() {
+  pthread_t t;
+  pthread_create(&t, 0, Thread, 0);
+  sleep(1);
+  Counter++;
+  pthread_join(t, 0);
+  printf("OK\n");
+}
+
+// CHECK-NOT: WARNING: ThreadSanitizer: data race
+// CHECK: OK
@@ -10,6 +10,8 @@ int  __tsan_java_fini();
 void __tsan_java_alloc(jptr ptr, jptr size);
 void __tsan_java_free(jptr ptr, jptr size);
 void __tsan_java_move(jptr src, jptr dst, jptr size);
+void __tsan_java_free_batch(const jptr *frees, jptr n);
+void __tsan_java_move_batch(const jptr *moves, jptr n);
 void __tsan_java_mutex_lock(jptr addr);
 void __tsan_java_mutex_unlock(jptr addr);
 void __tsan_java_mutex_read_lock(jptr addr);
@@ -0,0 +1,40 @@
+// RUN: %clangxx_tsan -O1 %s -o %t && not %t 2>&1 | FileCheck %s
+#include "java.h"
+
+jptr varaddr;
+jptr varaddr2;
+
+void *Thread(void *p) {
+  sleep(1);
+  *(int*)varaddr2 = 42;
+  return 0;
+}
+
+int main() {
+  int const kHeapSize = 1024 * 1024;
+  void *jheap = malloc(kHeapSize);
+  __tsan_java_init((jptr)jheap, kHeapSize);
+  const int kBlockSize = 64;
+  int const kMove = 1024;
+  __tsan_java_alloc((jptr)jheap, kBlockSize);
+  __tsan_java_alloc((jptr)jheap + kBlockSize, kBlockSize);
+  varaddr = (jptr)jheap + 16;
+  varaddr2 = varaddr + kMove;
+  pthread_t th;
+  pthread_create(&th, 0, Thread, 0);
+  *(int*)varaddr = 43;
+  jptr moves[] = {
+    (jptr)jheap, (jptr)jheap + kMove, kBlockSize,
+    (jptr)jheap + kBlockSize, (jptr)jheap + kMove + kBlockSize, kBlockSize,
+  };
+  __tsan_java_move_batch(moves, 2);
+  pthread_join(th, 0);
+  jptr frees[] = {
+    (jptr)jheap + kMove, kBlockSize,
+    (jptr)jheap + kMove + kBlockSize, kBlockSize,
+  };
+  __tsan_java_free_batch(frees, 2);
+  return __tsan_java_fini();
+}
+
+// CHECK: WARNING: ThreadSanitizer: data race
@@ -0,0 +1,44 @@
+// RUN: %clangxx_tsan -O1 %s -o %t
+// RUN: rm -f %t.log.*
+// RUN: TSAN_OPTIONS="$TSAN_OPTIONS report_log_path=%t.log" not %t 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=CHECK-RUN
+// RUN: %tsan_symbolize_report_log %t.log.* | FileCheck %s
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+int Global;
+
+void *Thread1(void *x) {
+  Global = 42;
+  return NULL;
+}
+
+void *Thread2(void *x) {
+  sleep(1);
+  Global = 43;
+  return NULL;
+}
+
+int main() {
+  pthread_t t[2];
+  pthread_create(&t[0], NULL, Thread1, NULL);
+  pthread_create(&t[1], NULL, Thread2, NULL);
+  pthread_join(t[0], NULL);
+  pthread_join(t[1], NULL);
+  fprintf(stderr, "DONE\n");
+}
+
+// The report goes only to the log.
+// CHECK-RUN-NOT: WARNING: ThreadSanitizer
+// CHECK-RUN: DONE
+
+// CHECK: WARNING: ThreadSanitizer: data race (pid={{[0-9]+}})
+// CHECK:   Write of size 4 at {{.*}} by thread T2:
+// CHECK:     #0 Thread2{{.*}} {{.*}}report_log.cc:19
+// CHECK:   Previous write of size 4 at {{.*}} by thread T1:
+// CHECK:     #0 Thread1{{.*}} {{.*}}report_log.cc:13
+// CHECK:   Thread T2 (tid={{[0-9]+}}, running) created by main thread at:
+// CHECK:     #1 main {{.*}}report_log.cc:26
+// CHECK:   Thread T1 (tid={{[0-9]+}}, finished) created by main thread at:
+// CHECK:     #1 main {{.*}}report_log.cc:25
@@ -12,92 +12,316 @@
 //===----------------------------------------------------------------------===//
 #include "tsan_clock.h"
 #include "tsan_rtl.h"
+#include "sanitizer_common/sanitizer_atomic.h"
 
-// It's possible to optimize clock operations for some important cases
-// so that they are O(1). The cases include singletons, once's, local mutexes.
-// First, SyncClock must be re-implemented to allow indexing by tid.
-// It must not necessarily be a full vector clock, though. For example it may
-// be a multi-level table.
-// Then, each slot in SyncClock must contain a dirty bit (it's united with
-// the clock value, so no space increase). The acquire algorithm looks
-// as follows:
-// void acquire(thr, tid, thr_clock, sync_clock) {
-//   if (!sync_clock[tid].dirty)
-//     return;  // No new info to acquire.
-//              // This handles constant reads of singleton pointers and
-//              // stop-flags.
-//   acquire_impl(thr_clock, sync_clock);  // As usual, O(N).
-//   sync_clock[tid].dirty = false;
-//   sync_clock.dirty_count--;
-// }
-// The release operation looks as follows:
-// void release(thr, tid, thr_clock, sync_clock) {
-//   // thr->sync_cache is a simple fixed-size hash-based cache that holds
-//   // several previous sync_clock's.
-//   if (thr->sync_cache[sync_clock] >= thr->last_acquire_epoch) {
-//     // The thread did no acquire operations since last release on this clock.
-//     // So update only the thread's slot (other slots can't possibly change).
-//     sync_clock[tid].clock = thr->epoch;
-//     if (sync_clock.dirty_count == sync_clock.cnt
-//         || (sync_clock.dirty_count == sync_clock.cnt - 1
-//           && sync_clock[tid].dirty == false))
-//       // All dirty flags are set, bail out.
-//       return;
-//     set all dirty bits, but preserve the thread's bit.  // O(N)
-//     update sync_clock.dirty_count;
-//     return;
-//   }
-//   release_impl(thr_clock, sync_clock);  // As usual, O(N).
-//   set all dirty bits, but preserve the thread's bit.
-//   // The previous step is combined with release_impl(), so that
-//   // we scan the arrays only once.
-//   update sync_clock.dirty_count;
-// }
+// SyncClock is a dense vector of epochs indexed by tid. Full (O(N))
+// acquire and release operations are avoided in the following cases.
+//
+// Release. If a thread did not acquire anything since its last release
+// on a clock, its other entries can't be newer than the clock's ones,
+// so only the thread's own entry needs to be updated. A thread knows
+// that if the clock's entry for the thread is newer than the thread's
+// epoch at its last acquire operation (last_acquire_). The same holds
+// for release-store, if the last release operation on the clock
+// was the release-store by the same thread (release_store_tid_).
+//
+// Acquire. Each entry holds an 'acquired' mark (the reused field), that
+// is set when the thread with this tid has acquired the whole clock.
+// Release operations that update only entries listed in dirty_tids_
+// preserve the marks, the rest reset all marks. So if the mark is set,
+// it is enough to acquire the dirty entries. This handles repeated
+// acquires of singletons, once's, stop-flags and local mutexes.
+// While no mark is set (has_marks_), releases need not track dirty
+// entries, so a series of own-entry updates after a reset is O(1) each.
+//
+// The mark holds the reuse count of the thread (+1), so that a new
+// thread with the same tid does not inherit marks of the previous one.
+//
+// Release-store does not copy the clock. Instead the thread takes a
+// snapshot of its clock without its own entry (ClockBlock), and the sync
+// clock references the snapshot and holds the own entry separately
+// (store_epoch_). The snapshot stays valid until the thread acquires
+// something, so sequences of release-stores by the same thread (e.g. to
+// different atomics) share it. A thread that has acquired a snapshot
+// needs to acquire only the own entry of the storing thread next time.
+// Other release operations copy the snapshot into the sync clock first.
+//
+// Barriers. Each thread arriving at a barrier releases into its clock,
+// after the previous round acquired it. The release fast path does not
+// apply, as the thread did acquire (the barrier itself) since its last
+// release. The caller knows better (see BarrierRelease) and uses
+// ReleaseOwnEntry, so a round of N threads costs O(N) under the sync
+// variable lock instead of O(N^2). The acquires that end the round are
+// still O(N) each, but they run in parallel under the read lock.
 
 namespace __tsan {
 
-ThreadClock::ThreadClock() {
+struct ClockBlock {
+  atomic_uint32_t refs;
+  u32 size;
+  u64 clk[1];  // size elements
+};
+
+static ClockBlock *AllocClockBlock(uptr size) {
+  CHECK_GT(size, 0);
+  ClockBlock *b = (ClockBlock*)internal_alloc(MBlockClock,
+      sizeof(ClockBlock) + (size - 1) * sizeof(b->clk[0]));
+  atomic_store(&b->refs, 1, memory_order_relaxed);
+  b->size = size;
+  return b;
+}
+
+static void RefClockBlock(ClockBlock *b) {
+  atomic_fetch_add(&b->refs, 1, memory_order_relaxed);
+}
+
+static void UnrefClockBlock(ClockBlock *b) {
+  if (b && atomic_fetch_sub(&b->refs, 1, memory_order_acq_rel) == 1)
+    internal_free(b);
+}
+
+ThreadClock::ThreadClock(unsigned tid, unsigned reused, bool zeroed)
+    : tid_(tid)
+    , reused_(reused + 1) {  // 0 has special meaning
+  CHECK(tid_ == kInvalidTid || tid_ < kMaxTid);
+  last_acquire_ = 0;
+  acquire_seq_ = 0;
+  cached_ = 0;
+  cached_seq_ = 0;
+  acquired_ = 0;
   nclk_ = 0;
+  if (zeroed) {
+#if TSAN_DEBUG
+    for (uptr i = 0; i < (uptr)kMaxTidInClock; i++)
+      CHECK_EQ(clk_[i], 0);
+#endif
+    return;
+  }
   for (uptr i = 0; i < (uptr)kMaxTidInClock; i++)
     clk_[i] = 0;
 }
 
-void ThreadClock::acquire(const SyncClock *src) {
+ThreadClock::~ThreadClock() {
+  UnrefClockBlock(cached_);
+  UnrefClockBlock(acquired_);
+}
+
+void ThreadClock::ClearForReuse() {
+  // All non-zero values are below nclk_, see set/tick/acquire.
+  for (uptr i = 0; i < nclk_; i++)
+    clk_[i] = 0;
+  nclk_ = 0;
+}
+
+void ThreadClock::acquire(SyncClock *src) {
   DCHECK(nclk_ <= kMaxTid);
-  DCHECK(src->clk_.Size() <= kMaxTid);
+  DCHECK(src->size() <= kMaxTid);
 
+  if (src->shared_) {
+    AcquireShared(src);
+    return;
+  }
   const uptr nclk = src->clk_.Size();
   if (nclk == 0)
     return;
+
+  // Check if we've already acquired src after the last release
+  // operation that reset the marks. If so, only the dirty entries
+  // can be newer.
+  if (HasOwner() && tid_ < nclk && src->clk_[tid_].reused == reused_) {
+    bool acquired = false;
+    for (uptr i = 0; i < SyncClock::kDirtyTids; i++) {
+      unsigned tid = src->dirty_tids_[i];
+      if (tid == kInvalidTid)
+        continue;
+      u64 epoch = src->clk_[tid].epoch;
+      if (clk_[tid] < epoch) {
+        clk_[tid] = epoch;
+        if (nclk_ <= tid)
+          nclk_ = tid + 1;
+        acquired = true;
+      }
+    }
+    if (acquired)
+      UpdateLastAcquire();
+    return;
+  }
+
+  // O(N) acquire.
+  bool acquired = false;
   nclk_ = max(nclk_, nclk);
   for (uptr i = 0; i < nclk; i++) {
-    if (clk_[i] < src->clk_[i])
-      clk_[i] = src->clk_[i];
+    u64 epoch = src->clk_[i].epoch;
+    if (clk_[i] < epoch) {
+      clk_[i] = epoch;
+      acquired = true;
+    }
+  }
+  if (acquired)
+    UpdateLastAcquire();
+  // Remember that this thread has acquired this clock.
+  if (HasOwner() && tid_ < nclk) {
+    src->clk_[tid_].reused = reused_;
+    src->has_marks_ = true;
   }
 }
 
+void ThreadClock::AcquireShared(SyncClock *src) {
+  ClockBlock *b = src->shared_;
+  bool acquired = false;
+  if (b != acquired_) {
+    // O(N) acquire.
+    nclk_ = max(nclk_, (uptr)b->size);
+    for (uptr i = 0; i < b->size; i++) {
+      if (clk_[i] < b->clk[i]) {
+        clk_[i] = b->clk[i];
+        acquired = true;
+      }
+    }
+    RefClockBlock(b);
+    UnrefClockBlock(acquired_);
+    acquired_ = b;
+  }
+  const unsigned tid = src->release_store_tid_;
+  if (clk_[tid] < src->store_epoch_) {
+    clk_[tid] = src->store_epoch_;
+    if (nclk_ <= tid)
+      nclk_ = tid + 1;
+    acquired = true;
+  }
+  if (acquired)
+    UpdateLastAcquire();
+}
+
 void ThreadClock::release(SyncClock *dst) const {
   DCHECK(nclk_ <= kMaxTid);
-  DCHECK(dst->clk_.Size() <= kMaxTid);
+  DCHECK(dst->size() <= kMaxTid);
+
+  if (dst->shared_) {
+    // Same as the release-store fast path below.
+    if (HasOwner() && dst->release_store_tid_ == tid_ &&
+        dst->release_store_reused_ == reused_ &&
+        dst->store_epoch_ > last_acquire_) {
+      dst->store_epoch_ = clk_[tid_];
+      return;
+    }
+    dst->Unshare();
+  }
+
+  if (dst->clk_.Size() == 0) {
+    // ReleaseStore will correctly set release_store_tid_,
+    // which can be important for future operations.
+    ReleaseStore(dst);
+    return;
+  }
 
   if (dst->clk_.Size() < nclk_)
     dst->clk_.Resize(nclk_);
+
+  // Check if we had not acquired anything from other threads
+  // since the last release on dst. If so, we need to update
+  // only dst->clk_[tid_].
+  if (HasOwner() && tid_ < dst->clk_.Size() &&
+      dst->clk_[tid_].epoch > last_acquire_) {
+    UpdateCurrentThread(dst);
+    if (dst->release_store_tid_ != tid_ ||
+        dst->release_store_reused_ != reused_)
+      dst->release_store_tid_ = kInvalidTid;
+    return;
+  }
+
+  // O(N) release.
+  // First, remember whether we've acquired dst.
+  bool acquired = IsAlreadyAcquired(dst);
+  // Update dst->clk_ and reset all 'acquired' marks.
   for (uptr i = 0; i < nclk_; i++) {
-    if (dst->clk_[i] < clk_[i])
-      dst->clk_[i] = clk_[i];
+    ClockElem &ce = dst->clk_[i];
+    if (ce.epoch < clk_[i])
+      ce.epoch = clk_[i];
+    ce.reused = 0;
   }
+  for (uptr i = nclk_; i < dst->clk_.Size(); i++)
+    dst->clk_[i].reused = 0;
+  for (uptr i = 0; i < SyncClock::kDirtyTids; i++)
+    dst->dirty_tids_[i] = kInvalidTid;
+  dst->release_store_tid_ = kInvalidTid;
+  dst->release_store_reused_ = 0;
+  dst->has_marks_ = acquired;
+  // If we've acquired dst before, we still do, since the release
+  // did not add anything we don't know.
+  if (acquired)
+    dst->clk_[tid_].reused = reused_;
 }
 
 void ThreadClock::ReleaseStore(SyncClock *dst) const {
   DCHECK(nclk_ <= kMaxTid);
-  DCHECK(dst->clk_.Size() <= kMaxTid);
+  DCHECK(dst->size() <= kMaxTid);
+
+  // Check if the last release operation on dst was a release-store
+  // by this thread and we did not acquire anything since then.
+  // If so, dst already holds our clock except for our own entry.
+  if (HasOwner() && dst->release_store_tid_ == tid_ &&
+      dst->release_store_reused_ == reused_) {
+    if (dst->shared_) {
+      if (dst->store_epoch_ > last_acquire_) {
+        dst->store_epoch_ = clk_[tid_];
+        return;
+      }
+    } else if (tid_ < dst->clk_.Size() &&
+               dst->clk_[tid_].epoch > last_acquire_) {
+      UpdateCurrentThread(dst);
+      return;
+    }
+  }
 
+  if (HasOwner()) {
+    // Reference the snapshot of our clock instead of copying it.
+    ClockBlock *b = GetSnapshot();
+    RefClockBlock(b);
+    UnrefClockBlock(dst->shared_);
+    dst->shared_ = b;
+    dst->store_epoch_ = clk_[tid_];
+    dst->clk_.Reset();
+    for (uptr i = 0; i < SyncClock::kDirtyTids; i++)
+      dst->dirty_tids_[i] = kInvalidTid;
+    dst->has_marks_ = false;
+    dst->release_store_tid_ = tid_;
+    dst->release_store_reused_ = reused_;
+    return;
+  }
+
+  // O(N) release-store.
+  dst->Unshare();
   if (dst->clk_.Size() < nclk_)
     dst->clk_.Resize(nclk_);
-  for (uptr i = 0; i < nclk_; i++)
-    dst->clk_[i] = clk_[i];
-  for (uptr i = nclk_; i < dst->clk_.Size(); i++)
-    dst->clk_[i] = 0;
+  for (uptr i = 0; i < nclk_; i++) {
+    dst->clk_[i].epoch = clk_[i];
+    dst->clk_[i].reused = 0;
+  }
+  for (uptr i = nclk_; i < dst->clk_.Size(); i++) {
+    dst->clk_[i].epoch = 0;
+    dst->clk_[i].reused = 0;
+  }
+  for (uptr i = 0; i < SyncClock::kDirtyTids; i++)
+    dst->dirty_tids_[i] = kInvalidTid;
+  dst->has_marks_ = false;
+  dst->release_store_tid_ = kInvalidTid;
+  dst->release_store_reused_ = 0;
+}
+
+// Returns the snapshot of the clock without the own entry,
+// creating a new one if the clock has changed since the last snapshot.
+ClockBlock *ThreadClock::GetSnapshot() const {
+  if (cached_ && cached_seq_ == acquire_seq_)
+    return cached_;
+  UnrefClockBlock(cached_);
+  const uptr size = max(nclk_, (uptr)tid_ + 1);
+  cached_ = AllocClockBlock(size);
+  for (uptr i = 0; i < size; i++)
+    cached_->clk[i] = clk_[i];
+  cached_->clk[tid_] = 0;
+  cached_seq_ = acquire_seq_;
+  return cached_;
 }
 
 void ThreadClock::acq_rel(SyncClock *dst) {
@@ -105,7 +329,109 @@ void ThreadClock::acq_rel(SyncClock *dst) {
   release(dst);
 }
 
+void ThreadClock::ReleaseOwnEntry(SyncClock *dst) const {
+  if (!HasOwner() || dst->shared_ || tid_ >= dst->clk_.Size()) {
+    release(dst);
+    return;
+  }
+  UpdateCurrentThread(dst);
+  if (dst->release_store_tid_ != tid_ ||
+      dst->release_store_reused_ != reused_)
+    dst->release_store_tid_ = kInvalidTid;
+}
+
+// Updates only the thread's own entry in dst, preserving the 'acquired'
+// marks if possible.
+void ThreadClock::UpdateCurrentThread(SyncClock *dst) const {
+  dst->clk_[tid_].epoch = clk_[tid_];
+  if (!dst->has_marks_)
+    return;
+  for (uptr i = 0; i < SyncClock::kDirtyTids; i++) {
+    if (dst->dirty_tids_[i] == tid_)
+      return;
+    if (dst->dirty_tids_[i] == kInvalidTid) {
+      dst->dirty_tids_[i] = tid_;
+      return;
+    }
+  }
+  // No free dirty slots, reset all 'acquired' marks, O(N).
+  bool acquired = IsAlreadyAcquired(dst);
+  for (uptr i = 0; i < dst->clk_.Size(); i++)
+    dst->clk_[i].reused = 0;
+  for (uptr i = 0; i < SyncClock::kDirtyTids; i++)
+    dst->dirty_tids_[i] = kInvalidTid;
+  dst->has_marks_ = acquired;
+  if (acquired)
+    dst->clk_[tid_].reused = reused_;
+}
+
+// Checks whether this thread has acquired everything that is in src.
+bool ThreadClock::IsAlreadyAcquired(const SyncClock *src) const {
+  if (!HasOwner() || tid_ >= src->clk_.Size() ||
+      src->clk_[tid_].reused != reused_)
+    return false;
+  for (uptr i = 0; i < SyncClock::kDirtyTids; i++) {
+    unsigned tid = src->dirty_tids_[i];
+    if (tid != kInvalidTid && clk_[tid] < src->clk_[tid].epoch)
+      return false;
+  }
+  return true;
+}
+
 SyncClock::SyncClock()
-  : clk_(MBlockClock) {
+    : release_store_tid_(kInvalidTid)
+    , release_store_reused_()
+    , has_marks_()
+    , shared_()
+    , store_epoch_()
+    , clk_(MBlockClock) {
+  for (uptr i = 0; i < kDirtyTids; i++)
+    dirty_tids_[i] = kInvalidTid;
+}
+
+SyncClock::~SyncClock() {
+  UnrefClockBlock(shared_);
+}
+
+uptr SyncClock::size() const {
+  return shared_ ? shared_->size : clk_.Size();
+}
+
+u64 SyncClock::get(unsigned tid) const {
+  DCHECK_LT(tid, size());
+  if (shared_)
+    return tid == release_store_tid_ ? store_epoch_ : shared_->clk[tid];
+  return clk_[tid].epoch;
+}
+
+// Copies the shared snapshot into clk_, so that the clock can be modified.
+void SyncClock::Unshare() {
+  ClockBlock *b = shared_;
+  if (b == 0)
+    return;
+  DCHECK_EQ(clk_.Size(), 0);
+  clk_.Resize(b->size);
+  for (uptr i = 0; i < b->size; i++)
+    clk_[i].epoch = b->clk[i];
+  clk_[release_store_tid_].epoch = store_epoch_;
+  // The storing thread knows everything in the clock.
+  clk_[release_store_tid_].reused = release_store_reused_;
+  for (uptr i = 0; i < kDirtyTids; i++)
+    dirty_tids_[i] = kInvalidTid;
+  has_marks_ = true;
+  shared_ = 0;
+  UnrefClockBlock(b);
+}
+
+void SyncClock::Reset() {
+  UnrefClockBlock(shared_);
+  shared_ = 0;
+  store_epoch_ = 0;
+  clk_.Reset();
+  release_store_tid_ = kInvalidTid;
+  release_store_reused_ = 0;
+  for (uptr i = 0; i < kDirtyTids; i++)
+    dirty_tids_[i] = kInvalidTid;
+  has_marks_ = false;
 }
 }  // namespace __tsan
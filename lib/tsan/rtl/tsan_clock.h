@@ -18,28 +18,65 @@
 
 namespace __tsan {
 
+struct ClockElem {
+  u64 epoch  : kClkBits;
+  // Non-zero if the thread with this tid has acquired the whole clock
+  // (holds the ThreadClock::reused_ value of that thread).
+  u64 reused : 64 - kClkBits;
+};
+
+// Immutable reference-counted copy of a thread clock without the
+// thread's own entry, shared between sync clocks (see tsan_clock.cc).
+struct ClockBlock;
+
 // The clock that lives in sync variables (mutexes, atomics, etc).
 class SyncClock {
  public:
   SyncClock();
+  ~SyncClock();
 
-  uptr size() const {
-    return clk_.Size();
-  }
-
-  void Reset() {
-    clk_.Reset();
-  }
+  uptr size() const;
+  u64 get(unsigned tid) const;
+  void Reset();
 
  private:
-  Vector<u64> clk_;
+  // Number of entries that can be updated by release operations
+  // without resetting the 'acquired' marks of all threads.
+  static const uptr kDirtyTids = 2;
+
+  // The thread that did the last release-store, kInvalidTid if there was
+  // another release operation after it.
+  unsigned release_store_tid_;
+  unsigned release_store_reused_;
+  // Entries updated since the 'acquired' marks were reset.
+  unsigned dirty_tids_[kDirtyTids];
+  // Cleared when all 'acquired' marks are reset, set when one is set.
+  // While it is clear, updates need not be listed in dirty_tids_.
+  bool has_marks_;
+  // If set, the clock is shared_ with the entry of release_store_tid_
+  // replaced with store_epoch_, and clk_ is empty.
+  ClockBlock *shared_;
+  u64 store_epoch_;
+  Vector<ClockElem> clk_;
+
+  void Unshare();
   friend struct ThreadClock;
 };
 
 // The clock that lives in threads.
 struct ThreadClock {
  public:
-  ThreadClock();
+  // tid is the owner thread, kInvalidTid for clocks that are not
+  // used for synchronization by a thread. reused must be distinct for
+  // all threads that ever had the same tid.
+  // If zeroed is set, the object is constructed in zero-initialized memory,
+  // and the (large) array of clock values is not cleared again.
+  explicit ThreadClock(unsigned tid = kInvalidTid, unsigned reused = 0,
+                       bool zeroed = false);
+  ~ThreadClock();
+  // Zeroes the used prefix of the clock values, so that the memory can be
+  // reused for a clock constructed with zeroed set.
+  void ClearForReuse();
 
   u64 get(unsigned tid) const {
     DCHECK_LT(tid, kMaxTidInClock);
@@ -52,6 +89,8 @@ struct ThreadClock {
     clk_[tid] = v;
     if (nclk_ <= tid)
       nclk_ = tid + 1;
+    if (tid != tid_)
+      UpdateLastAcquire();
   }
 
   void tick(unsigned tid) {
@@ -59,20 +98,56 @@ struct ThreadClock {
     clk_[tid]++;
     if (nclk_ <= tid)
       nclk_ = tid + 1;
+    if (tid != tid_)
+      UpdateLastAcquire();
   }
 
   uptr size() const {
     return nclk_;
   }
 
-  void acquire(const SyncClock *src);
+  // Changes whenever an entry of another thread changes.
+  u64 acquire_seq() const {
+    return acquire_seq_;
+  }
+
+  void acquire(SyncClock *src);
   void release(SyncClock *dst) const;
   void acq_rel(SyncClock *dst);
   void ReleaseStore(SyncClock *dst) const;
+  // Same as release, for a thread that is known to have acquired
+  // everything in dst except for its own entry (e.g. it has not acquired
+  // anything else since it acquired dst). Only the own entry is updated.
+  void ReleaseOwnEntry(SyncClock *dst) const;
 
  private:
+  const unsigned tid_;
+  const unsigned reused_;
+  // Own epoch at the last acquire that changed the clock.
+  u64 last_acquire_;
+  // Number of acquires that changed the clock.
+  u64 acquire_seq_;
+  // Snapshot of the clock for release-store, valid if no acquires
+  // changed the clock since it was taken (at acquire_seq_ == cached_seq_).
+  mutable ClockBlock *cached_;
+  mutable u64 cached_seq_;
+  // Shared clock block that was fully acquired last.
+  ClockBlock *acquired_;
   uptr nclk_;
   u64 clk_[kMaxTidInClock];
+
+  bool HasOwner() const {
+    return tid_ != kInvalidTid;
+  }
+  void UpdateLastAcquire() {
+    acquire_seq_++;
+    if (HasOwner())
+      last_acquire_ = clk_[tid_];
+  }
+  ClockBlock *GetSnapshot() const;
+  void AcquireShared(SyncClock *src);
+  bool IsAlreadyAcquired(const SyncClock *src) const;
+  void UpdateCurrentThread(SyncClock *dst) const;
 };
 
 }  // namespace __tsan
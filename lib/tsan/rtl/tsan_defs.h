@@ -22,6 +22,15 @@
 #define TSAN_DEBUG 0
 #endif  // TSAN_DEBUG
 
+// Check shadow values with SSE2 vector compares in MemoryAccessImpl.
+#ifndef TSAN_VECTORIZE
+# if defined(__SSE2__)
+#  define TSAN_VECTORIZE 1
+# else
+#  define TSAN_VECTORIZE 0
+# endif
+#endif  // TSAN_VECTORIZE
+
 namespace __tsan {
 
 #ifdef TSAN_GO
@@ -37,25 +46,37 @@ const char *const kTsanOptionsEnv = "TSAN_OPTIONS";
 #define CPP_WEAK WEAK
 #endif
 
-const int kTidBits = 13;
+// Number of bits of a tid, i.e. the limit of the simultaneously existing
+// threads. Selected at build time (TSAN_TID_BITS=15 allows 32768 threads).
+// The tid and the epoch share a shadow value, so every additional tid bit
+// halves the number of epochs, and each thread clock doubles.
+#ifndef TSAN_TID_BITS
+# define TSAN_TID_BITS 13
+#endif
+#if TSAN_TID_BITS < 13 || TSAN_TID_BITS > 15
+# error "TSAN_TID_BITS must be in [13, 15]"
+#endif
+const int kTidBits = TSAN_TID_BITS;
 const unsigned kMaxTid = 1 << kTidBits;
 const unsigned kMaxTidInClock = kMaxTid * 2;  // This includes msb 'freed' bit.
-const int kClkBits = 42;
+const int kClkBits = 55 - kTidBits;
+const unsigned kInvalidTid = (unsigned)-1;
 #ifndef TSAN_GO
 const int kShadowStackSize = 4 * 1024;
 const int kTraceStackSize = 256;
 #endif
 
-#ifdef TSAN_SHADOW_COUNT
-# if TSAN_SHADOW_COUNT == 2 \
+// Count of shadow values in a shadow cell. Selected at build time
+// (TSAN_SHADOW_COUNT=2 halves shadow memory, 8 remembers more accesses per
+// cell and so misses fewer races).
+#ifndef TSAN_SHADOW_COUNT
+# define TSAN_SHADOW_COUNT 4
+#endif
+#if TSAN_SHADOW_COUNT == 2 \
   || TSAN_SHADOW_COUNT == 4 || TSAN_SHADOW_COUNT == 8
 const uptr kShadowCnt = TSAN_SHADOW_COUNT;
-# else
-#   error "TSAN_SHADOW_COUNT must be one of 2,4,8"
-# endif
 #else
-// Count of shadow values in a shadow cell.
-const uptr kShadowCnt = 4;
+# error "TSAN_SHADOW_COUNT must be one of 2,4,8"
 #endif
 
 // That many user bytes are mapped onto a single shadow cell.
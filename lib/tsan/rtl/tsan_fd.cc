@@ -62,7 +62,7 @@ static void unref(ThreadState *thr, uptr pc, FdSync *s) {
       CHECK_NE(s, &fdctx.socksync);
       SyncVar *v = CTX()->synctab.GetAndRemove(thr, pc, (uptr)s);
       if (v)
-        DestroyAndFree(v);
+        CTX()->synctab.Destroy(v);
       internal_free(s);
     }
   }
@@ -86,6 +86,14 @@ static FdDesc *fddesc(ThreadState *thr, uptr pc, int fd) {
   return &((FdDesc*)l1)[fd % kTableSizeL2];  // NOLINT
 }
 
+// Files and sockets share one sync object per kind, unless io_sync=3
+// asks for a separate one for every fd.
+static FdSync *kindsync(FdSync *s) {
+  if (flags()->io_sync == 3)
+    return allocsync();
+  return s;
+}
+
 // pd must be already ref'ed.
 static void init(ThreadState *thr, uptr pc, int fd, FdSync *s) {
   FdDesc *d = fddesc(thr, pc, fd);
@@ -97,7 +105,7 @@ static void init(ThreadState *thr, uptr pc, int fd, FdSync *s) {
   }
   if (flags()->io_sync == 0) {
     unref(thr, pc, s);
-  } else if (flags()->io_sync == 1) {
+  } else if (flags()->io_sync == 1 || flags()->io_sync == 3) {
     d->sync = s;
   } else if (flags()->io_sync == 2) {
     unref(thr, pc, s);
@@ -119,14 +127,14 @@ void FdOnFork(ThreadState *thr, uptr pc) {
   // On fork() we need to reset all fd's, because the child is going
   // close all them, and that will cause races between previous read/write
   // and the close.
+  // The second level tables are allocated on demand, so there may be holes.
+  // Each table is reset at once rather than one descriptor at a time, fork()
+  // latency matters for pre-forking servers.
   for (int l1 = 0; l1 < kTableSizeL1; l1++) {
     FdDesc *tab = (FdDesc*)atomic_load(&fdctx.tab[l1], memory_order_relaxed);
     if (tab == 0)
-      break;
-    for (int l2 = 0; l2 < kTableSizeL2; l2++) {
-      FdDesc *d = &tab[l2];
-      MemoryResetRange(thr, pc, (uptr)d, 8);
-    }
+      continue;
+    MemoryResetRange(thr, pc, (uptr)tab, kTableSizeL2 * sizeof(FdDesc));
   }
 }
 
@@ -187,7 +195,7 @@ void FdClose(ThreadState *thr, uptr pc, int fd) {
 
 void FdFileCreate(ThreadState *thr, uptr pc, int fd) {
   DPrintf("#%d: FdFileCreate(%d)\n", thr->tid, fd);
-  init(thr, pc, fd, &fdctx.filesync);
+  init(thr, pc, fd, kindsync(&fdctx.filesync));
 }
 
 void FdDup(ThreadState *thr, uptr pc, int oldfd, int newfd) {
@@ -230,14 +238,14 @@ void FdPollCreate(ThreadState *thr, uptr pc, int fd) {
 void FdSocketCreate(ThreadState *thr, uptr pc, int fd) {
   DPrintf("#%d: FdSocketCreate(%d)\n", thr->tid, fd);
   // It can be a UDP socket.
-  init(thr, pc, fd, &fdctx.socksync);
+  init(thr, pc, fd, kindsync(&fdctx.socksync));
 }
 
 void FdSocketAccept(ThreadState *thr, uptr pc, int fd, int newfd) {
   DPrintf("#%d: FdSocketAccept(%d, %d)\n", thr->tid, fd, newfd);
   // Synchronize connect->accept.
   Acquire(thr, pc, (uptr)&fdctx.connectsync);
-  init(thr, pc, newfd, &fdctx.socksync);
+  init(thr, pc, newfd, kindsync(&fdctx.socksync));
 }
 
 void FdSocketConnecting(ThreadState *thr, uptr pc, int fd) {
@@ -248,7 +256,7 @@ void FdSocketConnecting(ThreadState *thr, uptr pc, int fd) {
 
 void FdSocketConnect(ThreadState *thr, uptr pc, int fd) {
   DPrintf("#%d: FdSocketConnect(%d)\n", thr->tid, fd);
-  init(thr, pc, fd, &fdctx.socksync);
+  init(thr, pc, fd, kindsync(&fdctx.socksync));
 }
 
 uptr File2addr(char *path) {
@@ -46,6 +46,7 @@ void InitializeFlags(Flags *f, const char *env) {
   f->report_destroy_locked = true;
   f->report_signal_unsafe = true;
   f->report_atomic_races = true;
+  f->report_async = false;
   f->force_seq_cst_atomics = false;
   f->strip_path_prefix = "";
   f->suppressions = "";
@@ -56,43 +57,72 @@ void InitializeFlags(Flags *f, const char *env) {
   f->atexit_sleep_ms = 1000;
   f->verbosity = 0;
   f->profile_memory = "";
+  f->profile_memory_json = false;
   f->flush_memory_ms = 0;
+  f->flush_shadow_budget_mb = 0;
   f->flush_symbolizer_ms = 5000;
+  f->report_log_path = "";
+  f->stats_sample_rate = 0;
   f->stop_on_start = false;
   f->running_on_valgrind = false;
   f->external_symbolizer_path = "";
   f->history_size = kGoMode ? 1 : 2;  // There are a lot of goroutines in Go.
   f->io_sync = 1;
+  f->merge_atomic_releases = false;
+  f->shadow_huge_pages = 0;
+  f->prefault_shadow = false;
+  f->fast_init = false;
+  f->timing_sample_rate = 0;
+  f->coverage = false;
+  f->coverage_dir = "";
+  f->access_sample_rate = 0;
+  f->rodata_mmap = true;
 
   // Let a frontend override.
   OverrideFlags(f);
 
   // Override from command line.
-  ParseFlag(env, &f->enable_annotations, "enable_annotations");
-  ParseFlag(env, &f->suppress_equal_stacks, "suppress_equal_stacks");
-  ParseFlag(env, &f->suppress_equal_addresses, "suppress_equal_addresses");
-  ParseFlag(env, &f->suppress_java, "suppress_java");
-  ParseFlag(env, &f->report_bugs, "report_bugs");
-  ParseFlag(env, &f->report_thread_leaks, "report_thread_leaks");
-  ParseFlag(env, &f->report_destroy_locked, "report_destroy_locked");
-  ParseFlag(env, &f->report_signal_unsafe, "report_signal_unsafe");
-  ParseFlag(env, &f->report_atomic_races, "report_atomic_races");
-  ParseFlag(env, &f->force_seq_cst_atomics, "force_seq_cst_atomics");
-  ParseFlag(env, &f->strip_path_prefix, "strip_path_prefix");
-  ParseFlag(env, &f->suppressions, "suppressions");
-  ParseFlag(env, &f->print_suppressions, "print_suppressions");
-  ParseFlag(env, &f->print_benign, "print_benign");
-  ParseFlag(env, &f->exitcode, "exitcode");
-  ParseFlag(env, &f->log_path, "log_path");
-  ParseFlag(env, &f->atexit_sleep_ms, "atexit_sleep_ms");
-  ParseFlag(env, &f->verbosity, "verbosity");
-  ParseFlag(env, &f->profile_memory, "profile_memory");
-  ParseFlag(env, &f->flush_memory_ms, "flush_memory_ms");
-  ParseFlag(env, &f->flush_symbolizer_ms, "flush_symbolizer_ms");
-  ParseFlag(env, &f->stop_on_start, "stop_on_start");
-  ParseFlag(env, &f->external_symbolizer_path, "external_symbolizer_path");
-  ParseFlag(env, &f->history_size, "history_size");
-  ParseFlag(env, &f->io_sync, "io_sync");
+  FlagParser parser;
+  parser.AddFlag(&f->enable_annotations, "enable_annotations");
+  parser.AddFlag(&f->suppress_equal_stacks, "suppress_equal_stacks");
+  parser.AddFlag(&f->suppress_equal_addresses, "suppress_equal_addresses");
+  parser.AddFlag(&f->suppress_java, "suppress_java");
+  parser.AddFlag(&f->report_bugs, "report_bugs");
+  parser.AddFlag(&f->report_thread_leaks, "report_thread_leaks");
+  parser.AddFlag(&f->report_destroy_locked, "report_destroy_locked");
+  parser.AddFlag(&f->report_signal_unsafe, "report_signal_unsafe");
+  parser.AddFlag(&f->report_atomic_races, "report_atomic_races");
+  parser.AddFlag(&f->report_async, "report_async");
+  parser.AddFlag(&f->force_seq_cst_atomics, "force_seq_cst_atomics");
+  parser.AddFlag(&f->strip_path_prefix, "strip_path_prefix");
+  parser.AddFlag(&f->suppressions, "suppressions");
+  parser.AddFlag(&f->print_suppressions, "print_suppressions");
+  parser.AddFlag(&f->print_benign, "print_benign");
+  parser.AddFlag(&f->exitcode, "exitcode");
+  parser.AddFlag(&f->log_path, "log_path");
+  parser.AddFlag(&f->atexit_sleep_ms, "atexit_sleep_ms");
+  parser.AddFlag(&f->verbosity, "verbosity");
+  parser.AddFlag(&f->profile_memory, "profile_memory");
+  parser.AddFlag(&f->profile_memory_json, "profile_memory_json");
+  parser.AddFlag(&f->flush_memory_ms, "flush_memory_ms");
+  parser.AddFlag(&f->flush_shadow_budget_mb, "flush_shadow_budget_mb");
+  parser.AddFlag(&f->flush_symbolizer_ms, "flush_symbolizer_ms");
+  parser.AddFlag(&f->report_log_path, "report_log_path");
+  parser.AddFlag(&f->stats_sample_rate, "stats_sample_rate");
+  parser.AddFlag(&f->stop_on_start, "stop_on_start");
+  parser.AddFlag(&f->external_symbolizer_path, "external_symbolizer_path");
+  parser.AddFlag(&f->history_size, "history_size");
+  parser.AddFlag(&f->io_sync, "io_sync");
+  parser.AddFlag(&f->merge_atomic_releases, "merge_atomic_releases");
+  parser.AddFlag(&f->shadow_huge_pages, "shadow_huge_pages");
+  parser.AddFlag(&f->prefault_shadow, "prefault_shadow");
+  parser.AddFlag(&f->fast_init, "fast_init");
+  parser.AddFlag(&f->timing_sample_rate, "timing_sample_rate");
+  parser.AddFlag(&f->coverage, "coverage");
+  parser.AddFlag(&f->coverage_dir, "coverage_dir");
+  parser.AddFlag(&f->access_sample_rate, "access_sample_rate");
+  parser.AddFlag(&f->rodata_mmap, "rodata_mmap");
+  parser.ParseString(env);
 
   if (!f->report_bugs) {
     f->report_thread_leaks = false;
@@ -106,9 +136,21 @@ void InitializeFlags(Flags *f, const char *env) {
     Die();
   }
 
-  if (f->io_sync < 0 || f->io_sync > 2) {
+  if (f->io_sync < 0 || f->io_sync > 3) {
     Printf("ThreadSanitizer: incorrect value for io_sync"
-           " (must be [0..2])\n");
+           " (must be [0..3])\n");
+    Die();
+  }
+
+  if (f->stats_sample_rate < 0) {
+    Printf("ThreadSanitizer: incorrect value for stats_sample_rate"
+           " (must be >= 0)\n");
+    Die();
+  }
+
+  if (f->access_sample_rate < 0) {
+    Printf("ThreadSanitizer: incorrect value for access_sample_rate"
+           " (must be >= 0)\n");
     Die();
   }
 }
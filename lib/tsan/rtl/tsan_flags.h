@@ -45,6 +45,9 @@ struct Flags {
   bool report_signal_unsafe;
   // Report races between atomic and plain memory accesses.
   bool report_atomic_races;
+  // Collect and print race reports on a separate thread, so that the racing
+  // threads do not wait for symbolization.
+  bool report_async;
   // If set, all atomics are effectively sequentially consistent (seq_cst),
   // regardless of what user actually specified.
   bool force_seq_cst_atomics;
@@ -69,10 +72,25 @@ struct Flags {
   int verbosity;
   // If set, periodically write memory profile to that file.
   const char *profile_memory;
+  // Write the memory profile as one JSON object per line with byte counts
+  // per runtime component (for automated processing).
+  bool profile_memory_json;
   // Flush shadow memory every X ms.
   int flush_memory_ms;
+  // If non-zero, flush_memory_ms flushes only the coldest parts of shadow
+  // memory until shadow RSS drops below that many MB.
+  int flush_shadow_budget_mb;
+  // If non-zero in builds without TSAN_COLLECT_STATS, collect statistics for
+  // 1 in stats_sample_rate memory accesses (and for the events that follow
+  // it until the next access) and print them at exit.
+  int stats_sample_rate;
   // Flush symbolizer caches every X ms.
   int flush_symbolizer_ms;
+  // If set, reports are not symbolized and printed; instead their raw pcs
+  // (and the module map) are appended to "report_log_path.pid" in binary
+  // form. Use symbolize_report_log.py to symbolize and print them later.
+  // Function and file suppressions do not apply to such reports.
+  const char *report_log_path;
   // Stops on start until __tsan_resume() is called (for debugging).
   bool stop_on_start;
   // Controls whether RunningOnValgrind() returns true or false.
@@ -89,7 +107,39 @@ struct Flags {
   // 0 - no synchronization
   // 1 - reasonable level of synchronization (write->read)
   // 2 - global synchronization of all IO operations
+  // 3 - like 1, but every file and socket fd gets its own synchronization
+  //     object: unrelated fds do not synchronize with each other, and
+  //     neither do the two ends of an in-process socket connection
   int io_sync;
+  // Merge an atomic read-modify-write with release semantics into the
+  // previous release on the same variable, if nothing happened in between.
+  // This makes CAS loops and reference counting cheaper and keeps them out
+  // of the trace. The merged operation is not recorded in the shadow.
+  bool merge_atomic_releases;
+  // Transparent huge pages for the shadow memory: 0 - system default,
+  // 1 - use them for the shadow of the heap and not for the rest,
+  // 2 - never use them.
+  int shadow_huge_pages;
+  // Back the shadow of the main thread stack with memory at startup.
+  bool prefault_shadow;
+  // Start the external symbolizer and the background thread only when they
+  // are needed.
+  bool fast_init;
+  // Time one in that many allocator calls and interceptors, and every race
+  // report, and print the histograms at exit. 0 - disabled.
+  int timing_sample_rate;
+  // If set, write the edge coverage of the modules built with
+  // -fsanitize-coverage=trace-pc-guard to coverage_dir at exit.
+  bool coverage;
+  const char *coverage_dir;
+  // If greater than 1, check only about 1 in that many plain memory accesses
+  // for races, in bursts of consecutive accesses of a thread. Atomics and
+  // synchronization are tracked exactly, so there are no false reports, but
+  // a race is found only if both of its accesses are checked.
+  int access_sample_rate;
+  // Do not check accesses to read-only private file mappings, as for .rodata.
+  // A race is missed if such a mapping is made writable with mprotect.
+  bool rodata_mmap;
 };
 
 Flags *flags();
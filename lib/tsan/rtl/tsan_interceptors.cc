@@ -19,6 +19,8 @@
 #include "sanitizer_common/sanitizer_platform_limits_posix.h"
 #include "sanitizer_common/sanitizer_placement_new.h"
 #include "sanitizer_common/sanitizer_stacktrace.h"
+#include "sanitizer_common/sanitizer_symbolizer.h"
+#include "sanitizer_common/sanitizer_timing.h"
 #include "interception/interception.h"
 #include "tsan_interface.h"
 #include "tsan_platform.h"
@@ -81,6 +83,9 @@ const int SIGSYS = 31;
 void *const MAP_FAILED = (void*)-1;
 const int PTHREAD_BARRIER_SERIAL_THREAD = -1;
 const int MAP_FIXED = 0x10;
+const int MAP_PRIVATE = 0x02;
+const int MAP_ANONYMOUS = 0x20;
+const int PROT_READ = 0x1;
 typedef long long_t;  // NOLINT
 
 // From /usr/include/unistd.h
@@ -117,7 +122,6 @@ static sigaction_t sigactions[kSigCount];
 
 namespace __tsan {
 struct SignalDesc {
-  bool armed;
   bool sigaction;
   my_siginfo_t siginfo;
   ucontext_t ctx;
@@ -126,7 +130,9 @@ struct SignalDesc {
 struct SignalContext {
   int in_blocking_func;
   int int_signal_send;
-  int pending_signal_count;
+  // Bit i is set if pending_signals[i] is armed. Only the owning thread
+  // touches it, but from its signal handlers too.
+  atomic_uint64_t pending_signal_mask;
   SignalDesc pending_signals[kSigCount];
 };
 }  // namespace __tsan
@@ -149,13 +155,16 @@ class ScopedInterceptor {
   ScopedInterceptor(ThreadState *thr, const char *fname, uptr pc);
   ~ScopedInterceptor();
  private:
+  // Declared first, so that the timed region also covers FuncEntry/FuncExit.
+  ScopedTiming timing_;
   ThreadState *const thr_;
   const int in_rtl_;
 };
 
 ScopedInterceptor::ScopedInterceptor(ThreadState *thr, const char *fname,
                                      uptr pc)
-    : thr_(thr)
+    : timing_(kTimingInterceptor)
+    , thr_(thr)
     , in_rtl_(thr->in_rtl) {
   if (thr_->in_rtl == 0) {
     Initialize(thr);
@@ -445,9 +454,7 @@ TSAN_INTERCEPTOR(void*, calloc, uptr size, uptr n) {
   void *p = 0;
   {
     SCOPED_INTERCEPTOR_RAW(calloc, size, n);
-    p = user_alloc(thr, pc, n * size);
-    if (p)
-      internal_memset(p, 0, n * size);
+    p = user_alloc(thr, pc, n * size, kDefaultAlignment, true);
   }
   invoke_malloc_hook(p, n * size);
   return p;
@@ -674,6 +681,15 @@ static bool fix_mmap_addr(void **addr, long_t sz, int flags) {
   return true;
 }
 
+// Read-only private file mappings can't be changed by the program, unless
+// it makes them writable with mprotect (which is rare), so they are treated
+// like .rodata. Read-only anonymous mappings are usually reserved memory that
+// is made writable later.
+static bool IsImmutableMapping(int prot, int mflags, int fd) {
+  return flags()->rodata_mmap && fd >= 0 && prot == PROT_READ &&
+         (mflags & (MAP_PRIVATE | MAP_ANONYMOUS)) == MAP_PRIVATE;
+}
+
 TSAN_INTERCEPTOR(void*, mmap, void *addr, long_t sz, int prot,
                          int flags, int fd, unsigned off) {
   SCOPED_TSAN_INTERCEPTOR(mmap, addr, sz, prot, flags, fd, off);
@@ -681,9 +697,14 @@ TSAN_INTERCEPTOR(void*, mmap, void *addr, long_t sz, int prot,
     return MAP_FAILED;
   void *res = REAL(mmap)(addr, sz, prot, flags, fd, off);
   if (res != MAP_FAILED) {
+    // A fixed mapping may replace a mapping with SyncVars.
+    if (flags & MAP_FIXED)
+      UnmapShadow(thr, (uptr)res, sz);
     if (fd > 0)
       FdAccess(thr, pc, fd);
-    MemoryRangeImitateWrite(thr, pc, (uptr)res, sz);
+    if (!IsImmutableMapping(prot, flags, fd) ||
+        !MapShadowRodata((uptr)res, sz))
+      MemoryRangeImitateWrite(thr, pc, (uptr)res, sz);
   }
   return res;
 }
@@ -695,20 +716,33 @@ TSAN_INTERCEPTOR(void*, mmap64, void *addr, long_t sz, int prot,
     return MAP_FAILED;
   void *res = REAL(mmap64)(addr, sz, prot, flags, fd, off);
   if (res != MAP_FAILED) {
+    // A fixed mapping may replace a mapping with SyncVars.
+    if (flags & MAP_FIXED)
+      UnmapShadow(thr, (uptr)res, sz);
     if (fd > 0)
       FdAccess(thr, pc, fd);
-    MemoryRangeImitateWrite(thr, pc, (uptr)res, sz);
+    if (!IsImmutableMapping(prot, flags, fd) ||
+        !MapShadowRodata((uptr)res, sz))
+      MemoryRangeImitateWrite(thr, pc, (uptr)res, sz);
   }
   return res;
 }
 
 TSAN_INTERCEPTOR(int, munmap, void *addr, long_t sz) {
   SCOPED_TSAN_INTERCEPTOR(munmap, addr, sz);
-  DontNeedShadowFor((uptr)addr, sz);
+  UnmapShadow(thr, (uptr)addr, sz);
   int res = REAL(munmap)(addr, sz);
   return res;
 }
 
+TSAN_INTERCEPTOR(int, dlclose, void *handle) {
+  SCOPED_TSAN_INTERCEPTOR(dlclose, handle);
+  int res = REAL(dlclose)(handle);
+  // Code addresses of the module may be reused by another one.
+  InvalidateSymbolizerCache();
+  return res;
+}
+
 TSAN_INTERCEPTOR(void*, memalign, uptr align, uptr sz) {
   SCOPED_TSAN_INTERCEPTOR(memalign, align, sz);
   return user_alloc(thr, pc, sz, align);
@@ -1109,12 +1143,12 @@ TSAN_INTERCEPTOR(int, pthread_barrier_destroy, void *b) {
 
 TSAN_INTERCEPTOR(int, pthread_barrier_wait, void *b) {
   SCOPED_TSAN_INTERCEPTOR(pthread_barrier_wait, b);
-  Release(thr, pc, (uptr)b);
+  BarrierRelease(thr, pc, (uptr)b);
   MemoryRead(thr, pc, (uptr)b, kSizeLog1);
   int res = REAL(pthread_barrier_wait)(b);
   MemoryRead(thr, pc, (uptr)b, kSizeLog1);
   if (res == 0 || res == PTHREAD_BARRIER_SERIAL_THREAD) {
-    Acquire(thr, pc, (uptr)b);
+    BarrierAcquire(thr, pc, (uptr)b);
   }
   return res;
 }
@@ -1633,14 +1667,16 @@ void ALWAYS_INLINE rtl_generic_sighandler(bool sigact, int sig,
   if (sctx == 0)
     return;
   SignalDesc *signal = &sctx->pending_signals[sig];
-  if (signal->armed == false) {
-    signal->armed = true;
+  u64 mask = atomic_load(&sctx->pending_signal_mask, memory_order_relaxed);
+  u64 bit = 1ULL << sig;
+  if ((mask & bit) == 0) {
     signal->sigaction = sigact;
     if (info)
       internal_memcpy(&signal->siginfo, info, sizeof(*info));
     if (ctx)
       internal_memcpy(&signal->ctx, ctx, sizeof(signal->ctx));
-    sctx->pending_signal_count++;
+    // All signals are blocked while this handler runs.
+    atomic_store(&sctx->pending_signal_mask, mask | bit, memory_order_relaxed);
   }
 }
 
@@ -1835,47 +1871,51 @@ namespace __tsan {
 
 void ProcessPendingSignals(ThreadState *thr) {
   CHECK_EQ(thr->in_rtl, 0);
-  SignalContext *sctx = SigCtx(thr);
-  if (sctx == 0 || sctx->pending_signal_count == 0 || thr->in_signal_handler)
+  // This runs on every exit from an interceptor. A thread that has not got
+  // any signal yet has no signal context, don't create one here.
+  SignalContext *sctx = thr->signal_ctx;
+  if (sctx == 0 || thr->in_signal_handler ||
+      atomic_load(&sctx->pending_signal_mask, memory_order_relaxed) == 0)
     return;
   Context *ctx = CTX();
   thr->in_signal_handler = true;
-  sctx->pending_signal_count = 0;
   // These are too big for stack.
   static THREADLOCAL sigset_t emptyset, oldset;
   sigfillset(&emptyset);
   pthread_sigmask(SIG_SETMASK, &emptyset, &oldset);
-  for (int sig = 0; sig < kSigCount; sig++) {
+  // With all signals blocked, nothing can be armed until the mask is restored.
+  u64 pending = atomic_load(&sctx->pending_signal_mask, memory_order_relaxed);
+  atomic_store(&sctx->pending_signal_mask, 0, memory_order_relaxed);
+  while (pending) {
+    int sig = (int)LeastSignificantSetBitIndex(pending);
+    pending &= pending - 1;
     SignalDesc *signal = &sctx->pending_signals[sig];
-    if (signal->armed) {
-      signal->armed = false;
-      if (sigactions[sig].sa_handler != SIG_DFL
-          && sigactions[sig].sa_handler != SIG_IGN) {
-        // Insure that the handler does not spoil errno.
-        const int saved_errno = errno;
-        errno = 0;
-        if (signal->sigaction)
-          sigactions[sig].sa_sigaction(sig, &signal->siginfo, &signal->ctx);
-        else
-          sigactions[sig].sa_handler(sig);
-        if (flags()->report_bugs && errno != 0) {
-          ScopedInRtl in_rtl;
-          __tsan::StackTrace stack;
-          uptr pc = signal->sigaction ?
-              (uptr)sigactions[sig].sa_sigaction :
-              (uptr)sigactions[sig].sa_handler;
-          pc += 1;  // return address is expected, OutputReport() will undo this
-          stack.Init(&pc, 1);
-          ThreadRegistryLock l(ctx->thread_registry);
-          ScopedReport rep(ReportTypeErrnoInSignal);
-          if (!IsFiredSuppression(ctx, rep, stack)) {
-            rep.AddStack(&stack);
-            OutputReport(ctx, rep, rep.GetReport()->stacks[0]);
-          }
-        }
-        errno = saved_errno;
+    if (sigactions[sig].sa_handler == SIG_DFL ||
+        sigactions[sig].sa_handler == SIG_IGN)
+      continue;
+    // Insure that the handler does not spoil errno.
+    const int saved_errno = errno;
+    errno = 0;
+    if (signal->sigaction)
+      sigactions[sig].sa_sigaction(sig, &signal->siginfo, &signal->ctx);
+    else
+      sigactions[sig].sa_handler(sig);
+    if (flags()->report_bugs && errno != 0) {
+      ScopedInRtl in_rtl;
+      __tsan::StackTrace stack;
+      uptr pc = signal->sigaction ?
+          (uptr)sigactions[sig].sa_sigaction :
+          (uptr)sigactions[sig].sa_handler;
+      pc += 1;  // return address is expected, OutputReport() will undo this
+      stack.Init(&pc, 1);
+      ThreadRegistryLock l(ctx->thread_registry);
+      ScopedReport rep(ReportTypeErrnoInSignal);
+      if (!IsFiredSuppression(ctx, rep, stack)) {
+        rep.AddStack(&stack);
+        OutputReport(ctx, rep, rep.GetReport()->stacks[0]);
       }
     }
+    errno = saved_errno;
   }
   pthread_sigmask(SIG_SETMASK, &oldset, 0);
   CHECK_EQ(thr->in_signal_handler, true);
@@ -1927,6 +1967,7 @@ void InitializeInterceptors() {
   TSAN_INTERCEPT(mmap);
   TSAN_INTERCEPT(mmap64);
   TSAN_INTERCEPT(munmap);
+  TSAN_INTERCEPT(dlclose);
   TSAN_INTERCEPT(memalign);
   TSAN_INTERCEPT(valloc);
   TSAN_INTERCEPT(pvalloc);
@@ -90,3 +90,16 @@ void __tsan_acquire(void *addr) {
 void __tsan_release(void *addr) {
   Release(cur_thread(), CALLERPC, (uptr)addr);
 }
+
+void __tsan_publish_immutable_range(void *addr, uptr size) {
+  MemoryRangeImmutable(cur_thread(), CALLERPC, (uptr)addr, size);
+}
+
+uptr __tsan_get_stats(unsigned long long *stats, uptr size) {  // NOLINT
+  ScopedInRtl in_rtl;
+  u64 stat[StatCnt];
+  StatSnapshot(stat);
+  for (uptr i = 0; i < size && i < StatCnt; i++)
+    stats[i] = stat[i];
+  return StatCnt;
+}
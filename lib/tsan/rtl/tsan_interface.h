@@ -55,6 +55,14 @@ void __tsan_vptr_update(void **vptr_p, void *new_val)
 void __tsan_func_entry(void *call_pc) SANITIZER_INTERFACE_ATTRIBUTE;
 void __tsan_func_exit() SANITIZER_INTERFACE_ATTRIBUTE;
 
+// Copies up to size aggregated statistics counters (indexed by StatType
+// from tsan_stat.h) into stats and returns the number of counters.
+// The counters are collected only in TSAN_COLLECT_STATS builds or with
+// the stats_sample_rate flag; sampled counters are not scaled.
+unsigned long __tsan_get_stats(unsigned long long *stats,  // NOLINT
+                               unsigned long size)  // NOLINT
+    SANITIZER_INTERFACE_ATTRIBUTE;
+
 void __tsan_read_range(void *addr, unsigned long size)  // NOLINT
     SANITIZER_INTERFACE_ATTRIBUTE;
 void __tsan_write_range(void *addr, unsigned long size)  // NOLINT
@@ -68,6 +68,8 @@ static const int kMaxDescLen = 128;
 struct ExpectRace {
   ExpectRace *next;
   ExpectRace *prev;
+  // Races added later have larger ids and take precedence.
+  uptr id;
   int hitcount;
   int addcount;
   uptr addr;
@@ -77,10 +79,35 @@ struct ExpectRace {
   char desc[kMaxDescLen];
 };
 
+// Programs may annotate tens of thousands of benign races (e.g. statistics
+// counters), so besides the list the races are indexed by the 64-byte
+// granules they cover, and a report is only compared with the races of the
+// granules it touches. Races that span many granules (e.g. whole arrays)
+// are few and are kept in a separate chain that is always scanned.
+struct RaceIndexNode {
+  RaceIndexNode *next;
+  uptr granule;
+  ExpectRace *race;
+};
+
+struct RaceIndex {
+  RaceIndexNode **buckets;
+  uptr n_buckets;
+  uptr n_nodes;
+  RaceIndexNode *wide;
+  uptr next_id;
+};
+
+static const uptr kGranuleShift = 6;
+static const uptr kMaxIndexedGranules = 64;
+static const uptr kInitialIndexBuckets = 1024;
+
 struct DynamicAnnContext {
   Mutex mtx;
   ExpectRace expect;
   ExpectRace benign;
+  RaceIndex expect_index;
+  RaceIndex benign_index;
 
   DynamicAnnContext()
     : mtx(MutexTypeAnnotations, StatMtxAnnotations) {
@@ -90,14 +117,135 @@ struct DynamicAnnContext {
 static DynamicAnnContext *dyn_ann_ctx;
 static char dyn_ann_ctx_placeholder[sizeof(DynamicAnnContext)] ALIGNED(64);
 
-static void AddExpectRace(ExpectRace *list,
+static uptr GranuleBucket(const RaceIndex *index, uptr granule) {
+  return (granule ^ (granule >> 16)) & (index->n_buckets - 1);
+}
+
+static RaceIndexNode **AllocBuckets(uptr n) {
+  uptr size = n * sizeof(RaceIndexNode*);
+  RaceIndexNode **buckets =
+      (RaceIndexNode**)internal_alloc(MBlockExpectRace, size);
+  internal_memset(buckets, 0, size);
+  return buckets;
+}
+
+static void GrowIndex(RaceIndex *index) {
+  RaceIndexNode **old_buckets = index->buckets;
+  uptr old_n_buckets = index->n_buckets;
+  index->n_buckets = old_n_buckets ? old_n_buckets * 2 : kInitialIndexBuckets;
+  index->buckets = AllocBuckets(index->n_buckets);
+  for (uptr i = 0; i < old_n_buckets; i++) {
+    while (RaceIndexNode *node = old_buckets[i]) {
+      old_buckets[i] = node->next;
+      RaceIndexNode **bucket =
+          &index->buckets[GranuleBucket(index, node->granule)];
+      node->next = *bucket;
+      *bucket = node;
+    }
+  }
+  if (old_buckets)
+    internal_free(old_buckets);
+}
+
+static void AddIndexNode(RaceIndexNode **chain, uptr granule,
+                         ExpectRace *race) {
+  RaceIndexNode *node =
+      (RaceIndexNode*)internal_alloc(MBlockExpectRace, sizeof(*node));
+  node->granule = granule;
+  node->race = race;
+  node->next = *chain;
+  *chain = node;
+}
+
+static void IndexRace(RaceIndex *index, ExpectRace *race) {
+  race->id = ++index->next_id;
+  // An empty range never matches.
+  if (race->size == 0)
+    return;
+  uptr beg = race->addr >> kGranuleShift;
+  uptr end = (race->addr + race->size - 1) >> kGranuleShift;
+  if (end < beg || end - beg >= kMaxIndexedGranules) {
+    AddIndexNode(&index->wide, 0, race);
+    return;
+  }
+  if (index->n_nodes + (end - beg + 1) > 2 * index->n_buckets)
+    GrowIndex(index);
+  for (uptr g = beg; g <= end; g++) {
+    AddIndexNode(&index->buckets[GranuleBucket(index, g)], g, race);
+    index->n_nodes++;
+  }
+}
+
+static void FreeChain(RaceIndexNode *node) {
+  while (node) {
+    RaceIndexNode *next = node->next;
+    internal_free(node);
+    node = next;
+  }
+}
+
+static void ClearIndex(RaceIndex *index) {
+  for (uptr i = 0; i < index->n_buckets; i++) {
+    FreeChain(index->buckets[i]);
+    index->buckets[i] = 0;
+  }
+  FreeChain(index->wide);
+  index->wide = 0;
+  index->n_nodes = 0;
+}
+
+static bool Overlaps(const ExpectRace *race, uptr addr, uptr size) {
+  uptr maxbegin = max(race->addr, addr);
+  uptr minend = min(race->addr + race->size, addr + size);
+  return maxbegin < minend;
+}
+
+static ExpectRace *FindInChain(RaceIndexNode *node, uptr granule, bool wide,
+                               uptr addr, uptr size, ExpectRace *best) {
+  for (; node; node = node->next) {
+    if (!wide && node->granule != granule)
+      continue;
+    if ((best == 0 || node->race->id > best->id) &&
+        Overlaps(node->race, addr, size))
+      best = node->race;
+  }
+  return best;
+}
+
+static ExpectRace *FindExactRace(RaceIndex *index, uptr addr, uptr size) {
+  if (size != 0) {
+    uptr granule = addr >> kGranuleShift;
+    RaceIndexNode *node = index->n_buckets
+        ? index->buckets[GranuleBucket(index, granule)] : 0;
+    for (; node; node = node->next) {
+      if (node->race->addr == addr && node->race->size == size)
+        return node->race;
+    }
+  }
+  for (RaceIndexNode *node = index->wide; node; node = node->next) {
+    if (node->race->addr == addr && node->race->size == size)
+      return node->race;
+  }
+  return 0;
+}
+
+static void AddExpectRace(ExpectRace *list, RaceIndex *index,
     char *f, int l, uptr addr, uptr size, char *desc) {
-  ExpectRace *race = list->next;
-  for (; race != list; race = race->next) {
-    if (race->addr == addr && race->size == size) {
-      race->addcount++;
-      return;
+  ExpectRace *race = 0;
+  if (size != 0) {
+    race = FindExactRace(index, addr, size);
+  } else {
+    // Empty ranges are not indexed.
+    for (race = list->next; race != list; race = race->next) {
+      if (race->addr == addr && race->size == 0)
+        break;
     }
+    if (race == list)
+      race = 0;
+  }
+  if (race) {
+    race->addcount++;
+    return;
   }
   race = (ExpectRace*)internal_alloc(MBlockExpectRace, sizeof(ExpectRace));
   race->addr = addr;
@@ -117,22 +265,39 @@ static void AddExpectRace(ExpectRace *list,
   race->next = list->next;
   race->next->prev = race;
   list->next = race;
-}
-
-static ExpectRace *FindRace(ExpectRace *list, uptr addr, uptr size) {
-  for (ExpectRace *race = list->next; race != list; race = race->next) {
-    uptr maxbegin = max(race->addr, addr);
-    uptr minend = min(race->addr + race->size, addr + size);
-    if (maxbegin < minend)
-      return race;
+  IndexRace(index, race);
+}
+
+// Returns the most recently added race that overlaps the range.
+static ExpectRace *FindRace(ExpectRace *list, RaceIndex *index,
+                            uptr addr, uptr size) {
+  if (size == 0)
+    return 0;
+  uptr beg = addr >> kGranuleShift;
+  uptr end = (addr + size - 1) >> kGranuleShift;
+  if (end < beg || end - beg >= kMaxIndexedGranules) {
+    // Not expected from race reports, which cover a few bytes.
+    for (ExpectRace *race = list->next; race != list; race = race->next) {
+      if (Overlaps(race, addr, size))
+        return race;
+    }
+    return 0;
   }
-  return 0;
+  ExpectRace *best = FindInChain(index->wide, 0, true, addr, size, 0);
+  if (index->n_buckets == 0)
+    return best;
+  for (uptr g = beg; g <= end; g++) {
+    best = FindInChain(index->buckets[GranuleBucket(index, g)], g, false,
+                       addr, size, best);
+  }
+  return best;
 }
 
-static bool CheckContains(ExpectRace *list, uptr addr, uptr size) {
-  ExpectRace *race = FindRace(list, addr, size);
+static bool CheckContains(ExpectRace *list, RaceIndex *index,
+                          uptr addr, uptr size) {
+  ExpectRace *race = FindRace(list, index, addr, size);
   if (race == 0 && AlternativeAddress(addr))
-    race = FindRace(list, AlternativeAddress(addr), size);
+    race = FindRace(list, index, AlternativeAddress(addr), size);
   if (race == 0)
     return false;
   DPrintf("Hit expected/benign race: %s addr=%zx:%d %s:%d\n",
@@ -150,13 +315,17 @@ void InitializeDynamicAnnotations() {
   dyn_ann_ctx = new(dyn_ann_ctx_placeholder) DynamicAnnContext;
   InitList(&dyn_ann_ctx->expect);
   InitList(&dyn_ann_ctx->benign);
+  internal_memset(&dyn_ann_ctx->expect_index, 0, sizeof(RaceIndex));
+  internal_memset(&dyn_ann_ctx->benign_index, 0, sizeof(RaceIndex));
 }
 
 bool IsExpectedReport(uptr addr, uptr size) {
   Lock lock(&dyn_ann_ctx->mtx);
-  if (CheckContains(&dyn_ann_ctx->expect, addr, size))
+  if (CheckContains(&dyn_ann_ctx->expect, &dyn_ann_ctx->expect_index,
+                    addr, size))
     return true;
-  if (CheckContains(&dyn_ann_ctx->benign, addr, size))
+  if (CheckContains(&dyn_ann_ctx->benign, &dyn_ann_ctx->benign_index,
+                    addr, size))
     return true;
   return false;
 }
@@ -318,6 +487,7 @@ void INTERFACE_ATTRIBUTE AnnotateFlushExpectedRaces(char *f, int l) {
     race->next->prev = race->prev;
     internal_free(race);
   }
+  ClearIndex(&dyn_ann_ctx->expect_index);
 }
 
 void INTERFACE_ATTRIBUTE AnnotateEnableRaceDetection(
@@ -355,7 +525,7 @@ void INTERFACE_ATTRIBUTE AnnotateExpectRace(
     char *f, int l, uptr mem, char *desc) {
   SCOPED_ANNOTATION(AnnotateExpectRace);
   Lock lock(&dyn_ann_ctx->mtx);
-  AddExpectRace(&dyn_ann_ctx->expect,
+  AddExpectRace(&dyn_ann_ctx->expect, &dyn_ann_ctx->expect_index,
                 f, l, mem, 1, desc);
   DPrintf("Add expected race: %s addr=%zx %s:%d\n", desc, mem, f, l);
 }
@@ -363,7 +533,7 @@ void INTERFACE_ATTRIBUTE AnnotateExpectRace(
 static void BenignRaceImpl(
     char *f, int l, uptr mem, uptr size, char *desc) {
   Lock lock(&dyn_ann_ctx->mtx);
-  AddExpectRace(&dyn_ann_ctx->benign,
+  AddExpectRace(&dyn_ann_ctx->benign, &dyn_ann_ctx->benign_index,
                 f, l, mem, size, desc);
   DPrintf("Add benign race: %s addr=%zx %s:%d\n", desc, mem, f, l);
 }
@@ -401,6 +571,35 @@ void INTERFACE_ATTRIBUTE AnnotateIgnoreWritesEnd(char *f, int l) {
   IgnoreCtl(thr, true, false);
 }
 
+// Accesses of all threads to the range are not checked, e.g. to intentionally
+// racy statistics counters. The range should be 8-byte aligned; partially
+// covered 8-byte cells at its ends are still checked.
+void INTERFACE_ATTRIBUTE AnnotateIgnoreRangeBegin(
+    char *f, int l, uptr mem, uptr size) {
+  SCOPED_ANNOTATION(AnnotateIgnoreRangeBegin);
+  MemoryRangeIgnoreBegin(thr, pc, mem, size);
+}
+
+void INTERFACE_ATTRIBUTE AnnotateIgnoreRangeEnd(
+    char *f, int l, uptr mem, uptr size) {
+  SCOPED_ANNOTATION(AnnotateIgnoreRangeEnd);
+  MemoryRangeIgnoreEnd(thr, pc, mem, size);
+}
+
+// Accesses of the current thread to the range are not checked, until
+// AnnotateThreadIgnoreEnd with the same range.
+void INTERFACE_ATTRIBUTE AnnotateThreadIgnoreBegin(
+    char *f, int l, uptr mem, uptr size) {
+  SCOPED_ANNOTATION(AnnotateThreadIgnoreBegin);
+  ThreadIgnoreRangeBegin(thr, pc, mem, size);
+}
+
+void INTERFACE_ATTRIBUTE AnnotateThreadIgnoreEnd(
+    char *f, int l, uptr mem, uptr size) {
+  SCOPED_ANNOTATION(AnnotateThreadIgnoreEnd);
+  ThreadIgnoreRangeEnd(thr, pc, mem, size);
+}
+
 void INTERFACE_ATTRIBUTE AnnotatePublishMemoryRange(
     char *f, int l, uptr addr, uptr size) {
   SCOPED_ANNOTATION(AnnotatePublishMemoryRange);
@@ -26,6 +26,12 @@ extern "C" {
 void __tsan_acquire(void *addr) SANITIZER_INTERFACE_ATTRIBUTE;
 void __tsan_release(void *addr) SANITIZER_INTERFACE_ATTRIBUTE;
 
+// Says that the range is not written from now on until it is freed or
+// unmapped, e.g. a table filled before it is published to other threads.
+// Accesses to it are then not checked, as for .rodata.
+void __tsan_publish_immutable_range(void *addr, unsigned long size)  // NOLINT
+    SANITIZER_INTERFACE_ATTRIBUTE;
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
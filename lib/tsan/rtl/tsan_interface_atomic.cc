@@ -243,6 +243,92 @@ static int SizeLog() {
   // this leads to false negatives only in very obscure cases.
 }
 
+static AcquireCacheEntry *AcquireCacheGet(ThreadState *thr, uptr a) {
+  return &thr->acquire_cache[a / 8 % kAcquireCacheSize];
+}
+
+// Must be called after acquiring the clock of the SyncVar for a,
+// while the SyncVar is still locked.
+static void AcquireCacheUpdate(ThreadState *thr, uptr a) {
+  AcquireCacheEntry *e = AcquireCacheGet(thr, a);
+  e->addr = a;
+  e->version = CTX()->synctab.GetReleaseVersion(a);
+}
+
+// Returns true if the thread has already acquired all releases on a.
+// Must be called after the atomic operation on a: a release store or RMW
+// increments the release version before modifying the variable, so if the
+// operation has observed the value it has also observed the new version.
+static bool AcquireCacheHit(ThreadState *thr, AcquireCacheEntry *e, uptr a) {
+  if (e->addr != a || CTX()->synctab.GetReleaseVersion(a) != e->version)
+    return false;
+  StatInc(thr, StatAtomicAcquireCached);
+  return true;
+}
+
+// Acquires the clock of a after an RMW operation that missed the cache.
+static void AtomicAcquireSlow(ThreadState *thr, uptr pc, uptr a) {
+  SyncVar *s = CTX()->synctab.GetOrCreateAndLock(thr, pc, a, false);
+  thr->clock.set(thr->tid, thr->fast_state.epoch());
+  thr->clock.acquire(&s->clock);
+  AcquireCacheUpdate(thr, a);
+  s->mtx.ReadUnlock();
+}
+
+// Synchronizes with the write-locked SyncVar of a according to mo,
+// for read-modify-write operations.
+static void AtomicSync(ThreadState *thr, SyncVar *s, uptr a, morder mo) {
+  thr->clock.set(thr->tid, thr->fast_state.epoch());
+  if (IsAcqRelOrder(mo))
+    thr->clock.acq_rel(&s->clock);
+  else if (IsReleaseOrder(mo))
+    thr->clock.release(&s->clock);
+  else if (IsAcquireOrder(mo))
+    thr->clock.acquire(&s->clock);
+  if (IsAcquireOrder(mo))
+    AcquireCacheUpdate(thr, a);
+  if (IsReleaseOrder(mo)) {
+    s->OnClockRelease(thr->unique_id);
+    CTX()->synctab.OnRelease(a);
+    AtomicRelease *r = &thr->last_atomic_release;
+    r->addr = a;
+    r->epoch = thr->fast_state.epoch();
+    r->acquire_seq = thr->clock.acquire_seq();
+    r->version = CTX()->synctab.GetReleaseVersion(a);
+    r->acquire = IsAcquireOrder(mo);
+  }
+}
+
+// With merge_atomic_releases, a release by a read-modify-write operation
+// is merged into the previous one if it is done on the same variable and
+// the thread did not access memory, synchronize or acquire anything since
+// then. The thread clock is the same, so the release would not change
+// the SyncVar clock, and the memory access is the same as the previous one.
+static bool CanMergeRelease(ThreadState *thr, uptr a, morder mo) {
+  if (!flags()->merge_atomic_releases)
+    return false;
+  AtomicRelease *r = &thr->last_atomic_release;
+  return r->addr == a
+      && r->epoch == thr->fast_state.epoch()
+      && r->acquire_seq == thr->clock.acquire_seq()
+      && (r->acquire || !IsAcquireOrder(mo));
+}
+
+// Must be called after the merged operation. If another thread released
+// to a since the previous release, the operation could have observed that,
+// so the synchronization is done after all.
+static void FinishMergedRelease(ThreadState *thr, uptr pc, uptr a,
+                                morder mo) {
+  if (CTX()->synctab.GetReleaseVersion(a) ==
+      thr->last_atomic_release.version) {
+    StatInc(thr, StatAtomicReleaseMerged);
+    return;
+  }
+  SyncVar *s = CTX()->synctab.GetOrCreateAndLock(thr, pc, a, true);
+  AtomicSync(thr, s, a, mo);
+  s->mtx.Unlock();
+}
+
 template<typename T>
 static T AtomicLoad(ThreadState *thr, uptr pc, const volatile T *a,
     morder mo) {
@@ -253,9 +339,20 @@ static T AtomicLoad(ThreadState *thr, uptr pc, const volatile T *a,
     MemoryReadAtomic(thr, pc, (uptr)a, SizeLog<T>());
     return *a;
   }
+  if (sizeof(T) <= sizeof(a)) {
+    AcquireCacheEntry *e = AcquireCacheGet(thr, (uptr)a);
+    if (e->addr == (uptr)a) {
+      T v = *a;
+      if (AcquireCacheHit(thr, e, (uptr)a)) {
+        MemoryReadAtomic(thr, pc, (uptr)a, SizeLog<T>());
+        return v;
+      }
+    }
+  }
   SyncVar *s = CTX()->synctab.GetOrCreateAndLock(thr, pc, (uptr)a, false);
   thr->clock.set(thr->tid, thr->fast_state.epoch());
   thr->clock.acquire(&s->clock);
+  AcquireCacheUpdate(thr, (uptr)a);
   T v = *a;
   s->mtx.ReadUnlock();
   __sync_synchronize();
@@ -280,6 +377,8 @@ static void AtomicStore(ThreadState *thr, uptr pc, volatile T *a, T v,
   SyncVar *s = CTX()->synctab.GetOrCreateAndLock(thr, pc, (uptr)a, true);
   thr->clock.set(thr->tid, thr->fast_state.epoch());
   thr->clock.ReleaseStore(&s->clock);
+  s->OnClockRelease(thr->unique_id);
+  CTX()->synctab.OnRelease((uptr)a);
   *a = v;
   s->mtx.Unlock();
   // Trainling memory barrier to provide sequential consistency
@@ -289,17 +388,26 @@ static void AtomicStore(ThreadState *thr, uptr pc, volatile T *a, T v,
 
 template<typename T, T (*F)(volatile T *v, T op)>
 static T AtomicRMW(ThreadState *thr, uptr pc, volatile T *a, T v, morder mo) {
+  if (IsReleaseOrder(mo) && CanMergeRelease(thr, (uptr)a, mo)) {
+    v = F(a, v);
+    FinishMergedRelease(thr, pc, (uptr)a, mo);
+    return v;
+  }
+  if (IsAcquireOrder(mo) && !IsReleaseOrder(mo)) {
+    AcquireCacheEntry *e = AcquireCacheGet(thr, (uptr)a);
+    if (e->addr == (uptr)a) {
+      MemoryWriteAtomic(thr, pc, (uptr)a, SizeLog<T>());
+      v = F(a, v);
+      if (!AcquireCacheHit(thr, e, (uptr)a))
+        AtomicAcquireSlow(thr, pc, (uptr)a);
+      return v;
+    }
+  }
   MemoryWriteAtomic(thr, pc, (uptr)a, SizeLog<T>());
   SyncVar *s = 0;
   if (mo != mo_relaxed) {
     s = CTX()->synctab.GetOrCreateAndLock(thr, pc, (uptr)a, true);
-    thr->clock.set(thr->tid, thr->fast_state.epoch());
-    if (IsAcqRelOrder(mo))
-      thr->clock.acq_rel(&s->clock);
-    else if (IsReleaseOrder(mo))
-      thr->clock.release(&s->clock);
-    else if (IsAcquireOrder(mo))
-      thr->clock.acquire(&s->clock);
+    AtomicSync(thr, s, (uptr)a, mo);
   }
   v = F(a, v);
   if (s)
@@ -353,17 +461,34 @@ template<typename T>
 static bool AtomicCAS(ThreadState *thr, uptr pc,
     volatile T *a, T *c, T v, morder mo, morder fmo) {
   (void)fmo;  // Unused because llvm does not pass it yet.
+  if (IsReleaseOrder(mo) && CanMergeRelease(thr, (uptr)a, mo)) {
+    T cc = *c;
+    T pr = func_cas(a, cc, v);
+    FinishMergedRelease(thr, pc, (uptr)a, mo);
+    if (pr == cc)
+      return true;
+    *c = pr;
+    return false;
+  }
+  if (IsAcquireOrder(mo) && !IsReleaseOrder(mo)) {
+    AcquireCacheEntry *e = AcquireCacheGet(thr, (uptr)a);
+    if (e->addr == (uptr)a) {
+      MemoryWriteAtomic(thr, pc, (uptr)a, SizeLog<T>());
+      T cc = *c;
+      T pr = func_cas(a, cc, v);
+      if (!AcquireCacheHit(thr, e, (uptr)a))
+        AtomicAcquireSlow(thr, pc, (uptr)a);
+      if (pr == cc)
+        return true;
+      *c = pr;
+      return false;
+    }
+  }
   MemoryWriteAtomic(thr, pc, (uptr)a, SizeLog<T>());
   SyncVar *s = 0;
   if (mo != mo_relaxed) {
     s = CTX()->synctab.GetOrCreateAndLock(thr, pc, (uptr)a, true);
-    thr->clock.set(thr->tid, thr->fast_state.epoch());
-    if (IsAcqRelOrder(mo))
-      thr->clock.acq_rel(&s->clock);
-    else if (IsReleaseOrder(mo))
-      thr->clock.release(&s->clock);
-    else if (IsAcquireOrder(mo))
-      thr->clock.acquire(&s->clock);
+    AtomicSync(thr, s, (uptr)a, mo);
   }
   T cc = *c;
   T pr = func_cas(a, cc, v);
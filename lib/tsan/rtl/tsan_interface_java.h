@@ -52,6 +52,13 @@ void __tsan_java_free(jptr ptr, jptr size) INTERFACE_ATTRIBUTE;
 // Can be aggregated for several objects (preferably).
 // The ranges must not overlap.
 void __tsan_java_move(jptr src, jptr dst, jptr size) INTERFACE_ATTRIBUTE;
+// Batched callbacks for a whole GC cycle, equivalent to calling
+// __tsan_java_free for each of the n (ptr, size) pairs in frees and
+// __tsan_java_move for each of the n (src, dst, size) triples in moves,
+// in order. Several GC threads can issue batches concurrently
+// if the batches touch disjoint memory ranges.
+void __tsan_java_free_batch(const jptr *frees, jptr n) INTERFACE_ATTRIBUTE;
+void __tsan_java_move_batch(const jptr *moves, jptr n) INTERFACE_ATTRIBUTE;
 
 // Mutex lock.
 // Addr is any unique address associated with the mutex.
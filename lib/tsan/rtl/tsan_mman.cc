@@ -12,6 +12,7 @@
 //===----------------------------------------------------------------------===//
 #include "sanitizer_common/sanitizer_common.h"
 #include "sanitizer_common/sanitizer_placement_new.h"
+#include "sanitizer_common/sanitizer_timing.h"
 #include "tsan_mman.h"
 #include "tsan_rtl.h"
 #include "tsan_report.h"
@@ -31,6 +32,19 @@ namespace __tsan {
 
 COMPILER_CHECK(sizeof(MBlock) == 16);
 
+static const char *const kMBlockTypeNames[] = {
+  "ScopedBuf", "String", "StackTrace", "ShadowStack", "Sync", "Clock",
+  "ThreadContex", "DeadInfo", "RacyStacks", "RacyAddresses", "AtExit",
+  "Flag", "Report", "ReportMop", "ReportThread", "ReportMutex", "ReportLoc",
+  "ReportStack", "Suppression", "ExpectRace", "Signal", "FD", "JmpBuf",
+  "RestoreCache"
+};
+COMPILER_CHECK(ARRAY_SIZE(kMBlockTypeNames) == MBlockTypeCount);
+
+// Relaxed counters updated by internal_alloc, read by the memory profiler.
+static atomic_uint64_t internal_alloc_count[MBlockTypeCount];
+static atomic_uint64_t internal_alloc_size[MBlockTypeCount];
+
 void MBlock::Lock() {
   atomic_uintptr_t *a = reinterpret_cast<atomic_uintptr_t*>(this);
   uptr v = atomic_load(a, memory_order_relaxed);
@@ -62,6 +76,7 @@ struct MapUnmapCallback {
     // Mark the corresponding shadow memory as not needed.
     DontNeedShadowFor(p, size);
   }
+  void OnRelease(uptr p, uptr size) const { }
 };
 
 static char allocator_placeholder[sizeof(Allocator)] ALIGNED(64);
@@ -69,16 +84,85 @@ Allocator *allocator() {
   return reinterpret_cast<Allocator*>(&allocator_placeholder);
 }
 
+// Fixed-size objects of these types come from own slab arenas,
+// so that they do not fragment the internal allocator and each other.
+// Larger requests of these types go to the internal allocator.
+static const struct {
+  MBlockType typ;
+  uptr obj_size;
+} kSlabArenaDesc[kSlabArenaCount] = {
+  {MBlockSync, (sizeof(SyncVar) + kDefaultAlignment - 1)
+      & ~(kDefaultAlignment - 1)},
+  {MBlockFD, 16},  // FdSync
+};
+
+static int SlabArenaIndex(MBlockType typ) {
+  switch (typ) {
+    case MBlockSync: return 0;
+    case MBlockFD: return 1;
+    default: return -1;
+  }
+}
+
+static char slab_arena_placeholder[kSlabArenaCount][sizeof(SlabArena)]
+    ALIGNED(64);
+static SlabArena *slab_arena(int i) {
+  return reinterpret_cast<SlabArena*>(&slab_arena_placeholder[i]);
+}
+
 void InitializeAllocator() {
   allocator()->Init();
 }
 
+// The arenas are below the application memory, so they are mapped after
+// InitializePlatform() has checked that nothing is mapped there.
+void InitializeSlabArenas() {
+  if ((uptr)MmapFixedNoReserve(kSlabMemBegin, kSlabMemSize) != kSlabMemBegin) {
+    Printf("FATAL: ThreadSanitizer can not mmap slab arenas\n");
+    Die();
+  }
+  const uptr arena_size = kSlabMemSize / kSlabArenaCount;
+  for (int i = 0; i < kSlabArenaCount; i++) {
+    CHECK_EQ(SlabArenaIndex(kSlabArenaDesc[i].typ), i);
+    new(slab_arena(i)) SlabArena(kSlabMemBegin + i * arena_size, arena_size,
+                                 kSlabArenaDesc[i].obj_size);
+  }
+}
+
 void AllocatorThreadStart(ThreadState *thr) {
   allocator()->InitCache(&thr->alloc_cache);
   internal_allocator()->InitCache(&thr->internal_alloc_cache);
 }
 
+void GetSlabArenaStats(SlabArenaStat *stats) {
+  for (int i = 0; i < kSlabArenaCount; i++) {
+    stats[i].typ = kSlabArenaDesc[i].typ;
+    stats[i].mapped = slab_arena(i)->MappedBytes();
+    stats[i].allocated = slab_arena(i)->AllocatedBytes();
+  }
+}
+
+// SyncVars of freed blocks are destroyed when that many are retired.
+static const uptr kRetiredSyncBatch = 64;
+
+static void FlushRetiredSyncs(ThreadState *thr) {
+  SyncVar *s = thr->retired_syncs;
+  thr->retired_syncs = 0;
+  thr->retired_sync_count = 0;
+  while (s) {
+    SyncVar *res = s;
+    s = s->next;
+    // A thread racing with free() may still hold the mutex.
+    res->mtx.Lock();
+    res->mtx.Unlock();
+    DestroyAndFree(res);
+  }
+}
+
 void AllocatorThreadFinish(ThreadState *thr) {
+  FlushRetiredSyncs(thr);
+  for (int i = 0; i < kSlabArenaCount; i++)
+    thr->slab_cache[i].Drain(slab_arena(i));
   allocator()->DestroyCache(&thr->alloc_cache);
   internal_allocator()->DestroyCache(&thr->internal_alloc_cache);
 }
@@ -101,11 +185,13 @@ static void SignalUnsafeCall(ThreadState *thr, uptr pc) {
   }
 }
 
-void *user_alloc(ThreadState *thr, uptr pc, uptr sz, uptr align) {
+void *user_alloc(ThreadState *thr, uptr pc, uptr sz, uptr align,
+                 bool cleared) {
   CHECK_GT(thr->in_rtl, 0);
-  if ((sz >= (1ull << 40)) || (align >= (1ull << 40)))
+  ScopedTiming timing(kTimingMalloc);
+  if ((sz >= (1ull << MBlock::kSizeBits)) || (align >= (1ull << 40)))
     return 0;
-  void *p = allocator()->Allocate(&thr->alloc_cache, sz, align);
+  void *p = allocator()->Allocate(&thr->alloc_cache, sz, align, cleared);
   if (p == 0)
     return 0;
   MBlock *b = new(allocator()->GetMetaData(p)) MBlock;
@@ -120,19 +206,30 @@ void *user_alloc(ThreadState *thr, uptr pc, uptr sz, uptr align) {
 void user_free(ThreadState *thr, uptr pc, void *p) {
   CHECK_GT(thr->in_rtl, 0);
   CHECK_NE(p, (void*)0);
+  ScopedTiming timing(kTimingFree);
   DPrintf("#%d: free(%p)\n", thr->tid, p);
   MBlock *b = (MBlock*)allocator()->GetMetaData(p);
   if (b->ListHead()) {
-    MBlock::ScopedLock l(b);
-    for (SyncVar *s = b->ListHead(); s;) {
-      SyncVar *res = s;
-      s = s->next;
-      StatInc(thr, StatSyncDestroyed);
-      res->mtx.Lock();
-      res->mtx.Unlock();
-      DestroyAndFree(res);
+    // Only unlink the SyncVars under the block lock, and destroy them
+    // later together with SyncVars of other freed blocks.
+    SyncVar *head = 0;
+    {
+      MBlock::ScopedLock l(b);
+      head = b->ListHead();
+      b->ListReset();
+    }
+    if (head) {
+      SyncVar *tail = head;
+      uptr n = 1;
+      for (; tail->next; tail = tail->next)
+        n++;
+      StatInc(thr, StatSyncDestroyed, n);
+      tail->next = thr->retired_syncs;
+      thr->retired_syncs = head;
+      thr->retired_sync_count += n;
+      if (thr->retired_sync_count >= kRetiredSyncBatch)
+        FlushRetiredSyncs(thr);
     }
-    b->ListReset();
   }
   if (CTX() && CTX()->initialized && thr->in_rtl == 1)
     MemoryRangeFreed(thr, pc, (uptr)p, b->Size());
@@ -201,6 +298,14 @@ void *internal_alloc(MBlockType typ, uptr sz) {
     thr->nomalloc = 0;  // CHECK calls internal_malloc().
     CHECK(0);
   }
+  atomic_fetch_add(&internal_alloc_count[typ], 1, memory_order_relaxed);
+  atomic_fetch_add(&internal_alloc_size[typ], sz, memory_order_relaxed);
+  int slab = SlabArenaIndex(typ);
+  if (slab >= 0 && sz <= slab_arena(slab)->ObjSize()) {
+    void *p = thr->slab_cache[slab].Alloc(slab_arena(slab));
+    if (p)
+      return p;
+  }
   return InternalAlloc(sz, &thr->internal_alloc_cache);
 }
 
@@ -211,9 +316,53 @@ void internal_free(void *p) {
     thr->nomalloc = 0;  // CHECK calls internal_malloc().
     CHECK(0);
   }
+  if ((uptr)p - kSlabMemBegin < kSlabMemSize) {
+    int slab = ((uptr)p - kSlabMemBegin) / (kSlabMemSize / kSlabArenaCount);
+    thr->slab_cache[slab].Free(slab_arena(slab), p);
+    return;
+  }
   InternalFree(p, &thr->internal_alloc_cache);
 }
 
+void GetInternalAllocStats(InternalAllocStat *stats) {
+  for (int i = 0; i < MBlockTypeCount; i++) {
+    stats[i].count = atomic_load(&internal_alloc_count[i],
+                                 memory_order_relaxed);
+    stats[i].size = atomic_load(&internal_alloc_size[i], memory_order_relaxed);
+  }
+}
+
+const char *MBlockTypeName(MBlockType typ) {
+  CHECK_LT(typ, MBlockTypeCount);
+  return kMBlockTypeNames[typ];
+}
+
+uptr GetInternalAllocatedBytes() {
+  if (internal_allocator() == 0)
+    return 0;
+  u64 stats[AllocatorStatCount];
+  internal_allocator()->GetStats(stats);
+  u64 m = stats[AllocatorStatMalloced];
+  u64 f = stats[AllocatorStatFreed];
+  return m >= f ? m - f : 0;
+}
+
+uptr GetUserAllocatedBytes() {
+  u64 stats[AllocatorStatCount];
+  allocator()->GetStats(stats);
+  u64 m = stats[AllocatorStatMalloced];
+  u64 f = stats[AllocatorStatFreed];
+  return m >= f ? m - f : 0;
+}
+
+uptr GetUserMappedBytes() {
+  u64 stats[AllocatorStatCount];
+  allocator()->GetStats(stats);
+  u64 m = stats[AllocatorStatMmapped];
+  u64 f = stats[AllocatorStatUnmapped];
+  return m >= f ? m - f : 0;
+}
+
 }  // namespace __tsan
 
 using namespace __tsan;
@@ -20,13 +20,14 @@ namespace __tsan {
 const uptr kDefaultAlignment = 16;
 
 void InitializeAllocator();
+void InitializeSlabArenas();
 void AllocatorThreadStart(ThreadState *thr);
 void AllocatorThreadFinish(ThreadState *thr);
 void AllocatorPrintStats();
 
-// For user allocations.
+// For user allocations. If cleared, the memory is zero.
 void *user_alloc(ThreadState *thr, uptr pc, uptr sz,
-                 uptr align = kDefaultAlignment);
+                 uptr align = kDefaultAlignment, bool cleared = false);
 // Does not accept NULL.
 void user_free(ThreadState *thr, uptr pc, void *p);
 void *user_realloc(ThreadState *thr, uptr pc, void *p, uptr sz);
@@ -64,6 +65,7 @@ enum MBlockType {
   MBlockSignal,
   MBlockFD,
   MBlockJmpBuf,
+  MBlockRestoreCache,
 
   // This must be the last.
   MBlockTypeCount
@@ -73,6 +75,31 @@ enum MBlockType {
 void *internal_alloc(MBlockType typ, uptr sz);
 void internal_free(void *p);
 
+// Cumulative number and size of internal allocations of one MBlockType.
+struct InternalAllocStat {
+  u64 count;
+  u64 size;
+};
+
+// Fills MBlockTypeCount elements of stats.
+void GetInternalAllocStats(InternalAllocStat *stats);
+const char *MBlockTypeName(MBlockType typ);
+// Bytes currently allocated from the internal allocator.
+uptr GetInternalAllocatedBytes();
+// Bytes currently allocated and mapped by the user allocator.
+uptr GetUserAllocatedBytes();
+uptr GetUserMappedBytes();
+
+// Memory of a slab arena (see tsan_slab.h).
+struct SlabArenaStat {
+  MBlockType typ;
+  uptr mapped;
+  uptr allocated;
+};
+
+// Fills kSlabArenaCount elements of stats.
+void GetSlabArenaStats(SlabArenaStat *stats);
+
 template<typename T>
 void DestroyAndFree(T *&p) {
   p->~T();
@@ -271,4 +271,55 @@ void Mutex::CheckLocked() {
   CHECK_NE(atomic_load(&state_, memory_order_relaxed), 0);
 }
 
+TicketMutex::TicketMutex(MutexType type, StatType stat_type) {
+  CHECK_GT(type, MutexTypeInvalid);
+  CHECK_LT(type, MutexTypeCount);
+#if TSAN_DEBUG
+  type_ = type;
+#endif
+#if TSAN_COLLECT_STATS
+  stat_type_ = stat_type;
+#endif
+  atomic_store(&next_, 0, memory_order_relaxed);
+  atomic_store(&serving_, 0, memory_order_relaxed);
+}
+
+TicketMutex::~TicketMutex() {
+  CHECK_EQ(atomic_load(&next_, memory_order_relaxed),
+           atomic_load(&serving_, memory_order_relaxed));
+}
+
+void TicketMutex::Lock() {
+#if TSAN_DEBUG && !TSAN_GO
+  cur_thread()->deadlock_detector.Lock(type_);
+#endif
+  u32 ticket = atomic_fetch_add(&next_, 1, memory_order_relaxed);
+  if (atomic_load(&serving_, memory_order_acquire) == ticket)
+    return;
+  for (Backoff backoff; backoff.Do();) {
+    if (atomic_load(&serving_, memory_order_acquire) == ticket) {
+#if TSAN_COLLECT_STATS
+      StatInc(cur_thread(), stat_type_, backoff.Contention());
+#endif
+      return;
+    }
+  }
+}
+
+void TicketMutex::Unlock() {
+  DCHECK_NE(atomic_load(&next_, memory_order_relaxed),
+            atomic_load(&serving_, memory_order_relaxed));
+  // Only the owner writes serving_.
+  u32 serving = atomic_load(&serving_, memory_order_relaxed);
+  atomic_store(&serving_, serving + 1, memory_order_release);
+#if TSAN_DEBUG && !TSAN_GO
+  cur_thread()->deadlock_detector.Unlock(type_);
+#endif
+}
+
+void TicketMutex::CheckLocked() {
+  CHECK_NE(atomic_load(&next_, memory_order_relaxed),
+           atomic_load(&serving_, memory_order_relaxed));
+}
+
 }  // namespace __tsan
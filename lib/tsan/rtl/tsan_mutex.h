@@ -62,8 +62,38 @@ class Mutex {
   void operator = (const Mutex&);
 };
 
+// Exclusive FIFO ticket lock. Unlike Mutex, waiters do not race on
+// compare-and-swap of the lock word: each one takes a ticket and spins
+// reading the ticket being served, so under contention the lock is handed
+// over in arrival order with a single cache line transfer per handoff.
+// Zero-initialized object is an unlocked mutex.
+class TicketMutex {
+ public:
+  explicit TicketMutex(MutexType type, StatType stat_type);
+  ~TicketMutex();
+
+  void Lock();
+  void Unlock();
+
+  void CheckLocked();
+
+ private:
+  atomic_uint32_t next_;     // Next ticket to hand out.
+  atomic_uint32_t serving_;  // Ticket of the current owner.
+#if TSAN_DEBUG
+  MutexType type_;
+#endif
+#if TSAN_COLLECT_STATS
+  StatType stat_type_;
+#endif
+
+  TicketMutex(const TicketMutex&);
+  void operator = (const TicketMutex&);
+};
+
 typedef GenericScopedLock<Mutex> Lock;
 typedef GenericScopedReadLock<Mutex> ReadLock;
+typedef GenericScopedLock<TicketMutex> TicketLock;
 
 class DeadlockDetector {
  public:
@@ -16,17 +16,23 @@
 namespace __tsan {
 
 const uptr MutexSet::kMaxSize;
+const u64 MutexSet::kMaxCount;
 
 MutexSet::MutexSet() {
   size_ = 0;
   internal_memset(&descs_, 0, sizeof(descs_));
 }
 
+// Mutexes are mostly released in the reverse order of acquisition, and
+// recursive locking re-acquires the most recent one, so all lookups scan
+// from the most recently added descriptor.
+
 void MutexSet::Add(u64 id, bool write, u64 epoch) {
   // Look up existing mutex with the same id.
-  for (uptr i = 0; i < size_; i++) {
+  for (uptr i = size_; i-- > 0; ) {
     if (descs_[i].id == id) {
-      descs_[i].count++;
+      if (descs_[i].count < kMaxCount)
+        descs_[i].count++;
       descs_[i].epoch = epoch;
       return;
     }
@@ -53,7 +59,7 @@ void MutexSet::Add(u64 id, bool write, u64 epoch) {
 }
 
 void MutexSet::Del(u64 id, bool write) {
-  for (uptr i = 0; i < size_; i++) {
+  for (uptr i = size_; i-- > 0; ) {
     if (descs_[i].id == id) {
       if (--descs_[i].count == 0)
         RemovePos(i);
@@ -63,7 +69,7 @@ void MutexSet::Del(u64 id, bool write) {
 }
 
 void MutexSet::Remove(u64 id) {
-  for (uptr i = 0; i < size_; i++) {
+  for (uptr i = size_; i-- > 0; ) {
     if (descs_[i].id == id) {
       RemovePos(i);
       return;
@@ -22,12 +22,15 @@ class MutexSet {
  public:
   // Holds limited number of mutexes.
   // The oldest mutexes are discarded on overflow.
-  static const uptr kMaxSize = 16;
+  // The set is copied into every trace part header, so it is kept compact
+  // rather than growing dynamically.
+  static const uptr kMaxSize = 32;
+  static const u64 kMaxCount = (1ull << (63 - kClkBits)) - 1;
   struct Desc {
     u64 id;
-    u64 epoch;
-    int count;
-    bool write;
+    u64 epoch : kClkBits;
+    u64 count : 63 - kClkBits;  // Saturates at kMaxCount.
+    u64 write : 1;
   };
 
   MutexSet();
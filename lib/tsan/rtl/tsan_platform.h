@@ -18,7 +18,9 @@ C++ linux memory layout:
 03c0 0000 0000 - 1000 0000 0000: shadow
 1000 0000 0000 - 6000 0000 0000: protected
 6000 0000 0000 - 6200 0000 0000: traces
-6200 0000 0000 - 7d00 0000 0000: -
+6200 0000 0000 - 6400 0000 0000: -
+6400 0000 0000 - 6500 0000 0000: slab arenas
+6500 0000 0000 - 7d00 0000 0000: -
 7d00 0000 0000 - 7e00 0000 0000: heap
 7e00 0000 0000 - 7fff ffff ffff: modules and main thread stack
 
@@ -29,7 +31,9 @@ C++ COMPAT linux memory layout:
 2900 0000 0000 - 2c00 0000 0000: modules
 2c00 0000 0000 - 6000 0000 0000: -
 6000 0000 0000 - 6200 0000 0000: traces
-6200 0000 0000 - 7d00 0000 0000: -
+6200 0000 0000 - 6400 0000 0000: -
+6400 0000 0000 - 6500 0000 0000: slab arenas
+6500 0000 0000 - 7d00 0000 0000: -
 7d00 0000 0000 - 7e00 0000 0000: heap
 7e00 0000 0000 - 7f00 0000 0000: -
 7f00 0000 0000 - 7fff ffff ffff: main thread stack
@@ -91,6 +95,12 @@ const uptr kTraceMemBegin = 0x600000000000ULL;
 #endif
 const uptr kTraceMemSize = 0x020000000000ULL;
 
+#ifndef TSAN_GO
+// Slab arenas of runtime objects (see tsan_slab.h).
+const uptr kSlabMemBegin = 0x640000000000ULL;
+const uptr kSlabMemSize = 0x010000000000ULL;
+#endif
+
 // This has to be a macro to allow constant initialization of constants below.
 #ifndef TSAN_GO
 #define MemToShadow(addr) \
@@ -133,10 +143,18 @@ static inline uptr AlternativeAddress(uptr addr) {
 }
 
 void FlushShadowMemory();
+// Maps the kShadowRodata marker into the shadow of [addr, addr + size),
+// where addr is page aligned, so that accesses to it are not checked.
+// Returns false if that is not supported.
+bool MapShadowRodata(uptr addr, uptr size);
+uptr GetShadowMemoryConsumption();
 void WriteMemoryProfile(char *buf, uptr buf_size);
 
 const char *InitializePlatform();
 void FinalizePlatform();
+// The traces of all tids must fit into the trace memory.
+COMPILER_CHECK((u64)kMaxTid * 2 * kTraceSize * sizeof(Event) <= kTraceMemSize);
+
 uptr ALWAYS_INLINE GetThreadTrace(int tid) {
   uptr p = kTraceMemBegin + (uptr)(tid * 2) * kTraceSize * sizeof(Event);
   DCHECK_LT(p, kTraceMemBegin + kTraceMemSize);
@@ -143,6 +143,28 @@ void WriteMemoryProfile(char *buf, uptr buf_size) {
       mi.arena >> 20, mi.hblkhd >> 20, mi.fordblks >> 20, mi.keepcost >> 20);
 }
 
+uptr GetShadowMemoryConsumption() {
+  char *smaps = 0;
+  uptr smaps_cap = 0;
+  uptr smaps_len = ReadFileToBuffer("/proc/self/smaps",
+      &smaps, &smaps_cap, 64<<20);
+  uptr total = 0;
+  bool shadow = false;
+  const char *pos = smaps;
+  while (pos < smaps + smaps_len) {
+    if (ishex(pos[0])) {
+      uptr start = readhex(pos);
+      shadow = start >= kLinuxShadowBeg && start < kLinuxShadowEnd;
+    } else if (shadow && internal_strncmp(pos, "Rss:", 4) == 0) {
+      for (; *pos < '0' || *pos > '9'; pos++) {}
+      total += readdec(pos) * 1024;
+    }
+    while (*pos++ != '\n') {}
+  }
+  UnmapOrDie(smaps, smaps_cap);
+  return total;
+}
+
 void FlushShadowMemory() {
   FlushUnneededShadowMemory(kLinuxShadowBeg, kLinuxShadowEnd - kLinuxShadowBeg);
 }
@@ -162,6 +184,35 @@ static void ProtectRange(uptr beg, uptr end) {
 #endif
 
 #ifndef TSAN_GO
+// An unlinked file filled with kShadowRodata, which is mapped (read-only)
+// into the shadow of memory that can't race. The page cache pages are
+// shared by all such shadow, so it costs no memory.
+static fd_t rodata_marker_fd = kInvalidFd;
+static const uptr kRodataMarkerSize = 512 * 1024;
+
+static bool MapShadowRodataRange(char *shadow_start, char *shadow_end) {
+  for (char *p = shadow_start; p < shadow_end; p += kRodataMarkerSize) {
+    uptr res = internal_mmap(p, Min<uptr>(kRodataMarkerSize, shadow_end - p),
+                             PROT_READ, MAP_PRIVATE | MAP_FIXED,
+                             rodata_marker_fd, 0);
+    if (internal_iserror(res))
+      return false;
+  }
+  return true;
+}
+
+bool MapShadowRodata(uptr addr, uptr size) {
+  if (rodata_marker_fd == kInvalidFd || addr % kPageSize != 0)
+    return false;
+  char *shadow_start = (char*)MemToShadow(addr);
+  char *shadow_end = (char*)MemToShadow(RoundUpTo(addr + size, kPageSize));
+  if (MapShadowRodataRange(shadow_start, shadow_end))
+    return true;
+  // Undo a partial mapping.
+  MmapFixedNoReserve((uptr)shadow_start, shadow_end - shadow_start);
+  return false;
+}
+
 // Mark shadow for .rodata sections with the special kShadowRodata marker.
 // Accesses to .rodata can't race, so this saves time, memory and trace space.
 static void MapRodata() {
@@ -183,19 +234,22 @@ static void MapRodata() {
     return;
   fd_t fd = openrv;
   // Fill the file with kShadowRodata.
-  const uptr kMarkerSize = 512 * 1024 / sizeof(u64);
+  const uptr kMarkerSize = kRodataMarkerSize / sizeof(u64);
   InternalScopedBuffer<u64> marker(kMarkerSize);
   for (u64 *p = marker.data(); p < marker.data() + kMarkerSize; p++)
     *p = kShadowRodata;
   internal_write(fd, marker.data(), marker.size());
+  internal_unlink(filename);
   // Map the file into memory.
   uptr page = internal_mmap(0, kPageSize, PROT_READ | PROT_WRITE,
                             MAP_PRIVATE | MAP_ANONYMOUS, fd, 0);
   if (internal_iserror(page)) {
     internal_close(fd);
-    internal_unlink(filename);
     return;
   }
+  // The file stays open for mappings created later (see the mmap
+  // interceptor).
+  rodata_marker_fd = fd;
   // Map the file into shadow of .rodata sections.
   MemoryMappingLayout proc_maps(/*cache_enabled*/true);
   uptr start, end, offset, prot;
@@ -207,16 +261,9 @@ static void MapRodata() {
         && !(prot & MemoryMappingLayout::kProtectionWrite)
         && IsAppMem(start)) {
       // Assume it's .rodata
-      char *shadow_start = (char*)MemToShadow(start);
-      char *shadow_end = (char*)MemToShadow(end);
-      for (char *p = shadow_start; p < shadow_end; p += marker.size()) {
-        internal_mmap(p, Min<uptr>(marker.size(), shadow_end - p),
-                      PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
-      }
+      MapShadowRodataRange((char*)MemToShadow(start), (char*)MemToShadow(end));
     }
   }
-  internal_close(fd);
-  internal_unlink(filename);
 }
 
 void InitializeShadowMemory() {
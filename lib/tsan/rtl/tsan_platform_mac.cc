@@ -54,6 +54,10 @@ void FlushShadowMemory() {
 }
 
 #ifndef TSAN_GO
+bool MapShadowRodata(uptr addr, uptr size) {
+  return false;
+}
+
 void InitializeShadowMemory() {
   uptr shadow = (uptr)MmapFixedNoReserve(kLinuxShadowBeg,
     kLinuxShadowEnd - kLinuxShadowBeg);
@@ -23,6 +23,7 @@ ReportDesc::ReportDesc()
     , mutexes(MBlockReportMutex)
     , threads(MBlockReportThread)
     , sleep()
+    , sleep_stack_id()
     , count() {
 }
 
@@ -39,6 +39,12 @@ struct ReportStack {
   int col;
 };
 
+// The stacks that describe the context of a report (creation of the threads,
+// mutexes and fds, heap allocation, sleep) are recorded as StackDepot ids,
+// and are materialized into ReportStack lists only when the report is output
+// (see ScopedReport::SymbolizeStacks), so suppressed reports do not pay for
+// their symbolization. In Go the stacks are symbolized when they are added.
+
 struct ReportMopMutex {
   u64 id;
   bool write;
@@ -76,6 +82,7 @@ struct ReportLocation {
   char *file;
   int line;
   ReportStack *stack;
+  u32 stack_id;
 };
 
 struct ReportThread {
@@ -85,12 +92,14 @@ struct ReportThread {
   char *name;
   int parent_tid;
   ReportStack *stack;
+  u32 stack_id;
 };
 
 struct ReportMutex {
   u64 id;
   bool destroyed;
   ReportStack *stack;
+  u32 stack_id;
 };
 
 class ReportDesc {
@@ -102,6 +111,7 @@ class ReportDesc {
   Vector<ReportMutex*> mutexes;
   Vector<ReportThread*> threads;
   ReportStack *sleep;
+  u32 sleep_stack_id;
   int count;
 
   ReportDesc();
@@ -116,6 +126,12 @@ class ReportDesc {
 void PrintReport(const ReportDesc *rep);
 void PrintStack(const ReportStack *stack);
 
+#ifndef TSAN_GO
+// Binary report log for offline symbolization (see report_log_path flag).
+bool ReportLogEnabled();
+void WriteReportLog(const ReportDesc *rep);
+#endif
+
 }  // namespace __tsan
 
 #endif  // TSAN_REPORT_H
@@ -0,0 +1,186 @@
+//===-- tsan_report_log.cc ------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of ThreadSanitizer (TSan), a race detector.
+//
+// Binary report log for offline symbolization (report_log_path flag).
+// The log starts with kReportLogMagic followed by the pid (u64), then
+// holds records of the form {u32 kind, u32 size, u8 payload[size]}:
+//   ReportLogModules: u64 n, then n times
+//                     {u64 start, u64 end, u64 offset, u32 len, char name[len]}
+//                     for every executable mapping.
+//   ReportLogReport:  u32 type, u32 n, then n ReportLogItem's, each followed
+//                     by npc u64 pcs (return addresses, as in the trace).
+// A modules record is written before the first report and whenever
+// the set of executable mappings changes.
+// The log is symbolized by lib/tsan/symbolize_report_log.py.
+//===----------------------------------------------------------------------===//
+#include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_libc.h"
+#include "sanitizer_common/sanitizer_procmaps.h"
+#include "tsan_flags.h"
+#include "tsan_report.h"
+#include "tsan_rtl.h"
+
+namespace __tsan {
+
+static const char kReportLogMagic[8] = {'T', 'S', 'A', 'N', 'R', 'L', 'G', '1'};
+
+enum ReportLogRecordKind {
+  ReportLogModules = 1,
+  ReportLogReport = 2
+};
+
+enum ReportLogItemKind {
+  ReportLogItemStack,
+  ReportLogItemMop,       // flags: 1 - write, 2 - atomic.
+  ReportLogItemLocation,  // flags: ReportLocationType.
+  ReportLogItemThread,    // flags: 1 - running; addr: pid; size: parent tid.
+  ReportLogItemMutex,     // flags: 1 - destroyed; addr: mutex id.
+  ReportLogItemSleep
+};
+
+struct ReportLogItem {
+  u8 kind;
+  u8 flags;
+  u16 reserved;
+  s32 tid;
+  u64 addr;
+  u64 size;
+  u64 npc;
+};
+
+// The log is accessed only under ctx->report_mtx.
+static fd_t log_fd = kInvalidFd;
+static u64 log_modules_hash;
+
+bool ReportLogEnabled() {
+  return flags()->report_log_path[0] != 0;
+}
+
+static void AppendBytes(InternalMmapVector<char> *buf, const void *p,
+                        uptr size) {
+  for (uptr i = 0; i < size; i++)
+    buf->push_back(((const char*)p)[i]);
+}
+
+template<typename T>
+static void Append(InternalMmapVector<char> *buf, T v) {
+  AppendBytes(buf, &v, sizeof(v));
+}
+
+static void AppendRecord(InternalMmapVector<char> *buf, u32 kind,
+                         const InternalMmapVector<char> &payload) {
+  Append<u32>(buf, kind);
+  Append<u32>(buf, payload.size());
+  AppendBytes(buf, payload.data(), payload.size());
+}
+
+static void AppendModules(InternalMmapVector<char> *buf) {
+  InternalMmapVector<char> payload(4096);
+  InternalScopedBuffer<char> name(kMaxPathLength);
+  MemoryMappingLayout proc_maps(/*cache_enabled*/true);
+  uptr start, end, offset, prot;
+  u64 n = 0;
+  u64 hash = 0;
+  Append<u64>(&payload, 0);  // Patched below.
+  while (proc_maps.Next(&start, &end, &offset, name.data(), name.size(),
+                        &prot)) {
+    if ((prot & MemoryMappingLayout::kProtectionExecute) == 0)
+      continue;
+    u32 len = internal_strlen(name.data());
+    Append<u64>(&payload, start);
+    Append<u64>(&payload, end);
+    Append<u64>(&payload, offset);
+    Append<u32>(&payload, len);
+    AppendBytes(&payload, name.data(), len);
+    hash = hash * 31 + (start ^ (end << 7) ^ offset) + len;
+    n++;
+  }
+  if (n != 0 && hash == log_modules_hash)
+    return;
+  log_modules_hash = hash;
+  internal_memcpy(&payload[0], &n, sizeof(n));
+  AppendRecord(buf, ReportLogModules, payload);
+}
+
+static void AppendItem(InternalMmapVector<char> *payload, u32 *nitems,
+                       u8 kind, u8 flags, s32 tid, uptr addr, uptr size,
+                       const ReportStack *stack) {
+  uptr npc = 0;
+  for (const ReportStack *ent = stack; ent; ent = ent->next)
+    npc++;
+  ReportLogItem item = {kind, flags, 0, tid, addr, size, npc};
+  AppendBytes(payload, &item, sizeof(item));
+  for (const ReportStack *ent = stack; ent; ent = ent->next)
+    Append<u64>(payload, ent->pc);
+  (*nitems)++;
+}
+
+static bool OpenReportLog() {
+  if (log_fd != kInvalidFd)
+    return true;
+  InternalScopedBuffer<char> path(kMaxPathLength);
+  internal_snprintf(path.data(), path.size(), "%s.%d",
+                    flags()->report_log_path, (int)internal_getpid());
+  uptr openrv = OpenFile(path.data(), true);
+  if (internal_iserror(openrv)) {
+    Printf("ThreadSanitizer: failed to open report log '%s'\n", path.data());
+    return false;
+  }
+  log_fd = openrv;
+  u64 pid = internal_getpid();
+  internal_write(log_fd, kReportLogMagic, sizeof(kReportLogMagic));
+  internal_write(log_fd, &pid, sizeof(pid));
+  return true;
+}
+
+void WriteReportLog(const ReportDesc *rep) {
+  if (!OpenReportLog())
+    return;
+  InternalMmapVector<char> buf(4096);
+  AppendModules(&buf);
+  InternalMmapVector<char> payload(4096);
+  u32 nitems = 0;
+  Append<u32>(&payload, rep->typ);
+  Append<u32>(&payload, 0);  // Patched below.
+  for (uptr i = 0; i < rep->stacks.Size(); i++)
+    AppendItem(&payload, &nitems, ReportLogItemStack, 0, 0, 0, 0,
+               rep->stacks[i]);
+  for (uptr i = 0; i < rep->mops.Size(); i++) {
+    const ReportMop *mop = rep->mops[i];
+    AppendItem(&payload, &nitems, ReportLogItemMop,
+               (mop->write ? 1 : 0) | (mop->atomic ? 2 : 0),
+               mop->tid, mop->addr, mop->size, mop->stack);
+  }
+  for (uptr i = 0; i < rep->locs.Size(); i++) {
+    const ReportLocation *loc = rep->locs[i];
+    AppendItem(&payload, &nitems, ReportLogItemLocation, loc->type,
+               loc->type == ReportLocationFD ? loc->fd : loc->tid,
+               loc->addr, loc->size, loc->stack);
+  }
+  for (uptr i = 0; i < rep->threads.Size(); i++) {
+    const ReportThread *rt = rep->threads[i];
+    AppendItem(&payload, &nitems, ReportLogItemThread, rt->running,
+               rt->id, rt->pid, rt->parent_tid, rt->stack);
+  }
+  for (uptr i = 0; i < rep->mutexes.Size(); i++) {
+    const ReportMutex *rm = rep->mutexes[i];
+    AppendItem(&payload, &nitems, ReportLogItemMutex, rm->destroyed,
+               0, rm->id, 0, rm->stack);
+  }
+  if (rep->sleep)
+    AppendItem(&payload, &nitems, ReportLogItemSleep, 0, 0, 0, 0, rep->sleep);
+  internal_memcpy(&payload[sizeof(u32)], &nitems, sizeof(nitems));
+  AppendRecord(&buf, ReportLogReport, payload);
+  // One write per report, so that a crash does not leave half a record.
+  internal_write(log_fd, buf.data(), buf.size());
+}
+
+}  // namespace __tsan
@@ -14,10 +14,12 @@
 
 #include "sanitizer_common/sanitizer_atomic.h"
 #include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_coverage.h"
 #include "sanitizer_common/sanitizer_libc.h"
 #include "sanitizer_common/sanitizer_stackdepot.h"
 #include "sanitizer_common/sanitizer_placement_new.h"
 #include "sanitizer_common/sanitizer_symbolizer.h"
+#include "sanitizer_common/sanitizer_timing.h"
 #include "tsan_defs.h"
 #include "tsan_platform.h"
 #include "tsan_rtl.h"
@@ -25,6 +27,14 @@
 #include "tsan_suppressions.h"
 #include "tsan_symbolize.h"
 
+#if TSAN_VECTORIZE
+// <emmintrin.h> includes <mm_malloc.h>, which needs <stdlib.h>. The runtime
+// is built without libc headers (see NO_SYSROOT in Makefile.old).
+# define _MM_MALLOC_H_INCLUDED
+# define __MM_MALLOC_H
+# include <emmintrin.h>
+#endif
+
 volatile int __tsan_resumed = 0;
 
 extern "C" void __tsan_resume() {
@@ -75,10 +85,13 @@ Context::Context()
   , racy_stacks(MBlockRacyStacks)
   , racy_addresses(MBlockRacyAddresses)
   , fired_suppressions(8) {
+  for (uptr i = 0; i < kKnownRaces; i++)
+    atomic_store(&known_races[i], 0, memory_order_relaxed);
 }
 
 // The objects are allocated in TLS, so one may rely on zero-initialization.
-ThreadState::ThreadState(Context *ctx, int tid, int unique_id, u64 epoch,
+ThreadState::ThreadState(Context *ctx, int tid, int unique_id,
+                         int reuse_count, u64 epoch,
                          uptr stk_addr, uptr stk_size,
                          uptr tls_addr, uptr tls_size)
   : fast_state(tid, epoch)
@@ -87,15 +100,29 @@ ThreadState::ThreadState(Context *ctx, int tid, int unique_id, u64 epoch,
   // , ignore_reads_and_writes()
   // , in_rtl()
   , shadow_stack_pos(&shadow_stack[0])
+  // The clock is 128K, clearing it would touch all of its pages.
+  , clock(tid, reuse_count, /*zeroed=*/ true)
 #ifndef TSAN_GO
   , jmp_bufs(MBlockJmpBuf)
+  , retired_syncs()
+  , retired_sync_count()
 #endif
+  , stat_sampled(false)
+  , stat_sample_rate(kCollectStats ? 0 : flags()->stats_sample_rate)
+  , stat_sample_countdown(stat_sample_rate)
+  , mop_sample_period(flags()->access_sample_rate > 1 ?
+                      flags()->access_sample_rate * kMopSampleBurst : 0)
+  // Start with a burst, to check the accesses of short threads.
+  , mop_sample_countdown(kMopSampleBurst)
+  , ignore_range_count()
   , tid(tid)
   , unique_id(unique_id)
   , stk_addr(stk_addr)
   , stk_size(stk_size)
   , tls_addr(tls_addr)
-  , tls_size(tls_size) {
+  , tls_size(tls_size)
+  , last_barrier_id()
+  , last_barrier_seq() {
 }
 
 static void MemoryProfiler(Context *ctx, fd_t fd, int i) {
@@ -110,6 +137,74 @@ static void MemoryProfiler(Context *ctx, fd_t fd, int i) {
   internal_write(fd, buf.data(), internal_strlen(buf.data()));
 }
 
+// Writes one JSON line with runtime memory broken down by component.
+// All numbers come from counters, so this is cheap enough to run every second.
+static void MemoryProfilerJson(Context *ctx, fd_t fd, int i) {
+  uptr n_threads;
+  uptr n_running_threads;
+  ctx->thread_registry->GetNumberOfThreads(&n_threads, &n_running_threads);
+  uptr nsync = 0;
+  uptr sync = ctx->synctab.GetMemoryConsumption(&nsync);
+  uptr trace = n_threads * (TraceSize() * sizeof(Event) + sizeof(Trace));
+  InternalScopedBuffer<char> buf(4096);
+  char *pos = buf.data();
+  char *end = pos + buf.size();
+  pos += internal_snprintf(pos, end - pos,
+      "{\"t\":%d,\"nthr\":%zu,\"nlive\":%zu,\"sync\":%zu,\"nsync\":%zu,"
+      "\"trace\":%zu", i, n_threads, n_running_threads, sync, nsync, trace);
+#ifndef TSAN_GO
+  StackDepotStats *depot = StackDepotGetStats();
+  pos += internal_snprintf(pos, end - pos,
+      ",\"heap\":%zu,\"heap_mapped\":%zu,\"internal\":%zu,"
+      "\"stack_depot\":%zu,\"mblock\":{",
+      GetUserAllocatedBytes(), GetUserMappedBytes(),
+      GetInternalAllocatedBytes(), depot ? depot->mapped : 0);
+  InternalAllocStat stats[MBlockTypeCount];
+  GetInternalAllocStats(stats);
+  bool first = true;
+  for (int typ = 0; typ < MBlockTypeCount; typ++) {
+    if (stats[typ].count == 0)
+      continue;
+    pos += internal_snprintf(pos, end - pos, "%s\"%s\":[%llu,%llu]",
+        first ? "" : ",", MBlockTypeName((MBlockType)typ),
+        stats[typ].count, stats[typ].size);
+    first = false;
+  }
+  pos += internal_snprintf(pos, end - pos, "},\"slab\":{");
+  SlabArenaStat slabs[kSlabArenaCount];
+  GetSlabArenaStats(slabs);
+  for (int i = 0; i < kSlabArenaCount; i++) {
+    pos += internal_snprintf(pos, end - pos, "%s\"%s\":[%zu,%zu]",
+        i ? "," : "", MBlockTypeName(slabs[i].typ),
+        slabs[i].mapped, slabs[i].allocated);
+  }
+  pos += internal_snprintf(pos, end - pos, "}");
+#endif
+  internal_snprintf(pos, end - pos, "}\n");
+  internal_write(fd, buf.data(), internal_strlen(buf.data()));
+}
+
+// Shadow memory is flushed in kShadowFlushParts equal parts in round-robin
+// order, so the part that went the longest without a flush goes first.
+// Tracking access recency per region would cost a store on every access.
+static const uptr kShadowFlushParts = 64;
+
+static void FlushShadowMemoryIncremental(uptr *next_part) {
+  const uptr budget = (uptr)flags()->flush_shadow_budget_mb << 20;
+  const uptr part_size = RoundUpTo(
+      (kLinuxShadowEnd - kLinuxShadowBeg) / kShadowFlushParts,
+      GetPageSizeCached());
+  for (uptr i = 0; i < kShadowFlushParts; i++) {
+    if (GetShadowMemoryConsumption() <= budget)
+      break;
+    uptr beg = kLinuxShadowBeg + *next_part * part_size;
+    uptr end = min(beg + part_size, kLinuxShadowEnd);
+    if (beg < end)
+      FlushUnneededShadowMemory(beg, end - beg);
+    *next_part = (*next_part + 1) % kShadowFlushParts;
+  }
+}
+
 static void BackgroundThread(void *arg) {
   ScopedInRtl in_rtl;
   Context *ctx = CTX();
@@ -130,6 +225,7 @@ static void BackgroundThread(void *arg) {
   }
 
   u64 last_flush = NanoTime();
+  uptr next_flush_part = 0;
   for (int i = 0; ; i++) {
     SleepForSeconds(1);
     u64 now = NanoTime();
@@ -137,14 +233,21 @@ static void BackgroundThread(void *arg) {
     // Flush memory if requested.
     if (flags()->flush_memory_ms) {
       if (last_flush + flags()->flush_memory_ms * kMs2Ns < now) {
-        FlushShadowMemory();
+        if (flags()->flush_shadow_budget_mb > 0)
+          FlushShadowMemoryIncremental(&next_flush_part);
+        else
+          FlushShadowMemory();
         last_flush = NanoTime();
       }
     }
 
     // Write memory profile if requested.
-    if (mprof_fd != kInvalidFd)
-      MemoryProfiler(ctx, mprof_fd, i);
+    if (mprof_fd != kInvalidFd) {
+      if (flags()->profile_memory_json)
+        MemoryProfilerJson(ctx, mprof_fd, i);
+      else
+        MemoryProfiler(ctx, mprof_fd, i);
+    }
 
 #ifndef TSAN_GO
     // Flush symbolizer cache if requested.
@@ -152,7 +255,7 @@ static void BackgroundThread(void *arg) {
       u64 last = atomic_load(&ctx->last_symbolize_time_ns,
                              memory_order_relaxed);
       if (last != 0 && last + flags()->flush_symbolizer_ms * kMs2Ns < now) {
-        Lock l(&ctx->report_mtx);
+        TicketLock l(&ctx->report_mtx);
         SpinMutexLock l2(&CommonSanitizerReportMutex);
         SymbolizeFlush();
         atomic_store(&ctx->last_symbolize_time_ns, 0, memory_order_relaxed);
@@ -162,12 +265,37 @@ static void BackgroundThread(void *arg) {
   }
 }
 
+static atomic_uint8_t background_thread_started;
+
+void MaybeStartBackgroundThread() {
+  if (atomic_load(&background_thread_started, memory_order_relaxed) ||
+      atomic_exchange(&background_thread_started, 1, memory_order_relaxed))
+    return;
+  internal_start_thread(&BackgroundThread, 0);
+}
+
 void DontNeedShadowFor(uptr addr, uptr size) {
   uptr shadow_beg = MemToShadow(addr);
   uptr shadow_end = MemToShadow(addr + size);
   FlushUnneededShadowMemory(shadow_beg, shadow_end - shadow_beg);
 }
 
+void UnmapShadow(ThreadState *thr, uptr addr, uptr size) {
+  if (size == 0)
+    return;
+  // The shadow of an immutable mapping may be mapped read-only
+  // (see MapShadowRodata), and the next mapping needs writable shadow.
+  const uptr page_size = GetPageSizeCached();
+  if (addr % page_size == 0 && IsAppMem(addr) && IsAppMem(addr + size - 1) &&
+      (*(u64*)MemToShadow(addr) == kShadowRodata ||
+       *(u64*)MemToShadow(RoundDown(addr + size - 1, kShadowCell)) ==
+           kShadowRodata))
+    MapShadow(addr, RoundUp(size, page_size));
+  else
+    DontNeedShadowFor(addr, size);
+  CTX()->synctab.RemoveRange(thr, addr, size);
+}
+
 void MapShadow(uptr addr, uptr size) {
   MmapFixedNoReserve(MemToShadow(addr), size * kShadowMultiplier);
 }
@@ -203,8 +331,19 @@ void Initialize(ThreadState *thr) {
   ctx = new(ctx_placeholder) Context;
 #ifndef TSAN_GO
   InitializeShadowMemory();
+  InitializeSlabArenas();
 #endif
   InitializeFlags(&ctx->flags, env);
+  InitializeTiming(flags()->timing_sample_rate);
+#ifndef TSAN_GO
+  InitializeCoverage(flags()->coverage_dir);
+#endif
+#ifndef TSAN_GO
+  SetShadowHugePages(flags()->shadow_huge_pages, kLinuxShadowBeg,
+                     kLinuxShadowEnd - kLinuxShadowBeg, /*dense*/ false);
+  SetShadowHugePages(flags()->shadow_huge_pages, MemToShadow(kAllocatorSpace),
+                     kAllocatorSize * kShadowMultiplier, /*dense*/ true);
+#endif
   // Setup correct file descriptor for error reports.
   if (internal_strcmp(flags()->log_path, "stdout") == 0)
     __sanitizer_set_report_fd(kStdoutFd);
@@ -217,24 +356,39 @@ void Initialize(ThreadState *thr) {
   // Initialize external symbolizer before internal threads are started.
   const char *external_symbolizer = flags()->external_symbolizer_path;
   if (external_symbolizer != 0 && external_symbolizer[0] != '\0') {
-    if (!InitializeExternalSymbolizer(external_symbolizer)) {
+    if (flags()->fast_init) {
+      InitializeExternalSymbolizerLazily(external_symbolizer);
+    } else if (!InitializeExternalSymbolizer(external_symbolizer)) {
       Printf("Failed to start external symbolizer: '%s'\n",
              external_symbolizer);
       Die();
     }
   }
 #endif
-  internal_start_thread(&BackgroundThread, 0);
+  // Unless it has periodic work from the start, the background thread is
+  // only needed to flush the symbolizer after the first report.
+  if (!flags()->fast_init || flags()->flush_memory_ms ||
+      (flags()->profile_memory && flags()->profile_memory[0]))
+    MaybeStartBackgroundThread();
 
   if (ctx->flags.verbosity)
-    Printf("***** Running under ThreadSanitizer v2 (pid %d) *****\n",
-           (int)internal_getpid());
+    Printf("***** Running under ThreadSanitizer v2 (pid %d, %d shadow "
+           "cells) *****\n", (int)internal_getpid(), (int)kShadowCnt);
 
   // Initialize thread 0.
   int tid = ThreadCreate(thr, 0, 0, true);
   CHECK_EQ(tid, 0);
   ThreadStart(thr, tid, internal_getpid());
   CHECK_EQ(thr->in_rtl, 1);
+#ifndef TSAN_GO
+  if (flags()->prefault_shadow) {
+    // The top of the stack is the part in use.
+    const uptr kMaxPrefaultedStack = 1 << 23;
+    uptr size = min(thr->stk_size, kMaxPrefaultedStack);
+    PrefaultRegion(MemToShadow(thr->stk_addr + thr->stk_size - size),
+                   size * kShadowMultiplier);
+  }
+#endif
   ctx->initialized = true;
 
   if (flags()->stop_on_start) {
@@ -253,6 +407,11 @@ int Finalize(ThreadState *thr) {
   if (flags()->atexit_sleep_ms > 0 && ThreadCount(thr) > 1)
     SleepForMillis(flags()->atexit_sleep_ms);
 
+#ifndef TSAN_GO
+  if (flags()->report_async)
+    ProcessAsyncRaces();
+#endif
+
   // Wait for pending reports.
   ctx->report_mtx.Lock();
   CommonSanitizerReportMutex.Lock();
@@ -263,6 +422,11 @@ int Finalize(ThreadState *thr) {
   if (ctx->flags.verbosity)
     AllocatorPrintStats();
 #endif
+  PrintTimingStats();
+#ifndef TSAN_GO
+  if (flags()->coverage)
+    DumpCoverage();
+#endif
 
   ThreadFinalize(thr);
 
@@ -303,8 +467,8 @@ u32 CurrentStackId(ThreadState *thr, uptr pc) {
     thr->shadow_stack_pos[0] = pc;
     thr->shadow_stack_pos++;
   }
-  u32 id = StackDepotPut(thr->shadow_stack,
-                         thr->shadow_stack_pos - thr->shadow_stack);
+  u32 id = StackDepotPutCached(&thr->stack_depot_cache, thr->shadow_stack,
+                               thr->shadow_stack_pos - thr->shadow_stack);
   if (pc)
     thr->shadow_stack_pos--;
   return id;
@@ -315,9 +479,9 @@ void TraceSwitch(ThreadState *thr) {
   thr->nomalloc++;
   ScopedInRtl in_rtl;
   Trace *thr_trace = ThreadTrace(thr->tid);
-  Lock l(&thr_trace->mtx);
+  TicketLock l(&thr_trace->mtx);
   unsigned trace = (thr->fast_state.epoch() / kTracePartSize) % TraceParts();
-  TraceHeader *hdr = &thr_trace->headers[trace];
+  TraceHeader *hdr = thr_trace->GetHeader(trace);
   hdr->epoch0 = thr->fast_state.epoch();
   hdr->stack0.ObtainCurrent(thr, 0);
   hdr->mset0 = thr->mset;
@@ -328,6 +492,27 @@ Trace *ThreadTrace(int tid) {
   return (Trace*)GetThreadTraceHeader(tid);
 }
 
+TraceHeader *Trace::GetHeader(uptr part) {
+  DCHECK_LT(part, kTraceParts);
+  const u64 bit = 1ull << (part % 64);
+  TraceHeader *hdr = reinterpret_cast<TraceHeader*>(headers_[part]);
+  if ((used_[part / 64] & bit) == 0) {
+    new(hdr) TraceHeader();
+    used_[part / 64] |= bit;
+  }
+  return hdr;
+}
+
+void Trace::ResetHeaders() {
+  for (uptr i = 0; i < kTraceParts / 64; i++)
+    used_[i] = 0;
+  uptr beg = RoundUpTo((uptr)headers_, GetPageSizeCached());
+  uptr end = RoundDownTo((uptr)headers_ + sizeof(headers_),
+                         GetPageSizeCached());
+  if (beg < end)
+    FlushUnneededShadowMemory(beg, end - beg);
+}
+
 uptr TraceTopPC(ThreadState *thr) {
   Event *events = (Event*)GetThreadTrace(thr->tid);
   uptr pc = events[thr->fast_state.GetTracePos()];
@@ -389,6 +574,66 @@ static inline bool HappensBefore(Shadow old, ThreadState *thr) {
   return thr->clock.get(old.TidWithIgnore()) >= old.epoch();
 }
 
+#if TSAN_VECTORIZE
+#if TSAN_DEBUG
+// Returns true if one of the shadow values describes the same access
+// (same tid, addr0 and size, same synch epoch, and not weaker type),
+// that is, the case when the main loop in MemoryAccessImpl would return
+// without doing anything.
+static bool ContainsSameAccessSlow(u64 *s, Shadow cur, ThreadState *thr,
+    bool kAccessIsWrite, bool kIsAtomic) {
+  for (uptr i = 0; i < kShadowCnt; i++) {
+    Shadow old = LoadShadow(&s[i]);
+    if (!old.IsZero() && Shadow::Addr0AndSizeAreEqual(cur, old) &&
+        Shadow::TidsAreEqual(cur, old) && OldIsInSameSynchEpoch(old, thr) &&
+        old.IsRWNotWeaker(kAccessIsWrite, kIsAtomic))
+      return true;
+  }
+  return false;
+}
+#endif
+
+// Vector version of ContainsSameAccessSlow, checks 2 shadow values
+// per instruction and does not branch on individual values.
+// Can return false for an atomic write when the slow version returns true
+// (see Shadow::SameAccessMask), the main loop handles such accesses.
+ALWAYS_INLINE
+static bool ContainsSameAccessFast(u64 *s, Shadow cur, ThreadState *thr,
+    bool kAccessIsWrite, bool kIsAtomic) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i vcur = _mm_set1_epi64x(cur.raw());
+  const __m128i vmask =
+      _mm_set1_epi64x(Shadow::SameAccessMask(kAccessIsWrite, kIsAtomic));
+  const __m128i vlower =
+      _mm_set1_epi64x(cur.SameTidLowerBound(thr->fast_synch_epoch));
+  const __m128i vtid = _mm_set1_epi64x(Shadow::TidMask());
+  __m128i same = zero;
+  for (uptr i = 0; i < kShadowCnt; i += 2) {
+    const __m128i old = _mm_load_si128((const __m128i*)&s[i]);
+    // Non-zero bits where tid, addr0, size or access type differ,
+    // or where the epoch is older than the synch epoch.
+    __m128i diff = _mm_and_si128(_mm_xor_si128(old, vcur), vmask);
+    diff = _mm_or_si128(diff,
+        _mm_and_si128(_mm_sub_epi64(old, vlower), vtid));
+    // There are no 64-bit compares in SSE2, so compare 32-bit halves
+    // and combine each half with its pair.
+    __m128i eq = _mm_cmpeq_epi32(diff, zero);
+    eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+    __m128i empty = _mm_cmpeq_epi32(old, zero);
+    empty = _mm_and_si128(empty,
+        _mm_shuffle_epi32(empty, _MM_SHUFFLE(2, 3, 0, 1)));
+    same = _mm_or_si128(same, _mm_andnot_si128(empty, eq));
+  }
+  bool res = _mm_movemask_epi8(same) != 0;
+  DCHECK(!res || ContainsSameAccessSlow(s, cur, thr, kAccessIsWrite,
+                                        kIsAtomic));
+  DCHECK(res || kIsAtomic || !ContainsSameAccessSlow(s, cur, thr,
+                                                     kAccessIsWrite,
+                                                     kIsAtomic));
+  return res;
+}
+#endif
+
 ALWAYS_INLINE USED
 void MemoryAccessImpl(ThreadState *thr, uptr addr,
     int kAccessSizeLog, bool kAccessIsWrite, bool kIsAtomic,
@@ -397,6 +642,18 @@ void MemoryAccessImpl(ThreadState *thr, uptr addr,
   StatInc(thr, kAccessIsWrite ? StatMopWrite : StatMopRead);
   StatInc(thr, (StatType)(StatMop1 + kAccessSizeLog));
 
+#if TSAN_VECTORIZE
+  // The most common case is a repeated access from the same thread.
+  // Filter it out before the per-value loop below. The loop could find
+  // a race with a value preceding the same one, but such race was already
+  // checked when either of the two values was stored.
+  if (LIKELY(ContainsSameAccessFast(shadow_mem, cur, thr, kAccessIsWrite,
+                                    kIsAtomic))) {
+    StatInc(thr, StatMopSame);
+    return;
+  }
+#endif
+
   // This potentially can live in an MMX/SSE scratch register.
   // The required intrinsics are:
   // __m128i _mm_move_epi64(__m128i*);
@@ -484,9 +741,55 @@ void UnalignedMemoryAccess(ThreadState *thr, uptr pc, uptr addr,
   }
 }
 
+ALWAYS_INLINE
+uptr AccessCacheKey(uptr addr, int kAccessSizeLog, bool kAccessIsWrite,
+                    bool kIsAtomic) {
+  return (addr << 4) | (kAccessSizeLog << 2) | (kAccessIsWrite << 1)
+      | kIsAtomic;
+}
+
+ALWAYS_INLINE
+AccessCacheEntry *AccessCacheGet(ThreadState *thr, uptr addr) {
+  return &thr->access_cache[(addr / kShadowCell) % kAccessCacheSize];
+}
+
+static void AccessCacheInvalidate(ThreadState *thr, uptr addr, uptr size) {
+  if (size >= kAccessCacheSize * kShadowCell) {
+    internal_memset(thr->access_cache, 0, sizeof(thr->access_cache));
+    return;
+  }
+  for (uptr p = RoundDown(addr, kShadowCell); p < addr + size;
+       p += kShadowCell)
+    AccessCacheGet(thr, p)->key = 0;
+}
+
 ALWAYS_INLINE USED
 void MemoryAccess(ThreadState *thr, uptr pc, uptr addr,
     int kAccessSizeLog, bool kAccessIsWrite, bool kIsAtomic) {
+  StatSampleMop(thr);
+  if (!kIsAtomic && MopSampledOut(thr)) {
+    StatInc(thr, StatMop);
+    StatInc(thr, StatMopSampledOut);
+    return;
+  }
+  if (InThreadIgnoreRange(thr, addr)) {
+    StatInc(thr, StatMop);
+    StatInc(thr, StatMopIgnoredRange);
+    return;
+  }
+  // The same access was already recorded in the shadow since the last
+  // synchronization (see OldIsInSameSynchEpoch), so there is nothing to do.
+  const uptr cache_key = AccessCacheKey(addr, kAccessSizeLog, kAccessIsWrite,
+                                        kIsAtomic);
+  AccessCacheEntry *cache = AccessCacheGet(thr, addr);
+  if (cache->key == cache_key && cache->epoch >= thr->fast_synch_epoch) {
+    StatInc(thr, StatMop);
+    StatInc(thr, kAccessIsWrite ? StatMopWrite : StatMopRead);
+    StatInc(thr, (StatType)(StatMop1 + kAccessSizeLog));
+    StatInc(thr, StatMopCached);
+    return;
+  }
+
   u64 *shadow_mem = (u64*)MemToShadow(addr);
   DPrintf2("#%d: MemoryAccess: @%p %p size=%d"
       " is_write=%d shadow_mem=%p {%zx, %zx, %zx, %zx}\n",
@@ -505,13 +808,15 @@ void MemoryAccess(ThreadState *thr, uptr pc, uptr addr,
   }
 #endif
 
-  if (*shadow_mem == kShadowRodata) {
-    // Access to .rodata section, no races here.
-    // Measurements show that it can be 10-20% of all memory accesses.
+  if (*shadow_mem >= kShadowIgnored) {
+    // Access to .rodata section or to a range ignored by all threads,
+    // no races here.
+    // Measurements show that .rodata can be 10-20% of all memory accesses.
     StatInc(thr, StatMop);
     StatInc(thr, kAccessIsWrite ? StatMopWrite : StatMopRead);
     StatInc(thr, (StatType)(StatMop1 + kAccessSizeLog));
-    StatInc(thr, StatMopRodata);
+    StatInc(thr, *shadow_mem == kShadowRodata ? StatMopRodata
+                                              : StatMopIgnoredRange);
     return;
   }
 
@@ -531,14 +836,36 @@ void MemoryAccess(ThreadState *thr, uptr pc, uptr addr,
 
   MemoryAccessImpl(thr, addr, kAccessSizeLog, kAccessIsWrite, kIsAtomic,
       shadow_mem, cur);
+  cache->key = cache_key;
+  cache->epoch = fast_state.epoch();
+}
+
+// Handles 8-byte accesses to ncells consecutive shadow cells starting at
+// addr, all on behalf of the same fast_state (the middle part of
+// MemoryAccessRange). The caller is responsible for the trace event.
+// Lives here so that MemoryAccessImpl is inlined into the loop.
+void MemoryAccessCells(ThreadState *thr, uptr addr, uptr ncells,
+    bool kAccessIsWrite, u64 *shadow_mem, FastState fast_state) {
+  Shadow cur(fast_state);
+  cur.SetWrite(kAccessIsWrite);
+  cur.SetAddr0AndSizeLog(0, kSizeLog8);
+  for (uptr i = 0; i < ncells; i++) {
+    // Cells that already hold this access (e.g. a buffer that is copied
+    // repeatedly within one synch epoch) are skipped by the fast check
+    // at the beginning of MemoryAccessImpl.
+    MemoryAccessImpl(thr, addr, kSizeLog8, kAccessIsWrite, false,
+        shadow_mem, cur);
+    addr += kShadowCell;
+    shadow_mem += kShadowCnt;
+  }
 }
 
 static void MemoryRangeSet(ThreadState *thr, uptr pc, uptr addr, uptr size,
                            u64 val) {
-  (void)thr;
   (void)pc;
   if (size == 0)
     return;
+  AccessCacheInvalidate(thr, addr, size);
   // FIXME: fix me.
   uptr offset = addr % kShadowCell;
   if (offset) {
@@ -628,6 +955,66 @@ void MemoryRangeImitateWrite(ThreadState *thr, uptr pc, uptr addr, uptr size) {
   MemoryRangeSet(thr, pc, addr, size, s.raw());
 }
 
+// Sets the shadow cells that lie entirely in the range to val, except for
+// the cells of .rodata (whose shadow is mapped read-only) and, if
+// ignored_only, the cells that do not hold kShadowIgnored.
+static void SetShadowCells(uptr addr, uptr size, u64 val, bool ignored_only) {
+  if (!IsAppMem(addr) || size == 0)
+    return;
+  u64 *p = (u64*)MemToShadow(RoundUp(addr, kShadowCell));
+  u64 *end = (u64*)MemToShadow(RoundDown(addr + size, kShadowCell));
+  for (; p < end; p += kShadowCnt) {
+    if (*p == kShadowRodata || *p == val)
+      continue;
+    if (ignored_only && *p != kShadowIgnored)
+      continue;
+    for (uptr j = 0; j < kShadowCnt; j++)
+      p[j] = val;
+  }
+}
+
+void MemoryRangeImmutable(ThreadState *thr, uptr pc, uptr addr, uptr size) {
+  SetShadowCells(addr, size, kShadowRodata, false);
+}
+
+void MemoryRangeIgnoreBegin(ThreadState *thr, uptr pc, uptr addr, uptr size) {
+  SetShadowCells(addr, size, kShadowIgnored, false);
+}
+
+void MemoryRangeIgnoreEnd(ThreadState *thr, uptr pc, uptr addr, uptr size) {
+  SetShadowCells(addr, size, 0, true);
+}
+
+void ThreadIgnoreRangeBegin(ThreadState *thr, uptr pc, uptr addr, uptr size) {
+  if (size == 0)
+    return;
+  if (thr->ignore_range_count == kMaxThreadIgnoreRanges) {
+    Printf("ThreadSanitizer: thread T%d has more than %zu ignore ranges,"
+           " %p-%p is checked\n", thr->tid, kMaxThreadIgnoreRanges,
+           (void*)addr, (void*)(addr + size));
+    return;
+  }
+  uptr i = thr->ignore_range_count++;
+  for (; i > 0 && thr->ignore_ranges[i - 1].beg > addr; i--)
+    thr->ignore_ranges[i] = thr->ignore_ranges[i - 1];
+  thr->ignore_ranges[i].beg = addr;
+  thr->ignore_ranges[i].end = addr + size;
+}
+
+void ThreadIgnoreRangeEnd(ThreadState *thr, uptr pc, uptr addr, uptr size) {
+  if (size == 0)
+    return;
+  for (uptr i = 0; i < thr->ignore_range_count; i++) {
+    if (thr->ignore_ranges[i].beg != addr ||
+        thr->ignore_ranges[i].end != addr + size)
+      continue;
+    thr->ignore_range_count--;
+    for (; i < thr->ignore_range_count; i++)
+      thr->ignore_ranges[i] = thr->ignore_ranges[i + 1];
+    return;
+  }
+}
+
 ALWAYS_INLINE USED
 void FuncEntry(ThreadState *thr, uptr pc) {
   DCHECK_EQ(thr->in_rtl, 0);
@@ -29,6 +29,7 @@
 #include "sanitizer_common/sanitizer_allocator.h"
 #include "sanitizer_common/sanitizer_allocator_internal.h"
 #include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_stackdepot.h"
 #include "sanitizer_common/sanitizer_suppressions.h"
 #include "sanitizer_common/sanitizer_thread_registry.h"
 #include "tsan_clock.h"
@@ -38,6 +39,7 @@
 #include "tsan_trace.h"
 #include "tsan_vector.h"
 #include "tsan_report.h"
+#include "tsan_slab.h"
 #include "tsan_platform.h"
 #include "tsan_mutexset.h"
 
@@ -54,8 +56,9 @@ struct MBlock {
   u64 lst : 44;
   u64 stk : 31;  // on word boundary
   u64 tid : kTidBits;
-  u64 siz : 128 - 1 - 31 - 44 - kTidBits;  // 39
+  u64 siz : kSizeBits;  // 39 with 13 tid bits
   */
+  static const int kSizeBits = 128 - 1 - 31 - 44 - kTidBits;
   u64 raw[2];
 
   void Init(uptr siz, u32 tid, u32 stk) {
@@ -128,7 +131,7 @@ const uptr kAllocatorSize  =  0x10000000000ULL;  // 1T.
 
 struct MapUnmapCallback;
 typedef SizeClassAllocator64<kAllocatorSpace, kAllocatorSize, sizeof(MBlock),
-    DefaultSizeClassMap, MapUnmapCallback> PrimaryAllocator;
+    DefaultTableSizeClassMap, MapUnmapCallback> PrimaryAllocator;
 typedef SizeClassAllocatorLocalCache<PrimaryAllocator> AllocatorCache;
 typedef LargeMmapAllocator<MapUnmapCallback> SecondaryAllocator;
 typedef CombinedAllocator<PrimaryAllocator, AllocatorCache,
@@ -140,6 +143,10 @@ void TsanCheckFailed(const char *file, int line, const char *cond,
                      u64 v1, u64 v2);
 
 const u64 kShadowRodata = (u64)-1;  // .rodata shadow marker
+// Shadow marker of the ranges ignored by all threads. Neither it nor
+// kShadowRodata is a valid Shadow (addr0 + size is more than 8), and both
+// are checked with a single comparison: *shadow_mem >= kShadowIgnored.
+const u64 kShadowIgnored = (u64)-2;
 
 // FastState (from most significant bit):
 //   ignore          : 1
@@ -358,6 +365,27 @@ class Shadow : public FastState {
     return v;
   }
 
+  // Bits of a shadow value that must be equal to the bits of the current
+  // access for the shadow value to be the same or a stronger access
+  // (same tid and freed bit, addr0 and size, see IsRWNotWeaker).
+  // For atomic writes this is stricter than IsRWNotWeaker: old atomic reads
+  // do not match.
+  static u64 SameAccessMask(bool kIsWrite, bool kIsAtomic) {
+    return (~0ull << kTidShift) | 31
+        | (kIsWrite ? kReadBit : 0) | (kIsAtomic ? 0 : kAtomicBit);
+  }
+
+  // The smallest shadow value with the same tid and the given epoch.
+  // A shadow value v with the same tid is in the epoch or later iff
+  // v - SameTidLowerBound(epoch) does not borrow from the tid bits.
+  u64 SameTidLowerBound(u64 epoch) const {
+    return (x_ & (~0ull << kTidShift)) | (epoch << kClkShift);
+  }
+
+  static u64 TidMask() {
+    return ~0ull << kTidShift;
+  }
+
   bool IsRWWeakerOrEqual(bool kIsWrite, bool kIsAtomic) const {
     bool v = ((x_ >> kReadShift) & 3)
         >= u64((kIsWrite ^ 1) | (kIsAtomic << 1));
@@ -392,6 +420,40 @@ struct JmpBuf {
   uptr *shadow_stack_pos;
 };
 
+// An entry of the per-thread cache of recent memory accesses.
+struct AccessCacheEntry {
+  uptr key;   // See AccessCacheKey.
+  u64 epoch;  // Epoch of the access.
+};
+
+const uptr kAccessCacheSize = 64;
+
+// A range [beg, end) whose accesses a thread does not check.
+struct IgnoreRange {
+  uptr beg;
+  uptr end;
+};
+
+const uptr kMaxThreadIgnoreRanges = 8;
+
+// An entry of the per-thread cache of acquired atomic variables.
+struct AcquireCacheEntry {
+  uptr addr;
+  u64 version;  // SyncTab::GetReleaseVersion(addr) when it was acquired.
+};
+
+const uptr kAcquireCacheSize = 16;
+
+// The last release done by an atomic read-modify-write operation,
+// see flags()->merge_atomic_releases.
+struct AtomicRelease {
+  uptr addr;
+  u64 epoch;        // Thread epoch after the operation.
+  u64 acquire_seq;  // ThreadClock::acquire_seq() after the operation.
+  u64 version;      // SyncTab::GetReleaseVersion(addr) after the operation.
+  bool acquire;     // The operation had acquire semantics as well.
+};
+
 // This struct is stored in TLS.
 struct ThreadState {
   FastState fast_state;
@@ -414,6 +476,14 @@ struct ThreadState {
   uptr *shadow_stack_pos;
   u64 *racy_shadow_addr;
   u64 racy_state[2];
+  // Direct-mapped cache of accesses that were recorded in the shadow
+  // in the current synch epoch. If the same access is repeated before
+  // the next synchronization, it can skip the shadow entirely.
+  AccessCacheEntry access_cache[kAccessCacheSize];
+  // Atomic variables whose clocks were acquired by the thread, see
+  // tsan_interface_atomic.cc.
+  AcquireCacheEntry acquire_cache[kAcquireCacheSize];
+  AtomicRelease last_atomic_release;
 #ifndef TSAN_GO
   // C/C++ uses embed shadow stack of fixed size.
   uptr shadow_stack[kShadowStackSize];
@@ -427,9 +497,26 @@ struct ThreadState {
 #ifndef TSAN_GO
   AllocatorCache alloc_cache;
   InternalAllocatorCache internal_alloc_cache;
+  SlabCache slab_cache[kSlabArenaCount];
+  StackDepotCache stack_depot_cache;
   Vector<JmpBuf> jmp_bufs;
+  // SyncVars of freed heap blocks, destroyed in batches (see user_free).
+  SyncVar *retired_syncs;
+  uptr retired_sync_count;
 #endif
   u64 stat[StatCnt];
+  // With stats_sample_rate, StatInc updates stat only while stat_sampled
+  // is set. It is recomputed on every memory access (see StatSampleMop).
+  bool stat_sampled;
+  u32 stat_sample_rate;
+  u32 stat_sample_countdown;
+  // With access_sample_rate, the plain memory accesses are checked while
+  // mop_sample_countdown is at most kMopSampleBurst (see MopSampledOut).
+  u32 mop_sample_period;
+  u32 mop_sample_countdown;
+  // Sorted by beg, see ThreadIgnoreRangeBegin.
+  uptr ignore_range_count;
+  IgnoreRange ignore_ranges[kMaxThreadIgnoreRanges];
   const int tid;
   const int unique_id;
   int in_rtl;
@@ -451,13 +538,18 @@ struct ThreadState {
   u32 last_sleep_stack_id;
   ThreadClock last_sleep_clock;
 #endif
+  // Id of the barrier sync var whose clock holds everything in the thread
+  // clock except for the own entry, as long as the clock's acquire_seq()
+  // stays last_barrier_seq (see BarrierRelease).
+  u64 last_barrier_id;
+  u64 last_barrier_seq;
 
   // Set in regions of runtime that must be signal-safe and fork-safe.
   // If set, malloc must not be called.
   int nomalloc;
 
-  explicit ThreadState(Context *ctx, int tid, int unique_id, u64 epoch,
-                       uptr stk_addr, uptr stk_size,
+  explicit ThreadState(Context *ctx, int tid, int unique_id, int reuse_count,
+                       u64 epoch, uptr stk_addr, uptr stk_size,
                        uptr tls_addr, uptr tls_size);
 };
 
@@ -512,6 +604,9 @@ struct RacyAddress {
   uptr addr_max;
 };
 
+// Size of the lock-free filter of already reported races, see ReportRace.
+const uptr kKnownRaces = 4096;
+
 struct FiredSuppression {
   ReportType type;
   uptr pc;
@@ -525,7 +620,7 @@ struct Context {
 
   SyncTab synctab;
 
-  Mutex report_mtx;
+  TicketMutex report_mtx;
   int nreported;
   int nmissed_expected;
   atomic_uint64_t last_symbolize_time_ns;
@@ -536,6 +631,9 @@ struct Context {
   Vector<RacyAddress> racy_addresses;
   // Number of fired suppressions may be large enough.
   InternalMmapVector<FiredSuppression> fired_suppressions;
+  // Hashes of races that are known to be duplicates of reported races.
+  // Written under thread_registry lock, read without any locks.
+  atomic_uint64_t known_races[kKnownRaces];
 
   Flags flags;
 
@@ -567,6 +665,8 @@ class ScopedReport {
   void AddLocation(uptr addr, uptr size);
   void AddSleep(u32 stack_id);
   void SetCount(int count);
+  // Symbolizes the stacks recorded as StackDepot ids.
+  void SymbolizeStacks();
 
   const ReportDesc *GetReport() const;
 
@@ -584,25 +684,71 @@ void RestoreStack(int tid, const u64 epoch, StackTrace *stk, MutexSet *mset);
 
 void StatAggregate(u64 *dst, u64 *src);
 void StatOutput(u64 *stat);
+// Aggregated statistics of all threads (finished and running).
+void StatSnapshot(u64 *stat);
 void ALWAYS_INLINE StatInc(ThreadState *thr, StatType typ, u64 n = 1) {
-  if (kCollectStats)
+  if (kCollectStats || thr->stat_sampled)
     thr->stat[typ] += n;
 }
 void ALWAYS_INLINE StatSet(ThreadState *thr, StatType typ, u64 n) {
-  if (kCollectStats)
+  if (kCollectStats || thr->stat_sampled)
     thr->stat[typ] = n;
 }
+void ALWAYS_INLINE StatSampleMop(ThreadState *thr) {
+  if (kCollectStats || thr->stat_sample_rate == 0)
+    return;
+  thr->stat_sampled = --thr->stat_sample_countdown == 0;
+  if (thr->stat_sampled)
+    thr->stat_sample_countdown = thr->stat_sample_rate;
+}
+
+// The accesses are sampled in bursts, so that the accesses of a thread which
+// are close in time, e.g. both sides of a racy read-modify-write, tend to be
+// checked together.
+const u32 kMopSampleBurst = 64;
+
+// Returns true if the plain memory access is not checked because of
+// access_sample_rate.
+bool ALWAYS_INLINE MopSampledOut(ThreadState *thr) {
+  if (LIKELY(thr->mop_sample_period == 0))
+    return false;
+  if (thr->mop_sample_countdown-- > kMopSampleBurst)
+    return true;
+  if (thr->mop_sample_countdown == 0)
+    thr->mop_sample_countdown = thr->mop_sample_period;
+  return false;
+}
+
+// Returns true if the access is in one of the ignore ranges of the thread.
+bool ALWAYS_INLINE InThreadIgnoreRange(ThreadState *thr, uptr addr) {
+  if (LIKELY(thr->ignore_range_count == 0))
+    return false;
+  for (uptr i = 0; i < thr->ignore_range_count; i++) {
+    const IgnoreRange &r = thr->ignore_ranges[i];
+    if (addr < r.beg)
+      break;
+    if (addr < r.end)
+      return true;
+  }
+  return false;
+}
 
 void MapShadow(uptr addr, uptr size);
 void MapThreadTrace(uptr addr, uptr size);
 void DontNeedShadowFor(uptr addr, uptr size);
+// Releases the shadow and destroys the SyncVars of an unmapped range.
+void UnmapShadow(ThreadState *thr, uptr addr, uptr size);
+// Starts the background thread unless it is already running.
+void MaybeStartBackgroundThread();
 void InitializeShadowMemory();
 void InitializeInterceptors();
 void InitializeDynamicAnnotations();
 
 void ReportRace(ThreadState *thr);
+// Reports the races queued with report_async.
+void ProcessAsyncRaces();
 bool OutputReport(Context *ctx,
-                  const ScopedReport &srep,
+                  ScopedReport &srep,
                   const ReportStack *suppress_stack1 = 0,
                   const ReportStack *suppress_stack2 = 0,
                   const ReportLocation *suppress_loc = 0);
@@ -642,6 +788,8 @@ void MemoryAccess(ThreadState *thr, uptr pc, uptr addr,
 void MemoryAccessImpl(ThreadState *thr, uptr addr,
     int kAccessSizeLog, bool kAccessIsWrite, bool kIsAtomic,
     u64 *shadow_mem, Shadow cur);
+void MemoryAccessCells(ThreadState *thr, uptr addr, uptr ncells,
+    bool kAccessIsWrite, u64 *shadow_mem, FastState fast_state);
 void MemoryAccessRange(ThreadState *thr, uptr pc, uptr addr,
     uptr size, bool is_write);
 void MemoryAccessRangeStep(ThreadState *thr, uptr pc, uptr addr,
@@ -677,6 +825,17 @@ void ALWAYS_INLINE MemoryWriteAtomic(ThreadState *thr, uptr pc,
 void MemoryResetRange(ThreadState *thr, uptr pc, uptr addr, uptr size);
 void MemoryRangeFreed(ThreadState *thr, uptr pc, uptr addr, uptr size);
 void MemoryRangeImitateWrite(ThreadState *thr, uptr pc, uptr addr, uptr size);
+// Accesses to the range are not checked from now on, as for .rodata,
+// until it is freed or unmapped.
+void MemoryRangeImmutable(ThreadState *thr, uptr pc, uptr addr, uptr size);
+// Accesses of all threads to the shadow cells that lie entirely in the
+// range are not checked until MemoryRangeIgnoreEnd or until it is freed.
+void MemoryRangeIgnoreBegin(ThreadState *thr, uptr pc, uptr addr, uptr size);
+void MemoryRangeIgnoreEnd(ThreadState *thr, uptr pc, uptr addr, uptr size);
+// Accesses of the thread to the range are not checked until
+// ThreadIgnoreRangeEnd with the same range.
+void ThreadIgnoreRangeBegin(ThreadState *thr, uptr pc, uptr addr, uptr size);
+void ThreadIgnoreRangeEnd(ThreadState *thr, uptr pc, uptr addr, uptr size);
 void IgnoreCtl(ThreadState *thr, bool write, bool begin);
 
 void FuncEntry(ThreadState *thr, uptr pc);
@@ -706,6 +865,8 @@ void Acquire(ThreadState *thr, uptr pc, uptr addr);
 void AcquireGlobal(ThreadState *thr, uptr pc);
 void Release(ThreadState *thr, uptr pc, uptr addr);
 void ReleaseStore(ThreadState *thr, uptr pc, uptr addr);
+void BarrierRelease(ThreadState *thr, uptr pc, uptr addr);
+void BarrierAcquire(ThreadState *thr, uptr pc, uptr addr);
 void AfterSleep(ThreadState *thr, uptr pc);
 
 // The hacky call uses custom calling convention and an assembly thunk.
@@ -76,7 +76,7 @@ void MutexDestroy(ThreadState *thr, uptr pc, uptr addr) {
     OutputReport(ctx, rep);
   }
   thr->mset.Remove(s->GetId());
-  DestroyAndFree(s);
+  ctx->synctab.Destroy(s);
 }
 
 void MutexLock(ThreadState *thr, uptr pc, uptr addr, int rec) {
@@ -100,11 +100,18 @@ void MutexLock(ThreadState *thr, uptr pc, uptr addr, int rec) {
   }
   if (s->recursion == 0) {
     StatInc(thr, StatMutexLock);
-    thr->clock.set(thr->tid, thr->fast_state.epoch());
-    thr->clock.acquire(&s->clock);
-    StatInc(thr, StatSyncAcquire);
-    thr->clock.acquire(&s->read_clock);
-    StatInc(thr, StatSyncAcquire);
+    if (s->acquired_uid == thr->unique_id) {
+      // Nobody else released the mutex since this thread last acquired it,
+      // e.g. it is not shared yet.
+      StatInc(thr, StatMutexLockNoAcquire);
+    } else {
+      thr->clock.set(thr->tid, thr->fast_state.epoch());
+      thr->clock.acquire(&s->clock);
+      StatInc(thr, StatSyncAcquire);
+      thr->clock.acquire(&s->read_clock);
+      StatInc(thr, StatSyncAcquire);
+      s->acquired_uid = thr->unique_id;
+    }
   } else if (!s->is_recursive) {
     StatInc(thr, StatMutexRecLock);
   }
@@ -143,6 +150,8 @@ int MutexUnlock(ThreadState *thr, uptr pc, uptr addr, bool all) {
       thr->clock.set(thr->tid, thr->fast_state.epoch());
       thr->fast_synch_epoch = thr->fast_state.epoch();
       thr->clock.ReleaseStore(&s->clock);
+      s->OnClockRelease(thr->unique_id);
+      CTX()->synctab.OnRelease(s->addr);
       StatInc(thr, StatSyncRelease);
     } else {
       StatInc(thr, StatMutexRecUnlock);
@@ -191,6 +200,7 @@ void MutexReadUnlock(ThreadState *thr, uptr pc, uptr addr) {
   thr->clock.set(thr->tid, thr->fast_state.epoch());
   thr->fast_synch_epoch = thr->fast_state.epoch();
   thr->clock.release(&s->read_clock);
+  s->OnClockRelease(thr->unique_id);
   StatInc(thr, StatSyncRelease);
   s->mtx.Unlock();
   thr->mset.Del(s->GetId(), false);
@@ -212,6 +222,7 @@ void MutexReadOrWriteUnlock(ThreadState *thr, uptr pc, uptr addr) {
     thr->clock.set(thr->tid, thr->fast_state.epoch());
     thr->fast_synch_epoch = thr->fast_state.epoch();
     thr->clock.release(&s->read_clock);
+    s->OnClockRelease(thr->unique_id);
     StatInc(thr, StatSyncRelease);
   } else if (s->owner_tid == thr->tid) {
     // Seems to be write unlock.
@@ -229,6 +240,8 @@ void MutexReadOrWriteUnlock(ThreadState *thr, uptr pc, uptr addr) {
       thr->clock.set(thr->tid, thr->fast_state.epoch());
       thr->fast_synch_epoch = thr->fast_state.epoch();
       thr->clock.ReleaseStore(&s->clock);
+      s->OnClockRelease(thr->unique_id);
+      CTX()->synctab.OnRelease(s->addr);
       StatInc(thr, StatSyncRelease);
     } else {
       StatInc(thr, StatMutexRecUnlock);
@@ -273,6 +286,8 @@ void Release(ThreadState *thr, uptr pc, uptr addr) {
   SyncVar *s = CTX()->synctab.GetOrCreateAndLock(thr, pc, addr, true);
   thr->clock.set(thr->tid, thr->fast_state.epoch());
   thr->clock.release(&s->clock);
+  s->OnClockRelease(thr->unique_id);
+  CTX()->synctab.OnRelease(addr);
   StatInc(thr, StatSyncRelease);
   s->mtx.Unlock();
 }
@@ -283,10 +298,54 @@ void ReleaseStore(ThreadState *thr, uptr pc, uptr addr) {
   SyncVar *s = CTX()->synctab.GetOrCreateAndLock(thr, pc, addr, true);
   thr->clock.set(thr->tid, thr->fast_state.epoch());
   thr->clock.ReleaseStore(&s->clock);
+  s->OnClockRelease(thr->unique_id);
+  CTX()->synctab.OnRelease(addr);
+  StatInc(thr, StatSyncRelease);
+  s->mtx.Unlock();
+}
+
+// Release on arrival at a barrier. When a thread leaves a barrier, its
+// clock is the barrier clock plus what it had released on arrival, and
+// barrier clocks only grow. So if the thread has not acquired anything
+// else until it arrives again, only its own entry is new to the barrier.
+void BarrierRelease(ThreadState *thr, uptr pc, uptr addr) {
+  CHECK_GT(thr->in_rtl, 0);
+  DPrintf("#%d: BarrierRelease %zx\n", thr->tid, addr);
+  SyncVar *s = CTX()->synctab.GetOrCreateAndLock(thr, pc, addr, true);
+  thr->clock.set(thr->tid, thr->fast_state.epoch());
+  if (thr->last_barrier_id == s->GetId() &&
+      thr->last_barrier_seq == thr->clock.acquire_seq()) {
+    thr->clock.ReleaseOwnEntry(&s->clock);
+    StatInc(thr, StatSyncBarrierOwnRelease);
+  } else {
+    thr->clock.release(&s->clock);
+  }
+  thr->last_barrier_id = s->GetId();
+  thr->last_barrier_seq = thr->clock.acquire_seq();
+  s->OnClockRelease(thr->unique_id);
+  CTX()->synctab.OnRelease(addr);
   StatInc(thr, StatSyncRelease);
   s->mtx.Unlock();
 }
 
+// Acquire on departure from a barrier.
+void BarrierAcquire(ThreadState *thr, uptr pc, uptr addr) {
+  CHECK_GT(thr->in_rtl, 0);
+  DPrintf("#%d: BarrierAcquire %zx\n", thr->tid, addr);
+  SyncVar *s = CTX()->synctab.GetOrCreateAndLock(thr, pc, addr, false);
+  thr->clock.set(thr->tid, thr->fast_state.epoch());
+  // E.g. a signal handler could have acquired something during the wait.
+  bool known = thr->last_barrier_id == s->GetId() &&
+      thr->last_barrier_seq == thr->clock.acquire_seq();
+  thr->clock.acquire(&s->clock);
+  if (known)
+    thr->last_barrier_seq = thr->clock.acquire_seq();
+  else
+    thr->last_barrier_id = 0;
+  StatInc(thr, StatSyncAcquire);
+  s->mtx.ReadUnlock();
+}
+
 #ifndef TSAN_GO
 static void UpdateSleepClockCallback(ThreadContextBase *tctx_base, void *arg) {
   ThreadState *thr = reinterpret_cast<ThreadState*>(arg);
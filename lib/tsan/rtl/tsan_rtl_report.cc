@@ -11,11 +11,13 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "sanitizer_common/sanitizer_lfstack.h"
 #include "sanitizer_common/sanitizer_libc.h"
 #include "sanitizer_common/sanitizer_placement_new.h"
 #include "sanitizer_common/sanitizer_stackdepot.h"
 #include "sanitizer_common/sanitizer_common.h"
 #include "sanitizer_common/sanitizer_stacktrace.h"
+#include "sanitizer_common/sanitizer_timing.h"
 #include "tsan_platform.h"
 #include "tsan_rtl.h"
 #include "tsan_suppressions.h"
@@ -105,6 +107,22 @@ static ReportStack *SymbolizeStack(const StackTrace& trace) {
   if (trace.IsEmpty())
     return 0;
   ReportStack *stack = 0;
+#ifndef TSAN_GO
+  if (ReportLogEnabled()) {
+    // Symbolization is deferred, keep only the pcs.
+    for (uptr si = 0; si < trace.Size(); si++) {
+      ReportStack *ent = NewReportStackEntry(trace.Get(si));
+      ent->next = stack;
+      stack = ent;
+    }
+    return stack;
+  }
+  // Symbolize the whole stack in one exchange with the external symbolizer.
+  InternalScopedBuffer<uptr> pcs(trace.Size());
+  for (uptr si = 0; si < trace.Size(); si++)
+    pcs[si] = __sanitizer::StackTrace::GetPreviousInstructionPc(trace.Get(si));
+  SymbolizeCodePrefetch(pcs.data(), trace.Size());
+#endif
   for (uptr si = 0; si < trace.Size(); si++) {
     const uptr pc = trace.Get(si);
 #ifndef TSAN_GO
@@ -140,9 +158,11 @@ ScopedReport::ScopedReport(ReportType typ) {
   rep_->typ = typ;
   ctx_->report_mtx.Lock();
   CommonSanitizerReportMutex.Lock();
+  StartReportBuffering();
 }
 
 ScopedReport::~ScopedReport() {
+  FinishReportBuffering();
   CommonSanitizerReportMutex.Unlock();
   ctx_->report_mtx.Unlock();
   DestroyAndFree(rep_);
@@ -173,11 +193,11 @@ void ScopedReport::AddMemoryAccess(uptr addr, Shadow s,
     // Another mutex can be created at the same address,
     // so check uid as well.
     if (s && s->CheckId(uid)) {
-      ReportMopMutex mtx = {s->uid, d.write};
+      ReportMopMutex mtx = {s->uid, d.write != 0};
       mop->mset.PushBack(mtx);
       AddMutex(s);
     } else {
-      ReportMopMutex mtx = {d.id, d.write};
+      ReportMopMutex mtx = {d.id, d.write != 0};
       mop->mset.PushBack(mtx);
       AddMutex(d.id);
     }
@@ -203,13 +223,7 @@ void ScopedReport::AddThread(const ThreadContext *tctx) {
 #ifdef TSAN_GO
   rt->stack = SymbolizeStack(tctx->creation_stack);
 #else
-  uptr ssz = 0;
-  const uptr *stack = StackDepotGet(tctx->creation_stack_id, &ssz);
-  if (stack) {
-    StackTrace trace;
-    trace.Init(stack, ssz);
-    rt->stack = SymbolizeStack(trace);
-  }
+  rt->stack_id = tctx->creation_stack_id;
 #endif
 }
 
@@ -272,13 +286,7 @@ void ScopedReport::AddMutex(const SyncVar *s) {
   rm->destroyed = false;
   rm->stack = 0;
 #ifndef TSAN_GO
-  uptr ssz = 0;
-  const uptr *stack = StackDepotGet(s->creation_stack_id, &ssz);
-  if (stack) {
-    StackTrace trace;
-    trace.Init(stack, ssz);
-    rm->stack = SymbolizeStack(trace);
-  }
+  rm->stack_id = s->creation_stack_id;
 #endif
 }
 
@@ -310,13 +318,7 @@ void ScopedReport::AddLocation(uptr addr, uptr size) {
     loc->type = ReportLocationFD;
     loc->fd = fd;
     loc->tid = creat_tid;
-    uptr ssz = 0;
-    const uptr *stack = StackDepotGet(creat_stack, &ssz);
-    if (stack) {
-      StackTrace trace;
-      trace.Init(stack, ssz);
-      loc->stack = SymbolizeStack(trace);
-    }
+    loc->stack_id = creat_stack;
     ThreadContext *tctx = FindThreadByUidLocked(creat_tid);
     if (tctx)
       AddThread(tctx);
@@ -337,13 +339,7 @@ void ScopedReport::AddLocation(uptr addr, uptr size) {
     loc->file = 0;
     loc->line = 0;
     loc->stack = 0;
-    uptr ssz = 0;
-    const uptr *stack = StackDepotGet(b->StackId(), &ssz);
-    if (stack) {
-      StackTrace trace;
-      trace.Init(stack, ssz);
-      loc->stack = SymbolizeStack(trace);
-    }
+    loc->stack_id = b->StackId();
     if (tctx)
       AddThread(tctx);
     return;
@@ -357,6 +353,8 @@ void ScopedReport::AddLocation(uptr addr, uptr size) {
     loc->tid = tctx->tid;
     AddThread(tctx);
   }
+  if (ReportLogEnabled())
+    return;
   ReportLocation *loc = SymbolizeData(addr);
   if (loc) {
     rep_->locs.PushBack(loc);
@@ -367,13 +365,19 @@ void ScopedReport::AddLocation(uptr addr, uptr size) {
 
 #ifndef TSAN_GO
 void ScopedReport::AddSleep(u32 stack_id) {
+  rep_->sleep_stack_id = stack_id;
+}
+
+static void SymbolizeStackId(ReportStack **stack, u32 stack_id) {
+  if (*stack || stack_id == 0)
+    return;
   uptr ssz = 0;
-  const uptr *stack = StackDepotGet(stack_id, &ssz);
-  if (stack) {
-    StackTrace trace;
-    trace.Init(stack, ssz);
-    rep_->sleep = SymbolizeStack(trace);
-  }
+  const uptr *pcs = StackDepotGet(stack_id, &ssz);
+  if (pcs == 0)
+    return;
+  StackTrace trace;
+  trace.Init(pcs, ssz);
+  *stack = SymbolizeStack(trace);
 }
 #endif
 
@@ -381,14 +385,50 @@ void ScopedReport::SetCount(int count) {
   rep_->count = count;
 }
 
+void ScopedReport::SymbolizeStacks() {
+#ifndef TSAN_GO
+  for (uptr i = 0; i < rep_->locs.Size(); i++)
+    SymbolizeStackId(&rep_->locs[i]->stack, rep_->locs[i]->stack_id);
+  for (uptr i = 0; i < rep_->mutexes.Size(); i++)
+    SymbolizeStackId(&rep_->mutexes[i]->stack, rep_->mutexes[i]->stack_id);
+  for (uptr i = 0; i < rep_->threads.Size(); i++)
+    SymbolizeStackId(&rep_->threads[i]->stack, rep_->threads[i]->stack_id);
+  SymbolizeStackId(&rep_->sleep, rep_->sleep_stack_id);
+#endif
+}
+
 const ReportDesc *ScopedReport::GetReport() const {
   return rep_;
 }
 
+// Replay state saved every kRestoreCheckpointInterval events of a trace part.
+// Checkpoints are built lazily by RestoreStack, so the hot path that appends
+// trace events does not pay for them, while repeated restorations from the
+// same part (e.g. many reports on a hot racy variable) replay at most
+// kRestoreCheckpointInterval events.
+const uptr kRestoreCheckpointInterval = 1024;
+const uptr kRestoreCheckpoints = kTracePartSize / kRestoreCheckpointInterval;
+const uptr kRestoreCheckpointStack = 256;
+
+struct RestoreCheckpoint {
+  uptr pos;  // kInvalidPos if the stack was too deep to be saved.
+  uptr stack[kRestoreCheckpointStack];
+  MutexSet mset;
+};
+
+struct TraceRestoreCache {
+  u64 epoch0;   // epoch0 of the trace part the checkpoints belong to.
+  uptr count;   // Number of built checkpoints.
+  RestoreCheckpoint checkpoints[kRestoreCheckpoints];
+};
+
+static const uptr kInvalidPos = (uptr)-1;
+
 void RestoreStack(int tid, const u64 epoch, StackTrace *stk, MutexSet *mset) {
   // This function restores stack trace and mutex set for the thread/epoch.
   // It does so by getting stack trace and mutex set at the beginning of
-  // trace part, and then replaying the trace till the given epoch.
+  // trace part (or at the closest checkpoint inside of the part),
+  // and then replaying the trace till the given epoch.
   Context *ctx = CTX();
   ctx->thread_registry->CheckLocked();
   ThreadContext *tctx = static_cast<ThreadContext*>(
@@ -400,26 +440,56 @@ void RestoreStack(int tid, const u64 epoch, StackTrace *stk, MutexSet *mset) {
       && tctx->status != ThreadStatusDead)
     return;
   Trace* trace = ThreadTrace(tctx->tid);
-  Lock l(&trace->mtx);
+  TicketLock l(&trace->mtx);
   const int partidx = (epoch / kTracePartSize) % TraceParts();
-  TraceHeader* hdr = &trace->headers[partidx];
-  if (epoch < hdr->epoch0)
+  TraceHeader* hdr = trace->FindHeader(partidx);
+  if (hdr == 0 || epoch < hdr->epoch0)
     return;
   const u64 epoch0 = RoundDown(epoch, TraceSize());
   const u64 eend = epoch % TraceSize();
   const u64 ebegin = RoundDown(eend, kTracePartSize);
   DPrintf("#%d: RestoreStack epoch=%zu ebegin=%zu eend=%zu partidx=%d\n",
           tid, (uptr)epoch, (uptr)ebegin, (uptr)eend, partidx);
+  TraceRestoreCache *cache = trace->restore_cache;
+  if (cache == 0) {
+    cache = (TraceRestoreCache*)internal_alloc(MBlockRestoreCache,
+                                               sizeof(*cache));
+    cache->epoch0 = hdr->epoch0 - 1;
+    cache->count = 0;
+    trace->restore_cache = cache;
+  }
+  if (cache->epoch0 != hdr->epoch0) {
+    // The part was rewritten since the checkpoints were built.
+    cache->epoch0 = hdr->epoch0;
+    cache->count = 0;
+  }
   InternalScopedBuffer<uptr> stack(1024);  // FIXME: de-hardcode 1024
-  for (uptr i = 0; i < hdr->stack0.Size(); i++) {
-    stack[i] = hdr->stack0.Get(i);
-    DPrintf2("  #%02lu: pc=%zx\n", i, stack[i]);
+  InternalScopedBuffer<MutexSet> mset1(1);
+  MutexSet *ms = new(mset1.data()) MutexSet();
+  uptr pos = 0;
+  u64 ecur = ebegin;
+  // Find the last usable checkpoint that precedes eend.
+  uptr cp = min((uptr)((eend - ebegin + 1) / kRestoreCheckpointInterval),
+                cache->count);
+  while (cp > 0 && cache->checkpoints[cp - 1].pos == kInvalidPos)
+    cp--;
+  if (cp > 0) {
+    RestoreCheckpoint *c = &cache->checkpoints[cp - 1];
+    pos = c->pos;
+    internal_memcpy(stack.data(), c->stack, (pos + 1) * sizeof(stack[0]));
+    *ms = c->mset;
+    ecur = ebegin + cp * kRestoreCheckpointInterval;
+    DPrintf2("  resuming from checkpoint %zu\n", cp - 1);
+  } else {
+    for (uptr i = 0; i < hdr->stack0.Size(); i++) {
+      stack[i] = hdr->stack0.Get(i);
+      DPrintf2("  #%02lu: pc=%zx\n", i, stack[i]);
+    }
+    *ms = hdr->mset0;
+    pos = hdr->stack0.Size();
   }
-  if (mset)
-    *mset = hdr->mset0;
-  uptr pos = hdr->stack0.Size();
   Event *events = (Event*)GetThreadTrace(tid);
-  for (uptr i = ebegin; i <= eend; i++) {
+  for (uptr i = ecur; i <= eend; i++) {
     Event ev = events[i];
     EventType typ = (EventType)(ev >> 61);
     uptr pc = (uptr)(ev & ((1ull << 61) - 1));
@@ -432,26 +502,93 @@ void RestoreStack(int tid, const u64 epoch, StackTrace *stk, MutexSet *mset) {
       if (pos > 0)
         pos--;
     }
-    if (mset) {
-      if (typ == EventTypeLock) {
-        mset->Add(pc, true, epoch0 + i);
-      } else if (typ == EventTypeUnlock) {
-        mset->Del(pc, true);
-      } else if (typ == EventTypeRLock) {
-        mset->Add(pc, false, epoch0 + i);
-      } else if (typ == EventTypeRUnlock) {
-        mset->Del(pc, false);
-      }
+    if (typ == EventTypeLock) {
+      ms->Add(pc, true, epoch0 + i);
+    } else if (typ == EventTypeUnlock) {
+      ms->Del(pc, true);
+    } else if (typ == EventTypeRLock) {
+      ms->Add(pc, false, epoch0 + i);
+    } else if (typ == EventTypeRUnlock) {
+      ms->Del(pc, false);
     }
     for (uptr j = 0; j <= pos; j++)
       DPrintf2("      #%zu: %zx\n", j, stack[j]);
+    const uptr done = i + 1 - ebegin;
+    if ((done % kRestoreCheckpointInterval) == 0
+        && done / kRestoreCheckpointInterval == cache->count + 1
+        && cache->count < kRestoreCheckpoints) {
+      RestoreCheckpoint *c = &cache->checkpoints[cache->count++];
+      if (pos < kRestoreCheckpointStack) {
+        c->pos = pos;
+        internal_memcpy(c->stack, stack.data(), (pos + 1) * sizeof(stack[0]));
+        c->mset = *ms;
+      } else {
+        c->pos = kInvalidPos;
+      }
+    }
   }
+  if (mset)
+    *mset = *ms;
   if (pos == 0 && stack[0] == 0)
     return;
   pos++;
   stk->Init(stack.data(), pos);
 }
 
+// Returns a key that identifies the race by the pcs of both accesses and
+// the accessed address range, or 0 if the pc of the previous access
+// is not available anymore (its trace part was overwritten).
+static u64 KnownRaceKey(ThreadState *thr, uptr addr_min, uptr addr_max) {
+  Shadow s2(thr->racy_state[1]);
+  const Event *events = (const Event*)GetThreadTrace(s2.tid());
+  const Event ev = events[s2.epoch() % TraceSize()];
+  if ((EventType)(ev >> 61) != EventTypeMop)
+    return 0;
+  uptr pc1 = TraceTopPC(thr);
+  uptr pc2 = (uptr)(ev & ((1ull << 61) - 1));
+  if (pc1 > pc2)
+    Swap(pc1, pc2);
+  u64 key = 0;
+  const u64 kMul = 0x9e3779b97f4a7c15ull;
+  key = (key ^ addr_min) * kMul;
+  key = (key ^ addr_max) * kMul;
+  key = (key ^ pc1) * kMul;
+  key = (key ^ pc2) * kMul;
+  key ^= key >> 29;
+  return key ? key : 1;
+}
+
+static const uptr kKnownRaceProbes = 8;
+
+static bool IsKnownRace(Context *ctx, u64 key) {
+  for (uptr i = 0; i < kKnownRaceProbes; i++) {
+    u64 v = atomic_load(&ctx->known_races[(key + i) % kKnownRaces],
+                        memory_order_relaxed);
+    if (v == key)
+      return true;
+    if (v == 0)
+      return false;
+  }
+  return false;
+}
+
+static void AddKnownRace(Context *ctx, u64 key) {
+  ctx->thread_registry->CheckLocked();
+  if (key == 0 || !flags()->suppress_equal_addresses)
+    return;
+  for (uptr i = 0; i < kKnownRaceProbes; i++) {
+    atomic_uint64_t *p = &ctx->known_races[(key + i) % kKnownRaces];
+    u64 v = atomic_load(p, memory_order_relaxed);
+    if (v == key)
+      return;
+    if (v == 0) {
+      atomic_store(p, key, memory_order_relaxed);
+      return;
+    }
+  }
+  // The probe sequence is full, the race will take the slow path.
+}
+
 static bool HandleRacyStacks(ThreadState *thr, const StackTrace (&traces)[2],
     uptr addr_min, uptr addr_max) {
   Context *ctx = CTX();
@@ -508,11 +645,12 @@ static void AddRacyStacks(ThreadState *thr, const StackTrace (&traces)[2],
 }
 
 bool OutputReport(Context *ctx,
-                  const ScopedReport &srep,
+                  ScopedReport &srep,
                   const ReportStack *suppress_stack1,
                   const ReportStack *suppress_stack2,
                   const ReportLocation *suppress_loc) {
   atomic_store(&ctx->last_symbolize_time_ns, NanoTime(), memory_order_relaxed);
+  MaybeStartBackgroundThread();
   const ReportDesc *rep = srep.GetReport();
   Suppression *supp = 0;
   uptr suppress_pc = IsSuppressed(rep->typ, suppress_stack1, &supp);
@@ -523,10 +661,21 @@ bool OutputReport(Context *ctx,
   if (suppress_pc != 0) {
     FiredSuppression s = {srep.GetReport()->typ, suppress_pc, supp};
     ctx->fired_suppressions.push_back(s);
+  } else {
+    // The suppressions are matched against the access stacks and the
+    // location only, the other stacks are needed only for the output.
+    srep.SymbolizeStacks();
   }
   if (OnReport(rep, suppress_pc != 0))
     return false;
+#ifndef TSAN_GO
+  if (ReportLogEnabled())
+    WriteReportLog(rep);
+  else
+    PrintReport(rep);
+#else
   PrintReport(rep);
+#endif
   CTX()->nreported++;
   return true;
 }
@@ -620,10 +769,134 @@ static bool RaceBetweenAtomicAndFree(ThreadState *thr) {
   return false;
 }
 
+// What a race report needs from the racing thread. The rest is collected
+// later, possibly on the reporter thread (see report_async).
+struct RaceInfo {
+  RaceInfo *next;  // In async_races.
+  u64 racy_state[2];
+  uptr addr;  // Of the racy shadow cell.
+  uptr addr_min;
+  uptr addr_max;
+  u64 known_race_key;
+  ReportType typ;
+  bool slept;
+  u32 sleep_stack_id;
+  u32 stack_id;  // Of the current access, with report_async.
+  MutexSet mset;  // Of the current thread.
+};
+
+static void ProcessRace(ThreadState *thr, Context *ctx, const RaceInfo *info,
+                        const StackTrace &trace0) {
+  ThreadRegistryLock l0(ctx->thread_registry);
+
+  ScopedReport rep(info->typ);
+  if (IsFiredSuppression(ctx, rep, info->addr))
+    return;
+  const uptr kMop = 2;
+  StackTrace traces[kMop];
+  traces[0].CopyFrom(trace0);
+  if (IsFiredSuppression(ctx, rep, traces[0]))
+    return;
+  InternalScopedBuffer<MutexSet> mset2(1);
+  new(mset2.data()) MutexSet();
+  Shadow s2(info->racy_state[1]);
+  RestoreStack(s2.tid(), s2.epoch(), &traces[1], mset2.data());
+  if (IsFiredSuppression(ctx, rep, traces[1]))
+    return;
+
+  if (HandleRacyStacks(thr, traces, info->addr_min, info->addr_max)) {
+    AddKnownRace(ctx, info->known_race_key);
+    return;
+  }
+
+  for (uptr i = 0; i < kMop; i++) {
+    Shadow s(info->racy_state[i]);
+    rep.AddMemoryAccess(info->addr, s, &traces[i],
+                        i == 0 ? &info->mset : mset2.data());
+  }
+
+  if (flags()->suppress_java && IsJavaNonsense(rep.GetReport()))
+    return;
+
+  for (uptr i = 0; i < kMop; i++) {
+    FastState s(info->racy_state[i]);
+    ThreadContext *tctx = static_cast<ThreadContext*>(
+        ctx->thread_registry->GetThreadLocked(s.tid()));
+    if (s.epoch() < tctx->epoch0 || s.epoch() > tctx->epoch1)
+      continue;
+    rep.AddThread(tctx);
+  }
+
+  rep.AddLocation(info->addr_min, info->addr_max - info->addr_min);
+
+#ifndef TSAN_GO
+  if (info->slept)
+    rep.AddSleep(info->sleep_stack_id);
+#endif
+
+  ReportLocation *suppress_loc = rep.GetReport()->locs.Size() ?
+                                 rep.GetReport()->locs[0] : 0;
+  if (!OutputReport(ctx, rep, rep.GetReport()->mops[0]->stack,
+                              rep.GetReport()->mops[1]->stack,
+                              suppress_loc))
+    return;
+
+  AddRacyStacks(thr, traces, info->addr_min, info->addr_max);
+  AddKnownRace(ctx, info->known_race_key);
+}
+
+#ifndef TSAN_GO
+// With report_async, the racing threads push the races here and go on.
+// The reporter thread restores the other stack, symbolizes and prints them,
+// so the other racing threads do not wait for the report mutexes. The
+// stack of the current access goes to the stack depot, the other one is
+// restored from its trace, which the thread may overwrite in the meantime
+// (the report then lacks the stack, as for any race on an old access).
+static LFStack<RaceInfo> async_races;
+// Serializes the processing of the popped races, so that Finalize can wait
+// for the ones that the reporter thread is processing.
+static BlockingMutex async_races_mtx(LINKER_INITIALIZED);
+static atomic_uint8_t async_reporter_started;
+static const int kAsyncReportIntervalMs = 10;
+
+static void ProcessAsyncRacesLocked(ThreadState *thr, Context *ctx) {
+  // The list is LIFO, reverse it so that the reports go in order.
+  RaceInfo *races = 0;
+  while (RaceInfo *info = async_races.Pop()) {
+    info->next = races;
+    races = info;
+  }
+  while (RaceInfo *info = races) {
+    races = info->next;
+    uptr ssz = 0;
+    const uptr *pcs = StackDepotGet(info->stack_id, &ssz);
+    StackTrace trace0;
+    if (pcs)
+      trace0.Init(pcs, ssz);
+    ProcessRace(thr, ctx, info, trace0);
+    internal_free(info);
+  }
+}
+
+void ProcessAsyncRaces() {
+  BlockingMutexLock l(&async_races_mtx);
+  ProcessAsyncRacesLocked(cur_thread(), CTX());
+}
+
+static void AsyncReporterThread(void *arg) {
+  ScopedInRtl in_rtl;
+  for (;;) {
+    SleepForMillis(kAsyncReportIntervalMs);
+    ProcessAsyncRaces();
+  }
+}
+#endif
+
 void ReportRace(ThreadState *thr) {
   if (!flags()->report_bugs)
     return;
   ScopedInRtl in_rtl;
+  ScopedTiming timing(kTimingReport);
 
   if (!flags()->report_atomic_races && !RaceBetweenAtomicAndFree(thr))
     return;
@@ -649,69 +922,65 @@ void ReportRace(ThreadState *thr) {
       return;
   }
 
+  // Fast check for races that have already been reported or deduplicated.
+  // With suppress_equal_addresses any later race on the same address range
+  // is not reported, so it can be dropped before restoring any stacks.
   Context *ctx = CTX();
-  ThreadRegistryLock l0(ctx->thread_registry);
-
-  ReportType typ = ReportTypeRace;
-  if (thr->is_vptr_access)
-    typ = ReportTypeVptrRace;
-  else if (freed)
-    typ = ReportTypeUseAfterFree;
-  ScopedReport rep(typ);
-  if (IsFiredSuppression(ctx, rep, addr))
-    return;
-  const uptr kMop = 2;
-  StackTrace traces[kMop];
-  const uptr toppc = TraceTopPC(thr);
-  traces[0].ObtainCurrent(thr, toppc);
-  if (IsFiredSuppression(ctx, rep, traces[0]))
-    return;
-  InternalScopedBuffer<MutexSet> mset2(1);
-  new(mset2.data()) MutexSet();
-  Shadow s2(thr->racy_state[1]);
-  RestoreStack(s2.tid(), s2.epoch(), &traces[1], mset2.data());
-  if (IsFiredSuppression(ctx, rep, traces[1]))
-    return;
-
-  if (HandleRacyStacks(thr, traces, addr_min, addr_max))
+  const u64 known_race_key = KnownRaceKey(thr, addr_min, addr_max);
+  if (known_race_key && IsKnownRace(ctx, known_race_key)) {
+    StatInc(thr, StatReportKnownRace);
     return;
-
-  for (uptr i = 0; i < kMop; i++) {
-    Shadow s(thr->racy_state[i]);
-    rep.AddMemoryAccess(addr, s, &traces[i],
-                        i == 0 ? &thr->mset : mset2.data());
   }
 
-  if (flags()->suppress_java && IsJavaNonsense(rep.GetReport()))
-    return;
-
-  for (uptr i = 0; i < kMop; i++) {
-    FastState s(thr->racy_state[i]);
-    ThreadContext *tctx = static_cast<ThreadContext*>(
-        ctx->thread_registry->GetThreadLocked(s.tid()));
-    if (s.epoch() < tctx->epoch0 || s.epoch() > tctx->epoch1)
-      continue;
-    rep.AddThread(tctx);
+  InternalScopedBuffer<RaceInfo> info_buf(1);
+  RaceInfo *info = info_buf.data();
+#ifndef TSAN_GO
+  if (flags()->report_async) {
+    info = (RaceInfo*)internal_alloc(MBlockReport, sizeof(RaceInfo));
+    StatInc(thr, StatReportAsync);
   }
-
-  rep.AddLocation(addr_min, addr_max - addr_min);
-
+#endif
+  info->racy_state[0] = thr->racy_state[0];
+  info->racy_state[1] = thr->racy_state[1];
+  info->addr = addr;
+  info->addr_min = addr_min;
+  info->addr_max = addr_max;
+  info->known_race_key = known_race_key;
+  info->typ = ReportTypeRace;
+  if (thr->is_vptr_access)
+    info->typ = ReportTypeVptrRace;
+  else if (freed)
+    info->typ = ReportTypeUseAfterFree;
+  info->slept = false;
+  info->sleep_stack_id = 0;
+  info->stack_id = 0;
 #ifndef TSAN_GO
   {  // NOLINT
     Shadow s(thr->racy_state[1]);
-    if (s.epoch() <= thr->last_sleep_clock.get(s.tid()))
-      rep.AddSleep(thr->last_sleep_stack_id);
+    if (s.epoch() <= thr->last_sleep_clock.get(s.tid())) {
+      info->slept = true;
+      info->sleep_stack_id = thr->last_sleep_stack_id;
+    }
   }
 #endif
+  new(&info->mset) MutexSet(thr->mset);
+  const uptr toppc = TraceTopPC(thr);
 
-  ReportLocation *suppress_loc = rep.GetReport()->locs.Size() ?
-                                 rep.GetReport()->locs[0] : 0;
-  if (!OutputReport(ctx, rep, rep.GetReport()->mops[0]->stack,
-                              rep.GetReport()->mops[1]->stack,
-                              suppress_loc))
+#ifndef TSAN_GO
+  if (flags()->report_async) {
+    info->stack_id = CurrentStackId(thr, toppc);
+    async_races.Push(info);
+    if (atomic_load(&async_reporter_started, memory_order_relaxed) ||
+        atomic_exchange(&async_reporter_started, 1, memory_order_relaxed))
+      return;
+    internal_start_thread(&AsyncReporterThread, 0);
     return;
+  }
+#endif
 
-  AddRacyStacks(thr, traces, addr_min, addr_max);
+  StackTrace trace0;
+  trace0.ObtainCurrent(thr, toppc);
+  ProcessRace(thr, ctx, info, trace0);
 }
 
 void PrintCurrentStack(ThreadState *thr, uptr pc) {
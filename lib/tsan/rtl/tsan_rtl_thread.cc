@@ -12,6 +12,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "sanitizer_common/sanitizer_placement_new.h"
+#include "sanitizer_common/sanitizer_timing.h"
 #include "tsan_rtl.h"
 #include "tsan_mman.h"
 #include "tsan_platform.h"
@@ -61,7 +62,9 @@ void ThreadContext::OnCreated(void *arg) {
   TraceAddEvent(args->thr, args->thr->fast_state, EventTypeMop, 0);
   args->thr->clock.set(args->thr->tid, args->thr->fast_state.epoch());
   args->thr->fast_synch_epoch = args->thr->fast_state.epoch();
-  args->thr->clock.release(&sync);
+  // sync is empty here, so release-store is equivalent to release, but it
+  // shares one clock snapshot between all threads created in a row.
+  args->thr->clock.ReleaseStore(&sync);
   StatInc(args->thr, StatSyncRelease);
 #ifdef TSAN_GO
   creation_stack.ObtainCurrent(args->thr, args->pc);
@@ -75,7 +78,9 @@ void ThreadContext::OnCreated(void *arg) {
 void ThreadContext::OnReset() {
   sync.Reset();
   FlushUnneededShadowMemory(GetThreadTrace(tid), TraceSize() * sizeof(Event));
-  //!!! FlushUnneededShadowMemory(GetThreadTraceHeader(tid), sizeof(Trace));
+  Trace *trace = ThreadTrace(tid);
+  TicketLock l(&trace->mtx);
+  trace->ResetHeaders();
 }
 
 struct OnStartedArgs {
@@ -93,15 +98,18 @@ void ThreadContext::OnStarted(void *arg) {
   // from different threads.
   epoch0 = RoundUp(epoch1 + 1, kTracePartSize);
   epoch1 = (u64)-1;
-  new(thr) ThreadState(CTX(), tid, unique_id,
+  new(thr) ThreadState(CTX(), tid, unique_id, reuse_count,
       epoch0, args->stk_addr, args->stk_size, args->tls_addr, args->tls_size);
 #ifdef TSAN_GO
-  // Setup dynamic shadow stack.
+  // Setup dynamic shadow stack, unless the goroutine reuses the state
+  // of a finished one which has it (see AllocGoroutine).
   const int kInitStackSize = 8;
-  args->thr->shadow_stack = (uptr*)internal_alloc(MBlockShadowStack,
-      kInitStackSize * sizeof(uptr));
+  if (args->thr->shadow_stack == 0) {
+    args->thr->shadow_stack = (uptr*)internal_alloc(MBlockShadowStack,
+        kInitStackSize * sizeof(uptr));
+    args->thr->shadow_stack_end = thr->shadow_stack + kInitStackSize;
+  }
   args->thr->shadow_stack_pos = thr->shadow_stack;
-  args->thr->shadow_stack_end = thr->shadow_stack + kInitStackSize;
 #endif
 #ifndef TSAN_GO
   AllocatorThreadStart(args->thr);
@@ -113,7 +121,10 @@ void ThreadContext::OnStarted(void *arg) {
   thr->fast_state.SetHistorySize(flags()->history_size);
   const uptr trace = (epoch0 / kTracePartSize) % TraceParts();
   Trace *thr_trace = ThreadTrace(thr->tid);
-  thr_trace->headers[trace].epoch0 = epoch0;
+  {
+    TicketLock l(&thr_trace->mtx);
+    thr_trace->GetHeader(trace)->epoch0 = epoch0;
+  }
   StatInc(thr, StatSyncAcquire);
   sync.Reset();
   DPrintf("#%d: ThreadStart epoch=%zu stk_addr=%zx stk_size=%zx "
@@ -130,19 +141,37 @@ void ThreadContext::OnFinished() {
     TraceAddEvent(thr, thr->fast_state, EventTypeMop, 0);
     thr->clock.set(thr->tid, thr->fast_state.epoch());
     thr->fast_synch_epoch = thr->fast_state.epoch();
-    thr->clock.release(&sync);
+    // sync was reset in OnStarted, see OnCreated.
+    thr->clock.ReleaseStore(&sync);
     StatInc(thr, StatSyncRelease);
   }
   epoch1 = thr->fast_state.epoch();
 
 #ifndef TSAN_GO
   AllocatorThreadFinish(thr);
+#else
+  thr->clock.ClearForReuse();
 #endif
   thr->~ThreadState();
   StatAggregate(CTX()->stat, thr->stat);
   thr = 0;
 }
 
+static void StatSnapshotCallback(ThreadContextBase *tctx_base, void *arg) {
+  ThreadContext *tctx = static_cast<ThreadContext*>(tctx_base);
+  if (tctx->status == ThreadStatusRunning && tctx->thr)
+    StatAggregate((u64*)arg, tctx->thr->stat);
+}
+
+void StatSnapshot(u64 *stat) {
+  // Finished threads are aggregated into ctx->stat in OnFinished,
+  // which runs under the registry lock.
+  ThreadRegistryLock l(CTX()->thread_registry);
+  internal_memcpy(stat, CTX()->stat, StatCnt * sizeof(stat[0]));
+  CTX()->thread_registry->RunCallbackForEachThreadLocked(
+      StatSnapshotCallback, stat);
+}
+
 #ifndef TSAN_GO
 struct ThreadLeak {
   ThreadContext *tctx;
@@ -245,6 +274,7 @@ void ThreadFinish(ThreadState *thr) {
   CHECK_GT(thr->in_rtl, 0);
   ThreadCheckIgnore(thr);
   StatInc(thr, StatThreadFinish);
+  TimingThreadFinish();
   if (thr->stk_addr && thr->stk_size)
     DontNeedShadowFor(thr->stk_addr, thr->stk_size);
   if (thr->tls_addr && thr->tls_size)
@@ -325,10 +355,17 @@ void MemoryAccessRange(ThreadState *thr, uptr pc, uptr addr,
 
   StatInc(thr, StatMopRange);
 
-  if (*shadow_mem == kShadowRodata) {
-    // Access to .rodata section, no races here.
-    // Measurements show that it can be 10-20% of all memory accesses.
-    StatInc(thr, StatMopRangeRodata);
+  if (*shadow_mem >= kShadowIgnored) {
+    // Access to .rodata section or to a range ignored by all threads,
+    // no races here.
+    // Measurements show that .rodata can be 10-20% of all memory accesses.
+    StatInc(thr, *shadow_mem == kShadowRodata ? StatMopRangeRodata
+                                              : StatMopRangeIgnoredRange);
+    return;
+  }
+
+  if (InThreadIgnoreRange(thr, addr)) {
+    StatInc(thr, StatMopRangeIgnoredRange);
     return;
   }
 
@@ -354,14 +391,12 @@ void MemoryAccessRange(ThreadState *thr, uptr pc, uptr addr,
   if (unaligned)
     shadow_mem += kShadowCnt;
   // Handle middle part, if any.
-  for (; size >= kShadowCell; addr += kShadowCell, size -= kShadowCell) {
-    int const kAccessSizeLog = 3;
-    Shadow cur(fast_state);
-    cur.SetWrite(is_write);
-    cur.SetAddr0AndSizeLog(0, kAccessSizeLog);
-    MemoryAccessImpl(thr, addr, kAccessSizeLog, is_write, false,
-        shadow_mem, cur);
-    shadow_mem += kShadowCnt;
+  if (size >= kShadowCell) {
+    uptr ncells = size / kShadowCell;
+    MemoryAccessCells(thr, addr, ncells, is_write, shadow_mem, fast_state);
+    addr += ncells * kShadowCell;
+    size -= ncells * kShadowCell;
+    shadow_mem += ncells * kShadowCnt;
   }
   // Handle ending, if any.
   for (; size; addr++, size--) {
@@ -0,0 +1,151 @@
+//===-- tsan_slab.h ---------------------------------------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of ThreadSanitizer (TSan), a race detector.
+//
+// Slab arenas for fixed-size runtime objects of a single MBlockType
+// (SyncVars, FD syncs), with per-thread caches of free objects.
+//===----------------------------------------------------------------------===//
+#ifndef TSAN_SLAB_H
+#define TSAN_SLAB_H
+
+#include "tsan_defs.h"
+#include "tsan_mutex.h"
+
+namespace __tsan {
+
+// Number of MBlockTypes that have own arenas (see SlabArenaIndex).
+const int kSlabArenaCount = 2;
+
+// An arena carves a reserved address range into objects of a fixed size.
+// Free objects are linked through their first word.
+// Memory is never returned to the OS.
+class SlabArena {
+ public:
+  SlabArena(uptr beg, uptr size, uptr obj_size)
+      : mtx_(MutexTypeSlab, StatMtxSlab)
+      , beg_(beg)
+      , size_(size)
+      , obj_size_(obj_size)
+      , pos_()
+      , free_()
+      , free_count_() {
+    CHECK_GE(obj_size, sizeof(void*));
+    CHECK_EQ(obj_size % sizeof(void*), 0);
+  }
+
+  uptr ObjSize() const {
+    return obj_size_;
+  }
+
+  // Returns a list of up to n objects, or 0 if the arena is exhausted.
+  void *Alloc(uptr n, uptr *count) {
+    Lock l(&mtx_);
+    void *head = 0;
+    uptr i = 0;
+    for (; i < n && free_; i++) {
+      void *p = free_;
+      free_ = *(void**)p;
+      *(void**)p = head;
+      head = p;
+    }
+    free_count_ -= i;
+    for (; i < n && pos_ + obj_size_ <= size_; i++) {
+      void *p = (void*)(beg_ + pos_);
+      pos_ += obj_size_;
+      *(void**)p = head;
+      head = p;
+    }
+    *count = i;
+    return head;
+  }
+
+  // Returns a list of count objects ending with tail.
+  void Free(void *head, void *tail, uptr count) {
+    Lock l(&mtx_);
+    *(void**)tail = free_;
+    free_ = head;
+    free_count_ += count;
+  }
+
+  // Bytes carved from the range so far.
+  uptr MappedBytes() {
+    Lock l(&mtx_);
+    return pos_;
+  }
+
+  // Bytes of objects that are in use or in per-thread caches.
+  uptr AllocatedBytes() {
+    Lock l(&mtx_);
+    return pos_ - free_count_ * obj_size_;
+  }
+
+ private:
+  Mutex mtx_;
+  const uptr beg_;
+  const uptr size_;
+  const uptr obj_size_;
+  uptr pos_;
+  void *free_;
+  uptr free_count_;
+
+  SlabArena(const SlabArena&);  // Not implemented.
+  void operator = (const SlabArena&);  // Not implemented.
+};
+
+// Per-thread cache of free objects of one arena.
+// Relies on zero initialization (it lives in ThreadState).
+class SlabCache {
+ public:
+  void *Alloc(SlabArena *arena) {
+    if (head_ == 0) {
+      head_ = arena->Alloc(kBatch, &count_);
+      if (head_ == 0)
+        return 0;
+    }
+    void *p = head_;
+    head_ = *(void**)p;
+    count_--;
+    return p;
+  }
+
+  void Free(SlabArena *arena, void *p) {
+    *(void**)p = head_;
+    head_ = p;
+    count_++;
+    if (count_ >= 2 * kBatch)
+      Drain(arena, kBatch);
+  }
+
+  // Returns all cached objects to the arena.
+  void Drain(SlabArena *arena) {
+    Drain(arena, count_);
+  }
+
+ private:
+  static const uptr kBatch = 64;
+  void *head_;
+  uptr count_;
+
+  void Drain(SlabArena *arena, uptr n) {
+    if (n == 0)
+      return;
+    void *head = head_;
+    void *tail = head;
+    for (uptr i = 1; i < n; i++)
+      tail = *(void**)tail;
+    head_ = *(void**)tail;
+    count_ -= n;
+    arena->Free(head, tail, n);
+  }
+};
+
+}  // namespace __tsan
+
+#endif  // TSAN_SLAB_H
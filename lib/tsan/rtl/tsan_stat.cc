@@ -11,19 +11,24 @@
 //
 //===----------------------------------------------------------------------===//
 #include "tsan_stat.h"
+#include "tsan_flags.h"
 #include "tsan_rtl.h"
 
 namespace __tsan {
 
+static bool StatsEnabled() {
+  return kCollectStats || flags()->stats_sample_rate;
+}
+
 void StatAggregate(u64 *dst, u64 *src) {
-  if (!kCollectStats)
+  if (!StatsEnabled())
     return;
   for (int i = 0; i < StatCnt; i++)
     dst[i] += src[i];
 }
 
 void StatOutput(u64 *stat) {
-  if (!kCollectStats)
+  if (!StatsEnabled())
     return;
 
   stat[StatShadowNonZero] = stat[StatShadowProcessed] - stat[StatShadowZero];
@@ -37,9 +42,13 @@ void StatOutput(u64 *stat) {
   name[StatMop4]                         = "            size 4                ";
   name[StatMop8]                         = "            size 8                ";
   name[StatMopSame]                      = "  Including same                  ";
+  name[StatMopCached]                    = "  Including cached                ";
   name[StatMopRange]                     = "  Including range                 ";
   name[StatMopRodata]                    = "  Including .rodata               ";
   name[StatMopRangeRodata]               = "  Including .rodata range         ";
+  name[StatMopIgnoredRange]              = "  Including ignored range         ";
+  name[StatMopRangeIgnoredRange]         = "  Including ignored range range   ";
+  name[StatMopSampledOut]                = "  Including sampled out           ";
   name[StatShadowProcessed]              = "Shadow processed                  ";
   name[StatShadowZero]                   = "  Including empty                 ";
   name[StatShadowNonZero]                = "  Including non empty             ";
@@ -53,6 +62,8 @@ void StatOutput(u64 *stat) {
   name[StatFuncEnter]                    = "Function entries                  ";
   name[StatFuncExit]                     = "Function exits                    ";
   name[StatEvents]                       = "Events collected                  ";
+  name[StatReportKnownRace]              = "Known races filtered              ";
+  name[StatReportAsync]                  = "Races queued for reporter thread  ";
 
   name[StatThreadCreate]                 = "Total threads created             ";
   name[StatThreadFinish]                 = "  threads finished                ";
@@ -66,6 +77,7 @@ void StatOutput(u64 *stat) {
   name[StatMutexUnlock]                  = "  unlock                          ";
   name[StatMutexRecLock]                 = "  recursive lock                  ";
   name[StatMutexRecUnlock]               = "  recursive unlock                ";
+  name[StatMutexLockNoAcquire]           = "  lock w/o acquire                ";
   name[StatMutexReadLock]                = "  read lock                       ";
   name[StatMutexReadUnlock]              = "  read unlock                     ";
 
@@ -73,6 +85,7 @@ void StatOutput(u64 *stat) {
   name[StatSyncDestroyed]                = "             destroyed            ";
   name[StatSyncAcquire]                  = "             acquired             ";
   name[StatSyncRelease]                  = "             released             ";
+  name[StatSyncBarrierOwnRelease]        = "             barrier own release  ";
 
   name[StatAtomic]                       = "Atomic operations                 ";
   name[StatAtomicLoad]                   = "  Including load                  ";
@@ -97,6 +110,8 @@ void StatOutput(u64 *stat) {
   name[StatAtomic4]                      = "            size 4                ";
   name[StatAtomic8]                      = "            size 8                ";
   name[StatAtomic16]                     = "            size 16               ";
+  name[StatAtomicAcquireCached]          = "  Including cached acquire        ";
+  name[StatAtomicReleaseMerged]          = "            merged release        ";
 
   name[StatInterceptor]                  = "Interceptors                      ";
   name[StatInt_longjmp]                  = "  longjmp                         ";
@@ -111,6 +126,7 @@ void StatOutput(u64 *stat) {
   name[StatInt_mmap]                     = "  mmap                            ";
   name[StatInt_mmap64]                   = "  mmap64                          ";
   name[StatInt_munmap]                   = "  munmap                          ";
+  name[StatInt_dlclose]                  = "  dlclose                         ";
   name[StatInt_memalign]                 = "  memalign                        ";
   name[StatInt_valloc]                   = "  valloc                          ";
   name[StatInt_pvalloc]                  = "  pvalloc                         ";
@@ -385,6 +401,10 @@ void StatOutput(u64 *stat) {
   name[StatAnnotateIgnoreReadsEnd]       = "  IgnoreReadsEnd                  ";
   name[StatAnnotateIgnoreWritesBegin]    = "  IgnoreWritesBegin               ";
   name[StatAnnotateIgnoreWritesEnd]      = "  IgnoreWritesEnd                 ";
+  name[StatAnnotateIgnoreRangeBegin]     = "  IgnoreRangeBegin                ";
+  name[StatAnnotateIgnoreRangeEnd]       = "  IgnoreRangeEnd                  ";
+  name[StatAnnotateThreadIgnoreBegin]    = "  ThreadIgnoreBegin               ";
+  name[StatAnnotateThreadIgnoreEnd]      = "  ThreadIgnoreEnd                 ";
   name[StatAnnotatePublishMemoryRange]   = "  PublishMemoryRange              ";
   name[StatAnnotateUnpublishMemoryRange] = "  UnpublishMemoryRange            ";
   name[StatAnnotateThreadName]           = "  ThreadName                      ";
@@ -402,7 +422,11 @@ void StatOutput(u64 *stat) {
   name[StatMtxJavaMBlock]                = "  JavaMBlock                      ";
   name[StatMtxFD]                        = "  FD                              ";
 
-  Printf("Statistics:\n");
+  if (kCollectStats)
+    Printf("Statistics:\n");
+  else
+    Printf("Statistics (sampled 1 in %d memory accesses):\n",
+           flags()->stats_sample_rate);
   for (int i = 0; i < StatCnt; i++)
     Printf("%s: %zu\n", name[i], (uptr)stat[i]);
 }
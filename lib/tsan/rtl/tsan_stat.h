@@ -26,9 +26,13 @@ enum StatType {
   StatMop4,
   StatMop8,
   StatMopSame,
+  StatMopCached,
   StatMopRange,
   StatMopRodata,
   StatMopRangeRodata,
+  StatMopIgnoredRange,
+  StatMopRangeIgnoredRange,
+  StatMopSampledOut,
   StatShadowProcessed,
   StatShadowZero,
   StatShadowNonZero,  // Derived.
@@ -46,6 +50,10 @@ enum StatType {
   // Trace processing.
   StatEvents,
 
+  // Reports.
+  StatReportKnownRace,
+  StatReportAsync,
+
   // Threads.
   StatThreadCreate,
   StatThreadFinish,
@@ -60,6 +68,7 @@ enum StatType {
   StatMutexUnlock,
   StatMutexRecLock,
   StatMutexRecUnlock,
+  StatMutexLockNoAcquire,
   StatMutexReadLock,
   StatMutexReadUnlock,
 
@@ -68,6 +77,7 @@ enum StatType {
   StatSyncDestroyed,
   StatSyncAcquire,
   StatSyncRelease,
+  StatSyncBarrierOwnRelease,
 
   // Atomics.
   StatAtomic,
@@ -93,6 +103,8 @@ enum StatType {
   StatAtomic4,
   StatAtomic8,
   StatAtomic16,
+  StatAtomicAcquireCached,
+  StatAtomicReleaseMerged,
 
   // Interceptors.
   StatInterceptor,
@@ -108,6 +120,7 @@ enum StatType {
   StatInt_mmap,
   StatInt_mmap64,
   StatInt_munmap,
+  StatInt_dlclose,
   StatInt_memalign,
   StatInt_valloc,
   StatInt_pvalloc,
@@ -381,6 +394,10 @@ enum StatType {
   StatAnnotateIgnoreReadsEnd,
   StatAnnotateIgnoreWritesBegin,
   StatAnnotateIgnoreWritesEnd,
+  StatAnnotateIgnoreRangeBegin,
+  StatAnnotateIgnoreRangeEnd,
+  StatAnnotateThreadIgnoreBegin,
+  StatAnnotateThreadIgnoreEnd,
   StatAnnotatePublishMemoryRange,
   StatAnnotateUnpublishMemoryRange,
   StatAnnotateThreadName,
@@ -71,7 +71,7 @@ static ReportStack *NewReportStackEntry(const AddressInfo &info) {
 
 ReportStack *SymbolizeCode(uptr addr) {
   if (!IsSymbolizerAvailable())
-    return SymbolizeCodeAddr2Line(addr);
+    return SymbolizeCodeElf(addr);
   ScopedInSymbolizer in_symbolizer;
   static const uptr kMaxAddrFrames = 16;
   InternalScopedBuffer<AddressInfo> addr_frames(kMaxAddrFrames);
@@ -96,6 +96,13 @@ ReportStack *SymbolizeCode(uptr addr) {
   return top;
 }
 
+void SymbolizeCodePrefetch(const uptr *addrs, uptr n) {
+  if (!IsSymbolizerAvailable())
+    return;
+  ScopedInSymbolizer in_symbolizer;
+  __sanitizer::SymbolizeCodePrefetch(addrs, n);
+}
+
 ReportLocation *SymbolizeData(uptr addr) {
   if (!IsSymbolizerAvailable())
     return 0;
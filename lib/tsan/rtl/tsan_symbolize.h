@@ -19,10 +19,12 @@
 namespace __tsan {
 
 ReportStack *SymbolizeCode(uptr addr);
+// Makes the following SymbolizeCode calls for addrs faster.
+void SymbolizeCodePrefetch(const uptr *addrs, uptr n);
 ReportLocation *SymbolizeData(uptr addr);
 void SymbolizeFlush();
 
-ReportStack *SymbolizeCodeAddr2Line(uptr addr);
+ReportStack *SymbolizeCodeElf(uptr addr);
 
 ReportStack *NewReportStackEntry(uptr addr);
 
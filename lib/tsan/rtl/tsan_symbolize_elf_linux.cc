@@ -0,0 +1,239 @@
+//===-- tsan_symbolize_elf_linux.cc ---------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of ThreadSanitizer (TSan), a race detector.
+//
+// Fallback in-process symbolizer, used when no external symbolizer is
+// available. Reads function names from ELF .symtab/.dynsym of the modules.
+// Modules are mapped lazily on first lookup, nothing is forked.
+//===----------------------------------------------------------------------===//
+#include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_libc.h"
+#include "sanitizer_common/sanitizer_symbolizer.h"
+#include "tsan_symbolize.h"
+#include "tsan_mman.h"
+#include "tsan_rtl.h"
+#include "tsan_platform.h"
+
+#include <elf.h>
+#include <link.h>
+#include <sys/mman.h>
+
+namespace __tsan {
+
+struct SymbolDesc {
+  uptr addr;  // Relative to module base.
+  uptr size;
+  const char *name;  // Points into the mapped module.
+};
+
+struct ModuleDesc {
+  const char *fullname;
+  const char *name;
+  uptr base;
+  bool inited;
+  SymbolDesc *syms;  // Sorted by addr.
+  uptr nsyms;
+};
+
+struct SectionDesc {
+  SectionDesc *next;
+  ModuleDesc *module;
+  uptr base;
+  uptr end;
+};
+
+struct DlIteratePhdrCtx {
+  SectionDesc *sections;
+  bool is_first;
+};
+
+static bool CompareSymbols(const SymbolDesc &a, const SymbolDesc &b) {
+  return a.addr < b.addr;
+}
+
+static const Elf64_Shdr *FindSymtab(const char *map, uptr size,
+                                    const Elf64_Ehdr *ehdr, Elf64_Word type) {
+  const Elf64_Shdr *shdr = (const Elf64_Shdr*)(map + ehdr->e_shoff);
+  for (uptr i = 0; i < ehdr->e_shnum; i++) {
+    const Elf64_Shdr *s = &shdr[i];
+    if (s->sh_type != type || s->sh_link >= ehdr->e_shnum)
+      continue;
+    const Elf64_Shdr *str = &shdr[s->sh_link];
+    if (s->sh_offset + s->sh_size > size ||
+        str->sh_offset + str->sh_size > size)
+      continue;
+    return s;
+  }
+  return 0;
+}
+
+static bool IsFunctionSymbol(const Elf64_Sym *sym, uptr strtab_size) {
+  return ELF64_ST_TYPE(sym->st_info) == STT_FUNC &&
+         sym->st_shndx != SHN_UNDEF && sym->st_value != 0 &&
+         sym->st_name < strtab_size;
+}
+
+// Maps the module file and indexes its function symbols.
+// The mapping is never released, symbol names point into it.
+static void NOINLINE InitModule(ModuleDesc *m) {
+  m->inited = true;
+  uptr fd = OpenFile(m->fullname, false);
+  if (internal_iserror(fd))
+    return;
+  uptr size = internal_filesize(fd);
+  if (size == (uptr)-1 || size < sizeof(Elf64_Ehdr)) {
+    internal_close(fd);
+    return;
+  }
+  uptr mapped = internal_mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  internal_close(fd);
+  if (internal_iserror(mapped))
+    return;
+  const char *map = (const char*)mapped;
+  const Elf64_Ehdr *ehdr = (const Elf64_Ehdr*)map;
+  if (internal_memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+      ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+      ehdr->e_shoff + ehdr->e_shnum * sizeof(Elf64_Shdr) > size) {
+    internal_munmap((void*)mapped, size);
+    return;
+  }
+  // Stripped modules still have the dynamic symbol table.
+  const Elf64_Shdr *symtab = FindSymtab(map, size, ehdr, SHT_SYMTAB);
+  if (symtab == 0)
+    symtab = FindSymtab(map, size, ehdr, SHT_DYNSYM);
+  if (symtab == 0) {
+    internal_munmap((void*)mapped, size);
+    return;
+  }
+  const Elf64_Shdr *strtab = &((const Elf64_Shdr*)(map + ehdr->e_shoff))
+      [symtab->sh_link];
+  const Elf64_Sym *sym = (const Elf64_Sym*)(map + symtab->sh_offset);
+  const uptr nsym = symtab->sh_size / sizeof(Elf64_Sym);
+  uptr nfunc = 0;
+  for (uptr i = 0; i < nsym; i++) {
+    if (IsFunctionSymbol(&sym[i], strtab->sh_size))
+      nfunc++;
+  }
+  if (nfunc == 0) {
+    internal_munmap((void*)mapped, size);
+    return;
+  }
+  m->syms = (SymbolDesc*)internal_alloc(MBlockReportStack,
+                                        nfunc * sizeof(SymbolDesc));
+  for (uptr i = 0; i < nsym; i++) {
+    if (!IsFunctionSymbol(&sym[i], strtab->sh_size))
+      continue;
+    SymbolDesc *s = &m->syms[m->nsyms++];
+    s->addr = sym[i].st_value;
+    s->size = sym[i].st_size;
+    s->name = map + strtab->sh_offset + sym[i].st_name;
+  }
+  InternalSort(&m->syms, m->nsyms, CompareSymbols);
+  DPrintf2("Module %s: %zu function symbols\n", m->name, m->nsyms);
+}
+
+static const SymbolDesc *FindSymbol(ModuleDesc *m, uptr offset) {
+  if (!m->inited)
+    InitModule(m);
+  // Find the last symbol that starts at or before offset.
+  uptr lo = 0;
+  uptr hi = m->nsyms;
+  while (lo < hi) {
+    uptr mid = lo + (hi - lo) / 2;
+    if (m->syms[mid].addr <= offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0)
+    return 0;
+  const SymbolDesc *s = &m->syms[lo - 1];
+  // Symbols without size extend up to the next symbol.
+  if (s->size != 0 && offset >= s->addr + s->size)
+    return 0;
+  return s;
+}
+
+static int dl_iterate_phdr_cb(dl_phdr_info *info, size_t size, void *arg) {
+  DlIteratePhdrCtx *ctx = (DlIteratePhdrCtx*)arg;
+  InternalScopedBuffer<char> tmp(128);
+  if (ctx->is_first) {
+    internal_snprintf(tmp.data(), tmp.size(), "/proc/%d/exe",
+                      (int)internal_getpid());
+    info->dlpi_name = tmp.data();
+  }
+  ctx->is_first = false;
+  if (info->dlpi_name == 0 || info->dlpi_name[0] == 0)
+    return 0;
+  ModuleDesc *m = (ModuleDesc*)internal_alloc(MBlockReportStack,
+                                              sizeof(ModuleDesc));
+  internal_memset(m, 0, sizeof(*m));
+  m->fullname = internal_strdup(info->dlpi_name);
+  m->name = internal_strrchr(m->fullname, '/');
+  if (m->name)
+    m->name += 1;
+  else
+    m->name = m->fullname;
+  m->base = (uptr)info->dlpi_addr;
+  DPrintf2("Module %s %zx\n", m->name, m->base);
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    const Elf64_Phdr *s = &info->dlpi_phdr[i];
+    DPrintf2("  Section p_type=%zx p_offset=%zx p_vaddr=%zx p_paddr=%zx"
+        " p_filesz=%zx p_memsz=%zx p_flags=%zx p_align=%zx\n",
+            (uptr)s->p_type, (uptr)s->p_offset, (uptr)s->p_vaddr,
+            (uptr)s->p_paddr, (uptr)s->p_filesz, (uptr)s->p_memsz,
+            (uptr)s->p_flags, (uptr)s->p_align);
+    if (s->p_type != PT_LOAD)
+      continue;
+    SectionDesc *sec = (SectionDesc*)internal_alloc(MBlockReportStack,
+                                                    sizeof(SectionDesc));
+    sec->module = m;
+    sec->base = info->dlpi_addr + s->p_vaddr;
+    sec->end = sec->base + s->p_memsz;
+    sec->next = ctx->sections;
+    ctx->sections = sec;
+    DPrintf2("  Section %zx-%zx\n", sec->base, sec->end);
+  }
+  return 0;
+}
+
+static SectionDesc *InitSections() {
+  DlIteratePhdrCtx ctx = {0, true};
+  dl_iterate_phdr(dl_iterate_phdr_cb, &ctx);
+  return ctx.sections;
+}
+
+static SectionDesc *GetSectionDesc(uptr addr) {
+  static SectionDesc *sections = 0;
+  if (sections == 0)
+    sections = InitSections();
+  for (SectionDesc *s = sections; s; s = s->next) {
+    if (addr >= s->base && addr < s->end)
+      return s;
+  }
+  return 0;
+}
+
+ReportStack *SymbolizeCodeElf(uptr addr) {
+  SectionDesc *s = GetSectionDesc(addr);
+  if (s == 0)
+    return NewReportStackEntry(addr);
+  ModuleDesc *m = s->module;
+  uptr offset = addr - m->base;
+  ReportStack *res = NewReportStackEntry(addr);
+  res->module = internal_strdup(m->name);
+  res->offset = offset;
+  const SymbolDesc *sym = FindSymbol(m, offset);
+  if (sym)
+    res->func = internal_strdup(DemangleCXXABI(sym->name));
+  return res;
+}
+
+}  // namespace __tsan
@@ -19,33 +19,83 @@ namespace __tsan {
 
 SyncVar::SyncVar(uptr addr, u64 uid)
   : mtx(MutexTypeSyncVar, StatMtxSyncVar)
-  , addr(addr)
-  , uid(uid)
-  , owner_tid(kInvalidTid)
-  , last_lock()
-  , recursion()
-  , is_rw()
-  , is_recursive()
-  , is_broken()
-  , is_linker_init() {
+  , tab_state(TabNone) {
+  Init(addr, uid);
 }
 
-SyncTab::Part::Part()
-  : mtx(MutexTypeSyncTab, StatMtxSyncTab)
-  , val() {
+// Resets everything but mtx and tab_state, does not touch the clocks.
+void SyncVar::Init(uptr addr, u64 uid) {
+  this->addr = addr;
+  this->uid = uid;
+  creation_stack_id = 0;
+  owner_tid = kInvalidTid;
+  acquired_uid = kInvalidTid;
+  last_lock = 0;
+  recursion = 0;
+  is_rw = false;
+  is_recursive = false;
+  is_broken = false;
+  is_linker_init = false;
+  next = 0;
 }
 
 SyncTab::SyncTab() {
+  for (uptr i = 0; i < kStripeCount; i++)
+    stripes_[i].count = 0;
+  free_.Clear();
+  atomic_store(&uid_gen_, 0, memory_order_relaxed);
+  for (uptr i = 0; i < kReleaseVersions; i++)
+    atomic_store(&release_versions_[i], 0, memory_order_relaxed);
+  atomic_store(&buckets_, (uptr)AllocBuckets(kInitialSize),
+               memory_order_relaxed);
 }
 
 SyncTab::~SyncTab() {
-  for (int i = 0; i < kPartCount; i++) {
-    while (tab_[i].val) {
-      SyncVar *tmp = tab_[i].val;
-      tab_[i].val = tmp->next;
+  Buckets *b = (Buckets*)atomic_load(&buckets_, memory_order_relaxed);
+  for (uptr i = 0; i < b->size; i++) {
+    SyncVar *s = (SyncVar*)atomic_load(&b->bucket[i], memory_order_relaxed);
+    while (s) {
+      SyncVar *tmp = s;
+      s = s->next;
       DestroyAndFree(tmp);
     }
   }
+  while (SyncVar *s = free_.Pop())
+    DestroyAndFree(s);
+  while (b) {
+    Buckets *prev = b->prev;
+    UnmapOrDie(b, sizeof(*b) + (b->size - 1) * sizeof(b->bucket[0]));
+    b = prev;
+  }
+}
+
+uptr SyncTab::GetMemoryConsumption(uptr *nsync) {
+  uptr n = 0;
+  for (uptr i = 0; i < kStripeCount; i++) {
+    SpinMutexLock l(&stripes_[i].mtx);
+    n += stripes_[i].count;
+  }
+  uptr mem = n * sizeof(SyncVar);
+  for (Buckets *b = (Buckets*)atomic_load(&buckets_, memory_order_acquire);
+       b; b = b->prev)
+    mem += sizeof(*b) + (b->size - 1) * sizeof(b->bucket[0]);
+  if (nsync)
+    *nsync = n;
+  return mem;
+}
+
+uptr SyncTab::Hash(uptr addr) {
+  return (uptr)(((u64)addr * 0x9e3779b97f4a7c15ull) >> 20);
+}
+
+SyncTab::Buckets *SyncTab::AllocBuckets(uptr size) {
+  CHECK(IsPowerOfTwo(size));
+  CHECK_GE(size, kStripeCount);
+  Buckets *b = (Buckets*)MmapOrDie(
+      sizeof(*b) + (size - 1) * sizeof(b->bucket[0]), "SyncTab");
+  b->size = size;
+  b->prev = 0;
+  return b;
 }
 
 SyncVar* SyncTab::GetOrCreateAndLock(ThreadState *thr, uptr pc,
@@ -68,6 +118,56 @@ SyncVar* SyncTab::Create(ThreadState *thr, uptr pc, uptr addr) {
   return res;
 }
 
+// Creates a SyncVar that is to be linked into the hashtable,
+// reusing memory of destroyed ones if possible.
+SyncVar* SyncTab::CreateInTab(ThreadState *thr, uptr pc, uptr addr) {
+  SyncVar *res = free_.Pop();
+  if (res == 0) {
+    res = Create(thr, pc, addr);
+    res->tab_state = SyncVar::TabLinked;
+    return res;
+  }
+  StatInc(thr, StatSyncCreated);
+  const u64 uid = atomic_fetch_add(&uid_gen_, 1, memory_order_relaxed);
+  // Lookups that still hold a pointer to the old SyncVar may lock it.
+  res->mtx.Lock();
+  CHECK_EQ(res->tab_state, SyncVar::TabUnlinked);
+  res->Init(addr, uid);
+#ifndef TSAN_GO
+  res->creation_stack_id = CurrentStackId(thr, pc);
+#endif
+  res->tab_state = SyncVar::TabLinked;
+  res->mtx.Unlock();
+  return res;
+}
+
+void SyncTab::Destroy(SyncVar *s) {
+  if (s->tab_state == SyncVar::TabNone) {
+    DestroyAndFree(s);
+    return;
+  }
+  CHECK_EQ(s->tab_state, SyncVar::TabUnlinked);
+  s->clock.Reset();
+  s->read_clock.Reset();
+  free_.Push(s);
+}
+
+SyncVar* SyncTab::FindLockFree(uptr addr, uptr hash) {
+  Buckets *b = (Buckets*)atomic_load(&buckets_, memory_order_acquire);
+  SyncVar *s = (SyncVar*)atomic_load(&b->bucket[hash & (b->size - 1)],
+                                     memory_order_acquire);
+  // The list can be concurrently modified, with the SyncVar we look at
+  // moved to another list or to free_, so the result may be stale
+  // and a failed lookup is not authoritative.
+  for (uptr i = 0; s && i < kMaxLockFreeSteps; i++) {
+    if (s->addr == addr)
+      return s;
+    s = (SyncVar*)atomic_load((atomic_uintptr_t*)&s->next,
+                              memory_order_acquire);
+  }
+  return 0;
+}
+
 SyncVar* SyncTab::GetAndLock(ThreadState *thr, uptr pc,
                              uptr addr, bool write_lock, bool create) {
 #ifndef TSAN_GO
@@ -103,38 +203,137 @@ SyncVar* SyncTab::GetAndLock(ThreadState *thr, uptr pc,
   }
 #endif
 
-  Part *p = &tab_[PartIdx(addr)];
-  {
-    ReadLock l(&p->mtx);
-    for (SyncVar *res = p->val; res; res = res->next) {
-      if (res->addr == addr) {
-        if (write_lock)
-          res->mtx.Lock();
-        else
-          res->mtx.ReadLock();
-        return res;
-      }
-    }
+  const uptr hash = Hash(addr);
+  SyncVar *res = FindLockFree(addr, hash);
+  if (res) {
+    if (write_lock)
+      res->mtx.Lock();
+    else
+      res->mtx.ReadLock();
+    if (res->tab_state == SyncVar::TabLinked && res->addr == addr)
+      return res;
+    if (write_lock)
+      res->mtx.Unlock();
+    else
+      res->mtx.ReadUnlock();
   }
-  if (!create)
-    return 0;
+
+  Stripe *st = &stripes_[hash % kStripeCount];
+  Buckets *b = 0;
+  bool grow = false;
   {
-    Lock l(&p->mtx);
-    SyncVar *res = p->val;
+    SpinMutexLock l(&st->mtx);
+    b = (Buckets*)atomic_load(&buckets_, memory_order_relaxed);
+    atomic_uintptr_t *head = &b->bucket[hash & (b->size - 1)];
+    res = (SyncVar*)atomic_load(head, memory_order_relaxed);
     for (; res; res = res->next) {
       if (res->addr == addr)
         break;
     }
     if (res == 0) {
-      res = Create(thr, pc, addr);
-      res->next = p->val;
-      p->val = res;
+      if (!create)
+        return 0;
+      res = CreateInTab(thr, pc, addr);
+      res->next = (SyncVar*)atomic_load(head, memory_order_relaxed);
+      atomic_store(head, (uptr)res, memory_order_release);
+      st->count++;
+      grow = st->count > 2 * b->size / kStripeCount;
     }
     if (write_lock)
       res->mtx.Lock();
     else
       res->mtx.ReadLock();
-    return res;
+  }
+  if (grow)
+    Grow(b);
+  return res;
+}
+
+// Makes the table 4 times larger. Lookups can run concurrently and may
+// miss SyncVars that are being moved, then they take the stripe lock.
+void SyncTab::Grow(Buckets *old) {
+  for (uptr i = 0; i < kStripeCount; i++)
+    stripes_[i].mtx.Lock();
+  Buckets *b = (Buckets*)atomic_load(&buckets_, memory_order_relaxed);
+  if (b == old) {
+    Buckets *nb = AllocBuckets(b->size * 4);
+    for (uptr i = 0; i < b->size; i++) {
+      SyncVar *s = (SyncVar*)atomic_load(&b->bucket[i], memory_order_relaxed);
+      while (s) {
+        SyncVar *next = s->next;
+        atomic_uintptr_t *head = &nb->bucket[Hash(s->addr) & (nb->size - 1)];
+        atomic_store((atomic_uintptr_t*)&s->next,
+                     atomic_load(head, memory_order_relaxed),
+                     memory_order_release);
+        atomic_store(head, (uptr)s, memory_order_release);
+        s = next;
+      }
+    }
+    nb->prev = b;
+    atomic_store(&buckets_, (uptr)nb, memory_order_release);
+  }
+  for (uptr i = kStripeCount; i > 0; i--)
+    stripes_[i - 1].mtx.Unlock();
+}
+
+// Unlinks the SyncVars with addresses in [beg, end) from the bucket list
+// at head, which belongs to st and is locked by the caller, and pushes
+// them onto unlinked.
+SyncVar *SyncTab::UnlinkRange(Stripe *st, atomic_uintptr_t *head,
+                              uptr beg, uptr end, SyncVar *unlinked) {
+  atomic_uintptr_t *prev = head;
+  SyncVar *s = (SyncVar*)atomic_load(prev, memory_order_relaxed);
+  while (s) {
+    SyncVar *next = s->next;
+    if (s->addr >= beg && s->addr < end && !s->is_linker_init) {
+      atomic_store(prev, (uptr)next, memory_order_release);
+      st->count--;
+      // Lookups that have already found s retry once it is unlinked.
+      s->mtx.Lock();
+      s->tab_state = SyncVar::TabUnlinked;
+      s->mtx.Unlock();
+      s->next = unlinked;
+      unlinked = s;
+    } else {
+      prev = (atomic_uintptr_t*)&s->next;
+    }
+    s = next;
+  }
+  return unlinked;
+}
+
+void SyncTab::RemoveRange(ThreadState *thr, uptr addr, uptr size) {
+  const uptr end = addr + size;
+  SyncVar *unlinked = 0;
+  Buckets *b = (Buckets*)atomic_load(&buckets_, memory_order_acquire);
+  if (size < b->size / kRemoveRangeProbeRatio) {
+    for (uptr a = addr; a < end; a++) {
+      const uptr hash = Hash(a);
+      Stripe *st = &stripes_[hash % kStripeCount];
+      SpinMutexLock l(&st->mtx);
+      b = (Buckets*)atomic_load(&buckets_, memory_order_relaxed);
+      unlinked = UnlinkRange(st, &b->bucket[hash & (b->size - 1)],
+                             a, a + 1, unlinked);
+    }
+  } else {
+    // The bucket index is the hash modulo the table size, which is
+    // a multiple of kStripeCount, so bucket i belongs to stripe
+    // i % kStripeCount.
+    for (uptr i = 0; i < kStripeCount; i++) {
+      Stripe *st = &stripes_[i];
+      SpinMutexLock l(&st->mtx);
+      if (st->count == 0)
+        continue;
+      b = (Buckets*)atomic_load(&buckets_, memory_order_relaxed);
+      for (uptr j = i; j < b->size; j += kStripeCount)
+        unlinked = UnlinkRange(st, &b->bucket[j], addr, end, unlinked);
+    }
+  }
+  while (unlinked) {
+    SyncVar *s = unlinked;
+    unlinked = s->next;
+    StatInc(thr, StatSyncDestroyed);
+    Destroy(s);
   }
 }
 
@@ -182,35 +381,37 @@ SyncVar* SyncTab::GetAndRemove(ThreadState *thr, uptr pc, uptr addr) {
   }
 #endif
 
-  Part *p = &tab_[PartIdx(addr)];
+  const uptr hash = Hash(addr);
+  Stripe *st = &stripes_[hash % kStripeCount];
   SyncVar *res = 0;
   {
-    Lock l(&p->mtx);
-    SyncVar **prev = &p->val;
-    res = *prev;
+    SpinMutexLock l(&st->mtx);
+    Buckets *b = (Buckets*)atomic_load(&buckets_, memory_order_relaxed);
+    atomic_uintptr_t *prev = &b->bucket[hash & (b->size - 1)];
+    res = (SyncVar*)atomic_load(prev, memory_order_relaxed);
     while (res) {
       if (res->addr == addr) {
         if (res->is_linker_init)
           return 0;
-        *prev = res->next;
+        atomic_store(prev, (uptr)res->next, memory_order_release);
+        st->count--;
         break;
       }
-      prev = &res->next;
-      res = *prev;
+      prev = (atomic_uintptr_t*)&res->next;
+      res = res->next;
     }
   }
   if (res) {
     StatInc(thr, StatSyncDestroyed);
+    // Wait for current holders and make concurrent lookups that
+    // have already found res retry.
     res->mtx.Lock();
+    res->tab_state = SyncVar::TabUnlinked;
     res->mtx.Unlock();
   }
   return res;
 }
 
-int SyncTab::PartIdx(uptr addr) {
-  return (addr >> 3) % kPartCount;
-}
-
 StackTrace::StackTrace()
     : n_()
     , s_()
@@ -15,6 +15,8 @@
 
 #include "sanitizer_common/sanitizer_atomic.h"
 #include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_lfstack.h"
+#include "sanitizer_common/sanitizer_mutex.h"
 #include "tsan_clock.h"
 #include "tsan_defs.h"
 #include "tsan_mutex.h"
@@ -51,24 +53,44 @@ class StackTrace {
 
 struct SyncVar {
   explicit SyncVar(uptr addr, u64 uid);
+  void Init(uptr addr, u64 uid);
 
   static const int kInvalidTid = -1;
 
+  // State with respect to the SyncTab hashtable.
+  enum TabState {
+    TabNone,      // Not in the hashtable (e.g. lives in a heap block).
+    TabLinked,    // In the hashtable.
+    TabUnlinked   // Removed from the hashtable or free.
+  };
+
   Mutex mtx;
   uptr addr;
-  const u64 uid;  // Globally unique id.
+  u64 uid;  // Globally unique id.
   SyncClock clock;
   SyncClock read_clock;  // Used for rw mutexes only.
   u32 creation_stack_id;
   int owner_tid;  // Set only by exclusive owners.
+  // Unique id of the thread whose clock is known to be ahead of clock and
+  // read_clock, or kInvalidTid. Locks by that thread need no acquire.
+  // Changed only under the write lock of mtx.
+  int acquired_uid;
   u64 last_lock;
   int recursion;
   bool is_rw;
   bool is_recursive;
   bool is_broken;
   bool is_linker_init;
+  TabState tab_state;  // Changed only under mtx.
   SyncVar *next;  // In SyncTab hashtable.
 
+  // Must be called after the thread released its clock into clock or
+  // read_clock.
+  void OnClockRelease(int unique_id) {
+    if (acquired_uid != unique_id)
+      acquired_uid = kInvalidTid;
+  }
+
   uptr GetMemoryConsumption();
   u64 GetId() const {
     // 47 lsb is addr, then 14 bits is low part of uid, then 3 zero bits.
@@ -96,24 +118,73 @@ class SyncTab {
   // If the SyncVar does not exist, returns 0.
   SyncVar* GetAndRemove(ThreadState *thr, uptr pc, uptr addr);
 
+  // Removes and destroys all SyncVars of the hashtable with addresses
+  // in [addr, addr + size), e.g. of an unmapped region.
+  void RemoveRange(ThreadState *thr, uptr addr, uptr size);
+
   SyncVar* Create(ThreadState *thr, uptr pc, uptr addr);
+  // Frees a SyncVar returned by GetAndRemove.
+  void Destroy(SyncVar *s);
 
   uptr GetMemoryConsumption(uptr *nsync);
 
+  // Release versions are counters indexed by address hash. A counter is
+  // incremented (under the SyncVar write lock) whenever a release modifies
+  // SyncVar::clock of an address that maps to it. If the counter has not
+  // changed since a thread acquired the SyncVar clock, acquiring it again
+  // is a no-op, and the thread does not need to look up the SyncVar.
+  void OnRelease(uptr addr) {
+    atomic_fetch_add(&release_versions_[addr / 8 % kReleaseVersions], 1,
+                     memory_order_acq_rel);
+  }
+
+  u64 GetReleaseVersion(uptr addr) {
+    return atomic_load(&release_versions_[addr / 8 % kReleaseVersions],
+                       memory_order_acquire);
+  }
+
  private:
-  struct Part {
-    Mutex mtx;
-    SyncVar *val;
-    char pad[kCacheLineSize - sizeof(Mutex) - sizeof(SyncVar*)];  // NOLINT
-    Part();
+  // Lookups do not take any locks: they scan the bucket list,
+  // lock the found SyncVar and check that it is still linked and has
+  // the right address. Modifications of a bucket list are done under the
+  // stripe lock for the bucket. A SyncVar removed from the table may still
+  // be accessed by lookups, so memory of such SyncVars is never returned
+  // to the allocator and is reused only for SyncVars (free_).
+  struct Buckets {
+    uptr size;  // Power of two, at least kStripeCount.
+    Buckets *prev;  // Previous (smaller) arrays, can be accessed by lookups.
+    atomic_uintptr_t bucket[1];  // size elements
   };
 
-  // FIXME: Implement something more sane.
-  static const int kPartCount = 1009;
-  Part tab_[kPartCount];
-  atomic_uint64_t uid_gen_;
+  struct Stripe {
+    SpinMutex mtx;
+    uptr count;  // Number of SyncVars in the buckets of this stripe.
+    char pad[kCacheLineSize - sizeof(SpinMutex) - sizeof(uptr)];  // NOLINT
+  };
 
-  int PartIdx(uptr addr);
+  static const uptr kStripeCount = 64;
+  static const uptr kInitialSize = 4096;
+  // Lookups that do not find the address in that many steps
+  // fall back to the locked path.
+  static const uptr kMaxLockFreeSteps = 64;
+  static const uptr kReleaseVersions = 4096;
+  // RemoveRange looks up every address of ranges that are that many times
+  // smaller than the table, and scans all buckets for larger ranges.
+  static const uptr kRemoveRangeProbeRatio = 16;
+
+  Stripe stripes_[kStripeCount];
+  atomic_uintptr_t buckets_;  // Buckets*
+  LFStack<SyncVar> free_;
+  atomic_uint64_t uid_gen_;
+  atomic_uint64_t release_versions_[kReleaseVersions];
+
+  static uptr Hash(uptr addr);
+  static Buckets *AllocBuckets(uptr size);
+  SyncVar *FindLockFree(uptr addr, uptr hash);
+  SyncVar *CreateInTab(ThreadState *thr, uptr pc, uptr addr);
+  void Grow(Buckets *old);
+  SyncVar *UnlinkRange(Stripe *st, atomic_uintptr_t *head,
+                       uptr beg, uptr end, SyncVar *unlinked);
 
   SyncVar* GetAndLock(ThreadState *thr, uptr pc,
                       uptr addr, bool write_lock, bool create);
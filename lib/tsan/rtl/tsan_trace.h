@@ -59,13 +59,44 @@ struct TraceHeader {
   }
 };
 
+struct TraceRestoreCache;
+
 struct Trace {
-  TraceHeader headers[kTraceParts];
-  Mutex mtx;
+  TicketMutex mtx;
+  // Replay checkpoints used by RestoreStack, allocated on first use.
+  TraceRestoreCache *restore_cache;
 
   Trace()
-    : mtx(MutexTypeTrace, StatMtxTrace) {
+    : mtx(MutexTypeTrace, StatMtxTrace)
+    , restore_cache() {
+    for (uptr i = 0; i < kTraceParts / 64; i++)
+      used_[i] = 0;
+  }
+
+  // Returns the header of a trace part, constructing it on first use.
+  // The caller must hold mtx.
+  TraceHeader *GetHeader(uptr part);
+
+  // Returns the header of a trace part, or 0 if the part was never used.
+  // The caller must hold mtx.
+  TraceHeader *FindHeader(uptr part) {
+    DCHECK_LT(part, kTraceParts);
+    if ((used_[part / 64] & (1ull << (part % 64))) == 0)
+      return 0;
+    return reinterpret_cast<TraceHeader*>(headers_[part]);
   }
+
+  // Forgets all headers and returns their memory to the OS.
+  // The caller must hold mtx.
+  void ResetHeaders();
+
+ private:
+  // Headers are constructed lazily: a TraceHeader holds a whole stack and
+  // mutex set, so constructing all kTraceParts of them would touch several
+  // hundred KB per thread, while a thread uses only TraceParts() of them
+  // and a short-lived thread uses just one or two.
+  u64 used_[kTraceParts / 64];
+  u64 headers_[kTraceParts][sizeof(TraceHeader) / sizeof(u64)];
 };
 
 }  // namespace __tsan
@@ -0,0 +1,222 @@
+#!/usr/bin/env python
+#===- lib/tsan/symbolize_report_log.py -------------------------------------===#
+#
+#                     The LLVM Compiler Infrastructure
+#
+# This file is distributed under the University of Illinois Open Source
+# License. See LICENSE.TXT for details.
+#
+#===------------------------------------------------------------------------===#
+#
+# Symbolizes and prints reports from a binary log written by ThreadSanitizer
+# with report_log_path (see tsan_report_log.cc for the format).
+#
+# Usage: symbolize_report_log.py [-s llvm-symbolizer] log_path.pid...
+#
+# The module files must be available at the paths they had in the process.
+import getopt
+import struct
+import subprocess
+import sys
+
+MAGIC = b'TSANRLG1'
+RECORD_MODULES = 1
+RECORD_REPORT = 2
+
+ITEM_STACK, ITEM_MOP, ITEM_LOCATION, ITEM_THREAD, ITEM_MUTEX, ITEM_SLEEP = \
+    range(6)
+ITEM_FORMAT = '=BBHiQQQ'
+ITEM_SIZE = struct.calcsize(ITEM_FORMAT)
+
+REPORT_TYPES = [
+  'data race',
+  'data race on vptr (ctor/dtor vs virtual call)',
+  'heap-use-after-free',
+  'thread leak',
+  'destroy of a locked mutex',
+  'signal-unsafe call inside of a signal',
+  'signal handler spoils errno',
+]
+
+LOCATION_GLOBAL, LOCATION_HEAP, LOCATION_STACK, LOCATION_TLS, LOCATION_FD = \
+    range(5)
+
+
+class Symbolizer(object):
+  def __init__(self, path):
+    self.pipe = subprocess.Popen([path, '--inlining=false'],
+                                 stdin=subprocess.PIPE,
+                                 stdout=subprocess.PIPE,
+                                 universal_newlines=True)
+    self.cache = {}
+
+  def symbolize(self, module, offset):
+    key = (module, offset)
+    if key not in self.cache:
+      self.pipe.stdin.write('"%s" 0x%x\n' % (module, offset))
+      self.pipe.stdin.flush()
+      func = self.pipe.stdout.readline().rstrip()
+      file_line = self.pipe.stdout.readline().rstrip()
+      while self.pipe.stdout.readline().rstrip():
+        pass
+      self.cache[key] = (func, file_line)
+    return self.cache[key]
+
+
+def is_exec_module(path, cache={}):
+  """True for non-PIE executables, whose pcs are not relative to the base."""
+  if path not in cache:
+    try:
+      with open(path, 'rb') as f:
+        header = f.read(18)
+      cache[path] = struct.unpack('=H', header[16:18])[0] == 2  # ET_EXEC
+    except (IOError, struct.error):
+      cache[path] = False
+  return cache[path]
+
+
+class ReportLog(object):
+  def __init__(self, symbolizer):
+    self.symbolizer = symbolizer
+    self.modules = []
+    self.pid = 0
+
+  def module_for(self, pc):
+    for start, end, offset, name in self.modules:
+      if start <= pc < end:
+        return start, offset, name
+    return None
+
+  def print_stack(self, pcs):
+    if not pcs:
+      print('    [failed to restore the stack]\n')
+      return
+    for i, pc in enumerate(pcs):
+      m = self.module_for(pc)
+      if m is None or not m[2]:
+        print('    #%d ?? ??:0 (0x%x)' % (i, pc))
+        continue
+      start, offset, name = m
+      rel = pc - (start - offset)
+      lookup = pc if is_exec_module(name) else rel
+      # pcs are return addresses, symbolize the call instruction.
+      func, file_line = self.symbolizer.symbolize(name, lookup - 1)
+      print('    #%d %s %s (%s+0x%x)' % (i, func, file_line,
+                                         name.split('/')[-1], rel))
+    print('')
+
+  def print_report(self, typ, items):
+    print('==================')
+    typ_str = REPORT_TYPES[typ] if typ < len(REPORT_TYPES) else 'report'
+    print('WARNING: ThreadSanitizer: %s (pid=%d)' % (typ_str, self.pid))
+    first_stack = True
+    first_mop = True
+    for kind, flags, tid, addr, size, pcs in items:
+      if kind == ITEM_STACK:
+        if not first_stack:
+          print('  and:')
+        first_stack = False
+        self.print_stack(pcs)
+      elif kind == ITEM_MOP:
+        write, atomic = flags & 1, flags & 2
+        desc = ('Write' if write else 'Read') if first_mop else \
+               ('Previous write' if write else 'Previous read')
+        if atomic:
+          desc = ('Atomic ' + desc.lower()) if first_mop else \
+                 desc.replace('Previous ', 'Previous atomic ')
+        first_mop = False
+        print('  %s of size %d at 0x%x by %s:' % (desc, size, addr,
+                                                   thread_name(tid)))
+        self.print_stack(pcs)
+      elif kind == ITEM_SLEEP:
+        print('  As if synchronized via sleep:')
+        self.print_stack(pcs)
+      elif kind == ITEM_LOCATION:
+        if flags == LOCATION_HEAP:
+          print('  Location is heap block of size %d at 0x%x allocated by '
+                '%s:' % (size, addr, thread_name(tid)))
+          self.print_stack(pcs)
+        elif flags == LOCATION_STACK:
+          print('  Location is stack of %s.\n' % thread_name(tid))
+        elif flags == LOCATION_TLS:
+          print('  Location is TLS of %s.\n' % thread_name(tid))
+        elif flags == LOCATION_FD:
+          print('  Location is file descriptor %d:' % tid)
+          self.print_stack(pcs)
+        else:
+          print('  Location is global at 0x%x\n' % addr)
+      elif kind == ITEM_MUTEX:
+        if flags & 1:
+          print('  Mutex M%d is already destroyed.\n' % addr)
+        else:
+          print('  Mutex M%d created at:' % addr)
+          self.print_stack(pcs)
+      elif kind == ITEM_THREAD and tid != 0:
+        print('  Thread T%d (tid=%d, %s) created by %s%s' % (
+            tid, addr, 'running' if flags & 1 else 'finished',
+            thread_name(size), ' at:' if pcs else ''))
+        self.print_stack(pcs)
+    print('==================')
+
+  def process(self, data):
+    if data[:8] != MAGIC:
+      raise ValueError('not a ThreadSanitizer report log')
+    self.pid = struct.unpack_from('=Q', data, 8)[0]
+    pos = 16
+    while pos + 8 <= len(data):
+      kind, size = struct.unpack_from('=II', data, pos)
+      pos += 8
+      payload = data[pos:pos + size]
+      pos += size
+      if kind == RECORD_MODULES:
+        self.parse_modules(payload)
+      elif kind == RECORD_REPORT:
+        self.parse_report(payload)
+
+  def parse_modules(self, p):
+    n = struct.unpack_from('=Q', p, 0)[0]
+    pos = 8
+    self.modules = []
+    for _ in range(n):
+      start, end, offset, length = struct.unpack_from('=QQQI', p, pos)
+      pos += 28
+      name = p[pos:pos + length].decode('utf-8', 'replace')
+      pos += length
+      self.modules.append((start, end, offset, name))
+
+  def parse_report(self, p):
+    typ, n = struct.unpack_from('=II', p, 0)
+    pos = 8
+    items = []
+    for _ in range(n):
+      kind, flags, _, tid, addr, size, npc = \
+          struct.unpack_from(ITEM_FORMAT, p, pos)
+      pos += ITEM_SIZE
+      pcs = list(struct.unpack_from('=%dQ' % npc, p, pos))
+      pos += 8 * npc
+      items.append((kind, flags, tid, addr, size, pcs))
+    self.print_report(typ, items)
+
+
+def thread_name(tid):
+  return 'main thread' if tid == 0 else 'thread T%d' % tid
+
+
+def main():
+  symbolizer_path = 'llvm-symbolizer'
+  opts, args = getopt.getopt(sys.argv[1:], 's:')
+  for opt, value in opts:
+    if opt == '-s':
+      symbolizer_path = value
+  if not args:
+    sys.stderr.write(__doc__ or
+                     'usage: symbolize_report_log.py [-s symbolizer] log\n')
+    sys.exit(1)
+  symbolizer = Symbolizer(symbolizer_path)
+  for path in args:
+    with open(path, 'rb') as f:
+      ReportLog(symbolizer).process(f.read())
+
+
+if __name__ == '__main__':
+  main()
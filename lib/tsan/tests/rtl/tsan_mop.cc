@@ -11,6 +11,7 @@
 //
 //===----------------------------------------------------------------------===//
 #include "tsan_interface.h"
+#include "tsan_interface_ann.h"
 #include "tsan_test_util.h"
 #include "gtest/gtest.h"
 #include <stddef.h>
@@ -57,6 +58,14 @@ TEST(ThreadSanitizer, ReadReadNoRace) {
   t2.Read1(l);
 }
 
+TEST(ThreadSanitizer, ImmutableRangeNoRace) {
+  ScopedThread t1, t2;
+  MemLoc l;
+  t1.Write8(l);
+  __tsan_publish_immutable_range(l.loc(), 8);
+  t2.Read8(l);
+}
+
 TEST(ThreadSanitizer, WriteThenRead) {
   MemLoc l;
   ScopedThread t1, t2;
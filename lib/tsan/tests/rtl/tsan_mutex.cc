@@ -149,6 +149,37 @@ TEST(ThreadSanitizer, RwMutex) {
   t2.Destroy(m);
 }
 
+TEST(ThreadSanitizer, MutexReacquire) {
+  Mutex m;
+  MainThread t0;
+  t0.Create(m);
+
+  ScopedThread t1, t2;
+  MemLoc l;
+  // The second lock by t1 skips the acquire.
+  t1.Lock(m);
+  t1.Write1(l);
+  t1.Unlock(m);
+  t1.Lock(m);
+  t1.Write1(l);
+  t1.Unlock(m);
+  t2.Lock(m);
+  t2.Write1(l);
+  t2.Unlock(m);
+  // After t2, t1 must acquire again.
+  t1.Lock(m);
+  t1.Write1(l);
+  t1.Unlock(m);
+  t1.Lock(m);
+  t1.Write1(l);
+  t1.Unlock(m);
+  t2.Write1(l, true);
+  // Synchronize with t1 before destroying the mutex.
+  t2.Lock(m);
+  t2.Unlock(m);
+  t2.Destroy(m);
+}
+
 TEST(ThreadSanitizer, StaticMutex) {
   // Emulates statically initialized mutex.
   Mutex m;
@@ -120,4 +120,266 @@ TEST(Clock, DifferentSizes) {
   }
 }
 
+TEST(Clock, RepeatedRelease) {
+  ScopedInRtl in_rtl;
+  ThreadClock thr1(1);
+  ThreadClock thr2(2);
+  SyncClock sync;
+  thr1.set(1, 10);
+  thr1.set(5, 7);
+  thr1.release(&sync);
+  CHECK_EQ(sync.size(), 6);
+  // No acquires in between, only the own entry changes.
+  thr1.set(1, 11);
+  thr1.release(&sync);
+  CHECK_EQ(sync.get(1), 11);
+  CHECK_EQ(sync.get(5), 7);
+  thr2.set(2, 3);
+  thr2.acquire(&sync);
+  CHECK_EQ(thr2.get(1), 11);
+  CHECK_EQ(thr2.get(5), 7);
+  thr1.set(1, 12);
+  thr1.release(&sync);
+  // thr2 has acquired sync before, but must see the new release.
+  thr2.acquire(&sync);
+  CHECK_EQ(thr2.get(1), 12);
+  // An acquire in between must be visible after the next release.
+  thr1.set(3, 5);
+  thr1.set(1, 13);
+  thr1.release(&sync);
+  CHECK_EQ(sync.get(3), 5);
+  thr2.acquire(&sync);
+  CHECK_EQ(thr2.get(3), 5);
+  CHECK_EQ(thr2.get(1), 13);
+}
+
+TEST(Clock, RepeatedReleaseStore) {
+  ScopedInRtl in_rtl;
+  ThreadClock thr1(1);
+  ThreadClock thr2(2);
+  SyncClock sync;
+  thr2.set(2, 5);
+  thr2.release(&sync);
+  thr1.set(1, 10);
+  thr1.set(4, 3);
+  thr1.ReleaseStore(&sync);
+  CHECK_EQ(sync.size(), 5);
+  CHECK_EQ(sync.get(2), 0);
+  thr1.set(1, 11);
+  thr1.ReleaseStore(&sync);
+  CHECK_EQ(sync.get(1), 11);
+  CHECK_EQ(sync.get(4), 3);
+  thr2.set(2, 6);
+  thr2.release(&sync);
+  thr1.set(1, 12);
+  thr1.ReleaseStore(&sync);
+  CHECK_EQ(sync.get(1), 12);
+  CHECK_EQ(sync.get(2), 0);
+}
+
+TEST(Clock, SharedReleaseStore) {
+  ScopedInRtl in_rtl;
+  ThreadClock thr1(1);
+  ThreadClock thr2(2);
+  ThreadClock thr3(3);
+  SyncClock sync1;
+  SyncClock sync2;
+  thr1.set(1, 10);
+  thr1.set(5, 4);
+  thr1.ReleaseStore(&sync1);
+  thr1.set(1, 11);
+  thr1.ReleaseStore(&sync2);
+  CHECK_EQ(sync1.get(1), 10);
+  CHECK_EQ(sync2.get(1), 11);
+  CHECK_EQ(sync1.get(5), 4);
+  CHECK_EQ(sync2.get(5), 4);
+  thr2.set(2, 1);
+  thr2.acquire(&sync1);
+  CHECK_EQ(thr2.get(1), 10);
+  CHECK_EQ(thr2.get(5), 4);
+  thr2.acquire(&sync2);
+  CHECK_EQ(thr2.get(1), 11);
+  // Modification of one clock must not affect the other.
+  thr3.set(3, 7);
+  thr3.release(&sync2);
+  CHECK_EQ(sync2.get(3), 7);
+  CHECK_EQ(sync2.get(1), 11);
+  CHECK_EQ(sync1.size(), 6);
+  CHECK_EQ(sync1.get(3), 0);
+  thr2.acquire(&sync2);
+  CHECK_EQ(thr2.get(3), 7);
+  // After an acquire the next release-store must take a new snapshot.
+  thr1.acquire(&sync2);
+  thr1.set(1, 12);
+  thr1.ReleaseStore(&sync1);
+  CHECK_EQ(sync1.get(3), 7);
+  CHECK_EQ(sync1.get(1), 12);
+  sync1.Reset();
+  CHECK_EQ(sync1.size(), 0);
+}
+
+TEST(Clock, ReusedTid) {
+  ScopedInRtl in_rtl;
+  SyncClock sync;
+  {
+    ThreadClock thr1(1);
+    ThreadClock thr2(2);
+    thr2.set(2, 1);
+    thr2.acquire(&sync);
+    thr1.set(1, 1);
+    thr1.release(&sync);
+    thr2.acquire(&sync);
+    CHECK_EQ(thr2.get(1), 1);
+  }
+  {
+    ThreadClock thr3(3);
+    thr3.set(3, 1);
+    thr3.set(5, 2);
+    thr3.release(&sync);
+    // A new thread with the same tid must not inherit the previous
+    // thread's knowledge about sync.
+    ThreadClock thr2(2, 1);
+    thr2.set(2, 2);
+    thr2.acquire(&sync);
+    CHECK_EQ(thr2.get(1), 1);
+    CHECK_EQ(thr2.get(3), 1);
+    CHECK_EQ(thr2.get(5), 2);
+  }
+}
+
+TEST(Clock, ClearForReuse) {
+  ScopedInRtl in_rtl;
+  // Too large for internal_alloc(). The mapping is zeroed, as the memory of
+  // a new thread state.
+  void *mem = MmapOrDie(sizeof(ThreadClock), "ThreadClock");
+  ThreadClock *thr = new(mem) ThreadClock(1, 0, /*zeroed=*/ true);
+  ThreadClock thr2(2);
+  SyncClock sync;
+  thr2.set(2, 5);
+  thr2.set(100, 7);
+  thr2.release(&sync);
+  thr->set(1, 3);
+  thr->acquire(&sync);
+  CHECK_EQ(thr->get(100), 7);
+  thr->ClearForReuse();
+  thr->~ThreadClock();
+  // The memory can be reused for a clock that does not clear it.
+  thr = new(mem) ThreadClock(1, 1, /*zeroed=*/ true);
+  CHECK_EQ(thr->size(), 0);
+  for (unsigned i = 0; i < kMaxTidInClock; i++)
+    CHECK_EQ(thr->get(i), 0);
+  thr->~ThreadClock();
+  UnmapOrDie(mem, sizeof(ThreadClock));
+}
+
+TEST(Clock, Barrier) {
+  ScopedInRtl in_rtl;
+  const unsigned kThreads = 5;
+  ThreadClock *thr[kThreads];
+  for (unsigned i = 0; i < kThreads; i++)
+    thr[i] = new ThreadClock(i);
+  ThreadClock other(kThreads);
+  SyncClock sync;
+  for (unsigned round = 1; round <= 4; round++) {
+    for (unsigned i = 0; i < kThreads; i++) {
+      thr[i]->set(i, round * 10 + i);
+      if (round == 1)
+        thr[i]->release(&sync);
+      else
+        thr[i]->ReleaseOwnEntry(&sync);
+      CHECK_EQ(sync.get(i), round * 10 + i);
+    }
+    // A thread that acquired sync in the previous round must see
+    // all the own-entry updates, more of them than there are dirty slots.
+    other.acquire(&sync);
+    for (unsigned i = 0; i < kThreads; i++) {
+      CHECK_EQ(other.get(i), round * 10 + i);
+      thr[i]->acquire(&sync);
+    }
+    for (unsigned i = 0; i < kThreads; i++) {
+      for (unsigned j = 0; j < kThreads; j++)
+        CHECK_EQ(thr[i]->get(j), round * 10 + j);
+    }
+  }
+  for (unsigned i = 0; i < kThreads; i++)
+    delete thr[i];
+}
+
+// Compares the clocks with a straightforward vector clock implementation
+// on random sequences of operations.
+TEST(Clock, Fuzzer) {
+  ScopedInRtl in_rtl;
+  const int kThreads = 8;
+  const int kClocks = 4;
+  const int kMaxEpoch = 1 << 20;
+  u64 ref_thr[kThreads][kThreads] = {};
+  u64 ref_sync[kClocks][kThreads] = {};
+  u64 epoch[kThreads] = {};
+  int reuse[kThreads] = {};
+  ThreadClock *thr[kThreads];
+  SyncClock sync[kClocks];
+  unsigned rnd = 0;
+  for (int i = 0; i < kThreads; i++)
+    thr[i] = new ThreadClock(i);
+  for (int iter = 0; iter < 100000; iter++) {
+    rnd = rnd * 1103515245 + 12345;
+    int tid = (rnd >> 8) % kThreads;
+    int sid = (rnd >> 16) % kClocks;
+    int op = (rnd >> 24) % 7;
+    u64 *rt = ref_thr[tid];
+    u64 *rs = ref_sync[sid];
+    switch (op) {
+    case 0:
+      CHECK_LT(epoch[tid], kMaxEpoch);
+      rt[tid] = ++epoch[tid];
+      thr[tid]->set(tid, rt[tid]);
+      break;
+    case 1:
+      for (int i = 0; i < kThreads; i++)
+        rt[i] = max(rt[i], rs[i]);
+      thr[tid]->acquire(&sync[sid]);
+      break;
+    case 2:
+      for (int i = 0; i < kThreads; i++)
+        rs[i] = max(rt[i], rs[i]);
+      thr[tid]->release(&sync[sid]);
+      break;
+    case 3:
+      for (int i = 0; i < kThreads; i++)
+        rs[i] = rt[i];
+      thr[tid]->ReleaseStore(&sync[sid]);
+      break;
+    case 4:
+      for (int i = 0; i < kThreads; i++)
+        rs[i] = rt[i] = max(rt[i], rs[i]);
+      thr[tid]->acq_rel(&sync[sid]);
+      break;
+    case 5:
+      if ((rnd & 15) == 0) {
+        for (int i = 0; i < kThreads; i++)
+          rs[i] = 0;
+        sync[sid].Reset();
+      }
+      break;
+    case 6:
+      if ((rnd & 31) == 0) {
+        // The thread exits, a new thread gets the same tid.
+        delete thr[tid];
+        thr[tid] = new ThreadClock(tid, ++reuse[tid]);
+        for (int i = 0; i < kThreads; i++)
+          rt[i] = 0;
+        rt[tid] = ++epoch[tid];
+        thr[tid]->set(tid, rt[tid]);
+      }
+      break;
+    }
+    for (int i = 0; i < kThreads; i++)
+      CHECK_EQ(thr[tid]->get(i), rt[i]);
+    for (int i = 0; i < kThreads; i++)
+      CHECK_EQ(i < (int)sync[sid].size() ? sync[sid].get(i) : 0, rs[i]);
+  }
+  for (int i = 0; i < kThreads; i++)
+    delete thr[i];
+}
+
 }  // namespace __tsan
@@ -35,4 +35,44 @@ TEST(Flags, DefaultValues) {
   EXPECT_EQ(true, f.enable_annotations);
 }
 
+TEST(Flags, HistorySize) {
+  ScopedInRtl in_rtl;
+  Flags f;
+
+  InitializeFlags(&f, "history_size=0");
+  EXPECT_EQ(0, f.history_size);
+  InitializeFlags(&f, "history_size=7");
+  EXPECT_EQ(7, f.history_size);
+}
+
+TEST(Flags, StatsSampleRate) {
+  ScopedInRtl in_rtl;
+  Flags f;
+
+  InitializeFlags(&f, "");
+  EXPECT_EQ(0, f.stats_sample_rate);
+  InitializeFlags(&f, "stats_sample_rate=1000");
+  EXPECT_EQ(1000, f.stats_sample_rate);
+}
+
+TEST(Flags, AccessSampleRate) {
+  ScopedInRtl in_rtl;
+  Flags f;
+
+  InitializeFlags(&f, "");
+  EXPECT_EQ(0, f.access_sample_rate);
+  InitializeFlags(&f, "access_sample_rate=100");
+  EXPECT_EQ(100, f.access_sample_rate);
+}
+
+TEST(Flags, RodataMmap) {
+  ScopedInRtl in_rtl;
+  Flags f;
+
+  InitializeFlags(&f, "");
+  EXPECT_TRUE(f.rodata_mmap);
+  InitializeFlags(&f, "rodata_mmap=0");
+  EXPECT_FALSE(f.rodata_mmap);
+}
+
 }  // namespace __tsan
@@ -44,6 +44,22 @@ TEST(Mman, Internal) {
   internal_free(p2);
 }
 
+TEST(Mman, InternalStats) {
+  ScopedInRtl in_rtl;
+  InternalAllocStat before[MBlockTypeCount];
+  GetInternalAllocStats(before);
+  void *p = internal_alloc(MBlockFD, 100);
+  void *p2 = internal_alloc(MBlockFD, 28);
+  InternalAllocStat after[MBlockTypeCount];
+  GetInternalAllocStats(after);
+  EXPECT_EQ(after[MBlockFD].count, before[MBlockFD].count + 2);
+  EXPECT_EQ(after[MBlockFD].size, before[MBlockFD].size + 128);
+  EXPECT_STREQ(MBlockTypeName(MBlockFD), "FD");
+  EXPECT_STREQ(MBlockTypeName(MBlockRestoreCache), "RestoreCache");
+  internal_free(p);
+  internal_free(p2);
+}
+
 TEST(Mman, User) {
   ScopedInRtl in_rtl;
   ThreadState *thr = cur_thread();
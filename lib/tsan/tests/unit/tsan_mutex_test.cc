@@ -113,6 +113,16 @@ TEST(Mutex, ReadWrite) {
     pthread_join(threads[i], 0);
 }
 
+TEST(Mutex, TicketWrite) {
+  TicketMutex mtx(MutexTypeAnnotations, StatMtxAnnotations);
+  TestData<TicketMutex> data(&mtx);
+  pthread_t threads[kThreads];
+  for (int i = 0; i < kThreads; i++)
+    pthread_create(&threads[i], 0, write_mutex_thread<TicketMutex>, &data);
+  for (int i = 0; i < kThreads; i++)
+    pthread_join(threads[i], 0);
+}
+
 TEST(Mutex, SpinWrite) {
   SpinMutex mtx;
   TestData<SpinMutex> data(&mtx);
@@ -19,9 +19,9 @@ static void Expect(const MutexSet &mset, uptr i, u64 id, bool write, u64 epoch,
     int count) {
   MutexSet::Desc d = mset.Get(i);
   EXPECT_EQ(id, d.id);
-  EXPECT_EQ(write, d.write);
-  EXPECT_EQ(epoch, d.epoch);
-  EXPECT_EQ(count, d.count);
+  EXPECT_EQ(write, (bool)d.write);
+  EXPECT_EQ(epoch, (u64)d.epoch);
+  EXPECT_EQ(count, (int)d.count);
 }
 
 TEST(MutexSet, Basic) {
@@ -124,4 +124,15 @@ TEST(MutexSet, Overflow) {
   }
 }
 
+TEST(MutexSet, ReverseOrder) {
+  MutexSet mset;
+  for (uptr i = 0; i < MutexSet::kMaxSize; i++)
+    mset.Add(i, i % 2, i + 1);
+  for (uptr i = MutexSet::kMaxSize; i-- > 0; ) {
+    Expect(mset, i, i, i % 2, i + 1, 1);
+    mset.Del(i, i % 2);
+    EXPECT_EQ(mset.Size(), i);
+  }
+}
+
 }  // namespace __tsan
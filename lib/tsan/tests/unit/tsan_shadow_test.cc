@@ -46,6 +46,15 @@ TEST(Shadow, FastState) {
   EXPECT_EQ(s.GetHistorySize(), 0);
 }
 
+TEST(Shadow, TracePos) {
+  FastState s(11, kTraceSize + 5);
+  for (int hs = 0; hs < 8; hs++) {
+    s.SetHistorySize(hs);
+    const u64 size = 1ull << (kTracePartSizeBits + hs + 1);
+    EXPECT_EQ((kTraceSize + 5) % size, s.GetTracePos());
+  }
+}
+
 TEST(Shadow, Mapping) {
   static int global;
   int stack;
@@ -0,0 +1,67 @@
+//===-- tsan_slab_test.cc -------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of ThreadSanitizer (TSan), a race detector.
+//
+//===----------------------------------------------------------------------===//
+#include "sanitizer_common/sanitizer_common.h"
+#include "tsan_slab.h"
+#include "gtest/gtest.h"
+
+namespace __tsan {
+
+TEST(Slab, AllocFree) {
+  const uptr kSize = 64 * 1024;
+  const uptr kObjSize = 32;
+  void *mem = MmapOrDie(kSize, "SlabTest");
+  SlabArena arena((uptr)mem, kSize, kObjSize);
+  SlabCache cache;
+  internal_memset(&cache, 0, sizeof(cache));
+
+  void *p[1000];
+  for (int i = 0; i < 1000; i++) {
+    p[i] = cache.Alloc(&arena);
+    ASSERT_NE(p[i], (void*)0);
+    EXPECT_GE((uptr)p[i], (uptr)mem);
+    EXPECT_LT((uptr)p[i], (uptr)mem + kSize);
+    EXPECT_EQ((uptr)p[i] % kObjSize, 0U);
+    internal_memset(p[i], 0xab, kObjSize);
+  }
+  EXPECT_GE(arena.AllocatedBytes(), 1000 * kObjSize);
+  for (int i = 0; i < 1000; i++)
+    cache.Free(&arena, p[i]);
+  cache.Drain(&arena);
+  EXPECT_EQ(arena.AllocatedBytes(), 0U);
+  uptr mapped = arena.MappedBytes();
+
+  // Freed objects are reused before new memory is carved.
+  for (int i = 0; i < 1000; i++)
+    p[i] = cache.Alloc(&arena);
+  EXPECT_EQ(arena.MappedBytes(), mapped);
+  for (int i = 0; i < 1000; i++)
+    cache.Free(&arena, p[i]);
+  cache.Drain(&arena);
+  UnmapOrDie(mem, kSize);
+}
+
+TEST(Slab, Exhausted) {
+  const uptr kSize = 4096;
+  const uptr kObjSize = 64;
+  void *mem = MmapOrDie(kSize, "SlabTest");
+  SlabArena arena((uptr)mem, kSize, kObjSize);
+  SlabCache cache;
+  internal_memset(&cache, 0, sizeof(cache));
+  for (uptr i = 0; i < kSize / kObjSize; i++)
+    EXPECT_NE(cache.Alloc(&arena), (void*)0);
+  EXPECT_EQ(cache.Alloc(&arena), (void*)0);
+  EXPECT_EQ(arena.MappedBytes(), kSize);
+  UnmapOrDie(mem, kSize);
+}
+
+}  // namespace __tsan
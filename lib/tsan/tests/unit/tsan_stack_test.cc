@@ -18,7 +18,7 @@
 namespace __tsan {
 
 static void TestStackTrace(StackTrace *trace) {
-  ThreadState thr(0, 0, 0, 0, 0, 0, 0, 0);
+  ThreadState thr(0, 0, 0, 0, 0, 0, 0, 0, 0);
 
   trace->ObtainCurrent(&thr, 0);
   EXPECT_EQ(trace->Size(), (uptr)0);
@@ -60,7 +60,7 @@ TEST(StackTrace, StaticTrim) {
   ScopedInRtl in_rtl;
   uptr buf[2];
   StackTrace trace(buf, 2);
-  ThreadState thr(0, 0, 0, 0, 0, 0, 0, 0);
+  ThreadState thr(0, 0, 0, 0, 0, 0, 0, 0, 0);
 
   *thr.shadow_stack_pos++ = 100;
   *thr.shadow_stack_pos++ = 101;
@@ -15,6 +15,7 @@
 #include "tsan_mman.h"
 #include "gtest/gtest.h"
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <map>
@@ -48,7 +49,7 @@ TEST(Sync, Table) {
       if (v) {
         EXPECT_EQ(v->addr, addr);
         golden[addr] = 0;
-        DestroyAndFree(v);
+        tab.Destroy(v);
       }
     }
   }
@@ -58,8 +59,84 @@ TEST(Sync, Table) {
     SyncVar *v = tab.GetAndRemove(thr, pc, addr);
     EXPECT_EQ(v, golden[addr]);
     EXPECT_EQ(v->addr, addr);
-    DestroyAndFree(v);
+    tab.Destroy(v);
   }
 }
 
+TEST(Sync, TableRemoveRange) {
+  ScopedInRtl in_rtl;
+  ThreadState *thr = cur_thread();
+  uptr pc = 0;
+
+  SyncTab tab;
+  const uptr kBeg = 0x1000;
+  const uptr kEnd = 0x3000;
+  for (uptr addr = kBeg; addr < kEnd; addr += 8)
+    tab.GetOrCreateAndLock(thr, pc, addr, true)->mtx.Unlock();
+  uptr nsync = 0;
+  // Small ranges are looked up address by address.
+  tab.RemoveRange(thr, kBeg + 4, 16);
+  tab.GetMemoryConsumption(&nsync);
+  EXPECT_EQ(nsync, (kEnd - kBeg) / 8 - 2);
+  // Large ranges scan the table.
+  tab.RemoveRange(thr, kBeg, 0x1000);
+  tab.GetMemoryConsumption(&nsync);
+  EXPECT_EQ(nsync, (kEnd - kBeg) / 8 / 2);
+  for (uptr addr = kBeg; addr < kEnd; addr += 8) {
+    SyncVar *v = tab.GetIfExistsAndLock(addr, true);
+    EXPECT_EQ(v != 0, addr >= kBeg + 0x1000);
+    if (v)
+      v->mtx.Unlock();
+  }
+  tab.RemoveRange(thr, 0, kEnd);
+  tab.GetMemoryConsumption(&nsync);
+  EXPECT_EQ(nsync, 0U);
+}
+
+struct TableThreadArg {
+  SyncTab *tab;
+  unsigned seed;
+};
+
+static const uptr kTableThreadRange = 1000;
+
+static void *TableThread(void *p) {
+  TableThreadArg *arg = (TableThreadArg*)p;
+  ScopedInRtl in_rtl;
+  ThreadState *thr = cur_thread();
+  for (int i = 0; i < 100000; i++) {
+    uptr idx = rand_r(&arg->seed) % kTableThreadRange;
+    uptr addr = (idx + 1) * 8;
+    if (rand_r(&arg->seed) % 8) {
+      SyncVar *v = arg->tab->GetOrCreateAndLock(thr, 0, addr, true);
+      CHECK_EQ(v->addr, addr);
+      CHECK_EQ(v->tab_state, SyncVar::TabLinked);
+      v->mtx.Unlock();
+    } else {
+      SyncVar *v = arg->tab->GetAndRemove(thr, 0, addr);
+      if (v) {
+        CHECK_EQ(v->addr, addr);
+        arg->tab->Destroy(v);
+      }
+    }
+  }
+  return 0;
+}
+
+TEST(Sync, TableConcurrent) {
+  const int kThreads = 4;
+  SyncTab *tab = new SyncTab;
+  TableThreadArg args[kThreads];
+  pthread_t threads[kThreads];
+  for (int i = 0; i < kThreads; i++) {
+    args[i].tab = tab;
+    args[i].seed = i;
+    pthread_create(&threads[i], 0, TableThread, &args[i]);
+  }
+  for (int i = 0; i < kThreads; i++)
+    pthread_join(threads[i], 0);
+  ScopedInRtl in_rtl;
+  delete tab;
+}
+
 }  // namespace __tsan
@@ -0,0 +1,42 @@
+//===-- tsan_trace_test.cc ------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file is a part of ThreadSanitizer (TSan), a race detector.
+//
+//===----------------------------------------------------------------------===//
+#include "sanitizer_common/sanitizer_common.h"
+#include "tsan_trace.h"
+#include "gtest/gtest.h"
+
+namespace __tsan {
+
+TEST(Trace, LazyHeaders) {
+  void *mem = MmapOrDie(sizeof(Trace), "trace test");
+  Trace *trace = new(mem) Trace();
+  {
+    TicketLock l(&trace->mtx);
+    for (uptr i = 0; i < kTraceParts; i++)
+      EXPECT_EQ((TraceHeader*)0, trace->FindHeader(i));
+    TraceHeader *hdr = trace->GetHeader(kTraceParts - 1);
+    EXPECT_EQ(0U, hdr->stack0.Size());
+    EXPECT_EQ(0U, hdr->mset0.Size());
+    hdr->epoch0 = 42;
+    EXPECT_EQ(hdr, trace->FindHeader(kTraceParts - 1));
+    EXPECT_EQ(hdr, trace->GetHeader(kTraceParts - 1));
+    EXPECT_EQ(42U, hdr->epoch0);
+    EXPECT_EQ((TraceHeader*)0, trace->FindHeader(kTraceParts - 2));
+    EXPECT_EQ((TraceHeader*)0, trace->FindHeader(0));
+    trace->ResetHeaders();
+    EXPECT_EQ((TraceHeader*)0, trace->FindHeader(kTraceParts - 1));
+    EXPECT_EQ(0U, trace->GetHeader(kTraceParts - 1)->epoch0);
+  }
+  UnmapOrDie(mem, sizeof(Trace));
+}
+
+}  // namespace __tsan
@@ -8,6 +8,11 @@ void overflow() {
   --i;
 }
 
+int cast(double d) {
+  // This check has no static source location, it is deduplicated by pc.
+  return d;
+}
+
 int main() {
   // CHECK: Start
   fprintf(stderr, "Start\n");
@@ -19,6 +24,14 @@ int main() {
   overflow();
   overflow();
 
+  // CHECK: Cast
+  fprintf(stderr, "Cast\n");
+
+  // CHECK: runtime error: value 1e+10 is outside the range
+  // CHECK-NOT: runtime error
+  for (int i = 0; i < 3; i++)
+    cast(1e10);
+
   // CHECK: End
   fprintf(stderr, "End\n");
   return 0;
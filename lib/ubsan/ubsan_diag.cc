@@ -12,6 +12,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "ubsan_diag.h"
+#include "sanitizer_common/sanitizer_atomic.h"
 #include "sanitizer_common/sanitizer_common.h"
 #include "sanitizer_common/sanitizer_libc.h"
 #include "sanitizer_common/sanitizer_report_decorator.h"
@@ -37,6 +38,26 @@ Location __ubsan::getCallerLocation(uptr CallerLoc) {
   return SourceLocation(Info.file, Info.line, Info.column);
 }
 
+/// Caller pcs of the reported checks. Probed linearly, 0 is an empty slot.
+static const uptr ReportedCallersSize = 1024;
+static atomic_uintptr_t ReportedCallers[ReportedCallersSize];
+
+bool __ubsan::acquireCallerLocation(uptr CallerLoc) {
+  uptr Start = (CallerLoc >> 2) % ReportedCallersSize;
+  for (uptr I = 0; I != ReportedCallersSize; ++I) {
+    atomic_uintptr_t *Slot =
+        &ReportedCallers[(Start + I) % ReportedCallersSize];
+    uptr Cmp = atomic_load(Slot, memory_order_relaxed);
+    if (!Cmp && atomic_compare_exchange_strong(Slot, &Cmp, CallerLoc,
+                                               memory_order_relaxed))
+      return true;
+    if (Cmp == CallerLoc)
+      return false;
+  }
+  // The table is full: report, but don't remember.
+  return true;
+}
+
 Diag &Diag::operator<<(const TypeDescriptor &V) {
   return AddArg(V.getTypeName());
 }
@@ -238,6 +259,7 @@ static void renderMemorySnippet(const __sanitizer::AnsiColorDecorator &Decor,
 Diag::~Diag() {
   __sanitizer::AnsiColorDecorator Decor(PrintsToTty());
   SpinMutexLock l(&CommonSanitizerReportMutex);
+  ScopedReportBuffer report_buffer;
   Printf(Decor.Bold());
 
   renderLocation(Loc);
@@ -80,6 +80,11 @@ public:
 /// an invalid location or a module location for the caller.
 Location getCallerLocation(uptr CallerLoc = GET_CALLER_PC());
 
+/// \brief Deduplicate the reports of checks which have no SourceLocation.
+/// Like SourceLocation::acquire(), returns \c true only for the first call
+/// with a given caller pc.
+bool acquireCallerLocation(uptr CallerLoc);
+
 /// A diagnostic severity level.
 enum DiagLevel {
   DL_Error, ///< An error.
@@ -27,14 +27,15 @@ namespace __ubsan {
 }
 
 static void handleTypeMismatchImpl(TypeMismatchData *Data, ValueHandle Pointer,
-                                   Location FallbackLoc) {
+                                   uptr CallerLoc) {
   Location Loc = Data->Loc.acquire();
 
   // Use the SourceLocation from Data to track deduplication, even if 'invalid'
   if (Loc.getSourceLocation().isDisabled())
     return;
+  // Only symbolize the caller once we know the report is not a duplicate.
   if (Data->Loc.isInvalid())
-    Loc = FallbackLoc;
+    Loc = getCallerLocation(CallerLoc);
 
   if (!Pointer)
     Diag(Loc, DL_Error, "%0 null pointer of type %1")
@@ -53,11 +54,11 @@ static void handleTypeMismatchImpl(TypeMismatchData *Data, ValueHandle Pointer,
 }
 void __ubsan::__ubsan_handle_type_mismatch(TypeMismatchData *Data,
                                            ValueHandle Pointer) {
-  handleTypeMismatchImpl(Data, Pointer, getCallerLocation());
+  handleTypeMismatchImpl(Data, Pointer, GET_CALLER_PC());
 }
 void __ubsan::__ubsan_handle_type_mismatch_abort(TypeMismatchData *Data,
                                                  ValueHandle Pointer) {
-  handleTypeMismatchImpl(Data, Pointer, getCallerLocation());
+  handleTypeMismatchImpl(Data, Pointer, GET_CALLER_PC());
   Die();
 }
 
@@ -230,8 +231,11 @@ void __ubsan::__ubsan_handle_vla_bound_not_positive_abort(VLABoundData *Data,
 
 void __ubsan::__ubsan_handle_float_cast_overflow(FloatCastOverflowData *Data,
                                                  ValueHandle From) {
-  // TODO: Add deduplication once a SourceLocation is generated for this check.
-  Diag(getCallerLocation(), DL_Error,
+  // This check has no SourceLocation, it is deduplicated by the caller pc.
+  uptr CallerLoc = GET_CALLER_PC();
+  if (!acquireCallerLocation(CallerLoc))
+    return;
+  Diag(getCallerLocation(CallerLoc), DL_Error,
        "value %0 is outside the range of representable values of type %2")
     << Value(Data->FromType, From) << Data->FromType << Data->ToType;
 }
@@ -246,8 +250,11 @@ void __ubsan::__ubsan_handle_float_cast_overflow_abort(
 
 void __ubsan::__ubsan_handle_load_invalid_value(InvalidValueData *Data,
                                                 ValueHandle Val) {
-  // TODO: Add deduplication once a SourceLocation is generated for this check.
-  Diag(getCallerLocation(), DL_Error,
+  // This check has no SourceLocation, it is deduplicated by the caller pc.
+  uptr CallerLoc = GET_CALLER_PC();
+  if (!acquireCallerLocation(CallerLoc))
+    return;
+  Diag(getCallerLocation(CallerLoc), DL_Error,
        "load of value %0, which is not a valid value for type %1")
     << Value(Data->Type, Val) << Data->Type;
 }
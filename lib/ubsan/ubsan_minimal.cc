@@ -0,0 +1,180 @@
+//===-- ubsan_minimal.cc --------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Minimal UBSan runtime, a drop-in replacement for the handlers library
+// (clang_rt.ubsan). The recoverable handlers only count the failed checks per
+// check kind and call site, without rendering diagnostics or symbolizing.
+// The counters are printed at exit, or when the program calls
+// __ubsan_minimal_print_counters(). The call sites are printed as module and
+// offset, so that the counts from many processes can be aggregated.
+//
+// The handlers for the checks which can't be recovered from print a one-line
+// report and die.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ubsan_handlers.h"
+
+#include "sanitizer_common/sanitizer_atomic.h"
+#include "sanitizer_common/sanitizer_common.h"
+#include "sanitizer_common/sanitizer_procmaps.h"
+#include "sanitizer_common/sanitizer_stacktrace.h"
+
+using namespace __sanitizer;
+using namespace __ubsan;
+
+extern "C" {
+/// \brief Print the check counters collected so far.
+SANITIZER_INTERFACE_ATTRIBUTE
+void __ubsan_minimal_print_counters();
+}
+
+namespace {
+
+enum CheckKind {
+  CK_TypeMismatch,
+  CK_AddOverflow,
+  CK_SubOverflow,
+  CK_MulOverflow,
+  CK_NegateOverflow,
+  CK_DivremOverflow,
+  CK_ShiftOutOfBounds,
+  CK_OutOfBounds,
+  CK_BuiltinUnreachable,
+  CK_MissingReturn,
+  CK_VLABoundNotPositive,
+  CK_FloatCastOverflow,
+  CK_LoadInvalidValue,
+  CK_Last
+};
+
+const char *const CheckKindNames[CK_Last] = {
+  "type-mismatch", "add-overflow", "sub-overflow", "mul-overflow",
+  "negate-overflow", "divrem-overflow", "shift-out-of-bounds",
+  "out-of-bounds", "builtin-unreachable", "missing-return",
+  "vla-bound-not-positive", "float-cast-overflow", "load-invalid-value"
+};
+
+/// A call site counter. Key is (pc << 5 | kind), 0 marks an empty counter.
+struct SiteCounter {
+  atomic_uint64_t Key;
+  atomic_uint64_t Count;
+};
+
+}
+
+/// Open addressing hash table of the counters. It lives in .bss, so only the
+/// pages holding the sites which failed a check are ever touched.
+static const uptr SiteCountersSize = 1 << 14;
+static SiteCounter SiteCounters[SiteCountersSize];
+/// The failed checks which did not fit in the table.
+static atomic_uint64_t DroppedCount;
+static atomic_uint8_t AtexitInstalled;
+
+static void installAtexit() {
+  if (atomic_load(&AtexitInstalled, memory_order_relaxed) ||
+      atomic_exchange(&AtexitInstalled, 1, memory_order_relaxed))
+    return;
+  Atexit(__ubsan_minimal_print_counters);
+}
+
+static void countCheck(CheckKind Kind, uptr CallerLoc) {
+  u64 Key = ((u64)CallerLoc << 5) | Kind;
+  uptr Start = (uptr)((Key * 0x9E3779B97F4A7C15ULL) >> 40) % SiteCountersSize;
+  for (uptr I = 0; I != SiteCountersSize; ++I) {
+    SiteCounter *C = &SiteCounters[(Start + I) % SiteCountersSize];
+    u64 Cmp = atomic_load(&C->Key, memory_order_relaxed);
+    if (!Cmp && atomic_compare_exchange_strong(&C->Key, &Cmp, Key,
+                                               memory_order_relaxed)) {
+      installAtexit();
+      Cmp = Key;
+    }
+    if (Cmp == Key) {
+      atomic_fetch_add(&C->Count, 1, memory_order_relaxed);
+      return;
+    }
+  }
+  atomic_fetch_add(&DroppedCount, 1, memory_order_relaxed);
+}
+
+static void printSite(MemoryMappingLayout *Maps, uptr CallerLoc,
+                      const char *What, u64 Count) {
+  uptr PC = StackTrace::GetPreviousInstructionPc(CallerLoc);
+  char Module[4096];
+  uptr Offset;
+  if (Maps->GetObjectNameAndOffset(PC, &Offset, Module, sizeof(Module), 0))
+    Printf("ubsan: %s at %s+0x%zx: %llu\n", What, Module,
+           Offset, Count);
+  else
+    Printf("ubsan: %s at %p: %llu\n", What, (void*)PC, Count);
+}
+
+void __ubsan_minimal_print_counters() {
+  MemoryMappingLayout Maps(/*cache_enabled*/true);
+  for (uptr I = 0; I != SiteCountersSize; ++I) {
+    u64 Key = atomic_load(&SiteCounters[I].Key, memory_order_relaxed);
+    if (!Key)
+      continue;
+    printSite(&Maps, (uptr)(Key >> 5), CheckKindNames[Key & 31],
+              atomic_load(&SiteCounters[I].Count, memory_order_relaxed));
+  }
+  u64 Dropped = atomic_load(&DroppedCount, memory_order_relaxed);
+  if (Dropped)
+    Printf("ubsan: %llu failed checks at untracked sites\n", Dropped);
+}
+
+static void NORETURN reportAndDie(CheckKind Kind, uptr CallerLoc) {
+  MemoryMappingLayout Maps(/*cache_enabled*/true);
+  printSite(&Maps, CallerLoc, CheckKindNames[Kind], 1);
+  Die();
+}
+
+#define RECOVERABLE_HANDLER(checkname, kind, ...)                              \
+  void __ubsan::__ubsan_handle_##checkname(__VA_ARGS__) {                      \
+    countCheck(kind, GET_CALLER_PC());                                         \
+  }                                                                            \
+  void __ubsan::__ubsan_handle_##checkname##_abort(__VA_ARGS__) {              \
+    reportAndDie(kind, GET_CALLER_PC());                                       \
+  }
+
+RECOVERABLE_HANDLER(type_mismatch, CK_TypeMismatch,
+                    TypeMismatchData *Data, ValueHandle Pointer)
+RECOVERABLE_HANDLER(add_overflow, CK_AddOverflow,
+                    OverflowData *Data, ValueHandle LHS, ValueHandle RHS)
+RECOVERABLE_HANDLER(sub_overflow, CK_SubOverflow,
+                    OverflowData *Data, ValueHandle LHS, ValueHandle RHS)
+RECOVERABLE_HANDLER(mul_overflow, CK_MulOverflow,
+                    OverflowData *Data, ValueHandle LHS, ValueHandle RHS)
+RECOVERABLE_HANDLER(negate_overflow, CK_NegateOverflow,
+                    OverflowData *Data, ValueHandle OldVal)
+RECOVERABLE_HANDLER(divrem_overflow, CK_DivremOverflow,
+                    OverflowData *Data, ValueHandle LHS, ValueHandle RHS)
+RECOVERABLE_HANDLER(shift_out_of_bounds, CK_ShiftOutOfBounds,
+                    ShiftOutOfBoundsData *Data, ValueHandle LHS,
+                    ValueHandle RHS)
+RECOVERABLE_HANDLER(out_of_bounds, CK_OutOfBounds,
+                    OutOfBoundsData *Data, ValueHandle Index)
+RECOVERABLE_HANDLER(vla_bound_not_positive, CK_VLABoundNotPositive,
+                    VLABoundData *Data, ValueHandle Bound)
+// These two checks have no SourceLocation, which does not matter here: all
+// the sites are keyed by the caller pc.
+RECOVERABLE_HANDLER(float_cast_overflow, CK_FloatCastOverflow,
+                    FloatCastOverflowData *Data, ValueHandle From)
+RECOVERABLE_HANDLER(load_invalid_value, CK_LoadInvalidValue,
+                    InvalidValueData *Data, ValueHandle Val)
+
+#undef RECOVERABLE_HANDLER
+
+void __ubsan::__ubsan_handle_builtin_unreachable(UnreachableData *Data) {
+  reportAndDie(CK_BuiltinUnreachable, GET_CALLER_PC());
+}
+
+void __ubsan::__ubsan_handle_missing_return(UnreachableData *Data) {
+  reportAndDie(CK_MissingReturn, GET_CALLER_PC());
+}
@@ -15,6 +15,7 @@
 
 #include "ubsan_type_hash.h"
 
+#include "sanitizer_common/sanitizer_atomic.h"
 #include "sanitizer_common/sanitizer_common.h"
 
 // The following are intended to be binary compatible with the definitions
@@ -72,7 +73,7 @@ public:
 
 namespace abi = __cxxabiv1;
 
-// We implement a simple two-level cache for type-checking results. For each
+// We implement a simple three-level cache for type-checking results. For each
 // (vptr,type) pair, a hash is computed. This hash is assumed to be globally
 // unique; if it collides, we will get false negatives, but:
 //  * such a collision would have to occur on the *first* bad access,
@@ -82,43 +83,123 @@ namespace abi = __cxxabiv1;
 //    give better coverage.
 //
 // The first caching layer is a small hash table with no chaining; buckets are
-// reused as needed. The second caching layer is a large hash table with open
-// chaining. We can freely evict from either layer since this is just a cache.
+// reused as needed. It is checked inline by the instrumented code. The second
+// layer is a per-thread table of the same kind, so the hashes evicted from the
+// first layer by other threads are found without touching shared cache lines.
+// The third caching layer is a large hash table with open addressing, shared
+// by all threads. We can freely evict from any layer since this is just a
+// cache.
 //
-// FIXME: Make these hash table accesses thread-safe. The races here are benign
-//        (worst-case, we could miss a bug or see a slowdown) but we should
-//        avoid upsetting race detectors.
+// FIXME: The first layer is read by the instrumented code without atomics.
+//        The races there are benign (worst-case, we could miss a bug or see a
+//        slowdown) but we should avoid upsetting race detectors.
+
+static const unsigned HashTableSize = 65537;
+static atomic_uintptr_t __ubsan_vptr_hash_set[HashTableSize];
+static const int HashTableProbes = 5;
+
+/// State of the generator picking the entries to evict from the shared table.
+static THREADLOCAL u32 EvictionRandomState;
+
+static u32 getEvictionRandom(__ubsan::HashValue V) {
+  u32 X = EvictionRandomState;
+  if (!X)
+    X = (u32)V | 1;
+  // xorshift32.
+  X ^= X << 13;
+  X ^= X >> 17;
+  X ^= X << 5;
+  EvictionRandomState = X;
+  return X;
+}
 
 /// Find a bucket to store the given hash value in.
-static __ubsan::HashValue *getTypeCacheHashTableBucket(__ubsan::HashValue V) {
-  static const unsigned HashTableSize = 65537;
-  static __ubsan::HashValue __ubsan_vptr_hash_set[HashTableSize] = { 1 };
-
-  unsigned Probe = V & 65535;
-  for (int Tries = 5; Tries; --Tries) {
-    if (!__ubsan_vptr_hash_set[Probe] || __ubsan_vptr_hash_set[Probe] == V)
+static atomic_uintptr_t *getTypeCacheHashTableBucket(__ubsan::HashValue V) {
+  const unsigned First = V & 65535;
+  const unsigned Step = ((V >> 16) & 65535) + 1;
+  unsigned Probe = First;
+  for (int Tries = HashTableProbes; Tries; --Tries) {
+    __ubsan::HashValue H =
+        atomic_load(&__ubsan_vptr_hash_set[Probe], memory_order_relaxed);
+    if (!H || H == V)
       return &__ubsan_vptr_hash_set[Probe];
-    Probe += ((V >> 16) & 65535) + 1;
+    Probe += Step;
     if (Probe >= HashTableSize)
       Probe -= HashTableSize;
   }
-  // FIXME: Pick a random entry from the probe sequence to evict rather than
-  //        just taking the first.
-  return &__ubsan_vptr_hash_set[V];
+  // Evict a random entry from the probe sequence, so that a few hot hashes
+  // sharing a sequence do not keep evicting each other from the same bucket.
+  Probe = First;
+  for (u32 Victim = getEvictionRandom(V) % HashTableProbes; Victim; --Victim) {
+    Probe += Step;
+    if (Probe >= HashTableSize)
+      Probe -= HashTableSize;
+  }
+  return &__ubsan_vptr_hash_set[Probe];
 }
 
 /// A cache of recently-checked hashes. Mini hash table with "random" evictions.
 __ubsan::HashValue
 __ubsan::__ubsan_vptr_type_cache[__ubsan::VptrTypeCacheSize] = { 1 };
 
+/// The per-thread cache of recently-checked hashes.
+static const unsigned ThreadTypeCacheSize = 256;
+static THREADLOCAL __ubsan::HashValue ThreadTypeCache[ThreadTypeCacheSize];
+
+/// Record a successful check in the first caching layer. The bucket is not
+/// written if it already holds the hash, to keep the cache line shared.
+static void updateVptrTypeCache(__ubsan::HashValue Hash) {
+  __ubsan::HashValue *Cached =
+      &__ubsan::__ubsan_vptr_type_cache[Hash % __ubsan::VptrTypeCacheSize];
+  if (*Cached != Hash)
+    *Cached = Hash;
+}
+
+/// A memo of isDerivedFromAtOffset results, shared by all threads. An entry
+/// holds the hash of a (Derived, Base, Offset) query with the result in the
+/// low bit, 0 marks an empty entry. Like the type cache, the memo relies on
+/// the hashes being unique, and entries are evicted freely.
+static const unsigned DerivedMemoSize = 4096;
+static atomic_uint64_t DerivedMemo[DerivedMemoSize];
+
+static u64 hashDerivedQuery(const abi::__class_type_info *Derived,
+                            const abi::__class_type_info *Base, sptr Offset) {
+  u64 H = (u64)(uptr)Derived * 0x9E3779B97F4A7C15ULL;
+  H = (H ^ (H >> 29) ^ (u64)(uptr)Base) * 0xC2B2AE3D27D4EB4FULL;
+  H = (H ^ (H >> 32) ^ (u64)Offset) * 0x165667B19E3779F9ULL;
+  H ^= H >> 32;
+  // Leave the low bit for the result, and never produce an empty entry.
+  return (H << 1) | 2;
+}
+
+static bool computeIsDerivedFromAtOffset(const abi::__class_type_info *Derived,
+                                         const abi::__class_type_info *Base,
+                                         sptr Offset);
+
 /// \brief Determine whether \p Derived has a \p Base base class subobject at
 /// offset \p Offset.
+///
+/// The results are memoized for every base visited, so each subobject of a
+/// diamond-shaped hierarchy is walked once instead of once per path to it.
 static bool isDerivedFromAtOffset(const abi::__class_type_info *Derived,
                                   const abi::__class_type_info *Base,
                                   sptr Offset) {
   if (Derived->__type_name == Base->__type_name)
     return Offset == 0;
 
+  u64 H = hashDerivedQuery(Derived, Base, Offset);
+  atomic_uint64_t *Entry = &DerivedMemo[(H >> 1) % DerivedMemoSize];
+  u64 E = atomic_load(Entry, memory_order_relaxed);
+  if ((E & ~1ULL) == H)
+    return E & 1;
+  bool Result = computeIsDerivedFromAtOffset(Derived, Base, Offset);
+  atomic_store(Entry, H | Result, memory_order_relaxed);
+  return Result;
+}
+
+static bool computeIsDerivedFromAtOffset(const abi::__class_type_info *Derived,
+                                         const abi::__class_type_info *Base,
+                                         sptr Offset) {
   if (const abi::__si_class_type_info *SI =
         dynamic_cast<const abi::__si_class_type_info*>(Derived))
     return isDerivedFromAtOffset(SI->__base_type, Base, Offset);
@@ -210,9 +291,15 @@ bool __ubsan::checkDynamicType(void *Object, void *Type, HashValue Hash) {
   // FIXME: Perform these checks more cautiously.
 
   // Check whether this is something we've evicted from the cache.
-  HashValue *Bucket = getTypeCacheHashTableBucket(Hash);
-  if (*Bucket == Hash) {
-    __ubsan_vptr_type_cache[Hash % VptrTypeCacheSize] = Hash;
+  HashValue *ThreadBucket = &ThreadTypeCache[Hash % ThreadTypeCacheSize];
+  if (*ThreadBucket == Hash) {
+    updateVptrTypeCache(Hash);
+    return true;
+  }
+  atomic_uintptr_t *Bucket = getTypeCacheHashTableBucket(Hash);
+  if (atomic_load(Bucket, memory_order_relaxed) == Hash) {
+    *ThreadBucket = Hash;
+    updateVptrTypeCache(Hash);
     return true;
   }
 
@@ -231,8 +318,9 @@ bool __ubsan::checkDynamicType(void *Object, void *Type, HashValue Hash) {
     return false;
 
   // Success. Cache this result.
-  __ubsan_vptr_type_cache[Hash % VptrTypeCacheSize] = Hash;
-  *Bucket = Hash;
+  updateVptrTypeCache(Hash);
+  *ThreadBucket = Hash;
+  atomic_store(Bucket, Hash, memory_order_relaxed);
   return true;
 }
 
@@ -0,0 +1,123 @@
+/* ===-- udivdi3_by_invariant.c - Division by an invariant divisor --------===
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is dual licensed under the MIT and the University of Illinois Open
+ * Source Licenses. See LICENSE.TXT for details.
+ *
+ * ===----------------------------------------------------------------------===
+ *
+ * This file implements __udivdi3_invariant_init, __udivdi3_by_invariant and
+ * __umoddi3_by_invariant for the compiler_rt library.
+ *
+ * Callers which divide many values by the same divisor (hashing modulo a
+ * table size, unit conversions) pay for one slow division in the init
+ * function and then divide with a 64x64 -> high 64 multiply and a shift.
+ * On 32-bit targets that is four 32-bit multiplies instead of a call into
+ * __udivmoddi4.
+ *
+ * The method is the round-up variant of Granlund and Montgomery, "Division
+ * by Invariant Integers using Multiplication": with p = floor(log2(d)), the
+ * magic number is ceil(2^(64 + p) / d) when that fits in 64 bits, and
+ * otherwise the low 64 bits of ceil(2^(65 + p) / d) with an extra add-back
+ * step.
+ *
+ * ===----------------------------------------------------------------------===
+ */
+
+#include "udivdi3_by_invariant.h"
+
+/* Returns: the high 64 bits of a * b */
+
+static inline du_int
+mulhi(du_int a, du_int b)
+{
+#if __SIZEOF_INT128__
+    return (du_int)(((unsigned __int128)a * b) >> 64);
+#else
+    const du_int a_lo = (su_int)a;
+    const du_int a_hi = a >> 32;
+    const du_int b_lo = (su_int)b;
+    const du_int b_hi = b >> 32;
+    const du_int lolo = a_lo * b_lo;
+    const du_int lohi = a_lo * b_hi;
+    const du_int hilo = a_hi * b_lo;
+    const du_int mid = (lolo >> 32) + (su_int)lohi + (su_int)hilo;
+    return a_hi * b_hi + (lohi >> 32) + (hilo >> 32) + (mid >> 32);
+#endif
+}
+
+/* Returns: (hi:0) / d, *rem = (hi:0) % d
+ * Precondition: hi < d
+ *
+ * Only used by the init function, so this is a plain restoring division.
+ */
+
+static du_int
+udiv128by64_hi(du_int hi, du_int d, du_int* rem)
+{
+    du_int q = 0;
+    int i;
+    for (i = 0; i < 64; ++i)
+    {
+        const du_int top = hi >> 63;
+        hi <<= 1;
+        q <<= 1;
+        if (top || hi >= d)
+        {
+            hi -= d;
+            q |= 1;
+        }
+    }
+    *rem = hi;
+    return q;
+}
+
+COMPILER_RT_ABI void
+__udivdi3_invariant_init(udivdi3_invariant* inv, du_int d)
+{
+    const su_int p = 63 - __builtin_clzll(d);
+    inv->divisor = d;
+    inv->shift = p;
+    inv->add = 0;
+    if ((d & (d - 1)) == 0)
+    {
+        /* Powers of two are a plain shift. */
+        inv->magic = 0;
+        return;
+    }
+    du_int rem;
+    du_int m = udiv128by64_hi((du_int)1 << p, d, &rem);
+    if (d - rem < ((du_int)1 << p))
+    {
+        /* The error of rounding up is small enough for 2^(64 + p). */
+        inv->magic = m + 1;
+        return;
+    }
+    /* Use 2^(65 + p); the 65th bit of the magic number is implicit and is
+     * added back by __udivdi3_by_invariant.
+     */
+    const du_int twice_rem = rem + rem;
+    m += m;
+    if (twice_rem >= d || twice_rem < rem)
+        m += 1;
+    inv->magic = m + 1;
+    inv->add = 1;
+}
+
+COMPILER_RT_ABI du_int
+__udivdi3_by_invariant(du_int a, const udivdi3_invariant* inv)
+{
+    if (inv->magic == 0)
+        return a >> inv->shift;
+    const du_int q = mulhi(inv->magic, a);
+    if (inv->add)
+        return (((a - q) >> 1) + q) >> inv->shift;
+    return q >> inv->shift;
+}
+
+COMPILER_RT_ABI du_int
+__umoddi3_by_invariant(du_int a, const udivdi3_invariant* inv)
+{
+    return a - __udivdi3_by_invariant(a, inv) * inv->divisor;
+}
@@ -0,0 +1,43 @@
+/* ===-- udivdi3_by_invariant.h - Division by an invariant divisor ---------===
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is dual licensed under the MIT and the University of Illinois Open
+ * Source Licenses. See LICENSE.TXT for details.
+ *
+ * ===----------------------------------------------------------------------===
+ *
+ * This file declares the functions in udivdi3_by_invariant.c, which divide
+ * many dividends by the same 64-bit divisor with a multiply and a shift
+ * instead of a division.
+ *
+ * ===----------------------------------------------------------------------===
+ */
+
+#ifndef UDIVDI3_BY_INVARIANT_H
+#define UDIVDI3_BY_INVARIANT_H
+
+#include "int_lib.h"
+
+/* Filled in by __udivdi3_invariant_init; the fields are private. */
+typedef struct
+{
+    du_int magic;
+    du_int divisor;
+    su_int shift;
+    su_int add;
+} udivdi3_invariant;
+
+/* Precondition: d != 0 */
+COMPILER_RT_ABI void
+__udivdi3_invariant_init(udivdi3_invariant* inv, du_int d);
+
+/* Returns: a / d */
+COMPILER_RT_ABI du_int
+__udivdi3_by_invariant(du_int a, const udivdi3_invariant* inv);
+
+/* Returns: a % d */
+COMPILER_RT_ABI du_int
+__umoddi3_by_invariant(du_int a, const udivdi3_invariant* inv);
+
+#endif /* UDIVDI3_BY_INVARIANT_H */
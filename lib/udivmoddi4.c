@@ -14,6 +14,54 @@
 
 #include "int_lib.h"
 
+/* Returns: u1:u0 / v, *r = u1:u0 % v
+ * Precondition: u1 < v, so that the quotient fits in 32 bits.
+ */
+
+static inline su_int
+udiv64by32(su_int u1, su_int u0, su_int v, su_int* r)
+{
+#if __i386__ || __x86_64__
+    su_int q;
+    __asm__ ("divl %4" : "=a"(q), "=d"(*r) : "a"(u0), "d"(u1), "rm"(v));
+    return q;
+#else
+    /* Figure 9-3 of Hacker's Delight: normalize v, then find the two 16-bit
+     * quotient digits with 32/16 divisions, each corrected at most twice.
+     */
+    const su_int b = 0x10000;
+    const unsigned s = __builtin_clz(v);
+    v <<= s;
+    const su_int vn1 = v >> 16;
+    const su_int vn0 = v & 0xFFFF;
+    const su_int un32 = s ? (u1 << s) | (u0 >> (32 - s)) : u1;
+    const su_int un10 = u0 << s;
+    const su_int un1 = un10 >> 16;
+    const su_int un0 = un10 & 0xFFFF;
+    su_int q1 = un32 / vn1;
+    su_int rhat = un32 - q1 * vn1;
+    while (q1 >= b || q1 * vn0 > b * rhat + un1)
+    {
+        --q1;
+        rhat += vn1;
+        if (rhat >= b)
+            break;
+    }
+    const su_int un21 = un32 * b + un1 - q1 * v;
+    su_int q0 = un21 / vn1;
+    rhat = un21 - q0 * vn1;
+    while (q0 >= b || q0 * vn0 > b * rhat + un0)
+    {
+        --q0;
+        rhat += vn1;
+        if (rhat >= b)
+            break;
+    }
+    *r = (un21 * b + un0 - q0 * v) >> s;
+    return q1 * b + q0;
+#endif
+}
+
 /* Effects: if rem != 0, *rem = a % b
  * Returns: a / b
  */
@@ -139,47 +187,21 @@ __udivmoddi4(du_int a, du_int b, du_int* rem)
              * ---
              *0 K
              */
-            sr = 1 + n_uword_bits + __builtin_clz(d.s.low) - __builtin_clz(n.s.high);
-            /* 2 <= sr <= n_udword_bits - 1
-             * q.all = n.all << (n_udword_bits - sr);
-             * r.all = n.all >> sr;
-             * if (sr == n_uword_bits)
-             * {
-             *     q.s.low = 0;
-             *     q.s.high = n.s.low;
-             *     r.s.high = 0;
-             *     r.s.low = n.s.high;
-             * }
-             * else if (sr < n_uword_bits)  // 2 <= sr <= n_uword_bits - 1
-             * {
-             *     q.s.low = 0;
-             *     q.s.high = n.s.low << (n_uword_bits - sr);
-             *     r.s.high = n.s.high >> sr;
-             *     r.s.low = (n.s.high << (n_uword_bits - sr)) | (n.s.low >> sr);
-             * }
-             * else              // n_uword_bits + 1 <= sr <= n_udword_bits - 1
-             * {
-             *     q.s.low = n.s.low << (n_udword_bits - sr);
-             *     q.s.high = (n.s.high << (n_udword_bits - sr)) |
-             *              (n.s.low >> (sr - n_uword_bits));
-             *     r.s.high = 0;
-             *     r.s.low = n.s.high >> (sr - n_uword_bits);
-             * }
-             */
-            q.s.low =  (n.s.low << (n_udword_bits - sr)) &
-                     ((si_int)(n_uword_bits - sr) >> (n_uword_bits-1));
-            q.s.high = ((n.s.low << ( n_uword_bits - sr))                       &
-                     ((si_int)(sr - n_uword_bits - 1) >> (n_uword_bits-1))) |
-                     (((n.s.high << (n_udword_bits - sr))                     |
-                     (n.s.low >> (sr - n_uword_bits)))                        &
-                     ((si_int)(n_uword_bits - sr) >> (n_uword_bits-1)));
-            r.s.high = (n.s.high >> sr) &
-                     ((si_int)(sr - n_uword_bits) >> (n_uword_bits-1));
-            r.s.low =  ((n.s.high >> (sr - n_uword_bits))                       &
-                     ((si_int)(n_uword_bits - sr - 1) >> (n_uword_bits-1))) |
-                     (((n.s.high << (n_uword_bits - sr))                      |
-                     (n.s.low >> sr))                                         &
-                     ((si_int)(sr - n_uword_bits) >> (n_uword_bits-1)));
+            if (n.s.high < d.s.low)
+            {
+                q.s.high = 0;
+                r.s.high = n.s.high;
+            }
+            else
+            {
+                q.s.high = n.s.high / d.s.low;
+                r.s.high = n.s.high % d.s.low;
+            }
+            q.s.low = udiv64by32(r.s.high, n.s.low, d.s.low, &r.s.low);
+            r.s.high = 0;
+            if (rem)
+                *rem = r.all;
+            return q.all;
         }
         else
         {
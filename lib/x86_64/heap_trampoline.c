@@ -0,0 +1,146 @@
+/* ===-- heap_trampoline.c - Trampolines for nested functions -------------===
+ *
+ *                     The LLVM Compiler Infrastructure
+ *
+ * This file is dual licensed under the MIT and the University of Illinois Open
+ * Source Licenses. See LICENSE.TXT for details.
+ *
+ * ===----------------------------------------------------------------------===
+ *
+ * This file implements __gcc_nested_func_ptr_created and
+ * __gcc_nested_func_ptr_deleted, which the compiler calls instead of writing
+ * the trampoline of a nested function on the stack (and calling
+ * __enable_execute_stack) with -ftrampoline-impl=heap.  The stack stays
+ * non-executable and no system call is made per trampoline.
+ *
+ * Trampolines are taken from blocks of two pages.  The first page is filled
+ * once with identical 16 byte stubs and then made read-only and executable.
+ * The second page holds the static chain and the target of each stub, at the
+ * same offset from the stub, so creating a trampoline only stores two words.
+ * Trampolines are deleted in the reverse order of creation, so each thread
+ * keeps its blocks as a stack, plus one free block so that a loop creating
+ * a single trampoline does not map and unmap a block each time.
+ *
+ * ===----------------------------------------------------------------------===
+ */
+
+#if __x86_64__ && (__linux__ || __APPLE__)
+
+#include "../int_lib.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#define STUB_SIZE 16
+
+/* Slot i of the data page holds the words loaded by stub i.  Slot 0 is the
+ * header of the block, so stub 0 is never handed out.
+ */
+struct tramp_slot {
+    void *chain;
+    void *func;
+};
+
+struct tramp_block {
+    struct tramp_block *prev;
+    uintptr_t used;  /* Including the header slot. */
+};
+
+static __thread struct tramp_block *tramp_top;
+static __thread struct tramp_block *tramp_free;
+
+static uintptr_t tramp_page_size(void)
+{
+    static uintptr_t page_size;
+    if (!page_size)
+        page_size = sysconf(_SC_PAGESIZE);
+    return page_size;
+}
+
+static struct tramp_slot *tramp_slots(struct tramp_block *b)
+{
+    return (struct tramp_slot *)b;
+}
+
+static unsigned char *tramp_code(struct tramp_block *b)
+{
+    return (unsigned char *)b - tramp_page_size();
+}
+
+static struct tramp_block *tramp_block_create(void)
+{
+    const uintptr_t page_size = tramp_page_size();
+    unsigned char *code = (unsigned char *)mmap(0, 2 * page_size,
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED)
+        compilerrt_abort();
+    /* Stub i runs at code + 16 * i and its slot is at code + page_size +
+     * 16 * i, so all the stubs have the same rip-relative displacements.
+     */
+    const uint32_t chain_disp = (uint32_t)(page_size - 7);
+    const uint32_t func_disp = (uint32_t)(page_size + 8 - 13);
+    uintptr_t i;
+    for (i = 0; i < page_size; i += STUB_SIZE) {
+        unsigned char *stub = code + i;
+        /* movq chain_disp(%rip), %r10 */
+        stub[0] = 0x4c;
+        stub[1] = 0x8b;
+        stub[2] = 0x15;
+        __builtin_memcpy(stub + 3, &chain_disp, 4);
+        /* jmpq *func_disp(%rip) */
+        stub[7] = 0xff;
+        stub[8] = 0x25;
+        __builtin_memcpy(stub + 9, &func_disp, 4);
+        /* int3 padding */
+        stub[13] = 0xcc;
+        stub[14] = 0xcc;
+        stub[15] = 0xcc;
+    }
+    if (mprotect(code, page_size, PROT_READ | PROT_EXEC) != 0)
+        compilerrt_abort();
+    return (struct tramp_block *)(code + page_size);
+}
+
+static void tramp_block_destroy(struct tramp_block *b)
+{
+    munmap(tramp_code(b), 2 * tramp_page_size());
+}
+
+void __gcc_nested_func_ptr_created(void *chain, void *func, void **dst)
+{
+    struct tramp_block *b = tramp_top;
+    if (!b || b->used == tramp_page_size() / sizeof(struct tramp_slot)) {
+        if (tramp_free) {
+            b = tramp_free;
+            tramp_free = 0;
+        } else {
+            b = tramp_block_create();
+        }
+        b->prev = tramp_top;
+        b->used = 1;
+        tramp_top = b;
+    }
+    const uintptr_t i = b->used++;
+    tramp_slots(b)[i].chain = chain;
+    tramp_slots(b)[i].func = func;
+    *dst = tramp_code(b) + i * STUB_SIZE;
+}
+
+void __gcc_nested_func_ptr_deleted(void)
+{
+    struct tramp_block *b = tramp_top;
+    if (!b || b->used <= 1)
+        compilerrt_abort();
+    if (--b->used > 1)
+        return;
+    tramp_top = b->prev;
+    if (tramp_free)
+        tramp_block_destroy(tramp_free);
+    tramp_free = b;
+}
+
+#endif /* __x86_64__ && (__linux__ || __APPLE__) */
@@ -0,0 +1,99 @@
+//===-- addtf3_test.c - Test __addtf3 -------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __addtf3 for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include "fp_test.h"
+
+#if defined(CRT_HAS_TF_MODE)
+extern tf_float __addtf3(tf_float a, tf_float b);
+
+int test__addtf3(uint64_t aHi, uint64_t aLo, uint64_t bHi, uint64_t bLo,
+                 uint64_t expectedHi, uint64_t expectedLo)
+{
+    tf_float x = __addtf3(fromRep128(aHi, aLo), fromRep128(bHi, bLo));
+    int ret = compareResultTF(x, expectedHi, expectedLo);
+    if (ret)
+        printf("error in test__addtf3(0x%016llx%016llx, 0x%016llx%016llx) = "
+               "0x%016llx%016llx, expected 0x%016llx%016llx\n",
+               (unsigned long long)aHi, (unsigned long long)aLo,
+               (unsigned long long)bHi, (unsigned long long)bLo,
+               (unsigned long long)(toRep128(x) >> 64),
+               (unsigned long long)toRep128(x),
+               (unsigned long long)expectedHi, (unsigned long long)expectedLo);
+    return ret;
+}
+#endif
+
+int main()
+{
+#if defined(CRT_HAS_TF_MODE)
+    // 1 + 1 = 2
+    if (test__addtf3(0x3fff000000000000ULL, 0x0000000000000000ULL,
+                     0x3fff000000000000ULL, 0x0000000000000000ULL,
+                     0x4000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 1 + 2^-113 is a tie, rounds to even
+    if (test__addtf3(0x3fff000000000000ULL, 0x0000000000000000ULL,
+                     0x3f8e000000000000ULL, 0x0000000000000000ULL,
+                     0x3fff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 1 + 2^-112 + 2^-113 is a tie, rounds to even
+    if (test__addtf3(0x3fff000000000000ULL, 0x0000000000000001ULL,
+                     0x3f8e000000000000ULL, 0x0000000000000000ULL,
+                     0x3fff000000000000ULL, 0x0000000000000002ULL))
+        return 1;
+    // just above the tie rounds up
+    if (test__addtf3(0x3fff000000000000ULL, 0x0000000000000000ULL,
+                     0x3f8e000000000000ULL, 0x0000000002000000ULL,
+                     0x3fff000000000000ULL, 0x0000000000000001ULL))
+        return 1;
+    // overflow to infinity
+    if (test__addtf3(0x7ffeffffffffffffULL, 0xffffffffffffffffULL,
+                     0x7ffeffffffffffffULL, 0xffffffffffffffffULL,
+                     0x7fff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // denormal + denormal = normal
+    if (test__addtf3(0x0000ffffffffffffULL, 0xffffffffffffffffULL,
+                     0x0000000000000000ULL, 0x0000000000000001ULL,
+                     0x0001000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // a + -a = +0
+    if (test__addtf3(0x3fff123456789abcULL, 0xdef0123456789abcULL,
+                     0xbfff123456789abcULL, 0xdef0123456789abcULL,
+                     0x0000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // -0 + -0 = -0
+    if (test__addtf3(0x8000000000000000ULL, 0x0000000000000000ULL,
+                     0x8000000000000000ULL, 0x0000000000000000ULL,
+                     0x8000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // partial cancellation
+    if (test__addtf3(0x4005123456789abcULL, 0xdef0123456789abcULL,
+                     0xbffe876543210fedULL, 0xcba9876543210fedULL,
+                     0x40050f258bf2589dULL, 0x0358bf258bf2589cULL))
+        return 1;
+    // inf + -inf = qNaN
+    if (test__addtf3(0x7fff000000000000ULL, 0x0000000000000000ULL,
+                     0xffff000000000000ULL, 0x0000000000000000ULL,
+                     0x7fff800000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // qNaN + 1 = qNaN
+    if (test__addtf3(0x7fff800000000000ULL, 0x0000000000000000ULL,
+                     0x3fff000000000000ULL, 0x0000000000000000ULL,
+                     0x7fff800000000000ULL, 0x0000000000000000ULL))
+        return 1;
+#else
+    printf("skipped\n");
+#endif
+    return 0;
+}
@@ -10,6 +10,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 #include <stdint.h>
 #if defined(_WIN32)
 #include <windows.h>
@@ -22,6 +23,8 @@ void __clear_cache(void* start, void* end)
 #include <sys/mman.h>
 extern void __clear_cache(void* start, void* end);
 #endif
+extern void __clear_cache_ranges(void* const* starts, void* const* ends,
+                                 size_t count);
 
 
 
@@ -72,5 +75,14 @@ int main()
     if ((*f2)() != 2)
         return 1;
 
+    // verify the batched version, with the function split in two ranges
+    memcpy(execution_buffer, (void *)(uintptr_t)&func1, 128);
+    void* starts[2] = { execution_buffer, &execution_buffer[64] };
+    void* ends[2] = { &execution_buffer[64], &execution_buffer[128] };
+    __clear_cache_ranges(starts, ends, 2);
+    pfunc f3 = (pfunc)(uintptr_t)execution_buffer;
+    if ((*f3)() != 1)
+        return 1;
+
     return 0;
 }
@@ -0,0 +1,129 @@
+//===-- comparetf2_test.c - Test the quad-precision comparisons -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests the quad-precision soft-float comparisons for the compiler-rt
+// library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include "fp_test.h"
+
+#if defined(CRT_HAS_TF_MODE)
+int __eqtf2(tf_float, tf_float);
+int __getf2(tf_float, tf_float);
+int __gttf2(tf_float, tf_float);
+int __letf2(tf_float, tf_float);
+int __lttf2(tf_float, tf_float);
+int __netf2(tf_float, tf_float);
+int __unordtf2(tf_float, tf_float);
+
+struct TestVector {
+    uint64_t aHi, aLo;
+    uint64_t bHi, bLo;
+    // The sign of the result of __letf2 and __getf2, and __unordtf2.
+    int leReference;
+    int geReference;
+    int unReference;
+};
+
+static int sign(int x) {
+    return (x > 0) - (x < 0);
+}
+
+int test__cmptf2(const struct TestVector *vector) {
+    const tf_float a = fromRep128(vector->aHi, vector->aLo);
+    const tf_float b = fromRep128(vector->bHi, vector->bLo);
+    
+    if (sign(__letf2(a, b)) != vector->leReference ||
+        sign(__eqtf2(a, b)) != vector->leReference ||
+        sign(__lttf2(a, b)) != vector->leReference ||
+        sign(__netf2(a, b)) != vector->leReference) {
+        printf("error in __letf2(0x%016llx%016llx, 0x%016llx%016llx) = %d, "
+               "expected %d\n",
+               (unsigned long long)vector->aHi, (unsigned long long)vector->aLo,
+               (unsigned long long)vector->bHi, (unsigned long long)vector->bLo,
+               __letf2(a, b), vector->leReference);
+        return 1;
+    }
+    
+    if (sign(__getf2(a, b)) != vector->geReference ||
+        sign(__gttf2(a, b)) != vector->geReference) {
+        printf("error in __getf2(0x%016llx%016llx, 0x%016llx%016llx) = %d, "
+               "expected %d\n",
+               (unsigned long long)vector->aHi, (unsigned long long)vector->aLo,
+               (unsigned long long)vector->bHi, (unsigned long long)vector->bLo,
+               __getf2(a, b), vector->geReference);
+        return 1;
+    }
+    
+    if (__unordtf2(a, b) != vector->unReference) {
+        printf("error in __unordtf2(0x%016llx%016llx, 0x%016llx%016llx) = %d, "
+               "expected %d\n",
+               (unsigned long long)vector->aHi, (unsigned long long)vector->aLo,
+               (unsigned long long)vector->bHi, (unsigned long long)vector->bLo,
+               __unordtf2(a, b), vector->unReference);
+        return 1;
+    }
+    
+    return 0;
+}
+
+#define ONE     0x3fff000000000000ULL
+#define TWO     0x4000000000000000ULL
+#define NEG     0x8000000000000000ULL
+#define INF     0x7fff000000000000ULL
+#define QNAN    0x7fff800000000000ULL
+
+static const struct TestVector vectors[] = {
+    // zeros compare equal whatever their signs
+    {0, 0, 0, 0, 0, 0, 0},
+    {NEG, 0, 0, 0, 0, 0, 0},
+    {0, 0, NEG, 0, 0, 0, 0},
+    // ordering of normals
+    {ONE, 0, ONE, 0, 0, 0, 0},
+    {ONE, 0, TWO, 0, -1, -1, 0},
+    {TWO, 0, ONE, 0, 1, 1, 0},
+    {NEG | ONE, 0, ONE, 0, -1, -1, 0},
+    {NEG | ONE, 0, NEG | TWO, 0, 1, 1, 0},
+    // the low word decides when the high words are equal
+    {ONE, 1, ONE, 0, 1, 1, 0},
+    {ONE, 0, ONE, 1, -1, -1, 0},
+    {NEG | ONE, 1, NEG | ONE, 0, -1, -1, 0},
+    {ONE, 0x8000000000000000ULL, ONE, 0x7fffffffffffffffULL, 1, 1, 0},
+    // denormals and zero
+    {0, 1, 0, 0, 1, 1, 0},
+    {NEG, 1, 0, 0, -1, -1, 0},
+    {0, 1, 0, 2, -1, -1, 0},
+    // infinities
+    {INF, 0, 0x7ffeffffffffffffULL, 0xffffffffffffffffULL, 1, 1, 0},
+    {NEG | INF, 0, INF, 0, -1, -1, 0},
+    {INF, 0, INF, 0, 0, 0, 0},
+    // NaNs are unordered with everything
+    {QNAN, 0, ONE, 0, 1, -1, 1},
+    {ONE, 0, QNAN, 0, 1, -1, 1},
+    {INF, 1, INF, 0, 1, -1, 1},
+    {QNAN, 0, QNAN, 0, 1, -1, 1},
+};
+#endif
+
+int main()
+{
+#if defined(CRT_HAS_TF_MODE)
+    const int numVectors = sizeof vectors / sizeof vectors[0];
+    int i;
+    for (i = 0; i < numVectors; ++i) {
+        if (test__cmptf2(&vectors[i]))
+            return 1;
+    }
+#else
+    printf("skipped\n");
+#endif
+    return 0;
+}
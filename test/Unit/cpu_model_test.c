@@ -0,0 +1,59 @@
+//===-- cpu_model_test.c - Test the CPU feature detection -----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests the CPU feature detection of int_cpu_model.h for the
+// compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include "int_cpu_model.h"
+#include <stdio.h>
+
+int test_feature(const char *name, unsigned feature, int expected)
+{
+    int has = __compilerrt_cpu_has(feature);
+    if (has != expected)
+        printf("error in __compilerrt_cpu_has(%s) = %d, expected %d\n",
+               name, has, expected);
+    return has != expected;
+}
+
+// Doubles its argument, with a version that is never selected.
+static int twice_good(int x) { return 2 * x; }
+static int twice_bad(int x) { return 3 * x; }
+COMPILERRT_MULTIVERSION(int, test_twice, (int x), (x),
+    __compilerrt_cpu_has(COMPILERRT_CPU_INITIALIZED) ? twice_good : twice_bad)
+
+int main()
+{
+    // Initialized by the constructor, or by the first query.
+    if (test_feature("INITIALIZED", COMPILERRT_CPU_INITIALIZED, 1))
+        return 1;
+#if (__i386__ || __x86_64__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8))
+    // Compare with the detection of the compiler.
+    if (test_feature("POPCNT", COMPILERRT_CPU_X86_POPCNT,
+                     !!__builtin_cpu_supports("popcnt")) ||
+        test_feature("SSE4_2", COMPILERRT_CPU_X86_SSE4_2,
+                     !!__builtin_cpu_supports("sse4.2")) ||
+        test_feature("AVX", COMPILERRT_CPU_X86_AVX,
+                     !!__builtin_cpu_supports("avx")) ||
+        test_feature("AVX2", COMPILERRT_CPU_X86_AVX2,
+                     !!__builtin_cpu_supports("avx2")))
+        return 1;
+#endif
+    int i;
+    for (i = 0; i < 3; ++i) {
+        if (test_twice(i + 1) != 2 * (i + 1)) {
+            printf("error in test_twice(%d) = %d\n", i + 1, test_twice(i + 1));
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+//===-- divtf3_test.c - Test __divtf3 -------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __divtf3 for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include "fp_test.h"
+
+#if defined(CRT_HAS_TF_MODE)
+extern tf_float __divtf3(tf_float a, tf_float b);
+
+int test__divtf3(uint64_t aHi, uint64_t aLo, uint64_t bHi, uint64_t bLo,
+                 uint64_t expectedHi, uint64_t expectedLo)
+{
+    tf_float x = __divtf3(fromRep128(aHi, aLo), fromRep128(bHi, bLo));
+    int ret = compareResultTF(x, expectedHi, expectedLo);
+    if (ret)
+        printf("error in test__divtf3(0x%016llx%016llx, 0x%016llx%016llx) = "
+               "0x%016llx%016llx, expected 0x%016llx%016llx\n",
+               (unsigned long long)aHi, (unsigned long long)aLo,
+               (unsigned long long)bHi, (unsigned long long)bLo,
+               (unsigned long long)(toRep128(x) >> 64),
+               (unsigned long long)toRep128(x),
+               (unsigned long long)expectedHi, (unsigned long long)expectedLo);
+    return ret;
+}
+#endif
+
+int main()
+{
+#if defined(CRT_HAS_TF_MODE)
+    // 1 / 3
+    if (test__divtf3(0x3fff000000000000ULL, 0x0000000000000000ULL,
+                     0x4000800000000000ULL, 0x0000000000000000ULL,
+                     0x3ffd555555555555ULL, 0x5555555555555555ULL))
+        return 1;
+    // normal / normal
+    if (test__divtf3(0x3fff123456789abcULL, 0xdef0123456789abcULL,
+                     0xc003876543210fedULL, 0xcba9876543210fedULL,
+                     0xbffa66b29aca5b85ULL, 0x9b6550d8af8ca328ULL))
+        return 1;
+    // divisor close to 1
+    if (test__divtf3(0x3fff123456789abcULL, 0xdef0123456789abcULL,
+                     0x3fff000000000000ULL, 0x0000000000000001ULL,
+                     0x3fff123456789abcULL, 0xdef0123456789abbULL))
+        return 1;
+    // divisor close to 2
+    if (test__divtf3(0x3fff123456789abcULL, 0xdef0123456789abcULL,
+                     0x3fffffffffffffffULL, 0xffffffffffffffffULL,
+                     0x3ffe123456789abcULL, 0xdef0123456789abdULL))
+        return 1;
+    // overflow to infinity
+    if (test__divtf3(0x7ffeffffffffffffULL, 0xffffffffffffffffULL,
+                     0x3ffe000000000000ULL, 0x0000000000000000ULL,
+                     0x7fff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // denormal result
+    if (test__divtf3(0x0001000000000000ULL, 0x0000000000000000ULL,
+                     0x4000800000000000ULL, 0x0000000000000000ULL,
+                     0x0000555555555555ULL, 0x5555555555555555ULL))
+        return 1;
+    // exact tie in the denormal range rounds to even
+    if (test__divtf3(0x0001fd47734611fcULL, 0x1e27b13f2ba562dfULL,
+                     0xc001000000000000ULL, 0x0000000000000000ULL,
+                     0x80007f51dcd1847fULL, 0x0789ec4fcae958b8ULL))
+        return 1;
+    // underflow to zero
+    if (test__divtf3(0x0000000000000000ULL, 0x0000000000000001ULL,
+                     0x4000800000000000ULL, 0x0000000000000000ULL,
+                     0x0000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // smallest denormal round up
+    if (test__divtf3(0x0000000000000000ULL, 0x0000000000000001ULL,
+                     0x3fff000000000000ULL, 0x0000000000000001ULL,
+                     0x0000000000000000ULL, 0x0000000000000001ULL))
+        return 1;
+    // denormal / normal, exact
+    if (test__divtf3(0x0000000000000000ULL, 0x0000000000000005ULL,
+                     0x3ffe000000000000ULL, 0x0000000000000000ULL,
+                     0x0000000000000000ULL, 0x000000000000000aULL))
+        return 1;
+    // 1 / 0 = inf
+    if (test__divtf3(0x3fff000000000000ULL, 0x0000000000000000ULL,
+                     0x0000000000000000ULL, 0x0000000000000000ULL,
+                     0x7fff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 0 / 0 = qNaN
+    if (test__divtf3(0x0000000000000000ULL, 0x0000000000000000ULL,
+                     0x0000000000000000ULL, 0x0000000000000000ULL,
+                     0x7fff800000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // inf / inf = qNaN
+    if (test__divtf3(0x7fff000000000000ULL, 0x0000000000000000ULL,
+                     0x7fff000000000000ULL, 0x0000000000000000ULL,
+                     0x7fff800000000000ULL, 0x0000000000000000ULL))
+        return 1;
+#else
+    printf("skipped\n");
+#endif
+    return 0;
+}
@@ -0,0 +1,91 @@
+//===-- extenddftf2_test.c - Test __extenddftf2 ---------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __extenddftf2 for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include "fp_test.h"
+
+#if defined(CRT_HAS_TF_MODE)
+extern tf_float __extenddftf2(double a);
+
+int test__extenddftf2(uint64_t a, uint64_t expectedHi, uint64_t expectedLo)
+{
+    double f;
+    memcpy(&f, &a, sizeof(f));
+    tf_float x = __extenddftf2(f);
+    int ret = compareResultTF(x, expectedHi, expectedLo);
+    if (ret)
+        printf("error in test__extenddftf2(0x%016llx) = 0x%016llx%016llx, "
+               "expected 0x%016llx%016llx\n", (unsigned long long)a,
+               (unsigned long long)(toRep128(x) >> 64),
+               (unsigned long long)toRep128(x),
+               (unsigned long long)expectedHi, (unsigned long long)expectedLo);
+    return ret;
+}
+#endif
+
+int main()
+{
+#if defined(CRT_HAS_TF_MODE)
+    // +0
+    if (test__extenddftf2(0x0000000000000000ULL,
+                          0x0000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // -0
+    if (test__extenddftf2(0x8000000000000000ULL,
+                          0x8000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 1
+    if (test__extenddftf2(0x3ff0000000000000ULL,
+                          0x3fff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // -pi
+    if (test__extenddftf2(0xc00921fb54442d18ULL,
+                          0xc000921fb54442d1ULL, 0x8000000000000000ULL))
+        return 1;
+    // largest normal
+    if (test__extenddftf2(0x7fefffffffffffffULL,
+                          0x43feffffffffffffULL, 0xf000000000000000ULL))
+        return 1;
+    // smallest normal
+    if (test__extenddftf2(0x0010000000000000ULL,
+                          0x3c01000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // smallest denormal
+    if (test__extenddftf2(0x0000000000000001ULL,
+                          0x3bcd000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // largest negative denormal
+    if (test__extenddftf2(0x800fffffffffffffULL,
+                          0xbc00ffffffffffffULL, 0xe000000000000000ULL))
+        return 1;
+    // inf
+    if (test__extenddftf2(0x7ff0000000000000ULL,
+                          0x7fff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // -inf
+    if (test__extenddftf2(0xfff0000000000000ULL,
+                          0xffff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // qNaN
+    if (test__extenddftf2(0x7ff8000000000000ULL,
+                          0x7fff800000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // sNaN is quieted, the payload is kept
+    if (test__extenddftf2(0x7ff4000000000001ULL,
+                          0x7fffc00000000000ULL, 0x1000000000000000ULL))
+        return 1;
+#else
+    printf("skipped\n");
+#endif
+    return 0;
+}
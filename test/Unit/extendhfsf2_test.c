@@ -0,0 +1,92 @@
+//===-- extendhfsf2_test.c - Test __extendhfsf2 ---------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __extendhfsf2 for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+extern float __extendhfsf2(uint16_t a);
+extern float __gnu_h2f_ieee(uint16_t a);
+extern void __extendhfsf2_array(float *dst, const uint16_t *src, size_t count);
+
+static uint32_t toRep(float x)
+{
+    uint32_t rep;
+    memcpy(&rep, &x, sizeof(rep));
+    return rep;
+}
+
+int test__extendhfsf2(uint16_t a, uint32_t expected)
+{
+    uint32_t actual = toRep(__extendhfsf2(a));
+    if (actual != expected || toRep(__gnu_h2f_ieee(a)) != expected)
+        printf("error in test__extendhfsf2(0x%04x) = 0x%08x, expected 0x%08x\n",
+               a, actual, expected);
+    return actual != expected;
+}
+
+int main()
+{
+    // zeros
+    if (test__extendhfsf2(0x0000, 0x00000000))
+        return 1;
+    if (test__extendhfsf2(0x8000, 0x80000000))
+        return 1;
+    // normals
+    if (test__extendhfsf2(0x3c00, 0x3f800000))
+        return 1;
+    if (test__extendhfsf2(0xc000, 0xc0000000))
+        return 1;
+    if (test__extendhfsf2(0x3555, 0x3eaaa000))
+        return 1;
+    if (test__extendhfsf2(0x0400, 0x38800000))
+        return 1;
+    if (test__extendhfsf2(0x7bff, 0x477fe000))
+        return 1;
+    // denormals
+    if (test__extendhfsf2(0x0001, 0x33800000))
+        return 1;
+    if (test__extendhfsf2(0x03ff, 0x387fc000))
+        return 1;
+    if (test__extendhfsf2(0x8200, 0xb8000000))
+        return 1;
+    // infinities
+    if (test__extendhfsf2(0x7c00, 0x7f800000))
+        return 1;
+    if (test__extendhfsf2(0xfc00, 0xff800000))
+        return 1;
+    // NaNs keep their payload and are quieted
+    if (test__extendhfsf2(0x7e00, 0x7fc00000))
+        return 1;
+    if (test__extendhfsf2(0xfe01, 0xffc02000))
+        return 1;
+    if (test__extendhfsf2(0x7c01, 0x7fc02000))
+        return 1;
+
+    // The bulk conversion agrees with the scalar one, including the tail
+    // which doesn't fill a vector.
+    uint16_t src[67];
+    float dst[67];
+    int i;
+    for (i = 0; i < 67; ++i)
+        src[i] = (uint16_t)(i * 977);
+    __extendhfsf2_array(dst, src, 67);
+    for (i = 0; i < 67; ++i) {
+        if (toRep(dst[i]) != toRep(__extendhfsf2(src[i]))) {
+            printf("error in __extendhfsf2_array at %d\n", i);
+            return 1;
+        }
+    }
+    return 0;
+}
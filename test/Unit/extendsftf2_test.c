@@ -0,0 +1,91 @@
+//===-- extendsftf2_test.c - Test __extendsftf2 ---------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __extendsftf2 for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include "fp_test.h"
+
+#if defined(CRT_HAS_TF_MODE)
+extern tf_float __extendsftf2(float a);
+
+int test__extendsftf2(uint32_t a, uint64_t expectedHi, uint64_t expectedLo)
+{
+    float f;
+    memcpy(&f, &a, sizeof(f));
+    tf_float x = __extendsftf2(f);
+    int ret = compareResultTF(x, expectedHi, expectedLo);
+    if (ret)
+        printf("error in test__extendsftf2(0x%08x) = 0x%016llx%016llx, "
+               "expected 0x%016llx%016llx\n", a,
+               (unsigned long long)(toRep128(x) >> 64),
+               (unsigned long long)toRep128(x),
+               (unsigned long long)expectedHi, (unsigned long long)expectedLo);
+    return ret;
+}
+#endif
+
+int main()
+{
+#if defined(CRT_HAS_TF_MODE)
+    // +0
+    if (test__extendsftf2(0x00000000U,
+                          0x0000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // -0
+    if (test__extendsftf2(0x80000000U,
+                          0x8000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 1
+    if (test__extendsftf2(0x3f800000U,
+                          0x3fff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // -pi
+    if (test__extendsftf2(0xc0490fdbU,
+                          0xc000921fb6000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // largest normal
+    if (test__extendsftf2(0x7f7fffffU,
+                          0x407efffffe000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // smallest normal
+    if (test__extendsftf2(0x00800000U,
+                          0x3f81000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // smallest denormal
+    if (test__extendsftf2(0x00000001U,
+                          0x3f6a000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // largest negative denormal
+    if (test__extendsftf2(0x807fffffU,
+                          0xbf80fffffc000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // inf
+    if (test__extendsftf2(0x7f800000U,
+                          0x7fff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // -inf
+    if (test__extendsftf2(0xff800000U,
+                          0xffff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // qNaN
+    if (test__extendsftf2(0x7fc00000U,
+                          0x7fff800000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // sNaN is quieted, the payload is kept
+    if (test__extendsftf2(0x7fa00001U,
+                          0x7fffc00002000000ULL, 0x0000000000000000ULL))
+        return 1;
+#else
+    printf("skipped\n");
+#endif
+    return 0;
+}
@@ -0,0 +1,82 @@
+//===-- fixtfdi_test.c - Test __fixtfdi -----------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __fixtfdi for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include "fp_test.h"
+
+#if defined(CRT_HAS_TF_MODE)
+extern long long __fixtfdi(tf_float a);
+
+int test__fixtfdi(uint64_t aHi, uint64_t aLo, long long expected)
+{
+    long long x = __fixtfdi(fromRep128(aHi, aLo));
+    if (x != expected)
+        printf("error in test__fixtfdi(0x%016llx%016llx) = %lld, "
+               "expected %lld\n", (unsigned long long)aHi,
+               (unsigned long long)aLo, x, expected);
+    return x != expected;
+}
+#endif
+
+int main()
+{
+#if defined(CRT_HAS_TF_MODE)
+    // 0
+    if (test__fixtfdi(0x0000000000000000ULL, 0x0000000000000000ULL,
+                      0LL))
+        return 1;
+    // 0.5 truncates to 0
+    if (test__fixtfdi(0x3ffe000000000000ULL, 0x0000000000000000ULL,
+                      0LL))
+        return 1;
+    // 1
+    if (test__fixtfdi(0x3fff000000000000ULL, 0x0000000000000000ULL,
+                      1LL))
+        return 1;
+    // 1.99 truncates to 1
+    if (test__fixtfdi(0x3ffffd70a3d70a3dULL, 0x70a3d70a3d70a3d7ULL,
+                      1LL))
+        return 1;
+    // -1
+    if (test__fixtfdi(0xbfff000000000000ULL, 0x0000000000000000ULL,
+                      -1LL))
+        return 1;
+    // -2.5 truncates to -2
+    if (test__fixtfdi(0xc000400000000000ULL, 0x0000000000000000ULL,
+                      -2LL))
+        return 1;
+    // 123456789.75
+    if (test__fixtfdi(0x4019d6f345700000ULL, 0x0000000000000000ULL,
+                      123456789LL))
+        return 1;
+    // large value
+    if (test__fixtfdi(0x403d800000000000ULL, 0x0000000000000000ULL,
+                      6917529027641081856LL))
+        return 1;
+    // largest value
+    if (test__fixtfdi(0x403dffffffffffffULL, 0xfffc000000000000ULL,
+                      9223372036854775807LL))
+        return 1;
+    // smallest value
+    if (test__fixtfdi(0xc03e000000000000ULL, 0x0000000000000000ULL,
+                      INT64_MIN))
+        return 1;
+    // tiny value
+    if (test__fixtfdi(0x0001000000000000ULL, 0x0000000000000000ULL,
+                      0LL))
+        return 1;
+#else
+    printf("skipped\n");
+#endif
+    return 0;
+}
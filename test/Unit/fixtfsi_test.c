@@ -0,0 +1,82 @@
+//===-- fixtfsi_test.c - Test __fixtfsi -----------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __fixtfsi for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include "fp_test.h"
+
+#if defined(CRT_HAS_TF_MODE)
+extern int __fixtfsi(tf_float a);
+
+int test__fixtfsi(uint64_t aHi, uint64_t aLo, int expected)
+{
+    int x = __fixtfsi(fromRep128(aHi, aLo));
+    if (x != expected)
+        printf("error in test__fixtfsi(0x%016llx%016llx) = %d, "
+               "expected %d\n", (unsigned long long)aHi,
+               (unsigned long long)aLo, x, expected);
+    return x != expected;
+}
+#endif
+
+int main()
+{
+#if defined(CRT_HAS_TF_MODE)
+    // 0
+    if (test__fixtfsi(0x0000000000000000ULL, 0x0000000000000000ULL,
+                      0))
+        return 1;
+    // 0.5 truncates to 0
+    if (test__fixtfsi(0x3ffe000000000000ULL, 0x0000000000000000ULL,
+                      0))
+        return 1;
+    // 1
+    if (test__fixtfsi(0x3fff000000000000ULL, 0x0000000000000000ULL,
+                      1))
+        return 1;
+    // 1.99 truncates to 1
+    if (test__fixtfsi(0x3ffffd70a3d70a3dULL, 0x70a3d70a3d70a3d7ULL,
+                      1))
+        return 1;
+    // -1
+    if (test__fixtfsi(0xbfff000000000000ULL, 0x0000000000000000ULL,
+                      -1))
+        return 1;
+    // -2.5 truncates to -2
+    if (test__fixtfsi(0xc000400000000000ULL, 0x0000000000000000ULL,
+                      -2))
+        return 1;
+    // 123456789.75
+    if (test__fixtfsi(0x4019d6f345700000ULL, 0x0000000000000000ULL,
+                      123456789))
+        return 1;
+    // large value
+    if (test__fixtfsi(0x401d800000000000ULL, 0x0000000000000000ULL,
+                      1610612736))
+        return 1;
+    // largest value
+    if (test__fixtfsi(0x401dfffffffc0000ULL, 0x0000000000000000ULL,
+                      2147483647))
+        return 1;
+    // smallest value
+    if (test__fixtfsi(0xc01e000000000000ULL, 0x0000000000000000ULL,
+                      INT32_MIN))
+        return 1;
+    // tiny value
+    if (test__fixtfsi(0x0001000000000000ULL, 0x0000000000000000ULL,
+                      0))
+        return 1;
+#else
+    printf("skipped\n");
+#endif
+    return 0;
+}
@@ -11,6 +11,9 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <stdio.h>
+#include "fp_test.h"
+
 #if _ARCH_PPC
 
 #include "int_lib.h"
@@ -39,6 +42,19 @@ char assumption_1[sizeof(du_int) == 2*sizeof(su_int)] = {0};
 char assumption_2[sizeof(du_int)*CHAR_BIT == 64] = {0};
 char assumption_3[sizeof(long double)*CHAR_BIT == 128] = {0};
 
+#elif defined(CRT_HAS_TF_MODE)
+
+extern unsigned long long __fixunstfdi(tf_float a);
+
+int test__fixunstfdi(uint64_t aHi, uint64_t aLo, unsigned long long expected)
+{
+    unsigned long long x = __fixunstfdi(fromRep128(aHi, aLo));
+    if (x != expected)
+        printf("error in test__fixunstfdi(0x%016llx%016llx) = %llu, "
+               "expected %llu\n", (unsigned long long)aHi,
+               (unsigned long long)aLo, x, expected);
+    return x != expected;
+}
 #endif
 
 int main()
@@ -114,6 +130,44 @@ int main()
     if (test__fixunstfdi(-0x1.FFFFFFFFFFFFFFF8p+62L, 0))
         return 1;
 
+#elif defined(CRT_HAS_TF_MODE)
+    // 0
+    if (test__fixunstfdi(0x0000000000000000ULL, 0x0000000000000000ULL,
+                         0x0000000000000000ULL))
+        return 1;
+    // 0.5 truncates to 0
+    if (test__fixunstfdi(0x3ffe000000000000ULL, 0x0000000000000000ULL,
+                         0x0000000000000000ULL))
+        return 1;
+    // 1
+    if (test__fixunstfdi(0x3fff000000000000ULL, 0x0000000000000000ULL,
+                         0x0000000000000001ULL))
+        return 1;
+    // 1.99 truncates to 1
+    if (test__fixunstfdi(0x3ffffd70a3d70a3dULL, 0x70a3d70a3d70a3d7ULL,
+                         0x0000000000000001ULL))
+        return 1;
+    // negative values convert to 0
+    if (test__fixunstfdi(0xbfff000000000000ULL, 0x0000000000000000ULL,
+                         0))
+        return 1;
+    // 123456789.75
+    if (test__fixunstfdi(0x4019d6f345700000ULL, 0x0000000000000000ULL,
+                         0x00000000075bcd15ULL))
+        return 1;
+    // large value
+    if (test__fixunstfdi(0x403d800000000000ULL, 0x0000000000000000ULL,
+                         0x6000000000000000ULL))
+        return 1;
+    // largest value
+    if (test__fixunstfdi(0x403effffffffffffULL, 0xfffe000000000000ULL,
+                         0xffffffffffffffffULL))
+        return 1;
+    // tiny value
+    if (test__fixunstfdi(0x0001000000000000ULL, 0x0000000000000000ULL,
+                         0x0000000000000000ULL))
+        return 1;
+
 #else
     printf("skipped\n");
 #endif
@@ -0,0 +1,74 @@
+//===-- fixunstfsi_test.c - Test __fixunstfsi -----------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __fixunstfsi for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include "fp_test.h"
+
+#if defined(CRT_HAS_TF_MODE)
+extern unsigned __fixunstfsi(tf_float a);
+
+int test__fixunstfsi(uint64_t aHi, uint64_t aLo, unsigned expected)
+{
+    unsigned x = __fixunstfsi(fromRep128(aHi, aLo));
+    if (x != expected)
+        printf("error in test__fixunstfsi(0x%016llx%016llx) = %u, "
+               "expected %u\n", (unsigned long long)aHi,
+               (unsigned long long)aLo, x, expected);
+    return x != expected;
+}
+#endif
+
+int main()
+{
+#if defined(CRT_HAS_TF_MODE)
+    // 0
+    if (test__fixunstfsi(0x0000000000000000ULL, 0x0000000000000000ULL,
+                         0x00000000U))
+        return 1;
+    // 0.5 truncates to 0
+    if (test__fixunstfsi(0x3ffe000000000000ULL, 0x0000000000000000ULL,
+                         0x00000000U))
+        return 1;
+    // 1
+    if (test__fixunstfsi(0x3fff000000000000ULL, 0x0000000000000000ULL,
+                         0x00000001U))
+        return 1;
+    // 1.99 truncates to 1
+    if (test__fixunstfsi(0x3ffffd70a3d70a3dULL, 0x70a3d70a3d70a3d7ULL,
+                         0x00000001U))
+        return 1;
+    // negative values convert to 0
+    if (test__fixunstfsi(0xbfff000000000000ULL, 0x0000000000000000ULL,
+                         0))
+        return 1;
+    // 123456789.75
+    if (test__fixunstfsi(0x4019d6f345700000ULL, 0x0000000000000000ULL,
+                         0x075bcd15U))
+        return 1;
+    // large value
+    if (test__fixunstfsi(0x401d800000000000ULL, 0x0000000000000000ULL,
+                         0x60000000U))
+        return 1;
+    // largest value
+    if (test__fixunstfsi(0x401efffffffe0000ULL, 0x0000000000000000ULL,
+                         0xffffffffU))
+        return 1;
+    // tiny value
+    if (test__fixunstfsi(0x0001000000000000ULL, 0x0000000000000000ULL,
+                         0x00000000U))
+        return 1;
+#else
+    printf("skipped\n");
+#endif
+    return 0;
+}
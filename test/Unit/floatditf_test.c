@@ -0,0 +1,77 @@
+//===-- floatditf_test.c - Test __floatditf -------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __floatditf for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include "fp_test.h"
+
+#if defined(CRT_HAS_TF_MODE)
+extern tf_float __floatditf(long long a);
+
+int test__floatditf(long long a, uint64_t expectedHi, uint64_t expectedLo)
+{
+    tf_float x = __floatditf(a);
+    int ret = compareResultTF(x, expectedHi, expectedLo);
+    if (ret)
+        printf("error in test__floatditf(%lld) = 0x%016llx%016llx, "
+               "expected 0x%016llx%016llx\n", a,
+               (unsigned long long)(toRep128(x) >> 64),
+               (unsigned long long)toRep128(x),
+               (unsigned long long)expectedHi, (unsigned long long)expectedLo);
+    return ret;
+}
+#endif
+
+int main()
+{
+#if defined(CRT_HAS_TF_MODE)
+    // 0
+    if (test__floatditf(0LL,
+                        0x0000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 1
+    if (test__floatditf(1LL,
+                        0x3fff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // -1
+    if (test__floatditf(-1LL,
+                        0xbfff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 2
+    if (test__floatditf(2LL,
+                        0x4000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 1234567
+    if (test__floatditf(1234567LL,
+                        0x40132d6870000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // -1234567
+    if (test__floatditf(-1234567LL,
+                        0xc0132d6870000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // largest value
+    if (test__floatditf(9223372036854775807LL,
+                        0x403dffffffffffffULL, 0xfffc000000000000ULL))
+        return 1;
+    // smallest value
+    if (test__floatditf(INT64_MIN,
+                        0xc03e000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // exact, no rounding
+    if (test__floatditf(1311768467463790320LL,
+                        0x403b23456789abcdULL, 0xef00000000000000ULL))
+        return 1;
+#else
+    printf("skipped\n");
+#endif
+    return 0;
+}
@@ -0,0 +1,77 @@
+//===-- floatsitf_test.c - Test __floatsitf -------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __floatsitf for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include "fp_test.h"
+
+#if defined(CRT_HAS_TF_MODE)
+extern tf_float __floatsitf(int a);
+
+int test__floatsitf(int a, uint64_t expectedHi, uint64_t expectedLo)
+{
+    tf_float x = __floatsitf(a);
+    int ret = compareResultTF(x, expectedHi, expectedLo);
+    if (ret)
+        printf("error in test__floatsitf(%d) = 0x%016llx%016llx, "
+               "expected 0x%016llx%016llx\n", a,
+               (unsigned long long)(toRep128(x) >> 64),
+               (unsigned long long)toRep128(x),
+               (unsigned long long)expectedHi, (unsigned long long)expectedLo);
+    return ret;
+}
+#endif
+
+int main()
+{
+#if defined(CRT_HAS_TF_MODE)
+    // 0
+    if (test__floatsitf(0,
+                        0x0000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 1
+    if (test__floatsitf(1,
+                        0x3fff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // -1
+    if (test__floatsitf(-1,
+                        0xbfff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 2
+    if (test__floatsitf(2,
+                        0x4000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 1234567
+    if (test__floatsitf(1234567,
+                        0x40132d6870000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // -1234567
+    if (test__floatsitf(-1234567,
+                        0xc0132d6870000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // largest value
+    if (test__floatsitf(2147483647,
+                        0x401dfffffffc0000ULL, 0x0000000000000000ULL))
+        return 1;
+    // smallest value
+    if (test__floatsitf(INT32_MIN,
+                        0xc01e000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // exact, no rounding
+    if (test__floatsitf(305419896,
+                        0x401b234567800000ULL, 0x0000000000000000ULL))
+        return 1;
+#else
+    printf("skipped\n");
+#endif
+    return 0;
+}
@@ -15,6 +15,7 @@
 
 #include "int_lib.h"
 #include <float.h>
+#include <stddef.h>
 #include <stdio.h>
 
 // Returns: convert a to a double, rounding toward even.
@@ -25,6 +26,7 @@
 // seee eeee eeee mmmm mmmm mmmm mmmm mmmm | mmmm mmmm mmmm mmmm mmmm mmmm mmmm mmmm
 
 double __floattidf(ti_int a);
+void __floattidf_array(double* dst, const ti_int* src, size_t count);
 
 int test__floattidf(ti_int a, double expected)
 {
@@ -173,6 +175,25 @@ int main()
         return 1;
     if (test__floattidf(make_ti(0x023479FD0E092DE0LL, 14), 0x1.1A3CFE870496Fp+121))
         return 1;
+
+    // The bulk conversion agrees with the scalar one, for groups which fit in
+    // 64 bits, groups which don't and the tail which doesn't fill a vector.
+    ti_int src[67];
+    double dst[67];
+    int i;
+    for (i = 0; i < 67; ++i)
+        src[i] = i < 32 ? (ti_int)0x123456789ABCDLL * (i - 33) * (i - 33)
+                        : make_ti((di_int)(i * 0x0123456789ABCDEFuLL), i);
+    src[40] = 1;
+    __floattidf_array(dst, src, 67);
+    for (i = 0; i < 67; ++i)
+    {
+        if (dst[i] != __floattidf(src[i]))
+        {
+            printf("error in __floattidf_array at %d\n", i);
+            return 1;
+        }
+    }
 #else
     printf("skipped\n");
 #endif
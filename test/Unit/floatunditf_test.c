@@ -0,0 +1,70 @@
+//===-- floatunditf_test.c - Test __floatunditf ---------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __floatunditf for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include "fp_test.h"
+
+#if defined(CRT_HAS_TF_MODE)
+extern tf_float __floatunditf(unsigned long long a);
+
+int test__floatunditf(unsigned long long a, uint64_t expectedHi,
+                      uint64_t expectedLo)
+{
+    tf_float x = __floatunditf(a);
+    int ret = compareResultTF(x, expectedHi, expectedLo);
+    if (ret)
+        printf("error in test__floatunditf(%llu) = 0x%016llx%016llx, "
+               "expected 0x%016llx%016llx\n", a,
+               (unsigned long long)(toRep128(x) >> 64),
+               (unsigned long long)toRep128(x),
+               (unsigned long long)expectedHi, (unsigned long long)expectedLo);
+    return ret;
+}
+#endif
+
+int main()
+{
+#if defined(CRT_HAS_TF_MODE)
+    // 0
+    if (test__floatunditf(0x0000000000000000ULL,
+                          0x0000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 1
+    if (test__floatunditf(0x0000000000000001ULL,
+                          0x3fff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 2
+    if (test__floatunditf(0x0000000000000002ULL,
+                          0x4000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 1234567
+    if (test__floatunditf(0x000000000012d687ULL,
+                          0x40132d6870000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // large value
+    if (test__floatunditf(0x7fffffffffffffffULL,
+                          0x403dffffffffffffULL, 0xfffc000000000000ULL))
+        return 1;
+    // largest value
+    if (test__floatunditf(0xffffffffffffffffULL,
+                          0x403effffffffffffULL, 0xfffe000000000000ULL))
+        return 1;
+    // exact, no rounding
+    if (test__floatunditf(0x123456789abcdef0ULL,
+                          0x403b23456789abcdULL, 0xef00000000000000ULL))
+        return 1;
+#else
+    printf("skipped\n");
+#endif
+    return 0;
+}
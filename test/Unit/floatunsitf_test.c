@@ -0,0 +1,69 @@
+//===-- floatunsitf_test.c - Test __floatunsitf ---------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __floatunsitf for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include "fp_test.h"
+
+#if defined(CRT_HAS_TF_MODE)
+extern tf_float __floatunsitf(unsigned a);
+
+int test__floatunsitf(unsigned a, uint64_t expectedHi, uint64_t expectedLo)
+{
+    tf_float x = __floatunsitf(a);
+    int ret = compareResultTF(x, expectedHi, expectedLo);
+    if (ret)
+        printf("error in test__floatunsitf(%u) = 0x%016llx%016llx, "
+               "expected 0x%016llx%016llx\n", a,
+               (unsigned long long)(toRep128(x) >> 64),
+               (unsigned long long)toRep128(x),
+               (unsigned long long)expectedHi, (unsigned long long)expectedLo);
+    return ret;
+}
+#endif
+
+int main()
+{
+#if defined(CRT_HAS_TF_MODE)
+    // 0
+    if (test__floatunsitf(0x00000000U,
+                          0x0000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 1
+    if (test__floatunsitf(0x00000001U,
+                          0x3fff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 2
+    if (test__floatunsitf(0x00000002U,
+                          0x4000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 1234567
+    if (test__floatunsitf(0x0012d687U,
+                          0x40132d6870000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // large value
+    if (test__floatunsitf(0x7fffffffU,
+                          0x401dfffffffc0000ULL, 0x0000000000000000ULL))
+        return 1;
+    // largest value
+    if (test__floatunsitf(0xffffffffU,
+                          0x401efffffffe0000ULL, 0x0000000000000000ULL))
+        return 1;
+    // exact, no rounding
+    if (test__floatunsitf(0x12345678U,
+                          0x401b234567800000ULL, 0x0000000000000000ULL))
+        return 1;
+#else
+    printf("skipped\n");
+#endif
+    return 0;
+}
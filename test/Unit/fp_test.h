@@ -0,0 +1,58 @@
+//===-- fp_test.h - Helpers for the quad-precision tests ------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the binary128 type of the target, as in lib/fp_lib.h, and
+// helpers to build and check values from their representation.  The tests
+// of the quad-precision routines are skipped when CRT_HAS_TF_MODE is not
+// defined.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SIZEOF_INT128__) && \
+    (__LDBL_MANT_DIG__ == 113 || \
+     (defined(__x86_64__) && defined(__SIZEOF_FLOAT128__)))
+#define CRT_HAS_TF_MODE
+
+#if __LDBL_MANT_DIG__ == 113
+typedef long double tf_float;
+#else
+typedef __float128 tf_float;
+#endif
+
+static inline tf_float fromRep128(uint64_t hi, uint64_t lo)
+{
+    const __uint128_t rep = (__uint128_t)hi << 64 | lo;
+    tf_float x;
+    memcpy(&x, &rep, sizeof(x));
+    return x;
+}
+
+static inline __uint128_t toRep128(tf_float x)
+{
+    __uint128_t rep;
+    memcpy(&rep, &x, sizeof(rep));
+    return rep;
+}
+
+// Returns 0 if result has the representation hi:lo, or if both are NaNs.
+static inline int compareResultTF(tf_float result, uint64_t hi, uint64_t lo)
+{
+    const __uint128_t expected = (__uint128_t)hi << 64 | lo;
+    const __uint128_t actual = toRep128(result);
+    const __uint128_t absMask = ~((__uint128_t)1 << 127);
+    const __uint128_t infRep = (__uint128_t)0x7fff << 112;
+    if (actual == expected)
+        return 0;
+    return !((actual & absMask) > infRep && (expected & absMask) > infRep);
+}
+
+#endif
@@ -0,0 +1,79 @@
+//===-- heap_trampoline_test.c - Test __gcc_nested_func_ptr_created -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests the heap trampolines of nested functions for the
+// compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdint.h>
+#include <stdio.h>
+
+#if __x86_64__ && (__linux__ || __APPLE__)
+
+extern void __gcc_nested_func_ptr_created(void *chain, void *func, void **dst);
+extern void __gcc_nested_func_ptr_deleted(void);
+
+// Returns the static chain (r10) plus the argument, like a nested function
+// that reads a local of its parent.
+uintptr_t chain_plus(uintptr_t x);
+__asm__(
+#if __APPLE__
+    "_chain_plus:\n"
+#else
+    "chain_plus:\n"
+#endif
+    "    leaq (%r10,%rdi), %rax\n"
+    "    ret\n");
+
+typedef uintptr_t (*pfunc)(uintptr_t);
+
+#define N 1000
+
+int test_nested(int n)
+{
+    void *t[N];
+    int i;
+    for (i = 0; i < n; ++i)
+        __gcc_nested_func_ptr_created((void *)(uintptr_t)(1000 * i),
+                                      (void *)chain_plus, &t[i]);
+    for (i = 0; i < n; ++i) {
+        uintptr_t r = ((pfunc)t[i])(7);
+        if (r != (uintptr_t)(1000 * i + 7)) {
+            printf("error in trampoline %d of %d: %lu\n", i, n,
+                   (unsigned long)r);
+            return 1;
+        }
+    }
+    for (i = 0; i < n; ++i)
+        __gcc_nested_func_ptr_deleted();
+    return 0;
+}
+
+int main()
+{
+    // Within a block, across several blocks, and reusing the freed ones.
+    if (test_nested(1) || test_nested(N) || test_nested(300))
+        return 1;
+    int i;
+    for (i = 0; i < 100000; ++i)
+        if (test_nested(1))
+            return 1;
+    return 0;
+}
+
+#else
+
+int main()
+{
+    printf("skipped\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,89 @@
+//===-- multf3_test.c - Test __multf3 -------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __multf3 for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include "fp_test.h"
+
+#if defined(CRT_HAS_TF_MODE)
+extern tf_float __multf3(tf_float a, tf_float b);
+
+int test__multf3(uint64_t aHi, uint64_t aLo, uint64_t bHi, uint64_t bLo,
+                 uint64_t expectedHi, uint64_t expectedLo)
+{
+    tf_float x = __multf3(fromRep128(aHi, aLo), fromRep128(bHi, bLo));
+    int ret = compareResultTF(x, expectedHi, expectedLo);
+    if (ret)
+        printf("error in test__multf3(0x%016llx%016llx, 0x%016llx%016llx) = "
+               "0x%016llx%016llx, expected 0x%016llx%016llx\n",
+               (unsigned long long)aHi, (unsigned long long)aLo,
+               (unsigned long long)bHi, (unsigned long long)bLo,
+               (unsigned long long)(toRep128(x) >> 64),
+               (unsigned long long)toRep128(x),
+               (unsigned long long)expectedHi, (unsigned long long)expectedLo);
+    return ret;
+}
+#endif
+
+int main()
+{
+#if defined(CRT_HAS_TF_MODE)
+    // normal * normal
+    if (test__multf3(0x3fff123456789abcULL, 0xdef0123456789abcULL,
+                     0xc003876543210fedULL, 0xcba9876543210fedULL,
+                     0xc003a33a669f6e5cULL, 0x00ba3613cad191b3ULL))
+        return 1;
+    // rounding with a tie
+    if (test__multf3(0x3fff000000000000ULL, 0x0000000000000001ULL,
+                     0x3fff800000000000ULL, 0x0000000000000000ULL,
+                     0x3fff800000000000ULL, 0x0000000000000002ULL))
+        return 1;
+    // overflow to infinity
+    if (test__multf3(0x7ffeffffffffffffULL, 0xffffffffffffffffULL,
+                     0x4000000000000000ULL, 0x0000000000000000ULL,
+                     0x7fff000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // normal * normal = denormal
+    if (test__multf3(0x0001000000000000ULL, 0x0000000000000000ULL,
+                     0x3ff5000000000000ULL, 0x0000000000000000ULL,
+                     0x0000004000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // denormal * normal
+    if (test__multf3(0x0000800000000000ULL, 0x0000000000000003ULL,
+                     0x4000800000000000ULL, 0x0000000000000000ULL,
+                     0x0001800000000000ULL, 0x0000000000000009ULL))
+        return 1;
+    // half the smallest denormal is a tie, rounds to zero
+    if (test__multf3(0x0000000000000000ULL, 0x0000000000000001ULL,
+                     0x3ffe000000000000ULL, 0x0000000000000000ULL,
+                     0x0000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // 1.5 denormal ulps rounds to even
+    if (test__multf3(0x0000000000000000ULL, 0x0000000000000003ULL,
+                     0x3ffe000000000000ULL, 0x0000000000000000ULL,
+                     0x0000000000000000ULL, 0x0000000000000002ULL))
+        return 1;
+    // inf * 0 = qNaN
+    if (test__multf3(0x7fff000000000000ULL, 0x0000000000000000ULL,
+                     0x0000000000000000ULL, 0x0000000000000000ULL,
+                     0x7fff800000000000ULL, 0x0000000000000000ULL))
+        return 1;
+    // -0 * 1 = -0
+    if (test__multf3(0x8000000000000000ULL, 0x0000000000000000ULL,
+                     0x3fff000000000000ULL, 0x0000000000000000ULL,
+                     0x8000000000000000ULL, 0x0000000000000000ULL))
+        return 1;
+#else
+    printf("skipped\n");
+#endif
+    return 0;
+}
@@ -0,0 +1,54 @@
+//===-- popcountdi2_array_test.c - Test __popcountdi2_array ---------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __popcountdi2_array for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include "int_lib.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+si_int __popcountdi2(di_int a);
+du_int __popcountdi2_array(const du_int *a, size_t count);
+
+int test__popcountdi2_array(const du_int *a, size_t count)
+{
+    du_int x = __popcountdi2_array(a, count);
+    du_int expected = 0;
+    size_t i;
+    for (i = 0; i < count; ++i)
+        expected += __popcountdi2(a[i]);
+    if (x != expected)
+        printf("error in __popcountdi2_array(%zu words) = %llu, expected %llu\n",
+               count, x, expected);
+    return x != expected;
+}
+
+int main()
+{
+    static du_int a[10000];
+    size_t i;
+    for (i = 0; i < 10000; ++i)
+        a[i] = ~0uLL;
+    // All ones, more words than fit in a partial sum.
+    for (i = 0; i <= 70; ++i)
+        if (test__popcountdi2_array(a, i))
+            return 1;
+    if (test__popcountdi2_array(a, 10000))
+        return 1;
+    for (i = 0; i < 10000; ++i)
+        a[i] = ((du_int)rand() << 40) ^ ((du_int)rand() << 20) ^ rand();
+    // Unaligned starts and odd lengths.
+    for (i = 0; i < 8; ++i)
+        if (test__popcountdi2_array(a + i, 10000 - 2 * i - 1))
+            return 1;
+    return 0;
+}
@@ -0,0 +1,91 @@
+//===-- truncdfhf2_test.c - Test __truncdfhf2 -----------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __truncdfhf2 for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+extern uint16_t __truncdfhf2(double a);
+
+static double fromRep(uint64_t x)
+{
+    double d;
+    memcpy(&d, &x, sizeof(d));
+    return d;
+}
+
+int test__truncdfhf2(uint64_t a, uint16_t expected)
+{
+    uint16_t actual = __truncdfhf2(fromRep(a));
+    if (actual != expected)
+        printf("error in test__truncdfhf2(0x%016llx) = 0x%04x, "
+               "expected 0x%04x\n", (unsigned long long)a, actual, expected);
+    return actual != expected;
+}
+
+int main()
+{
+    // zeros
+    if (test__truncdfhf2(0x0000000000000000ULL, 0x0000))
+        return 1;
+    if (test__truncdfhf2(0x8000000000000000ULL, 0x8000))
+        return 1;
+    // exact
+    if (test__truncdfhf2(0x3ff0000000000000ULL, 0x3c00))
+        return 1;
+    if (test__truncdfhf2(0x40effc0000000000ULL, 0x7bff))
+        return 1;
+    // ties to even
+    if (test__truncdfhf2(0x3ff0020000000000ULL, 0x3c00))
+        return 1;
+    if (test__truncdfhf2(0x3ff0060000000000ULL, 0x3c02))
+        return 1;
+    // Just above the tie. Rounding to single precision first would make
+    // this a tie and round it down.
+    if (test__truncdfhf2(0x3ff0020000000001ULL, 0x3c01))
+        return 1;
+    if (test__truncdfhf2(0xbff0020000000001ULL, 0xbc01))
+        return 1;
+    // overflow, 65520 is the tie with 2^16
+    if (test__truncdfhf2(0x40effdffffffffffULL, 0x7bff))
+        return 1;
+    if (test__truncdfhf2(0x40effe0000000000ULL, 0x7c00))
+        return 1;
+    if (test__truncdfhf2(0x40f0000000000000ULL, 0x7c00))
+        return 1;
+    if (test__truncdfhf2(0xc0f0000000000000ULL, 0xfc00))
+        return 1;
+    if (test__truncdfhf2(0x7fefffffffffffffULL, 0x7c00))
+        return 1;
+    // denormals
+    if (test__truncdfhf2(0x3e70000000000000ULL, 0x0001))
+        return 1;
+    if (test__truncdfhf2(0x3e60000000000000ULL, 0x0000))
+        return 1;
+    if (test__truncdfhf2(0x3e60000000000001ULL, 0x0001))
+        return 1;
+    if (test__truncdfhf2(0x3f0ff80000000000ULL, 0x03ff))
+        return 1;
+    if (test__truncdfhf2(0x0000000000000001ULL, 0x0000))
+        return 1;
+    // infinities and NaNs
+    if (test__truncdfhf2(0x7ff0000000000000ULL, 0x7c00))
+        return 1;
+    if (test__truncdfhf2(0xfff0000000000000ULL, 0xfc00))
+        return 1;
+    if (test__truncdfhf2(0x7ff8000000000000ULL, 0x7e00))
+        return 1;
+    if (test__truncdfhf2(0xfff8040000000000ULL, 0xfe01))
+        return 1;
+    return 0;
+}
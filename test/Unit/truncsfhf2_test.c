@@ -0,0 +1,120 @@
+//===-- truncsfhf2_test.c - Test __truncsfhf2 -----------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __truncsfhf2 for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+extern uint16_t __truncsfhf2(float a);
+extern uint16_t __gnu_f2h_ieee(float a);
+extern void __truncsfhf2_array(uint16_t *dst, const float *src, size_t count);
+
+static float fromRep(uint32_t x)
+{
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+int test__truncsfhf2(uint32_t a, uint16_t expected)
+{
+    uint16_t actual = __truncsfhf2(fromRep(a));
+    if (actual != expected || __gnu_f2h_ieee(fromRep(a)) != expected)
+        printf("error in test__truncsfhf2(0x%08x) = 0x%04x, expected 0x%04x\n",
+               a, actual, expected);
+    return actual != expected;
+}
+
+int main()
+{
+    // zeros
+    if (test__truncsfhf2(0x00000000, 0x0000))
+        return 1;
+    if (test__truncsfhf2(0x80000000, 0x8000))
+        return 1;
+    // exact
+    if (test__truncsfhf2(0x3f800000, 0x3c00))
+        return 1;
+    if (test__truncsfhf2(0xc0000000, 0xc000))
+        return 1;
+    if (test__truncsfhf2(0x477fe000, 0x7bff))
+        return 1;
+    // round to nearest
+    if (test__truncsfhf2(0x3eaaaaab, 0x3555))
+        return 1;
+    if (test__truncsfhf2(0x3f801001, 0x3c01))
+        return 1;
+    // ties to even
+    if (test__truncsfhf2(0x3f801000, 0x3c00))
+        return 1;
+    if (test__truncsfhf2(0x3f803000, 0x3c02))
+        return 1;
+    if (test__truncsfhf2(0xbf803000, 0xbc02))
+        return 1;
+    // largest finite and overflow, 65520 is the tie with 2^16
+    if (test__truncsfhf2(0x477fefff, 0x7bff))
+        return 1;
+    if (test__truncsfhf2(0x477ff000, 0x7c00))
+        return 1;
+    if (test__truncsfhf2(0x47800000, 0x7c00))
+        return 1;
+    if (test__truncsfhf2(0xc7800000, 0xfc00))
+        return 1;
+    if (test__truncsfhf2(0x7f7fffff, 0x7c00))
+        return 1;
+    // denormals, including the rounding into and out of the normal range
+    if (test__truncsfhf2(0x33800000, 0x0001))
+        return 1;
+    if (test__truncsfhf2(0x33000000, 0x0000))
+        return 1;
+    if (test__truncsfhf2(0x33000001, 0x0001))
+        return 1;
+    if (test__truncsfhf2(0x33c00000, 0x0002))
+        return 1;
+    if (test__truncsfhf2(0x387fc000, 0x03ff))
+        return 1;
+    if (test__truncsfhf2(0x387ff000, 0x0400))
+        return 1;
+    if (test__truncsfhf2(0xb8000000, 0x8200))
+        return 1;
+    if (test__truncsfhf2(0x00000001, 0x0000))
+        return 1;
+    // infinities and NaNs
+    if (test__truncsfhf2(0x7f800000, 0x7c00))
+        return 1;
+    if (test__truncsfhf2(0xff800000, 0xfc00))
+        return 1;
+    if (test__truncsfhf2(0x7fc00000, 0x7e00))
+        return 1;
+    if (test__truncsfhf2(0xffc02000, 0xfe01))
+        return 1;
+    if (test__truncsfhf2(0x7f802000, 0x7e01))
+        return 1;
+
+    // The bulk conversion agrees with the scalar one, including the tail
+    // which doesn't fill a vector.
+    float src[67];
+    uint16_t dst[67];
+    int i;
+    for (i = 0; i < 67; ++i)
+        src[i] = fromRep(0x33000000u + (uint32_t)i * 0x00c30001u);
+    __truncsfhf2_array(dst, src, 67);
+    for (i = 0; i < 67; ++i) {
+        if (dst[i] != __truncsfhf2(src[i])) {
+            printf("error in __truncsfhf2_array at %d\n", i);
+            return 1;
+        }
+    }
+    return 0;
+}
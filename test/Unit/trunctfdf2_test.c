@@ -0,0 +1,121 @@
+//===-- trunctfdf2_test.c - Test __trunctfdf2 -----------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __trunctfdf2 for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include "fp_test.h"
+
+#if defined(CRT_HAS_TF_MODE)
+extern double __trunctfdf2(tf_float a);
+
+int test__trunctfdf2(uint64_t aHi, uint64_t aLo, uint64_t expected)
+{
+    const double f = __trunctfdf2(fromRep128(aHi, aLo));
+    uint64_t x;
+    memcpy(&x, &f, sizeof(x));
+    if (x != expected)
+        printf("error in test__trunctfdf2(0x%016llx%016llx) = 0x%016llx, "
+               "expected 0x%016llx\n", (unsigned long long)aHi,
+               (unsigned long long)aLo, (unsigned long long)x,
+               (unsigned long long)expected);
+    return x != expected;
+}
+#endif
+
+int main()
+{
+#if defined(CRT_HAS_TF_MODE)
+    // +0
+    if (test__trunctfdf2(0x0000000000000000ULL, 0x0000000000000000ULL,
+                         0x0000000000000000ULL))
+        return 1;
+    // -0
+    if (test__trunctfdf2(0x8000000000000000ULL, 0x0000000000000000ULL,
+                         0x8000000000000000ULL))
+        return 1;
+    // 1
+    if (test__trunctfdf2(0x3fff000000000000ULL, 0x0000000000000000ULL,
+                         0x3ff0000000000000ULL))
+        return 1;
+    // pi
+    if (test__trunctfdf2(0x4000921fb54442d1ULL, 0x8469898cc51701b8ULL,
+                         0x400921fb54442d18ULL))
+        return 1;
+    // tie rounds to even (down)
+    if (test__trunctfdf2(0x3fff000000000000ULL, 0x0800000000000000ULL,
+                         0x3ff0000000000000ULL))
+        return 1;
+    // tie rounds to even (up)
+    if (test__trunctfdf2(0x3fff000000000000ULL, 0x1800000000000000ULL,
+                         0x3ff0000000000002ULL))
+        return 1;
+    // just above the tie rounds up
+    if (test__trunctfdf2(0x3fff000000000000ULL, 0x0800000000001000ULL,
+                         0x3ff0000000000001ULL))
+        return 1;
+    // just above the tie rounds up, negative
+    if (test__trunctfdf2(0xbfff000000000000ULL, 0x0800000000001000ULL,
+                         0xbff0000000000001ULL))
+        return 1;
+    // largest normal
+    if (test__trunctfdf2(0x43feffffffffffffULL, 0xf000000000000000ULL,
+                         0x7fefffffffffffffULL))
+        return 1;
+    // tie with the overflow threshold goes to infinity
+    if (test__trunctfdf2(0x43feffffffffffffULL, 0xf7ffffffffffffc0ULL,
+                         0x7fefffffffffffffULL))
+        return 1;
+    // overflow
+    if (test__trunctfdf2(0x43ffffffffffffffULL, 0xf000000000000000ULL,
+                         0x7ff0000000000000ULL))
+        return 1;
+    // smallest denormal
+    if (test__trunctfdf2(0x3bcd000000000000ULL, 0x0000000000000000ULL,
+                         0x0000000000000001ULL))
+        return 1;
+    // half the smallest denormal is a tie, rounds to zero
+    if (test__trunctfdf2(0x3bcc000000000000ULL, 0x0000000000000000ULL,
+                         0x0000000000000000ULL))
+        return 1;
+    // just above half the smallest denormal
+    if (test__trunctfdf2(0x3bcc000000000000ULL, 0x0000000000000000ULL,
+                         0x0000000000000000ULL))
+        return 1;
+    // 1.5 smallest denormals rounds to even
+    if (test__trunctfdf2(0x3bcd800000000000ULL, 0x0000000000000000ULL,
+                         0x0000000000000002ULL))
+        return 1;
+    // quad denormal underflows to zero
+    if (test__trunctfdf2(0x0000ffffffffffffULL, 0xffffffffffffffffULL,
+                         0x0000000000000000ULL))
+        return 1;
+    // inf
+    if (test__trunctfdf2(0x7fff000000000000ULL, 0x0000000000000000ULL,
+                         0x7ff0000000000000ULL))
+        return 1;
+    // -inf
+    if (test__trunctfdf2(0xffff000000000000ULL, 0x0000000000000000ULL,
+                         0xfff0000000000000ULL))
+        return 1;
+    // qNaN
+    if (test__trunctfdf2(0x7fff800000000000ULL, 0x0000000000000000ULL,
+                         0x7ff8000000000000ULL))
+        return 1;
+    // sNaN is quieted
+    if (test__trunctfdf2(0x7fff400000000000ULL, 0x0000000000001234ULL,
+                         0x7ffc000000000000ULL))
+        return 1;
+#else
+    printf("skipped\n");
+#endif
+    return 0;
+}
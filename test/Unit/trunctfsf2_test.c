@@ -0,0 +1,120 @@
+//===-- trunctfsf2_test.c - Test __trunctfsf2 -----------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __trunctfsf2 for the compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include "fp_test.h"
+
+#if defined(CRT_HAS_TF_MODE)
+extern float __trunctfsf2(tf_float a);
+
+int test__trunctfsf2(uint64_t aHi, uint64_t aLo, uint32_t expected)
+{
+    const float f = __trunctfsf2(fromRep128(aHi, aLo));
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    if (x != expected)
+        printf("error in test__trunctfsf2(0x%016llx%016llx) = 0x%08x, "
+               "expected 0x%08x\n", (unsigned long long)aHi,
+               (unsigned long long)aLo, x, expected);
+    return x != expected;
+}
+#endif
+
+int main()
+{
+#if defined(CRT_HAS_TF_MODE)
+    // +0
+    if (test__trunctfsf2(0x0000000000000000ULL, 0x0000000000000000ULL,
+                         0x00000000U))
+        return 1;
+    // -0
+    if (test__trunctfsf2(0x8000000000000000ULL, 0x0000000000000000ULL,
+                         0x80000000U))
+        return 1;
+    // 1
+    if (test__trunctfsf2(0x3fff000000000000ULL, 0x0000000000000000ULL,
+                         0x3f800000U))
+        return 1;
+    // pi
+    if (test__trunctfsf2(0x4000921fb54442d1ULL, 0x8469898cc51701b8ULL,
+                         0x40490fdbU))
+        return 1;
+    // tie rounds to even (down)
+    if (test__trunctfsf2(0x3fff000001000000ULL, 0x0000000000000000ULL,
+                         0x3f800000U))
+        return 1;
+    // tie rounds to even (up)
+    if (test__trunctfsf2(0x3fff000003000000ULL, 0x0000000000000000ULL,
+                         0x3f800002U))
+        return 1;
+    // just above the tie rounds up
+    if (test__trunctfsf2(0x3fff000001000000ULL, 0x0000000000001000ULL,
+                         0x3f800001U))
+        return 1;
+    // just above the tie rounds up, negative
+    if (test__trunctfsf2(0xbfff000001000000ULL, 0x0000000000001000ULL,
+                         0xbf800001U))
+        return 1;
+    // largest normal
+    if (test__trunctfsf2(0x407efffffe000000ULL, 0x0000000000000000ULL,
+                         0x7f7fffffU))
+        return 1;
+    // tie with the overflow threshold goes to infinity
+    if (test__trunctfsf2(0x407efffffeffffffULL, 0x0000000000000000ULL,
+                         0x7f7fffffU))
+        return 1;
+    // overflow
+    if (test__trunctfsf2(0x407ffffffe000000ULL, 0x0000000000000000ULL,
+                         0x7f800000U))
+        return 1;
+    // smallest denormal
+    if (test__trunctfsf2(0x3f6a000000000000ULL, 0x0000000000000000ULL,
+                         0x00000001U))
+        return 1;
+    // half the smallest denormal is a tie, rounds to zero
+    if (test__trunctfsf2(0x3f69000000000000ULL, 0x0000000000000000ULL,
+                         0x00000000U))
+        return 1;
+    // just above half the smallest denormal
+    if (test__trunctfsf2(0x3f69000000000000ULL, 0x0000000000000000ULL,
+                         0x00000000U))
+        return 1;
+    // 1.5 smallest denormals rounds to even
+    if (test__trunctfsf2(0x3f6a800000000000ULL, 0x0000000000000000ULL,
+                         0x00000002U))
+        return 1;
+    // quad denormal underflows to zero
+    if (test__trunctfsf2(0x0000ffffffffffffULL, 0xffffffffffffffffULL,
+                         0x00000000U))
+        return 1;
+    // inf
+    if (test__trunctfsf2(0x7fff000000000000ULL, 0x0000000000000000ULL,
+                         0x7f800000U))
+        return 1;
+    // -inf
+    if (test__trunctfsf2(0xffff000000000000ULL, 0x0000000000000000ULL,
+                         0xff800000U))
+        return 1;
+    // qNaN
+    if (test__trunctfsf2(0x7fff800000000000ULL, 0x0000000000000000ULL,
+                         0x7fc00000U))
+        return 1;
+    // sNaN is quieted
+    if (test__trunctfsf2(0x7fff400000000000ULL, 0x0000000000001234ULL,
+                         0x7fe00000U))
+        return 1;
+#else
+    printf("skipped\n");
+#endif
+    return 0;
+}
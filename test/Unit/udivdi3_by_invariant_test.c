@@ -0,0 +1,75 @@
+//===-- udivdi3_by_invariant_test.c - Test __udivdi3_by_invariant ---------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is dual licensed under the MIT and the University of Illinois Open
+// Source Licenses. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file tests __udivdi3_by_invariant and __umoddi3_by_invariant for the
+// compiler_rt library.
+//
+//===----------------------------------------------------------------------===//
+
+#include "udivdi3_by_invariant.h"
+#include <stdio.h>
+
+int test__udivdi3_by_invariant(du_int a, du_int b)
+{
+    udivdi3_invariant inv;
+    __udivdi3_invariant_init(&inv, b);
+    du_int q = __udivdi3_by_invariant(a, &inv);
+    du_int r = __umoddi3_by_invariant(a, &inv);
+    if (q != a / b || r != a % b)
+    {
+        printf("error in __udivdi3_by_invariant: %llu / %llu = %llu rem %llu, "
+               "expected %llu rem %llu\n", a, b, q, r, a / b, a % b);
+        return 1;
+    }
+    return 0;
+}
+
+static const du_int values[] =
+{
+    0, 1, 2, 3, 5, 7, 10, 641, 1000, 0x7FFFFFFFuLL, 0x80000000uLL,
+    0xFFFFFFFFuLL, 0x100000000uLL, 0x100000001uLL, 1000000000uLL,
+    1000000007uLL, 6700417uLL * 641uLL, 0x123456789ABCDEFuLL,
+    0x7FFFFFFFFFFFFFFFuLL, 0x8000000000000000uLL, 0x8000000000000001uLL,
+    0xFFFFFFFFFFFFFFFEuLL, 0xFFFFFFFFFFFFFFFFuLL
+};
+
+int main()
+{
+    const int n = sizeof(values) / sizeof(values[0]);
+    int i, j, k;
+    for (j = 0; j < n; ++j)
+    {
+        if (values[j] == 0)
+            continue;
+        for (i = 0; i < n; ++i)
+            if (test__udivdi3_by_invariant(values[i], values[j]))
+                return 1;
+    }
+    // Every divisor with a single, two or all but one bits set, against
+    // dividends near multiples of it.
+    for (k = 0; k < 64; ++k)
+    {
+        for (j = 0; j < 64; ++j)
+        {
+            const du_int d = ((du_int)1 << k) | ((du_int)1 << j);
+            const du_int divisors[2] = {d, ~d ? ~d : 1};
+            int m;
+            for (m = 0; m < 2; ++m)
+                for (i = 0; i < n; ++i)
+                {
+                    const du_int a = values[i] / divisors[m] * divisors[m];
+                    if (test__udivdi3_by_invariant(a, divisors[m]) ||
+                        test__udivdi3_by_invariant(a - 1, divisors[m]) ||
+                        test__udivdi3_by_invariant(values[i], divisors[m]))
+                        return 1;
+                }
+        }
+    }
+    return 0;
+}
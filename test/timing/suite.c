@@ -0,0 +1,534 @@
+// Times the integer, soft-float, complex, conversion and comparison builtins
+// in one run, with random and edge-case operands. Unlike the per-function
+// programs in this directory, the output is one "function,operands,time" line
+// per measurement (time in TIMING_UNIT per call), so that runs can be compared
+// with a script:
+//
+//   ./suite [-o random|edge] [name-substring...]
+//
+// Built with -DTF_ONLY, only the quad-precision functions are timed, which
+// allows comparing them with libgcc's soft-fp ones (which the programs using
+// __float128 and libquadmath call today) on the hosts where libgcc lacks the
+// other soft-float functions.
+
+#include "timing.h"
+#include "int_lib.h"
+#include <stdio.h>
+#include <string.h>
+
+#define INPUT_SIZE 512
+#define TRIALS 256
+
+#ifndef LIBNAME
+#define LIBNAME UNKNOWN
+#endif
+
+#define LIBSTRING		LIBSTRINGX(LIBNAME)
+#define LIBSTRINGX(a)	LIBSTRINGXX(a)
+#define LIBSTRINGXX(a)	#a
+
+enum distribution { RANDOM, EDGE };
+static const char *distributionNames[] = { "random", "edge" };
+
+// xorshift64, so that the operands are the same on every run and platform.
+static uint64_t randomState = 88172645463325252ULL;
+static uint64_t random64(void) {
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 7;
+	randomState ^= randomState << 17;
+	return randomState;
+}
+
+// Values of various magnitudes, as in the per-function programs.
+static du_int randomMagnitude(void) {
+	return random64() >> (random64() & 63);
+}
+
+static unsigned edgeIndex;
+#define EDGE_VALUE(table) (table[edgeIndex++ % (sizeof(table) / sizeof(table[0]))])
+
+static si_int gen_si(enum distribution d) {
+	static const si_int edges[] = { 0, 1, -1, 2, -2, 0x7fffffff, -0x7fffffff - 1,
+		0x10000, 0x7ffe, -0x8000, 3, -3 };
+	if (d == EDGE)
+		return EDGE_VALUE(edges);
+	return (si_int)(random64() >> (32 + (random64() & 31))) *
+	       ((random64() & 1) ? 1 : -1);
+}
+
+static di_int gen_di(enum distribution d) {
+	static const di_int edges[] = { 0, 1, -1, 2, -2, INT64_MAX, INT64_MIN,
+		0xffffffffLL, 0x100000000LL, -0x100000000LL, 3, -3 };
+	if (d == EDGE)
+		return EDGE_VALUE(edges);
+	return (di_int)randomMagnitude() * ((random64() & 1) ? 1 : -1);
+}
+
+#if __x86_64
+static ti_int gen_ti(enum distribution d) {
+	static const du_int edges[][2] = { { 0, 0 }, { 0, 1 }, { ~0ULL, ~0ULL },
+		{ 0, 2 }, { 0x7fffffffffffffffULL, ~0ULL }, { 0x8000000000000000ULL, 0 },
+		{ 0, ~0ULL }, { 1, 0 }, { ~0ULL, 0 }, { 0, 3 } };
+	if (d == EDGE) {
+		const du_int *e = edges[edgeIndex++ % (sizeof(edges) / sizeof(edges[0]))];
+		return (ti_int)(((tu_int)e[0] << 64) | e[1]);
+	}
+	return (ti_int)((((tu_int)random64() << 64) | random64()) >> (random64() & 127));
+}
+#endif
+
+// Divisors: no zero, and no -1 which overflows with the minimum dividend.
+static si_int gen_si_divisor(enum distribution d) {
+	si_int v = gen_si(d);
+	return v == 0 || v == -1 ? 7 : v;
+}
+static di_int gen_di_divisor(enum distribution d) {
+	di_int v = gen_di(d);
+	return v == 0 || v == -1 ? 7 : v;
+}
+#if __x86_64
+static ti_int gen_ti_divisor(enum distribution d) {
+	ti_int v = gen_ti(d);
+	return v == 0 || v == -1 ? 7 : v;
+}
+#endif
+
+static si_int gen_shift64(enum distribution d) {
+	static const si_int edges[] = { 0, 1, 31, 32, 33, 63 };
+	return d == EDGE ? EDGE_VALUE(edges) : (si_int)(random64() & 63);
+}
+#if __x86_64
+static si_int gen_shift128(enum distribution d) {
+	static const si_int edges[] = { 0, 1, 63, 64, 65, 127 };
+	return d == EDGE ? EDGE_VALUE(edges) : (si_int)(random64() & 127);
+}
+#endif
+
+// Random floating point operands are normal numbers with exponents around 0,
+// so that additions mostly need alignment shifts and products don't
+// overflow. The edge cases are the zeros, infinities, NaN and denormals.
+static float gen_sf(enum distribution d) {
+	static const uint32_t edges[] = { 0x00000000, 0x80000000, 0x7f800000,
+		0xff800000, 0x7fc00000, 0x00000001, 0x007fffff, 0x00800000, 0x7f7fffff,
+		0x3f800000, 0xbf800000, 0x3f000000 };
+	union { uint32_t i; float f; } u;
+	if (d == EDGE)
+		u.i = EDGE_VALUE(edges);
+	else
+		u.i = (uint32_t)(random64() & 0x807fffff) |
+		      ((uint32_t)(127 - 24 + (random64() % 48)) << 23);
+	return u.f;
+}
+
+static double gen_df(enum distribution d) {
+	static const uint64_t edges[] = { 0x0000000000000000ULL,
+		0x8000000000000000ULL, 0x7ff0000000000000ULL, 0xfff0000000000000ULL,
+		0x7ff8000000000000ULL, 0x0000000000000001ULL, 0x000fffffffffffffULL,
+		0x0010000000000000ULL, 0x7fefffffffffffffULL, 0x3ff0000000000000ULL,
+		0xbff0000000000000ULL, 0x3fe0000000000000ULL };
+	union { uint64_t i; double f; } u;
+	if (d == EDGE)
+		u.i = EDGE_VALUE(edges);
+	else
+		u.i = (random64() & 0x800fffffffffffffULL) |
+		      ((uint64_t)(1023 - 53 + (random64() % 106)) << 52);
+	return u.f;
+}
+
+// binary128, as in lib/fp_lib.h.
+#if defined(__SIZEOF_INT128__) && \
+    (__LDBL_MANT_DIG__ == 113 || \
+     (defined(__x86_64__) && defined(__SIZEOF_FLOAT128__)))
+#define HAS_TF_MODE 1
+#if __LDBL_MANT_DIG__ == 113
+typedef long double tf_float;
+#else
+typedef __float128 tf_float;
+#endif
+
+static tf_float gen_tf(enum distribution d) {
+	static const uint64_t edges[][2] = { { 0, 0 }, { 0x8000000000000000ULL, 0 },
+		{ 0x7fff000000000000ULL, 0 }, { 0xffff000000000000ULL, 0 },
+		{ 0x7fff800000000000ULL, 0 }, { 0, 1 }, { 0x0000ffffffffffffULL, ~0ULL },
+		{ 0x0001000000000000ULL, 0 }, { 0x7ffeffffffffffffULL, ~0ULL },
+		{ 0x3fff000000000000ULL, 0 }, { 0xbfff000000000000ULL, 0 },
+		{ 0x3ffe000000000000ULL, 0 } };
+	union { unsigned __int128 i; tf_float f; } u;
+	if (d == EDGE) {
+		const uint64_t *e = edges[edgeIndex++ % (sizeof(edges) / sizeof(edges[0]))];
+		u.i = ((unsigned __int128)e[0] << 64) | e[1];
+	} else {
+		u.i = ((unsigned __int128)(random64() & 0x8000ffffffffffffULL) << 64) |
+		      random64();
+		u.i |= (unsigned __int128)(16383 - 113 + (random64() % 226)) << 112;
+	}
+	return u.f;
+}
+#else
+#define HAS_TF_MODE 0
+#endif
+
+#define gen_su(d) ((su_int)gen_si(d))
+#define gen_du(d) ((du_int)gen_di(d))
+#define gen_tu(d) ((tu_int)gen_ti(d))
+#define gen_su_divisor(d) ((su_int)gen_si_divisor(d))
+#define gen_du_divisor(d) ((du_int)gen_di_divisor(d))
+#define gen_tu_divisor(d) ((tu_int)gen_ti_divisor(d))
+
+// The results are folded into a volatile, so that the calls can't be dropped.
+static volatile du_int sink;
+
+static du_int fold(const void *p, size_t size) {
+	du_int v = 0;
+	memcpy(&v, p, size < sizeof(v) ? size : sizeof(v));
+	return v;
+}
+
+// The body of time_<fn>(), which returns the best time per call over TRIALS
+// runs through the operands. CALL is evaluated for operand i.
+#define TIMED_LOOP(R, CALL)                                                 \
+	double bestTime = __builtin_inf();                                      \
+	int i, j;                                                               \
+	for (j = 0; j < TRIALS; ++j) {                                          \
+		du_int acc = 0;                                                     \
+		uint64_t startTime = mach_absolute_time();                          \
+		for (i = 0; i < INPUT_SIZE; ++i) {                                  \
+			R r = CALL;                                                     \
+			acc ^= fold(&r, sizeof(r));                                     \
+		}                                                                   \
+		uint64_t endTime = mach_absolute_time();                            \
+		sink = acc;                                                         \
+		double thisTime = intervalInCycles(startTime, endTime);             \
+		bestTime = __builtin_fmin(thisTime, bestTime);                      \
+	}                                                                       \
+	return bestTime / (double) INPUT_SIZE;
+
+#define UNARY(fn, R, A, genA)                                               \
+	COMPILER_RT_ABI R fn(A);                                                \
+	static double time_##fn(enum distribution d) {                          \
+		static A a[INPUT_SIZE];                                             \
+		int k;                                                              \
+		for (k = 0; k < INPUT_SIZE; ++k)                                    \
+			a[k] = genA(d);                                                 \
+		TIMED_LOOP(R, fn(a[i]))                                             \
+	}
+
+#define BINARY(fn, R, A, genA, B, genB)                                     \
+	COMPILER_RT_ABI R fn(A, B);                                             \
+	static double time_##fn(enum distribution d) {                          \
+		static A a[INPUT_SIZE];                                             \
+		static B b[INPUT_SIZE];                                             \
+		int k;                                                              \
+		for (k = 0; k < INPUT_SIZE; ++k) {                                  \
+			a[k] = genA(d);                                                 \
+			b[k] = genB(d);                                                 \
+		}                                                                   \
+		TIMED_LOOP(R, fn(a[i], b[i]))                                       \
+	}
+
+// For the functions with a result pointer third argument.
+#define BINARY_PTR(fn, R, A, genA, B, genB, P)                              \
+	COMPILER_RT_ABI R fn(A, B, P *);                                        \
+	static double time_##fn(enum distribution d) {                          \
+		static A a[INPUT_SIZE];                                             \
+		static B b[INPUT_SIZE];                                             \
+		P p;                                                                \
+		int k;                                                              \
+		for (k = 0; k < INPUT_SIZE; ++k) {                                  \
+			a[k] = genA(d);                                                 \
+			b[k] = genB(d);                                                 \
+		}                                                                   \
+		TIMED_LOOP(R, fn(a[i], b[i], &p))                                   \
+	}
+
+// For the complex multiplication and division, (a + ib) op (c + id).
+#define COMPLEX(fn, T, genT)                                                \
+	COMPILER_RT_ABI T _Complex fn(T, T, T, T);                              \
+	static double time_##fn(enum distribution d) {                          \
+		static T a[INPUT_SIZE][4];                                          \
+		int k, l;                                                           \
+		for (k = 0; k < INPUT_SIZE; ++k)                                    \
+			for (l = 0; l < 4; ++l)                                         \
+				a[k][l] = genT(d);                                          \
+		TIMED_LOOP(T _Complex, fn(a[i][0], a[i][1], a[i][2], a[i][3]))      \
+	}
+
+#ifndef TF_ONLY
+// Integer division.
+BINARY(__divsi3, si_int, si_int, gen_si, si_int, gen_si_divisor)
+BINARY(__udivsi3, su_int, su_int, gen_su, su_int, gen_su_divisor)
+BINARY(__modsi3, si_int, si_int, gen_si, si_int, gen_si_divisor)
+BINARY(__umodsi3, su_int, su_int, gen_su, su_int, gen_su_divisor)
+BINARY_PTR(__divmodsi4, si_int, si_int, gen_si, si_int, gen_si_divisor, si_int)
+BINARY_PTR(__udivmodsi4, su_int, su_int, gen_su, su_int, gen_su_divisor, su_int)
+BINARY(__divdi3, di_int, di_int, gen_di, di_int, gen_di_divisor)
+BINARY(__udivdi3, du_int, du_int, gen_du, du_int, gen_du_divisor)
+BINARY(__moddi3, di_int, di_int, gen_di, di_int, gen_di_divisor)
+BINARY(__umoddi3, du_int, du_int, gen_du, du_int, gen_du_divisor)
+BINARY_PTR(__divmoddi4, di_int, di_int, gen_di, di_int, gen_di_divisor, di_int)
+BINARY_PTR(__udivmoddi4, du_int, du_int, gen_du, du_int, gen_du_divisor, du_int)
+#if __x86_64
+BINARY(__divti3, ti_int, ti_int, gen_ti, ti_int, gen_ti_divisor)
+BINARY(__udivti3, tu_int, tu_int, gen_tu, tu_int, gen_tu_divisor)
+BINARY(__modti3, ti_int, ti_int, gen_ti, ti_int, gen_ti_divisor)
+BINARY(__umodti3, tu_int, tu_int, gen_tu, tu_int, gen_tu_divisor)
+BINARY_PTR(__udivmodti4, tu_int, tu_int, gen_tu, tu_int, gen_tu_divisor, tu_int)
+#endif
+
+// Shifts.
+BINARY(__ashldi3, di_int, di_int, gen_di, si_int, gen_shift64)
+BINARY(__ashrdi3, di_int, di_int, gen_di, si_int, gen_shift64)
+BINARY(__lshrdi3, di_int, di_int, gen_di, si_int, gen_shift64)
+#if __x86_64
+BINARY(__ashlti3, ti_int, ti_int, gen_ti, si_int, gen_shift128)
+BINARY(__ashrti3, ti_int, ti_int, gen_ti, si_int, gen_shift128)
+BINARY(__lshrti3, ti_int, ti_int, gen_ti, si_int, gen_shift128)
+#endif
+
+// Multiplication.
+BINARY(__muldi3, di_int, di_int, gen_di, di_int, gen_di)
+BINARY_PTR(__mulosi4, si_int, si_int, gen_si, si_int, gen_si, int)
+BINARY_PTR(__mulodi4, di_int, di_int, gen_di, di_int, gen_di, int)
+#if __x86_64
+BINARY(__multi3, ti_int, ti_int, gen_ti, ti_int, gen_ti)
+BINARY_PTR(__muloti4, ti_int, ti_int, gen_ti, ti_int, gen_ti, int)
+#endif
+
+// Soft-float arithmetic.
+BINARY(__addsf3, float, float, gen_sf, float, gen_sf)
+BINARY(__subsf3, float, float, gen_sf, float, gen_sf)
+BINARY(__mulsf3, float, float, gen_sf, float, gen_sf)
+BINARY(__divsf3, float, float, gen_sf, float, gen_sf)
+UNARY(__negsf2, float, float, gen_sf)
+BINARY(__adddf3, double, double, gen_df, double, gen_df)
+BINARY(__subdf3, double, double, gen_df, double, gen_df)
+BINARY(__muldf3, double, double, gen_df, double, gen_df)
+BINARY(__divdf3, double, double, gen_df, double, gen_df)
+UNARY(__negdf2, double, double, gen_df)
+
+// Conversions.
+UNARY(__extendsfdf2, double, float, gen_sf)
+UNARY(__truncdfsf2, float, double, gen_df)
+UNARY(__fixsfsi, si_int, float, gen_sf)
+UNARY(__fixdfsi, si_int, double, gen_df)
+UNARY(__fixsfdi, di_int, float, gen_sf)
+UNARY(__fixdfdi, di_int, double, gen_df)
+UNARY(__fixunssfsi, su_int, float, gen_sf)
+UNARY(__fixunsdfsi, su_int, double, gen_df)
+UNARY(__fixunssfdi, du_int, float, gen_sf)
+UNARY(__fixunsdfdi, du_int, double, gen_df)
+UNARY(__floatsisf, float, si_int, gen_si)
+UNARY(__floatsidf, double, si_int, gen_si)
+UNARY(__floatunsisf, float, su_int, gen_su)
+UNARY(__floatunsidf, double, su_int, gen_su)
+UNARY(__floatdisf, float, di_int, gen_di)
+UNARY(__floatdidf, double, di_int, gen_di)
+UNARY(__floatundisf, float, du_int, gen_du)
+UNARY(__floatundidf, double, du_int, gen_du)
+#if __x86_64
+UNARY(__fixsfti, ti_int, float, gen_sf)
+UNARY(__fixdfti, ti_int, double, gen_df)
+UNARY(__fixunssfti, tu_int, float, gen_sf)
+UNARY(__fixunsdfti, tu_int, double, gen_df)
+UNARY(__floattisf, float, ti_int, gen_ti)
+UNARY(__floattidf, double, ti_int, gen_ti)
+UNARY(__floatuntisf, float, tu_int, gen_tu)
+UNARY(__floatuntidf, double, tu_int, gen_tu)
+#endif
+
+// Comparisons.
+BINARY(__eqsf2, int, float, gen_sf, float, gen_sf)
+BINARY(__lesf2, int, float, gen_sf, float, gen_sf)
+BINARY(__ltsf2, int, float, gen_sf, float, gen_sf)
+BINARY(__gesf2, int, float, gen_sf, float, gen_sf)
+BINARY(__unordsf2, int, float, gen_sf, float, gen_sf)
+BINARY(__eqdf2, int, double, gen_df, double, gen_df)
+BINARY(__ledf2, int, double, gen_df, double, gen_df)
+BINARY(__ltdf2, int, double, gen_df, double, gen_df)
+BINARY(__gedf2, int, double, gen_df, double, gen_df)
+BINARY(__unorddf2, int, double, gen_df, double, gen_df)
+BINARY(__cmpdi2, si_int, di_int, gen_di, di_int, gen_di)
+BINARY(__ucmpdi2, si_int, du_int, gen_du, du_int, gen_du)
+#if __x86_64
+BINARY(__cmpti2, si_int, ti_int, gen_ti, ti_int, gen_ti)
+BINARY(__ucmpti2, si_int, tu_int, gen_tu, tu_int, gen_tu)
+#endif
+
+// Complex arithmetic.
+COMPLEX(__mulsc3, float, gen_sf)
+COMPLEX(__divsc3, float, gen_sf)
+COMPLEX(__muldc3, double, gen_df)
+COMPLEX(__divdc3, double, gen_df)
+#if !_ARCH_PPC
+COMPLEX(__mulxc3, long double, gen_df)
+COMPLEX(__divxc3, long double, gen_df)
+#endif
+
+#if __arm__ && __VFP_FP__
+// The VFP variants in lib/arm.
+BINARY(__addsf3vfp, float, float, gen_sf, float, gen_sf)
+BINARY(__subsf3vfp, float, float, gen_sf, float, gen_sf)
+BINARY(__mulsf3vfp, float, float, gen_sf, float, gen_sf)
+BINARY(__divsf3vfp, float, float, gen_sf, float, gen_sf)
+BINARY(__adddf3vfp, double, double, gen_df, double, gen_df)
+BINARY(__subdf3vfp, double, double, gen_df, double, gen_df)
+BINARY(__muldf3vfp, double, double, gen_df, double, gen_df)
+BINARY(__divdf3vfp, double, double, gen_df, double, gen_df)
+UNARY(__extendsfdf2vfp, double, float, gen_sf)
+UNARY(__truncdfsf2vfp, float, double, gen_df)
+UNARY(__fixsfsivfp, si_int, float, gen_sf)
+UNARY(__fixdfsivfp, si_int, double, gen_df)
+UNARY(__floatsisfvfp, float, si_int, gen_si)
+UNARY(__floatsidfvfp, double, si_int, gen_si)
+BINARY(__eqsf2vfp, int, float, gen_sf, float, gen_sf)
+BINARY(__ltsf2vfp, int, float, gen_sf, float, gen_sf)
+BINARY(__eqdf2vfp, int, double, gen_df, double, gen_df)
+BINARY(__ltdf2vfp, int, double, gen_df, double, gen_df)
+#endif
+#endif // TF_ONLY
+
+#if HAS_TF_MODE
+// Quad precision.
+BINARY(__addtf3, tf_float, tf_float, gen_tf, tf_float, gen_tf)
+BINARY(__subtf3, tf_float, tf_float, gen_tf, tf_float, gen_tf)
+BINARY(__multf3, tf_float, tf_float, gen_tf, tf_float, gen_tf)
+BINARY(__divtf3, tf_float, tf_float, gen_tf, tf_float, gen_tf)
+BINARY(__eqtf2, int, tf_float, gen_tf, tf_float, gen_tf)
+BINARY(__lttf2, int, tf_float, gen_tf, tf_float, gen_tf)
+BINARY(__getf2, int, tf_float, gen_tf, tf_float, gen_tf)
+BINARY(__unordtf2, int, tf_float, gen_tf, tf_float, gen_tf)
+UNARY(__extendsftf2, tf_float, float, gen_sf)
+UNARY(__extenddftf2, tf_float, double, gen_df)
+UNARY(__trunctfsf2, float, tf_float, gen_tf)
+UNARY(__trunctfdf2, double, tf_float, gen_tf)
+UNARY(__fixtfsi, si_int, tf_float, gen_tf)
+UNARY(__fixtfdi, di_int, tf_float, gen_tf)
+UNARY(__fixunstfsi, su_int, tf_float, gen_tf)
+UNARY(__fixunstfdi, du_int, tf_float, gen_tf)
+UNARY(__floatsitf, tf_float, si_int, gen_si)
+UNARY(__floatditf, tf_float, di_int, gen_di)
+UNARY(__floatunsitf, tf_float, su_int, gen_su)
+UNARY(__floatunditf, tf_float, du_int, gen_du)
+#endif
+
+struct benchmark {
+	const char *name;
+	double (*time)(enum distribution);
+};
+
+#define BENCHMARK(fn) { #fn, time_##fn }
+
+static const struct benchmark benchmarks[] = {
+#ifndef TF_ONLY
+	BENCHMARK(__divsi3), BENCHMARK(__udivsi3), BENCHMARK(__modsi3),
+	BENCHMARK(__umodsi3), BENCHMARK(__divmodsi4), BENCHMARK(__udivmodsi4),
+	BENCHMARK(__divdi3), BENCHMARK(__udivdi3), BENCHMARK(__moddi3),
+	BENCHMARK(__umoddi3), BENCHMARK(__divmoddi4), BENCHMARK(__udivmoddi4),
+#if __x86_64
+	BENCHMARK(__divti3), BENCHMARK(__udivti3), BENCHMARK(__modti3),
+	BENCHMARK(__umodti3), BENCHMARK(__udivmodti4),
+#endif
+	BENCHMARK(__ashldi3), BENCHMARK(__ashrdi3), BENCHMARK(__lshrdi3),
+#if __x86_64
+	BENCHMARK(__ashlti3), BENCHMARK(__ashrti3), BENCHMARK(__lshrti3),
+#endif
+	BENCHMARK(__muldi3), BENCHMARK(__mulosi4), BENCHMARK(__mulodi4),
+#if __x86_64
+	BENCHMARK(__multi3), BENCHMARK(__muloti4),
+#endif
+	BENCHMARK(__addsf3), BENCHMARK(__subsf3), BENCHMARK(__mulsf3),
+	BENCHMARK(__divsf3), BENCHMARK(__negsf2),
+	BENCHMARK(__adddf3), BENCHMARK(__subdf3), BENCHMARK(__muldf3),
+	BENCHMARK(__divdf3), BENCHMARK(__negdf2),
+	BENCHMARK(__extendsfdf2), BENCHMARK(__truncdfsf2),
+	BENCHMARK(__fixsfsi), BENCHMARK(__fixdfsi), BENCHMARK(__fixsfdi),
+	BENCHMARK(__fixdfdi), BENCHMARK(__fixunssfsi), BENCHMARK(__fixunsdfsi),
+	BENCHMARK(__fixunssfdi), BENCHMARK(__fixunsdfdi),
+	BENCHMARK(__floatsisf), BENCHMARK(__floatsidf), BENCHMARK(__floatunsisf),
+	BENCHMARK(__floatunsidf), BENCHMARK(__floatdisf), BENCHMARK(__floatdidf),
+	BENCHMARK(__floatundisf), BENCHMARK(__floatundidf),
+#if __x86_64
+	BENCHMARK(__fixsfti), BENCHMARK(__fixdfti), BENCHMARK(__fixunssfti),
+	BENCHMARK(__fixunsdfti), BENCHMARK(__floattisf), BENCHMARK(__floattidf),
+	BENCHMARK(__floatuntisf), BENCHMARK(__floatuntidf),
+#endif
+	BENCHMARK(__eqsf2), BENCHMARK(__lesf2), BENCHMARK(__ltsf2),
+	BENCHMARK(__gesf2), BENCHMARK(__unordsf2), BENCHMARK(__eqdf2),
+	BENCHMARK(__ledf2), BENCHMARK(__ltdf2), BENCHMARK(__gedf2),
+	BENCHMARK(__unorddf2),
+	BENCHMARK(__cmpdi2), BENCHMARK(__ucmpdi2),
+#if __x86_64
+	BENCHMARK(__cmpti2), BENCHMARK(__ucmpti2),
+#endif
+	BENCHMARK(__mulsc3), BENCHMARK(__divsc3), BENCHMARK(__muldc3),
+	BENCHMARK(__divdc3),
+#if !_ARCH_PPC
+	BENCHMARK(__mulxc3), BENCHMARK(__divxc3),
+#endif
+#if __arm__ && __VFP_FP__
+	BENCHMARK(__addsf3vfp), BENCHMARK(__subsf3vfp), BENCHMARK(__mulsf3vfp),
+	BENCHMARK(__divsf3vfp), BENCHMARK(__adddf3vfp), BENCHMARK(__subdf3vfp),
+	BENCHMARK(__muldf3vfp), BENCHMARK(__divdf3vfp),
+	BENCHMARK(__extendsfdf2vfp), BENCHMARK(__truncdfsf2vfp),
+	BENCHMARK(__fixsfsivfp), BENCHMARK(__fixdfsivfp),
+	BENCHMARK(__floatsisfvfp), BENCHMARK(__floatsidfvfp),
+	BENCHMARK(__eqsf2vfp), BENCHMARK(__ltsf2vfp),
+	BENCHMARK(__eqdf2vfp), BENCHMARK(__ltdf2vfp),
+#endif
+#endif // TF_ONLY
+#if HAS_TF_MODE
+	BENCHMARK(__addtf3), BENCHMARK(__subtf3), BENCHMARK(__multf3),
+	BENCHMARK(__divtf3), BENCHMARK(__eqtf2), BENCHMARK(__lttf2),
+	BENCHMARK(__getf2), BENCHMARK(__unordtf2),
+	BENCHMARK(__extendsftf2), BENCHMARK(__extenddftf2),
+	BENCHMARK(__trunctfsf2), BENCHMARK(__trunctfdf2),
+	BENCHMARK(__fixtfsi), BENCHMARK(__fixtfdi), BENCHMARK(__fixunstfsi),
+	BENCHMARK(__fixunstfdi), BENCHMARK(__floatsitf), BENCHMARK(__floatditf),
+	BENCHMARK(__floatunsitf), BENCHMARK(__floatunditf),
+#endif
+};
+
+static int selected(const char *name, int argc, char *argv[], int first) {
+	int i;
+	if (first == argc)
+		return 1;
+	for (i = first; i < argc; ++i)
+		if (strstr(name, argv[i]))
+			return 1;
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	int first = 1, onlyDistribution = -1;
+	unsigned i;
+	int d;
+
+	if (argc > 2 && !strcmp(argv[1], "-o")) {
+		for (d = RANDOM; d <= EDGE; ++d)
+			if (!strcmp(argv[2], distributionNames[d]))
+				onlyDistribution = d;
+		if (onlyDistribution == -1) {
+			fprintf(stderr, "usage: %s [-o random|edge] [name-substring...]\n",
+			        argv[0]);
+			return 1;
+		}
+		first = 3;
+	}
+
+	printf("# %s, %s per call\n", LIBSTRING, TIMING_UNIT);
+	printf("function,operands,time\n");
+	for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i) {
+		if (!selected(benchmarks[i].name, argc, argv, first))
+			continue;
+		for (d = RANDOM; d <= EDGE; ++d) {
+			if (onlyDistribution != -1 && d != onlyDistribution)
+				continue;
+			// The same operands for every library.
+			randomState = 88172645463325252ULL;
+			edgeIndex = 0;
+			printf("%s,%s,%.2f\n", benchmarks[i].name, distributionNames[d],
+			       benchmarks[i].time((enum distribution)d));
+		}
+	}
+	return 0;
+}
@@ -1,7 +1,12 @@
-#include <mach/mach_time.h>
 #include <stdint.h>
 #include <stdlib.h>
 
+#if __APPLE__
+
+#include <mach/mach_time.h>
+
+#define TIMING_UNIT "cycles"
+
 double intervalInCycles( uint64_t startTime, uint64_t endTime )
 {
 	uint64_t rawTime = endTime - startTime;
@@ -26,3 +31,42 @@ double intervalInCycles( uint64_t startTime, uint64_t endTime )
 	return (double) rawTime * conversion;
 }
 
+#elif defined(__i386__) || defined(__x86_64__)
+
+// Time stamp counter ticks, which run at the nominal frequency of the CPU.
+#define TIMING_UNIT "cycles"
+
+static inline uint64_t mach_absolute_time(void)
+{
+	uint32_t lo, hi;
+	// Keep the earlier instructions from being reordered past the read.
+	__asm__ __volatile__("lfence\n\trdtsc" : "=a"(lo), "=d"(hi) :: "memory");
+	return ((uint64_t)hi << 32) | lo;
+}
+
+double intervalInCycles( uint64_t startTime, uint64_t endTime )
+{
+	return (double)(endTime - startTime);
+}
+
+#else
+
+#include <time.h>
+
+// There is no portable cycle counter, so the other targets report
+// nanoseconds.
+#define TIMING_UNIT "ns"
+
+static inline uint64_t mach_absolute_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+double intervalInCycles( uint64_t startTime, uint64_t endTime )
+{
+	return (double)(endTime - startTime);
+}
+
+#endif